@@ -25,6 +25,7 @@
 #include "FileInformation.h"
 #include "SurfaceFile.h"
 #include "MetricFile.h"
+#include "RowBlockPipeline.h"
 #include "VolumeFile.h"
 
 #include <fstream>
@@ -254,27 +255,29 @@ AlgorithmCiftiAverageDenseROI::AlgorithmCiftiAverageDenseROI(ProgressObject* myP
     {
         verifyVolumeComponent(ciftiList[0], volROI);
     }
-    vector<vector<double> > accum(numMaps, vector<double>(rowSize, 0.0));
+    WeightedRows rowList;
     vector<double> denom(numMaps, 0.0);
     for (int i = 0; i < numCifti; ++i)
     {
         if (leftROI != NULL)
         {
-            processSurfaceComponent(accum, denom, ciftiList[i], StructureEnum::CORTEX_LEFT, leftROI, leftAreaPointer);
+            processSurfaceComponent(rowList, denom, ciftiList[i], StructureEnum::CORTEX_LEFT, leftROI, leftAreaPointer);
         }
         if (rightROI != NULL)
         {
-            processSurfaceComponent(accum, denom, ciftiList[i], StructureEnum::CORTEX_RIGHT, rightROI, rightAreaPointer);
+            processSurfaceComponent(rowList, denom, ciftiList[i], StructureEnum::CORTEX_RIGHT, rightROI, rightAreaPointer);
         }
         if (cerebROI != NULL)
         {
-            processSurfaceComponent(accum, denom, ciftiList[i], StructureEnum::CEREBELLUM, cerebROI, cerebAreaPointer);
+            processSurfaceComponent(rowList, denom, ciftiList[i], StructureEnum::CEREBELLUM, cerebROI, cerebAreaPointer);
         }
         if (volROI != NULL)
         {
-            processVolumeComponent(accum, denom, ciftiList[i], volROI);
+            processVolumeComponent(rowList, denom, ciftiList[i], volROI);
         }
     }
+    vector<vector<double> > accum(numMaps, vector<double>(rowSize, 0.0));
+    sumWeightedRows(accum, rowList);
     CiftiXML newXml;
     newXml.setNumberOfDimensions(2);
     newXml.setMap(CiftiXML::ALONG_COLUMN, *(baseXML.getMap(CiftiXML::ALONG_ROW)));
@@ -349,12 +352,14 @@ AlgorithmCiftiAverageDenseROI::AlgorithmCiftiAverageDenseROI(ProgressObject* myP
         if (!thisXML.approximateMatch(baseXML)) throw AlgorithmException("cifti files do not match between #1 and #" + AString::number(i + 1));
     }
     int numMaps = roiXML.getDimensionLength(CiftiXML::ALONG_ROW);
-    vector<vector<double> > accum(numMaps, vector<double>(rowSize, 0.0));
+    WeightedRows rowList;
     vector<double> denom(numMaps, 0.0);
     for (int i = 0; i < numCifti; ++i)
     {
-        processCifti(accum, denom, ciftiList[i], ciftiROI, leftAreaPointer, rightAreaPointer, cerebAreaPointer);
+        processCifti(rowList, denom, ciftiList[i], ciftiROI, leftAreaPointer, rightAreaPointer, cerebAreaPointer);
     }
+    vector<vector<double> > accum(numMaps, vector<double>(rowSize, 0.0));
+    sumWeightedRows(accum, rowList);
     CiftiXML newXml;
     newXml.setNumberOfDimensions(2);
     newXml.setMap(CiftiXML::ALONG_COLUMN, *(baseXML.getMap(CiftiXML::ALONG_ROW)));
@@ -398,7 +403,7 @@ void AlgorithmCiftiAverageDenseROI::verifySurfaceComponent(const CiftiFile* myCi
     }
 }
 
-void AlgorithmCiftiAverageDenseROI::processSurfaceComponent(vector<vector<double> >& accum, vector<double>& denom, const CiftiFile* myCifti, const StructureEnum::Enum& myStruct, const MetricFile* myRoi, const float* myAreas)
+void AlgorithmCiftiAverageDenseROI::processSurfaceComponent(WeightedRows& rowList, vector<double>& denom, const CiftiFile* myCifti, const StructureEnum::Enum& myStruct, const MetricFile* myRoi, const float* myAreas)
 {
     const CiftiXML& myXml = myCifti->getCiftiXML();
     CaretAssert(myXml.getMappingType(CiftiXML::ALONG_COLUMN) == CiftiMappingType::BRAIN_MODELS);//should be checked in the algorithm constructor
@@ -408,59 +413,36 @@ void AlgorithmCiftiAverageDenseROI::processSurfaceComponent(vector<vector<double
         return;
     }
     if (myRoi->getNumberOfNodes() != brainModelsMap.getSurfaceNumberOfNodes(myStruct)) throw AlgorithmException("cifti number of vertices does not match roi");
-    int rowSize = myXml.getDimensionLength(CiftiXML::ALONG_ROW);
-    vector<float> rowScratch(rowSize);
-    CaretAssert(rowScratch.size() == accum[0].size());
     vector<CiftiBrainModelsMap::SurfaceMap> myMap = brainModelsMap.getSurfaceMap(myStruct);
     int mapSize = (int)myMap.size();
     int numMaps = myRoi->getNumberOfMaps();
-    if (myAreas == NULL)
+    CaretAssert(numMaps == (int)denom.size());
+    vector<float> weights(numMaps);
+    for (int i = 0; i < mapSize; ++i)
     {
-        for (int i = 0; i < mapSize; ++i)
+        const int& myNode = myMap[i].m_surfaceNode;
+        bool used = false;
+        for (int m = 0; m < numMaps; ++m)
         {
-            const int& myNode = myMap[i].m_surfaceNode;
-            bool dataLoaded = false;
-            for (int m = 0; m < numMaps; ++m)
+            const float roiVal = myRoi->getValue(myNode, m);
+            weights[m] = 0.0f;
+            if (roiVal != 0.0f)
             {
-                const float roiVal = myRoi->getValue(myNode, m);
-                if (roiVal != 0.0f)
+                if (myAreas == NULL)
                 {
-                    if (!dataLoaded)
-                    {
-                        myCifti->getRow(rowScratch.data(), myMap[i].m_ciftiIndex);
-                        dataLoaded = true;
-                    }
-                    for (int j = 0; j < rowSize; ++j)
-                    {
-                        accum[m][j] += rowScratch[j] * roiVal;
-                    }
-                    denom[m] += roiVal;
+                    weights[m] = roiVal;
+                } else {
+                    weights[m] = roiVal * myAreas[myNode];
                 }
+                denom[m] += weights[m];
+                used = true;
             }
         }
-    } else {
-        for (int i = 0; i < mapSize; ++i)
+        if (used)
         {
-            const int& myNode = myMap[i].m_surfaceNode;
-            bool dataLoaded = false;
-            for (int m = 0; m < numMaps; ++m)
-            {
-                const float& roiVal = myRoi->getValue(myNode, m);
-                if (roiVal != 0.0f)
-                {
-                    const float weight = roiVal * myAreas[myMap[i].m_surfaceNode];
-                    if (!dataLoaded)
-                    {
-                        myCifti->getRow(rowScratch.data(), myMap[i].m_ciftiIndex);
-                        dataLoaded = true;
-                    }
-                    for (int j = 0; j < rowSize; ++j)
-                    {
-                        accum[m][j] += rowScratch[j] * weight;
-                    }
-                    denom[m] += weight;
-                }
-            }
+            rowList.m_files.push_back(myCifti);
+            rowList.m_rows.push_back(myMap[i].m_ciftiIndex);
+            rowList.m_weights.insert(rowList.m_weights.end(), weights.begin(), weights.end());
         }
     }
 }
@@ -473,52 +455,49 @@ void AlgorithmCiftiAverageDenseROI::verifyVolumeComponent(const CiftiFile* myCif
     if (!volROI->matchesVolumeSpace(brainModelsMap.getVolumeSpace())) throw AlgorithmException("cifti files don't match the ROI volume's space");
 }
 
-void AlgorithmCiftiAverageDenseROI::processVolumeComponent(vector<vector<double> >& accum, vector<double>& denom, const CiftiFile* myCifti, const VolumeFile* volROI)
+void AlgorithmCiftiAverageDenseROI::processVolumeComponent(WeightedRows& rowList, vector<double>& denom, const CiftiFile* myCifti, const VolumeFile* volROI)
 {
     const CiftiXML& myXml = myCifti->getCiftiXML();
     CaretAssert(myXml.getMappingType(CiftiXML::ALONG_COLUMN) == CiftiMappingType::BRAIN_MODELS);//should be checked in the algorithm constructor
     const CiftiBrainModelsMap& brainModelsMap = myXml.getBrainModelsMap(CiftiXML::ALONG_COLUMN);
     if (!volROI->matchesVolumeSpace(brainModelsMap.getVolumeSpace())) throw AlgorithmException("cifti files don't match the ROI volume's space");
-    int rowSize = myXml.getDimensionLength(CiftiXML::ALONG_ROW);
-    vector<float> rowScratch(rowSize);
-    CaretAssert(rowScratch.size() == accum[0].size());
     vector<CiftiBrainModelsMap::VolumeMap> myMap = brainModelsMap.getFullVolumeMap();
     int mapSize = (int)myMap.size();
     int numMaps = volROI->getNumberOfMaps();
+    CaretAssert(numMaps == (int)denom.size());
+    vector<float> weights(numMaps);
     for (int i = 0; i < mapSize; ++i)
     {
-        bool dataLoaded = false;
+        bool used = false;
         if (!volROI->indexValid(myMap[i].m_ijk)) throw AlgorithmException("cifti file lists invalid voxels");
         for (int m = 0; m < numMaps; ++m)
         {
-            const float& roiVal = volROI->getValue(myMap[i].m_ijk, m);
-            if (roiVal != 0.0f)
+            weights[m] = volROI->getValue(myMap[i].m_ijk, m);
+            if (weights[m] != 0.0f)
             {
-                if (!dataLoaded)
-                {
-                    myCifti->getRow(rowScratch.data(), myMap[i].m_ciftiIndex);
-                    dataLoaded = true;
-                }
-                for (int j = 0; j < rowSize; ++j)
-                {
-                    accum[m][j] += rowScratch[j] * roiVal;
-                }
-                denom[m] += roiVal;
+                denom[m] += weights[m];
+                used = true;
             }
         }
+        if (used)
+        {
+            rowList.m_files.push_back(myCifti);
+            rowList.m_rows.push_back(myMap[i].m_ciftiIndex);
+            rowList.m_weights.insert(rowList.m_weights.end(), weights.begin(), weights.end());
+        }
     }
 }
 
-void AlgorithmCiftiAverageDenseROI::processCifti(vector<vector<double> >& accum, vector<double>& denom, const CiftiFile* myCifti, const CiftiFile* ciftiROI,
+void AlgorithmCiftiAverageDenseROI::processCifti(WeightedRows& rowList, vector<double>& denom, const CiftiFile* myCifti, const CiftiFile* ciftiROI,
                                                  const float* leftAreas, const float* rightAreas, const float* cerebAreas)
 {
     const CiftiXML& myXml = myCifti->getCiftiXML();//same along columns for data and roi, we already checked
     CaretAssert(myXml.getMappingType(CiftiXML::ALONG_COLUMN) == CiftiMappingType::BRAIN_MODELS);//should be checked in the algorithm constructor
     const CiftiBrainModelsMap& brainModelsMap = myXml.getBrainModelsMap(CiftiXML::ALONG_COLUMN);
-    int rowSize = myXml.getDimensionLength(CiftiXML::ALONG_ROW);
     vector<StructureEnum::Enum> surfList = brainModelsMap.getSurfaceStructureList();
     int numMaps = ciftiROI->getNumberOfColumns();
-    vector<float> dataScratch(rowSize), roiScratch(numMaps);
+    CaretAssert(numMaps == (int)denom.size());
+    vector<float> roiScratch(numMaps);
     for (int s = 0; s < (int)surfList.size(); ++s)
     {
         const float* myAreas = NULL;
@@ -538,54 +517,27 @@ void AlgorithmCiftiAverageDenseROI::processCifti(vector<vector<double> >& accum,
         }
         vector<CiftiBrainModelsMap::SurfaceMap> myMap = brainModelsMap.getSurfaceMap(surfList[s]);
         int mapSize = (int)myMap.size();
-        if (myAreas != NULL)
+        for (int i = 0; i < mapSize; ++i)
         {
-            for (int i = 0; i < mapSize; ++i)
+            ciftiROI->getRow(roiScratch.data(), myMap[i].m_ciftiIndex);
+            bool used = false;
+            for (int m = 0; m < numMaps; ++m)//ROI maps, not cifti mapping
             {
-                ciftiROI->getRow(roiScratch.data(), myMap[i].m_ciftiIndex);
-                const float& thisArea = myAreas[myMap[i].m_surfaceNode];
-                bool dataLoaded = false;
-                for (int m = 0; m < numMaps; ++m)//ROI maps, not cifti mapping
+                if (roiScratch[m] != 0.0f)
                 {
-                    const float& roiValue = roiScratch[m];
-                    if (roiValue != 0.0f)
+                    if (myAreas != NULL)
                     {
-                        if (!dataLoaded)
-                        {
-                            myCifti->getRow(dataScratch.data(), i);
-                            dataLoaded = true;
-                        }
-                        const float weight = roiValue * thisArea;
-                        for (int j = 0; j < rowSize; ++j)
-                        {
-                            accum[m][j] += dataScratch[j] * weight;
-                        }
-                        denom[m] += weight;
+                        roiScratch[m] *= myAreas[myMap[i].m_surfaceNode];
                     }
+                    denom[m] += roiScratch[m];
+                    used = true;
                 }
             }
-        } else {
-            for (int i = 0; i < mapSize; ++i)
+            if (used)
             {
-                ciftiROI->getRow(roiScratch.data(), myMap[i].m_ciftiIndex);
-                bool dataLoaded = false;
-                for (int m = 0; m < numMaps; ++m)//ROI maps, not cifti mapping
-                {
-                    const float& roiValue = roiScratch[m];
-                    if (roiValue != 0.0f)
-                    {
-                        if (!dataLoaded)
-                        {
-                            myCifti->getRow(dataScratch.data(), i);
-                            dataLoaded = true;
-                        }
-                        for (int j = 0; j < rowSize; ++j)
-                        {
-                            accum[m][j] += dataScratch[j] * roiValue;
-                        }
-                        denom[m] += roiValue;
-                    }
-                }
+                rowList.m_files.push_back(myCifti);
+                rowList.m_rows.push_back(myMap[i].m_ciftiIndex);
+                rowList.m_weights.insert(rowList.m_weights.end(), roiScratch.begin(), roiScratch.end());
             }
         }
     }
@@ -594,25 +546,86 @@ void AlgorithmCiftiAverageDenseROI::processCifti(vector<vector<double> >& accum,
     for (int i = 0; i < mapSize; ++i)
     {
         ciftiROI->getRow(roiScratch.data(), myMap[i].m_ciftiIndex);
-        bool dataLoaded = false;
+        bool used = false;
         for (int m = 0; m < numMaps; ++m)//ROI maps, not cifti mapping
         {
-            const float& roiValue = roiScratch[m];
-            if (roiValue != 0.0f)
+            if (roiScratch[m] != 0.0f)
             {
-                if (!dataLoaded)
-                {
-                    myCifti->getRow(dataScratch.data(), i);
-                    dataLoaded = true;
-                }
-                for (int j = 0; j < rowSize; ++j)
+                denom[m] += roiScratch[m];
+                used = true;
+            }
+        }
+        if (used)
+        {
+            rowList.m_files.push_back(myCifti);
+            rowList.m_rows.push_back(myMap[i].m_ciftiIndex);
+            rowList.m_weights.insert(rowList.m_weights.end(), roiScratch.begin(), roiScratch.end());
+        }
+    }
+}
+
+namespace
+{
+    ///reads the rows in order, and adds them into the accumulators, split by column so each accumulator element is summed in the same order as reading one row at a time
+    class WeightedSumProcessor : public RowBlockPipeline::Processor
+    {
+        vector<vector<double> >& m_accum;
+        const vector<const CiftiFile*>& m_files;
+        const vector<int64_t>& m_rows;
+        const vector<float>& m_weights;
+        int64_t m_rowSize, m_numMaps;
+        vector<float> m_data[RowBlockPipeline::NUM_SLOTS];
+    public:
+        WeightedSumProcessor(vector<vector<double> >& accum, const vector<const CiftiFile*>& files, const vector<int64_t>& rows, const vector<float>& weights) :
+            m_accum(accum), m_files(files), m_rows(rows), m_weights(weights)
+        {
+            CaretAssert(accum.size() > 0);
+            m_numMaps = (int64_t)accum.size();
+            m_rowSize = (int64_t)accum[0].size();
+            CaretAssert(files.size() == rows.size() && (int64_t)weights.size() == (int64_t)rows.size() * m_numMaps);
+        }
+        int64_t getBytesPerItem() const { return m_rowSize * sizeof(float); }
+        void readBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            m_data[slot].resize(numItems * m_rowSize);
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                m_files[firstItem + i]->getRow(m_data[slot].data() + i * m_rowSize, m_rows[firstItem + i]);
+            }
+        }
+        void processBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot, const int& part, const int& numParts)
+        {
+            int64_t start, end;
+            RowBlockPipeline::getPartRange(m_rowSize, part, numParts, start, end);
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                const float* row = m_data[slot].data() + i * m_rowSize;
+                const float* rowWeights = m_weights.data() + (firstItem + i) * m_numMaps;
+                for (int64_t m = 0; m < m_numMaps; ++m)
                 {
-                    accum[m][j] += dataScratch[j] * roiValue;
+                    const float weight = rowWeights[m];
+                    if (weight != 0.0f)
+                    {
+                        double* accumRow = m_accum[m].data();
+                        for (int64_t j = start; j < end; ++j)
+                        {
+                            accumRow[j] += row[j] * weight;
+                        }
+                    }
                 }
-                denom[m] += roiValue;
             }
         }
-    }
+        void writeBlock(const int64_t&, const int64_t&, const int&)
+        {//output is written after all inputs are summed
+        }
+    };
+}
+
+void AlgorithmCiftiAverageDenseROI::sumWeightedRows(vector<vector<double> >& accum, const WeightedRows& rowList)
+{
+    WeightedSumProcessor myProcessor(accum, rowList.m_files, rowList.m_rows, rowList.m_weights);
+    const int64_t numRows = (int64_t)rowList.m_rows.size();
+    RowBlockPipeline::run(myProcessor, numRows, RowBlockPipeline::getItemsPerBlock(myProcessor.getBytesPerItem(), numRows));
 }
 
 float AlgorithmCiftiAverageDenseROI::getAlgorithmInternalWeight()
@@ -24,6 +24,7 @@
 #include "AbstractAlgorithm.h"
 #include "StructureEnum.h"
 
+#include <stdint.h>
 #include <vector>
 
 namespace caret {
@@ -31,13 +32,21 @@ namespace caret {
     class AlgorithmCiftiAverageDenseROI : public AbstractAlgorithm
     {
         AlgorithmCiftiAverageDenseROI();
+        ///the input rows that are in any roi, in the order they are summed, with the weight for each roi map
+        struct WeightedRows
+        {
+            std::vector<const CiftiFile*> m_files;
+            std::vector<int64_t> m_rows;
+            std::vector<float> m_weights;//numMaps per row
+        };
         void verifySurfaceComponent(const CiftiFile* myCifti, const StructureEnum::Enum& myStruct, const MetricFile* myRoi);
-        void processSurfaceComponent(std::vector<std::vector<double> >& accum, std::vector<double>& denom, const CiftiFile* myCifti,
+        void processSurfaceComponent(WeightedRows& rowList, std::vector<double>& denom, const CiftiFile* myCifti,
                                      const StructureEnum::Enum& myStruct, const MetricFile* myRoi, const float* myAreas);
         void verifyVolumeComponent(const CiftiFile* myCifti, const VolumeFile* volROI);
-        void processVolumeComponent(std::vector<std::vector<double> >& accum, std::vector<double>& denom, const CiftiFile* myCifti, const VolumeFile* volROI);
-        void processCifti(std::vector<std::vector<double> >& accum, std::vector<double>& denom, const CiftiFile* myCifti, const CiftiFile* ciftiROI,
+        void processVolumeComponent(WeightedRows& rowList, std::vector<double>& denom, const CiftiFile* myCifti, const VolumeFile* volROI);
+        void processCifti(WeightedRows& rowList, std::vector<double>& denom, const CiftiFile* myCifti, const CiftiFile* ciftiROI,
                                     const float* leftAreas, const float* rightAreas, const float* cerebAreas);
+        void sumWeightedRows(std::vector<std::vector<double> >& accum, const WeightedRows& rowList);
     protected:
         static float getSubAlgorithmWeight();
         static float getAlgorithmInternalWeight();
@@ -30,7 +30,7 @@
 #include "CaretOMP.h"
 #include "FileInformation.h"
 #include "CaretPointer.h"
-#include "dot_wrapper.h"
+#include "BlockedDot.h"
 #include <fstream>
 #include <utility>
 #include <algorithm>
@@ -38,6 +38,12 @@
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    const int MOVING_BLOCK = 4 * BlockedDot::TILE_ROWS;//rows read together and multiplied against the cached rows as one block
+    const int CHUNK_PANEL = 64 * BlockedDot::TILE_ROWS;//cached rows per multiply, keeps the per-thread result buffer small
+}
+
 AString AlgorithmCiftiCorrelation::getCommandSwitch()
 {
     return "-cifti-correlation";
@@ -223,11 +229,14 @@ AlgorithmCiftiCorrelation::AlgorithmCiftiCorrelation(ProgressObject* myProgObj,
             cacheRow(i);
         }
     }
+    vector<int> chunkRows;
+    CaretArray<int> chunkPosition(numRows, -1);
     for (int startrow = 0; startrow < numRows; startrow += numCacheRows)
     {
         int endrow = startrow + numCacheRows;
         if (endrow > numRows) endrow = numRows;
         outRows.resize(endrow - startrow);
+        chunkRows.resize(endrow - startrow);
         for (int i = startrow; i < endrow; ++i)
         {
             if (!cacheFullInput)
@@ -238,41 +247,14 @@ AlgorithmCiftiCorrelation::AlgorithmCiftiCorrelation(ProgressObject* myProgObj,
             {
                 outRows[i - startrow] = CaretArray<float>(numRows);
             }
+            chunkRows[i - startrow] = i;
+            chunkPosition[i] = i - startrow;
         }
-        int curRow = 0;//because we can't trust the order threads hit the critical section
-#pragma omp CARET_PARFOR schedule(dynamic)
-        for (int i = 0; i < numRows; ++i)
-        {
-            float movingRrs;
-            int myrow;
-            const float* movingRow;
-#pragma omp critical
-            {//CiftiFile may explode if we request multiple rows concurrently (needs mutexes), but we should force sequential requests anyway
-                myrow = curRow;//so, manually force it to read sequentially
-                ++curRow;
-                movingRow = getRow(myrow, movingRrs);
-            }
-            for (int j = startrow; j < endrow; ++j)
-            {
-                if (myrow >= startrow && myrow < endrow)//check whether we are in the output memory area
-                {
-                    if (j >= myrow)//if so, only compute one half, and store both places
-                    {
-                        float cacheRrs;
-                        const float* cacheRow = getRow(j, cacheRrs, true);
-                        outRows[j - startrow][myrow] = correlate(movingRow, movingRrs, cacheRow, cacheRrs, fisherZ);
-                        outRows[myrow - startrow][j] = outRows[j - startrow][myrow];
-                    }
-                } else {
-                    float cacheRrs;
-                    const float* cacheRow = getRow(j, cacheRrs, true);
-                    outRows[j - startrow][myrow] = correlate(movingRow, movingRrs, cacheRow, cacheRrs, fisherZ);
-                }
-            }
-        }
+        processChunk(chunkRows, chunkPosition, outRows, fisherZ);
         for (int i = startrow; i < endrow; ++i)
         {
             myCiftiOut->setRow(outRows[i - startrow], i);
+            chunkPosition[i] = -1;
         }
         if (!cacheFullInput)
         {
@@ -409,13 +391,14 @@ AlgorithmCiftiCorrelation::AlgorithmCiftiCorrelation(ProgressObject* myProgObj,
             cacheRow(i);
         }
     }
-    CaretArray<int> indexReverse(numRows, -1);
+    vector<int> chunkRows;
+    CaretArray<int> chunkPosition(numRows, -1);
     for (int startrow = 0; startrow < numSelected; startrow += numCacheRows)
     {
         int endrow = startrow + numCacheRows;
         if (endrow > numSelected) endrow = numSelected;
         outRows.resize(endrow - startrow);
-        int curRow = 0;//because we can't trust the order threads hit the critical section
+        chunkRows.resize(endrow - startrow);
         for (int i = startrow; i < endrow; ++i)
         {
             if (!cacheFullInput)
@@ -426,42 +409,14 @@ AlgorithmCiftiCorrelation::AlgorithmCiftiCorrelation(ProgressObject* myProgObj,
             {
                 outRows[i - startrow] = CaretArray<float>(numRows);
             }
-            indexReverse[ciftiIndexList[i].first] = i;
-        }
-#pragma omp CARET_PARFOR schedule(dynamic)
-        for (int i = 0; i < numRows; ++i)
-        {
-            float movingRrs;
-            int myrow;
-            const float* movingRow;
-#pragma omp critical
-            {//CiftiFile may explode if we request multiple rows concurrently (needs mutexes), but we should force sequential requests anyway
-                myrow = curRow;//so, manually force it to read sequentially
-                ++curRow;
-                movingRow = getRow(myrow, movingRrs);
-            }
-            for (int j = startrow; j < endrow; ++j)
-            {
-                if (indexReverse[myrow] != -1)//check if we are on a row that is in the output memory range
-                {
-                    if (indexReverse[myrow] <= j)//if so, only compute one of the elements, then store it both places
-                    {
-                        float cacheRrs;
-                        const float* cacheRow = getRow(ciftiIndexList[j].first, cacheRrs, true);
-                        outRows[j - startrow][myrow] = correlate(movingRow, movingRrs, cacheRow, cacheRrs, fisherZ);
-                        outRows[indexReverse[myrow] - startrow][ciftiIndexList[j].first] = outRows[j - startrow][myrow];
-                    }
-                } else {
-                    float cacheRrs;
-                    const float* cacheRow = getRow(ciftiIndexList[j].first, cacheRrs, true);
-                    outRows[j - startrow][myrow] = correlate(movingRow, movingRrs, cacheRow, cacheRrs, fisherZ);
-                }
-            }
+            chunkRows[i - startrow] = ciftiIndexList[i].first;
+            chunkPosition[ciftiIndexList[i].first] = i - startrow;
         }
+        processChunk(chunkRows, chunkPosition, outRows, fisherZ);
         for (int i = startrow; i < endrow; ++i)
         {
             myCiftiOut->setRow(outRows[i - startrow], ciftiIndexList[i].second);
-            indexReverse[ciftiIndexList[i].first] = -1;
+            chunkPosition[ciftiIndexList[i].first] = -1;
         }
         if (!cacheFullInput)
         {
@@ -517,35 +472,103 @@ AlgorithmCiftiCorrelation::AlgorithmCiftiCorrelation(ProgressObject* myProgObj,
     AlgorithmCiftiCorrelation(myProgObj, myCifti, myCiftiOut, leftRoiPtr, rightRoiPtr, cerebRoiPtr, volRoiPtr, weights, fisherZ, memLimitGB, noDemean, covariance);//HACK: pass through our progress object
 }
 
-float AlgorithmCiftiCorrelation::correlate(const float* row1, const float& rrs1, const float* row2, const float& rrs2, const bool& fisherZ)
+void AlgorithmCiftiCorrelation::processChunk(const vector<int>& chunkRows, const CaretArray<int>& chunkPosition, vector<CaretArray<float> >& outRows, const bool& fisherZ)
+{//chunkRows are the cached rows whose output rows are in memory, chunkPosition is the reverse lookup (-1 for rows outside the chunk)
+    const int numRows = m_inputCifti->getNumberOfRows();
+    const int numChunk = (int)chunkRows.size();
+    const int dotLength = (m_weightedMode ? (int)m_weightIndexes.size() : m_numCols);//because we compacted the data in the row to not include any zero weights
+    vector<const float*> chunkPtrs(numChunk);
+    vector<float> chunkRrs(numChunk);
+    for (int i = 0; i < numChunk; ++i)
+    {
+        chunkPtrs[i] = getRow(chunkRows[i], chunkRrs[i], true);
+    }
+    const int numBlocks = (numRows + MOVING_BLOCK - 1) / MOVING_BLOCK;
+    int curRow = 0;//because we can't trust the order threads hit the critical section
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        const float* movingPtrs[MOVING_BLOCK];
+        float movingRrs[MOVING_BLOCK];
+        double dotResults[MOVING_BLOCK * CHUNK_PANEL];
+        int firstRow, blockSize;
+#pragma omp critical
+        {//CiftiFile may explode if we request multiple rows concurrently (needs mutexes), but we should force sequential requests anyway
+            firstRow = curRow;//so, manually force it to read sequentially
+            blockSize = min(MOVING_BLOCK, numRows - firstRow);
+            curRow += blockSize;
+            for (int i = 0; i < blockSize; ++i)
+            {
+                movingPtrs[i] = getRow(firstRow + i, movingRrs[i], false, i);
+            }
+        }
+        bool allInChunk = true;
+        int minMovingPos = numChunk;
+        for (int i = 0; i < blockSize; ++i)
+        {
+            int pos = chunkPosition[firstRow + i];
+            if (pos == -1)
+            {
+                allInChunk = false;
+            } else {
+                if (pos < minMovingPos) minMovingPos = pos;
+            }
+        }
+        for (int panelStart = 0; panelStart < numChunk; panelStart += CHUNK_PANEL)
+        {
+            int panelEnd = min(panelStart + CHUNK_PANEL, numChunk);
+            if (allInChunk && panelEnd <= minMovingPos) continue;//everything in this panel gets stored from the other side of the symmetry
+            BlockedDot::multiplyTransposed(movingPtrs, blockSize, chunkPtrs.data() + panelStart, panelEnd - panelStart, dotLength, dotResults, CHUNK_PANEL);
+            for (int i = 0; i < blockSize; ++i)
+            {
+                int myrow = firstRow + i;
+                int myPos = chunkPosition[myrow];
+                const double* dotRow = dotResults + i * CHUNK_PANEL;
+                for (int j = panelStart; j < panelEnd; ++j)
+                {
+                    if (myPos != -1)//check whether we are in the output memory area
+                    {
+                        if (j >= myPos)//if so, only compute one half, and store both places
+                        {
+                            outRows[j][myrow] = correlate(dotRow[j - panelStart], movingRrs[i], chunkRrs[j], myrow == chunkRows[j], fisherZ);
+                            outRows[myPos][chunkRows[j]] = outRows[j][myrow];
+                        }
+                    } else {
+                        outRows[j][myrow] = correlate(dotRow[j - panelStart], movingRrs[i], chunkRrs[j], false, fisherZ);
+                    }
+                }
+            }
+        }
+    }
+}
+
+float AlgorithmCiftiCorrelation::correlate(const double& dotProduct, const float& rrs1, const float& rrs2, const bool& sameRow, const bool& fisherZ)
 {
     double r;
-    if (row1 == row2 && !m_covariance)
+    if (sameRow && !m_covariance)
     {
         r = 1.0;//short circuit for same row
     } else {
         if (m_weightedMode)
         {
-            int numWeights = (int)m_weightIndexes.size();//because we compacted the data in the row to not include any zero weights
-            double accum = sddot(row1, row2, numWeights);//these have already had the weighted row means subtracted out, and weights applied
+            int numWeights = (int)m_weightIndexes.size();
             if (m_covariance)
             {
                 if (m_binaryWeights)
                 {
-                    r = accum / numWeights;
+                    r = dotProduct / numWeights;
                 } else {
-                    r = accum / rrs1;//NOTE: will equal rrs2 as it only depends on weights, and is not square root
+                    r = dotProduct / rrs1;//NOTE: will equal rrs2 as it only depends on weights, and is not square root
                 }
             } else {
-                r = accum / (rrs1 * rrs2);//as do these
+                r = dotProduct / (rrs1 * rrs2);//the rows have already had the weighted row means subtracted out, and weights applied
             }
         } else {
-            double accum = sddot(row1, row2, m_numCols);//these have already had the row means subtracted out
             if (m_covariance)
             {
-                r = accum / m_numCols;
+                r = dotProduct / m_numCols;
             } else {
-                r = accum / (rrs1 * rrs2);
+                r = dotProduct / (rrs1 * rrs2);//the rows have already had the row means subtracted out
             }
         }
     }
@@ -638,7 +661,7 @@ void AlgorithmCiftiCorrelation::clearCache()
     m_cacheUsed = 0;
 }
 
-const float* AlgorithmCiftiCorrelation::getRow(const int& ciftiIndex, float& rootResidSqr, const bool& mustBeCached)
+const float* AlgorithmCiftiCorrelation::getRow(const int& ciftiIndex, float& rootResidSqr, const bool& mustBeCached, const int& tempSlot)
 {
     float* ret;
     CaretAssertVectorIndex(m_rowInfo, ciftiIndex);
@@ -651,7 +674,7 @@ const float* AlgorithmCiftiCorrelation::getRow(const int& ciftiIndex, float& roo
         {
             throw AlgorithmException("something very bad happened, notify the developers");
         }
-        ret = getTempRow();
+        ret = getTempRow(tempSlot);
         m_inputCifti->getRow(ret, ciftiIndex);
         if (!m_rowInfo[ciftiIndex].m_haveCalculated)
         {
@@ -769,8 +792,9 @@ void AlgorithmCiftiCorrelation::doSubtract(float* row, const float& mean)
     }
 }
 
-float* AlgorithmCiftiCorrelation::getTempRow()
+float* AlgorithmCiftiCorrelation::getTempRow(const int& slot)
 {
+    CaretAssert(slot >= 0 && slot < MOVING_BLOCK);
 #ifdef CARET_OMP
     int oldsize = (int)m_tempRows.size();
     int threadNum = omp_get_thread_num();
@@ -779,17 +803,17 @@ float* AlgorithmCiftiCorrelation::getTempRow()
         m_tempRows.resize(threadNum + 1);
         for (int i = oldsize; i <= threadNum; ++i)
         {
-            m_tempRows[i] = CaretArray<float>(m_numCols);
+            m_tempRows[i] = CaretArray<float>(MOVING_BLOCK * (int64_t)m_numCols);
         }
     }
-    return m_tempRows[threadNum].getArray();
+    return m_tempRows[threadNum].getArray() + slot * (int64_t)m_numCols;
 #else
     if (m_tempRows.size() == 0)
     {
         m_tempRows.resize(1);
-        m_tempRows[0] = CaretArray<float>(m_numCols);
+        m_tempRows[0] = CaretArray<float>(MOVING_BLOCK * (int64_t)m_numCols);
     }
-    return m_tempRows[0].getArray();
+    return m_tempRows[0].getArray() + slot * (int64_t)m_numCols;
 #endif
 }
 
@@ -800,9 +824,9 @@ int AlgorithmCiftiCorrelation::numRowsForMem(const float& memLimitGB, bool& cach
     int64_t targetBytes = (int64_t)(memLimitGB * 1024 * 1024 * 1024);
     if (m_inputCifti->isInMemory()) targetBytes -= numRows * m_numCols * 4;//count in-memory input against the total too
 #ifdef CARET_OMP
-    targetBytes -= inrowBytes * omp_get_max_threads();
+    targetBytes -= inrowBytes * MOVING_BLOCK * omp_get_max_threads();
 #else
-    targetBytes -= inrowBytes;//1 row in memory that isn't a reference to cache
+    targetBytes -= inrowBytes * MOVING_BLOCK;//1 block of rows in memory that isn't a reference to cache
 #endif
     targetBytes -= numRows * sizeof(RowInfo);//storage for mean, stdev, and info about caching
     int64_t perRowBytes = inrowBytes + outrowBytes;//cache and memory collation for output rows
@@ -48,7 +48,7 @@ namespace caret {
         };
         std::vector<CacheRow> m_rowCache;
         std::vector<RowInfo> m_rowInfo;
-        std::vector<CaretArray<float> > m_tempRows;//reuse return values in getRow instead of reallocating
+        std::vector<CaretArray<float> > m_tempRows;//reuse return values in getRow instead of reallocating, one block of rows per thread
         std::vector<float> m_weights;
         std::vector<int> m_weightIndexes;
         bool m_binaryWeights, m_weightedMode, m_noDemean, m_covariance;
@@ -59,9 +59,10 @@ namespace caret {
         void computeRowStats(const float* row, float& mean, float& rootResidSqr);
         void doSubtract(float* row, const float& mean);
         void clearCache();
-        const float* getRow(const int& ciftiIndex, float& rootResidSqr, const bool& mustBeCached = false);
-        float* getTempRow();
-        float correlate(const float* row1, const float& rrs1, const float* row2, const float& rrs2, const bool& fisherZ);
+        const float* getRow(const int& ciftiIndex, float& rootResidSqr, const bool& mustBeCached = false, const int& tempSlot = 0);
+        float* getTempRow(const int& slot);
+        float correlate(const double& dotProduct, const float& rrs1, const float& rrs2, const bool& sameRow, const bool& fisherZ);
+        void processChunk(const std::vector<int>& chunkRows, const CaretArray<int>& chunkPosition, std::vector<CaretArray<float> >& outRows, const bool& fisherZ);
         void init(const CiftiFile* input, const std::vector<float>* weights, const bool& noDemean, const bool& covariance);
         int numRowsForMem(const float& memLimitGB, bool& cacheFullInput);
     protected:
@@ -26,6 +26,7 @@
 #include "CiftiFile.h"
 #include "LabelFile.h"
 #include "MetricFile.h"
+#include "RowBlockPipeline.h"
 #include "VolumeFile.h"
 
 using namespace caret;
@@ -80,6 +81,97 @@ void AlgorithmCiftiMergeDense::useParameters(OperationParameters* myParams, Prog
     AlgorithmCiftiMergeDense(myProgObj, myDir, ciftiList, myCiftiOut);
 }
 
+namespace
+{
+    ///copies data of non-label inputs to the merged output
+    ///for ALONG_ROW, an item is an output row, made from the same row of every input, otherwise an item is one row of one input
+    class MergeProcessor : public RowBlockPipeline::Processor
+    {
+        const vector<const CiftiFile*>& m_inputs;
+        CiftiFile* m_output;
+        int m_direction;
+        const vector<int>& m_sources;//input file of each copied index
+        const vector<int64_t>& m_inIndices, & m_outIndices;
+        vector<int64_t> m_inOffsets;//for ALONG_ROW, where each input's row starts in the slot
+        int64_t m_inLength, m_outLength;
+        vector<float> m_inData[RowBlockPipeline::NUM_SLOTS], m_outData[RowBlockPipeline::NUM_SLOTS];
+    public:
+        MergeProcessor(const vector<const CiftiFile*>& inputs, CiftiFile* output, const int& direction,
+                       const vector<int>& sources, const vector<int64_t>& inIndices, const vector<int64_t>& outIndices) :
+            m_inputs(inputs), m_sources(sources), m_inIndices(inIndices), m_outIndices(outIndices)
+        {
+            m_output = output;
+            m_direction = direction;
+            CaretAssert(sources.size() == inIndices.size() && sources.size() == outIndices.size());
+            m_outLength = output->getNumberOfColumns();
+            if (direction == CiftiXMLOld::ALONG_ROW)
+            {
+                m_inOffsets.resize(inputs.size());
+                m_inLength = 0;
+                for (int i = 0; i < (int)inputs.size(); ++i)
+                {
+                    m_inOffsets[i] = m_inLength;
+                    m_inLength += inputs[i]->getNumberOfColumns();
+                }
+                CaretAssert((int64_t)sources.size() == m_outLength);//every output column comes from some input
+            } else {
+                m_inLength = m_outLength;
+            }
+        }
+        int64_t getNumberOfItems() const
+        {
+            if (m_direction == CiftiXMLOld::ALONG_ROW) return m_output->getNumberOfRows();
+            return (int64_t)m_sources.size();
+        }
+        int64_t getBytesPerItem() const { return (m_inLength + m_outLength) * sizeof(float); }
+        void readBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            m_inData[slot].resize(numItems * m_inLength);
+            if (m_direction == CiftiXMLOld::ALONG_ROW) m_outData[slot].resize(numItems * m_outLength);
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                float* inRow = m_inData[slot].data() + i * m_inLength;
+                if (m_direction == CiftiXMLOld::ALONG_ROW)
+                {
+                    for (int f = 0; f < (int)m_inputs.size(); ++f)
+                    {
+                        m_inputs[f]->getRow(inRow + m_inOffsets[f], firstItem + i);
+                    }
+                } else {
+                    m_inputs[m_sources[firstItem + i]]->getRow(inRow, m_inIndices[firstItem + i]);
+                }
+            }
+        }
+        void processBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot, const int& part, const int& numParts)
+        {
+            if (m_direction != CiftiXMLOld::ALONG_ROW) return;//rows are copied unchanged
+            int64_t start, end;
+            RowBlockPipeline::getPartRange(numItems, part, numParts, start, end);
+            for (int64_t i = start; i < end; ++i)
+            {
+                const float* inRow = m_inData[slot].data() + i * m_inLength;
+                float* outRow = m_outData[slot].data() + i * m_outLength;
+                for (int64_t k = 0; k < (int64_t)m_sources.size(); ++k)
+                {
+                    outRow[m_outIndices[k]] = inRow[m_inOffsets[m_sources[k]] + m_inIndices[k]];
+                }
+            }
+        }
+        void writeBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                if (m_direction == CiftiXMLOld::ALONG_ROW)
+                {
+                    m_output->setRow(m_outData[slot].data() + i * m_outLength, firstItem + i);
+                } else {
+                    m_output->setRow(m_inData[slot].data() + i * m_inLength, m_outIndices[firstItem + i]);
+                }
+            }
+        }
+    };
+}
+
 AlgorithmCiftiMergeDense::AlgorithmCiftiMergeDense(ProgressObject* myProgObj, const int& myDir, const vector<const CiftiFile*>& ciftiList, CiftiFile* myCiftiOut) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
@@ -169,6 +261,8 @@ AlgorithmCiftiMergeDense::AlgorithmCiftiMergeDense(ProgressObject* myProgObj, co
     }
     CaretAssert((int)sourceCifti.size() == outXML.getNumberOfBrainModels(myDir));
     myCiftiOut->setCiftiXML(outXML);
+    vector<int> copySources;//for non-label data, which input index goes to which output index
+    vector<int64_t> copyInIndices, copyOutIndices;
     for (int i = 0; i < (int)sourceCifti.size(); ++i)
     {
         CiftiBrainModelInfo myInfo = outXML.getBrainModelInfo(myDir, i);
@@ -187,27 +281,12 @@ AlgorithmCiftiMergeDense::AlgorithmCiftiMergeDense(ProgressObject* myProgObj, co
                     outXML.getSurfaceMap(myDir, outMap, myInfo.m_structure);
                     otherXML.getSurfaceMap(myDir, inMap, myInfo.m_structure);
                     CaretAssert(inMap.size() == outMap.size());
-                    vector<float> rowscratch(outXML.getNumberOfColumns()), otherscratch(otherXML.getNumberOfColumns());
-                    if (myDir == CiftiXMLOld::ALONG_ROW)
+                    for (int k = 0; k < (int)inMap.size(); ++k)
                     {
-                        for (int j = 0; j < outXML.getNumberOfRows(); ++j)
-                        {
-                            myCiftiOut->getRow(rowscratch.data(), j, true);
-                            ciftiList[sourceCifti[i]]->getRow(otherscratch.data(), j);
-                            for (int k = 0; k < (int)inMap.size(); ++k)
-                            {
-                                CaretAssert(inMap[k].m_surfaceNode == outMap[k].m_surfaceNode);
-                                rowscratch[outMap[k].m_ciftiIndex] = otherscratch[inMap[k].m_ciftiIndex];
-                            }
-                            myCiftiOut->setRow(rowscratch.data(), j);
-                        }
-                    } else {
-                        for (int k = 0; k < (int)inMap.size(); ++k)
-                        {
-                            CaretAssert(inMap[k].m_surfaceNode == outMap[k].m_surfaceNode);
-                            ciftiList[sourceCifti[i]]->getRow(otherscratch.data(), inMap[k].m_ciftiIndex);
-                            myCiftiOut->setRow(otherscratch.data(), outMap[k].m_ciftiIndex);
-                        }
+                        CaretAssert(inMap[k].m_surfaceNode == outMap[k].m_surfaceNode);
+                        copySources.push_back(sourceCifti[i]);
+                        copyInIndices.push_back(inMap[k].m_ciftiIndex);
+                        copyOutIndices.push_back(outMap[k].m_ciftiIndex);
                     }
                 }
                 break;
@@ -226,31 +305,14 @@ AlgorithmCiftiMergeDense::AlgorithmCiftiMergeDense(ProgressObject* myProgObj, co
                     outXML.getVolumeStructureMap(myDir, outMap, myInfo.m_structure);
                     otherXML.getVolumeStructureMap(myDir, inMap, myInfo.m_structure);
                     CaretAssert(inMap.size() == outMap.size());
-                    vector<float> rowscratch(outXML.getNumberOfColumns()), otherscratch(otherXML.getNumberOfColumns());
-                    if (myDir == CiftiXMLOld::ALONG_ROW)
+                    for (int k = 0; k < (int)inMap.size(); ++k)
                     {
-                        for (int j = 0; j < outXML.getNumberOfRows(); ++j)
-                        {
-                            myCiftiOut->getRow(rowscratch.data(), j, true);
-                            ciftiList[sourceCifti[i]]->getRow(otherscratch.data(), j);
-                            for (int k = 0; k < (int)inMap.size(); ++k)
-                            {
-                                CaretAssert(inMap[k].m_ijk[0] == outMap[k].m_ijk[0]);
-                                CaretAssert(inMap[k].m_ijk[1] == outMap[k].m_ijk[1]);
-                                CaretAssert(inMap[k].m_ijk[2] == outMap[k].m_ijk[2]);
-                                rowscratch[outMap[k].m_ciftiIndex] = otherscratch[inMap[k].m_ciftiIndex];
-                            }
-                            myCiftiOut->setRow(rowscratch.data(), j);
-                        }
-                    } else {
-                        for (int k = 0; k < (int)inMap.size(); ++k)
-                        {
-                            CaretAssert(inMap[k].m_ijk[0] == outMap[k].m_ijk[0]);
-                            CaretAssert(inMap[k].m_ijk[1] == outMap[k].m_ijk[1]);
-                            CaretAssert(inMap[k].m_ijk[2] == outMap[k].m_ijk[2]);
-                            ciftiList[sourceCifti[i]]->getRow(otherscratch.data(), inMap[k].m_ciftiIndex);
-                            myCiftiOut->setRow(otherscratch.data(), outMap[k].m_ciftiIndex);
-                        }
+                        CaretAssert(inMap[k].m_ijk[0] == outMap[k].m_ijk[0]);
+                        CaretAssert(inMap[k].m_ijk[1] == outMap[k].m_ijk[1]);
+                        CaretAssert(inMap[k].m_ijk[2] == outMap[k].m_ijk[2]);
+                        copySources.push_back(sourceCifti[i]);
+                        copyInIndices.push_back(inMap[k].m_ciftiIndex);
+                        copyOutIndices.push_back(outMap[k].m_ciftiIndex);
                     }
                 }
                 break;
@@ -259,6 +321,12 @@ AlgorithmCiftiMergeDense::AlgorithmCiftiMergeDense(ProgressObject* myProgObj, co
                 throw AlgorithmException("encountered unknown model type in cifti merge dense");
         }
     }
+    if (!isLabel)
+    {//copy everything in one pass, rather than a pass over the output for each brain model
+        MergeProcessor myProcessor(ciftiList, myCiftiOut, myDir, copySources, copyInIndices, copyOutIndices);
+        const int64_t numItems = myProcessor.getNumberOfItems();
+        RowBlockPipeline::run(myProcessor, numItems, RowBlockPipeline::getItemsPerBlock(myProcessor.getBytesPerItem(), numItems));
+    }
 }
 
 float AlgorithmCiftiMergeDense::getAlgorithmInternalWeight()
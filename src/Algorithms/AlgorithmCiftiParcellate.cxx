@@ -21,14 +21,17 @@
 #include "AlgorithmCiftiParcellate.h"
 #include "AlgorithmException.h"
 #include "CaretLogger.h"
+#include "CaretOMP.h"
 #include "CiftiFile.h"
 #include "GiftiLabel.h"
 #include "GiftiLabelTable.h"
 #include "MetricFile.h"
 #include "MultiDimIterator.h"
 #include "ReductionOperation.h"
+#include "RowBlockPipeline.h"
 #include "SurfaceFile.h"
 
+#include <algorithm>
 #include <cmath>
 #include <map>
 
@@ -205,399 +208,341 @@ void AlgorithmCiftiParcellate::useParameters(OperationParameters* myParams, Prog
     AlgorithmCiftiParcellate(myProgObj, myCiftiIn, myCiftiLabel, direction, myCiftiOut, method, excludeLow, excludeHigh, onlyNumeric);
 }
 
-AlgorithmCiftiParcellate::AlgorithmCiftiParcellate(ProgressObject* myProgObj, const CiftiFile* myCiftiIn, const CiftiFile* myCiftiLabel, const int& direction, CiftiFile* myCiftiOut,
-                                                   const ReductionEnum::Enum& method, const float& excludeLow, const float& excludeHigh, const bool& onlyNumeric) : AbstractAlgorithm(myProgObj)
+namespace
 {
-    LevelProgress myProgress(myProgObj);
-    CaretAssert(direction >= 0);
-    const CiftiXML& myInputXML = myCiftiIn->getCiftiXML();
-    const CiftiXML& myLabelXML = myCiftiLabel->getCiftiXML();
-    vector<int64_t> dims = myInputXML.getDimensions();
-    if (direction >= (int)dims.size()) throw AlgorithmException("specified direction doesn't exist in input file");
-    if (myInputXML.getMappingType(direction) != CiftiMappingType::BRAIN_MODELS)
-    {
-        throw AlgorithmException("input cifti file does not have brain models mapping type in specified direction");
-    }
-    if (myLabelXML.getNumberOfDimensions() != 2 ||
-        myLabelXML.getMappingType(CiftiXML::ALONG_ROW) != CiftiMappingType::LABELS ||
-        myLabelXML.getMappingType(CiftiXML::ALONG_COLUMN) != CiftiMappingType::BRAIN_MODELS)
-    {
-        throw AlgorithmException("input cifti label file has the wrong mapping types");
-    }
-    const CiftiBrainModelsMap& inputDense = myInputXML.getBrainModelsMap(direction);
-    const CiftiBrainModelsMap& labelDense = myLabelXML.getBrainModelsMap(CiftiXML::ALONG_COLUMN);
-    if (inputDense.hasVolumeData())
-    {//don't check volume space if direction doesn't have volume data
-        if (labelDense.hasVolumeData() && !inputDense.getVolumeSpace().matches(labelDense.getVolumeSpace()))
-        {
-            throw AlgorithmException("input cifti files must have the same volume space");
-        }
-    }
-    vector<int> indexToParcel;
-    CiftiXML myOutXML = myInputXML;
-    CiftiParcelsMap outParcelMap = parcellateMapping(myCiftiLabel, inputDense, indexToParcel);
-    int numParcels = outParcelMap.getLength();
-    if (numParcels < 1)
-    {
-        throw AlgorithmException("no parcels found, output file would be empty, aborting");
-    }
-    myOutXML.setMap(direction, outParcelMap);
-    myCiftiOut->setCiftiXML(myOutXML);
-    int64_t numCols = myInputXML.getDimensionLength(CiftiXML::ALONG_ROW);
-    vector<float> scratchRow(numCols);
-    vector<int64_t> parcelCounts(numParcels, 0);
-    for (int64_t j = 0; j < (int64_t)indexToParcel.size(); ++j)
-    {
-        int parcel = indexToParcel[j];
-        CaretAssert(parcel > -2 && parcel < numParcels);
-        if (parcel != -1)
-        {
-            ++parcelCounts[parcel];
-        }
-    }
-    bool isLabel = false;
-    int labelDir = -1;
-    for (int i = 0; i < (int)dims.size(); ++i)
-    {
-        if (myInputXML.getMappingType(i) == CiftiMappingType::LABELS)
-        {
-            isLabel = true;
-            labelDir = i;
-            break;//there should never be more than one dimension with LABEL type, and if there is, just use the first one, i guess...
-        }
-    }
-    if (isLabel && method != ReductionEnum::MODE)
+    struct ParcelRowRead
     {
-        CaretLogWarning(ReductionEnum::toName(method) + " reduction requested while parcellating label data");
-    }
-    if (direction == CiftiXML::ALONG_ROW)
+        int64_t m_fileRow, m_item, m_member;
+        bool operator<(const ParcelRowRead& rhs) const { return m_fileRow < rhs.m_fileRow; }
+    };
+    
+    ///for ALONG_ROW, an item is one input row, reduced to one value per parcel
+    ///otherwise, an item is one parcel of the rows along the parcellated direction (for each index of any other dimensions), reduced to one output row
+    class ParcellateProcessor : public RowBlockPipeline::Processor
     {
-        vector<float> scratchOutRow(numParcels);
-        vector<vector<float> > parcelData(numParcels);//float so we can use ReductionOperation
-        for (int j = 0; j < numParcels; ++j)
+        const CiftiFile* m_input;
+        CiftiFile* m_output;
+        int m_direction;
+        const vector<vector<float> >* m_parcelWeights;//NULL for unweighted
+        ReductionEnum::Enum m_method;
+        float m_excludeLow, m_excludeHigh;
+        bool m_onlyNumeric, m_isLabel;
+        int m_labelDir, m_numParcels;
+        int64_t m_numCols, m_maxCount;
+        vector<int> m_indexToParcel;
+        vector<vector<int64_t> > m_parcelMembers;//dense indices in each parcel, in file order
+        vector<vector<int64_t> > m_itemIndices;//for other directions, indices[direction - 1] is the parcel
+        vector<int64_t> m_rowStrides;//to find where a row is in the file, to read a block's rows in order
+        vector<float> m_inData[RowBlockPipeline::NUM_SLOTS], m_outData[RowBlockPipeline::NUM_SLOTS];
+        vector<int64_t> m_inOffsets[RowBlockPipeline::NUM_SLOTS];//for other directions, where each item's rows start in m_inData
+        vector<float> m_unassignedKeys;//for label data, the unassigned key of each map
+        float reduceParcel(const float* data, const int& parcel, const int64_t& count) const
         {
-            parcelData[j].reserve(parcelCounts[j]);
-        }
-        for (MultiDimIterator<int64_t> iter(vector<int64_t>(dims.begin() + 1, dims.end())); !iter.atEnd(); ++iter)
-        {
-            for (int j = 0; j < numParcels; ++j)
-            {
-                parcelData[j].clear();//doesn't change allocation
-            }
-            myCiftiIn->getRow(scratchRow.data(), *iter);
-            for (int64_t j = 0; j < numCols; ++j)
+            if (m_parcelWeights != NULL)
             {
-                int parcel = indexToParcel[j];
-                if (parcel != -1)
+                const float* weights = (*m_parcelWeights)[parcel].data();
+                if (m_excludeLow > 0.0f && m_excludeHigh > 0.0f)
                 {
-                    if (isLabel)
-                    {
-                        parcelData[parcel].push_back(floor(scratchRow[j] + 0.5f));//round to nearest integer to be safe
-                    } else {
-                        parcelData[parcel].push_back(scratchRow[j]);
-                    }
+                    return ReductionOperation::reduceWeightedExcludeDev(data, weights, count, m_method, m_excludeLow, m_excludeHigh);
                 }
+                if (m_onlyNumeric) return ReductionOperation::reduceWeightedOnlyNumeric(data, weights, count, m_method);
+                return ReductionOperation::reduceWeighted(data, weights, count, m_method);
             }
-            for (int j = 0; j < numParcels; ++j)
+            if (m_excludeLow > 0.0f && m_excludeHigh > 0.0f)
             {
-                CaretAssert(parcelCounts[j] == (int64_t)parcelData[j].size());
-                if (parcelCounts[j] > 0 && (method != ReductionEnum::SAMPSTDEV || parcelCounts[j] > 1))
-                {
-                    if (excludeLow > 0.0f && excludeHigh > 0.0f)
-                    {
-                        scratchOutRow[j] = ReductionOperation::reduceExcludeDev(parcelData[j].data(), parcelData[j].size(), method, excludeLow, excludeHigh);
-                    } else {
-                        if (onlyNumeric)
-                        {
-                            scratchOutRow[j] = ReductionOperation::reduceOnlyNumeric(parcelData[j].data(), parcelData[j].size(), method);
-                        } else {
-                            scratchOutRow[j] = ReductionOperation::reduce(parcelData[j].data(), parcelData[j].size(), method);
-                        }
-                    }
-                } else {//labelDir can't be 0 (row) because we are parcellating along row, so row must be dense
-                    if (isLabel)
-                    {
-                        scratchOutRow[j] = myOutXML.getLabelsMap(labelDir).getMapLabelTable((*iter)[labelDir - 1])->getUnassignedLabelKey();
-                    } else {
-                        scratchOutRow[j] = 0.0f;
-                    }
-                }
+                return ReductionOperation::reduceExcludeDev(data, count, m_method, m_excludeLow, m_excludeHigh);
             }
-            myCiftiOut->setRow(scratchOutRow.data(), *iter);
+            if (m_onlyNumeric) return ReductionOperation::reduceOnlyNumeric(data, count, m_method);
+            return ReductionOperation::reduce(data, count, m_method);
         }
-    } else {
-        vector<float> scratchOutRow(numCols);
-        vector<int64_t> otherDims = dims;
-        otherDims.erase(otherDims.begin() + direction);//direction being parcellated
-        otherDims.erase(otherDims.begin());//row
-        vector<vector<vector<float> > > parcelData(numParcels, vector<vector<float> >(numCols));//float so we can use ReductionOperation
-        for (int i = 0; i < numParcels; ++i)
+        bool parcelUsable(const int64_t& count) const
         {
-            for (int j = 0; j < numCols; ++j)
-            {
-                parcelData[i][j].reserve(parcelCounts[i]);
-            }
+            return count > 0 && (m_method != ReductionEnum::SAMPSTDEV || count > 1);
         }
-        for (MultiDimIterator<int64_t> iter(otherDims); !iter.atEnd(); ++iter)
+        float getValue(const float& value) const
         {
-            vector<int64_t> indices(dims.size() - 1);//we need to add the parcellated direction index back into the index list to use it in getRow/setRow
-            for (int i = 0; i < (int)otherDims.size(); ++i)
+            if (m_isLabel) return floor(value + 0.5f);//round to nearest integer to be safe
+            return value;
+        }
+    public:
+        ParcellateProcessor(const CiftiFile* myCiftiIn, const int& direction, CiftiFile* myCiftiOut, const vector<int>& indexToParcel,
+                            const vector<vector<float> >* parcelWeights, const ReductionEnum::Enum& method, const float& excludeLow, const float& excludeHigh, const bool& onlyNumeric)
+        {
+            m_input = myCiftiIn;
+            m_output = myCiftiOut;
+            m_direction = direction;
+            m_indexToParcel = indexToParcel;
+            m_parcelWeights = parcelWeights;
+            m_method = method;
+            m_excludeLow = excludeLow;
+            m_excludeHigh = excludeHigh;
+            m_onlyNumeric = onlyNumeric;
+            const CiftiXML& myInputXML = myCiftiIn->getCiftiXML();
+            vector<int64_t> dims = myInputXML.getDimensions();
+            CaretAssert(direction < (int)dims.size());
+            m_isLabel = false;
+            m_labelDir = -1;
+            for (int i = 0; i < (int)dims.size(); ++i)
             {
-                if (i < direction - 1)
+                if (myInputXML.getMappingType(i) == CiftiMappingType::LABELS)
                 {
-                    indices[i] = (*iter)[i];
-                } else {
-                    indices[i + 1] = (*iter)[i];
+                    m_isLabel = true;
+                    m_labelDir = i;
+                    break;//there should never be more than one dimension with LABEL type, and if there is, just use the first one, i guess...
                 }
-            }//indices[direction - 1] is uninitialized, as it is the dimension to be parcellated
-            for (int i = 0; i < numParcels; ++i)
+            }
+            if (m_isLabel && method != ReductionEnum::MODE)
             {
-                for (int j = 0; j < numCols; ++j)
+                CaretLogWarning(ReductionEnum::toName(method) + " reduction requested while parcellating label data");
+            }
+            m_numParcels = myCiftiOut->getCiftiXML().getDimensionLength(direction);
+            if (m_isLabel)
+            {//getUnassignedLabelKey adds a label to the table if there isn't one, so use a copy rather than change the output header while it is being written
+                CiftiXML keyXML = myCiftiOut->getCiftiXML();
+                const CiftiLabelsMap& keyLabels = keyXML.getLabelsMap(m_labelDir);
+                m_unassignedKeys.resize(keyLabels.getLength());
+                for (int64_t i = 0; i < keyLabels.getLength(); ++i)
                 {
-                    parcelData[i][j].clear();//doesn't change allocation
+                    m_unassignedKeys[i] = keyLabels.getMapLabelTable(i)->getUnassignedLabelKey();
                 }
             }
-            for (int64_t i = 0; i < dims[direction]; ++i)
+            m_numCols = myInputXML.getDimensionLength(CiftiXML::ALONG_ROW);
+            m_rowStrides.resize(dims.size() - 1);
+            int64_t stride = 1;
+            for (int i = 1; i < (int)dims.size(); ++i)
+            {//first index after row is the fastest changing
+                m_rowStrides[i - 1] = stride;
+                stride *= dims[i];
+            }
+            m_parcelMembers.resize(m_numParcels);
+            for (int64_t j = 0; j < (int64_t)indexToParcel.size(); ++j)
             {
-                int parcel = indexToParcel[i];
+                int parcel = indexToParcel[j];
+                CaretAssert(parcel > -2 && parcel < m_numParcels);
                 if (parcel != -1)
                 {
-                    indices[direction - 1] = i;
-                    myCiftiIn->getRow(scratchRow.data(), indices);
-                    vector<vector<float> >& parcelRef = parcelData[parcel];
-                    for (int j = 0; j < numCols; ++j)
-                    {
-                        if (isLabel)
-                        {
-                            parcelRef[j].push_back(floor(scratchRow[j] + 0.5f));
-                        } else {
-                            parcelRef[j].push_back(scratchRow[j]);
-                        }
-                    }
+                    m_parcelMembers[parcel].push_back(j);
                 }
             }
-            for (int i = 0; i < numParcels; ++i)
+            m_maxCount = 0;
+            for (int i = 0; i < m_numParcels; ++i)
             {
-                indices[direction - 1] = i;
-                int64_t count = parcelCounts[i];
-                vector<vector<float> >& parcelRef = parcelData[i];
-                if (count > 0 && (method != ReductionEnum::SAMPSTDEV || count > 1))
+                CaretAssert(parcelWeights == NULL || (*parcelWeights)[i].size() == m_parcelMembers[i].size());
+                m_maxCount = max(m_maxCount, (int64_t)m_parcelMembers[i].size());
+            }
+            if (direction == CiftiXML::ALONG_ROW)
+            {
+                for (MultiDimIterator<int64_t> iter(vector<int64_t>(dims.begin() + 1, dims.end())); !iter.atEnd(); ++iter)
                 {
-                    for (int j = 0; j < numCols; ++j)
-                    {
-                        CaretAssert((int64_t)parcelRef[j].size() == count);
-                        if (excludeLow > 0.0f && excludeHigh > 0.0f)
-                        {
-                            scratchOutRow[j] = ReductionOperation::reduceExcludeDev(parcelRef[j].data(), parcelRef[j].size(), method, excludeLow, excludeHigh);
-                        } else {
-                            if (onlyNumeric)
-                            {
-                                scratchOutRow[j] = ReductionOperation::reduceOnlyNumeric(parcelRef[j].data(), parcelRef[j].size(), method);
-                            } else {
-                                scratchOutRow[j] = ReductionOperation::reduce(parcelRef[j].data(), parcelRef[j].size(), method);
-                            }
-                        }
-                    }
-                } else {
-                    for (int j = 0; j < numCols; ++j)
+                    m_itemIndices.push_back(*iter);
+                }
+            } else {
+                vector<int64_t> otherDims = dims;
+                otherDims.erase(otherDims.begin() + direction);//direction being parcellated
+                otherDims.erase(otherDims.begin());//row
+                for (MultiDimIterator<int64_t> iter(otherDims); !iter.atEnd(); ++iter)
+                {
+                    vector<int64_t> indices = *iter;//we need to add the parcellated direction index back into the index list to use it in getRow/setRow
+                    indices.insert(indices.begin() + direction - 1, 0);
+                    for (int i = 0; i < m_numParcels; ++i)
                     {
-                        CaretAssert((int64_t)parcelRef[j].size() == count);
-                        if (isLabel)
-                        {
-                            if (labelDir == CiftiXML::ALONG_ROW)
-                            {
-                                scratchOutRow[j] = myOutXML.getLabelsMap(CiftiXML::ALONG_ROW).getMapLabelTable(j)->getUnassignedLabelKey();
-                            } else {
-                                scratchOutRow[j] = myOutXML.getLabelsMap(labelDir).getMapLabelTable(indices[labelDir - 1])->getUnassignedLabelKey();
-                            }
-                        } else {
-                            scratchOutRow[j] = 0.0f;
-                        }
+                        indices[direction - 1] = i;
+                        m_itemIndices.push_back(indices);
                     }
                 }
-                myCiftiOut->setRow(scratchOutRow.data(), indices);
             }
         }
-    }
-}
-
-namespace
-{
-    void doWeightedParcellation(const CiftiFile* myCiftiIn, const int& direction, CiftiFile* myCiftiOut, const vector<int>& indexToParcel,
-                                const vector<vector<float> >& parcelWeights, const ReductionEnum::Enum& method, const float& excludeLow, const float& excludeHigh, const bool& onlyNumeric)
-    {
-        const CiftiXML& myInputXML = myCiftiIn->getCiftiXML();
-        const CiftiXML& myOutXML = myCiftiOut->getCiftiXML();
-        vector<int64_t> dims = myInputXML.getDimensions();
-        CaretAssert(direction < (int)dims.size());
-        bool isLabel = false;
-        int labelDir = -1;
-        for (int i = 0; i < (int)dims.size(); ++i)
-        {
-            if (myInputXML.getMappingType(i) == CiftiMappingType::LABELS)
-            {
-                isLabel = true;
-                labelDir = i;
-                break;//there should never be more than one dimension with LABEL type, and if there is, just use the first one, i guess...
-            }
-        }
-        if (isLabel && method != ReductionEnum::MODE)
+        int64_t getNumberOfItems() const { return (int64_t)m_itemIndices.size(); }
+        int64_t getBytesPerItem() const
         {
-            CaretLogWarning(ReductionEnum::toName(method) + " reduction requested while parcellating label data");
+            if (m_direction == CiftiXML::ALONG_ROW) return (m_numCols + m_numParcels) * sizeof(float);
+            return ((int64_t)m_indexToParcel.size() / m_numParcels + 1) * m_numCols * sizeof(float);//parcels are usually similar in size, so use the average
         }
-        int numParcels = myCiftiOut->getCiftiXML().getDimensionLength(direction);
-        int64_t numCols = myInputXML.getDimensionLength(CiftiXML::ALONG_ROW);
-        vector<float> scratchRow(numCols);
-        if (direction == CiftiXML::ALONG_ROW)
+        void readBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
         {
-            vector<float> scratchOutRow(numParcels);
-            vector<vector<float> > parcelData(numParcels);//float so we can use ReductionOperation
-            for (int j = 0; j < numParcels; ++j)
+            if (m_direction == CiftiXML::ALONG_ROW)
             {
-                parcelData[j].reserve(parcelWeights[j].size());
-            }
-            for (MultiDimIterator<int64_t> iter(vector<int64_t>(dims.begin() + 1, dims.end())); !iter.atEnd(); ++iter)
-            {
-                for (int j = 0; j < numParcels; ++j)
+                m_inData[slot].resize(numItems * m_numCols);
+                m_outData[slot].resize(numItems * m_numParcels);
+                for (int64_t i = 0; i < numItems; ++i)
                 {
-                    parcelData[j].clear();//doesn't change allocation
+                    m_input->getRow(m_inData[slot].data() + i * m_numCols, m_itemIndices[firstItem + i]);
                 }
-                myCiftiIn->getRow(scratchRow.data(), *iter);
-                for (int64_t j = 0; j < numCols; ++j)
+            } else {
+                vector<int64_t>& offsets = m_inOffsets[slot];
+                offsets.resize(numItems + 1);
+                offsets[0] = 0;
+                for (int64_t i = 0; i < numItems; ++i)
                 {
-                    int parcel = indexToParcel[j];
-                    if (parcel != -1)
-                    {
-                        if (isLabel)
-                        {
-                            parcelData[parcel].push_back(floor(scratchRow[j] + 0.5f));//round to nearest integer to be safe
-                        } else {
-                            parcelData[parcel].push_back(scratchRow[j]);
-                        }
-                    }
+                    offsets[i + 1] = offsets[i] + (int64_t)m_parcelMembers[m_itemIndices[firstItem + i][m_direction - 1]].size() * m_numCols;
                 }
-                for (int j = 0; j < numParcels; ++j)
+                m_inData[slot].resize(offsets[numItems]);
+                m_outData[slot].resize(numItems * m_numCols);
+                vector<ParcelRowRead> reads;//parcels interleave in the file, so sort the reads to avoid jumping around an on-disk file
+                reads.reserve(offsets[numItems] / max(m_numCols, (int64_t)1));
+                for (int64_t i = 0; i < numItems; ++i)
                 {
-                    CaretAssert(parcelWeights[j].size() == parcelData[j].size());
-                    if (parcelData[j].size() > 0 && (method != ReductionEnum::SAMPSTDEV || parcelData[j].size() > 1))
+                    vector<int64_t> indices = m_itemIndices[firstItem + i];
+                    const vector<int64_t>& members = m_parcelMembers[indices[m_direction - 1]];
+                    for (int64_t k = 0; k < (int64_t)members.size(); ++k)
                     {
-                        if (excludeLow > 0.0f && excludeHigh > 0.0f)
-                        {
-                            scratchOutRow[j] = ReductionOperation::reduceWeightedExcludeDev(parcelData[j].data(), parcelWeights[j].data(), parcelData[j].size(), method, excludeLow, excludeHigh);
-                        } else {
-                            if (onlyNumeric)
-                            {
-                                scratchOutRow[j] = ReductionOperation::reduceWeightedOnlyNumeric(parcelData[j].data(), parcelWeights[j].data(), parcelData[j].size(), method);
-                            } else {
-                                scratchOutRow[j] = ReductionOperation::reduceWeighted(parcelData[j].data(), parcelWeights[j].data(), parcelData[j].size(), method);
-                            }
-                        }
-                    } else {//labelDir can't be 0 (row) because we are parcellating along row, so row must be dense
-                        if (isLabel)
+                        indices[m_direction - 1] = members[k];
+                        ParcelRowRead thisRead;
+                        thisRead.m_fileRow = 0;
+                        for (int d = 0; d < (int)indices.size(); ++d)
                         {
-                            scratchOutRow[j] = myOutXML.getLabelsMap(labelDir).getMapLabelTable((*iter)[labelDir - 1])->getUnassignedLabelKey();
-                        } else {
-                            scratchOutRow[j] = 0.0f;
+                            thisRead.m_fileRow += indices[d] * m_rowStrides[d];
                         }
+                        thisRead.m_item = i;
+                        thisRead.m_member = k;
+                        reads.push_back(thisRead);
                     }
                 }
-                myCiftiOut->setRow(scratchOutRow.data(), *iter);
-            }
-        } else {
-            vector<float> scratchOutRow(numCols);
-            vector<int64_t> otherDims = dims;
-            otherDims.erase(otherDims.begin() + direction);//direction being parcellated
-            otherDims.erase(otherDims.begin());//row
-            vector<vector<vector<float> > > parcelData(numParcels, vector<vector<float> >(numCols));//float so we can use ReductionOperation
-            for (int i = 0; i < numParcels; ++i)
-            {
-                for (int j = 0; j < numCols; ++j)
+                sort(reads.begin(), reads.end());
+                for (int64_t r = 0; r < (int64_t)reads.size(); ++r)
                 {
-                    parcelData[i][j].reserve(parcelWeights[i].size());
+                    const ParcelRowRead& thisRead = reads[r];
+                    vector<int64_t> indices = m_itemIndices[firstItem + thisRead.m_item];
+                    indices[m_direction - 1] = m_parcelMembers[indices[m_direction - 1]][thisRead.m_member];
+                    m_input->getRow(m_inData[slot].data() + offsets[thisRead.m_item] + thisRead.m_member * m_numCols, indices);
                 }
             }
-            for (MultiDimIterator<int64_t> iter(otherDims); !iter.atEnd(); ++iter)
+        }
+        void processBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot, const int& part, const int& numParts)
+        {
+            const float* inData = m_inData[slot].data();
+            float* outData = m_outData[slot].data();
+            int64_t start, end;
+            if (m_direction == CiftiXML::ALONG_ROW)
             {
-                vector<int64_t> indices(dims.size() - 1);//we need to add the parcellated direction index back into the index list to use it in getRow/setRow
-                for (int i = 0; i < (int)otherDims.size(); ++i)
+                RowBlockPipeline::getPartRange(numItems, part, numParts, start, end);
+                vector<vector<float> > parcelData(m_numParcels);//float so we can use ReductionOperation
+                for (int j = 0; j < m_numParcels; ++j)
+                {
+                    parcelData[j].reserve(m_parcelMembers[j].size());
+                }
+                for (int64_t i = start; i < end; ++i)
                 {
-                    if (i < direction - 1)
+                    const float* inRow = inData + i * m_numCols;
+                    float* outRow = outData + i * m_numParcels;
+                    for (int j = 0; j < m_numParcels; ++j)
                     {
-                        indices[i] = (*iter)[i];
-                    } else {
-                        indices[i + 1] = (*iter)[i];
+                        parcelData[j].clear();//doesn't change allocation
                     }
-                }//indices[direction - 1] is uninitialized, as it is the dimension to be parcellated
-                for (int i = 0; i < numParcels; ++i)
-                {
-                    for (int j = 0; j < numCols; ++j)
+                    for (int64_t j = 0; j < m_numCols; ++j)
                     {
-                        parcelData[i][j].clear();//doesn't change allocation
+                        int parcel = m_indexToParcel[j];
+                        if (parcel != -1)
+                        {
+                            parcelData[parcel].push_back(getValue(inRow[j]));
+                        }
                     }
-                }
-                for (int64_t i = 0; i < dims[direction]; ++i)
-                {
-                    int parcel = indexToParcel[i];
-                    if (parcel != -1)
+                    for (int j = 0; j < m_numParcels; ++j)
                     {
-                        indices[direction - 1] = i;
-                        myCiftiIn->getRow(scratchRow.data(), indices);
-                        vector<vector<float> >& parcelRef = parcelData[parcel];
-                        for (int j = 0; j < numCols; ++j)
+                        if (parcelUsable(parcelData[j].size()))
                         {
-                            if (isLabel)
+                            outRow[j] = reduceParcel(parcelData[j].data(), j, parcelData[j].size());
+                        } else {//labelDir can't be 0 (row) because we are parcellating along row, so row must be dense
+                            if (m_isLabel)
                             {
-                                parcelRef[j].push_back(floor(scratchRow[j] + 0.5f));
+                                outRow[j] = m_unassignedKeys[m_itemIndices[firstItem + i][m_labelDir - 1]];
                             } else {
-                                parcelRef[j].push_back(scratchRow[j]);
+                                outRow[j] = 0.0f;
                             }
                         }
                     }
                 }
-                for (int i = 0; i < numParcels; ++i)
+            } else {//split by output element, because a block may have only one parcel
+                RowBlockPipeline::getPartRange(numItems * m_numCols, part, numParts, start, end);
+                vector<float> parcelScratch(m_maxCount);//float so we can use ReductionOperation
+                for (int64_t u = start; u < end; ++u)
                 {
-                    indices[direction - 1] = i;
-                    int64_t count = (int64_t)parcelWeights[i].size();
-                    vector<vector<float> >& parcelRef = parcelData[i];
-                    if (count > 0 && (method != ReductionEnum::SAMPSTDEV || count > 1))
+                    const int64_t item = u / m_numCols, col = u % m_numCols;
+                    const vector<int64_t>& indices = m_itemIndices[firstItem + item];
+                    const int parcel = indices[m_direction - 1];
+                    const int64_t count = (int64_t)m_parcelMembers[parcel].size();
+                    if (parcelUsable(count))
                     {
-                        for (int j = 0; j < numCols; ++j)
+                        const float* itemData = inData + m_inOffsets[slot][item];
+                        for (int64_t k = 0; k < count; ++k)
                         {
-                            CaretAssert((int64_t)parcelRef[j].size() == count);
-                            if (excludeLow > 0.0f && excludeHigh > 0.0f)
-                            {
-                                scratchOutRow[j] = ReductionOperation::reduceWeightedExcludeDev(parcelRef[j].data(), parcelWeights[i].data(), parcelRef[j].size(), method, excludeLow, excludeHigh);
-                            } else {
-                                if (onlyNumeric)
-                                {
-                                    scratchOutRow[j] = ReductionOperation::reduceWeightedOnlyNumeric(parcelRef[j].data(), parcelWeights[i].data(), parcelRef[j].size(), method);
-                                } else {
-                                    scratchOutRow[j] = ReductionOperation::reduceWeighted(parcelRef[j].data(), parcelWeights[i].data(), parcelRef[j].size(), method);
-                                }
-                            }
+                            parcelScratch[k] = getValue(itemData[k * m_numCols + col]);
                         }
+                        outData[u] = reduceParcel(parcelScratch.data(), parcel, count);
                     } else {
-                        for (int j = 0; j < numCols; ++j)
+                        if (m_isLabel)
                         {
-                            CaretAssert((int64_t)parcelRef[j].size() == count);
-                            if (isLabel)
+                            if (m_labelDir == CiftiXML::ALONG_ROW)
                             {
-                                if (labelDir == CiftiXML::ALONG_ROW)
-                                {
-                                    scratchOutRow[j] = myOutXML.getLabelsMap(CiftiXML::ALONG_ROW).getMapLabelTable(j)->getUnassignedLabelKey();
-                                } else {
-                                    scratchOutRow[j] = myOutXML.getLabelsMap(labelDir).getMapLabelTable(indices[labelDir - 1])->getUnassignedLabelKey();
-                                }
+                                outData[u] = m_unassignedKeys[col];
                             } else {
-                                scratchOutRow[j] = 0.0f;
+                                outData[u] = m_unassignedKeys[indices[m_labelDir - 1]];
                             }
+                        } else {
+                            outData[u] = 0.0f;
                         }
                     }
-                    myCiftiOut->setRow(scratchOutRow.data(), indices);
                 }
             }
         }
+        void writeBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            const int64_t outLength = (m_direction == CiftiXML::ALONG_ROW ? m_numParcels : m_numCols);
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                m_output->setRow(m_outData[slot].data() + i * outLength, m_itemIndices[firstItem + i]);
+            }
+        }
+    };
+    
+    void doParcellation(const CiftiFile* myCiftiIn, const int& direction, CiftiFile* myCiftiOut, const vector<int>& indexToParcel,
+                        const vector<vector<float> >* parcelWeights, const ReductionEnum::Enum& method, const float& excludeLow, const float& excludeHigh, const bool& onlyNumeric)
+    {
+        ParcellateProcessor myProcessor(myCiftiIn, direction, myCiftiOut, indexToParcel, parcelWeights, method, excludeLow, excludeHigh, onlyNumeric);
+        const int64_t numItems = myProcessor.getNumberOfItems();
+        RowBlockPipeline::run(myProcessor, numItems, RowBlockPipeline::getItemsPerBlock(myProcessor.getBytesPerItem(), numItems));
+    }
+}
+
+AlgorithmCiftiParcellate::AlgorithmCiftiParcellate(ProgressObject* myProgObj, const CiftiFile* myCiftiIn, const CiftiFile* myCiftiLabel, const int& direction, CiftiFile* myCiftiOut,
+                                                   const ReductionEnum::Enum& method, const float& excludeLow, const float& excludeHigh, const bool& onlyNumeric) : AbstractAlgorithm(myProgObj)
+{
+    LevelProgress myProgress(myProgObj);
+    CaretAssert(direction >= 0);
+    const CiftiXML& myInputXML = myCiftiIn->getCiftiXML();
+    const CiftiXML& myLabelXML = myCiftiLabel->getCiftiXML();
+    vector<int64_t> dims = myInputXML.getDimensions();
+    if (direction >= (int)dims.size()) throw AlgorithmException("specified direction doesn't exist in input file");
+    if (myInputXML.getMappingType(direction) != CiftiMappingType::BRAIN_MODELS)
+    {
+        throw AlgorithmException("input cifti file does not have brain models mapping type in specified direction");
+    }
+    if (myLabelXML.getNumberOfDimensions() != 2 ||
+        myLabelXML.getMappingType(CiftiXML::ALONG_ROW) != CiftiMappingType::LABELS ||
+        myLabelXML.getMappingType(CiftiXML::ALONG_COLUMN) != CiftiMappingType::BRAIN_MODELS)
+    {
+        throw AlgorithmException("input cifti label file has the wrong mapping types");
+    }
+    const CiftiBrainModelsMap& inputDense = myInputXML.getBrainModelsMap(direction);
+    const CiftiBrainModelsMap& labelDense = myLabelXML.getBrainModelsMap(CiftiXML::ALONG_COLUMN);
+    if (inputDense.hasVolumeData())
+    {//don't check volume space if direction doesn't have volume data
+        if (labelDense.hasVolumeData() && !inputDense.getVolumeSpace().matches(labelDense.getVolumeSpace()))
+        {
+            throw AlgorithmException("input cifti files must have the same volume space");
+        }
+    }
+    vector<int> indexToParcel;
+    CiftiXML myOutXML = myInputXML;
+    CiftiParcelsMap outParcelMap = parcellateMapping(myCiftiLabel, inputDense, indexToParcel);
+    int numParcels = outParcelMap.getLength();
+    if (numParcels < 1)
+    {
+        throw AlgorithmException("no parcels found, output file would be empty, aborting");
     }
+    myOutXML.setMap(direction, outParcelMap);
+    myCiftiOut->setCiftiXML(myOutXML);
+    doParcellation(myCiftiIn, direction, myCiftiOut, indexToParcel, NULL, method, excludeLow, excludeHigh, onlyNumeric);
 }
 
 AlgorithmCiftiParcellate::AlgorithmCiftiParcellate(ProgressObject* myProgObj, const CiftiFile* myCiftiIn, const CiftiFile* myCiftiLabel, const int& direction, CiftiFile* myCiftiOut,
@@ -698,7 +643,7 @@ AlgorithmCiftiParcellate::AlgorithmCiftiParcellate(ProgressObject* myProgObj, co
             }
         }
     }
-    doWeightedParcellation(myCiftiIn, direction, myCiftiOut, indexToParcel, parcelWeights, method, excludeLow, excludeHigh, onlyNumeric);
+    doParcellation(myCiftiIn, direction, myCiftiOut, indexToParcel, &parcelWeights, method, excludeLow, excludeHigh, onlyNumeric);
 }
 
 AlgorithmCiftiParcellate::AlgorithmCiftiParcellate(ProgressObject* myProgObj, const CiftiFile* myCiftiIn, const CiftiFile* myCiftiLabel, const int& direction, CiftiFile* myCiftiOut,
@@ -759,7 +704,7 @@ AlgorithmCiftiParcellate::AlgorithmCiftiParcellate(ProgressObject* myProgObj, co
             parcelWeights[parcel].push_back(weightCol[j]);//we already tested that the dense mappings matched
         }
     }
-    doWeightedParcellation(myCiftiIn, direction, myCiftiOut, indexToParcel, parcelWeights, method, excludeLow, excludeHigh, onlyNumeric);
+    doParcellation(myCiftiIn, direction, myCiftiOut, indexToParcel, &parcelWeights, method, excludeLow, excludeHigh, onlyNumeric);
 }
 
 CiftiParcelsMap AlgorithmCiftiParcellate::parcellateMapping(const CiftiFile* myCiftiLabel, const CiftiBrainModelsMap& toParcellate, vector<int>& indexToParcelOut)
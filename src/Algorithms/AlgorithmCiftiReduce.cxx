@@ -25,12 +25,136 @@
 #include "CiftiFile.h"
 #include "MultiDimIterator.h"
 #include "ReductionOperation.h"
+#include "RowBlockPipeline.h"
 
 #include <vector>
 
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    ///for ALONG_ROW, an item is one input row, reduced to one value
+    ///otherwise, an item is all input rows along the reduction direction, reduced to one output row
+    class ReduceProcessor : public RowBlockPipeline::Processor
+    {
+        const CiftiFile* m_input;
+        CiftiFile* m_output;
+        int m_direction;
+        ReductionEnum::Enum m_reduce;
+        bool m_onlyNumeric, m_excludeDev;
+        float m_sigmaBelow, m_sigmaAbove;
+        int64_t m_rowLength, m_rowsPerItem, m_outLength;
+        vector<vector<int64_t> > m_itemIndices;//for reading and writing, the reduction direction index is set when used
+        vector<float> m_inData[RowBlockPipeline::NUM_SLOTS], m_outData[RowBlockPipeline::NUM_SLOTS];
+        float reduce(const float* data, const int64_t& count) const
+        {
+            if (m_excludeDev) return ReductionOperation::reduceExcludeDev(data, count, m_reduce, m_sigmaBelow, m_sigmaAbove);
+            if (m_onlyNumeric) return ReductionOperation::reduceOnlyNumeric(data, count, m_reduce);
+            return ReductionOperation::reduce(data, count, m_reduce);
+        }
+    public:
+        ReduceProcessor(const CiftiFile* ciftiIn, CiftiFile* ciftiOut, const int& direction, const ReductionEnum::Enum& myReduce,
+                        const bool& onlyNumeric, const bool& excludeDev, const float& sigmaBelow, const float& sigmaAbove)
+        {
+            m_input = ciftiIn;
+            m_output = ciftiOut;
+            m_direction = direction;
+            m_reduce = myReduce;
+            m_onlyNumeric = onlyNumeric;
+            m_excludeDev = excludeDev;
+            m_sigmaBelow = sigmaBelow;
+            m_sigmaAbove = sigmaAbove;
+            vector<int64_t> inDims = ciftiIn->getDimensions();
+            m_rowLength = inDims[0];
+            if (direction == CiftiXML::ALONG_ROW)
+            {
+                m_rowsPerItem = 1;
+                m_outLength = 1;//if reducing along row, length of output row is 1
+                for (MultiDimIterator<int64_t> iter(vector<int64_t>(inDims.begin() + 1, inDims.end())); !iter.atEnd(); ++iter)
+                {// + 1 to exclude row dimension, because getRow/setRow
+                    m_itemIndices.push_back(*iter);
+                }
+            } else {
+                m_rowsPerItem = inDims[direction];
+                m_outLength = m_rowLength;//reduction isn't along row, so out rows will be same length as in rows
+                vector<int64_t> otherDims = inDims;
+                otherDims.erase(otherDims.begin() + direction);//direction isn't 0
+                otherDims.erase(otherDims.begin());//remove row direction because getRow/setRow
+                for (MultiDimIterator<int64_t> iter(otherDims); !iter.atEnd(); ++iter)
+                {
+                    vector<int64_t> indexvec = *iter;
+                    indexvec.insert(indexvec.begin() + direction - 1, 0);//placeholder for reduce direction
+                    m_itemIndices.push_back(indexvec);
+                }
+            }
+        }
+        int64_t getNumberOfItems() const { return (int64_t)m_itemIndices.size(); }
+        int64_t getBytesPerItem() const { return (m_rowsPerItem * m_rowLength + m_outLength) * sizeof(float); }
+        void readBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            const int64_t itemLength = m_rowsPerItem * m_rowLength;
+            m_inData[slot].resize(numItems * itemLength);
+            m_outData[slot].resize(numItems * m_outLength);
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                vector<int64_t> indexvec = m_itemIndices[firstItem + i];
+                float* itemData = m_inData[slot].data() + i * itemLength;
+                if (m_direction == CiftiXML::ALONG_ROW)
+                {
+                    m_input->getRow(itemData, indexvec);
+                } else {
+                    for (int64_t r = 0; r < m_rowsPerItem; ++r)
+                    {
+                        indexvec[m_direction - 1] = r;
+                        m_input->getRow(itemData + r * m_rowLength, indexvec);
+                    }
+                }
+            }
+        }
+        void processBlock(const int64_t&, const int64_t& numItems, const int& slot, const int& part, const int& numParts)
+        {
+            const float* inData = m_inData[slot].data();
+            float* outData = m_outData[slot].data();
+            int64_t start, end;
+            if (m_direction == CiftiXML::ALONG_ROW)
+            {
+                RowBlockPipeline::getPartRange(numItems, part, numParts, start, end);
+                for (int64_t i = start; i < end; ++i)
+                {
+                    outData[i] = reduce(inData + i * m_rowLength, m_rowLength);
+                }
+            } else {//split by output element, because there may be only one item
+                RowBlockPipeline::getPartRange(numItems * m_rowLength, part, numParts, start, end);
+                vector<float> reduceScratch(m_rowsPerItem);
+                for (int64_t u = start; u < end; ++u)
+                {
+                    const int64_t item = u / m_rowLength, col = u % m_rowLength;
+                    const float* itemData = inData + item * m_rowsPerItem * m_rowLength;
+                    for (int64_t j = 0; j < m_rowsPerItem; ++j)
+                    {//need reduction input in contiguous array
+                        reduceScratch[j] = itemData[j * m_rowLength + col];
+                    }
+                    outData[u] = reduce(reduceScratch.data(), m_rowsPerItem);
+                }
+            }
+        }
+        void writeBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            for (int64_t i = 0; i < numItems; ++i)
+            {//for other directions, the placeholder is 0, the only element along reduce output direction
+                m_output->setRow(m_outData[slot].data() + i * m_outLength, m_itemIndices[firstItem + i]);
+            }
+        }
+    };
+    
+    void runReduction(ReduceProcessor& myProcessor)
+    {
+        const int64_t numItems = myProcessor.getNumberOfItems();
+        RowBlockPipeline::run(myProcessor, numItems, RowBlockPipeline::getItemsPerBlock(myProcessor.getBytesPerItem(), numItems));
+    }
+}
+
 AString AlgorithmCiftiReduce::getCommandSwitch()
 {
     return "-cifti-reduce";
@@ -105,54 +229,8 @@ AlgorithmCiftiReduce::AlgorithmCiftiReduce(ProgressObject* myProgObj, const Cift
     newMap.setMapName(0, ReductionEnum::toName(myReduce));
     myOutXML.setMap(direction, newMap);
     ciftiOut->setCiftiXML(myOutXML);
-    vector<int64_t> inDims = inputXML.getDimensions();
-    if (direction == CiftiXML::ALONG_ROW)
-    {
-        vector<float> scratchInRow(inDims[0]);
-        for (MultiDimIterator<int64_t> iter(vector<int64_t>(inDims.begin() + 1, inDims.end())); !iter.atEnd(); ++iter)
-        {// + 1 to exclude row dimension, because getRow/setRow
-            ciftiIn->getRow(scratchInRow.data(), *iter);
-            float result = -1;
-            if (onlyNumeric)
-            {
-                result = ReductionOperation::reduceOnlyNumeric(scratchInRow.data(), inDims[0], myReduce);
-            } else {
-                result = ReductionOperation::reduce(scratchInRow.data(), inDims[0], myReduce);
-            }
-            ciftiOut->setRow(&result, *iter);//if reducing along row, length of output row is 1
-        }
-    } else {
-        vector<vector<float> > scratchInRows(inDims[direction], vector<float>(inDims[0]));
-        vector<float> outRow(inDims[0]), reduceScratch(inDims[direction]);//reduction isn't along row, so out rows will be same length as in rows
-        vector<int64_t> otherDims = inDims;
-        otherDims.erase(otherDims.begin() + direction);//direction isn't 0
-        otherDims.erase(otherDims.begin());//remove row direction because getRow/setRow
-        for (MultiDimIterator<int64_t> iter(otherDims); !iter.atEnd(); ++iter)
-        {
-            vector<int64_t> indexvec = *iter;
-            indexvec.insert(indexvec.begin() + direction - 1, -1);//dummy value in place of reduce direction
-            for (int64_t i = 0; i < inDims[direction]; ++i)
-            {
-                indexvec[direction - 1] = i;
-                ciftiIn->getRow(scratchInRows[i].data(), indexvec);
-            }
-            for (int64_t i = 0; i < inDims[0]; ++i)
-            {
-                for (int64_t j = 0; j < inDims[direction]; ++j)
-                {//need reduction input in contiguous array
-                    reduceScratch[j] = scratchInRows[j][i];
-                }
-                if (onlyNumeric)
-                {
-                    outRow[i] = ReductionOperation::reduceOnlyNumeric(reduceScratch.data(), inDims[direction], myReduce);
-                } else {
-                    outRow[i] = ReductionOperation::reduce(reduceScratch.data(), inDims[direction], myReduce);
-                }
-            }
-            indexvec[direction - 1] = 0;//only one element along reduce output direction
-            ciftiOut->setRow(outRow.data(), indexvec);
-        }
-    }
+    ReduceProcessor myProcessor(ciftiIn, ciftiOut, direction, myReduce, onlyNumeric, false, 0.0f, 0.0f);
+    runReduction(myProcessor);
 }
 
 AlgorithmCiftiReduce::AlgorithmCiftiReduce(ProgressObject* myProgObj, const CiftiFile* ciftiIn, const ReductionEnum::Enum& myReduce, CiftiFile* ciftiOut,
@@ -168,43 +246,8 @@ AlgorithmCiftiReduce::AlgorithmCiftiReduce(ProgressObject* myProgObj, const Cift
     newMap.setMapName(0, ReductionEnum::toName(myReduce));
     myOutXML.setMap(direction, newMap);
     ciftiOut->setCiftiXML(myOutXML);
-    vector<int64_t> inDims = inputXML.getDimensions();
-    if (direction == CiftiXML::ALONG_ROW)
-    {
-        vector<float> scratchInRow(inDims[0]);
-        for (MultiDimIterator<int64_t> iter(vector<int64_t>(inDims.begin() + 1, inDims.end())); !iter.atEnd(); ++iter)
-        {// + 1 to exclude row dimension, because getRow/setRow
-            ciftiIn->getRow(scratchInRow.data(), *iter);
-            float result = ReductionOperation::reduceExcludeDev(scratchInRow.data(), inDims[0], myReduce, sigmaBelow, sigmaAbove);
-            ciftiOut->setRow(&result, *iter);//if reducing along row, length of output row is 1
-        }
-    } else {
-        vector<vector<float> > scratchInRows(inDims[direction], vector<float>(inDims[0]));
-        vector<float> outRow(inDims[0]), reduceScratch(inDims[direction]);//reduction isn't along row, so out rows will be same length as in rows
-        vector<int64_t> otherDims = inDims;
-        otherDims.erase(otherDims.begin() + direction);//direction isn't 0
-        otherDims.erase(otherDims.begin());//remove row direction because getRow/setRow
-        for (MultiDimIterator<int64_t> iter(otherDims); !iter.atEnd(); ++iter)
-        {
-            vector<int64_t> indexvec = *iter;
-            indexvec.insert(indexvec.begin() + direction - 1, -1);//dummy value in place of reduce direction
-            for (int64_t i = 0; i < inDims[direction]; ++i)
-            {
-                indexvec[direction - 1] = i;
-                ciftiIn->getRow(scratchInRows[i].data(), indexvec);
-            }
-            for (int64_t i = 0; i < inDims[0]; ++i)
-            {
-                for (int64_t j = 0; j < inDims[direction]; ++j)
-                {//need reduction input in contiguous array
-                    reduceScratch[j] = scratchInRows[j][i];
-                }
-                outRow[i] = ReductionOperation::reduceExcludeDev(reduceScratch.data(), inDims[direction], myReduce, sigmaBelow, sigmaAbove);
-            }
-            indexvec[direction - 1] = 0;//only one element along reduce output direction
-            ciftiOut->setRow(outRow.data(), indexvec);
-        }
-    }
+    ReduceProcessor myProcessor(ciftiIn, ciftiOut, direction, myReduce, false, true, sigmaBelow, sigmaAbove);
+    runReduction(myProcessor);
 }
 
 float AlgorithmCiftiReduce::getAlgorithmInternalWeight()
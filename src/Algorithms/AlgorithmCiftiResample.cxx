@@ -30,6 +30,7 @@
 #include "AlgorithmVolumeAffineResample.h"
 #include "AlgorithmVolumeWarpfieldResample.h"
 #include "CiftiFile.h"
+#include "CiftiMapChunkHelper.h"
 #include "LabelFile.h"
 #include "MetricFile.h"
 #include "SurfaceFile.h"
@@ -130,6 +131,9 @@ OperationParameters* AlgorithmCiftiResample::getParameters()
     cerebAreaMetricsOpt->addMetricParameter(1, "current-area", "a metric file with vertex areas for the current mesh");
     cerebAreaMetricsOpt->addMetricParameter(2, "new-area", "a metric file with vertex areas for the new mesh");
     
+    OptionalParameter* memLimitOpt = ret->createOptionalParameter(16, "-mem-limit", "restrict memory usage when resampling along columns");
+    memLimitOpt->addDoubleParameter(1, "limit-GB", "memory limit in gigabytes");
+    
     AString myHelpText =
         AString("Resample cifti data to a different brainordinate space.  Use COLUMN for the direction to resample dscalar, dlabel, or dtseries.  ") +
         "Resampling both dimensions of a dconn requires running this command twice, once with COLUMN and once with ROW.  " +
@@ -139,6 +143,9 @@ OperationParameters* AlgorithmCiftiResample::getParameters()
         "Dilation is done with the 'nearest' method, and is done on <new-sphere> for surface data.  " +
         "Volume components are padded before dilation so that dilation doesn't run into the edge of the component bounding box.  " +
         "If neither -affine nor -warpfield are specified, the identity transform is assumed for the volume data.\n\n" +
+        "When resampling along columns, -mem-limit makes it resample the maps in chunks, instead of holding every map of a structure in memory at once.  " +
+        "With more than one chunk, the input is read once into a temporary file next to the output, and the output is kept in another until the last chunk is done, " +
+        "so there needs to be free space equal to the uncompressed size of the input and the output.  This does not apply to label data.\n\n" +
         "The recommended resampling methods are ADAP_BARY_AREA and CUBIC (cubic spline), except for label data which should use ADAP_BARY_AREA and ENCLOSING_VOXEL.  " +
         "Using ADAP_BARY_AREA requires specifying an area option to each used -*-spheres option.\n\n" +
         "The <volume-method> argument must be one of the following:\n\n" +
@@ -402,19 +409,29 @@ void AlgorithmCiftiResample::useParameters(OperationParameters* myParams, Progre
             newCerebAreas = cerebAreaMetricsOpt->getMetric(2);
         }
     }
+    float memLimitGB = -1.0f;
+    OptionalParameter* memLimitOpt = myParams->getOptionalParameter(16);
+    if (memLimitOpt->m_present)
+    {
+        memLimitGB = (float)memLimitOpt->getDouble(1);
+        if (memLimitGB < 0.0f)
+        {
+            throw AlgorithmException("memory limit cannot be negative");
+        }
+    }
     if (warpfieldOpt->m_present)
     {
         AlgorithmCiftiResample(myProgObj, myCiftiIn, direction, myTemplate, templateDir, mySurfMethod, myVolMethod, myCiftiOut, surfLargest, voldilatemm, surfdilatemm, myWarpfield.getWarpfield(),
                                curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
                                curRightSphere, newRightSphere, curRightAreas, newRightAreas,
                                curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas,
-                               volDilateMethod, volDilateExponent, surfDilateMethod, surfDilateExponent);
+                               volDilateMethod, volDilateExponent, surfDilateMethod, surfDilateExponent, memLimitGB);
     } else {//rely on AffineFile() being the identity transform for if neither option is specified
         AlgorithmCiftiResample(myProgObj, myCiftiIn, direction, myTemplate, templateDir, mySurfMethod, myVolMethod, myCiftiOut, surfLargest, voldilatemm, surfdilatemm, myAffine.getMatrix(),
                                curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
                                curRightSphere, newRightSphere, curRightAreas, newRightAreas,
                                curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas,
-                               volDilateMethod, volDilateExponent, surfDilateMethod, surfDilateExponent);
+                               volDilateMethod, volDilateExponent, surfDilateMethod, surfDilateExponent, memLimitGB);
     }
 }
 
@@ -516,15 +533,15 @@ namespace
         bool copyMode;
     };
     
-    void setupRowResampling(map<StructureEnum::Enum, ResampleCache>& surfCache, map<StructureEnum::Enum, ResampleCache>& volCache, const CiftiFile* myCiftiIn, CiftiFile* myCiftiOut,
-                            const SurfaceResamplingMethodEnum::Enum& mySurfMethod, const float& voldilatemm,
-                            const SurfaceFile* curLeftSphere, const SurfaceFile* newLeftSphere, const MetricFile* curLeftAreas, const MetricFile* newLeftAreas,
-                            const SurfaceFile* curRightSphere, const SurfaceFile* newRightSphere, const MetricFile* curRightAreas, const MetricFile* newRightAreas,
-                            const SurfaceFile* curCerebSphere, const SurfaceFile* newCerebSphere, const MetricFile* curCerebAreas, const MetricFile* newCerebAreas)
+    void setupResampleCaches(map<StructureEnum::Enum, ResampleCache>& surfCache, map<StructureEnum::Enum, ResampleCache>& volCache, const CiftiFile* myCiftiIn, CiftiFile* myCiftiOut,
+                             const int& direction, const SurfaceResamplingMethodEnum::Enum& mySurfMethod, const float& voldilatemm,
+                             const SurfaceFile* curLeftSphere, const SurfaceFile* newLeftSphere, const MetricFile* curLeftAreas, const MetricFile* newLeftAreas,
+                             const SurfaceFile* curRightSphere, const SurfaceFile* newRightSphere, const MetricFile* curRightAreas, const MetricFile* newRightAreas,
+                             const SurfaceFile* curCerebSphere, const SurfaceFile* newCerebSphere, const MetricFile* curCerebAreas, const MetricFile* newCerebAreas)
     {
         const CiftiXML& myInputXML = myCiftiIn->getCiftiXML(), &myOutXML = myCiftiOut->getCiftiXML();
-        bool labelMode = (myInputXML.getMappingType(CiftiXML::ALONG_COLUMN) == CiftiMappingType::LABELS);
-        const CiftiBrainModelsMap& inModels = myInputXML.getBrainModelsMap(CiftiXML::ALONG_ROW), &outModels = myOutXML.getBrainModelsMap(CiftiXML::ALONG_ROW);
+        bool labelMode = (myInputXML.getMappingType(1 - direction) == CiftiMappingType::LABELS);
+        const CiftiBrainModelsMap& inModels = myInputXML.getBrainModelsMap(direction), &outModels = myOutXML.getBrainModelsMap(direction);
         vector<StructureEnum::Enum> surfList = outModels.getSurfaceStructureList(), volList = outModels.getVolumeStructureList();
         int numSurfStructs = (int)surfList.size(), numVolStructs = (int)volList.size();
         for (int i = 0; i < numSurfStructs; ++i)//initialize reusables
@@ -606,8 +623,8 @@ namespace
             vector<int64_t> inDims(3);
             myCache.inOffset.resize(3);
             myCache.floatScratch1.resize(inDims[0] * inDims[1] * inDims[2]);
-            AlgorithmCiftiSeparate::getCroppedVolSpace(myCiftiIn, CiftiXML::ALONG_ROW, volList[i], inDims.data(), sform, myCache.inOffset.data());
-            AlgorithmCiftiSeparate::getCroppedVolSpace(myCiftiOut, CiftiXML::ALONG_ROW, volList[i], myCache.refDims, myCache.refSform, myCache.refOffset);
+            AlgorithmCiftiSeparate::getCroppedVolSpace(myCiftiIn, direction, volList[i], inDims.data(), sform, myCache.inOffset.data());
+            AlgorithmCiftiSeparate::getCroppedVolSpace(myCiftiOut, direction, volList[i], myCache.refDims, myCache.refSform, myCache.refOffset);
             if (labelMode)
             {
                 myCache.tempVol1.grabNew(new VolumeFile(inDims, sform, 1, SubvolumeAttributes::LABEL));
@@ -702,6 +719,163 @@ namespace
             }
         }
     }
+    
+    int64_t chunkBytesPerMap(const map<StructureEnum::Enum, ResampleCache>& surfCache, const map<StructureEnum::Enum, ResampleCache>& volCache, const float& voldilatemm)
+    {//temporaries that scale with the number of maps in a chunk, structures are done one at a time so only the largest counts
+        int64_t ret = 0;
+        for (map<StructureEnum::Enum, ResampleCache>::const_iterator iter = surfCache.begin(); iter != surfCache.end(); ++iter)
+        {
+            if (iter->second.copyMode) continue;
+            int64_t numCur = iter->second.curSphere->getNumberOfNodes(), numNew = iter->second.newSphere->getNumberOfNodes();
+            ret = max(ret, (int64_t)sizeof(float) * (numCur + 3 * numNew));//interleaved in and out, plus metric copies for dilation
+        }
+        for (map<StructureEnum::Enum, ResampleCache>::const_iterator iter = volCache.begin(); iter != volCache.end(); ++iter)
+        {
+            const ResampleCache& myCache = iter->second;
+            vector<int64_t> inDims;
+            if (voldilatemm > 0.0f)
+            {
+                myCache.volDilateRoi->getDimensions(inDims);
+            } else {
+                myCache.tempVol1->getDimensions(inDims);
+            }
+            int64_t inFrame = inDims[0] * inDims[1] * inDims[2], refFrame = myCache.refDims[0] * myCache.refDims[1] * myCache.refDims[2];
+            ret = max(ret, (int64_t)sizeof(float) * (3 * inFrame + refFrame));//input, padded, dilated, resampled
+        }
+        return ret;
+    }
+    
+    void resampleColumnChunks(map<StructureEnum::Enum, ResampleCache>& surfCache, map<StructureEnum::Enum, ResampleCache>& volCache, const CiftiFile* myCiftiIn, CiftiFile* myCiftiOut,
+                              const bool& surfLargest, const float& surfdilatemm, const AlgorithmMetricDilate::Method& surfDilateMethod, const float& surfDilateExponent,
+                              const float& voldilatemm, const AlgorithmVolumeDilate::Method& volDilateMethod, const float& volDilateExponent,
+                              const VolumeFile::InterpType& myVolMethod, const VolumeFile* warpfield, const FloatMatrix* affine, const float& memLimitGB)
+    {//for non-label data with brainordinates down columns, only holds a chunk of maps in memory, at the cost of going through temporary files when there is more than one chunk
+        CaretAssert((warpfield == NULL) != (affine == NULL));
+        CiftiMapChunkHelper myChunks(myCiftiIn, myCiftiOut, CiftiXML::ALONG_COLUMN, memLimitGB, chunkBytesPerMap(surfCache, volCache, voldilatemm));
+        int64_t numChunks = myChunks.getNumberOfChunks();
+        for (int64_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            myChunks.readChunk(chunk);
+            const int64_t chunkSize = myChunks.getChunkSize();
+            const float* inData = myChunks.getInputData();
+            float* outData = myChunks.getOutputData();
+            for (map<StructureEnum::Enum, ResampleCache>::iterator iter = surfCache.begin(); iter != surfCache.end(); ++iter)
+            {
+                ResampleCache& myCache = iter->second;
+                int64_t inMapSize = (int64_t)myCache.inSurfMap.size(), outMapSize = (int64_t)myCache.outSurfMap.size();
+                if (myCache.copyMode)
+                {
+                    vector<float> nodeData(myCache.floatScratch1.size() * chunkSize, 0.0f);
+                    for (int64_t i = 0; i < inMapSize; ++i)
+                    {
+                        copy(inData + myCache.inSurfMap[i].m_ciftiIndex * chunkSize, inData + (myCache.inSurfMap[i].m_ciftiIndex + 1) * chunkSize,
+                             nodeData.begin() + myCache.inSurfMap[i].m_surfaceNode * chunkSize);
+                    }
+                    for (int64_t i = 0; i < outMapSize; ++i)
+                    {
+                        copy(nodeData.begin() + myCache.outSurfMap[i].m_surfaceNode * chunkSize, nodeData.begin() + (myCache.outSurfMap[i].m_surfaceNode + 1) * chunkSize,
+                             outData + myCache.outSurfMap[i].m_ciftiIndex * chunkSize);
+                    }
+                    continue;
+                }
+                int64_t numCurNodes = myCache.curSphere->getNumberOfNodes(), numNewNodes = myCache.newSphere->getNumberOfNodes();
+                vector<float> curData(numCurNodes * chunkSize, 0.0f), newData(numNewNodes * chunkSize);
+                for (int64_t i = 0; i < inMapSize; ++i)
+                {
+                    copy(inData + myCache.inSurfMap[i].m_ciftiIndex * chunkSize, inData + (myCache.inSurfMap[i].m_ciftiIndex + 1) * chunkSize,
+                         curData.begin() + myCache.inSurfMap[i].m_surfaceNode * chunkSize);
+                }
+                if (surfLargest)
+                {
+                    for (int64_t j = 0; j < chunkSize; ++j)
+                    {
+                        for (int64_t i = 0; i < numCurNodes; ++i)
+                        {
+                            myCache.floatScratch1[i] = curData[i * chunkSize + j];
+                        }
+                        myCache.surfResamp.resampleLargest(myCache.floatScratch1.data(), myCache.floatScratch2.data());
+                        for (int64_t i = 0; i < numNewNodes; ++i)
+                        {
+                            newData[i * chunkSize + j] = myCache.floatScratch2[i];
+                        }
+                    }
+                } else {
+                    myCache.surfResamp.resampleNormalInterleaved(curData.data(), newData.data(), chunkSize);
+                }
+                if (surfdilatemm > 0.0f)
+                {
+                    MetricFile chunkMetric, chunkDilate;
+                    chunkMetric.setNumberOfNodesAndColumns(numNewNodes, chunkSize);
+                    for (int64_t j = 0; j < chunkSize; ++j)
+                    {
+                        for (int64_t i = 0; i < numNewNodes; ++i)
+                        {
+                            myCache.floatScratch2[i] = newData[i * chunkSize + j];
+                        }
+                        chunkMetric.setValuesForColumn(j, myCache.floatScratch2.data());
+                    }
+                    AlgorithmMetricDilate(NULL, &chunkMetric, myCache.newSphere, surfdilatemm, &chunkDilate, &(myCache.surfDilateRoi), NULL, -1, surfDilateMethod, surfDilateExponent);
+                    for (int64_t j = 0; j < chunkSize; ++j)
+                    {
+                        const float* dilateColumn = chunkDilate.getValuePointerForColumn(j);
+                        for (int64_t i = 0; i < numNewNodes; ++i)
+                        {
+                            newData[i * chunkSize + j] = dilateColumn[i];
+                        }
+                    }
+                }
+                for (int64_t i = 0; i < outMapSize; ++i)
+                {
+                    copy(newData.begin() + myCache.outSurfMap[i].m_surfaceNode * chunkSize, newData.begin() + (myCache.outSurfMap[i].m_surfaceNode + 1) * chunkSize,
+                         outData + myCache.outSurfMap[i].m_ciftiIndex * chunkSize);
+                }
+            }
+            for (map<StructureEnum::Enum, ResampleCache>::iterator iter = volCache.begin(); iter != volCache.end(); ++iter)
+            {
+                ResampleCache& myCache = iter->second;
+                int64_t inMapSize = (int64_t)myCache.inVolMap.size(), outMapSize = (int64_t)myCache.outVolMap.size();
+                vector<int64_t> chunkDims;
+                myCache.tempVol1->getDimensions(chunkDims);
+                chunkDims.resize(3);
+                if (chunkSize > 1) chunkDims.push_back(chunkSize);
+                VolumeFile chunkVol(chunkDims, myCache.tempVol1->getSform()), chunkPad, chunkDilate, chunkOut;
+                chunkVol.setValueAllVoxels(0.0f);
+                for (int64_t i = 0; i < inMapSize; ++i)
+                {
+                    const int64_t* ijk = myCache.inVolMap[i].m_ijk;
+                    const float* inValues = inData + myCache.inVolMap[i].m_ciftiIndex * chunkSize;
+                    for (int64_t j = 0; j < chunkSize; ++j)
+                    {
+                        chunkVol.setValue(inValues[j], ijk[0] - myCache.inOffset[0], ijk[1] - myCache.inOffset[1], ijk[2] - myCache.inOffset[2], j);
+                    }
+                }
+                const VolumeFile* toResample = &chunkVol;
+                if (voldilatemm > 0.0f)
+                {
+                    myCache.volPadding.doPadding(&chunkVol, &chunkPad);
+                    AlgorithmVolumeDilate(NULL, &chunkPad, voldilatemm, volDilateMethod, &chunkDilate, myCache.volDilateRoi, NULL, -1, volDilateExponent);
+                    chunkPad.clear();
+                    toResample = &chunkDilate;
+                }
+                if (warpfield != NULL)
+                {
+                    AlgorithmVolumeWarpfieldResample(NULL, toResample, warpfield, myCache.refDims, myCache.refSform, myVolMethod, &chunkOut);
+                } else {
+                    AlgorithmVolumeAffineResample(NULL, toResample, *affine, myCache.refDims, myCache.refSform, myVolMethod, &chunkOut);
+                }
+                for (int64_t i = 0; i < outMapSize; ++i)
+                {
+                    const int64_t* ijk = myCache.outVolMap[i].m_ijk;
+                    float* outValues = outData + myCache.outVolMap[i].m_ciftiIndex * chunkSize;
+                    for (int64_t j = 0; j < chunkSize; ++j)
+                    {
+                        outValues[j] = chunkOut.getValue(ijk[0] - myCache.refOffset[0], ijk[1] - myCache.refOffset[1], ijk[2] - myCache.refOffset[2], j);
+                    }
+                }
+            }
+            myChunks.writeChunk();
+        }
+    }
 }
 
 AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const CiftiFile* myCiftiIn, const int& direction, const CiftiFile* myTemplate, const int& templateDir,
@@ -712,7 +886,7 @@ AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const
                                                const SurfaceFile* curRightSphere, const SurfaceFile* newRightSphere, const MetricFile* curRightAreas, const MetricFile* newRightAreas,
                                                const SurfaceFile* curCerebSphere, const SurfaceFile* newCerebSphere, const MetricFile* curCerebAreas, const MetricFile* newCerebAreas,
                                                const AlgorithmVolumeDilate::Method& volDilateMethod, const float& volDilateExponent,
-                                               const AlgorithmMetricDilate::Method& surfDilateMethod, const float& surfDilateExponent) : AbstractAlgorithm(myProgObj)
+                                               const AlgorithmMetricDilate::Method& surfDilateMethod, const float& surfDilateExponent, const float& memLimitGB) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
     pair<bool, AString> myError = checkForErrors(myCiftiIn, direction, myTemplate, templateDir, mySurfMethod,
@@ -727,8 +901,16 @@ AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const
     const CiftiBrainModelsMap& outModels = myOutXML.getBrainModelsMap(direction);
     vector<StructureEnum::Enum> surfList = outModels.getSurfaceStructureList(), volList = outModels.getVolumeStructureList();
     myCiftiOut->setCiftiXML(myOutXML);
-    if (direction == CiftiXML::ALONG_COLUMN)
-    {
+    if (direction == CiftiXML::ALONG_COLUMN && memLimitGB >= 0.0f && myInputXML.getMappingType(CiftiXML::ALONG_ROW) != CiftiMappingType::LABELS)
+    {//without a limit, going one structure at a time is kept, as it doesn't need to reread the input
+        map<StructureEnum::Enum, ResampleCache> surfCache, volCache;
+        setupResampleCaches(surfCache, volCache, myCiftiIn, myCiftiOut, CiftiXML::ALONG_COLUMN, mySurfMethod, voldilatemm,
+                            curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
+                            curRightSphere, newRightSphere, curRightAreas, newRightAreas,
+                            curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas);
+        resampleColumnChunks(surfCache, volCache, myCiftiIn, myCiftiOut, surfLargest, surfdilatemm, surfDilateMethod, surfDilateExponent,
+                             voldilatemm, volDilateMethod, volDilateExponent, myVolMethod, warpfield, NULL, memLimitGB);
+    } else if (direction == CiftiXML::ALONG_COLUMN) {
         for (int i = 0; i < (int)surfList.size(); ++i)//and now, resampling
         {
             const SurfaceFile* curSphere = NULL, *newSphere = NULL;
@@ -777,10 +959,10 @@ AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const
             }
         }
         map<StructureEnum::Enum, ResampleCache> surfCache, volCache;//could make them different types, but whatever - two variables in case of structure overlap in surface and volume, as some members may get used by both
-        setupRowResampling(surfCache, volCache, myCiftiIn, myCiftiOut, mySurfMethod, voldilatemm,
-                           curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
-                           curRightSphere, newRightSphere, curRightAreas, newRightAreas,
-                           curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas);
+        setupResampleCaches(surfCache, volCache, myCiftiIn, myCiftiOut, CiftiXML::ALONG_ROW, mySurfMethod, voldilatemm,
+                            curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
+                            curRightSphere, newRightSphere, curRightAreas, newRightAreas,
+                            curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas);
         int64_t numRows = myInputXML.getDimensionLength(CiftiXML::ALONG_COLUMN);
         vector<float> inRow(myInputXML.getDimensionLength(CiftiXML::ALONG_ROW)), outRow(myOutXML.getDimensionLength(CiftiXML::ALONG_ROW));
         for (int64_t row = 0; row < numRows; ++row)
@@ -836,7 +1018,7 @@ AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const
                                                const SurfaceFile* curRightSphere, const SurfaceFile* newRightSphere, const MetricFile* curRightAreas, const MetricFile* newRightAreas,
                                                const SurfaceFile* curCerebSphere, const SurfaceFile* newCerebSphere, const MetricFile* curCerebAreas, const MetricFile* newCerebAreas,
                                                const AlgorithmVolumeDilate::Method& volDilateMethod, const float& volDilateExponent,
-                                               const AlgorithmMetricDilate::Method& surfDilateMethod, const float& surfDilateExponent) : AbstractAlgorithm(myProgObj)
+                                               const AlgorithmMetricDilate::Method& surfDilateMethod, const float& surfDilateExponent, const float& memLimitGB) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
     pair<bool, AString> myError = checkForErrors(myCiftiIn, direction, myTemplate, templateDir, mySurfMethod,
@@ -850,8 +1032,16 @@ AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const
     const CiftiBrainModelsMap& outModels = myOutXML.getBrainModelsMap(direction);
     vector<StructureEnum::Enum> surfList = outModels.getSurfaceStructureList(), volList = outModels.getVolumeStructureList();
     myCiftiOut->setCiftiXML(myOutXML);
-    if (direction == CiftiXML::ALONG_COLUMN)
-    {
+    if (direction == CiftiXML::ALONG_COLUMN && memLimitGB >= 0.0f && myInputXML.getMappingType(CiftiXML::ALONG_ROW) != CiftiMappingType::LABELS)
+    {//without a limit, going one structure at a time is kept, as it doesn't need to reread the input
+        map<StructureEnum::Enum, ResampleCache> surfCache, volCache;
+        setupResampleCaches(surfCache, volCache, myCiftiIn, myCiftiOut, CiftiXML::ALONG_COLUMN, mySurfMethod, voldilatemm,
+                            curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
+                            curRightSphere, newRightSphere, curRightAreas, newRightAreas,
+                            curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas);
+        resampleColumnChunks(surfCache, volCache, myCiftiIn, myCiftiOut, surfLargest, surfdilatemm, surfDilateMethod, surfDilateExponent,
+                             voldilatemm, volDilateMethod, volDilateExponent, myVolMethod, NULL, &affine, memLimitGB);
+    } else if (direction == CiftiXML::ALONG_COLUMN) {
         for (int i = 0; i < (int)surfList.size(); ++i)//and now, resampling
         {
             const SurfaceFile* curSphere = NULL, *newSphere = NULL;
@@ -900,10 +1090,10 @@ AlgorithmCiftiResample::AlgorithmCiftiResample(ProgressObject* myProgObj, const
             }
         }
         map<StructureEnum::Enum, ResampleCache> surfCache, volCache;//could make them different types, but whatever - two variables in case of structure overlap in surface and volume, as some members may get used by both
-        setupRowResampling(surfCache, volCache, myCiftiIn, myCiftiOut, mySurfMethod, voldilatemm,
-                           curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
-                           curRightSphere, newRightSphere, curRightAreas, newRightAreas,
-                           curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas);
+        setupResampleCaches(surfCache, volCache, myCiftiIn, myCiftiOut, CiftiXML::ALONG_ROW, mySurfMethod, voldilatemm,
+                            curLeftSphere, newLeftSphere, curLeftAreas, newLeftAreas,
+                            curRightSphere, newRightSphere, curRightAreas, newRightAreas,
+                            curCerebSphere, newCerebSphere, curCerebAreas, newCerebAreas);
         int64_t numRows = myInputXML.getDimensionLength(CiftiXML::ALONG_COLUMN);
         vector<float> inRow(myInputXML.getDimensionLength(CiftiXML::ALONG_ROW)), outRow(myOutXML.getDimensionLength(CiftiXML::ALONG_ROW));
         for (int64_t row = 0; row < numRows; ++row)
@@ -22,16 +22,33 @@
 #include "AlgorithmException.h"
 #include "AlgorithmMetricSmoothing.h"
 #include "AlgorithmVolumeSmoothing.h"
+#include "CaretPointer.h"
 #include "CiftiFile.h"
+#include "CiftiMapChunkHelper.h"
 #include "MetricFile.h"
+#include "MetricSmoothingObject.h"
 #include "VolumeFile.h"
 #include "SurfaceFile.h"
 #include "AlgorithmCiftiSeparate.h"
 #include "AlgorithmCiftiReplaceStructure.h"
 
+#include <algorithm>
+
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    struct VolumePart
+    {//a cropped volume for one structure (or all of them, for -merged-volume), built once and reused for every chunk
+        vector<CiftiBrainModelsMap::VolumeMap> m_map;
+        vector<int64_t> m_dims;
+        vector<vector<float> > m_sform;
+        int64_t m_offset[3];
+        CaretPointer<VolumeFile> m_roi;
+    };
+}
+
 AString AlgorithmCiftiSmoothing::getCommandSwitch()
 {
     return "-cifti-smoothing";
@@ -75,6 +92,9 @@ OperationParameters* AlgorithmCiftiSmoothing::getParameters()
     
     ret->createOptionalParameter(12, "-merged-volume", "smooth across subcortical structure boundaries");
     
+    OptionalParameter* memLimitOpt = ret->createOptionalParameter(13, "-mem-limit", "restrict memory usage");
+    memLimitOpt->addDoubleParameter(1, "limit-GB", "memory limit in gigabytes");
+    
     ret->setHelpText(
         AString("The input cifti file must have a brain models mapping on the chosen dimension, columns for .dtseries, and either for .dconn.  ") +
         "By default, data in different structures is smoothed independently (i.e., \"parcel constrained\" smoothing), so volume structures that touch do not smooth across this boundary.  " +
@@ -84,7 +104,11 @@ OperationParameters* AlgorithmCiftiSmoothing::getParameters()
         "for the reduction of structure in a group average surface.  It is better to smooth the data on individuals before averaging, when feasible.\n\n" +
         "The -fix-zeros-* options will treat values of zero as lack of data, and not use that value when generating the smoothed values, but will fill zeros with extrapolated values.  " +
         "The ROI should have a brain models mapping along columns, exactly matching the mapping of the chosen direction in the input file.  " +
-        "Data outside the ROI is ignored."
+        "Data outside the ROI is ignored.\n\n" +
+        "By default, the data is smoothed one structure at a time.  " +
+        "Restricting the memory usage will instead make it smooth all structures of a chunk of maps at once.  " +
+        "When smoothing along columns needs more than one chunk, the input is read once into a temporary file next to the output, and the output is kept in another until the last chunk is done, " +
+        "so there needs to be free space equal to the uncompressed size of the input and the output."
     );
     return ret;
 }
@@ -146,16 +170,27 @@ void AlgorithmCiftiSmoothing::useParameters(OperationParameters* myParams, Progr
     bool fixZerosVol = myParams->getOptionalParameter(10)->m_present;
     bool fixZerosSurf = myParams->getOptionalParameter(11)->m_present;
     bool mergedVolume = myParams->getOptionalParameter(12)->m_present;
+    float memLimitGB = -1.0f;
+    OptionalParameter* memLimitOpt = myParams->getOptionalParameter(13);
+    if (memLimitOpt->m_present)
+    {
+        memLimitGB = (float)memLimitOpt->getDouble(1);
+        if (memLimitGB < 0.0f)
+        {
+            throw AlgorithmException("memory limit cannot be negative");
+        }
+    }
     AlgorithmCiftiSmoothing(myProgObj, myCifti, surfKern, volKern, myDir, myCiftiOut,
                             myLeftSurf, myRightSurf, myCerebSurf,
                             roiCifti, fixZerosVol, fixZerosSurf,
-                            myLeftAreas, myRightAreas, myCerebAreas, mergedVolume);
+                            myLeftAreas, myRightAreas, myCerebAreas, mergedVolume, memLimitGB);
 }
 
 AlgorithmCiftiSmoothing::AlgorithmCiftiSmoothing(ProgressObject* myProgObj, const CiftiFile* myCifti, const float& surfKern, const float& volKern, const int& myDir, CiftiFile* myCiftiOut,
                                                  const SurfaceFile* myLeftSurf, const SurfaceFile* myRightSurf, const SurfaceFile* myCerebSurf,
                                                  const CiftiFile* roiCifti, bool fixZerosVol, bool fixZerosSurf,
-                                                 const MetricFile* myLeftAreas, const MetricFile* myRightAreas, const MetricFile* myCerebAreas, const bool& mergedVolume) : AbstractAlgorithm(myProgObj)
+                                                 const MetricFile* myLeftAreas, const MetricFile* myRightAreas, const MetricFile* myCerebAreas, const bool& mergedVolume,
+                                                 const float& memLimitGB) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
     if (!(surfKern > 0.0f) && !(volKern > 0.0f)) throw AlgorithmException("zero smoothing kernels requested for both volume and surface");
@@ -226,75 +261,236 @@ AlgorithmCiftiSmoothing::AlgorithmCiftiSmoothing(ProgressObject* myProgObj, cons
         }
     }
     myCiftiOut->setCiftiXML(myXML);
-    for (int whichStruct = 0; whichStruct < (int)surfaceList.size(); ++whichStruct)
-    {
-        const SurfaceFile* mySurf = NULL;
-        const MetricFile* myAreas = NULL;
-        switch (surfaceList[whichStruct])
+    if (memLimitGB < 0.0f)
+    {//one structure at a time, the input and output never need to be entirely in memory
+        for (int whichStruct = 0; whichStruct < (int)surfaceList.size(); ++whichStruct)
         {
-            case StructureEnum::CORTEX_LEFT:
-                mySurf = myLeftSurf;
-                myAreas = myLeftAreas;
-                break;
-            case StructureEnum::CORTEX_RIGHT:
-                mySurf = myRightSurf;
-                myAreas = myRightAreas;
-                break;
-            case StructureEnum::CEREBELLUM:
-                mySurf = myCerebSurf;
-                myAreas = myCerebAreas;
-                break;
-            default:
-                break;
+            const SurfaceFile* mySurf = NULL;
+            const MetricFile* myAreas = NULL;
+            switch (surfaceList[whichStruct])
+            {
+                case StructureEnum::CORTEX_LEFT:
+                    mySurf = myLeftSurf;
+                    myAreas = myLeftAreas;
+                    break;
+                case StructureEnum::CORTEX_RIGHT:
+                    mySurf = myRightSurf;
+                    myAreas = myRightAreas;
+                    break;
+                case StructureEnum::CEREBELLUM:
+                    mySurf = myCerebSurf;
+                    myAreas = myCerebAreas;
+                    break;
+                default:
+                    break;
+            }
+            MetricFile myMetric, myRoi, myMetricOut;
+            AlgorithmCiftiSeparate(NULL, myCifti, myDir, surfaceList[whichStruct], &myMetric, &myRoi);
+            if (surfKern > 0.0f)
+            {
+                if (roiCifti != NULL)
+                {//due to above testing, we know the structure mask is the same, so just overwrite the ROI from the mask
+                    AlgorithmCiftiSeparate(NULL, roiCifti, CiftiXMLOld::ALONG_COLUMN, surfaceList[whichStruct], &myRoi);
+                }
+                AlgorithmMetricSmoothing(NULL, mySurf, &myMetric, surfKern, &myMetricOut, &myRoi, false, fixZerosSurf, -1, myAreas);
+                AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, surfaceList[whichStruct], &myMetricOut);
+            } else {
+                AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, surfaceList[whichStruct], &myMetric);
+            }
         }
-        MetricFile myMetric, myRoi, myMetricOut;
-        AlgorithmCiftiSeparate(NULL, myCifti, myDir, surfaceList[whichStruct], &myMetric, &myRoi);
-        if (surfKern > 0.0f)
+        if (mergedVolume)
         {
-            if (roiCifti != NULL)
-            {//due to above testing, we know the structure mask is the same, so just overwrite the ROI from the mask
-                AlgorithmCiftiSeparate(NULL, roiCifti, CiftiXMLOld::ALONG_COLUMN, surfaceList[whichStruct], &myRoi);
+            VolumeFile myVol, myRoi, myVolOut;
+            int64_t offset[3];
+            AlgorithmCiftiSeparate(NULL, myCifti, myDir, &myVol, offset, &myRoi, true);
+            if (volKern > 0.0f)
+            {
+                if (roiCifti != NULL)
+                {//due to above testing, we know the structure mask is the same, so just overwrite the ROI from the mask
+                    AlgorithmCiftiSeparate(NULL, roiCifti, CiftiXMLOld::ALONG_COLUMN, &myRoi, offset, NULL, true);
+                }
+                AlgorithmVolumeSmoothing(NULL, &myVol, volKern, &myVolOut, &myRoi, fixZerosVol);
+                AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, &myVolOut, true);
+            } else {
+                AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, &myVol, true);
             }
-            AlgorithmMetricSmoothing(NULL, mySurf, &myMetric, surfKern, &myMetricOut, &myRoi, false, fixZerosSurf, -1, myAreas);
-            AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, surfaceList[whichStruct], &myMetricOut);
         } else {
-            AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, surfaceList[whichStruct], &myMetric);
+            for (int whichStruct = 0; whichStruct < (int)volumeList.size(); ++whichStruct)
+            {
+                VolumeFile myVol, myRoi, myVolOut;
+                int64_t offset[3];
+                AlgorithmCiftiSeparate(NULL, myCifti, myDir, volumeList[whichStruct], &myVol, offset, &myRoi, true);
+                if (volKern > 0.0f)
+                {
+                    if (roiCifti != NULL)
+                    {//due to above testing, we know the structure mask is the same, so just overwrite the ROI from the mask
+                        AlgorithmCiftiSeparate(NULL, roiCifti, CiftiXMLOld::ALONG_COLUMN, volumeList[whichStruct], &myRoi, offset, NULL, true);
+                    }
+                    AlgorithmVolumeSmoothing(NULL, &myVol, volKern, &myVolOut, &myRoi, fixZerosVol);
+                    AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, volumeList[whichStruct], &myVolOut, true);
+                } else {
+                    AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, volumeList[whichStruct], &myVol, true);
+                }
+            }
         }
+        return;
+    }
+    const CiftiBrainModelsMap& myModels = myCifti->getCiftiXML().getBrainModelsMap(myDir);
+    vector<float> roiData;
+    if (roiCifti != NULL)
+    {//only the first map of the roi is used, as before
+        roiData.resize(roiCifti->getNumberOfRows());
+        roiCifti->getColumn(roiData.data(), 0);
     }
-    if (mergedVolume)
+    int64_t extraBytesPerMap = 0;//the per-structure temporaries are the only thing that scales with chunk size other than the chunk itself
+    int numSurfStructs = (int)surfaceList.size();
+    vector<vector<CiftiBrainModelsMap::SurfaceMap> > surfMaps;
+    vector<CaretPointer<MetricFile> > surfRois;
+    vector<CaretPointer<MetricSmoothingObject> > surfSmoothers;//left empty with a zero kernel, so surface data just gets copied
+    if (surfKern > 0.0f)
     {
-        VolumeFile myVol, myRoi, myVolOut;
-        int64_t offset[3];
-        AlgorithmCiftiSeparate(NULL, myCifti, myDir, &myVol, offset, &myRoi, true);
-        if (volKern > 0.0f)
+        surfMaps.resize(numSurfStructs);
+        surfRois.resize(numSurfStructs);
+        surfSmoothers.resize(numSurfStructs);
+        for (int whichStruct = 0; whichStruct < numSurfStructs; ++whichStruct)
         {
-            if (roiCifti != NULL)
-            {//due to above testing, we know the structure mask is the same, so just overwrite the ROI from the mask
-                AlgorithmCiftiSeparate(NULL, roiCifti, CiftiXMLOld::ALONG_COLUMN, &myRoi, offset, NULL, true);
+            const SurfaceFile* mySurf = NULL;
+            const MetricFile* myAreas = NULL;
+            switch (surfaceList[whichStruct])
+            {
+                case StructureEnum::CORTEX_LEFT:
+                    mySurf = myLeftSurf;
+                    myAreas = myLeftAreas;
+                    break;
+                case StructureEnum::CORTEX_RIGHT:
+                    mySurf = myRightSurf;
+                    myAreas = myRightAreas;
+                    break;
+                case StructureEnum::CEREBELLUM:
+                    mySurf = myCerebSurf;
+                    myAreas = myCerebAreas;
+                    break;
+                default:
+                    break;
+            }
+            int32_t numNodes = mySurf->getNumberOfNodes();
+            surfMaps[whichStruct] = myModels.getSurfaceMap(surfaceList[whichStruct]);
+            const vector<CiftiBrainModelsMap::SurfaceMap>& myMap = surfMaps[whichStruct];
+            vector<float> roiScratch(numNodes, 0.0f);
+            for (int64_t i = 0; i < (int64_t)myMap.size(); ++i)
+            {
+                roiScratch[myMap[i].m_surfaceNode] = (roiCifti != NULL ? roiData[myMap[i].m_ciftiIndex] : 1.0f);
+            }
+            surfRois[whichStruct].grabNew(new MetricFile());
+            surfRois[whichStruct]->setNumberOfNodesAndColumns(numNodes, 1);
+            surfRois[whichStruct]->setValuesForColumn(0, roiScratch.data());
+            const float* areaData = NULL;
+            if (myAreas != NULL) areaData = myAreas->getValuePointerForColumn(0);
+            surfSmoothers[whichStruct].grabNew(new MetricSmoothingObject(mySurf, surfKern, surfRois[whichStruct], MetricSmoothingObject::GEO_GAUSS_AREA, areaData));
+            extraBytesPerMap = max(extraBytesPerMap, (int64_t)(2 * sizeof(float) * numNodes));
+        }
+    }
+    vector<VolumePart> volParts;
+    if (volKern > 0.0f)
+    {
+        if (mergedVolume)
+        {
+            if (myModels.hasVolumeData())
+            {
+                volParts.push_back(VolumePart());
+                VolumePart& myPart = volParts.back();
+                myPart.m_map = myModels.getFullVolumeMap();
+                myPart.m_dims.resize(3);
+                AlgorithmCiftiSeparate::getCroppedVolSpaceAll(myCifti, myDir, myPart.m_dims.data(), myPart.m_sform, myPart.m_offset);
             }
-            AlgorithmVolumeSmoothing(NULL, &myVol, volKern, &myVolOut, &myRoi, fixZerosVol);
-            AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, &myVolOut, true);
         } else {
-            AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, &myVol, true);
+            volParts.resize(volumeList.size());
+            for (int whichStruct = 0; whichStruct < (int)volumeList.size(); ++whichStruct)
+            {
+                VolumePart& myPart = volParts[whichStruct];
+                myPart.m_map = myModels.getVolumeStructureMap(volumeList[whichStruct]);
+                myPart.m_dims.resize(3);
+                AlgorithmCiftiSeparate::getCroppedVolSpace(myCifti, myDir, volumeList[whichStruct], myPart.m_dims.data(), myPart.m_sform, myPart.m_offset);
+            }
         }
-    } else {
-        for (int whichStruct = 0; whichStruct < (int)volumeList.size(); ++whichStruct)
+        for (int whichPart = 0; whichPart < (int)volParts.size(); ++whichPart)
         {
-            VolumeFile myVol, myRoi, myVolOut;
-            int64_t offset[3];
-            AlgorithmCiftiSeparate(NULL, myCifti, myDir, volumeList[whichStruct], &myVol, offset, &myRoi, true);
-            if (volKern > 0.0f)
+            VolumePart& myPart = volParts[whichPart];
+            myPart.m_roi.grabNew(new VolumeFile(myPart.m_dims, myPart.m_sform));
+            myPart.m_roi->setValueAllVoxels(0.0f);
+            for (int64_t i = 0; i < (int64_t)myPart.m_map.size(); ++i)
             {
-                if (roiCifti != NULL)
-                {//due to above testing, we know the structure mask is the same, so just overwrite the ROI from the mask
-                    AlgorithmCiftiSeparate(NULL, roiCifti, CiftiXMLOld::ALONG_COLUMN, volumeList[whichStruct], &myRoi, offset, NULL, true);
+                const int64_t* ijk = myPart.m_map[i].m_ijk;
+                myPart.m_roi->setValue((roiCifti != NULL ? roiData[myPart.m_map[i].m_ciftiIndex] : 1.0f),
+                                       ijk[0] - myPart.m_offset[0], ijk[1] - myPart.m_offset[1], ijk[2] - myPart.m_offset[2]);
+            }
+            extraBytesPerMap = max(extraBytesPerMap, (int64_t)(2 * sizeof(float) * myPart.m_dims[0] * myPart.m_dims[1] * myPart.m_dims[2]));
+        }
+    }
+    CiftiMapChunkHelper myChunks(myCifti, myCiftiOut, myDir, memLimitGB, extraBytesPerMap);
+    int64_t numChunks = myChunks.getNumberOfChunks(), numIndices = myModels.getLength();
+    for (int64_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        myChunks.readChunk(chunk);
+        const int64_t chunkSize = myChunks.getChunkSize();
+        const float* inData = myChunks.getInputData();
+        float* outData = myChunks.getOutputData();
+        copy(inData, inData + numIndices * chunkSize, outData);//anything with a zero kernel just gets copied
+        for (int whichStruct = 0; whichStruct < (int)surfSmoothers.size(); ++whichStruct)
+        {
+            const vector<CiftiBrainModelsMap::SurfaceMap>& myMap = surfMaps[whichStruct];
+            int64_t mapSize = (int64_t)myMap.size();
+            int32_t numNodes = surfRois[whichStruct]->getNumberOfNodes();
+            MetricFile chunkMetric, chunkMetricOut;
+            chunkMetric.setNumberOfNodesAndColumns(numNodes, chunkSize);
+            vector<float> scratch(numNodes, 0.0f);
+            for (int64_t j = 0; j < chunkSize; ++j)
+            {
+                for (int64_t i = 0; i < mapSize; ++i)
+                {
+                    scratch[myMap[i].m_surfaceNode] = inData[myMap[i].m_ciftiIndex * chunkSize + j];
+                }
+                chunkMetric.setValuesForColumn(j, scratch.data());
+            }
+            surfSmoothers[whichStruct]->smoothMetric(&chunkMetric, &chunkMetricOut, surfRois[whichStruct], fixZerosSurf);
+            for (int64_t j = 0; j < chunkSize; ++j)
+            {
+                const float* outColumn = chunkMetricOut.getValuePointerForColumn(j);
+                for (int64_t i = 0; i < mapSize; ++i)
+                {
+                    outData[myMap[i].m_ciftiIndex * chunkSize + j] = outColumn[myMap[i].m_surfaceNode];
+                }
+            }
+        }
+        for (int whichPart = 0; whichPart < (int)volParts.size(); ++whichPart)
+        {
+            const VolumePart& myPart = volParts[whichPart];
+            int64_t mapSize = (int64_t)myPart.m_map.size();
+            vector<int64_t> chunkDims = myPart.m_dims;
+            if (chunkSize > 1) chunkDims.push_back(chunkSize);
+            VolumeFile chunkVol(chunkDims, myPart.m_sform), chunkVolOut;
+            chunkVol.setValueAllVoxels(0.0f);
+            for (int64_t i = 0; i < mapSize; ++i)
+            {
+                const int64_t* ijk = myPart.m_map[i].m_ijk;
+                const float* inValues = inData + myPart.m_map[i].m_ciftiIndex * chunkSize;
+                for (int64_t j = 0; j < chunkSize; ++j)
+                {
+                    chunkVol.setValue(inValues[j], ijk[0] - myPart.m_offset[0], ijk[1] - myPart.m_offset[1], ijk[2] - myPart.m_offset[2], j);
+                }
+            }
+            AlgorithmVolumeSmoothing(NULL, &chunkVol, volKern, &chunkVolOut, myPart.m_roi, fixZerosVol);
+            for (int64_t i = 0; i < mapSize; ++i)
+            {
+                const int64_t* ijk = myPart.m_map[i].m_ijk;
+                float* outValues = outData + myPart.m_map[i].m_ciftiIndex * chunkSize;
+                for (int64_t j = 0; j < chunkSize; ++j)
+                {
+                    outValues[j] = chunkVolOut.getValue(ijk[0] - myPart.m_offset[0], ijk[1] - myPart.m_offset[1], ijk[2] - myPart.m_offset[2], j);
                 }
-                AlgorithmVolumeSmoothing(NULL, &myVol, volKern, &myVolOut, &myRoi, fixZerosVol);
-                AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, volumeList[whichStruct], &myVolOut, true);
-            } else {
-                AlgorithmCiftiReplaceStructure(NULL, myCiftiOut, myDir, volumeList[whichStruct], &myVol, true);
             }
         }
+        myChunks.writeChunk();
     }
 }
 
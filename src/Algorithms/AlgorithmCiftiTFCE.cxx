@@ -0,0 +1,414 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AlgorithmCiftiTFCE.h"
+#include "AlgorithmException.h"
+
+#include "AlgorithmCiftiSmoothing.h"
+#include "CaretOMP.h"
+#include "CaretPointer.h"
+#include "CiftiFile.h"
+#include "MetricFile.h"
+#include "SurfaceFile.h"
+#include "TFCEHelper.h"
+#include "TopologyHelper.h"
+#include "Vector3D.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+AString AlgorithmCiftiTFCE::getCommandSwitch()
+{
+    return "-cifti-tfce";
+}
+
+AString AlgorithmCiftiTFCE::getShortDescription()
+{
+    return "DO TFCE ON A CIFTI FILE";
+}
+
+OperationParameters* AlgorithmCiftiTFCE::getParameters()
+{
+    OperationParameters* ret = new OperationParameters();
+    ret->addCiftiParameter(1, "cifti-in", "the input cifti");
+
+    ret->addCiftiOutputParameter(2, "cifti-out", "the output cifti");
+
+    OptionalParameter* presmoothOpt = ret->createOptionalParameter(3, "-presmooth", "smooth the data before running TFCE");
+    presmoothOpt->addDoubleParameter(1, "surface-kernel", "the sigma for the gaussian surface smoothing kernel, in mm");
+    presmoothOpt->addDoubleParameter(2, "volume-kernel", "the sigma for the gaussian volume smoothing kernel, in mm");
+
+    OptionalParameter* roiOpt = ret->createOptionalParameter(4, "-cifti-roi", "select a region of interest to run TFCE on");
+    roiOpt->addCiftiParameter(1, "roi-cifti", "the area to run TFCE on, as a cifti file");
+
+    OptionalParameter* surfParamsOpt = ret->createOptionalParameter(5, "-surface-parameters", "set parameters for the TFCE integral on surfaces");
+    surfParamsOpt->addDoubleParameter(1, "E", "exponent for cluster area (default 1.0)");
+    surfParamsOpt->addDoubleParameter(2, "H", "exponent for threshold value (default 2.0)");
+
+    OptionalParameter* volParamsOpt = ret->createOptionalParameter(6, "-volume-parameters", "set parameters for the TFCE integral in volume");
+    volParamsOpt->addDoubleParameter(1, "E", "exponent for cluster volume (default 0.5)");
+    volParamsOpt->addDoubleParameter(2, "H", "exponent for threshold value (default 2.0)");
+
+    OptionalParameter* leftSurfOpt = ret->createOptionalParameter(7, "-left-surface", "specify the left surface to use");
+    leftSurfOpt->addSurfaceParameter(1, "surface", "the left surface file");
+    OptionalParameter* leftCorrAreasOpt = leftSurfOpt->createOptionalParameter(2, "-corrected-areas", "vertex areas to use instead of computing them from the surface");
+    leftCorrAreasOpt->addMetricParameter(1, "area-metric", "the corrected vertex areas, as a metric");
+
+    OptionalParameter* rightSurfOpt = ret->createOptionalParameter(8, "-right-surface", "specify the right surface to use");
+    rightSurfOpt->addSurfaceParameter(1, "surface", "the right surface file");
+    OptionalParameter* rightCorrAreasOpt = rightSurfOpt->createOptionalParameter(2, "-corrected-areas", "vertex areas to use instead of computing them from the surface");
+    rightCorrAreasOpt->addMetricParameter(1, "area-metric", "the corrected vertex areas, as a metric");
+
+    OptionalParameter* cerebSurfaceOpt = ret->createOptionalParameter(9, "-cerebellum-surface", "specify the cerebellum surface to use");
+    cerebSurfaceOpt->addSurfaceParameter(1, "surface", "the cerebellum surface file");
+    OptionalParameter* cerebCorrAreasOpt = cerebSurfaceOpt->createOptionalParameter(2, "-corrected-areas", "vertex areas to use instead of computing them from the surface");
+    cerebCorrAreasOpt->addMetricParameter(1, "area-metric", "the corrected vertex areas, as a metric");
+
+    ret->createOptionalParameter(10, "-merged-volume", "treat volume components as if they were a single component");
+
+    OptionalParameter* signFlipOpt = ret->createOptionalParameter(11, "-sign-flip", "run a one-sample sign-flip permutation test across the maps");
+    signFlipOpt->addIntegerParameter(1, "permutations", "number of permutations, including the unpermuted data");
+    signFlipOpt->addStringParameter(2, "null-out", "output text file for the maximum absolute TFCE value of each permutation");
+    OptionalParameter* seedOpt = signFlipOpt->createOptionalParameter(3, "-seed", "specify the seed for the random sign flips");
+    seedOpt->addIntegerParameter(1, "seed", "the seed (default 0)");
+
+    ret->setHelpText(
+        AString("Threshold-free cluster enhancement is a method to increase the relative value of regions that would form clusters in a standard thresholding test.  ") +
+        "This is accomplished by evaluating the integral of:\n\n" +
+        "e(h, p)^E * h^H * dh\n\n" +
+        "at each brainordinate p, where h ranges from 0 to the maximum value in the data, and e(h, p) is the extent of the cluster containing brainordinate p at threshold h.  " +
+        "Negative values are similarly enhanced by negating the data, running the same process, and negating the result.  " +
+        "Clusters never cross between structures, and volume structures are kept separate unless -merged-volume is specified.\n\n" +
+        "The input cifti file must have a brain models mapping along columns, so each map is a column, as in .dscalar.nii and .dtseries.nii.  " +
+        "The ROI should have a brain models mapping along columns, exactly matching the mapping of the input file.  " +
+        "Data outside the ROI is ignored, and the output is zero there.\n\n" +
+        "When using -sign-flip, the input maps are treated as maps from different subjects, and the output is a single map, the TFCE of the one-sample t statistic across the input maps.  " +
+        "For each permutation, the signs of a random subset of the input maps are flipped, and the maximum absolute TFCE value of the resulting t map is written to the text file, one value per line.  " +
+        "The first permutation is the unpermuted data.  " +
+        "The familywise error corrected p-value of a brainordinate is the fraction of the permutation maximums that are at least as large as the absolute value of the output at that brainordinate.  " +
+        "Because surface and volume TFCE values use different units, consider running the surface and volume components separately (using -cifti-roi) when using the maximum across the whole file.\n\n" +
+        "The TFCE method is explained in: Smith SM, Nichols TE., \"Threshold-free cluster enhancement: addressing problems of smoothing, threshold dependence and localisation in cluster inference.\" Neuroimage. 2009 Jan 1;44(1):83-98. PMID: 18501637"
+    );
+    return ret;
+}
+
+void AlgorithmCiftiTFCE::useParameters(OperationParameters* myParams, ProgressObject* myProgObj)
+{
+    CiftiFile* myCifti = myParams->getCifti(1);
+    CiftiFile* myCiftiOut = myParams->getOutputCifti(2);
+    float surfPresmooth = 0.0f, volPresmooth = 0.0f;
+    OptionalParameter* presmoothOpt = myParams->getOptionalParameter(3);
+    if (presmoothOpt->m_present)
+    {
+        surfPresmooth = (float)presmoothOpt->getDouble(1);
+        volPresmooth = (float)presmoothOpt->getDouble(2);
+        if (surfPresmooth < 0.0f || volPresmooth < 0.0f) throw AlgorithmException("presmooth kernel sizes must not be negative");
+    }
+    CiftiFile* roiCifti = NULL;
+    OptionalParameter* roiOpt = myParams->getOptionalParameter(4);
+    if (roiOpt->m_present)
+    {
+        roiCifti = roiOpt->getCifti(1);
+    }
+    float surfParamE = 1.0f, surfParamH = 2.0f, volParamE = 0.5f, volParamH = 2.0f;
+    OptionalParameter* surfParamsOpt = myParams->getOptionalParameter(5);
+    if (surfParamsOpt->m_present)
+    {
+        surfParamE = (float)surfParamsOpt->getDouble(1);
+        surfParamH = (float)surfParamsOpt->getDouble(2);
+    }
+    OptionalParameter* volParamsOpt = myParams->getOptionalParameter(6);
+    if (volParamsOpt->m_present)
+    {
+        volParamE = (float)volParamsOpt->getDouble(1);
+        volParamH = (float)volParamsOpt->getDouble(2);
+    }
+    SurfaceFile* myLeftSurf = NULL, *myRightSurf = NULL, *myCerebSurf = NULL;
+    MetricFile* myLeftAreas = NULL, *myRightAreas = NULL, *myCerebAreas = NULL;
+    OptionalParameter* leftSurfOpt = myParams->getOptionalParameter(7);
+    if (leftSurfOpt->m_present)
+    {
+        myLeftSurf = leftSurfOpt->getSurface(1);
+        OptionalParameter* leftCorrAreasOpt = leftSurfOpt->getOptionalParameter(2);
+        if (leftCorrAreasOpt->m_present)
+        {
+            myLeftAreas = leftCorrAreasOpt->getMetric(1);
+        }
+    }
+    OptionalParameter* rightSurfOpt = myParams->getOptionalParameter(8);
+    if (rightSurfOpt->m_present)
+    {
+        myRightSurf = rightSurfOpt->getSurface(1);
+        OptionalParameter* rightCorrAreasOpt = rightSurfOpt->getOptionalParameter(2);
+        if (rightCorrAreasOpt->m_present)
+        {
+            myRightAreas = rightCorrAreasOpt->getMetric(1);
+        }
+    }
+    OptionalParameter* cerebSurfOpt = myParams->getOptionalParameter(9);
+    if (cerebSurfOpt->m_present)
+    {
+        myCerebSurf = cerebSurfOpt->getSurface(1);
+        OptionalParameter* cerebCorrAreasOpt = cerebSurfOpt->getOptionalParameter(2);
+        if (cerebCorrAreasOpt->m_present)
+        {
+            myCerebAreas = cerebCorrAreasOpt->getMetric(1);
+        }
+    }
+    bool mergedVolume = myParams->getOptionalParameter(10)->m_present;
+    int numPermutations = 0;
+    AString nullTextName;
+    int64_t seed = 0;
+    OptionalParameter* signFlipOpt = myParams->getOptionalParameter(11);
+    if (signFlipOpt->m_present)
+    {
+        numPermutations = (int)signFlipOpt->getInteger(1);
+        if (numPermutations < 1) throw AlgorithmException("number of permutations must be positive");
+        nullTextName = signFlipOpt->getString(2);
+        OptionalParameter* seedOpt = signFlipOpt->getOptionalParameter(3);
+        if (seedOpt->m_present)
+        {
+            seed = seedOpt->getInteger(1);
+        }
+    }
+    AlgorithmCiftiTFCE(myProgObj, myCifti, myCiftiOut, surfPresmooth, volPresmooth, roiCifti, surfParamE, surfParamH, volParamE, volParamH,
+                       myLeftSurf, myLeftAreas, myRightSurf, myRightAreas, myCerebSurf, myCerebAreas, mergedVolume, numPermutations, nullTextName, seed);
+}
+
+AlgorithmCiftiTFCE::AlgorithmCiftiTFCE(ProgressObject* myProgObj, const CiftiFile* myCifti, CiftiFile* myCiftiOut,
+                                       const float& surfPresmooth, const float& volPresmooth, const CiftiFile* roiCifti,
+                                       const float& surfParamE, const float& surfParamH, const float& volParamE, const float& volParamH,
+                                       const SurfaceFile* myLeftSurf, const MetricFile* myLeftAreas,
+                                       const SurfaceFile* myRightSurf, const MetricFile* myRightAreas,
+                                       const SurfaceFile* myCerebSurf, const MetricFile* myCerebAreas,
+                                       const bool& mergedVolume, const int& numPermutations, const AString& nullTextName, const int64_t& seed) : AbstractAlgorithm(myProgObj)
+{
+    LevelProgress myProgress(myProgObj);
+    const CiftiXML& myXML = myCifti->getCiftiXML();
+    if (myXML.getNumberOfDimensions() != 2) throw AlgorithmException("cifti tfce only supported on 2D cifti");
+    if (myXML.getMappingType(CiftiXML::ALONG_COLUMN) != CiftiMappingType::BRAIN_MODELS)
+    {
+        throw AlgorithmException("input cifti does not have brainordinates along columns");
+    }
+    const CiftiBrainModelsMap& myBrainMap = myXML.getBrainModelsMap(CiftiXML::ALONG_COLUMN);
+    if (roiCifti != NULL && myBrainMap != *(roiCifti->getCiftiXML().getMap(CiftiXML::ALONG_COLUMN)))
+    {
+        throw AlgorithmException("along-column mapping of roi cifti does not match the input cifti");
+    }
+    const vector<int64_t>& dims = myCifti->getDimensions();
+    const int64_t numMaps = dims[0], numBrainordinates = dims[1];
+    if (numPermutations > 0 && numMaps < 2) throw AlgorithmException("sign flipping requires at least 2 maps");
+    vector<StructureEnum::Enum> surfaceList = myBrainMap.getSurfaceStructureList();
+    for (int whichStruct = 0; whichStruct < (int)surfaceList.size(); ++whichStruct)
+    {//sanity check surfaces
+        const SurfaceFile* mySurf = NULL;
+        const MetricFile* myAreas = NULL;
+        AString surfType;
+        switch (surfaceList[whichStruct])
+        {
+            case StructureEnum::CORTEX_LEFT:
+                mySurf = myLeftSurf;
+                myAreas = myLeftAreas;
+                surfType = "left";
+                break;
+            case StructureEnum::CORTEX_RIGHT:
+                mySurf = myRightSurf;
+                myAreas = myRightAreas;
+                surfType = "right";
+                break;
+            case StructureEnum::CEREBELLUM:
+                mySurf = myCerebSurf;
+                myAreas = myCerebAreas;
+                surfType = "cerebellum";
+                break;
+            default:
+                throw AlgorithmException("found surface model with incorrect type: " + StructureEnum::toName(surfaceList[whichStruct]));
+                break;
+        }
+        if (mySurf == NULL)
+        {
+            throw AlgorithmException(surfType + " surface required but not provided");
+        }
+        if (mySurf->getNumberOfNodes() != myBrainMap.getSurfaceNumberOfNodes(surfaceList[whichStruct]))
+        {
+            throw AlgorithmException(surfType + " surface has the wrong number of vertices");
+        }
+        if (myAreas != NULL && myAreas->getNumberOfNodes() != mySurf->getNumberOfNodes())
+        {
+            throw AlgorithmException(surfType + " corrected areas metric has the wrong number of vertices");
+        }
+    }
+    vector<float> roiData;
+    if (roiCifti != NULL)
+    {
+        roiData.resize(numBrainordinates);
+        roiCifti->getColumn(roiData.data(), 0);
+    }
+    TFCEHelper myTFCE(numBrainordinates);
+    for (int whichStruct = 0; whichStruct < (int)surfaceList.size(); ++whichStruct)
+    {
+        const SurfaceFile* mySurf = NULL;
+        const MetricFile* myAreas = NULL;
+        switch (surfaceList[whichStruct])
+        {
+            case StructureEnum::CORTEX_LEFT:
+                mySurf = myLeftSurf;
+                myAreas = myLeftAreas;
+                break;
+            case StructureEnum::CORTEX_RIGHT:
+                mySurf = myRightSurf;
+                myAreas = myRightAreas;
+                break;
+            case StructureEnum::CEREBELLUM:
+                mySurf = myCerebSurf;
+                myAreas = myCerebAreas;
+                break;
+            default:
+                break;
+        }
+        vector<float> surfAreas;
+        const float* areaData = NULL;
+        if (myAreas == NULL)
+        {
+            mySurf->computeNodeAreas(surfAreas);
+            areaData = surfAreas.data();
+        } else {
+            areaData = myAreas->getValuePointerForColumn(0);
+        }
+        vector<int32_t> vertexToElement(mySurf->getNumberOfNodes(), -1);
+        vector<CiftiBrainModelsMap::SurfaceMap> surfMap = myBrainMap.getSurfaceMap(surfaceList[whichStruct]);
+        for (int64_t i = 0; i < (int64_t)surfMap.size(); ++i)
+        {
+            if (roiCifti == NULL || roiData[surfMap[i].m_ciftiIndex] > 0.0f)
+            {
+                vertexToElement[surfMap[i].m_surfaceNode] = (int32_t)surfMap[i].m_ciftiIndex;
+            }
+        }
+        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
+        myTFCE.addSurface(myTopoHelp, areaData, vertexToElement, surfParamE, surfParamH);
+    }
+    if (myBrainMap.hasVolumeData())
+    {
+        const VolumeSpace& mySpace = myBrainMap.getVolumeSpace();
+        const int64_t* volDims = mySpace.getDims();
+        Vector3D ivec, jvec, kvec, origin;
+        mySpace.getSpacingVectors(ivec, jvec, kvec, origin);
+        float voxelVolume = abs(ivec.dot(jvec.cross(kvec)));
+        vector<vector<CiftiBrainModelsMap::VolumeMap> > volumeParts;
+        if (mergedVolume)
+        {
+            volumeParts.push_back(myBrainMap.getFullVolumeMap());
+        } else {
+            vector<StructureEnum::Enum> volumeList = myBrainMap.getVolumeStructureList();
+            for (int whichStruct = 0; whichStruct < (int)volumeList.size(); ++whichStruct)
+            {
+                volumeParts.push_back(myBrainMap.getVolumeStructureMap(volumeList[whichStruct]));
+            }
+        }
+        vector<int32_t> voxelToElement(volDims[0] * volDims[1] * volDims[2], -1);
+        for (int whichPart = 0; whichPart < (int)volumeParts.size(); ++whichPart)
+        {
+            const vector<CiftiBrainModelsMap::VolumeMap>& thisPart = volumeParts[whichPart];
+            for (int64_t i = 0; i < (int64_t)thisPart.size(); ++i)
+            {
+                if (roiCifti == NULL || roiData[thisPart[i].m_ciftiIndex] > 0.0f)
+                {
+                    const int64_t* ijk = thisPart[i].m_ijk;
+                    voxelToElement[ijk[0] + volDims[0] * (ijk[1] + volDims[1] * ijk[2])] = (int32_t)thisPart[i].m_ciftiIndex;
+                }
+            }
+            myTFCE.addVolume(volDims, voxelVolume, voxelToElement, volParamE, volParamH);
+            for (int64_t i = 0; i < (int64_t)thisPart.size(); ++i)
+            {//reset only what we set, so structures don't connect to each other
+                const int64_t* ijk = thisPart[i].m_ijk;
+                voxelToElement[ijk[0] + volDims[0] * (ijk[1] + volDims[1] * ijk[2])] = -1;
+            }
+        }
+    }
+    const CiftiFile* toUse = myCifti;
+    CiftiFile smoothed;
+    if (surfPresmooth > 0.0f || volPresmooth > 0.0f)
+    {
+        AlgorithmCiftiSmoothing(NULL, myCifti, surfPresmooth, volPresmooth, CiftiXML::ALONG_COLUMN, &smoothed, myLeftSurf, myRightSurf, myCerebSurf,
+                                roiCifti, false, false, myLeftAreas, myRightAreas, myCerebAreas, mergedVolume);
+        toUse = &smoothed;
+    }
+    vector<float> mapData(numMaps * numBrainordinates), scratchRow(numMaps);//map-major, so each map is contiguous for TFCE
+    for (int64_t i = 0; i < numBrainordinates; ++i)
+    {
+        toUse->getRow(scratchRow.data(), i);
+        for (int64_t m = 0; m < numMaps; ++m)
+        {
+            mapData[m * numBrainordinates + i] = scratchRow[m];
+        }
+    }
+    if (numPermutations > 0)
+    {
+        CiftiXML outXML = myXML;
+        CiftiScalarsMap outScalars(1);
+        outScalars.setMapName(0, "TFCE of one-sample t");
+        outXML.setMap(CiftiXML::ALONG_ROW, outScalars);
+        myCiftiOut->setCiftiXML(outXML);
+        vector<const float*> maps(numMaps);
+        for (int64_t m = 0; m < numMaps; ++m)
+        {
+            maps[m] = mapData.data() + m * numBrainordinates;
+        }
+        vector<float> tMap(numBrainordinates), outMap(numBrainordinates);
+        TFCEHelper::oneSampleT(maps, vector<float>(numMaps, 1.0f), numBrainordinates, tMap.data());
+        myTFCE.compute(tMap.data(), outMap.data());
+        for (int64_t i = 0; i < numBrainordinates; ++i)
+        {
+            myCiftiOut->setRow(outMap.data() + i, i);
+        }
+        vector<float> nullDist;
+        myTFCE.signFlipMaxNull(maps, numPermutations, seed, nullDist);
+        TFCEHelper::writeNullDistribution(nullTextName, nullDist);
+    } else {
+        myCiftiOut->setCiftiXML(myXML);
+        vector<float> outData(numMaps * numBrainordinates);
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int64_t m = 0; m < numMaps; ++m)
+        {
+            myTFCE.compute(mapData.data() + m * numBrainordinates, outData.data() + m * numBrainordinates);
+        }
+        for (int64_t i = 0; i < numBrainordinates; ++i)
+        {
+            for (int64_t m = 0; m < numMaps; ++m)
+            {
+                scratchRow[m] = outData[m * numBrainordinates + i];
+            }
+            myCiftiOut->setRow(scratchRow.data(), i);
+        }
+    }
+}
+
+float AlgorithmCiftiTFCE::getAlgorithmInternalWeight()
+{
+    return 1.0f;//override this if needed, if the progress bar isn't smooth
+}
+
+float AlgorithmCiftiTFCE::getSubAlgorithmWeight()
+{
+    return AlgorithmCiftiSmoothing::getAlgorithmWeight();
+}
@@ -0,0 +1,52 @@
+#ifndef __ALGORITHM_CIFTI_TFCE_H__
+#define __ALGORITHM_CIFTI_TFCE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AbstractAlgorithm.h"
+
+namespace caret {
+
+    class AlgorithmCiftiTFCE : public AbstractAlgorithm
+    {
+        AlgorithmCiftiTFCE();
+    protected:
+        static float getSubAlgorithmWeight();
+        static float getAlgorithmInternalWeight();
+    public:
+        AlgorithmCiftiTFCE(ProgressObject* myProgObj, const CiftiFile* myCifti, CiftiFile* myCiftiOut,
+                           const float& surfPresmooth = 0.0f, const float& volPresmooth = 0.0f, const CiftiFile* roiCifti = NULL,
+                           const float& surfParamE = 1.0f, const float& surfParamH = 2.0f, const float& volParamE = 0.5f, const float& volParamH = 2.0f,
+                           const SurfaceFile* myLeftSurf = NULL, const MetricFile* myLeftAreas = NULL,
+                           const SurfaceFile* myRightSurf = NULL, const MetricFile* myRightAreas = NULL,
+                           const SurfaceFile* myCerebSurf = NULL, const MetricFile* myCerebAreas = NULL,
+                           const bool& mergedVolume = false, const int& numPermutations = 0, const AString& nullTextName = "", const int64_t& seed = 0);
+        static OperationParameters* getParameters();
+        static void useParameters(OperationParameters* myParams, ProgressObject* myProgObj);
+        static AString getCommandSwitch();
+        static AString getShortDescription();
+    };
+
+    typedef TemplateAutoOperation<AlgorithmCiftiTFCE> AutoAlgorithmCiftiTFCE;
+
+}
+
+#endif //__ALGORITHM_CIFTI_TFCE_H__
@@ -22,6 +22,12 @@
 #include "AlgorithmException.h"
 #include "CiftiFile.h"
 
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+#include <algorithm>
+
 using namespace caret;
 using namespace std;
 
@@ -47,7 +53,9 @@ OperationParameters* AlgorithmCiftiTranspose::getParameters()
     
     ret->setHelpText(
         AString("The input must be a 2-dimensional cifti file.  ") +
-        "The output is a cifti file where every row in the input is a column in the output."
+        "The output is a cifti file where every row in the input is a column in the output.  " +
+        "If the output does not fit in the memory limit, the input is read once and written transposed in pieces to a temporary file " +
+        "in the same directory as the output, which needs free space equal to the uncompressed size of the input."
     );
     return ret;
 }
@@ -69,6 +77,103 @@ void AlgorithmCiftiTranspose::useParameters(OperationParameters* myParams, Progr
     AlgorithmCiftiTranspose(myProgObj, ciftiIn, ciftiOut, memLimitGB);
 }
 
+namespace
+{
+    const int64_t IO_CHUNK = 1<<30;//qt4 uses int for sizes
+    const int64_t ROW_GROUP = 16;//input rows transposed together, so writes into a tile are a cache line at a time
+    
+    void writeAll(QFile& file, const char* data, const int64_t& count)
+    {
+        for (int64_t done = 0; done < count; done += IO_CHUNK)
+        {
+            int64_t toWrite = min(IO_CHUNK, count - done);
+            if (file.write(data + done, toWrite) != toWrite)
+            {
+                throw AlgorithmException("failed to write to temporary file '" + file.fileName() + "'");
+            }
+        }
+    }
+    
+    void readAll(QFile& file, char* data, const int64_t& count)
+    {
+        for (int64_t done = 0; done < count; done += IO_CHUNK)
+        {
+            int64_t toRead = min(IO_CHUNK, count - done);
+            if (file.read(data + done, toRead) != toRead)
+            {
+                throw AlgorithmException("failed to read from temporary file '" + file.fileName() + "'");
+            }
+        }
+    }
+    
+    ///for when the output doesn't fit in memory and the input is on disk: read the input once, in tiles of whole rows, and write each tile transposed to a temporary file
+    ///a chunk of output rows is then a contiguous piece of every tile, so every byte of the temporary file is read once (with a seek per tile per chunk), and total IO is about twice the file size
+    void transposeThroughTiles(const CiftiFile* ciftiIn, CiftiFile* ciftiOut, const int64_t& memLimitBytes, const int64_t& numCacheRows)
+    {
+        const int64_t inRows = ciftiIn->getNumberOfRows(), inColumns = ciftiIn->getNumberOfColumns();//output has inColumns rows of length inRows
+        int64_t tileRows = memLimitBytes / (inColumns * (int64_t)sizeof(float));
+        if (tileRows < 1) tileRows = 1;
+        if (tileRows > inRows) tileRows = inRows;
+        AString tempTemplate = QDir::tempPath() + "/wb_cifti_transpose.XXXXXX";
+        if (!ciftiOut->isInMemory() && ciftiOut->getFileName() != "")
+        {//temp is often small or in memory, and this is the size of the whole file
+            QFileInfo outInfo(ciftiOut->getFileName());
+            tempTemplate = outInfo.absolutePath() + "/." + outInfo.fileName() + ".transpose.XXXXXX";
+        }
+        QTemporaryFile tempFile(tempTemplate);
+        if (!tempFile.open())
+        {
+            throw AlgorithmException("failed to create temporary file '" + tempTemplate + "'");
+        }
+        {
+            vector<float> tile(tileRows * inColumns), rowGroup(ROW_GROUP * inColumns);
+            for (int64_t tileStart = 0; tileStart < inRows; tileStart += tileRows)
+            {
+                int64_t thisTileRows = min(tileRows, inRows - tileStart);
+                for (int64_t groupStart = 0; groupStart < thisTileRows; groupStart += ROW_GROUP)
+                {
+                    int64_t groupRows = min(ROW_GROUP, thisTileRows - groupStart);
+                    for (int64_t j = 0; j < groupRows; ++j)
+                    {
+                        ciftiIn->getRow(rowGroup.data() + j * inColumns, tileStart + groupStart + j);
+                    }
+                    for (int64_t k = 0; k < inColumns; ++k)
+                    {
+                        float* tileOut = tile.data() + k * thisTileRows + groupStart;
+                        for (int64_t j = 0; j < groupRows; ++j)
+                        {
+                            tileOut[j] = rowGroup[j * inColumns + k];
+                        }
+                    }
+                }
+                writeAll(tempFile, (const char*)tile.data(), thisTileRows * inColumns * sizeof(float));
+            }
+        }//free the tile before allocating the output chunk
+        vector<vector<float> > cacheRows(numCacheRows, vector<float>(inRows));
+        for (int64_t i = 0; i < inColumns; i += numCacheRows)
+        {
+            int64_t end = min(i + numCacheRows, inColumns);
+            for (int64_t tileStart = 0; tileStart < inRows; tileStart += tileRows)
+            {
+                int64_t thisTileRows = min(tileRows, inRows - tileStart);
+                int64_t tileOffset = tileStart * inColumns * sizeof(float);//all earlier tiles are full size
+                if (!tempFile.seek(tileOffset + i * thisTileRows * sizeof(float)))
+                {
+                    throw AlgorithmException("failed to seek in temporary file '" + tempFile.fileName() + "'");
+                }
+                for (int64_t k = i; k < end; ++k)
+                {
+                    readAll(tempFile, (char*)(cacheRows[k - i].data() + tileStart), thisTileRows * sizeof(float));
+                }
+            }
+            for (int64_t k = i; k < end; ++k)
+            {
+                ciftiOut->setRow(cacheRows[k - i].data(), k);
+            }
+        }
+    }
+}
+
 AlgorithmCiftiTranspose::AlgorithmCiftiTranspose(ProgressObject* myProgObj, const CiftiFile* ciftiIn, CiftiFile* ciftiOut, const float& memLimitGB) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
@@ -91,6 +196,11 @@ AlgorithmCiftiTranspose::AlgorithmCiftiTranspose(ProgressObject* myProgObj, cons
         if (numCacheRows < 1) numCacheRows = 1;
         if (numCacheRows > colSize) numCacheRows = colSize;
     }
+    if (numCacheRows < colSize && !ciftiIn->isInMemory())
+    {//re-reading an on-disk input for each chunk of output rows would be colSize / numCacheRows passes over the file, but an in-memory input is cheaper to reread than a temporary file
+        transposeThroughTiles(ciftiIn, ciftiOut, (int64_t)(memLimitGB * 1024 * 1024 * 1024), numCacheRows);
+        return;
+    }
     vector<vector<float> > cacheRows(numCacheRows, vector<float>(rowSize));
     vector<float> scratchInRow(colSize);
     for (int i = 0; i < colSize; i += numCacheRows)//loop through cache chunks
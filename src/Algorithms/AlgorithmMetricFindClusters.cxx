@@ -21,12 +21,16 @@
 #include "AlgorithmMetricFindClusters.h"
 #include "AlgorithmException.h"
 
+#include "CaretAssert.h"
 #include "CaretLogger.h"
+#include "CaretOMP.h"
+#include "ClusterLabelingHelper.h"
 #include "GeodesicHelper.h"
 #include "MetricFile.h"
 #include "SurfaceFile.h"
 #include "TopologyHelper.h"
 
+#include <algorithm>
 #include <vector>
 
 using namespace caret;
@@ -145,19 +149,11 @@ void AlgorithmMetricFindClusters::useParameters(OperationParameters* myParams, P
 
 namespace
 {
-    struct Cluster
-    {
-        Cluster() { area = 0.0; }
-        vector<int32_t> members;
-        double area;
-    };
-    
-    void processColumn(const float* data, const float* roiData, const float* nodeAreas, TopologyHelper* myTopoHelp, GeodesicHelper* myGeoHelp,
-                       const float& threshVal, const float& minArea, const bool& lessThan, const float& areaRatio, const float& distanceCutoff,
-                       float* outData, int& markVal)
+    void labelColumn(const float* data, const float* roiData, const float* nodeAreas, const TopologyHelper* myTopoHelp, const float& threshVal, const bool& lessThan,
+                     ClusterLabelingHelper::Components& components)
     {
         int numNodes = myTopoHelp->getNumberOfNodes();
-        vector<int> marked(numNodes, 0);
+        vector<char> marked(numNodes, 0);
         if (lessThan)
         {
             for (int i = 0; i < numNodes; ++i)
@@ -176,48 +172,52 @@ namespace
                 }
             }
         }
-        vector<Cluster> clusters;
+        ClusterLabelingHelper::labelSurface(myTopoHelp, marked, nodeAreas, components);
+    }
+    
+    void markColumn(const ClusterLabelingHelper::Components& components, GeodesicHelper* myGeoHelp, const float& minArea, const float& areaRatio, const float& distanceCutoff,
+                    float* outData, int& markVal)
+    {
+        int numNodes = (int)components.m_labels.size();
+        int32_t numComponents = components.getNumberOfComponents();
+        vector<int32_t> clusters;//components that are big enough, in order of their lowest vertex
         float biggestSize = 0.0f;
         int biggestCluster = -1;
-        for (int i = 0; i < numNodes; ++i)
+        for (int32_t c = 0; c < numComponents; ++c)
         {
-            if (marked[i])
+            if (components.m_areas[c] > minArea)
             {
-                Cluster newCluster;
-                newCluster.members.push_back(i);
-                marked[i] = 0;//unmark it when added to list to prevent multiples
-                for (int index = 0; index < (int)newCluster.members.size(); ++index)//NOTE: vector grows inside loop
+                if (components.m_areas[c] > biggestSize)
                 {
-                    int node = newCluster.members[index];//keep list around so we can put it into the output immediately if it is large enough
-                    newCluster.area += nodeAreas[node];
-                    const vector<int32_t>& neighbors = myTopoHelp->getNodeNeighbors(node);
-                    int numNeigh = (int)neighbors.size();
-                    for (int n = 0; n < numNeigh; ++n)
-                    {
-                        const int32_t& neighbor = neighbors[n];
-                        if (marked[neighbor])
-                        {
-                            newCluster.members.push_back(neighbor);
-                            marked[neighbor] = 0;
-                        }
-                    }
-                }
-                if (newCluster.area > minArea)
-                {
-                    if (newCluster.area > biggestSize)
-                    {
-                        biggestSize = newCluster.area;
-                        biggestCluster = (int)clusters.size();
-                    }
-                    clusters.push_back(newCluster);
+                    biggestSize = components.m_areas[c];
+                    biggestCluster = (int)clusters.size();
                 }
+                clusters.push_back(c);
             }
         }
-        vector<int32_t> pathScratch;
-        vector<float> distScratch;
         if (!clusters.empty() && biggestCluster == -1) CaretLogWarning("clusters found, but none have positive area, check your vertex areas for negatives");
         if (biggestCluster != -1 && (distanceCutoff > 0.0f || areaRatio > 0.0f))
         {
+            vector<vector<int32_t> > members;
+            if (distanceCutoff > 0.0f)
+            {
+                vector<int> componentToCluster(numComponents, -1);
+                for (size_t i = 0; i < clusters.size(); ++i)
+                {
+                    componentToCluster[clusters[i]] = (int)i;
+                }
+                members.resize(clusters.size());
+                for (int i = 0; i < numNodes; ++i)
+                {
+                    int32_t label = components.m_labels[i];
+                    if (label >= 0 && componentToCluster[label] != -1)
+                    {
+                        members[componentToCluster[label]].push_back(i);
+                    }
+                }
+            }
+            vector<int32_t> pathScratch;
+            vector<float> distScratch;
             for (size_t i = 0; i < clusters.size(); ++i)
             {
                 if ((int)i != biggestCluster)
@@ -225,7 +225,7 @@ namespace
                     bool erase = false;
                     if (areaRatio > 0.0f)
                     {
-                        if ((clusters[i].area / biggestSize) < areaRatio)
+                        if ((components.m_areas[clusters[i]] / biggestSize) < areaRatio)
                         {
                             erase = true;
                         }
@@ -233,7 +233,7 @@ namespace
                     if (!erase && distanceCutoff > 0.0f)
                     {
                         CaretAssert(myGeoHelp != NULL);
-                        myGeoHelp->getPathBetweenNodeLists(clusters[i].members, clusters[biggestCluster].members, distanceCutoff, pathScratch, distScratch, true);
+                        myGeoHelp->getPathBetweenNodeLists(members[i], members[biggestCluster], distanceCutoff, pathScratch, distScratch, true);
                         if (pathScratch.empty())//empty path means no path found
                         {
                             erase = true;
@@ -242,12 +242,14 @@ namespace
                     if (erase)
                     {
                         clusters.erase(clusters.begin() + i);//remove it
+                        if (!members.empty()) members.erase(members.begin() + i);
                         --i;//don't skip a cluster
                         if (biggestCluster > (int)i) --biggestCluster;//don't lose track of the biggest cluster
                     }
                 }
             }
         }
+        vector<float> componentValues(numComponents, 0.0f);
         for (size_t i = 0; i < clusters.size(); ++i)
         {
             if (markVal == 0)
@@ -257,13 +259,14 @@ namespace
             }
             float tempVal = markVal;
             if ((int)tempVal != markVal) throw AlgorithmException("too many clusters, unable to mark them uniquely");
-            int numMembers = (int)clusters[i].members.size();
-            for (int index = 0; index < numMembers; ++index)
-            {
-                outData[clusters[i].members[index]] = tempVal;
-            }
+            componentValues[clusters[i]] = tempVal;
             ++markVal;
         }
+        for (int i = 0; i < numNodes; ++i)
+        {
+            int32_t label = components.m_labels[i];
+            outData[i] = (label < 0 ? 0.0f : componentValues[label]);
+        }
     }
 }
 
@@ -315,8 +318,7 @@ AlgorithmMetricFindClusters::AlgorithmMetricFindClusters(ProgressObject* myProgO
             myGeoHelp.grabNew(new GeodesicHelper(myGeoBase));
         }
     }
-    vector<int> toSearch;
-    int markVal = startVal;//give each cluster a different value, including across maps
+    vector<int> inColumns;//every column to process, in the order their clusters are numbered
     if (columnNum == -1)
     {
         myMetricOut->setNumberOfNodesAndColumns(numNodes, numCols);
@@ -324,19 +326,35 @@ AlgorithmMetricFindClusters::AlgorithmMetricFindClusters(ProgressObject* myProgO
         for (int c = 0; c < numCols; ++c)
         {
             myMetricOut->setColumnName(c, myMetric->getColumnName(c));
-            vector<float> outData(numNodes, 0.0f);
-            const float* data = myMetric->getValuePointerForColumn(c);
-            processColumn(data, roiData, nodeAreas, myTopoHelp, myGeoHelp, threshVal, minArea, lessThan, areaRatio, distanceCutoff, outData.data(), markVal);
-            myMetricOut->setValuesForColumn(c, outData.data());
+            inColumns.push_back(c);
         }
     } else {
         myMetricOut->setNumberOfNodesAndColumns(numNodes, 1);
         myMetricOut->setStructure(mySurf->getStructure());
         myMetricOut->setColumnName(0, myMetric->getColumnName(columnNum));
-        vector<float> outData(numNodes, 0.0f);
-        const float* data = myMetric->getValuePointerForColumn(columnNum);
-        processColumn(data, roiData, nodeAreas, myTopoHelp, myGeoHelp, threshVal, minArea, lessThan, areaRatio, distanceCutoff, outData.data(), markVal);
-        myMetricOut->setValuesForColumn(0, outData.data());
+        inColumns.push_back(columnNum);
+    }
+    int markVal = startVal;//give each cluster a different value, including across maps
+    int numInColumns = (int)inColumns.size();
+    int columnsPerChunk = 1;//label a chunk of columns in parallel, then number the clusters in column order, so the marking doesn't depend on threads
+#ifdef CARET_OMP
+    columnsPerChunk = omp_get_max_threads();
+#endif
+    vector<float> outData(numNodes, 0.0f);
+    for (int chunkStart = 0; chunkStart < numInColumns; chunkStart += columnsPerChunk)
+    {
+        int chunkEnd = min(chunkStart + columnsPerChunk, numInColumns);
+        vector<ClusterLabelingHelper::Components> chunkComponents(chunkEnd - chunkStart);
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int c = chunkStart; c < chunkEnd; ++c)
+        {
+            labelColumn(myMetric->getValuePointerForColumn(inColumns[c]), roiData, nodeAreas, myTopoHelp, threshVal, lessThan, chunkComponents[c - chunkStart]);
+        }
+        for (int c = chunkStart; c < chunkEnd; ++c)
+        {
+            markColumn(chunkComponents[c - chunkStart], myGeoHelp, minArea, areaRatio, distanceCutoff, outData.data(), markVal);
+            myMetricOut->setValuesForColumn(c, outData.data());
+        }
     }
     if (endVal != NULL) *endVal = markVal;
 }
@@ -27,6 +27,8 @@
 #include "SurfaceFile.h"
 #include "SurfaceResamplingHelper.h"
 
+#include <algorithm>
+
 using namespace caret;
 using namespace std;
 
@@ -200,13 +202,40 @@ AlgorithmMetricResample::AlgorithmMetricResample(ProgressObject* myProgObj, cons
     {
         metricOut->setColumnName(i, metricIn->getColumnName(i));
         *metricOut->getPaletteColorMapping(i) = *metricIn->getPaletteColorMapping(i);
-        if (largest)
+    }
+    if (largest)
+    {
+        for (int i = 0; i < numColumns; ++i)
         {
             myHelp.resampleLargest(metricIn->getValuePointerForColumn(i), colScratch.data());
-        } else {
-            myHelp.resampleNormal(metricIn->getValuePointerForColumn(i), colScratch.data());
+            metricOut->setValuesForColumn(i, colScratch.data());
+        }
+    } else {//interleave blocks of columns, so each pass over the weights does many columns
+        const int COLUMN_BLOCK = 32;
+        const int blockSize = min(numColumns, COLUMN_BLOCK);
+        const int numOldNodes = metricIn->getNumberOfNodes();
+        vector<float> interleavedIn((int64_t)numOldNodes * blockSize), interleavedOut((int64_t)numNewNodes * blockSize);
+        for (int colBase = 0; colBase < numColumns; colBase += COLUMN_BLOCK)
+        {
+            const int colCount = min(COLUMN_BLOCK, numColumns - colBase);
+            for (int c = 0; c < colCount; ++c)
+            {
+                const float* inColumn = metricIn->getValuePointerForColumn(colBase + c);
+                for (int j = 0; j < numOldNodes; ++j)
+                {
+                    interleavedIn[(int64_t)j * colCount + c] = inColumn[j];
+                }
+            }
+            myHelp.resampleNormalInterleaved(interleavedIn.data(), interleavedOut.data(), colCount);
+            for (int c = 0; c < colCount; ++c)
+            {
+                for (int j = 0; j < numNewNodes; ++j)
+                {
+                    colScratch[j] = interleavedOut[(int64_t)j * colCount + c];
+                }
+                metricOut->setValuesForColumn(colBase + c, colScratch.data());
+            }
         }
-        metricOut->setValuesForColumn(i, colScratch.data());
     }
 }
 
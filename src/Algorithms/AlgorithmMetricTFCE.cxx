@@ -23,14 +23,12 @@
 
 #include "AlgorithmMetricSmoothing.h"
 #include "CaretAssert.h"
-#include "CaretHeap.h"
 #include "CaretOMP.h"
 #include "MetricFile.h"
 #include "SurfaceFile.h"
+#include "TFCEHelper.h"
 #include "TopologyHelper.h"
 
-#include <cmath>
-#include <set>
 #include <vector>
 
 using namespace caret;
@@ -72,6 +70,12 @@ OperationParameters* AlgorithmMetricTFCE::getParameters()
     OptionalParameter* corrAreaOpt = ret->createOptionalParameter(8, "-corrected-areas", "vertex areas to use instead of computing them from the surface");
     corrAreaOpt->addMetricParameter(1, "area-metric", "the corrected vertex areas, as a metric");
     
+    OptionalParameter* signFlipOpt = ret->createOptionalParameter(9, "-sign-flip", "run a one-sample sign-flip permutation test across the columns");
+    signFlipOpt->addIntegerParameter(1, "permutations", "number of permutations, including the unpermuted data");
+    signFlipOpt->addStringParameter(2, "null-out", "output text file for the maximum absolute TFCE value of each permutation");
+    OptionalParameter* seedOpt = signFlipOpt->createOptionalParameter(3, "-seed", "specify the seed for the random sign flips");
+    seedOpt->addIntegerParameter(1, "seed", "the seed (default 0)");
+    
     ret->setHelpText(
         AString("Threshold-free cluster enhancement is a method to increase the relative value of regions that would form clusters in a standard thresholding test.  ") +
         "This is accomplished by evaluating the integral of:\n\n" +
@@ -80,6 +84,10 @@ OperationParameters* AlgorithmMetricTFCE::getParameters()
         "Negative values are similarly enhanced by negating the data, running the same process, and negating the result.\n\n" +
         "When using -presmooth with -corrected-areas, note that it is an approximate correction within the smoothing algorithm (the TFCE correction is exact).  " +
         "Doing smoothing on individual surfaces before averaging/TFCE is preferred, when possible, in order to better tie the smoothing kernel size to the original feature size.\n\n" +
+        "When using -sign-flip, the input columns are treated as maps from different subjects, and the output is a single column, the TFCE of the one-sample t statistic across the input columns.  " +
+        "For each permutation, the signs of a random subset of the input columns are flipped, and the maximum absolute TFCE value of the resulting t map is written to the text file, one value per line.  " +
+        "The first permutation is the unpermuted data.  " +
+        "The familywise error corrected p-value of a vertex is the fraction of the permutation maximums that are at least as large as the absolute value of the output at that vertex.\n\n" +
         "The TFCE method is explained in: Smith SM, Nichols TE., \"Threshold-free cluster enhancement: addressing problems of smoothing, threshold dependence and localisation in cluster inference.\" Neuroimage. 2009 Jan 1;44(1):83-98. PMID: 18501637"
     );
     return ret;
@@ -126,17 +134,39 @@ void AlgorithmMetricTFCE::useParameters(OperationParameters* myParams, ProgressO
     {
         corrAreaMetric = corrAreaOpt->getMetric(1);
     }
-    AlgorithmMetricTFCE(myProgObj, mySurf, myMetric, myMetricOut, presmooth, myRoi, param_e, param_h, columnNum, corrAreaMetric);
+    int numPermutations = 0;
+    AString nullTextName;
+    int64_t seed = 0;
+    OptionalParameter* signFlipOpt = myParams->getOptionalParameter(9);
+    if (signFlipOpt->m_present)
+    {
+        numPermutations = (int)signFlipOpt->getInteger(1);
+        if (numPermutations < 1) throw AlgorithmException("number of permutations must be positive");
+        nullTextName = signFlipOpt->getString(2);
+        OptionalParameter* seedOpt = signFlipOpt->getOptionalParameter(3);
+        if (seedOpt->m_present)
+        {
+            seed = seedOpt->getInteger(1);
+        }
+    }
+    AlgorithmMetricTFCE(myProgObj, mySurf, myMetric, myMetricOut, presmooth, myRoi, param_e, param_h, columnNum, corrAreaMetric, numPermutations, nullTextName, seed);
 }
 
 AlgorithmMetricTFCE::AlgorithmMetricTFCE(ProgressObject* myProgObj, const SurfaceFile* mySurf, const MetricFile* myMetric, MetricFile* myMetricOut, const float& presmooth,
-                                         const MetricFile* myRoi, const float& param_e, const float& param_h, const int& columnNum, const MetricFile* corrAreaMetric) : AbstractAlgorithm(myProgObj)
+                                         const MetricFile* myRoi, const float& param_e, const float& param_h, const int& columnNum, const MetricFile* corrAreaMetric,
+                                         const int& numPermutations, const AString& nullTextName, const int64_t& seed) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
     if (mySurf->getNumberOfNodes() != myMetric->getNumberOfNodes()) throw AlgorithmException("metric and surface have different number of vertices");
     if (myRoi != NULL && mySurf->getNumberOfNodes() != myRoi->getNumberOfNodes()) throw AlgorithmException("roi metric and surface have different number of vertices");
     if (corrAreaMetric != NULL && mySurf->getNumberOfNodes() != corrAreaMetric->getNumberOfNodes()) throw AlgorithmException("corrected area metric and surface have different number of vertices");
     if (columnNum < -1 || columnNum >= myMetric->getNumberOfColumns()) throw AlgorithmException("invalid column specified");
+    if (numPermutations > 0)
+    {
+        if (columnNum != -1) throw AlgorithmException("sign flipping uses all columns, it can't be used with a single column");
+        if (myMetric->getNumberOfColumns() < 2) throw AlgorithmException("sign flipping requires at least 2 columns");
+    }
+    int numNodes = mySurf->getNumberOfNodes();
     const float* roiData = NULL, *areaData = NULL;
     vector<float> surfAreaData;
     if (corrAreaMetric == NULL)
@@ -147,6 +177,16 @@ AlgorithmMetricTFCE::AlgorithmMetricTFCE(ProgressObject* myProgObj, const Surfac
         areaData = corrAreaMetric->getValuePointerForColumn(0);
     }
     if (myRoi != NULL) roiData = myRoi->getValuePointerForColumn(0);
+    TFCEHelper myTFCE(numNodes);
+    {
+        vector<int32_t> vertexToElement(numNodes, -1);
+        for (int i = 0; i < numNodes; ++i)
+        {
+            if (roiData == NULL || roiData[i] > 0.0f) vertexToElement[i] = i;
+        }
+        CaretPointer<TopologyHelper> myHelper = mySurf->getTopologyHelper();
+        myTFCE.addSurface(myHelper, areaData, vertexToElement, param_e, param_h);
+    }
     if (columnNum == -1)
     {
         const MetricFile* toUse = myMetric;
@@ -157,17 +197,35 @@ AlgorithmMetricTFCE::AlgorithmMetricTFCE(ProgressObject* myProgObj, const Surfac
             toUse = &postSmooth;
         }
         int numCols = myMetric->getNumberOfColumns();
-        myMetricOut->setNumberOfNodesAndColumns(mySurf->getNumberOfNodes(), numCols);
         myMetricOut->setStructure(mySurf->getStructure());
-#pragma omp CARET_PAR
+        if (numPermutations > 0)
         {
-            vector<float> outcol(mySurf->getNumberOfNodes(), 0.0f);
-#pragma omp CARET_FOR
+            vector<const float*> maps(numCols);
             for (int col = 0; col < numCols; ++col)
             {
-                processColumn(mySurf, toUse->getValuePointerForColumn(col), outcol.data(), roiData, param_e, param_h, areaData);
-                myMetricOut->setValuesForColumn(col, outcol.data());
-                myMetricOut->setMapName(col, myMetric->getMapName(col));
+                maps[col] = toUse->getValuePointerForColumn(col);
+            }
+            vector<float> tMap(numNodes), outcol(numNodes);
+            TFCEHelper::oneSampleT(maps, vector<float>(numCols, 1.0f), numNodes, tMap.data());
+            myTFCE.compute(tMap.data(), outcol.data());
+            myMetricOut->setNumberOfNodesAndColumns(numNodes, 1);
+            myMetricOut->setValuesForColumn(0, outcol.data());
+            myMetricOut->setMapName(0, "TFCE of one-sample t");
+            vector<float> nullDist;
+            myTFCE.signFlipMaxNull(maps, numPermutations, seed, nullDist);
+            TFCEHelper::writeNullDistribution(nullTextName, nullDist);
+        } else {
+            myMetricOut->setNumberOfNodesAndColumns(numNodes, numCols);
+#pragma omp CARET_PAR
+            {
+                vector<float> outcol(numNodes, 0.0f);
+#pragma omp CARET_FOR
+                for (int col = 0; col < numCols; ++col)
+                {
+                    myTFCE.compute(toUse->getValuePointerForColumn(col), outcol.data());
+                    myMetricOut->setValuesForColumn(col, outcol.data());
+                    myMetricOut->setMapName(col, myMetric->getMapName(col));
+                }
             }
         }
     } else {
@@ -180,198 +238,15 @@ AlgorithmMetricTFCE::AlgorithmMetricTFCE(ProgressObject* myProgObj, const Surfac
             toUse = &postSmooth;
             useCol = 0;
         }
-        myMetricOut->setNumberOfNodesAndColumns(mySurf->getNumberOfNodes(), 1);
+        myMetricOut->setNumberOfNodesAndColumns(numNodes, 1);
         myMetricOut->setStructure(mySurf->getStructure());
-        vector<float> outcol(mySurf->getNumberOfNodes(), 0.0f);
-        processColumn(mySurf, toUse->getValuePointerForColumn(useCol), outcol.data(), roiData, param_e, param_h, areaData);
+        vector<float> outcol(numNodes, 0.0f);
+        myTFCE.compute(toUse->getValuePointerForColumn(useCol), outcol.data());
         myMetricOut->setValuesForColumn(0, outcol.data());
         myMetricOut->setMapName(0, myMetric->getMapName(columnNum));
     }
 }
 
-void AlgorithmMetricTFCE::processColumn(const SurfaceFile* mySurf, const float* colData, float* outData, const float* roiData, const float& param_e, const float& param_h, const float* areaData)
-{
-    int numNodes = mySurf->getNumberOfNodes();
-    vector<double> accum(numNodes, 0.0);
-    CaretPointer<TopologyHelper> myHelper = mySurf->getTopologyHelper();
-    tfce_pos(myHelper, colData, accum.data(), roiData, param_e, param_h, areaData);
-    vector<float> negData(numNodes);
-    for (int i = 0; i < numNodes; ++i)
-    {
-        negData[i] = -colData[i];
-    }
-    tfce_pos(myHelper, negData.data(), accum.data(), roiData, param_e, param_h, areaData);//negatives and positives don't overlap, so reuse the accum array
-    for (int i = 0; i < numNodes; ++i)
-    {
-        if (roiData == NULL || roiData[i] > 0.0f)
-        {
-            if (colData[i] < 0.0f)
-            {
-                outData[i] = (float)-accum[i];
-            } else {
-                outData[i] = (float)accum[i];
-            }
-        } else {
-            outData[i] = 0.0f;
-        }
-    }
-}
-
-namespace
-{//hidden namespace just to make sure things don't collide
-    struct Cluster
-    {
-        double accumVal, totalArea;
-        vector<int> members;
-        float lastVal;
-        bool first;
-        Cluster()
-        {
-            first = true;
-            accumVal = 0.0;
-            totalArea = 0.0;
-        }
-        void addMember(const int& node, const float& val, const float& area, const float& param_e, const float& param_h)
-        {
-            update(val, param_e, param_h);
-            members.push_back(node);
-            totalArea += area;
-        }
-        void update(const float& bottomVal, const float& param_e, const float& param_h)
-        {
-            if (first)
-            {
-                lastVal = bottomVal;
-                first = false;
-            } else {
-                if (bottomVal != lastVal)//skip computing if there is no difference
-                {
-                    CaretAssert(bottomVal < lastVal);
-                    double integrated_h = param_h + 1.0f;//integral(x^h) = (x^(h + 1))/(h + 1) + C
-                    double newSlice = pow(totalArea, (double)param_e) * (pow((double)lastVal, integrated_h) - pow((double)bottomVal, integrated_h)) / integrated_h;
-                    accumVal += newSlice;
-                    lastVal = bottomVal;//computing in double precision, with float for inputs, puts the smallest difference between values far greater than the instability of the computation
-                }
-            }
-        }
-    };
-    
-    int allocCluster(vector<Cluster>& clusterList, set<int>& deadClusters)
-    {
-        if (deadClusters.empty())
-        {
-            clusterList.push_back(Cluster());
-            return (int)(clusterList.size() - 1);
-        } else {
-            set<int>::iterator iter = deadClusters.begin();
-            int ret = *iter;
-            deadClusters.erase(iter);
-            clusterList[ret] = Cluster();//reinitialize
-            return ret;
-        }
-    }
-}
-
-void AlgorithmMetricTFCE::tfce_pos(TopologyHelper* myHelper, const float* colData, double* accumData, const float* roiData, const float& param_e, const float& param_h, const float* areaData)
-{
-    int numNodes = myHelper->getNumberOfNodes();
-    vector<int> membership(numNodes, -1);//int is enough as long as numNodes is fine as an int, for obvious reasons
-    vector<Cluster> clusterList;
-    set<int> deadClusters;//to allow reallocation without changing indices
-    CaretSimpleMaxHeap<int, float> nodeHeap;
-    for (int i = 0; i < numNodes; ++i)
-    {
-        if ((roiData == NULL || roiData[i] > 0.0f) && colData[i] > 0.0f)
-        {
-            nodeHeap.push(i, colData[i]);
-        }
-    }
-    while (!nodeHeap.isEmpty())
-    {
-        float value;
-        int node = nodeHeap.pop(&value);
-        const vector<int32_t>& neighbors = myHelper->getNodeNeighbors(node);
-        int numNeigh = (int)neighbors.size();
-        set<int> touchingClusters;
-        for (int i = 0; i < numNeigh; ++i)
-        {
-            if (membership[neighbors[i]] != -1)
-            {
-                touchingClusters.insert(membership[neighbors[i]]);
-            }
-        }
-        int numTouching = (int)touchingClusters.size();
-        switch (numTouching)
-        {
-            case 0://make new cluster
-            {
-                int newCluster = allocCluster(clusterList, deadClusters);
-                clusterList[newCluster].addMember(node, value, areaData[node], param_e, param_h);
-                membership[node] = newCluster;
-                break;
-            }
-            case 1://add to cluster
-            {
-                int whichCluster = *(touchingClusters.begin());
-                clusterList[whichCluster].addMember(node, value, areaData[node], param_e, param_h);
-                membership[node] = whichCluster;
-                accumData[node] -= clusterList[whichCluster].accumVal;//the accum value is the current amount less than the peak value that the edge of the cluster has (this node is on the edge)
-                break;//so, when the cluster merges or reaches 0, we add the accum value to every member and zero the accum value of the merged cluster, and we get the correct value in the end (with far fewer flops than integrating everywhere)
-            }
-            default://merge all touching clusters
-            {
-                int mergedIndex = -1, biggestSize = 0;//find the biggest cluster (in number of members) and use as merged cluster, for optimization purposes
-                for (set<int>::iterator iter = touchingClusters.begin(); iter != touchingClusters.end(); ++iter)
-                {
-                    if ((int)clusterList[*iter].members.size() > biggestSize)
-                    {
-                        mergedIndex = *iter;
-                        biggestSize = (int)clusterList[*iter].members.size();
-                    }
-                }
-                CaretAssertVectorIndex(clusterList, mergedIndex);
-                Cluster& mergedCluster = clusterList[mergedIndex];
-                mergedCluster.update(value, param_e, param_h);//recalculate to align cluster bottoms
-                for (set<int>::iterator iter = touchingClusters.begin(); iter != touchingClusters.end(); ++iter)
-                {
-                    if (*iter != mergedIndex)//if we are the largest cluster, don't modify the per-vertex accum for members, so merges between small and large clusters are cheap
-                    {
-                        Cluster& thisCluster = clusterList[*iter];
-                        thisCluster.update(value, param_e, param_h);//recalculate to align cluster bottoms
-                        int numMembers = (int)thisCluster.members.size();
-                        double correctionVal = thisCluster.accumVal - mergedCluster.accumVal;//fix the accum values in the side cluster so we can add the merged cluster's accum to everything at the end
-                        for (int j = 0; j < numMembers; ++j)//add the correction value to every member so that we have the current integrated values correct
-                        {
-                            accumData[thisCluster.members[j]] += correctionVal;//apply the correction
-                            membership[thisCluster.members[j]] = mergedIndex;//change the membership lookup
-                        }
-                        mergedCluster.members.insert(mergedCluster.members.end(), thisCluster.members.begin(), thisCluster.members.end());//copy all members
-                        mergedCluster.totalArea += thisCluster.totalArea;
-                        deadClusters.insert(*iter);//kill it
-                        vector<int>().swap(clusterList[*iter].members);//also try to deallocate member list
-                    }
-                }
-                mergedCluster.addMember(node, value, areaData[node], param_e, param_h);//will not trigger recomputation, we already recomputed at this value
-                accumData[node] -= mergedCluster.accumVal;//the vertex they merge on must not get the peak value of the cluster, obviously, so again, record its difference from peak
-                membership[node] = mergedIndex;
-                break;//NOTE: do not reset the accum value of the merged cluster, we specifically avoided modifying the per-vertex accum for its members, so the cluster accum is still in play
-            }
-        }
-    }
-    int listSize = (int)clusterList.size();//final cleanup of accum values
-    for (int i = 0; i < listSize; ++i)
-    {
-        if (deadClusters.find(i) != deadClusters.end()) continue;//ignore clusters that don't exist
-        Cluster& thisCluster = clusterList[i];
-        thisCluster.update(0.0f, param_e, param_h);//update to include the to-zero slice
-        int numMembers = (int)thisCluster.members.size();
-        for (int j = 0; j < numMembers; ++j)
-        {
-            accumData[thisCluster.members[j]] += thisCluster.accumVal;//add the resulting slice to all members - their stored data contains the offset between the cluster peak and their corect value
-        }
-    }
-}
-
 float AlgorithmMetricTFCE::getAlgorithmInternalWeight()
 {
     return 1.0f;//override this if needed, if the progress bar isn't smooth
@@ -88,8 +88,8 @@ AlgorithmSurfaceMatch::useParameters(OperationParameters* myParams,
                                           ProgressObject* myProgObj)
 {
     try {
-        SurfaceFile* matchSurfaceFile = myParams->getSurface(1);
-        SurfaceFile* surfaceFile = myParams->getSurface(2);
+        const SurfaceFile* matchSurfaceFile = myParams->getSurface(1);
+        const SurfaceFile* surfaceFile = myParams->getSurface(2);
         const AString outputSurfaceFileName = myParams->getString(3);
         
         /*
@@ -115,11 +115,12 @@ AlgorithmSurfaceMatch::useParameters(OperationParameters* myParams,
         /*
          * Constructs and executes the algorithm
          */
+        SurfaceFile outputSurfaceFile(*surfaceFile);//input files may be shared between commands (see CommandInputCache), so don't modify them
         AlgorithmSurfaceMatch(myProgObj,
                               matchSurfaceFile,
-                              surfaceFile);
+                              &outputSurfaceFile);
         
-        surfaceFile->writeFile(outputSurfaceFileName);
+        outputSurfaceFile.writeFile(outputSurfaceFileName);
     }
     catch (const DataFileException& dfe) {
         throw AlgorithmException(dfe);
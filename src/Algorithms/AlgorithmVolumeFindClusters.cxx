@@ -24,11 +24,15 @@
 #include "CaretAssert.h"
 #include "CaretLogger.h"
 #include "CaretPointer.h"
+#include "CaretOMP.h"
 #include "CaretPointLocator.h"
+#include "ClusterLabelingHelper.h"
 #include "VolumeFile.h"
 #include "VoxelIJK.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <vector>
 
 using namespace caret;
@@ -135,23 +139,10 @@ void AlgorithmVolumeFindClusters::useParameters(OperationParameters* myParams, P
 
 namespace
 {
-    void processSubvol(const float* inFrame, VolumeFile* volOut, const int64_t& outSubvol, const int64_t& outComponent, const float& threshValue, const float& minVolume,
-                       const bool& lessThan, const float* roiFrame, const float& sizeRatio, const float& distanceCutoff, int& markVal)
+    void labelSubvol(const float* inFrame, const int64_t dims[3], const float& threshValue, const bool& lessThan, const float* roiFrame,
+                     ClusterLabelingHelper::Components& components)
     {
-        vector<int64_t> dims = volOut->getDimensions();
         int64_t frameSize = dims[0] * dims[1] * dims[2];
-        const VolumeSpace& mySpace = volOut->getVolumeSpace();
-        Vector3D ivec, jvec, kvec, origin;
-        mySpace.getSpacingVectors(ivec, jvec, kvec, origin);
-        float voxelVolume = abs(ivec.dot(jvec.cross(kvec)));
-        int64_t minVoxels = (int64_t)ceil(minVolume / voxelVolume);
-        vector<VoxelIJK> neighbors;
-        neighbors.push_back(VoxelIJK(1, 0, 0));
-        neighbors.push_back(VoxelIJK(-1, 0, 0));
-        neighbors.push_back(VoxelIJK(0, 1, 0));
-        neighbors.push_back(VoxelIJK(0, -1, 0));
-        neighbors.push_back(VoxelIJK(0, 0, 1));
-        neighbors.push_back(VoxelIJK(0, 0, -1));
         vector<char> marked(frameSize, 0);
         if (lessThan)
         {
@@ -171,65 +162,67 @@ namespace
                 }
             }
         }
-        vector<vector<VoxelIJK> > clusters;
-        size_t biggestCount = 0;
+        ClusterLabelingHelper::labelVolume(dims, marked, components);
+    }
+    
+    void markSubvol(const ClusterLabelingHelper::Components& components, const VolumeSpace& mySpace, const float& minVolume,
+                    const float& sizeRatio, const float& distanceCutoff, float* outFrame, int& markVal)
+    {
+        const int64_t* dims = mySpace.getDims();
+        int64_t frameSize = dims[0] * dims[1] * dims[2];
+        Vector3D ivec, jvec, kvec, origin;
+        mySpace.getSpacingVectors(ivec, jvec, kvec, origin);
+        float voxelVolume = abs(ivec.dot(jvec.cross(kvec)));
+        int64_t minVoxels = (int64_t)ceil(minVolume / voxelVolume);
+        int32_t numComponents = components.getNumberOfComponents();
+        vector<int32_t> clusters;//components that are big enough, in the order a scan of the volume finds them
+        int64_t biggestCount = 0;
         int64_t biggestCluster = -1;
-        for (int64_t k = 0; k < dims[2]; ++k)
+        for (int32_t c = 0; c < numComponents; ++c)
         {
-            for (int64_t j = 0; j < dims[1]; ++j)
+            if (components.m_counts[c] >= minVoxels)
             {
-                for (int64_t i = 0; i < dims[0]; ++i)
+                if (components.m_counts[c] > biggestCount)
                 {
-                    int64_t myIndex = mySpace.getIndex(i, j, k);
-                    if (marked[myIndex])
-                    {
-                        vector<VoxelIJK> voxelList;
-                        voxelList.push_back(VoxelIJK(i, j, k));
-                        marked[myIndex] = 0;//don't let voxels get duplicated in the list
-                        for (int64_t index = 0; index < (int64_t)voxelList.size(); ++index)//NOTE: vector grows inside loop
-                        {
-                            const VoxelIJK& thisVoxel = voxelList[index];
-                            for (int n = 0; n < (int)neighbors.size(); ++n)
-                            {
-                                VoxelIJK neighVox(thisVoxel.m_ijk[0] + neighbors[n].m_ijk[0],
-                                                    thisVoxel.m_ijk[1] + neighbors[n].m_ijk[1],
-                                                    thisVoxel.m_ijk[2] + neighbors[n].m_ijk[2]);
-                                if (mySpace.indexValid(neighVox.m_ijk))
-                                {
-                                    int64_t neighIndex = mySpace.getIndex(neighVox.m_ijk);
-                                    if (marked[neighIndex])
-                                    {
-                                        voxelList.push_back(neighVox);
-                                        marked[neighIndex] = 0;
-                                    }
-                                }
-                            }
-                        }
-                        if ((int64_t)voxelList.size() >= minVoxels)
-                        {
-                            if (voxelList.size() > biggestCount)
-                            {
-                                biggestCount = voxelList.size();
-                                biggestCluster = (int64_t)clusters.size();
-                            }
-                            clusters.push_back(voxelList);
-                        }
-                    }
+                    biggestCount = components.m_counts[c];
+                    biggestCluster = (int64_t)clusters.size();
                 }
+                clusters.push_back(c);
             }
         }
         if (!clusters.empty()) CaretAssert(biggestCluster != -1);
         if (biggestCluster != -1 && (distanceCutoff > 0.0f || sizeRatio > 0.0f))
         {
+            vector<vector<VoxelIJK> > members;
             CaretPointer<CaretPointLocator> myLocator;
             if (distanceCutoff > 0.0f)
             {
+                vector<int64_t> componentToCluster(numComponents, -1);
+                for (size_t i = 0; i < clusters.size(); ++i)
+                {
+                    componentToCluster[clusters[i]] = (int64_t)i;
+                }
+                members.resize(clusters.size());
+                for (int64_t k = 0; k < dims[2]; ++k)
+                {
+                    for (int64_t j = 0; j < dims[1]; ++j)
+                    {
+                        for (int64_t i = 0; i < dims[0]; ++i)
+                        {
+                            int32_t label = components.m_labels[mySpace.getIndex(i, j, k)];
+                            if (label >= 0 && componentToCluster[label] != -1)
+                            {
+                                members[componentToCluster[label]].push_back(VoxelIJK(i, j, k));
+                            }
+                        }
+                    }
+                }
                 vector<float> biggestCoords;//gather coordinates of biggest cluster voxels
                 biggestCoords.reserve(biggestCount * 3);
-                for (size_t i = 0; i < clusters[biggestCluster].size(); ++i)
+                for (size_t i = 0; i < members[biggestCluster].size(); ++i)
                 {
                     float thisCoord[3];
-                    mySpace.indexToSpace(clusters[biggestCluster][i].m_ijk, thisCoord);
+                    mySpace.indexToSpace(members[biggestCluster][i].m_ijk, thisCoord);
                     biggestCoords.push_back(thisCoord[0]);
                     biggestCoords.push_back(thisCoord[1]);
                     biggestCoords.push_back(thisCoord[2]);
@@ -241,17 +234,17 @@ namespace
                 if ((int64_t)i != biggestCluster)
                 {
                     bool erase = false;
-                    if (sizeRatio > 0.0f && ((float)clusters[i].size()) / biggestCount < sizeRatio)
+                    if (sizeRatio > 0.0f && ((float)components.m_counts[clusters[i]]) / biggestCount < sizeRatio)
                     {
                         erase = true;
                     }
                     if (!erase && distanceCutoff > 0.0f)
                     {
                         erase = true;//erase unless we find a point close enough to the biggest cluster
-                        for (size_t j = 0; j < clusters[i].size(); ++j)
+                        for (size_t j = 0; j < members[i].size(); ++j)
                         {
                             float thisCoord[3];
-                            mySpace.indexToSpace(clusters[i][j].m_ijk, thisCoord);
+                            mySpace.indexToSpace(members[i][j].m_ijk, thisCoord);
                             int32_t ret = myLocator->closestPointLimited(thisCoord, distanceCutoff);
                             if (ret == -1)
                             {
@@ -263,12 +256,14 @@ namespace
                     if (erase)
                     {
                         clusters.erase(clusters.begin() + i);//remove it
+                        if (!members.empty()) members.erase(members.begin() + i);
                         --i;//don't skip a cluster
                         if (biggestCluster > (int64_t)i) --biggestCluster;//don't lose track of the biggest cluster
                     }
                 }
             }
         }
+        vector<float> componentValues(numComponents, 0.0f);
         for (size_t i = 0; i < clusters.size(); ++i)
         {
             if (markVal == 0)
@@ -278,12 +273,14 @@ namespace
             }
             float tempVal = markVal;
             if ((int)tempVal != markVal) throw AlgorithmException("too many clusters, unable to mark them uniquely");
-            for (size_t index = 0; index < clusters[i].size(); ++index)
-            {
-                volOut->setValue(tempVal, clusters[i][index].m_ijk, outSubvol, outComponent);
-            }
+            componentValues[clusters[i]] = tempVal;
             ++markVal;
         }
+        for (int64_t i = 0; i < frameSize; ++i)
+        {
+            int32_t label = components.m_labels[i];
+            outFrame[i] = (label < 0 ? 0.0f : componentValues[label]);
+        }
     }
 }
 
@@ -304,28 +301,52 @@ AlgorithmVolumeFindClusters::AlgorithmVolumeFindClusters(ProgressObject* myProgO
         roiFrame = myRoi->getFrame();
     }
     vector<int64_t> dims = volIn->getDimensions();
-    int markVal = startVal;
+    int64_t frameSize = dims[0] * dims[1] * dims[2];
+    if (frameSize >= numeric_limits<int32_t>::max()) throw AlgorithmException("volume frame is too large to find clusters in");
+    vector<int64_t> frameInSubvols, frameOutSubvols, frameComponents;//every frame to process, in the order their clusters are numbered
     if (subvolNum == -1)
     {
         volOut->reinitialize(volIn->getOriginalDimensions(), volIn->getSform(), dims[4]);
-        volOut->setValueAllVoxels(0.0f);
         for (int64_t c = 0; c < dims[4]; ++c)
         {
             for (int64_t s = 0; s < dims[3]; ++s)
             {
-                const float* inFrame = volIn->getFrame(s, c);
-                processSubvol(inFrame, volOut, s, c, threshValue, minVolume, lessThan, roiFrame, sizeRatio, distanceCutoff, markVal);
+                frameInSubvols.push_back(s);
+                frameOutSubvols.push_back(s);
+                frameComponents.push_back(c);
             }
         }
     } else {
         vector<int64_t> outDims = volIn->getOriginalDimensions();
         outDims.resize(3);
         volOut->reinitialize(outDims, volIn->getSform(), dims[4]);
-        volOut->setValueAllVoxels(0.0f);
         for (int64_t c = 0; c < dims[4]; ++c)
         {
-            const float* inFrame = volIn->getFrame(subvolNum, c);
-            processSubvol(inFrame, volOut, 0, c, threshValue, minVolume, lessThan, roiFrame, sizeRatio, distanceCutoff, markVal);
+            frameInSubvols.push_back(subvolNum);
+            frameOutSubvols.push_back(0);
+            frameComponents.push_back(c);
+        }
+    }
+    int markVal = startVal;
+    int64_t numFrames = (int64_t)frameInSubvols.size();
+    int64_t framesPerChunk = 1;//label a chunk of frames in parallel, then number the clusters in frame order, so the marking doesn't depend on threads
+#ifdef CARET_OMP
+    framesPerChunk = omp_get_max_threads();
+#endif
+    vector<float> outFrame(frameSize);
+    for (int64_t chunkStart = 0; chunkStart < numFrames; chunkStart += framesPerChunk)
+    {
+        int64_t chunkEnd = min(chunkStart + framesPerChunk, numFrames);
+        vector<ClusterLabelingHelper::Components> chunkComponents(chunkEnd - chunkStart);
+#pragma omp CARET_PARFOR schedule(dynamic) if (chunkEnd - chunkStart > 1)
+        for (int64_t f = chunkStart; f < chunkEnd; ++f)
+        {//with only one frame, the labeling itself uses the threads
+            labelSubvol(volIn->getFrame(frameInSubvols[f], frameComponents[f]), dims.data(), threshValue, lessThan, roiFrame, chunkComponents[f - chunkStart]);
+        }
+        for (int64_t f = chunkStart; f < chunkEnd; ++f)
+        {
+            markSubvol(chunkComponents[f - chunkStart], mySpace, minVolume, sizeRatio, distanceCutoff, outFrame.data(), markVal);
+            volOut->setFrame(outFrame.data(), frameOutSubvols[f], frameComponents[f]);
         }
     }
     if (endVal != NULL) *endVal = markVal;
@@ -23,13 +23,11 @@
 
 #include "AlgorithmVolumeSmoothing.h"
 #include "CaretAssert.h"
-#include "CaretHeap.h"
 #include "CaretOMP.h"
+#include "TFCEHelper.h"
 #include "VolumeFile.h"
-#include "VoxelIJK.h"
 
 #include <cmath>
-#include <set>
 #include <vector>
 
 using namespace caret;
@@ -66,12 +64,22 @@ OperationParameters* AlgorithmVolumeTFCE::getParameters()
     OptionalParameter* subvolSelect = ret->createOptionalParameter(6, "-subvolume", "select a single subvolume");
     subvolSelect->addStringParameter(1, "subvolume", "the subvolume number or name");
     
+    OptionalParameter* signFlipOpt = ret->createOptionalParameter(7, "-sign-flip", "run a one-sample sign-flip permutation test across the subvolumes");
+    signFlipOpt->addIntegerParameter(1, "permutations", "number of permutations, including the unpermuted data");
+    signFlipOpt->addStringParameter(2, "null-out", "output text file for the maximum absolute TFCE value of each permutation");
+    OptionalParameter* seedOpt = signFlipOpt->createOptionalParameter(3, "-seed", "specify the seed for the random sign flips");
+    seedOpt->addIntegerParameter(1, "seed", "the seed (default 0)");
+    
     ret->setHelpText(
         AString("Threshold-free cluster enhancement is a method to increase the relative value of regions that would form clusters in a standard thresholding test.  ") +
         "This is accomplished by evaluating the integral of:\n\n" +
         "e(h, p)^E * h^H * dh\n\n" +
         "at each vertex p, where h ranges from 0 to the maximum value in the data, and e(h, p) is the extent of the cluster containing vertex p at threshold h.  " +
         "Negative values are similarly enhanced by negating the data, running the same process, and negating the result.\n\n" +
+        "When using -sign-flip, the input subvolumes are treated as maps from different subjects, and the output is a single subvolume, the TFCE of the one-sample t statistic across the input subvolumes.  " +
+        "For each permutation, the signs of a random subset of the input subvolumes are flipped, and the maximum absolute TFCE value of the resulting t map is written to the text file, one value per line.  " +
+        "The first permutation is the unpermuted data.  " +
+        "The familywise error corrected p-value of a voxel is the fraction of the permutation maximums that are at least as large as the absolute value of the output at that voxel.\n\n" +
         "This method is explained in: Smith SM, Nichols TE., \"Threshold-free cluster enhancement: addressing problems of smoothing, threshold dependence and localisation in cluster inference.\" Neuroimage. 2009 Jan 1;44(1):83-98. PMID: 18501637"
     );
     return ret;
@@ -111,21 +119,55 @@ void AlgorithmVolumeTFCE::useParameters(OperationParameters* myParams, ProgressO
             throw AlgorithmException("invalid subvolume specified");
         }
     }
-    AlgorithmVolumeTFCE(myProgObj, myVol, myVolOut, presmooth, myRoi, param_e, param_h, subvolNum);
+    int numPermutations = 0;
+    AString nullTextName;
+    int64_t seed = 0;
+    OptionalParameter* signFlipOpt = myParams->getOptionalParameter(7);
+    if (signFlipOpt->m_present)
+    {
+        numPermutations = (int)signFlipOpt->getInteger(1);
+        if (numPermutations < 1) throw AlgorithmException("number of permutations must be positive");
+        nullTextName = signFlipOpt->getString(2);
+        OptionalParameter* seedOpt = signFlipOpt->getOptionalParameter(3);
+        if (seedOpt->m_present)
+        {
+            seed = seedOpt->getInteger(1);
+        }
+    }
+    AlgorithmVolumeTFCE(myProgObj, myVol, myVolOut, presmooth, myRoi, param_e, param_h, subvolNum, numPermutations, nullTextName, seed);
 }
 
 AlgorithmVolumeTFCE::AlgorithmVolumeTFCE(ProgressObject* myProgObj, const VolumeFile* myVol, VolumeFile* myVolOut, const float& presmooth, const VolumeFile* myRoi,
-                                         const float& param_e, const float& param_h, const int64_t& subvolNum) : AbstractAlgorithm(myProgObj)
+                                         const float& param_e, const float& param_h, const int64_t& subvolNum,
+                                         const int& numPermutations, const AString& nullTextName, const int64_t& seed) : AbstractAlgorithm(myProgObj)
 {
     LevelProgress myProgress(myProgObj);
     if (myRoi != NULL && !myVol->getVolumeSpace().matches(myRoi->getVolumeSpace())) throw AlgorithmException("roi volume has different volume space than input");
     if (subvolNum < -1 || subvolNum >= myVol->getNumberOfMaps()) throw AlgorithmException("invalid subvolume specified");
     vector<int64_t> dims = myVol->getDimensions();
+    if (numPermutations > 0)
+    {
+        if (subvolNum != -1) throw AlgorithmException("sign flipping uses all subvolumes, it can't be used with a single subvolume");
+        if (dims[3] < 2) throw AlgorithmException("sign flipping requires at least 2 subvolumes");
+        if (dims[4] != 1) throw AlgorithmException("sign flipping is not supported on multi-component volumes");
+    }
+    const int64_t frameSize = dims[0] * dims[1] * dims[2];
     const float* roiFrame = NULL;
     if (myRoi != NULL) roiFrame = myRoi->getFrame();
+    Vector3D ivec, jvec, kvec, origin;//compute the volume of a voxel so different resolutions have comparable values - as if it matters, but hey
+    myVol->getVolumeSpace().getSpacingVectors(ivec, jvec, kvec, origin);//who knows, maybe we'll have distortion correction in volume someday
+    float voxelVolume = abs(ivec.dot(jvec.cross(kvec)));
+    TFCEHelper myTFCE(frameSize);
+    {
+        vector<int32_t> voxelToElement(frameSize, -1);
+        for (int64_t i = 0; i < frameSize; ++i)
+        {
+            if (roiFrame == NULL || roiFrame[i] > 0.0f) voxelToElement[i] = (int32_t)i;
+        }
+        myTFCE.addVolume(dims.data(), voxelVolume, voxelToElement, param_e, param_h);
+    }
     if (subvolNum == -1)
     {
-        myVolOut->reinitialize(myVol->getOriginalDimensions(), myVol->getSform(), dims[4]);
         const VolumeFile* toUse = myVol;
         VolumeFile smoothed;
         if (presmooth > 0.0f)
@@ -133,16 +175,37 @@ AlgorithmVolumeTFCE::AlgorithmVolumeTFCE(ProgressObject* myProgObj, const Volume
             AlgorithmVolumeSmoothing(NULL, myVol, presmooth, &smoothed, myRoi);
             toUse = &smoothed;
         }
-#pragma omp CARET_PAR
+        if (numPermutations > 0)
         {
-            vector<float> outframe(dims[0] * dims[1] * dims[2]);
-#pragma omp CARET_FOR
+            vector<int64_t> outDims = dims;
+            outDims.resize(3);
+            myVolOut->reinitialize(outDims, myVol->getSform());
+            vector<const float*> maps(dims[3]);
             for (int64_t b = 0; b < dims[3]; ++b)
             {
-                for (int64_t c = 0; c < dims[4]; ++c)
+                maps[b] = toUse->getFrame(b);
+            }
+            vector<float> tFrame(frameSize), outframe(frameSize);
+            TFCEHelper::oneSampleT(maps, vector<float>(dims[3], 1.0f), frameSize, tFrame.data());
+            myTFCE.compute(tFrame.data(), outframe.data());
+            myVolOut->setFrame(outframe.data());
+            myVolOut->setMapName(0, "TFCE of one-sample t");
+            vector<float> nullDist;
+            myTFCE.signFlipMaxNull(maps, numPermutations, seed, nullDist);
+            TFCEHelper::writeNullDistribution(nullTextName, nullDist);
+        } else {
+            myVolOut->reinitialize(myVol->getOriginalDimensions(), myVol->getSform(), dims[4]);
+#pragma omp CARET_PAR
+            {
+                vector<float> outframe(frameSize);
+#pragma omp CARET_FOR
+                for (int64_t b = 0; b < dims[3]; ++b)
                 {
-                    processFrame(toUse, b, c, outframe.data(), roiFrame, param_e, param_h);
-                    myVolOut->setFrame(outframe.data(), b, c);
+                    for (int64_t c = 0; c < dims[4]; ++c)
+                    {
+                        myTFCE.compute(toUse->getFrame(b, c), outframe.data());
+                        myVolOut->setFrame(outframe.data(), b, c);
+                    }
                 }
             }
         }
@@ -159,224 +222,15 @@ AlgorithmVolumeTFCE::AlgorithmVolumeTFCE(ProgressObject* myProgObj, const Volume
             toUse = &smoothed;
             useFrame = 0;
         }
-        vector<float> outframe(dims[0] * dims[1] * dims[2]);
+        vector<float> outframe(frameSize);
         for (int64_t c = 0; c < dims[4]; ++c)
         {
-            processFrame(toUse, useFrame, c, outframe.data(), roiFrame, param_e, param_h);
+            myTFCE.compute(toUse->getFrame(useFrame, c), outframe.data());
             myVolOut->setFrame(outframe.data(), 0, c);
         }
     }
 }
 
-void AlgorithmVolumeTFCE::processFrame(const VolumeFile* inVol, const int64_t& b, const int64_t& c, float* outData, const float* roiData, const float& param_e, const float& param_h)
-{
-    vector<int64_t> dims = inVol->getDimensions();
-    int64_t frameSize = dims[0] * dims[1] * dims[2];
-    vector<double> accum(frameSize, 0.0);
-    tfce(inVol, b, c, accum.data(), roiData, param_e, param_h, false);//don't negate - positives
-    tfce(inVol, b, c, accum.data(), roiData, param_e, param_h, true);//negate - negatives - NOTE: output is still positive!!!
-    const float* inData = inVol->getFrame(b, c);
-    for (int64_t i = 0; i < frameSize; ++i)
-    {
-        if (inData[i] > 0.0f)//negate the results from negative inputs
-        {
-            outData[i] = accum[i];
-        } else {//the areas outside the roi will have zeros, so we don't have to worry about them
-            outData[i] = -accum[i];
-        }
-    }
-}
-
-namespace
-{//hidden namespace just to make sure things don't collide
-    struct Cluster
-    {
-        double accumVal, totalVolume;
-        vector<VoxelIJK> members;
-        float lastVal;
-        bool first;
-        Cluster()
-        {
-            first = true;
-            accumVal = 0.0;
-            totalVolume = 0.0;
-        }
-        void addMember(const VoxelIJK& voxel, const float& val, const float& voxel_volume, const float& param_e, const float& param_h)
-        {
-            update(val, param_e, param_h);
-            members.push_back(voxel);
-            totalVolume += voxel_volume;
-        }
-        void update(const float& bottomVal, const float& param_e, const float& param_h)
-        {
-            if (first)
-            {
-                lastVal = bottomVal;
-                first = false;
-            } else {
-                if (bottomVal != lastVal)//skip computing if there is no difference
-                {
-                    CaretAssert(bottomVal < lastVal);
-                    double integrated_h = param_h + 1.0f;//integral(x^h) = (x^(h + 1))/(h + 1) + C
-                    double newSlice = pow(totalVolume, (double)param_e) * (pow((double)lastVal, integrated_h) - pow((double)bottomVal, integrated_h)) / integrated_h;
-                    accumVal += newSlice;
-                    lastVal = bottomVal;//computing in double precision, with float for inputs, puts the smallest difference between values far greater than the instability of the computation
-                }
-            }
-        }
-    };
-    
-    int64_t allocCluster(vector<Cluster>& clusterList, set<int64_t>& deadClusters)
-    {
-        if (deadClusters.empty())
-        {
-            clusterList.push_back(Cluster());
-            return (int64_t)(clusterList.size() - 1);
-        } else {
-            set<int64_t>::iterator iter = deadClusters.begin();
-            int64_t ret = *iter;
-            deadClusters.erase(iter);
-            clusterList[ret] = Cluster();//reinitialize
-            return ret;
-        }
-    }
-}
-
-void AlgorithmVolumeTFCE::tfce(const VolumeFile* inVol, const int64_t& b, const int64_t& c, double* accumData, const float* roiData, const float& param_e, const float& param_h, const bool& negate)
-{
-    vector<int64_t> dims = inVol->getDimensions();
-    Vector3D ivec, jvec, kvec, origin;//compute the volume of a voxel so different resolutions have comparable values - as if it matters, but hey
-    inVol->getVolumeSpace().getSpacingVectors(ivec, jvec, kvec, origin);//who knows, maybe we'll have distortion correction in volume someday
-    float voxelVolume = abs(ivec.dot(jvec.cross(kvec)));
-    const int64_t frameSize = dims[0] * dims[1] * dims[2];
-    const float* frameData = inVol->getFrame(b, c);
-    vector<int64_t> membership(frameSize, -1);//use int64_t just in case we get an absurd number of clusters
-    vector<Cluster> clusterList;
-    set<int64_t> deadClusters;//to allow reallocation without changing indices
-    CaretSimpleMaxHeap<VoxelIJK, float> voxelHeap;
-    for (int64_t i = 0; i < dims[0]; ++i)
-    {
-        for (int64_t j = 0; j < dims[1]; ++j)
-        {
-            for (int64_t k = 0; k < dims[2]; ++k)
-            {
-                int64_t index = inVol->getIndex(i, j, k);
-                if ((roiData == NULL || roiData[index] > 0.0f))
-                {
-                    if (negate)
-                    {
-                        if (frameData[index] < 0.0f)
-                        {
-                            voxelHeap.push(VoxelIJK(i, j, k), -frameData[index]);
-                        }
-                    } else {
-                        if (frameData[index] > 0.0f)
-                        {
-                            voxelHeap.push(VoxelIJK(i, j, k), frameData[index]);
-                        }
-                    }
-                }
-            }
-        }
-    }
-    const int STENCIL_SIZE = 18;
-    int64_t stencil[STENCIL_SIZE] = { 0, 0, -1,
-                                      0, -1, 0,
-                                      -1, 0, 0,
-                                      1, 0, 0,
-                                      0, 1, 0,
-                                      0, 0, 1 };
-    while (!voxelHeap.isEmpty())
-    {
-        float value;
-        VoxelIJK voxel = voxelHeap.pop(&value);
-        int64_t voxelIndex = inVol->getIndex(voxel.m_ijk);
-        set<int64_t> touchingClusters;
-        for (int i = 0; i < STENCIL_SIZE; i += 3)
-        {
-            VoxelIJK neighVoxel(voxel.m_ijk[0] + stencil[i], voxel.m_ijk[1] + stencil[i + 1], voxel.m_ijk[2] + stencil[i + 2]);
-            if (inVol->indexValid(neighVoxel.m_ijk))
-            {
-                int64_t neighIndex = inVol->getIndex(neighVoxel.m_ijk);
-                if (membership[neighIndex] != -1)
-                {
-                    touchingClusters.insert(membership[neighIndex]);
-                }
-            }
-        }
-        int numTouching = (int)touchingClusters.size();
-        switch (numTouching)
-        {
-            case 0://make new cluster
-            {
-                int64_t newCluster = allocCluster(clusterList, deadClusters);
-                clusterList[newCluster].addMember(voxel, value, voxelVolume, param_e, param_h);
-                membership[voxelIndex] = newCluster;
-                break;
-            }
-            case 1://add to cluster
-            {
-                int64_t whichCluster = *(touchingClusters.begin());
-                clusterList[whichCluster].addMember(voxel, value, voxelVolume, param_e, param_h);
-                membership[voxelIndex] = whichCluster;
-                accumData[voxelIndex] -= clusterList[whichCluster].accumVal;//the accum value is the current amount less than the peak value that the edge of the cluster has (this node is on the edge)
-                break;//so, when the cluster merges or reaches 0, we add the accum value to every member and zero the accum value of the merged cluster, and we get the correct value in the end (with far fewer flops than integrating everywhere)
-            }
-            default://merge all touching clusters
-            {
-                int64_t mergedIndex = -1, biggestSize = 0;//find the biggest cluster (in number of members) and use as merged cluster, for optimization purposes
-                for (set<int64_t>::iterator iter = touchingClusters.begin(); iter != touchingClusters.end(); ++iter)
-                {
-                    if ((int64_t)clusterList[*iter].members.size() > biggestSize)
-                    {
-                        mergedIndex = *iter;
-                        biggestSize = (int64_t)clusterList[*iter].members.size();
-                    }
-                }
-                CaretAssertVectorIndex(clusterList, mergedIndex);
-                Cluster& mergedCluster = clusterList[mergedIndex];
-                mergedCluster.update(value, param_e, param_h);//recalculate to align cluster bottoms
-                for (set<int64_t>::iterator iter = touchingClusters.begin(); iter != touchingClusters.end(); ++iter)
-                {
-                    if (*iter != mergedIndex)//if we are the largest cluster, don't modify the per-voxel accum for members, so merges between small and large clusters are cheap
-                    {
-                        Cluster& thisCluster = clusterList[*iter];
-                        thisCluster.update(value, param_e, param_h);
-                        int64_t numMembers = (int64_t)thisCluster.members.size();
-                        double correctionVal = thisCluster.accumVal - mergedCluster.accumVal;//fix the accum values in the side cluster so we can add the merged cluster's accum to everything at the end
-                        for (int64_t j = 0; j < numMembers; ++j)//add the correction value to every member so that we have the current integrated values correct
-                        {
-                            int64_t memberIndex = inVol->getIndex(thisCluster.members[j].m_ijk);
-                            accumData[memberIndex] += correctionVal;//apply the correction
-                            membership[memberIndex] = mergedIndex;//and update membership
-                        }
-                        mergedCluster.members.insert(mergedCluster.members.end(), thisCluster.members.begin(), thisCluster.members.end());//copy all members
-                        mergedCluster.totalVolume += thisCluster.totalVolume;
-                        deadClusters.insert(*iter);//kill it
-                        vector<VoxelIJK>().swap(clusterList[*iter].members);//also try to deallocate member list
-                    }
-                }
-                mergedCluster.addMember(voxel, value, voxelVolume, param_e, param_h);//will not trigger recomputation, we already recomputed at this value
-                accumData[voxelIndex] -= mergedCluster.accumVal;//the voxel they merge on must not get the peak value of the cluster, obviously, so again, record its difference from peak
-                membership[voxelIndex] = mergedIndex;
-                break;//NOTE: do not reset the accum value of the merged cluster, we specifically avoided modifying the per-voxel accum for its members, so the cluster accum is still in play
-            }
-        }
-    }
-    int listSize = (int)clusterList.size();//final cleanup of accum values
-    for (int i = 0; i < listSize; ++i)
-    {
-        if (deadClusters.find(i) != deadClusters.end()) continue;//ignore clusters that don't exist
-        Cluster& thisCluster = clusterList[i];
-        thisCluster.update(0.0f, param_e, param_h);//update to include the to-zero slice
-        int numMembers = (int)thisCluster.members.size();
-        for (int j = 0; j < numMembers; ++j)
-        {
-            accumData[inVol->getIndex(thisCluster.members[j].m_ijk)] += thisCluster.accumVal;//add the resulting slice to all members - their stored data contains the offset between the cluster peak and their corect value
-        }
-    }
-}
-
 float AlgorithmVolumeTFCE::getAlgorithmInternalWeight()
 {
     return 1.0f;//override this if needed, if the progress bar isn't smooth
@@ -28,14 +28,13 @@ namespace caret {
     class AlgorithmVolumeTFCE : public AbstractAlgorithm
     {
         AlgorithmVolumeTFCE();
-        void processFrame(const VolumeFile* inVol, const int64_t& b, const int64_t& c, float* outData, const float* roiData, const float& param_e, const float& param_h);
-        void tfce(const VolumeFile* inVol, const int64_t& b, const int64_t& c, double* accumData, const float* roiData, const float& param_e, const float& param_h, const bool& negate);
     protected:
         static float getSubAlgorithmWeight();
         static float getAlgorithmInternalWeight();
     public:
         AlgorithmVolumeTFCE(ProgressObject* myProgObj, const VolumeFile* myVol, VolumeFile* myVolOut, const float& presmooth = 0.0f, const VolumeFile* myRoi = NULL,
-                            const float& param_e = 0.5f, const float& param_h = 2.0f, const int64_t& subvolNum = -1);
+                            const float& param_e = 0.5f, const float& param_h = 2.0f, const int64_t& subvolNum = -1,
+                            const int& numPermutations = 0, const AString& nullTextName = "", const int64_t& seed = 0);
         static OperationParameters* getParameters();
         static void useParameters(OperationParameters* myParams, ProgressObject* myProgObj);
         static AString getCommandSwitch();
@@ -25,8 +25,12 @@
 #include "CaretOMP.h"
 #include "NiftiIO.h"
 #include "Vector3D.h"
+#include "VolumeResamplingStencil.h"
+#include "VolumeSpline.h"
 #include "WarpfieldFile.h"
 
+#include <algorithm>
+
 using namespace caret;
 using namespace std;
 
@@ -123,41 +127,70 @@ AlgorithmVolumeWarpfieldResample::AlgorithmVolumeWarpfieldResample(ProgressObjec
             *(outVol->getMapLabelTable(i)) = *(inVol->getMapLabelTable(i));
         }
     }
-    for (int64_t c = 0; c < numComponents; ++c)
-    {
-        for (int64_t b = 0; b < numMaps; ++b)
+    const int64_t sliceSize = outDims[0] * outDims[1], frameSize = sliceSize * outDims[2];
+    const int64_t chunkSize = VolumeResamplingStencil::samplesForMemoryLimit(myMethod, sliceSize, ((int64_t)1) << 29);//whole slices, about 512MB of weights at a time
+    vector<float> chunkOut(min(chunkSize, frameSize));
+    vector<VolumeSpline> frameSplines;//for cubic with more than one chunk, deconvolve each frame once, rather than once per chunk
+    for (int64_t chunkStart = 0; chunkStart < frameSize; chunkStart += chunkSize)
+    {//compute the source location and weights once, then apply them to every frame
+        const int64_t thisChunk = min(chunkSize, frameSize - chunkStart), startSlice = chunkStart / sliceSize, numSlices = thisChunk / sliceSize;
+        VolumeResamplingStencil myStencil(inVol->getVolumeSpace(), myMethod, thisChunk);
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int64_t k = startSlice; k < startSlice + numSlices; ++k)
         {
-            if (myMethod == VolumeFile::CUBIC)
+            for (int64_t j = 0; j < outDims[1]; ++j)
             {
-                inVol->validateSpline(b, c);//because deconvolve is parallel, but won't execute parallel if we are already in a parallel section
+                for (int64_t i = 0; i < outDims[0]; ++i)
+                {
+                    Vector3D outCoord, inCoord, displacement;
+                    outVol->indexToSpace(i, j, k, outCoord);
+                    bool validDisplacement = false;
+                    displacement[0] = warpfield->interpolateValue(outCoord, VolumeFile::TRILINEAR, &validDisplacement, 0);
+                    if (validDisplacement)
+                    {//samples that aren't set give INVALID_INTERP_VALUE
+                        displacement[1] = warpfield->interpolateValue(outCoord, VolumeFile::TRILINEAR, NULL, 1);
+                        displacement[2] = warpfield->interpolateValue(outCoord, VolumeFile::TRILINEAR, NULL, 2);
+                        inCoord = outCoord + displacement;
+                        myStencil.setSample(i + outDims[0] * (j + outDims[1] * (k - startSlice)), inCoord);
+                    }
+                }
             }
-#pragma omp CARET_PARFOR schedule(dynamic)
-            for (int64_t k = 0; k < outDims[2]; ++k)
+        }
+        for (int64_t c = 0; c < numComponents; ++c)
+        {
+            for (int64_t b = 0; b < numMaps; ++b)
             {
-                for (int64_t j = 0; j < outDims[1]; ++j)
+                if (myStencil.getMethod() == VolumeFile::CUBIC && chunkSize < frameSize)
                 {
-                    for (int64_t i = 0; i < outDims[0]; ++i)
+                    if (chunkStart == 0)
                     {
-                        Vector3D outCoord, inCoord, displacement;
-                        outVol->indexToSpace(i, j, k, outCoord);
-                        bool validDisplacement = false;
-                        displacement[0] = warpfield->interpolateValue(outCoord, VolumeFile::TRILINEAR, &validDisplacement, 0);
-                        if (validDisplacement)
+                        if (frameSplines.empty()) frameSplines.resize(numMaps * numComponents);
+                        frameSplines[b + c * numMaps] = VolumeSpline(inVol->getFrame(b, c), inVol->getVolumeSpace().getDims());
+                        if (frameSplines[b + c * numMaps].ignoredNonNumeric())
                         {
-                            displacement[1] = warpfield->interpolateValue(outCoord, VolumeFile::TRILINEAR, NULL, 1);
-                            displacement[2] = warpfield->interpolateValue(outCoord, VolumeFile::TRILINEAR, NULL, 2);
-                            inCoord = outCoord + displacement;
-                            float interpVal = inVol->interpolateValue(inCoord, myMethod, NULL, b, c);
-                            outVol->setValue(interpVal, i, j, k, b, c);
-                        } else {
-                            outVol->setValue(VolumeFile::INVALID_INTERP_VALUE, i, j, k, b, c);
+                            CaretLogWarning("ignored non-numeric input value when calculating cubic splines");
+                        }
+                    }
+                    myStencil.resample(frameSplines[b + c * numMaps], chunkOut.data());
+                } else {
+                    myStencil.resample(inVol->getFrame(b, c), chunkOut.data());
+                }
+                if (thisChunk == frameSize)
+                {
+                    outVol->setFrame(chunkOut.data(), b, c);
+                } else {
+#pragma omp CARET_PARFOR schedule(dynamic)
+                    for (int64_t k = startSlice; k < startSlice + numSlices; ++k)
+                    {
+                        for (int64_t j = 0; j < outDims[1]; ++j)
+                        {
+                            for (int64_t i = 0; i < outDims[0]; ++i)
+                            {
+                                outVol->setValue(chunkOut[i + outDims[0] * (j + outDims[1] * (k - startSlice))], i, j, k, b, c);
+                            }
                         }
                     }
                 }
-            }
-            if (myMethod == VolumeFile::CUBIC)
-            {
-                inVol->freeSpline(b, c);//release memory we no longer need, if we allocated it
             }
         }
     }
@@ -36,6 +36,7 @@
 #include "BrowserTabContent.h"
 #include "CaretDataFileHelper.h"
 #include "CaretLogger.h"
+#include "CaretOMP.h"
 #include "CaretPreferences.h"
 #include "ChartingDataManager.h"
 #include "ChartableLineSeriesBrainordinateInterface.h"
@@ -5233,6 +5234,344 @@ Brain::readDataFile(const DataFileTypeEnum::Enum dataFileType,
     return caretDataFileRead;
 }
 
+/**
+ * Can files of the given type be read by a worker thread?  Reading these
+ * files only decodes the content of the file (GIFTI, NIfTI, or CIFTI) and
+ * does not access the brain, the palette file, nor send events.
+ *
+ * @param dataFileType
+ *    Type of data file.
+ * @return
+ *    True if files of the type may be read concurrently, else false.
+ */
+bool
+Brain::isDataFileTypeReadConcurrently(const DataFileTypeEnum::Enum dataFileType)
+{
+    bool concurrentFlag = false;
+    
+    switch (dataFileType) {
+        case DataFileTypeEnum::ANNOTATION:
+            break;
+        case DataFileTypeEnum::BORDER:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_DENSE:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_DENSE_DYNAMIC:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_DENSE_LABEL:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_DENSE_PARCEL:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_DENSE_SCALAR:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_DENSE_TIME_SERIES:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_FIBER_ORIENTATIONS_TEMPORARY:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_FIBER_TRAJECTORY_TEMPORARY:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_PARCEL:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_PARCEL_DENSE:
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_PARCEL_LABEL:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_PARCEL_SCALAR:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_PARCEL_SERIES:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::CONNECTIVITY_SCALAR_DATA_SERIES:
+            break;
+        case DataFileTypeEnum::FOCI:
+            break;
+        case DataFileTypeEnum::IMAGE:
+            break;
+        case DataFileTypeEnum::LABEL:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::METRIC:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::PALETTE:
+            break;
+        case DataFileTypeEnum::RGBA:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::SCENE:
+            break;
+        case DataFileTypeEnum::SPECIFICATION:
+            break;
+        case DataFileTypeEnum::SURFACE:
+            concurrentFlag = true;
+            break;
+        case DataFileTypeEnum::UNKNOWN:
+            break;
+        case DataFileTypeEnum::VOLUME:
+            concurrentFlag = true;
+            break;
+    }
+    
+    return concurrentFlag;
+}
+
+/**
+ * @return Number of data files that are read concurrently before
+ * they are added to the brain.  Limiting the number of files read
+ * at one time limits the memory used by files that are waiting to be
+ * added and allows progress to be updated while files are read.
+ */
+int32_t
+Brain::getNumberOfDataFilesToReadConcurrently()
+{
+    int32_t numberOfFiles = 1;
+#ifdef CARET_OMP
+    numberOfFiles = omp_get_max_threads();
+#endif
+    
+    return std::max(numberOfFiles, 1);
+}
+
+/**
+ * Read, using worker threads, the data files in the given range that
+ * can be read concurrently.  The files are NOT added to the brain, that
+ * is done, in order, by addDataFileToLoad() on the main thread.  Files
+ * that are previously loaded, are on the network, do not exist, or of
+ * a type that cannot be read concurrently are skipped and will be read
+ * by addDataFileToLoad().
+ *
+ * @param dataFilesToLoad
+ *    Data files that are loaded.
+ * @param firstIndex
+ *    Index of first file that is read.
+ * @param lastIndex
+ *    One beyond index of last file that is read.
+ */
+void
+Brain::readDataFilesConcurrently(std::vector<DataFileToLoad>& dataFilesToLoad,
+                                 const int32_t firstIndex,
+                                 const int32_t lastIndex)
+{
+    /*
+     * Files are created on the main thread since conversion of
+     * the file's name to an absolute path uses the current directory.
+     */
+    std::vector<DataFileToLoad*> filesToRead;
+    for (int32_t i = firstIndex; i < lastIndex; i++) {
+        CaretAssertVectorIndex(dataFilesToLoad, i);
+        DataFileToLoad& dftl = dataFilesToLoad[i];
+        if (dftl.m_caretDataFile != NULL) {
+            continue;
+        }
+        if ( ! isDataFileTypeReadConcurrently(dftl.m_dataFileType)) {
+            continue;
+        }
+        
+        const AString fileName = convertFilePathNameToAbsolutePathName(dftl.m_fileName);
+        if (DataFile::isFileOnNetwork(fileName)) {
+            continue;
+        }
+        FileInformation fileInfo(fileName);
+        if ( ! fileInfo.exists()) {
+            continue;
+        }
+        
+        CaretDataFile* caretDataFile = NULL;
+        if (dftl.m_dataFileType == DataFileTypeEnum::SURFACE) {
+            /*
+             * Brain requires a Surface, not a SurfaceFile
+             */
+            caretDataFile = new Surface();
+        }
+        else {
+            caretDataFile = CaretDataFileHelper::createCaretDataFileForFileType(dftl.m_dataFileType);
+        }
+        if (caretDataFile == NULL) {
+            continue;
+        }
+        
+        dftl.m_fileName = fileName;
+        dftl.m_caretDataFile = caretDataFile;
+        filesToRead.push_back(&dftl);
+    }
+    
+    const int32_t numberOfFilesToRead = static_cast<int32_t>(filesToRead.size());
+    if (numberOfFilesToRead <= 0) {
+        return;
+    }
+    
+    ElapsedTimer timer;
+    timer.start();
+    
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int32_t i = 0; i < numberOfFilesToRead; i++) {
+        DataFileToLoad* dftl = filesToRead[i];
+        
+        /*
+         * Exceptions must not leave the parallel region
+         */
+        try {
+            try {
+                dftl->m_caretDataFile->readFile(dftl->m_fileName);
+            }
+            catch (const std::bad_alloc&) {
+                throw DataFileException(dftl->m_fileName,
+                                        CaretDataFileHelper::createBadAllocExceptionMessage(dftl->m_fileName));
+            }
+        }
+        catch (const DataFileException& dfe) {
+            dftl->m_errorMessage = dfe.whatString();
+        }
+        catch (const CaretException& ce) {
+            dftl->m_errorMessage = DataFileException(dftl->m_fileName,
+                                                     ce.whatString()).whatString();
+        }
+        catch (const std::exception& e) {
+            dftl->m_errorMessage = DataFileException(dftl->m_fileName,
+                                                     AString(e.what())).whatString();
+        }
+    }
+    
+    /*
+     * Files that failed are deleted here, on the main thread, since
+     * destroying a file removes it from the event manager and may
+     * invalidate other things
+     */
+    for (int32_t i = 0; i < numberOfFilesToRead; i++) {
+        DataFileToLoad* dftl = filesToRead[i];
+        if ( ! dftl->m_errorMessage.isEmpty()) {
+            delete dftl->m_caretDataFile;
+            dftl->m_caretDataFile = NULL;
+        }
+    }
+    
+    CaretLogInfo("Time to read "
+                 + AString::number(numberOfFilesToRead)
+                 + " files concurrently was "
+                 + AString::number(timer.getElapsedTimeSeconds())
+                 + " seconds.");
+}
+
+/**
+ * Add a data file to the brain.  If the file was read by
+ * readDataFilesConcurrently() it is added, otherwise it is read now.
+ *
+ * @param dataFileToLoad
+ *    The data file.  Ownership of its file passes to the brain.
+ * @throws DataFileException
+ *    If there is an error reading or adding the file.
+ */
+void
+Brain::addDataFileToLoad(DataFileToLoad& dataFileToLoad)
+{
+    CaretDataFile* caretDataFile = dataFileToLoad.m_caretDataFile;
+    dataFileToLoad.m_caretDataFile = NULL;
+    
+    if (dataFileToLoad.m_previouslyLoadedFlag) {
+        CaretAssert(caretDataFile);
+        addReadOrReloadDataFile(FILE_MODE_ADD,
+                                caretDataFile,
+                                caretDataFile->getDataFileType(),
+                                caretDataFile->getStructure(),
+                                dataFileToLoad.m_fileName,
+                                false);
+        return;
+    }
+    
+    if ( ! dataFileToLoad.m_errorMessage.isEmpty()) {
+        throw DataFileException(dataFileToLoad.m_errorMessage);
+    }
+    
+    if (caretDataFile == NULL) {
+        readDataFile(dataFileToLoad.m_dataFileType,
+                     dataFileToLoad.m_structure,
+                     dataFileToLoad.m_fileName,
+                     false);
+        return;
+    }
+    
+    /*
+     * Perform the validation that follows reading of a file
+     * in addReadOrReloadDataFile() since these checks depend upon
+     * the files that have been added to the brain.
+     */
+    try {
+        CiftiMappableDataFile* ciftiMapFile = dynamic_cast<CiftiMappableDataFile*>(caretDataFile);
+        if (ciftiMapFile != NULL) {
+            validateCiftiMappableDataFile(ciftiMapFile);
+        }
+        
+        switch (dataFileToLoad.m_dataFileType) {
+            case DataFileTypeEnum::LABEL:
+            case DataFileTypeEnum::METRIC:
+            case DataFileTypeEnum::RGBA:
+            case DataFileTypeEnum::SURFACE:
+                if ((dataFileToLoad.m_structure == StructureEnum::INVALID)
+                    && (caretDataFile->getStructure() == StructureEnum::INVALID)) {
+                    DataFileException e(dataFileToLoad.m_fileName,
+                                        "Structure is not valid.");
+                    e.setErrorInvalidStructure(true);
+                    CaretLogThrowing(e);
+                    throw e;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    catch (const DataFileException& dfe) {
+        delete caretDataFile;
+        throw dfe;
+    }
+    
+    /*
+     * When adding fails, the file was not taken by the brain
+     * and, unlike a previously loaded file, nothing else owns it.
+     */
+    try {
+        addReadOrReloadDataFile(FILE_MODE_ADD,
+                                caretDataFile,
+                                dataFileToLoad.m_dataFileType,
+                                dataFileToLoad.m_structure,
+                                dataFileToLoad.m_fileName,
+                                false);
+    }
+    catch (...) {
+        delete caretDataFile;
+        throw;
+    }
+}
+
+/**
+ * Delete files in the given range that have not been added to the brain,
+ * used when loading is cancelled.
+ *
+ * @param dataFilesToLoad
+ *    Data files that are loaded.
+ * @param firstIndex
+ *    Index of first file.
+ * @param lastIndex
+ *    One beyond index of last file.
+ */
+void
+Brain::deleteDataFilesToLoad(std::vector<DataFileToLoad>& dataFilesToLoad,
+                             const int32_t firstIndex,
+                             const int32_t lastIndex)
+{
+    for (int32_t i = firstIndex; i < lastIndex; i++) {
+        CaretAssertVectorIndex(dataFilesToLoad, i);
+        if (dataFilesToLoad[i].m_caretDataFile != NULL) {
+            delete dataFilesToLoad[i].m_caretDataFile;
+            dataFilesToLoad[i].m_caretDataFile = NULL;
+        }
+    }
+}
+
 /**
  * Processing performed after adding or removing a data file.
  */
@@ -5299,6 +5638,7 @@ Brain::loadFilesSelectedInSpecFile(EventSpecFileReadDataFiles* readSpecFileDataF
      * Note: Need to read palette first since some of the individual file
      * reading routines update palette coloring when file is read
      */
+    std::vector<DataFileToLoad> dataFilesToLoad;
     const int32_t numFileGroups = sf->getNumberOfDataFileTypeGroups();
     for (int32_t ig = -1; ig < numFileGroups; ig++) {
         const SpecFileDataFileTypeGroup* group = ((ig == -1)
@@ -5314,42 +5654,63 @@ Brain::loadFilesSelectedInSpecFile(EventSpecFileReadDataFiles* readSpecFileDataF
         for (int32_t iFile = 0; iFile < numFiles; iFile++) {
             const SpecFileDataFile* dataFileInfo = group->getFileInformation(iFile);
             if (dataFileInfo->isLoadingSelected()) {
-                const AString filename = dataFileInfo->getFileName();
-                const StructureEnum::Enum structure = dataFileInfo->getStructure();
-
-                /*
-                 * Send event indicating progress of file reading
-                 */
-                FileInformation fileInfo(dataFileInfo->getFileName());
-                progressUpdate.setProgress(fileReadCounter,
-                                           ("Reading "
-                                            + fileInfo.getFileName()));
-                EventManager::get()->sendEvent(progressUpdate.getPointer());
-                
-                /*
-                 * If user cancelled, reset brain and get out!
-                 */
-                if (progressUpdate.isCancelled()) {
-                    resetBrain();
-                    return;
-                }
-                
-                try {
-                    readDataFile(dataFileType,
-                                 structure,
-                                 filename,
-                                 false);
-                }
-                catch (const DataFileException& e) {
-                    if (errorMessage.isEmpty() == false) {
-                        errorMessage += "\n";
-                    }
-                    errorMessage += e.whatString();
-                }
-                
-                fileReadCounter++;
+                dataFilesToLoad.push_back(DataFileToLoad(dataFileType,
+                                                         dataFileInfo->getStructure(),
+                                                         dataFileInfo->getFileName(),
+                                                         NULL));
+            }
+        }
+    }
+    
+    /*
+     * Groups of files are read concurrently and then
+     * added to the brain in the order of the spec file
+     */
+    const int32_t numberOfDataFilesToLoad = static_cast<int32_t>(dataFilesToLoad.size());
+    const int32_t numberOfFilesReadConcurrently = getNumberOfDataFilesToReadConcurrently();
+    int32_t concurrentReadEndIndex = 0;
+    for (int32_t iFile = 0; iFile < numberOfDataFilesToLoad; iFile++) {
+        DataFileToLoad& dataFileToLoad = dataFilesToLoad[iFile];
+        
+        /*
+         * Send event indicating progress of file reading
+         */
+        FileInformation fileInfo(dataFileToLoad.m_fileName);
+        progressUpdate.setProgress(fileReadCounter,
+                                   ("Reading "
+                                    + fileInfo.getFileName()));
+        EventManager::get()->sendEvent(progressUpdate.getPointer());
+        
+        /*
+         * If user cancelled, reset brain and get out!
+         */
+        if (progressUpdate.isCancelled()) {
+            deleteDataFilesToLoad(dataFilesToLoad,
+                                  iFile,
+                                  numberOfDataFilesToLoad);
+            resetBrain();
+            return;
+        }
+        
+        if (iFile >= concurrentReadEndIndex) {
+            concurrentReadEndIndex = std::min(iFile + numberOfFilesReadConcurrently,
+                                              numberOfDataFilesToLoad);
+            readDataFilesConcurrently(dataFilesToLoad,
+                                      iFile,
+                                      concurrentReadEndIndex);
+        }
+        
+        try {
+            addDataFileToLoad(dataFileToLoad);
+        }
+        catch (const DataFileException& e) {
+            if (errorMessage.isEmpty() == false) {
+                errorMessage += "\n";
             }
+            errorMessage += e.whatString();
         }
+        
+        fileReadCounter++;
     }
     
     m_specFile->clearModified();
@@ -5571,6 +5932,7 @@ Brain::loadSpecFileFromScene(const SceneAttributes* sceneAttributes,
     /*
      * Load new files and add existing files that were previously loaded.
      */
+    std::vector<DataFileToLoad> dataFilesToLoad;
     const int32_t numFileGroups = specFileToLoad->getNumberOfDataFileTypeGroups();
     for (int32_t ig = 0; ig < numFileGroups; ig++) {
         const SpecFileDataFileTypeGroup* group = specFileToLoad->getDataFileTypeGroupByIndex(ig);
@@ -5579,67 +5941,77 @@ Brain::loadSpecFileFromScene(const SceneAttributes* sceneAttributes,
         for (int32_t iFile = 0; iFile < numFiles; iFile++) {
             const SpecFileDataFile* fileInfo = group->getFileInformation(iFile);
             if (fileInfo->isLoadingSelected()) {
-                try {
-                    
-                    AString filename = fileInfo->getFileName();
-                    
-                    std::map<const SpecFileDataFile*, CaretDataFile*>::iterator specToFileIter = specFilesEntryToNonModifiedFile.find(fileInfo);
-                    if (specToFileIter != specFilesEntryToNonModifiedFile.end()) {
-                        const QString msg = ("Adding previous file "
-                                             + FileInformation(filename).getFileName());
-                        progressEvent.setProgressMessage(msg);
-                        EventManager::get()->sendEvent(progressEvent.getPointer());
-                        if (progressEvent.isCancelled()) {
-                            resetBrain(keepSceneFiles,
-                                       keepSpecFile);
-                            return;
-                        }
-                        
-                        CaretDataFile* caretDataFile = specToFileIter->second;
-                        addReadOrReloadDataFile(FILE_MODE_ADD,
-                                                caretDataFile,
-                                                caretDataFile->getDataFileType(),
-                                                caretDataFile->getStructure(),
-                                                filename,
-                                                false);
-                    }
-                    else {
-                        const StructureEnum::Enum structure = fileInfo->getStructure();
-                        
-                        const QString msg = ("Loading "
-                                             + FileInformation(filename).getFileName());
-                        progressEvent.setProgressMessage(msg);
-                        EventManager::get()->sendEvent(progressEvent.getPointer());
-                        if (progressEvent.isCancelled()) {
-                            resetBrain(keepSceneFiles,
-                                       keepSpecFile);
-                            return;
-                        }
-                        
-                        if (sceneFileOnNetwork) {
-                            if (DataFile::isFileOnNetwork(filename) == false) {
-                                const int32_t lastSlashIndex = sceneFileName.lastIndexOf("/");
-                                if (lastSlashIndex >= 0) {
-                                    const AString newName = (sceneFileName.left(lastSlashIndex)
-                                                             + "/"
-                                                             + filename);
-                                    filename = newName;
-                                }
+                AString filename = fileInfo->getFileName();
+                
+                std::map<const SpecFileDataFile*, CaretDataFile*>::iterator specToFileIter = specFilesEntryToNonModifiedFile.find(fileInfo);
+                if (specToFileIter != specFilesEntryToNonModifiedFile.end()) {
+                    dataFilesToLoad.push_back(DataFileToLoad(dataFileType,
+                                                             fileInfo->getStructure(),
+                                                             filename,
+                                                             specToFileIter->second));
+                }
+                else {
+                    if (sceneFileOnNetwork) {
+                        if (DataFile::isFileOnNetwork(filename) == false) {
+                            const int32_t lastSlashIndex = sceneFileName.lastIndexOf("/");
+                            if (lastSlashIndex >= 0) {
+                                const AString newName = (sceneFileName.left(lastSlashIndex)
+                                                         + "/"
+                                                         + filename);
+                                filename = newName;
                             }
                         }
-                        readDataFile(dataFileType,
-                                     structure,
-                                     filename,
-                                     false);
                     }
-                }
-                catch (const DataFileException& e) {
-                    sceneAttributes->addToErrorMessage(e.whatString());
+                    dataFilesToLoad.push_back(DataFileToLoad(dataFileType,
+                                                             fileInfo->getStructure(),
+                                                             filename,
+                                                             NULL));
                 }
             }
         }
     }
     
+    /*
+     * Groups of files are read concurrently and then
+     * added to the brain in the order of the spec file
+     */
+    const int32_t numberOfDataFilesToLoad = static_cast<int32_t>(dataFilesToLoad.size());
+    const int32_t numberOfFilesReadConcurrently = getNumberOfDataFilesToReadConcurrently();
+    int32_t concurrentReadEndIndex = 0;
+    for (int32_t iFile = 0; iFile < numberOfDataFilesToLoad; iFile++) {
+        DataFileToLoad& dataFileToLoad = dataFilesToLoad[iFile];
+        
+        const QString msg = ((dataFileToLoad.m_previouslyLoadedFlag
+                              ? "Adding previous file "
+                              : "Loading ")
+                             + FileInformation(dataFileToLoad.m_fileName).getFileName());
+        progressEvent.setProgressMessage(msg);
+        EventManager::get()->sendEvent(progressEvent.getPointer());
+        if (progressEvent.isCancelled()) {
+            deleteDataFilesToLoad(dataFilesToLoad,
+                                  iFile,
+                                  numberOfDataFilesToLoad);
+            resetBrain(keepSceneFiles,
+                       keepSpecFile);
+            return;
+        }
+        
+        if (iFile >= concurrentReadEndIndex) {
+            concurrentReadEndIndex = std::min(iFile + numberOfFilesReadConcurrently,
+                                              numberOfDataFilesToLoad);
+            readDataFilesConcurrently(dataFilesToLoad,
+                                      iFile,
+                                      concurrentReadEndIndex);
+        }
+        
+        try {
+            addDataFileToLoad(dataFileToLoad);
+        }
+        catch (const DataFileException& e) {
+            sceneAttributes->addToErrorMessage(e.whatString());
+        }
+    }
+    
     m_isSpecFileBeingRead = false;
     
     if (m_paletteFile != NULL) {
@@ -477,7 +477,56 @@ namespace caret {
                           const StructureEnum::Enum structure,
                           const AString& dataFileName,
                           const bool markDataFileAsModified);
-        
+
+        /**
+         * A data file from a spec file that is to be loaded.  Files are
+         * read by worker threads and then added to the brain, in the
+         * order of the spec file, on the main thread.
+         */
+        struct DataFileToLoad {
+            DataFileToLoad(const DataFileTypeEnum::Enum dataFileType,
+                           const StructureEnum::Enum structure,
+                           const AString& fileName,
+                           CaretDataFile* previouslyLoadedFile)
+            : m_dataFileType(dataFileType),
+            m_structure(structure),
+            m_fileName(fileName),
+            m_caretDataFile(previouslyLoadedFile),
+            m_previouslyLoadedFlag(previouslyLoadedFile != NULL) { }
+
+            /** Type of the data file */
+            DataFileTypeEnum::Enum m_dataFileType;
+
+            /** Structure from the spec file */
+            StructureEnum::Enum m_structure;
+
+            /** Name of the data file */
+            AString m_fileName;
+
+            /** File read by a worker thread (or the previously loaded file), NULL if not read */
+            CaretDataFile* m_caretDataFile;
+
+            /** File was in memory prior to loading a scene */
+            bool m_previouslyLoadedFlag;
+
+            /** Error message from reading the file in a worker thread */
+            AString m_errorMessage;
+        };
+
+        static bool isDataFileTypeReadConcurrently(const DataFileTypeEnum::Enum dataFileType);
+
+        void readDataFilesConcurrently(std::vector<DataFileToLoad>& dataFilesToLoad,
+                                       const int32_t firstIndex,
+                                       const int32_t lastIndex);
+
+        void addDataFileToLoad(DataFileToLoad& dataFileToLoad);
+
+        void deleteDataFilesToLoad(std::vector<DataFileToLoad>& dataFilesToLoad,
+                                   const int32_t firstIndex,
+                                   const int32_t lastIndex);
+
+        static int32_t getNumberOfDataFilesToReadConcurrently();
+
         /**
          * Is the data file with the given name already loaded?
          *
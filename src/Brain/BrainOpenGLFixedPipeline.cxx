@@ -53,6 +53,8 @@
 #include "BrainOpenGLShapeRing.h"
 #include "BrainOpenGLShapeRingOutline.h"
 #include "BrainOpenGLShapeSphere.h"
+#include "BrainOpenGLSurfaceBufferCache.h"
+#include "BrainOpenGLVolumeSliceTextureCache.h"
 #include "BrainOpenGLViewportContent.h"
 #include "BrainStructure.h"
 #include "BrowserTabContent.h"
@@ -114,6 +116,7 @@
 #include "SelectionItemSurfaceNodeIdentificationSymbol.h"
 #include "SelectionItemSurfaceTriangle.h"
 #include "SelectionItemVoxel.h"
+#include "SignedDistanceHelper.h"
 #include "SurfaceMontageConfigurationCerebellar.h"
 #include "SurfaceMontageConfigurationCerebral.h"
 #include "SurfaceMontageConfigurationFlatMaps.h"
@@ -175,6 +178,8 @@ m_windowIndex(windowIndex)
     this->colorIdentification   = new IdentificationWithColor();
     m_annotationDrawing.grabNew(new BrainOpenGLAnnotationDrawingFixedPipeline(this));
     m_textureManager.grabNew(new BrainOpenGLTextureManager(m_windowIndex));
+    m_surfaceBufferCache.grabNew(new BrainOpenGLSurfaceBufferCache());
+    m_volumeSliceTextureCache.grabNew(new BrainOpenGLVolumeSliceTextureCache());
                              
     m_shapeSphere = NULL;
     m_shapeCone   = NULL;
@@ -702,6 +707,9 @@ BrainOpenGLFixedPipeline::drawModels(Brain* brain,
         drawWindowAnnotations(windowViewport);
     }
     
+    m_surfaceBufferCache->finishFrame();
+    m_volumeSliceTextureCache->finishFrame();
+    
     this->checkForOpenGLError(NULL, "At end of drawModels()");
     
     m_brain = NULL;
@@ -1792,10 +1800,12 @@ BrainOpenGLFixedPipeline::drawSurface(Surface* surface,
              */
             glShadeModel(GL_FLAT); 
             if (drawingType != SurfaceDrawingTypeEnum::DRAW_HIDE) {
-                this->drawSurfaceNodes(surface,
-                                       nodeColoringRGBA);
-                this->drawSurfaceTriangles(surface,
+                if ( ! identifySurfaceWithRay(surface)) {
+                    this->drawSurfaceNodes(surface,
                                            nodeColoringRGBA);
+                    this->drawSurfaceTriangles(surface,
+                                               nodeColoringRGBA);
+                }
             }
 
             this->disableClippingPlanes();
@@ -1858,6 +1868,155 @@ BrainOpenGLFixedPipeline::drawSurface(Surface* surface,
     this->disableClippingPlanes();
 }
 
+/**
+ * Identify the surface triangle and vertex under the mouse by casting
+ * a ray from the mouse position through the surface's triangles instead
+ * of drawing the surface with identification colors and reading the
+ * color buffer.  The triangles are searched with the surface's octree
+ * so this is much faster than an identification render, especially
+ * for large surfaces.
+ *
+ * @param surface
+ *    Surface that is identified.
+ * @return
+ *    True if identification was performed, false if the surface must
+ *    be identified with the color identification drawing (clipping
+ *    planes are active so part of the surface is not displayed).
+ */
+bool
+BrainOpenGLFixedPipeline::identifySurfaceWithRay(Surface* surface)
+{
+    for (int32_t i = 0; i < 6; i++) {
+        if (glIsEnabled(GL_CLIP_PLANE0 + i)) {
+            return false;
+        }
+    }
+    
+    SelectionItemSurfaceTriangle* triangleID = m_brain->getSelectionManager()->getSurfaceTriangleIdentification();
+    SelectionItemSurfaceNode* nodeID = m_brain->getSelectionManager()->getSurfaceNodeIdentification();
+    if (( ! triangleID->isEnabledForSelection())
+        && ( ! nodeID->isEnabledForSelection())) {
+        return true;
+    }
+    
+    GLdouble selectionModelviewMatrix[16];
+    glGetDoublev(GL_MODELVIEW_MATRIX, selectionModelviewMatrix);
+    
+    GLdouble selectionProjectionMatrix[16];
+    glGetDoublev(GL_PROJECTION_MATRIX, selectionProjectionMatrix);
+    
+    GLint selectionViewport[4];
+    glGetIntegerv(GL_VIEWPORT, selectionViewport);
+    
+    /*
+     * Ray passes through the mouse position from the near
+     * clipping plane to the far clipping plane
+     */
+    double nearXYZ[3], farXYZ[3];
+    if ( ! (gluUnProject(this->mouseX, this->mouseY, 0.0,
+                         selectionModelviewMatrix, selectionProjectionMatrix, selectionViewport,
+                         &nearXYZ[0], &nearXYZ[1], &nearXYZ[2])
+            && gluUnProject(this->mouseX, this->mouseY, 1.0,
+                            selectionModelviewMatrix, selectionProjectionMatrix, selectionViewport,
+                            &farXYZ[0], &farXYZ[1], &farXYZ[2]))) {
+        return true;
+    }
+    const float rayStart[3] = { nearXYZ[0], nearXYZ[1], nearXYZ[2] };
+    const float rayDirection[3] = {
+        farXYZ[0] - nearXYZ[0],
+        farXYZ[1] - nearXYZ[1],
+        farXYZ[2] - nearXYZ[2]
+    };
+    
+    BarycentricInfo hit;
+    CaretPointer<SignedDistanceHelper> distanceHelper = surface->getSignedDistanceHelper();
+    if ( ! distanceHelper->rayIntersection(rayStart, rayDirection, hit)) {
+        return true;
+    }
+    
+    double hitWindowXYZ[3];
+    if ( ! gluProject(hit.point[0], hit.point[1], hit.point[2],
+                      selectionModelviewMatrix, selectionProjectionMatrix, selectionViewport,
+                      &hitWindowXYZ[0], &hitWindowXYZ[1], &hitWindowXYZ[2])) {
+        return true;
+    }
+    const float depth = hitWindowXYZ[2];
+    
+    /*
+     * Vertex of the triangle that is nearest the mouse on the screen
+     */
+    int32_t nearestIndex = -1;
+    double nearestScreenXYZ[3] = { 0.0, 0.0, 0.0 };
+    double nearestModelXYZ[3]  = { 0.0, 0.0, 0.0 };
+    double nearestDistance = 0.0;
+    for (int32_t i = 0; i < 3; i++) {
+        const float* xyz = surface->getCoordinate(hit.nodes[i]);
+        double windowXYZ[3];
+        if (gluProject(xyz[0], xyz[1], xyz[2],
+                       selectionModelviewMatrix, selectionProjectionMatrix, selectionViewport,
+                       &windowXYZ[0], &windowXYZ[1], &windowXYZ[2])) {
+            const double dist = MathFunctions::distanceSquared2D(windowXYZ[0],
+                                                                 windowXYZ[1],
+                                                                 this->mouseX,
+                                                                 this->mouseY);
+            if ((nearestIndex < 0)
+                || (dist < nearestDistance)) {
+                nearestIndex = i;
+                nearestDistance = dist;
+                for (int32_t j = 0; j < 3; j++) {
+                    nearestScreenXYZ[j] = windowXYZ[j];
+                    nearestModelXYZ[j]  = xyz[j];
+                }
+            }
+        }
+    }
+    if (nearestIndex < 0) {
+        return true;
+    }
+    const int32_t nearestNode = hit.nodes[nearestIndex];
+    
+    if (triangleID->isEnabledForSelection()) {
+        if (triangleID->isOtherScreenDepthCloserToViewer(depth)) {
+            triangleID->setBrain(surface->getBrainStructure()->getBrain());
+            triangleID->setSurface(surface);
+            triangleID->setTriangleNumber(hit.triangle);
+            triangleID->setNearestNode(nearestNode);
+            triangleID->setNearestNodeScreenXYZ(nearestScreenXYZ);
+            triangleID->setNearestNodeModelXYZ(nearestModelXYZ);
+            triangleID->setScreenDepth(depth);
+            const float* c1 = surface->getCoordinate(hit.nodes[0]);
+            const float* c2 = surface->getCoordinate(hit.nodes[1]);
+            const float* c3 = surface->getCoordinate(hit.nodes[2]);
+            const float average[3] = {
+                c1[0] + c2[0] + c3[0],
+                c1[1] + c2[1] + c3[1],
+                c1[2] + c2[2] + c3[2]
+            };
+            this->setSelectedItemScreenXYZ(triangleID, average);
+            CaretLogFine("Selected Triangle: " + triangleID->toString());
+        }
+        else {
+            CaretLogFine("Rejecting Selected Triangle but still using: " + triangleID->toString());
+        }
+    }
+    
+    if (nodeID->isEnabledForSelection()) {
+        if (nodeID->isOtherScreenDepthCloserToViewer(depth)) {
+            nodeID->setBrain(surface->getBrainStructure()->getBrain());
+            nodeID->setSurface(surface);
+            nodeID->setNodeNumber(nearestNode);
+            nodeID->setScreenDepth(depth);
+            this->setSelectedItemScreenXYZ(nodeID, surface->getCoordinate(nearestNode));
+            CaretLogFine("Selected Vertex: " + nodeID->toString());
+        }
+        else {
+            CaretLogFine("Rejecting Selected Vertex: " + nodeID->toString());
+        }
+    }
+    
+    return true;
+}
+
 /**
  * Draw a surface as individual triangles.
  * @param surface
@@ -2295,7 +2454,8 @@ BrainOpenGLFixedPipeline::drawSurfaceNodes(Surface* surface,
 
 
 /**
- * Draw a surface triangles with vertex arrays.
+ * Draw a surface triangles with vertex arrays, or with buffer objects
+ * when they are available.
  * @param surface
  *    Surface that is drawn.
  * @param nodeColoringRGBA
@@ -2305,6 +2465,17 @@ void
 BrainOpenGLFixedPipeline::drawSurfaceTrianglesWithVertexArrays(const Surface* surface,
                                                                const float* nodeColoringRGBA)
 {
+    /*
+     * Coordinates, normals, and triangles are kept in buffer objects
+     * so that only the coloring needs to be sent to OpenGL, and
+     * only when it has changed.
+     */
+    if (m_surfaceBufferCache->drawSurfaceTriangles(surface,
+                                                   nodeColoringRGBA,
+                                                   m_backgroundColorFloat)) {
+        return;
+    }
+    
     glEnableClientState(GL_VERTEX_ARRAY);
     if (nodeColoringRGBA != NULL) {
         glEnableClientState(GL_COLOR_ARRAY);
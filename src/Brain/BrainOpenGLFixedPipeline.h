@@ -52,6 +52,8 @@ namespace caret {
     class BrainOpenGLShapeRing;
     class BrainOpenGLShapeRingOutline;
     class BrainOpenGLShapeSphere;
+    class BrainOpenGLSurfaceBufferCache;
+    class BrainOpenGLVolumeSliceTextureCache;
     class BrainOpenGLTextureManager;
     class BrainOpenGLViewportContent;
     class BrowserTabContent;
@@ -200,6 +202,8 @@ namespace caret {
         void drawSurfaceTriangles(Surface* surface,
                                   const float* nodeColoringRGBA);
         
+        bool identifySurfaceWithRay(Surface* surface);
+        
         void drawSurfaceNodeAttributes(Surface* surface);
         
         void drawSurfaceBorderBeingDrawn(const Surface* surface);
@@ -609,6 +613,12 @@ namespace caret {
         /** The texture manager. */
         CaretPointer<BrainOpenGLTextureManager> m_textureManager;
         
+        /** Buffer objects for drawing surfaces in retained mode. */
+        CaretPointer<BrainOpenGLSurfaceBufferCache> m_surfaceBufferCache;
+        
+        /** Textures for drawing orthogonal volume slices. */
+        CaretPointer<BrainOpenGLVolumeSliceTextureCache> m_volumeSliceTextureCache;
+        
         static bool s_staticInitialized;
 
         static const float s_gluLookAtCenterFromEyeOffsetDistance;
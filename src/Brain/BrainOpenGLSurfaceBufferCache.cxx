@@ -0,0 +1,439 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016 Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#define __BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_DECLARE__
+#include "BrainOpenGLSurfaceBufferCache.h"
+#undef __BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_DECLARE__
+
+#include "BrainOpenGL.h"
+#include "CaretAssert.h"
+#include "CaretLogger.h"
+#include "Surface.h"
+
+using namespace caret;
+
+
+
+/**
+ * \class caret::BrainOpenGLSurfaceBufferCache
+ * \brief Retained-mode drawing of surface triangles with OpenGL buffer objects.
+ * \ingroup Brain
+ *
+ * The coordinates, normal vectors, and triangles of each surface are
+ * copied to buffer objects once and reused for every redraw, in every
+ * tab of the window.  The RGBA coloring is copied to its own buffer,
+ * one for each coloring array of the surface (single surface, montage,
+ * and whole brain coloring in each tab), and is only copied again after
+ * the surface's coloring has been invalidated or replaced.
+ *
+ * Each window has its own OpenGL context, so each window's
+ * BrainOpenGLFixedPipeline has its own instance of this cache.
+ * Buffer names are verified before use since an image capture may
+ * recreate the OpenGL context.
+ *
+ * When buffer objects are not available (compiled without support
+ * or OpenGL older than 1.5), drawSurfaceTriangles() returns false and
+ * the caller should draw with client-side vertex arrays.
+ */
+
+/**
+ * Constructor.
+ */
+BrainOpenGLSurfaceBufferCache::BrainOpenGLSurfaceBufferCache()
+: CaretObject()
+{
+    m_frameNumber   = 0;
+    m_supportStatus = SUPPORT_UNKNOWN;
+}
+
+/**
+ * Destructor.
+ */
+BrainOpenGLSurfaceBufferCache::~BrainOpenGLSurfaceBufferCache()
+{
+    /*
+     * As with textures, the buffers are deleted along with the
+     * OpenGL context, which is deleted with the instance of
+     * BrainOpenGLFixedPipeline that owns this cache.
+     */
+}
+
+/**
+ * @return True if buffer objects can be used for drawing surfaces.
+ * Must be called while the OpenGL context is current.
+ */
+bool
+BrainOpenGLSurfaceBufferCache::isSupported()
+{
+    if (m_supportStatus == SUPPORT_UNKNOWN) {
+        m_supportStatus = SUPPORT_NO;
+#ifdef BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+        if (BrainOpenGL::isVertexBuffersSupported()
+            && BrainOpenGL::testForVersionOfOpenGLSupported("1.5")) {
+            m_supportStatus = SUPPORT_YES;
+        }
+        else {
+            CaretLogFine("OpenGL buffer objects not available, surfaces drawn with vertex arrays.");
+        }
+#endif // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    }
+
+    return (m_supportStatus == SUPPORT_YES);
+}
+
+/**
+ * Draw the triangles of a surface using buffer objects.
+ *
+ * @param surface
+ *    Surface that is drawn.
+ * @param nodeColoringRGBA
+ *    RGBA coloring for the nodes, may be NULL in which case the
+ *    background color is used.
+ * @param backgroundColor
+ *    Color used when there is no node coloring.
+ * @return
+ *    True if the surface was drawn, false if buffer objects are
+ *    not available and the surface must be drawn some other way.
+ */
+bool
+BrainOpenGLSurfaceBufferCache::drawSurfaceTriangles(const Surface* surface,
+                                                    const float* nodeColoringRGBA,
+                                                    const float backgroundColor[3])
+{
+    CaretAssert(surface);
+
+    if ( ! isSupported()) {
+        return false;
+    }
+
+    if ((surface->getNumberOfNodes() <= 0)
+        || (surface->getNumberOfTriangles() <= 0)) {
+        return false;
+    }
+
+#ifdef BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    std::map<const Surface*, SurfaceBuffers>::iterator surfaceIter = m_surfaceBuffers.find(surface);
+    if (surfaceIter == m_surfaceBuffers.end()) {
+        SurfaceBuffers newBuffers;
+        newBuffers.m_coordinateBufferID = 0;
+        newBuffers.m_normalBufferID     = 0;
+        newBuffers.m_triangleBufferID   = 0;
+        newBuffers.m_geometryModificationCount = -1;
+        newBuffers.m_numberOfTriangles  = 0;
+        newBuffers.m_lastFrameUsed      = m_frameNumber;
+        surfaceIter = m_surfaceBuffers.insert(std::make_pair(surface,
+                                                             newBuffers)).first;
+    }
+    SurfaceBuffers& buffers = surfaceIter->second;
+    buffers.m_lastFrameUsed = m_frameNumber;
+
+    if ((buffers.m_geometryModificationCount != surface->getGeometryModificationCount())
+        || (glIsBuffer(buffers.m_coordinateBufferID) == GL_FALSE)
+        || (glIsBuffer(buffers.m_normalBufferID) == GL_FALSE)
+        || (glIsBuffer(buffers.m_triangleBufferID) == GL_FALSE)) {
+        if ( ! uploadGeometry(surface,
+                              buffers)) {
+            return false;
+        }
+    }
+
+    GLuint colorBufferID = 0;
+    if (nodeColoringRGBA != NULL) {
+        std::map<const float*, ColorBuffer>::iterator colorIter = buffers.m_colorBuffers.find(nodeColoringRGBA);
+        if (colorIter == buffers.m_colorBuffers.end()) {
+            ColorBuffer newColorBuffer;
+            newColorBuffer.m_bufferID = 0;
+            newColorBuffer.m_coloringModificationCount = -1;
+            newColorBuffer.m_lastFrameUsed = m_frameNumber;
+            colorIter = buffers.m_colorBuffers.insert(std::make_pair(nodeColoringRGBA,
+                                                                     newColorBuffer)).first;
+        }
+        ColorBuffer& colorBuffer = colorIter->second;
+        colorBuffer.m_lastFrameUsed = m_frameNumber;
+
+        if ((colorBuffer.m_coloringModificationCount != surface->getNodeColoringModificationCount())
+            || (glIsBuffer(colorBuffer.m_bufferID) == GL_FALSE)) {
+            if ( ! uploadColoring(surface,
+                                  nodeColoringRGBA,
+                                  colorBuffer)) {
+                return false;
+            }
+        }
+        colorBufferID = colorBuffer.m_bufferID;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 buffers.m_coordinateBufferID);
+    glVertexPointer(3,
+                    GL_FLOAT,
+                    0,
+                    (GLvoid*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 buffers.m_normalBufferID);
+    glNormalPointer(GL_FLOAT,
+                    0,
+                    (GLvoid*)0);
+
+    if (colorBufferID > 0) {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER,
+                     colorBufferID);
+        glColorPointer(4,
+                       GL_FLOAT,
+                       0,
+                       (GLvoid*)0);
+    }
+    else {
+        glColor3fv(backgroundColor);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 buffers.m_triangleBufferID);
+    glDrawElements(GL_TRIANGLES,
+                   (3 * buffers.m_numberOfTriangles),
+                   GL_UNSIGNED_INT,
+                   (GLvoid*)0);
+
+    /*
+     * Deselect active buffers so that client-side
+     * vertex arrays used elsewhere still function.
+     */
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 0);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+
+    return true;
+#else // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    return false;
+#endif // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+}
+
+/**
+ * Copy the coordinates, normal vectors, and triangles of a surface
+ * into its buffers, creating the buffers if needed.
+ *
+ * @param surface
+ *    The surface.
+ * @param buffers
+ *    Buffers for the surface.
+ * @return
+ *    True if successful.
+ */
+bool
+BrainOpenGLSurfaceBufferCache::uploadGeometry(const Surface* surface,
+                                              SurfaceBuffers& buffers)
+{
+#ifdef BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    const int32_t numberOfNodes     = surface->getNumberOfNodes();
+    const int32_t numberOfTriangles = surface->getNumberOfTriangles();
+
+    GLuint* bufferIDs[3] = {
+        &buffers.m_coordinateBufferID,
+        &buffers.m_normalBufferID,
+        &buffers.m_triangleBufferID
+    };
+    for (int32_t i = 0; i < 3; i++) {
+        if (glIsBuffer(*bufferIDs[i]) == GL_FALSE) {
+            glGenBuffers(1, bufferIDs[i]);
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 buffers.m_coordinateBufferID);
+    glBufferData(GL_ARRAY_BUFFER,
+                 numberOfNodes * 3 * sizeof(GLfloat),
+                 surface->getCoordinate(0),
+                 GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 buffers.m_normalBufferID);
+    glBufferData(GL_ARRAY_BUFFER,
+                 numberOfNodes * 3 * sizeof(GLfloat),
+                 surface->getNormalVector(0),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 buffers.m_triangleBufferID);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 numberOfTriangles * 3 * sizeof(GLuint),
+                 surface->getTriangle(0),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                 0);
+
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        CaretLogWarning("Insufficient OpenGL memory for surface buffers, drawing with vertex arrays.");
+        deleteSurfaceBuffers(buffers);
+        return false;
+    }
+
+    buffers.m_numberOfTriangles = numberOfTriangles;
+    buffers.m_geometryModificationCount = surface->getGeometryModificationCount();
+
+    return true;
+#else // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    return false;
+#endif // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+}
+
+/**
+ * Copy RGBA coloring into a color buffer, creating the buffer if needed.
+ *
+ * @param surface
+ *    Surface that is colored.
+ * @param nodeColoringRGBA
+ *    RGBA coloring for the nodes.
+ * @param colorBuffer
+ *    The color buffer.
+ * @return
+ *    True if successful.
+ */
+bool
+BrainOpenGLSurfaceBufferCache::uploadColoring(const Surface* surface,
+                                              const float* nodeColoringRGBA,
+                                              ColorBuffer& colorBuffer)
+{
+#ifdef BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    if (glIsBuffer(colorBuffer.m_bufferID) == GL_FALSE) {
+        glGenBuffers(1, &colorBuffer.m_bufferID);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 colorBuffer.m_bufferID);
+    glBufferData(GL_ARRAY_BUFFER,
+                 surface->getNumberOfNodes() * 4 * sizeof(GLfloat),
+                 nodeColoringRGBA,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER,
+                 0);
+
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        CaretLogWarning("Insufficient OpenGL memory for surface coloring buffer, drawing with vertex arrays.");
+        glDeleteBuffers(1, &colorBuffer.m_bufferID);
+        colorBuffer.m_bufferID = 0;
+        colorBuffer.m_coloringModificationCount = -1;
+        return false;
+    }
+
+    colorBuffer.m_coloringModificationCount = surface->getNodeColoringModificationCount();
+
+    return true;
+#else // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    return false;
+#endif // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+}
+
+/**
+ * Delete all of the buffers for a surface.
+ *
+ * @param buffers
+ *    Buffers for the surface.
+ */
+void
+BrainOpenGLSurfaceBufferCache::deleteSurfaceBuffers(SurfaceBuffers& buffers)
+{
+#ifdef BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    GLuint* bufferIDs[3] = {
+        &buffers.m_coordinateBufferID,
+        &buffers.m_normalBufferID,
+        &buffers.m_triangleBufferID
+    };
+    for (int32_t i = 0; i < 3; i++) {
+        if (glIsBuffer(*bufferIDs[i]) == GL_TRUE) {
+            glDeleteBuffers(1, bufferIDs[i]);
+        }
+        *bufferIDs[i] = 0;
+    }
+
+    for (std::map<const float*, ColorBuffer>::iterator colorIter = buffers.m_colorBuffers.begin();
+         colorIter != buffers.m_colorBuffers.end();
+         colorIter++) {
+        if (glIsBuffer(colorIter->second.m_bufferID) == GL_TRUE) {
+            glDeleteBuffers(1, &colorIter->second.m_bufferID);
+        }
+    }
+    buffers.m_colorBuffers.clear();
+#endif // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    buffers.m_geometryModificationCount = -1;
+}
+
+/**
+ * Called after all models in the window have been drawn.  Releases
+ * buffers that have not been used recently, such as those for surfaces
+ * that have been closed or coloring arrays for tabs that are no longer
+ * displayed.  Must be called while the OpenGL context is current.
+ */
+void
+BrainOpenGLSurfaceBufferCache::finishFrame()
+{
+    m_frameNumber++;
+    if (m_supportStatus != SUPPORT_YES) {
+        return;
+    }
+
+#ifdef BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+    std::map<const Surface*, SurfaceBuffers>::iterator surfaceIter = m_surfaceBuffers.begin();
+    while (surfaceIter != m_surfaceBuffers.end()) {
+        SurfaceBuffers& buffers = surfaceIter->second;
+        if ((m_frameNumber - buffers.m_lastFrameUsed) > s_maximumUnusedFrames) {
+            deleteSurfaceBuffers(buffers);
+            m_surfaceBuffers.erase(surfaceIter++);
+            continue;
+        }
+
+        std::map<const float*, ColorBuffer>::iterator colorIter = buffers.m_colorBuffers.begin();
+        while (colorIter != buffers.m_colorBuffers.end()) {
+            if ((m_frameNumber - colorIter->second.m_lastFrameUsed) > s_maximumUnusedFrames) {
+                if (glIsBuffer(colorIter->second.m_bufferID) == GL_TRUE) {
+                    glDeleteBuffers(1, &colorIter->second.m_bufferID);
+                }
+                buffers.m_colorBuffers.erase(colorIter++);
+            }
+            else {
+                ++colorIter;
+            }
+        }
+        ++surfaceIter;
+    }
+#endif // BRAIN_OPENGL_INFO_SUPPORTS_VERTEX_BUFFERS
+}
+
+/**
+ * Get a description of this object's content.
+ * @return String describing this object's content.
+ */
+AString
+BrainOpenGLSurfaceBufferCache::toString() const
+{
+    return ("BrainOpenGLSurfaceBufferCache: "
+            + AString::number(m_surfaceBuffers.size())
+            + " surfaces");
+}
@@ -0,0 +1,119 @@
+#ifndef __BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_H__
+#define __BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016 Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include <map>
+#include <stdint.h>
+
+#include "CaretObject.h"
+#include "CaretOpenGLInclude.h"
+
+
+namespace caret {
+
+    class Surface;
+
+    class BrainOpenGLSurfaceBufferCache : public CaretObject {
+
+    public:
+        BrainOpenGLSurfaceBufferCache();
+
+        virtual ~BrainOpenGLSurfaceBufferCache();
+
+        bool drawSurfaceTriangles(const Surface* surface,
+                                  const float* nodeColoringRGBA,
+                                  const float backgroundColor[3]);
+
+        void finishFrame();
+
+        // ADD_NEW_METHODS_HERE
+
+        virtual AString toString() const;
+
+    private:
+        BrainOpenGLSurfaceBufferCache(const BrainOpenGLSurfaceBufferCache&);
+
+        BrainOpenGLSurfaceBufferCache& operator=(const BrainOpenGLSurfaceBufferCache&);
+
+        /** Buffer with the RGBA coloring from one of a surface's coloring arrays */
+        struct ColorBuffer {
+            GLuint m_bufferID;
+
+            int64_t m_coloringModificationCount;
+
+            int64_t m_lastFrameUsed;
+        };
+
+        /** Buffers with the geometry of one surface */
+        struct SurfaceBuffers {
+            GLuint m_coordinateBufferID;
+
+            GLuint m_normalBufferID;
+
+            GLuint m_triangleBufferID;
+
+            int64_t m_geometryModificationCount;
+
+            int32_t m_numberOfTriangles;
+
+            int64_t m_lastFrameUsed;
+
+            /** Keyed by the coloring array, there is one for each tab and model type the surface is drawn in */
+            std::map<const float*, ColorBuffer> m_colorBuffers;
+        };
+
+        bool isSupported();
+
+        bool uploadGeometry(const Surface* surface,
+                            SurfaceBuffers& buffers);
+
+        bool uploadColoring(const Surface* surface,
+                            const float* nodeColoringRGBA,
+                            ColorBuffer& colorBuffer);
+
+        void deleteSurfaceBuffers(SurfaceBuffers& buffers);
+
+        std::map<const Surface*, SurfaceBuffers> m_surfaceBuffers;
+
+        int64_t m_frameNumber;
+
+        /** Buffers not used for this many frames are released, a surface that is deleted is never drawn again */
+        static const int64_t s_maximumUnusedFrames;
+
+        enum SupportStatus {
+            SUPPORT_UNKNOWN,
+            SUPPORT_NO,
+            SUPPORT_YES
+        };
+
+        SupportStatus m_supportStatus;
+
+        // ADD_NEW_MEMBERS_HERE
+
+    };
+
+#ifdef __BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_DECLARE__
+    const int64_t BrainOpenGLSurfaceBufferCache::s_maximumUnusedFrames = 100;
+#endif // __BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_DECLARE__
+
+} // namespace
+#endif  //__BRAIN_OPEN_G_L_SURFACE_BUFFER_CACHE_H__
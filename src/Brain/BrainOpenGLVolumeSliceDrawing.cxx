@@ -31,6 +31,7 @@
 #include "Brain.h"
 #include "BrainOpenGLAnnotationDrawingFixedPipeline.h"
 #include "BrainOpenGLPrimitiveDrawing.h"
+#include "BrainOpenGLVolumeSliceTextureCache.h"
 #include "BrainOpenGLViewportContent.h"
 #include "BrainordinateRegionOfInterest.h"
 #include "BrowserTabContent.h"
@@ -4741,6 +4742,27 @@ BrainOpenGLVolumeSliceDrawing::drawOrthogonalSliceVoxels(const float sliceNormal
         return;
     }
     
+    /*
+     * When drawing (not identifying), the slice is drawn as a
+     * single quadrilateral with a texture containing the voxel
+     * coloring.
+     */
+    if ( ! m_identificationModeFlag) {
+        if (m_fixedPipelineDrawing->m_volumeSliceTextureCache->drawSlice(volumeInterface,
+                                                                         mapIndex,
+                                                                         m_tabIndex,
+                                                                         sliceNormalVector,
+                                                                         coordinate,
+                                                                         rowStep,
+                                                                         columnStep,
+                                                                         numberOfColumns,
+                                                                         numberOfRows,
+                                                                         sliceRGBA,
+                                                                         sliceOpacity)) {
+            return;
+        }
+    }
+    
     /*
      * There are two ways to draw the voxels.
      *
@@ -0,0 +1,327 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016 Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#define __BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_DECLARE__
+#include "BrainOpenGLVolumeSliceTextureCache.h"
+#undef __BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_DECLARE__
+
+#include "CaretAssert.h"
+#include "CaretLogger.h"
+
+using namespace caret;
+
+
+    
+/**
+ * \class caret::BrainOpenGLVolumeSliceTextureCache 
+ * \brief Draws orthogonal volume slices as textured quadrilaterals.
+ * \ingroup Brain
+ *
+ * Each slice is drawn as a single quadrilateral containing a texture
+ * with one texel for each voxel, instead of one quadrilateral for
+ * each voxel.  The voxel coloring comes from the volume file's voxel
+ * colorizer, which colors each map once and only again after the
+ * map's data or palette has changed.  A copy of the coloring is kept
+ * with each texture, and the texture is only replaced when the
+ * coloring of the slice differs from the copy (map, palette, label,
+ * or opacity change).
+ *
+ * Each window has its own OpenGL context, so each window's
+ * BrainOpenGLFixedPipeline has its own instance of this cache.
+ *
+ * Textures are only used when drawing.  Identification still draws
+ * each voxel so that each voxel receives an identification color.
+ */
+
+/**
+ * Constructor.
+ */
+BrainOpenGLVolumeSliceTextureCache::BrainOpenGLVolumeSliceTextureCache()
+: CaretObject()
+{
+    m_frameNumber = 0;
+    m_maximumTextureDimension = -1;
+}
+
+/**
+ * Destructor.
+ */
+BrainOpenGLVolumeSliceTextureCache::~BrainOpenGLVolumeSliceTextureCache()
+{
+    /*
+     * Textures are deleted along with the OpenGL context, which is
+     * deleted with the instance of BrainOpenGLFixedPipeline that
+     * owns this cache.
+     */
+}
+
+/**
+ * Compare slice keys for use in a map.
+ *
+ * @param rhs
+ *    Key on right side of comparison.
+ * @return
+ *    True if this key is less than rhs.
+ */
+bool
+BrainOpenGLVolumeSliceTextureCache::SliceKey::operator<(const SliceKey& rhs) const
+{
+    if (m_volume != rhs.m_volume) return (m_volume < rhs.m_volume);
+    if (m_mapIndex != rhs.m_mapIndex) return (m_mapIndex < rhs.m_mapIndex);
+    if (m_tabIndex != rhs.m_tabIndex) return (m_tabIndex < rhs.m_tabIndex);
+    for (int32_t i = 0; i < 3; i++) {
+        if (m_coordinate[i] != rhs.m_coordinate[i]) return (m_coordinate[i] < rhs.m_coordinate[i]);
+    }
+    if (m_numberOfColumns != rhs.m_numberOfColumns) return (m_numberOfColumns < rhs.m_numberOfColumns);
+    return (m_numberOfRows < rhs.m_numberOfRows);
+}
+
+/**
+ * Draw the voxels in an orthogonal slice as a textured quadrilateral.
+ *
+ * @param volume
+ *    Volume being drawn.
+ * @param mapIndex
+ *    Selected map in the volume being drawn.
+ * @param tabIndex
+ *    Index of the tab being drawn.
+ * @param sliceNormalVector
+ *    Normal vector of the slice plane.
+ * @param coordinate
+ *    Coordinate of bottom left corner of the first voxel in the slice.
+ * @param rowStep
+ *    Three-dimensional step to next row.
+ * @param columnStep
+ *    Three-dimensional step to next column.
+ * @param numberOfColumns
+ *    Number of columns in the slice.
+ * @param numberOfRows
+ *    Number of rows in the slice.
+ * @param sliceRGBA
+ *    RGBA coloring for voxels in the slice.
+ * @param sliceOpacity
+ *    Opacity from the overlay.
+ * @return
+ *    True if the slice was drawn, false if the slice is too large
+ *    for a texture and must be drawn some other way.
+ */
+bool
+BrainOpenGLVolumeSliceTextureCache::drawSlice(const VolumeMappableInterface* volume,
+                                              const int32_t mapIndex,
+                                              const int32_t tabIndex,
+                                              const float sliceNormalVector[3],
+                                              const float coordinate[3],
+                                              const float rowStep[3],
+                                              const float columnStep[3],
+                                              const int64_t numberOfColumns,
+                                              const int64_t numberOfRows,
+                                              const std::vector<uint8_t>& sliceRGBA,
+                                              const uint8_t sliceOpacity)
+{
+    if (m_maximumTextureDimension < 0) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE,
+                      &m_maximumTextureDimension);
+    }
+    if ((numberOfColumns > m_maximumTextureDimension)
+        || (numberOfRows > m_maximumTextureDimension)) {
+        return false;
+    }
+    
+    /*
+     * Same coloring as the quadrilateral drawing, voxels without
+     * coloring are transparent and others use the overlay's opacity.
+     */
+    const int64_t numberOfTexelComponents = numberOfColumns * numberOfRows * 4;
+    CaretAssert(static_cast<int64_t>(sliceRGBA.size()) >= numberOfTexelComponents);
+    m_newTextureRGBA.resize(numberOfTexelComponents);
+    for (int64_t i = 0; i < numberOfTexelComponents; i += 4) {
+        if (sliceRGBA[i + 3] > 0) {
+            m_newTextureRGBA[i]     = sliceRGBA[i];
+            m_newTextureRGBA[i + 1] = sliceRGBA[i + 1];
+            m_newTextureRGBA[i + 2] = sliceRGBA[i + 2];
+            m_newTextureRGBA[i + 3] = sliceOpacity;
+        }
+        else {
+            m_newTextureRGBA[i]     = 0;
+            m_newTextureRGBA[i + 1] = 0;
+            m_newTextureRGBA[i + 2] = 0;
+            m_newTextureRGBA[i + 3] = 0;
+        }
+    }
+    
+    SliceKey key;
+    key.m_volume   = volume;
+    key.m_mapIndex = mapIndex;
+    key.m_tabIndex = tabIndex;
+    key.m_coordinate[0] = coordinate[0];
+    key.m_coordinate[1] = coordinate[1];
+    key.m_coordinate[2] = coordinate[2];
+    key.m_numberOfColumns = numberOfColumns;
+    key.m_numberOfRows    = numberOfRows;
+    
+    std::map<SliceKey, SliceTexture>::iterator textureIter = m_sliceTextures.find(key);
+    if (textureIter == m_sliceTextures.end()) {
+        SliceTexture newTexture;
+        newTexture.m_textureName = 0;
+        newTexture.m_lastFrameUsed = m_frameNumber;
+        textureIter = m_sliceTextures.insert(std::make_pair(key,
+                                                            newTexture)).first;
+    }
+    SliceTexture& sliceTexture = textureIter->second;
+    sliceTexture.m_lastFrameUsed = m_frameNumber;
+    
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
+    if (glIsTexture(sliceTexture.m_textureName) == GL_FALSE) {
+        /*
+         * New texture or the OpenGL context was replaced
+         */
+        glGenTextures(1, &sliceTexture.m_textureName);
+        glBindTexture(GL_TEXTURE_2D, sliceTexture.m_textureName);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D,
+                     0,
+                     GL_RGBA,
+                     numberOfColumns,
+                     numberOfRows,
+                     0,
+                     GL_RGBA,
+                     GL_UNSIGNED_BYTE,
+                     &m_newTextureRGBA[0]);
+        sliceTexture.m_textureRGBA = m_newTextureRGBA;
+        
+        if (glGetError() == GL_OUT_OF_MEMORY) {
+            CaretLogWarning("Insufficient OpenGL memory for volume slice texture, drawing slice with quadrilaterals.");
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glDeleteTextures(1, &sliceTexture.m_textureName);
+            m_sliceTextures.erase(textureIter);
+            glPopClientAttrib();
+            return false;
+        }
+    }
+    else {
+        glBindTexture(GL_TEXTURE_2D, sliceTexture.m_textureName);
+        if (sliceTexture.m_textureRGBA != m_newTextureRGBA) {
+            glTexSubImage2D(GL_TEXTURE_2D,
+                            0,
+                            0,
+                            0,
+                            numberOfColumns,
+                            numberOfRows,
+                            GL_RGBA,
+                            GL_UNSIGNED_BYTE,
+                            &m_newTextureRGBA[0]);
+            sliceTexture.m_textureRGBA = m_newTextureRGBA;
+        }
+    }
+    
+    glPopClientAttrib();
+    
+    const float bottomLeft[3] = {
+        coordinate[0],
+        coordinate[1],
+        coordinate[2]
+    };
+    const float bottomRight[3] = {
+        coordinate[0] + (numberOfColumns * columnStep[0]),
+        coordinate[1] + (numberOfColumns * columnStep[1]),
+        coordinate[2] + (numberOfColumns * columnStep[2])
+    };
+    const float topLeft[3] = {
+        coordinate[0] + (numberOfRows * rowStep[0]),
+        coordinate[1] + (numberOfRows * rowStep[1]),
+        coordinate[2] + (numberOfRows * rowStep[2])
+    };
+    const float topRight[3] = {
+        bottomRight[0] + (numberOfRows * rowStep[0]),
+        bottomRight[1] + (numberOfRows * rowStep[1]),
+        bottomRight[2] + (numberOfRows * rowStep[2])
+    };
+    
+    /*
+     * Alpha test prevents transparent voxels from
+     * changing the depth buffer, as with the quadrilaterals
+     * which are not drawn for transparent voxels.
+     */
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.0);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    
+    glBegin(GL_QUADS);
+    glNormal3fv(sliceNormalVector);
+    glTexCoord2f(0.0, 0.0);
+    glVertex3fv(bottomLeft);
+    glTexCoord2f(1.0, 0.0);
+    glVertex3fv(bottomRight);
+    glTexCoord2f(1.0, 1.0);
+    glVertex3fv(topRight);
+    glTexCoord2f(0.0, 1.0);
+    glVertex3fv(topLeft);
+    glEnd();
+    
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+    
+    return true;
+}
+
+/**
+ * Called after all models in the window have been drawn.  Releases
+ * textures that have not been used recently, such as those for slices
+ * that are no longer displayed or files that have been closed.
+ * Must be called while the OpenGL context is current.
+ */
+void
+BrainOpenGLVolumeSliceTextureCache::finishFrame()
+{
+    m_frameNumber++;
+    
+    std::map<SliceKey, SliceTexture>::iterator textureIter = m_sliceTextures.begin();
+    while (textureIter != m_sliceTextures.end()) {
+        SliceTexture& sliceTexture = textureIter->second;
+        if ((m_frameNumber - sliceTexture.m_lastFrameUsed) > s_maximumUnusedFrames) {
+            if (glIsTexture(sliceTexture.m_textureName) == GL_TRUE) {
+                glDeleteTextures(1, &sliceTexture.m_textureName);
+            }
+            m_sliceTextures.erase(textureIter++);
+        }
+        else {
+            ++textureIter;
+        }
+    }
+}
+
+/**
+ * Get a description of this object's content.
+ * @return String describing this object's content.
+ */
+AString 
+BrainOpenGLVolumeSliceTextureCache::toString() const
+{
+    return ("BrainOpenGLVolumeSliceTextureCache: "
+            + AString::number(m_sliceTextures.size())
+            + " slices");
+}
@@ -0,0 +1,115 @@
+#ifndef __BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_H__
+#define __BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016 Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include "CaretObject.h"
+#include "CaretOpenGLInclude.h"
+
+
+namespace caret {
+
+    class VolumeMappableInterface;
+    
+    class BrainOpenGLVolumeSliceTextureCache : public CaretObject {
+        
+    public:
+        BrainOpenGLVolumeSliceTextureCache();
+        
+        virtual ~BrainOpenGLVolumeSliceTextureCache();
+        
+        bool drawSlice(const VolumeMappableInterface* volume,
+                       const int32_t mapIndex,
+                       const int32_t tabIndex,
+                       const float sliceNormalVector[3],
+                       const float coordinate[3],
+                       const float rowStep[3],
+                       const float columnStep[3],
+                       const int64_t numberOfColumns,
+                       const int64_t numberOfRows,
+                       const std::vector<uint8_t>& sliceRGBA,
+                       const uint8_t sliceOpacity);
+        
+        void finishFrame();
+        
+        // ADD_NEW_METHODS_HERE
+
+        virtual AString toString() const;
+        
+    private:
+        BrainOpenGLVolumeSliceTextureCache(const BrainOpenGLVolumeSliceTextureCache&);
+
+        BrainOpenGLVolumeSliceTextureCache& operator=(const BrainOpenGLVolumeSliceTextureCache&);
+        
+        /** Identifies a slice of a map, the same slice in each tab has its own texture */
+        struct SliceKey {
+            const VolumeMappableInterface* m_volume;
+            
+            int32_t m_mapIndex;
+            
+            int32_t m_tabIndex;
+            
+            /** Bottom left corner of the slice, differs for each slice and slice plane */
+            float m_coordinate[3];
+            
+            int64_t m_numberOfColumns;
+            
+            int64_t m_numberOfRows;
+            
+            bool operator<(const SliceKey& rhs) const;
+        };
+        
+        /** Texture containing the coloring of one slice */
+        struct SliceTexture {
+            GLuint m_textureName;
+            
+            /** Copy of the texels in the texture, texture is only replaced when they change */
+            std::vector<uint8_t> m_textureRGBA;
+            
+            int64_t m_lastFrameUsed;
+        };
+        
+        std::map<SliceKey, SliceTexture> m_sliceTextures;
+        
+        /** Texels for the slice being drawn, member to minimize allocations */
+        std::vector<uint8_t> m_newTextureRGBA;
+        
+        int64_t m_frameNumber;
+        
+        GLint m_maximumTextureDimension;
+        
+        /** Textures not used for this many frames are released, kept short since scrolling through slices creates a texture for each slice */
+        static const int64_t s_maximumUnusedFrames;
+        
+        // ADD_NEW_MEMBERS_HERE
+
+    };
+    
+#ifdef __BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_DECLARE__
+    const int64_t BrainOpenGLVolumeSliceTextureCache::s_maximumUnusedFrames = 10;
+#endif // __BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_DECLARE__
+
+} // namespace
+#endif  //__BRAIN_OPEN_G_L_VOLUME_SLICE_TEXTURE_CACHE_H__
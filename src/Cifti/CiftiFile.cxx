@@ -30,6 +30,8 @@
 #include "MultiDimIterator.h"
 #include "NiftiIO.h"
 
+#include <algorithm>
+
 using namespace std;
 using namespace caret;
 
@@ -46,6 +48,7 @@ namespace
                         const int16_t& datatype, const bool& rescale, const double& minval, const double& maxval);//make new empty file with read/write
         void getRow(float* dataOut, const std::vector<int64_t>& indexSelect, const bool& tolerateShortRead) const;
         void getColumn(float* dataOut, const int64_t& index) const;
+        void getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const;
         const CiftiXML& getCiftiXML() const { return m_xml; }
         QString getFilename() const { return m_nifti.getFilename(); }
         bool isSwapped() const { return m_nifti.getHeader().isSwapped(); }
@@ -60,6 +63,7 @@ namespace
         CiftiMemoryImpl(const CiftiXML& xml);
         void getRow(float* dataOut, const std::vector<int64_t>& indexSelect, const bool& tolerateShortRead) const;
         void getColumn(float* dataOut, const int64_t& index) const;
+        void getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const;
         bool isInMemory() const { return true; }
         void setRow(const float* dataIn, const std::vector<int64_t>& indexSelect);
         void setColumn(const float* dataIn, const int64_t& index);
@@ -77,6 +81,7 @@ namespace
         CiftiXnatImpl(const QString& url);//reuse existing user/pass, or access non-protected url - in the future, maybe only the second use (private http manager)
         void getRow(float* dataOut, const std::vector<int64_t>& indexSelect, const bool& tolerateShortRead) const;
         void getColumn(float* dataOut, const int64_t& index) const;
+        void getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const;
         const CiftiXML& getCiftiXML() const { return m_xml; }
     };
     
@@ -245,6 +250,16 @@ void CiftiFile::getColumn(float* dataOut, const int64_t& index) const
     m_readingImpl->getColumn(dataOut, index);
 }
 
+void CiftiFile::getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const
+{
+    if (m_dims.empty()) throw DataFileException("getColumns called on uninitialized CiftiFile");
+    if (m_dims.size() != 2) throw DataFileException("getColumns called on non-2D CiftiFile");
+    if (firstColumn < 0 || numColumns < 0 || firstColumn + numColumns > m_dims[0]) throw DataFileException("getColumns called with invalid column range");
+    if (m_readingImpl == NULL) return;//NOT an error because we are pretending to have a matrix already, while we are waiting for setRow to actually start writing the file
+    if (numColumns == 0) return;
+    m_readingImpl->getColumns(dataOut, firstColumn, numColumns);
+}
+
 void CiftiFile::setCiftiXML(const CiftiXML& xml, const bool useOldMetadata)
 {
     if (xml.getNumberOfDimensions() == 0) throw DataFileException("setCiftiXML called with 0-dimensional CiftiXML");
@@ -423,6 +438,24 @@ void CiftiMemoryImpl::getColumn(float* dataOut, const int64_t& index) const
     }
 }
 
+void CiftiMemoryImpl::getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const
+{
+    CaretAssert(m_array.getDimensions().size() == 2);//otherwise, CiftiFile shouldn't have called this
+    const float* ref = m_array.get(2, vector<int64_t>());
+    int64_t rowSize = m_array.getDimensions()[0];
+    int64_t colSize = m_array.getDimensions()[1];
+    CaretAssert(firstColumn >= 0 && numColumns >= 0 && firstColumn + numColumns <= rowSize);
+    for (int64_t i = 0; i < colSize; ++i)
+    {
+        const float* rowRef = ref + rowSize * i + firstColumn;
+        float* rowOut = dataOut + numColumns * i;
+        for (int64_t j = 0; j < numColumns; ++j)
+        {
+            rowOut[j] = rowRef[j];
+        }
+    }
+}
+
 void CiftiMemoryImpl::setRow(const float* dataIn, const vector<int64_t>& indexSelect)
 {
     float* ref = m_array.get(1, indexSelect);
@@ -502,6 +535,10 @@ CiftiOnDiskImpl::CiftiOnDiskImpl(const QString& filename)
             }
         }
     }
+    if (!m_nifti.mapForReading())//uncompressed files get read directly from a shared read-only mapping, with no locking or scratch copies
+    {
+        CaretLogFine("cifti file '" + filename + "' is not memory mapped, using file reads");
+    }
 }
 
 namespace
@@ -660,6 +697,43 @@ void CiftiOnDiskImpl::getColumn(float* dataOut, const int64_t& index) const
     }
 }
 
+void CiftiOnDiskImpl::getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const
+{
+    CaretAssert(m_xml.getNumberOfDimensions() == 2);//otherwise this shouldn't be called
+    int64_t rowLength = m_xml.getDimensionLength(CiftiXML::ALONG_ROW);
+    int64_t colLength = m_xml.getDimensionLength(CiftiXML::ALONG_COLUMN);
+    CaretAssert(firstColumn >= 0 && numColumns >= 0 && firstColumn + numColumns <= rowLength);
+    const int64_t BLOCK_BYTES = 1 << 22;//read whole rows in roughly 4MB requests
+    const int64_t SMALL_ROW_BYTES = 8192;//reading part of a row this short still touches about as many pages as the whole row
+    int64_t rowBytes = rowLength * (int64_t)sizeof(float);
+    if (numColumns * 2 >= rowLength || rowBytes <= SMALL_ROW_BYTES)
+    {//most of each row is wanted anyway, so coalesce into large contiguous reads of whole rows and pick out the columns
+        int64_t rowsPerBlock = max((int64_t)1, BLOCK_BYTES / rowBytes);
+        vector<float> block(min(rowsPerBlock, colLength) * rowLength);
+        for (int64_t blockStart = 0; blockStart < colLength; blockStart += rowsPerBlock)
+        {
+            int64_t blockRows = min(rowsPerBlock, colLength - blockStart);
+            m_nifti.readDataRange(block.data(), 6, vector<int64_t>(), blockStart * rowLength, blockRows * rowLength);//6 means the entire matrix, the range selects the rows
+            for (int64_t i = 0; i < blockRows; ++i)
+            {
+                const float* rowRef = block.data() + i * rowLength + firstColumn;
+                float* rowOut = dataOut + (blockStart + i) * numColumns;
+                for (int64_t j = 0; j < numColumns; ++j)
+                {
+                    rowOut[j] = rowRef[j];
+                }
+            }
+        }
+    } else {//one strided read per row of only the wanted span, rather than one read per element like getColumn
+        vector<int64_t> indexSelect(1);
+        for (int64_t i = 0; i < colLength; ++i)
+        {
+            indexSelect[0] = i;
+            m_nifti.readDataRange(dataOut + i * numColumns, 5, indexSelect, firstColumn, numColumns);
+        }
+    }
+}
+
 void CiftiOnDiskImpl::setRow(const float* dataIn, const vector<int64_t>& indexSelect)
 {
     m_nifti.writeData(dataIn, 5, indexSelect);
@@ -827,3 +901,17 @@ void CiftiXnatImpl::getColumn(float* dataOut, const int64_t& index) const
     columnRequest.m_queries.push_back(make_pair(AString("column-index"), AString::number(index)));
     getReqAsFloats(dataOut, m_xml.getDimensionLength(CiftiXML::ALONG_COLUMN), columnRequest);
 }
+
+void CiftiXnatImpl::getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const
+{
+    int64_t colLength = m_xml.getDimensionLength(CiftiXML::ALONG_COLUMN);
+    vector<float> scratch(colLength);
+    for (int64_t j = 0; j < numColumns; ++j)//server only has column requests, so just transpose them
+    {
+        getColumn(scratch.data(), firstColumn + j);
+        for (int64_t i = 0; i < colLength; ++i)
+        {
+            dataOut[i * numColumns + j] = scratch[i];
+        }
+    }
+}
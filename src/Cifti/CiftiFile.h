@@ -68,6 +68,7 @@ namespace caret
             return MultiDimIterator<int64_t>(std::vector<int64_t>(m_dims.begin() + 1, m_dims.end()));
         }
         void getColumn(float* dataOut, const int64_t& index) const;//for 2D only, will be slow if on disk!
+        void getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const;//for 2D only, output is row-major (numRows x numColumns), much faster than repeated getColumn on disk
         
         void setCiftiXML(const CiftiXML& xml, const bool useOldMetadata = true);
         void setCiftiXML(const CiftiXMLOld &xml, const bool useOldMetadata = true);//set xml from old implementation
@@ -90,6 +91,7 @@ namespace caret
         public:
             virtual void getRow(float* dataOut, const std::vector<int64_t>& indexSelect, const bool& tolerateShortRead) const = 0;
             virtual void getColumn(float* dataOut, const int64_t& index) const = 0;
+            virtual void getColumns(float* dataOut, const int64_t& firstColumn, const int64_t& numColumns) const = 0;
             virtual bool isInMemory() const { return false; }
             virtual ~ReadImplInterface();
         };
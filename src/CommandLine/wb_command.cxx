@@ -23,6 +23,7 @@
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <vector>
 
 #include "AString.h"
 #include "CaretAssert.h"
@@ -30,6 +31,7 @@
 #include "CaretCommandLine.h"
 #include "CaretLogger.h"
 #include "CommandOperationManager.h"
+#include "CommandServer.h"
 #include "ProgramParameters.h"
 #include "SessionManager.h"
 #include "SystemUtilities.h"
@@ -115,6 +117,23 @@ static int doCompletion(int argc, char* argv[])
     return 0;
 }
 
+static int runClient(int argc, char* argv[])
+{
+    //the server does all the work, so don't set up anything it doesn't need
+    QCoreApplication myApp(argc, argv);
+    if (argc < 3)
+    {
+        cerr << "\nERROR: -client requires a socket name, see -server-help\n" << endl;
+        return -1;
+    }
+    vector<AString> arguments;
+    for (int i = 3; i < argc; ++i)
+    {
+        arguments.push_back(AString::fromLocal8Bit(argv[i]));
+    }
+    return CommandServer::runClient(AString::fromLocal8Bit(argv[2]), arguments);
+}
+
 int main(int argc, char* argv[]) {
     srand(time(NULL));
     //short-circuit to avoid things like palette initialization so that command line completion can be more responsive
@@ -123,6 +142,10 @@ int main(int argc, char* argv[]) {
     {
         return doCompletion(argc, argv);
     }
+    if (argc > 1 && AString::fromLocal8Bit(argv[1]) == "-client")
+    {
+        return runClient(argc, argv);
+    }
     int result = 0;
     {
         /*
@@ -0,0 +1,345 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CommandBatch.h"
+
+#include "CaretAssert.h"
+#include "CaretCommandLine.h"
+#include "CaretLogger.h"
+#include "CaretOMP.h"
+#include "CommandException.h"
+#include "CommandNamedFiles.h"
+#include "CommandParser.h"
+#include "ProgramParameters.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <new>
+
+using namespace caret;
+using namespace std;
+
+CommandBatch::CommandBatch(const bool& preventProvenance, const int16_t& ciftiDType, const bool& ciftiScale, const double& ciftiMin, const double& ciftiMax)
+{
+    m_preventProvenance = preventProvenance;
+    m_ciftiDType = ciftiDType;
+    m_ciftiScale = ciftiScale;
+    m_ciftiMin = ciftiMin;
+    m_ciftiMax = ciftiMax;
+}
+
+void CommandBatch::splitScript(const AString& text, vector<vector<AString> >& commandsOut, vector<int64_t>& lineNumbersOut)
+{
+    commandsOut.clear();
+    lineNumbersOut.clear();
+    vector<AString> command;
+    AString token;
+    bool haveToken = false, inSingle = false, inDouble = false;
+    int64_t lineNumber = 1, commandLine = 1, quoteLine = 1;
+    int length = text.size();
+    for (int i = 0; i <= length; ++i)
+    {
+        QChar c = (i < length ? text[i] : QChar('\n'));//treat the end as a newline, to finish the last command
+        if (inSingle)
+        {
+            if (c == '\'')
+            {
+                inSingle = false;
+            } else {
+                if (c == '\n') ++lineNumber;
+                token += c;
+            }
+            continue;
+        }
+        if (inDouble)
+        {
+            if (c == '"')
+            {
+                inDouble = false;
+            } else if (c == '\\' && i + 1 < length && (text[i + 1] == '"' || text[i + 1] == '\\')) {
+                ++i;
+                token += text[i];
+            } else {
+                if (c == '\n') ++lineNumber;
+                token += c;
+            }
+            continue;
+        }
+        if (c == '\'' || c == '"')
+        {
+            if (c == '\'') inSingle = true; else inDouble = true;
+            quoteLine = lineNumber;
+            if (command.empty() && !haveToken) commandLine = lineNumber;
+            haveToken = true;//even '' is an argument
+            continue;
+        }
+        if (c == '\\' && i + 1 < length)
+        {
+            ++i;
+            if (text[i] == '\n')
+            {//line continuation
+                ++lineNumber;
+                continue;
+            }
+            if (command.empty() && !haveToken) commandLine = lineNumber;
+            haveToken = true;
+            token += text[i];
+            continue;
+        }
+        if (c == '#' && !haveToken)
+        {//comment, skip to the end of the line, but leave the newline to be handled normally
+            while (i + 1 < length && text[i + 1] != '\n') ++i;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            if (haveToken)
+            {
+                command.push_back(token);
+                token = "";
+                haveToken = false;
+            }
+            if (c == '\n')
+            {
+                if (!command.empty())
+                {
+                    commandsOut.push_back(command);
+                    lineNumbersOut.push_back(commandLine);
+                    command.clear();
+                }
+                ++lineNumber;
+            }
+            continue;
+        }
+        if (command.empty() && !haveToken) commandLine = lineNumber;
+        haveToken = true;
+        token += c;
+    }
+    if (inSingle || inDouble)
+    {
+        throw CommandException("unterminated quote starting on line " + AString::number(quoteLine));
+    }
+}
+
+AString CommandBatch::fileKey(const AString& argument)
+{
+    if (CommandNamedFiles::isName(argument)) return argument;
+    return QDir::cleanPath(QFileInfo(argument).absoluteFilePath());//so that different spellings of the same file are one dependency
+}
+
+void CommandBatch::readScript(const AString& scriptFileName, const vector<CommandOperation*>& operations)
+{
+    QFile scriptFile(scriptFileName);
+    if (!scriptFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        throw CommandException("failed to open batch script '" + scriptFileName + "' for reading");
+    }
+    AString text = QString::fromUtf8(scriptFile.readAll());
+    vector<vector<AString> > commands;
+    vector<int64_t> lineNumbers;
+    splitScript(text, commands, lineNumbers);
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        addStep(operations, commands[i], lineNumbers[i]);
+    }
+}
+
+void CommandBatch::addStep(const vector<CommandOperation*>& operations, const vector<AString>& command, const int64_t& lineNumber)
+{
+    CaretAssert(!command.empty());
+    const AString linePrefix = "batch script line " + AString::number(lineNumber) + ": ";
+    size_t switchIndex = 0;
+    if (command[0] == "wb_command")
+    {//allow lines pasted from shell scripts
+        switchIndex = 1;
+        if (command.size() == 1) throw CommandException(linePrefix + "no command given");
+    }
+    const AString commandSwitch = command[switchIndex].fixUnicodeHyphens(NULL, NULL, true);
+    CommandParser* prototype = NULL;
+    for (size_t i = 0; i < operations.size(); ++i)
+    {
+        if (operations[i]->getCommandLineSwitch() == commandSwitch)
+        {
+            prototype = dynamic_cast<CommandParser*>(operations[i]);
+            if (prototype == NULL) throw CommandException(linePrefix + "command '" + commandSwitch + "' can't be used in a batch script");
+            break;
+        }
+    }
+    if (prototype == NULL) throw CommandException(linePrefix + "command '" + commandSwitch + "' not found");
+    Step myStep;
+    myStep.m_lineNumber = lineNumber;
+    myStep.m_arguments.assign(command.begin() + switchIndex + 1, command.end());
+    myStep.m_parser.grabNew(prototype->cloneParser());//each step gets its own parser, because parsers keep state while running
+    if (m_preventProvenance) myStep.m_parser->disableProvenance();
+    if (m_ciftiScale)
+    {
+        myStep.m_parser->setCiftiOutputDTypeAndScale(m_ciftiDType, m_ciftiMin, m_ciftiMax);
+    } else {
+        myStep.m_parser->setCiftiOutputDTypeNoScale(m_ciftiDType);
+    }
+    vector<AString> inputs, outputs, strings;
+    ProgramParameters myParams;
+    for (size_t i = 0; i < myStep.m_arguments.size(); ++i)
+    {
+        myParams.addParameter(myStep.m_arguments[i]);
+    }
+    try
+    {
+        myStep.m_parser->scanFileArguments(myParams, inputs, outputs, strings);
+    } catch (CaretException& e) {
+        throw CommandException(linePrefix + e.whatString());
+    }
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        if (CommandNamedFiles::isName(inputs[i]))
+        {
+            bool found = false;
+            for (size_t j = 0; j < m_steps.size() && !found; ++j)
+            {
+                found = (m_steps[j].m_writes.count(inputs[i]) > 0);
+            }
+            if (!found) throw CommandException(linePrefix + "in-memory file '" + inputs[i] + "' is used before any earlier command creates it");
+            myStep.m_namedReads.insert(inputs[i]);
+        }
+        myStep.m_reads.insert(fileKey(inputs[i]));
+    }
+    for (size_t i = 0; i < outputs.size(); ++i)
+    {
+        myStep.m_writes.insert(fileKey(outputs[i]));
+    }
+    for (size_t i = 0; i < strings.size(); ++i)
+    {//some operations take file names as strings and may read or write them (spec files, in-place modification), so treat anything that looks like a path as both
+        bool isNumber = false;
+        strings[i].toDouble(&isNumber);
+        if (!isNumber && (strings[i].contains('.') || strings[i].contains('/')))
+        {
+            myStep.m_writes.insert(fileKey(strings[i]));
+        }
+    }
+    myStep.m_level = 0;
+    for (size_t j = 0; j < m_steps.size(); ++j)
+    {
+        if (conflicts(m_steps[j], myStep)) myStep.m_level = max(myStep.m_level, m_steps[j].m_level + 1);
+    }
+    m_steps.push_back(myStep);
+}
+
+bool CommandBatch::conflicts(const Step& earlier, const Step& later)
+{
+    for (set<AString>::const_iterator iter = earlier.m_writes.begin(); iter != earlier.m_writes.end(); ++iter)
+    {
+        if (later.m_reads.count(*iter) > 0 || later.m_writes.count(*iter) > 0) return true;
+    }
+    for (set<AString>::const_iterator iter = earlier.m_reads.begin(); iter != earlier.m_reads.end(); ++iter)
+    {
+        if (later.m_writes.count(*iter) > 0) return true;
+    }
+    for (set<AString>::const_iterator iter = earlier.m_namedReads.begin(); iter != earlier.m_namedReads.end(); ++iter)
+    {//in-memory files may cache things when read, so don't share them between concurrent steps
+        if (later.m_namedReads.count(*iter) > 0) return true;
+    }
+    return false;
+}
+
+void CommandBatch::run()
+{
+    int64_t numSteps = (int64_t)m_steps.size(), numLevels = 0;
+    map<AString, int64_t> lastLevelUsed;//release in-memory files after the last step that uses them
+    for (int64_t i = 0; i < numSteps; ++i)
+    {
+        numLevels = max(numLevels, m_steps[i].m_level + 1);
+        for (set<AString>::const_iterator iter = m_steps[i].m_writes.begin(); iter != m_steps[i].m_writes.end(); ++iter)
+        {
+            if (CommandNamedFiles::isName(*iter)) lastLevelUsed[*iter] = max(lastLevelUsed[*iter], m_steps[i].m_level);
+        }
+        for (set<AString>::const_iterator iter = m_steps[i].m_namedReads.begin(); iter != m_steps[i].m_namedReads.end(); ++iter)
+        {
+            lastLevelUsed[*iter] = max(lastLevelUsed[*iter], m_steps[i].m_level);
+        }
+    }
+    CommandNamedFiles namedFiles;
+    for (int64_t level = 0; level < numLevels; ++level)
+    {
+        vector<int64_t> levelSteps;
+        for (int64_t i = 0; i < numSteps; ++i)
+        {
+            if (m_steps[i].m_level == level) levelSteps.push_back(i);
+        }
+        int64_t numLevelSteps = (int64_t)levelSteps.size();
+        int numThreads = 1;
+#ifdef CARET_OMP
+        numThreads = omp_get_max_threads();
+#endif
+        //nested parallelism is off, so a step run on a worker thread does its own loops single threaded
+        //only run steps concurrently when there are enough of them to fill the threads, otherwise run them in order at full width
+        //steps create and delete files on the worker threads, which relies on the CaretObject tracker and EventManager listener registration being locked
+        bool concurrent = (numLevelSteps > 1 && numLevelSteps >= numThreads);
+        bool failed = false;
+        AString failMessage;
+#pragma omp CARET_PARFOR schedule(dynamic, 1) if (concurrent)
+        for (int64_t k = 0; k < numLevelSteps; ++k)
+        {
+            bool skip;
+#pragma omp critical (CommandBatchFailed)
+            skip = failed;
+            if (skip) continue;
+            Step& myStep = m_steps[levelSteps[k]];
+            AString stepError;
+            try
+            {
+                ProgramParameters myParams;
+                vector<AString> fullCommand(1, "wb_command");
+                fullCommand.push_back(myStep.m_parser->getCommandLineSwitch());
+                for (size_t i = 0; i < myStep.m_arguments.size(); ++i)
+                {
+                    myParams.addParameter(myStep.m_arguments[i]);
+                    fullCommand.push_back(myStep.m_arguments[i]);
+                }
+                CaretLogFine("batch script line " + AString::number(myStep.m_lineNumber) + ": running " + myStep.m_parser->getCommandLineSwitch());
+                myStep.m_parser->executeBatchStep(myParams, &namedFiles, caret_format_command_line(fullCommand));
+                continue;
+            } catch (CaretException& e) {
+                stepError = e.whatString();
+            } catch (bad_alloc&) {
+                stepError = "ran out of memory";
+            } catch (exception& e) {
+                stepError = e.what();
+            }
+#pragma omp critical (CommandBatchFailed)
+            {
+                if (!failed)
+                {//keep the first error
+                    failed = true;
+                    failMessage = "batch script line " + AString::number(myStep.m_lineNumber) + ": " + stepError;
+                }
+            }
+        }
+        if (failed) throw CommandException(failMessage);
+        for (map<AString, int64_t>::const_iterator iter = lastLevelUsed.begin(); iter != lastLevelUsed.end(); ++iter)
+        {
+            if (iter->second == level) namedFiles.removeFile(iter->first);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef __COMMAND_BATCH_H__
+#define __COMMAND_BATCH_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AString.h"
+#include "CaretPointer.h"
+
+#include <set>
+#include <vector>
+
+namespace caret {
+
+    class CommandOperation;
+    class CommandParser;
+    
+    ///runs a script of wb_command command lines in one process, keeping @name intermediate files in memory, and running steps that don't share files concurrently
+    class CommandBatch
+    {
+        struct Step
+        {
+            int64_t m_lineNumber;
+            std::vector<AString> m_arguments;//not including the command switch
+            CaretPointer<CommandParser> m_parser;
+            std::set<AString> m_reads, m_writes, m_namedReads;
+            int64_t m_level;//steps run in order of level, steps with the same level run concurrently
+        };
+        std::vector<Step> m_steps;
+        bool m_preventProvenance, m_ciftiScale;
+        int16_t m_ciftiDType;
+        double m_ciftiMin, m_ciftiMax;
+        void addStep(const std::vector<CommandOperation*>& operations, const std::vector<AString>& command, const int64_t& lineNumber);
+        static bool conflicts(const Step& earlier, const Step& later);
+        static AString fileKey(const AString& argument);
+    public:
+        CommandBatch(const bool& preventProvenance, const int16_t& ciftiDType, const bool& ciftiScale, const double& ciftiMin, const double& ciftiMax);
+        
+        ///read the script and check every command line, without opening any data files
+        void readScript(const AString& scriptFileName, const std::vector<CommandOperation*>& operations);
+        
+        void run();
+        
+        ///split script text into command lines and arguments, following shell quoting: '', "", \ escapes, \ at the end of a line continues it, # starts a comment
+        static void splitScript(const AString& text, std::vector<std::vector<AString> >& commandsOut, std::vector<int64_t>& lineNumbersOut);
+    };
+
+}
+
+#endif //__COMMAND_BATCH_H__
@@ -0,0 +1,108 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CommandInputCache.h"
+
+#include "CaretLogger.h"
+#include "FileInformation.h"
+#include "SurfaceFile.h"
+
+using namespace caret;
+using namespace std;
+
+CommandInputCache::CommandInputCache(const int64_t& limitBytes)
+{
+    m_limitBytes = limitBytes;
+    m_usedBytes = 0;
+    m_useCounter = 0;
+}
+
+CaretPointer<SurfaceFile> CommandInputCache::getSurface(const AString& fileName)
+{
+    FileInformation myInfo(fileName);
+    if (!myInfo.exists())
+    {//let readFile generate the error
+        CaretPointer<SurfaceFile> ret(new SurfaceFile());
+        ret->readFile(fileName);
+        return ret;
+    }
+    AString key = myInfo.getCanonicalFilePath();
+    int64_t modified = myInfo.getLastModifiedMilliseconds(), fileSize = myInfo.size();
+    {
+        CaretMutexLocker locked(&m_mutex);
+        map<AString, Entry>::iterator iter = m_surfaces.find(key);
+        if (iter != m_surfaces.end())
+        {
+            if (iter->second.m_modified == modified && iter->second.m_fileSize == fileSize)
+            {
+                ++m_useCounter;
+                iter->second.m_lastUsed = m_useCounter;
+                return iter->second.m_file;
+            }
+            m_usedBytes -= iter->second.m_memoryBytes;//file changed, commands already using the old one keep their reference
+            m_surfaces.erase(iter);
+        }
+    }
+    CaretPointer<SurfaceFile> ret(new SurfaceFile());//read without the lock, so other commands aren't stuck behind a slow read
+    ret->readFile(fileName);
+    ret->computeNormals();//some commands ask for normals, which would otherwise be computed lazily while other commands use the file
+    ret->getBoundingBox();//likewise, the bounding box is built on first use without a lock
+    CaretMutexLocker locked(&m_mutex);
+    map<AString, Entry>::iterator iter = m_surfaces.find(key);
+    if (iter != m_surfaces.end() && iter->second.m_modified == modified && iter->second.m_fileSize == fileSize)
+    {//another command read it at the same time, share that one instead
+        ++m_useCounter;
+        iter->second.m_lastUsed = m_useCounter;
+        return iter->second.m_file;
+    }
+    if (iter != m_surfaces.end())
+    {
+        m_usedBytes -= iter->second.m_memoryBytes;
+        m_surfaces.erase(iter);
+    }
+    Entry myEntry;
+    myEntry.m_file = ret;
+    myEntry.m_modified = modified;
+    myEntry.m_fileSize = fileSize;
+    myEntry.m_memoryBytes = int64_t(ret->getNumberOfNodes()) * 6 * sizeof(float) + int64_t(ret->getNumberOfTriangles()) * 3 * sizeof(int32_t);//coordinates, normals, triangles
+    ++m_useCounter;
+    myEntry.m_lastUsed = m_useCounter;
+    m_surfaces[key] = myEntry;
+    m_usedBytes += myEntry.m_memoryBytes;
+    evict(key);
+    return ret;
+}
+
+void CommandInputCache::evict(const AString& keep)
+{//m_mutex must already be locked
+    while (m_usedBytes > m_limitBytes && m_surfaces.size() > 1)
+    {
+        map<AString, Entry>::iterator oldest = m_surfaces.end();
+        for (map<AString, Entry>::iterator iter = m_surfaces.begin(); iter != m_surfaces.end(); ++iter)
+        {
+            if (iter->first == keep) continue;
+            if (oldest == m_surfaces.end() || iter->second.m_lastUsed < oldest->second.m_lastUsed) oldest = iter;
+        }
+        CaretAssert(oldest != m_surfaces.end());
+        CaretLogFine("input cache releasing " + oldest->first);
+        m_usedBytes -= oldest->second.m_memoryBytes;
+        m_surfaces.erase(oldest);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef __COMMAND_INPUT_CACHE_H__
+#define __COMMAND_INPUT_CACHE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AString.h"
+#include "CaretMutex.h"
+#include "CaretPointer.h"
+
+#include <map>
+#include <stdint.h>
+
+namespace caret {
+
+    class SurfaceFile;
+
+    ///read-only input files kept in memory between the commands run by a server, so that surfaces and their topology and geodesic helpers stay warm
+    ///entries are keyed by canonical path, and are reread when the file's modification time or size changes
+    class CommandInputCache
+    {
+        struct Entry
+        {
+            CaretPointer<SurfaceFile> m_file;
+            int64_t m_modified, m_fileSize, m_memoryBytes;
+            uint64_t m_lastUsed;
+        };
+        std::map<AString, Entry> m_surfaces;
+        CaretMutex m_mutex;
+        int64_t m_limitBytes, m_usedBytes;
+        uint64_t m_useCounter;
+        void evict(const AString& keep);
+    public:
+        ///limitBytes is approximate, it counts the coordinates, normals and triangles, but not helpers
+        CommandInputCache(const int64_t& limitBytes);
+
+        ///get the surface from the cache, reading it if it isn't cached or the file changed
+        ///the returned file is shared with other commands, so it must not be modified
+        CaretPointer<SurfaceFile> getSurface(const AString& fileName);
+    };
+
+}
+
+#endif //__COMMAND_INPUT_CACHE_H__
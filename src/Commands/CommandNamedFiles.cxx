@@ -0,0 +1,125 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CommandNamedFiles.h"
+
+#include "BorderFile.h"
+#include "CaretAssert.h"
+#include "CiftiFile.h"
+#include "CommandException.h"
+#include "FociFile.h"
+#include "LabelFile.h"
+#include "MetricFile.h"
+#include "SurfaceFile.h"
+#include "VolumeFile.h"
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    template<typename T>
+    void copyFilePointer(AbstractParameter* from, AbstractParameter* to)
+    {
+        ((T*)to)->m_parameter = ((T*)from)->m_parameter;
+    }
+    
+    void copyFile(AbstractParameter* from, AbstractParameter* to)
+    {
+        CaretAssert(from->getType() == to->getType());
+        switch (from->getType())
+        {
+            case OperationParametersEnum::BORDER:
+                copyFilePointer<BorderParameter>(from, to);
+                break;
+            case OperationParametersEnum::CIFTI:
+                copyFilePointer<CiftiParameter>(from, to);
+                break;
+            case OperationParametersEnum::FOCI:
+                copyFilePointer<FociParameter>(from, to);
+                break;
+            case OperationParametersEnum::LABEL:
+                copyFilePointer<LabelParameter>(from, to);
+                break;
+            case OperationParametersEnum::METRIC:
+                copyFilePointer<MetricParameter>(from, to);
+                break;
+            case OperationParametersEnum::SURFACE:
+                copyFilePointer<SurfaceParameter>(from, to);
+                break;
+            case OperationParametersEnum::VOLUME:
+                copyFilePointer<VolumeParameter>(from, to);
+                break;
+            default:
+                CaretAssert(false);
+                throw CommandException("internal error, only files can be kept in memory by name");
+        }
+    }
+}
+
+bool CommandNamedFiles::isName(const AString& argument)
+{
+    return argument.size() > 1 && argument[0] == '@';
+}
+
+bool CommandNamedFiles::isFileType(const OperationParametersEnum::Enum& type)
+{
+    switch (type)
+    {
+        case OperationParametersEnum::BORDER:
+        case OperationParametersEnum::CIFTI:
+        case OperationParametersEnum::FOCI:
+        case OperationParametersEnum::LABEL:
+        case OperationParametersEnum::METRIC:
+        case OperationParametersEnum::SURFACE:
+        case OperationParametersEnum::VOLUME:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void CommandNamedFiles::getFile(const AString& name, AbstractParameter* paramOut)
+{
+    CaretMutexLocker locked(&m_mutex);
+    map<AString, CaretPointer<AbstractParameter> >::iterator iter = m_files.find(name);
+    if (iter == m_files.end()) throw CommandException("in-memory file '" + name + "' has not been created by an earlier command");
+    if (iter->second->getType() != paramOut->getType())
+    {
+        throw CommandException("in-memory file '" + name + "' is a " + OperationParametersEnum::toName(iter->second->getType()) +
+                               " file, but <" + paramOut->m_shortName + "> must be a " + OperationParametersEnum::toName(paramOut->getType()) + " file");
+    }
+    copyFile(iter->second, paramOut);
+}
+
+void CommandNamedFiles::setFile(const AString& name, AbstractParameter* param)
+{
+    CaretAssert(isFileType(param->getType()));
+    CaretPointer<AbstractParameter> keep(param->cloneAbstractParameter());
+    copyFile(param, keep);
+    CaretMutexLocker locked(&m_mutex);
+    m_files[name] = keep;
+}
+
+void CommandNamedFiles::removeFile(const AString& name)
+{
+    CaretMutexLocker locked(&m_mutex);
+    m_files.erase(name);
+}
@@ -0,0 +1,57 @@
+#ifndef __COMMAND_NAMED_FILES_H__
+#define __COMMAND_NAMED_FILES_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AString.h"
+#include "CaretMutex.h"
+#include "CaretPointer.h"
+#include "OperationParameters.h"
+
+#include <map>
+
+namespace caret {
+
+    ///in-memory files shared between the steps of a batch script, given on the command line as @name instead of a file name
+    class CommandNamedFiles
+    {
+        std::map<AString, CaretPointer<AbstractParameter> > m_files;//clones of output parameters, each holding a reference to its file
+        CaretMutex m_mutex;//steps that run concurrently use different names, but the map itself is shared
+    public:
+        ///whether the argument names an in-memory file
+        static bool isName(const AString& argument);
+        
+        ///whether the parameter type is a file that can be kept in memory
+        static bool isFileType(const OperationParametersEnum::Enum& type);
+        
+        ///point the input parameter at the named file, throws if the name doesn't exist or is a different type of file
+        void getFile(const AString& name, AbstractParameter* paramOut);
+        
+        ///keep a reference to the file in the output parameter under the name, replacing any file already using the name
+        void setFile(const AString& name, AbstractParameter* param);
+        
+        ///release the named file, so its memory is freed once no step uses it
+        void removeFile(const AString& name);
+    };
+
+}
+
+#endif //__COMMAND_NAMED_FILES_H__
@@ -58,6 +58,7 @@
 #include "AlgorithmCiftiROIsFromExtrema.h"
 #include "AlgorithmCiftiSeparate.h"
 #include "AlgorithmCiftiSmoothing.h"
+#include "AlgorithmCiftiTFCE.h"
 #include "AlgorithmCiftiTranspose.h"
 #include "AlgorithmCiftiVectorOperation.h"
 #include "AlgorithmCreateSignedDistanceVolume.h"
@@ -207,6 +208,7 @@
 #include "OperationSurfaceGeodesicROIs.h"
 #include "OperationSurfaceInformation.h"
 #include "OperationSurfaceNormals.h"
+#include "OperationSurfaceRayIntersect.h"
 #include "OperationSurfaceVertexAreas.h"
 #include "OperationVolumeCapturePlane.h"
 #include "OperationVolumeCopyExtensions.h"
@@ -216,6 +218,7 @@
 #include "OperationVolumeMath.h"
 #include "OperationVolumeMerge.h"
 #include "OperationVolumePalette.h"
+#include "OperationVolumeRayIntersect.h"
 #include "OperationVolumeReorient.h"
 #include "OperationVolumeSetSpace.h"
 #include "OperationVolumeStats.h"
@@ -226,7 +229,9 @@
 
 #include "AlgorithmException.h"
 #include "ApplicationInformation.h"
+#include "CommandBatch.h"
 #include "CommandParser.h"
+#include "CommandServer.h"
 #include "OperationException.h"
 
 #include "CommandClassAddMember.h"
@@ -238,9 +243,13 @@
 #include "CommandUnitTest.h"
 #include "ProgramParameters.h"
 
+#include "CaretBinaryFile.h"
 #include "CaretLogger.h"
 #include "dot_wrapper.h"
 #include "StructureEnum.h"
+#include "SurfaceWeightCache.h"
+
+#include <QThread>
 
 #include <iostream>
 #include <map>
@@ -316,6 +325,7 @@ CommandOperationManager::CommandOperationManager()
     this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCiftiROIsFromExtrema()));
     this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCiftiSeparate()));
     this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCiftiSmoothing()));
+    this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCiftiTFCE()));
     this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCiftiTranspose()));
     this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCiftiVectorOperation()));
     this->commandOperations.push_back(new CommandParser(new AutoAlgorithmCreateSignedDistanceVolume()));
@@ -460,6 +470,7 @@ CommandOperationManager::CommandOperationManager()
     this->commandOperations.push_back(new CommandParser(new AutoOperationSurfaceGeodesicROIs()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationSurfaceInformation()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationSurfaceNormals()));
+    this->commandOperations.push_back(new CommandParser(new AutoOperationSurfaceRayIntersect()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationSurfaceVertexAreas()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeCapturePlane()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeCopyExtensions()));
@@ -469,6 +480,7 @@ CommandOperationManager::CommandOperationManager()
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeMath()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeMerge()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumePalette()));
+    this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeRayIntersect()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeReorient()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeSetSpace()));
     this->commandOperations.push_back(new CommandParser(new AutoOperationVolumeStats()));
@@ -550,9 +562,46 @@ namespace
  */
 void 
 CommandOperationManager::runCommand(ProgramParameters& parameters)
+{
+    runCommandInternal(parameters, "", false);
+}
+
+/**
+ * Run a command that was sent to a server, concurrently with other requests.
+ * 
+ * @param parameters
+ *    Reference to the command's parameters.
+ * @param requestCommandLine
+ *    The request's command line, for provenance.
+ * @throws CommandException
+ *    If the command failed.
+ */
+void
+CommandOperationManager::runServerRequest(ProgramParameters& parameters,
+                                          const AString& requestCommandLine)
+{
+    runCommandInternal(parameters, requestCommandLine, true);
+}
+
+void
+CommandOperationManager::runCommandInternal(ProgramParameters& parameters,
+                                            const AString& requestCommandLine,
+                                            const bool serverRequest)
 {
     vector<AString> globalOptionArgs;
     bool preventProvenance = getGlobalOption(parameters, "-disable-provenance", 0, globalOptionArgs);//check these BEFORE we test if we have a command switch, because they remove the switch and arguments from the ProgramParameters
+    if (serverRequest)
+    {//these change settings of the whole process, which would affect other requests running on the server
+        const char* processOptions[] = { "-logging", "-simd", "-block-compress-output", "-weight-cache" };
+        const int processOptionArgs[] = { 1, 1, 0, 1 };
+        for (int i = 0; i < 4; ++i)
+        {
+            if (getGlobalOption(parameters, processOptions[i], processOptionArgs[i], globalOptionArgs))
+            {
+                throw CommandException("global option '" + AString(processOptions[i]) + "' affects the whole server, give it when starting the server instead");
+            }
+        }
+    }
     if (getGlobalOption(parameters, "-logging", 1, globalOptionArgs))
     {
         bool valid = false;
@@ -571,6 +620,14 @@ CommandOperationManager::runCommand(ProgramParameters& parameters)
             CaretLogWarning("SIMD type '" + DotSIMDEnum::toName(impl) + "' not supported (could be cpu, compiler, or build options), using '" + DotSIMDEnum::toName(retval) + "'");
         }
     }
+    if (getGlobalOption(parameters, "-block-compress-output", 0, globalOptionArgs))
+    {
+        CaretBinaryFile::setWriteBlockCompressed(true);
+    }
+    if (getGlobalOption(parameters, "-weight-cache", 1, globalOptionArgs))
+    {
+        SurfaceWeightCache::setCacheDirectory(globalOptionArgs[0]);
+    }
     int16_t ciftiDType = NIFTI_TYPE_FLOAT32;
     bool ciftiScale = false;
     double ciftiMin = -1.0, ciftiMax = -1.0;
@@ -622,6 +679,40 @@ CommandOperationManager::runCommand(ProgramParameters& parameters)
         printDeprecatedCommands();
     } else if (commandSwitch == "-all-commands-help") {
         printAllCommandsHelpInfo(myProgramName);
+    } else if (commandSwitch == "-batch-help") {
+        printBatchHelp(myProgramName);
+    } else if (commandSwitch == "-server-help") {
+        printServerHelp(myProgramName);
+    } else if (commandSwitch == "-server") {
+        if (serverRequest) throw CommandException("-server can't be used in a request to a server");
+        AString socketName = parameters.nextString("socket name");
+        int64_t maxRequests = QThread::idealThreadCount();
+        int64_t cacheMB = 2048;
+        while (parameters.hasNext())
+        {
+            AString serverOption = parameters.nextString("server option");
+            if (serverOption == "-requests")
+            {
+                maxRequests = parameters.nextLong("maximum requests");
+                if (maxRequests < 1) throw CommandException("-requests must be at least 1");
+            } else if (serverOption == "-cache-mb") {
+                cacheMB = parameters.nextLong("cache size");
+                if (cacheMB < 0) throw CommandException("-cache-mb must not be negative");
+            } else {
+                throw CommandException("unrecognized -server option: '" + serverOption + "'");
+            }
+        }
+        if (maxRequests < 1) maxRequests = 1;//idealThreadCount returns -1 if it can't tell
+        CommandServer myServer(socketName, maxRequests, cacheMB * 1024 * 1024);
+        myServer.run();
+    } else if (commandSwitch == "-batch") {
+        AString scriptName = parameters.nextString("batch script");
+        parameters.verifyAllParametersProcessed();
+        vector<CommandOperation*> allOperations = this->commandOperations;
+        allOperations.insert(allOperations.end(), this->deprecatedOperations.begin(), this->deprecatedOperations.end());
+        CommandBatch myBatch(preventProvenance, ciftiDType, ciftiScale, ciftiMin, ciftiMax);
+        myBatch.readScript(scriptName, allOperations);//check the whole script before running anything
+        myBatch.run();
     } else {
         
         CommandOperation* operation = NULL;
@@ -658,6 +749,21 @@ CommandOperationManager::runCommand(ProgramParameters& parameters)
             {
                 cout << operation->getHelpInformation(myProgramName) << endl;
             } else {
+                CommandParser* parser = dynamic_cast<CommandParser*>(operation);
+                if (serverRequest && parser != NULL)
+                {//the shared parsers hold per-command settings, so a concurrent request needs its own
+                    CaretPointer<CommandParser> requestParser(parser->cloneParser());
+                    if (ciftiScale)
+                    {
+                        requestParser->setCiftiOutputDTypeAndScale(ciftiDType, ciftiMin, ciftiMax);
+                    } else {
+                        requestParser->setCiftiOutputDTypeNoScale(ciftiDType);
+                    }
+                    if (preventProvenance) requestParser->disableProvenance();
+                    requestParser->executeBatchStep(parameters, NULL, requestCommandLine);
+                    return;
+                }
+                CaretMutexLocker locked(&m_serverOperationMutex);//developer commands aren't written to run concurrently, only server requests can contend for this
                 if (ciftiScale)
                 {
                     operation->setCiftiOutputDTypeAndScale(ciftiDType, ciftiMin, ciftiMax);
@@ -700,6 +806,12 @@ AString CommandOperationManager::doCompletion(ProgramParameters& parameters, con
         }
         return ret;
     }
+    parseGlobalOption(parameters, "-block-compress-output", 0, globalOptionArgs, true);//doesn't take arguments
+    OptionInfo weightCacheInfo = parseGlobalOption(parameters, "-weight-cache", 1, globalOptionArgs, true);
+    if (weightCacheInfo.specified && !weightCacheInfo.complete)
+    {//a directory, let bash do its default completion
+        return "";
+    }
     OptionInfo ciftiDTypeInfo = parseGlobalOption(parameters, "-cifti-output-datatype", 1, globalOptionArgs, true);
     if (ciftiDTypeInfo.specified && !ciftiDTypeInfo.complete)
     {
@@ -710,7 +822,7 @@ AString CommandOperationManager::doCompletion(ProgramParameters& parameters, con
     {//can't tab complete a literal number
         return "";
     }
-    ret = "wordlist -disable-provenance\\ -logging\\ -simd\\ -cifti-output-datatype\\ -cifti-output-range";//we could prevent suggesting an already-provided global option, but that would be a bit surprising
+    ret = "wordlist -disable-provenance\\ -logging\\ -simd\\ -block-compress-output\\ -weight-cache\\ -cifti-output-datatype\\ -cifti-output-range";//we could prevent suggesting an already-provided global option, but that would be a bit surprising
     const uint64_t numberOfCommands = this->commandOperations.size();
     const uint64_t numberOfDeprecated = this->deprecatedOperations.size();
     if (!parameters.hasNext())
@@ -971,6 +1083,8 @@ void CommandOperationManager::printHelpInfo()
     cout << "   -list-deprecated-commands   list deprecated subcommands" << endl;
     cout << "   -all-commands-help          show all processing subcommands and their help" << endl;
     cout << "                                  info - VERY LONG" << endl;
+    cout << "   -batch-help                 explain how to run many commands in one process" << endl;
+    cout << "   -server-help                explain how to keep a server running for commands" << endl;
     cout << endl;
     cout << "To get the help information of a processing subcommand, run it without any" << endl;
     cout << "   additional arguments." << endl;
@@ -1049,6 +1163,19 @@ void CommandOperationManager::printGlobalOptions()
     cout << "   -disable-provenance               don't generate provenance info in output" << endl;
     cout << "                                        files" << endl;
     cout << endl;
+    cout << "   -block-compress-output            write .gz output files as independently" << endl;
+    cout << "                                        compressed 64KiB blocks (BGZF), with a" << endl;
+    cout << "                                        .gzi index file, so that reading parts" << endl;
+    cout << "                                        of them is fast, still readable by" << endl;
+    cout << "                                        other gzip-capable software" << endl;
+    cout << endl;
+    cout << "   -weight-cache <directory>         save surface smoothing and resampling" << endl;
+    cout << "                                        weights in this directory, and reuse" << endl;
+    cout << "                                        them when the same surfaces and" << endl;
+    cout << "                                        settings are used again (default: the" << endl;
+    cout << "                                        WB_WEIGHT_CACHE_DIR environment" << endl;
+    cout << "                                        variable, if set)" << endl;
+    cout << endl;
     cout << "   -cifti-output-datatype <type>     write cifti output with the given" << endl;
     cout << "                                        datatype (default FLOAT32), note that" << endl;
     cout << "                                        calculation precision is only float32," << endl;
@@ -1183,6 +1310,70 @@ void CommandOperationManager::printGiftiHelp()
     cout << endl;//guide for wrap, assuming 80 columns:                                     |
 }
 
+void CommandOperationManager::printBatchHelp(const AString& programName)
+{
+    //guide for wrap, assuming 80 columns:                                                  |
+    cout << "   To run many processing commands without starting a new process for each one," << endl;
+    cout << "   put the command lines in a text file, one per line, and run:" << endl;
+    cout << endl;
+    cout << "$ " << programName << " -batch <script-file>" << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   Each line is a processing command with its arguments, as it would be given" << endl;
+    cout << "   to " << programName << " (the leading '" << programName << "' is optional).  Arguments are" << endl;
+    cout << "   quoted as in a shell: '', \"\", and \\ work as in bash, a \\ at the end of a" << endl;
+    cout << "   line continues the command on the next line, and # starts a comment." << endl;
+    cout << "   Variables, globbing, and redirection are not supported." << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   Any file argument can be given as @name instead of a file name.  An output" << endl;
+    cout << "   given as @name is kept in memory instead of being written, and later" << endl;
+    cout << "   commands can use it as an input by the same name.  Only outputs given as" << endl;
+    cout << "   file names are written to disk.  For example:" << endl;
+    cout << endl;
+    cout << "-cifti-separate in.dscalar.nii COLUMN -metric CORTEX_LEFT @left" << endl;
+    cout << "-metric-smoothing left.surf.gii @left 2 @left_smooth" << endl;
+    cout << "-metric-math 'x * 2' out.func.gii -var x @left_smooth" << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   The whole script is checked before any command runs.  Commands that do not" << endl;
+    cout << "   share any files run at the same time, while commands that write a file or" << endl;
+    cout << "   @name used by another command run in script order.  String arguments that" << endl;
+    cout << "   look like file names (containing '.' or '/') are treated as files, because" << endl;
+    cout << "   some commands read or modify them.  Global options given before -batch," << endl;
+    cout << "   such as -disable-provenance, apply to every command in the script." << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+}
+
+void CommandOperationManager::printServerHelp(const AString& programName)
+{
+    //guide for wrap, assuming 80 columns:                                                  |
+    cout << "   When running many short commands that use the same surfaces, starting a new" << endl;
+    cout << "   process and rereading the surfaces each time can take longer than the" << endl;
+    cout << "   processing.  Instead, start a server that stays running:" << endl;
+    cout << endl;
+    cout << "$ " << programName << " -server <socket-name> [-requests <num>] [-cache-mb <size>]" << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   and then put '-client <socket-name>' in front of each command:" << endl;
+    cout << endl;
+    cout << "$ " << programName << " -client <socket-name> -surface-normals mid.surf.gii normals.func.gii" << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   The client sends its arguments and working directory to the server, prints" << endl;
+    cout << "   the command's output once it finishes, and exits with the same status the" << endl;
+    cout << "   command would have.  -client must be the first argument.  The socket name" << endl;
+    cout << "   can be a path, otherwise the socket is created in the temporary directory." << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   The server runs up to -requests commands at the same time (default: number" << endl;
+    cout << "   of cores), each of which can also use multiple threads, so consider setting" << endl;
+    cout << "   OMP_NUM_THREADS when starting the server (see -parallel-help).  Commands" << endl;
+    cout << "   from different working directories take turns.  Input surfaces are kept" << endl;
+    cout << "   in memory, along with their topology and geodesic information, and are" << endl;
+    cout << "   reread if the file changes.  The least recently used surfaces are released" << endl;
+    cout << "   when they take more than -cache-mb megabytes (default 2048)." << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+    cout << "   Global options that change the whole process, such as -logging, must be" << endl;
+    cout << "   given when starting the server.  Environment variables of the client are" << endl;
+    cout << "   not used.  The server runs until it is killed." << endl;
+    cout << endl;//guide for wrap, assuming 80 columns:                                     |
+}
+
 void CommandOperationManager::printParallelHelp(const AString& programName)
 {
     //guide for wrap, assuming 80 columns:                                                  |
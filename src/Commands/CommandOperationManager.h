@@ -24,6 +24,7 @@
 
 #include <vector>
 
+#include "CaretMutex.h"
 #include "CaretObject.h"
 #include "CommandException.h"
 
@@ -44,6 +45,9 @@ namespace caret {
         
         void runCommand(ProgramParameters& parameters);
         
+        void runServerRequest(ProgramParameters& parameters,
+                              const AString& requestCommandLine);
+        
         AString doCompletion(ProgramParameters& parameters, const bool& useExtGlob);
         
         std::vector<CommandOperation*> getCommandOperations();
@@ -75,6 +79,14 @@ namespace caret {
         
         void printParallelHelp(const AString& programName);
         
+        void printBatchHelp(const AString& programName);
+        
+        void printServerHelp(const AString& programName);
+        
+        void runCommandInternal(ProgramParameters& parameters,
+                                const AString& requestCommandLine,
+                                const bool serverRequest);
+        
         void printVersionInfo();
         
         bool getGlobalOption(ProgramParameters& parameters, const AString& optionString, const int& numArgs, std::vector<AString>& arguments);
@@ -94,6 +106,8 @@ namespace caret {
     private:
         std::vector<CommandOperation*> commandOperations, deprecatedOperations;
         
+        CaretMutex m_serverOperationMutex;
+        
         static CommandOperationManager* singletonCommandOperationManager;
     };
     
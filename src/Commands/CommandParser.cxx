@@ -28,6 +28,8 @@
 #include "CaretDataFileHelper.h"
 #include "CaretLogger.h"
 #include "CiftiFile.h"
+#include "CommandInputCache.h"
+#include "CommandNamedFiles.h"
 #include "DataFileException.h"
 #include "FileInformation.h"
 #include "FociFile.h"
@@ -49,6 +51,7 @@ const AString CommandParser::PROVENANCE_NAME = "Provenance";
 const AString CommandParser::PARENT_PROVENANCE_NAME = "ParentProvenance";
 const AString CommandParser::PROGRAM_PROVENANCE_NAME = "ProgramProvenance";
 const AString CommandParser::CWD_PROVENANCE_NAME = "WorkingDirectory";
+CommandInputCache* CommandParser::s_inputCache = NULL;
 
 CommandParser::CommandParser(AutoOperationInterface* myAutoOper) :
     CommandOperation(myAutoOper->getCommandSwitch(), myAutoOper->getShortDescription()),
@@ -59,6 +62,12 @@ CommandParser::CommandParser(AutoOperationInterface* myAutoOper) :
     m_ciftiDType = NIFTI_TYPE_FLOAT32;
     m_ciftiMax = -1.0;//these values won't get used, but don't leave them uninitialized
     m_ciftiMin = -1.0;
+    m_namedFiles = NULL;
+}
+
+CommandParser* CommandParser::cloneParser()
+{
+    return new CommandParser(m_autoOper->clone());
 }
 
 void CommandParser::disableProvenance()
@@ -87,6 +96,7 @@ void CommandParser::executeOperation(ProgramParameters& parameters)
     CaretPointer<OperationParameters> myAlgParams(m_autoOper->getParameters());//could be an autopointer, but this is safer
     vector<OutputAssoc> myOutAssoc;
     m_provenance = caret_global_commandLine;
+    if (m_batchCommandLine != "") m_provenance = m_batchCommandLine;//the batch command line would say nothing about how this output was made
     //the idea is to have m_provenance set before the command executes, so it can be overridden, but have m_parentProvenance set AFTER the processing is complete
     //the parent provenance should never be generated manually
     m_parentProvenance = "";//in case someone tries to use the same instance more than once
@@ -108,6 +118,132 @@ void CommandParser::executeOperation(ProgramParameters& parameters)
     writeOutput(myOutAssoc);
 }
 
+void CommandParser::executeBatchStep(ProgramParameters& parameters, CommandNamedFiles* namedFiles, const AString& stepCommandLine)
+{
+    m_namedFiles = namedFiles;
+    m_batchCommandLine = stepCommandLine;
+    try
+    {
+        executeOperation(parameters);
+    } catch (...) {
+        m_namedFiles = NULL;
+        m_batchCommandLine = "";
+        throw;
+    }
+    m_namedFiles = NULL;
+    m_batchCommandLine = "";
+}
+
+void CommandParser::setInputCache(CommandInputCache* cache)
+{
+    s_inputCache = cache;
+}
+
+bool CommandParser::isNamedFile(const AString& argument, const OperationParametersEnum::Enum& type)
+{
+    return m_namedFiles != NULL && CommandNamedFiles::isFileType(type) && CommandNamedFiles::isName(argument);
+}
+
+void CommandParser::scanFileArguments(ProgramParameters& parameters, vector<AString>& inputsOut, vector<AString>& outputsOut, vector<AString>& stringsOut)
+{
+    CaretPointer<OperationParameters> myAlgParams(m_autoOper->getParameters());
+    inputsOut.clear();
+    outputsOut.clear();
+    stringsOut.clear();
+    scanComponent(myAlgParams.getPointer(), parameters, inputsOut, outputsOut, stringsOut);
+    parameters.verifyAllParametersProcessed();
+}
+
+void CommandParser::scanComponent(ParameterComponent* myComponent, ProgramParameters& parameters, vector<AString>& inputsOut, vector<AString>& outputsOut, vector<AString>& stringsOut)
+{//IMPORTANT: this must consume arguments the same way as parseComponent(), but without opening any files
+    for (int i = 0; i < (int)myComponent->m_paramList.size(); ++i)
+    {
+        AString nextArg = parameters.nextString(myComponent->m_paramList[i]->m_shortName).fixUnicodeHyphens(NULL, NULL, true);
+        const OperationParametersEnum::Enum nextType = myComponent->m_paramList[i]->getType();
+        if (!nextArg.isEmpty() && nextArg[0] == '-')
+        {
+            if (scanOption(nextArg, myComponent, parameters, inputsOut, outputsOut, stringsOut))
+            {
+                --i;
+                continue;
+            }
+            switch (nextType)
+            {
+                case OperationParametersEnum::STRING:
+                case OperationParametersEnum::INT:
+                case OperationParametersEnum::DOUBLE:
+                    break;//negative number
+                default:
+                    throw ProgramParametersException("Invalid option \"" + nextArg + "\" while next required argument is <" + myComponent->m_paramList[i]->m_shortName +
+                                                     ">, option is either incorrect, or incorrectly placed");
+            }
+        }
+        switch (nextType)
+        {
+            case OperationParametersEnum::BOOL:
+            case OperationParametersEnum::DOUBLE:
+            case OperationParametersEnum::INT:
+                break;//checked when the step is parsed for real
+            case OperationParametersEnum::STRING:
+                stringsOut.push_back(nextArg);
+                break;
+            default:
+                inputsOut.push_back(nextArg);
+                break;
+        }
+    }
+    for (int i = 0; i < (int)myComponent->m_outputList.size(); ++i)
+    {
+        AString nextArg = parameters.nextString(myComponent->m_outputList[i]->m_shortName).fixUnicodeHyphens(NULL, NULL, true);
+        if (!nextArg.isEmpty() && nextArg[0] == '-')
+        {
+            if (!scanOption(nextArg, myComponent, parameters, inputsOut, outputsOut, stringsOut))
+            {
+                throw ProgramParametersException("Invalid option \"" + nextArg + "\" while next reqired argument is <" + myComponent->m_outputList[i]->m_shortName +
+                ">, option is either incorrect, or incorrectly placed");
+            }
+            --i;
+            continue;
+        }
+        if (CommandNamedFiles::isFileType(myComponent->m_outputList[i]->getType())) outputsOut.push_back(nextArg);
+    }
+    scanRemainingOptions(myComponent, parameters, inputsOut, outputsOut, stringsOut);
+}
+
+bool CommandParser::scanOption(const AString& mySwitch, ParameterComponent* myComponent, ProgramParameters& parameters, vector<AString>& inputsOut, vector<AString>& outputsOut, vector<AString>& stringsOut)
+{
+    for (uint32_t i = 0; i < myComponent->m_optionList.size(); ++i)
+    {
+        if (mySwitch == myComponent->m_optionList[i]->m_optionSwitch)
+        {
+            scanComponent(myComponent->m_optionList[i], parameters, inputsOut, outputsOut, stringsOut);//repeated options are an error when the step is parsed for real
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < myComponent->m_repeatableOptions.size(); ++i)
+    {
+        if (mySwitch == myComponent->m_repeatableOptions[i]->m_optionSwitch)
+        {
+            scanComponent(&(myComponent->m_repeatableOptions[i]->m_template), parameters, inputsOut, outputsOut, stringsOut);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommandParser::scanRemainingOptions(ParameterComponent* myComponent, ProgramParameters& parameters, vector<AString>& inputsOut, vector<AString>& outputsOut, vector<AString>& stringsOut)
+{
+    while (parameters.hasNext())
+    {
+        AString nextArg = parameters.nextString("option").fixUnicodeHyphens(NULL, NULL, true);
+        if (nextArg.isEmpty() || nextArg[0] != '-' || !scanOption(nextArg, myComponent, parameters, inputsOut, outputsOut, stringsOut))
+        {
+            parameters.backup();
+            return;
+        }
+    }
+}
+
 void CommandParser::showParsedOperation(ProgramParameters& parameters)
 {
     CaretPointer<OperationParameters> myAlgParams(m_autoOper->getParameters());//could be an autopointer, but this is safer
@@ -119,7 +255,7 @@ void CommandParser::showParsedOperation(ProgramParameters& parameters)
 }
 
 void CommandParser::parseComponent(ParameterComponent* myComponent, ProgramParameters& parameters, vector<OutputAssoc>& outAssociation, bool debug)
-{//IMPORTANT: update completionComponent() and friends with any change to parsing logic
+{//IMPORTANT: update completionComponent(), scanComponent(), and friends with any change to parsing logic
     for (int i = 0; i < (int)myComponent->m_paramList.size(); ++i)
     {
         bool hyphenReplaced = false;
@@ -151,6 +287,16 @@ void CommandParser::parseComponent(ParameterComponent* myComponent, ProgramParam
             }
         }
         const OperationParametersEnum::Enum nextType = myComponent->m_paramList[i]->getType();// need in catch statement below
+        if (isNamedFile(nextArg, nextType))
+        {
+            m_namedFiles->getFile(nextArg, myComponent->m_paramList[i]);
+            if (debug)
+            {
+                cout << "Parameter <" << myComponent->m_paramList[i]->m_shortName << "> using in-memory file ";
+                cout << nextArg << endl;
+            }
+            continue;
+        }
         try {
             switch (myComponent->m_paramList[i]->getType())
             {
@@ -324,8 +470,14 @@ void CommandParser::parseComponent(ParameterComponent* myComponent, ProgramParam
                 }
                 case OperationParametersEnum::SURFACE:
                 {
-                    CaretPointer<SurfaceFile> myFile(new SurfaceFile());
-                    myFile->readFile(nextArg);
+                    CaretPointer<SurfaceFile> myFile;
+                    if (s_inputCache != NULL)
+                    {
+                        myFile = s_inputCache->getSurface(nextArg);
+                    } else {
+                        myFile.grabNew(new SurfaceFile());
+                        myFile->readFile(nextArg);
+                    }
                     if (m_doProvenance)
                     {
                         const GiftiMetaData* md = myFile->getFileMetaData();
@@ -962,7 +1114,9 @@ void CommandParser::makeOnDiskOutputs(const vector<OutputAssoc>& outAssociation)
                         CaretLogInfo("Computing output file '" + outAssociation[i].m_fileName + "' in memory due to collision with input file");
                     }
                     myCiftiParam->m_parameter.grabNew(new CiftiFile());
-               } else {
+                } else if (isNamedFile(outAssociation[i].m_fileName, OperationParametersEnum::CIFTI)) {
+                    myCiftiParam->m_parameter.grabNew(new CiftiFile());//kept in memory for later batch steps
+                } else {
                     myCiftiParam->m_parameter.grabNew(new CiftiFile());
                     myCiftiParam->m_parameter->setWritingFile(outAssociation[i].m_fileName);
                 }
@@ -985,6 +1139,11 @@ void CommandParser::writeOutput(const vector<OutputAssoc>& outAssociation)
     for (uint32_t i = 0; i < outAssociation.size(); ++i)
     {
         AbstractParameter* myParam = outAssociation[i].m_param;
+        if (isNamedFile(outAssociation[i].m_fileName, myParam->getType()))
+        {
+            m_namedFiles->setFile(outAssociation[i].m_fileName, myParam);
+            continue;
+        }
         switch (myParam->getType())
         {
             case OperationParametersEnum::BOOL://ignores the name you give the output for now, but what gives primitive type output and how is it used?
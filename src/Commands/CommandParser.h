@@ -28,20 +28,26 @@
 #include "CommandException.h"
 #include "ProgramParametersException.h"
 
+#include <map>
 #include <vector>
 #include <set>
 
 namespace caret {
 
+    class CommandInputCache;
+    class CommandNamedFiles;
+    
     class CommandParser : public CommandOperation, OperationParserInterface
     {
         int m_minIndent, m_maxIndent, m_indentIncrement, m_maxWidth;
-        AString m_provenance, m_parentProvenance, m_workingDir;
+        AString m_provenance, m_parentProvenance, m_workingDir, m_batchCommandLine;
         bool m_doProvenance, m_ciftiScale;
         double m_ciftiMin, m_ciftiMax;
         int16_t m_ciftiDType;
         const static AString PROVENANCE_NAME, PARENT_PROVENANCE_NAME, PROGRAM_PROVENANCE_NAME, CWD_PROVENANCE_NAME;//TODO: put this elsewhere?
         std::map<AString, const CiftiFile*> m_inputCiftiNames;
+        CommandNamedFiles* m_namedFiles;//only set while running a batch step
+        static CommandInputCache* s_inputCache;//only set in server mode, shared by all parsers
         struct OutputAssoc
         {//how the output is stored is up to the parser, in the GUI it should load into memory without writing to disk
             AString m_fileName;
@@ -56,6 +62,10 @@ namespace caret {
         void parseComponent(ParameterComponent* myComponent, ProgramParameters& parameters, std::vector<OutputAssoc>& outAssociation, bool debug = false);
         bool parseOption(const AString& mySwitch, ParameterComponent* myComponent, ProgramParameters& parameters, std::vector<OutputAssoc>& outAssociation, bool debug);
         void parseRemainingOptions(ParameterComponent* myAlgParams, ProgramParameters& parameters, std::vector<OutputAssoc>& outAssociation, bool debug);
+        void scanComponent(ParameterComponent* myComponent, ProgramParameters& parameters, std::vector<AString>& inputsOut, std::vector<AString>& outputsOut, std::vector<AString>& stringsOut);
+        bool scanOption(const AString& mySwitch, ParameterComponent* myComponent, ProgramParameters& parameters, std::vector<AString>& inputsOut, std::vector<AString>& outputsOut, std::vector<AString>& stringsOut);
+        void scanRemainingOptions(ParameterComponent* myComponent, ProgramParameters& parameters, std::vector<AString>& inputsOut, std::vector<AString>& outputsOut, std::vector<AString>& stringsOut);
+        bool isNamedFile(const AString& argument, const OperationParametersEnum::Enum& type);
         void provenanceBeforeOperation(const std::vector<OutputAssoc>& outAssociation);
         void provenanceAfterOperation(const std::vector<OutputAssoc>& outAssociation);
         void makeOnDiskOutputs(const std::vector<OutputAssoc>& outAssociation);//ensures on-disk inputs aren't used as on-disk outputs, keeping outputs in-memory when needed
@@ -77,6 +87,15 @@ namespace caret {
         void setCiftiOutputDTypeAndScale(const int16_t& dtype, const double& minVal, const double& maxVal);
         void setCiftiOutputDTypeNoScale(const int16_t& dtype);
         void executeOperation(ProgramParameters& parameters);
+        ///new parser for the same operation, for running batch steps concurrently
+        CommandParser* cloneParser();
+        ///find the file arguments without opening anything, string arguments are reported separately because some operations treat them as files
+        void scanFileArguments(ProgramParameters& parameters, std::vector<AString>& inputsOut, std::vector<AString>& outputsOut, std::vector<AString>& stringsOut);
+        ///run as a step of a batch script: @name inputs and outputs use in-memory files, and provenance records the step's own command line
+        ///namedFiles may be NULL, for a server request that only needs its own command line in provenance
+        void executeBatchStep(ProgramParameters& parameters, CommandNamedFiles* namedFiles, const AString& stepCommandLine);
+        ///read-only inputs that can be shared between commands come from the cache, set before running commands concurrently, NULL disables it
+        static void setInputCache(CommandInputCache* cache);
         void showParsedOperation(ProgramParameters& parameters);
         AString doCompletion(ProgramParameters& parameters, const bool& useExtGlob);
         AString getHelpInformation(const AString& programName);
@@ -0,0 +1,325 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CommandServer.h"
+
+#include "CaretAssert.h"
+#include "CaretCommandLine.h"
+#include "CaretLogger.h"
+#include "CommandException.h"
+#include "CommandOperationManager.h"
+#include "CommandParser.h"
+#include "ProgramParameters.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QLocalSocket>
+#include <QRunnable>
+#include <QStringList>
+#include <QThreadStorage>
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const quint32 PROTOCOL_VERSION = 1;
+
+    struct RequestOutput
+    {
+        string m_stdout, m_stderr;
+    };
+
+    QThreadStorage<RequestOutput*> s_requestOutput;//set only on threads that are running a request
+
+    ///sends cout and cerr to the request running on the current thread, or to the original stream if there isn't one
+    class RequestStreamBuf : public streambuf
+    {
+        streambuf* m_original;
+        bool m_isStderr;
+        string* getBuffer()
+        {
+            if (!s_requestOutput.hasLocalData()) return NULL;
+            RequestOutput* myOutput = s_requestOutput.localData();
+            if (myOutput == NULL) return NULL;
+            return m_isStderr ? &(myOutput->m_stderr) : &(myOutput->m_stdout);
+        }
+    protected:
+        int overflow(int c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            string* myBuffer = getBuffer();
+            if (myBuffer == NULL) return m_original->sputc(traits_type::to_char_type(c));
+            myBuffer->push_back(traits_type::to_char_type(c));
+            return c;
+        }
+        streamsize xsputn(const char* s, streamsize n)
+        {
+            string* myBuffer = getBuffer();
+            if (myBuffer == NULL) return m_original->sputn(s, n);
+            myBuffer->append(s, n);
+            return n;
+        }
+        int sync()
+        {
+            if (getBuffer() == NULL) return m_original->pubsync();
+            return 0;
+        }
+    public:
+        RequestStreamBuf(streambuf* original, const bool& isStderr)
+        {
+            m_original = original;
+            m_isStderr = isStderr;
+        }
+    };
+
+    ///one connection, handled on a thread pool thread with blocking socket calls
+    class ServerConnection : public QRunnable
+    {
+        CommandServer* m_server;
+        quintptr m_descriptor;
+    public:
+        ServerConnection(CommandServer* server, const quintptr& descriptor)
+        {
+            m_server = server;
+            m_descriptor = descriptor;
+        }
+        void run()
+        {
+            QLocalSocket mySocket;
+            if (!mySocket.setSocketDescriptor(m_descriptor)) return;
+            QByteArray request;
+            if (!CommandServer::readMessage(mySocket, request)) return;
+            QDataStream requestStream(request);
+            quint32 version = 0;
+            QStringList arguments;
+            QString workingDirectory;
+            requestStream >> version;
+            QByteArray outText, errText;
+            qint32 exitCode = -1;
+            if (version != PROTOCOL_VERSION)
+            {
+                errText = "\nERROR: wb_command client and server are different versions\n\n";
+            } else {
+                requestStream >> arguments >> workingDirectory;
+                vector<AString> myArguments;
+                for (int i = 0; i < arguments.size(); ++i)
+                {
+                    myArguments.push_back(arguments[i]);
+                }
+                exitCode = m_server->runRequest(myArguments, workingDirectory, outText, errText);
+            }
+            QByteArray reply;
+            QDataStream replyStream(&reply, QIODevice::WriteOnly);
+            replyStream << outText << errText << exitCode;
+            if (CommandServer::writeMessage(mySocket, reply))
+            {
+                mySocket.disconnectFromServer();
+            }
+        }
+    };
+}
+
+CommandServer::CommandServer(const AString& socketName, const int& maxRequests, const int64_t& cacheBytes) : m_inputCache(cacheBytes)
+{
+    CaretAssert(maxRequests > 0);
+    m_socketName = socketName;
+    m_threadPool.setMaxThreadCount(maxRequests);
+    m_threadPool.setExpiryTimeout(-1);//keep the threads, so that the thread storage for output capture isn't constantly recreated
+    m_currentDirectory = QDir::currentPath();
+    m_directoryUsers = 0;
+}
+
+void CommandServer::run()
+{
+    QLocalServer::removeServer(m_socketName);//clean up the socket file left by a server that was killed
+#if QT_VERSION >= 0x050000
+    setSocketOptions(QLocalServer::UserAccessOption);//commands run as the server's user, so other local users must not be able to connect
+#endif
+    if (!listen(m_socketName))
+    {
+        throw CommandException("unable to listen on socket '" + m_socketName + "': " + errorString());
+    }
+#if QT_VERSION < 0x050000 && !defined(_WIN32)
+    if (!QFile::setPermissions(fullServerName(), QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner))
+    {//qt4 has no socket options, restrict the socket file directly
+        close();
+        throw CommandException("unable to restrict access to socket '" + fullServerName() + "'");
+    }
+#endif
+    cout << "wb_command server listening on " << fullServerName().toLocal8Bit().constData() << endl;
+    RequestStreamBuf outBuf(cout.rdbuf(), false), errBuf(cerr.rdbuf(), true);
+    streambuf* origOut = cout.rdbuf(&outBuf);
+    streambuf* origErr = cerr.rdbuf(&errBuf);
+    CommandParser::setInputCache(&m_inputCache);
+    while (isListening())
+    {
+        waitForNewConnection(-1);//calls incomingConnection for each client
+    }
+    m_threadPool.waitForDone();
+    CommandParser::setInputCache(NULL);
+    cout.rdbuf(origOut);
+    cerr.rdbuf(origErr);
+}
+
+void CommandServer::incomingConnection(quintptr socketDescriptor)
+{
+    m_threadPool.start(new ServerConnection(this, socketDescriptor));//the pool queues connections beyond the maximum number of requests
+}
+
+bool CommandServer::acquireDirectory(const AString& directory)
+{
+    QMutexLocker locked(&m_directoryMutex);
+    while (m_directoryUsers > 0 && directory != m_currentDirectory)
+    {
+        m_directoryFree.wait(&m_directoryMutex);
+    }
+    if (directory != m_currentDirectory)
+    {
+        if (!QDir::setCurrent(directory)) return false;
+        m_currentDirectory = directory;
+    }
+    ++m_directoryUsers;
+    return true;
+}
+
+void CommandServer::releaseDirectory()
+{
+    QMutexLocker locked(&m_directoryMutex);
+    CaretAssert(m_directoryUsers > 0);
+    --m_directoryUsers;
+    if (m_directoryUsers == 0) m_directoryFree.wakeAll();
+}
+
+int CommandServer::runRequest(const vector<AString>& arguments, const AString& workingDirectory, QByteArray& stdoutOut, QByteArray& stderrOut)
+{
+    vector<AString> fullCommand(1, "wb_command");
+    fullCommand.insert(fullCommand.end(), arguments.begin(), arguments.end());
+    const AString commandLine = caret_format_command_line(fullCommand);
+    if (!acquireDirectory(workingDirectory))
+    {
+        stderrOut = ("\nWhile running:\n" + commandLine + "\n\nERROR: server could not change to directory '" + workingDirectory + "'\n\n").toLocal8Bit();
+        return -1;
+    }
+    s_requestOutput.setLocalData(new RequestOutput());
+    ProgramParameters myParams;
+    for (size_t i = 0; i < arguments.size(); ++i)
+    {
+        myParams.addParameter(arguments[i]);
+    }
+    int ret = 0;
+    try
+    {
+        CaretLogFine("server running: " + commandLine);
+        CommandOperationManager::getCommandOperationManager()->runServerRequest(myParams, commandLine);
+    } catch (CaretException& e) {
+        cerr << "\nWhile running:\n" << commandLine.toLocal8Bit().constData() << "\n\nERROR: " << e.whatString().toLocal8Bit().constData() << endl << endl;
+        ret = -1;
+    } catch (bad_alloc& e) {
+        cerr << "\nWhile running:\n" << commandLine.toLocal8Bit().constData() << "\n\nERROR: " << e.what() << endl;
+        cerr << endl << "OUT OF MEMORY" << endl << endl;
+        ret = -1;
+    } catch (exception& e) {
+        cerr << "\nWhile running:\n" << commandLine.toLocal8Bit().constData() << "\n\nERROR: " << e.what() << endl << endl;
+        ret = -1;
+    } catch (...) {//don't let one request take down the server
+        cerr << "\nWhile running:\n" << commandLine.toLocal8Bit().constData() << "\n\nERROR: caught unknown exception type" << endl << endl;
+        ret = -1;
+    }
+    RequestOutput* myOutput = s_requestOutput.localData();
+    stdoutOut = QByteArray(myOutput->m_stdout.data(), (int)myOutput->m_stdout.size());
+    stderrOut = QByteArray(myOutput->m_stderr.data(), (int)myOutput->m_stderr.size());
+    s_requestOutput.setLocalData(NULL);//deletes the output
+    releaseDirectory();
+    return ret;
+}
+
+int CommandServer::runClient(const AString& socketName, const vector<AString>& arguments)
+{
+    QLocalSocket mySocket;
+    mySocket.connectToServer(socketName);
+    if (!mySocket.waitForConnected(-1))
+    {
+        cerr << "\nERROR: unable to connect to wb_command server '" << socketName.toLocal8Bit().constData() << "': " << mySocket.errorString().toLocal8Bit().constData() << endl << endl;
+        return -1;
+    }
+    QStringList myArguments;
+    for (size_t i = 0; i < arguments.size(); ++i)
+    {
+        myArguments.push_back(arguments[i]);
+    }
+    QByteArray request;
+    QDataStream requestStream(&request, QIODevice::WriteOnly);
+    requestStream << PROTOCOL_VERSION << myArguments << QDir::currentPath();
+    QByteArray reply;
+    if (!writeMessage(mySocket, request) || !readMessage(mySocket, reply))
+    {
+        cerr << "\nERROR: lost connection to wb_command server '" << socketName.toLocal8Bit().constData() << "'" << endl << endl;
+        return -1;
+    }
+    QDataStream replyStream(reply);
+    QByteArray outText, errText;
+    qint32 exitCode = -1;
+    replyStream >> outText >> errText >> exitCode;
+    cout.write(outText.constData(), outText.size());
+    cout.flush();
+    cerr.write(errText.constData(), errText.size());
+    cerr.flush();
+    return exitCode;
+}
+
+bool CommandServer::writeMessage(QLocalSocket& socket, const QByteArray& message)
+{
+    QByteArray header;
+    QDataStream headerStream(&header, QIODevice::WriteOnly);
+    headerStream << quint64(message.size());
+    if (socket.write(header) != header.size()) return false;
+    if (socket.write(message) != message.size()) return false;
+    while (socket.bytesToWrite() > 0)
+    {
+        if (!socket.waitForBytesWritten(-1)) return false;
+    }
+    return true;
+}
+
+bool CommandServer::readMessage(QLocalSocket& socket, QByteArray& messageOut)
+{
+    const qint64 HEADER_SIZE = sizeof(quint64);
+    while (socket.bytesAvailable() < HEADER_SIZE)
+    {
+        if (!socket.waitForReadyRead(-1)) return false;
+    }
+    QByteArray header = socket.read(HEADER_SIZE);
+    QDataStream headerStream(header);
+    quint64 length = 0;
+    headerStream >> length;
+    messageOut.clear();
+    while ((quint64)messageOut.size() < length)
+    {
+        if (socket.bytesAvailable() == 0 && !socket.waitForReadyRead(-1)) return false;
+        messageOut += socket.read(length - messageOut.size());
+    }
+    return true;
+}
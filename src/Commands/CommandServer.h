@@ -0,0 +1,71 @@
+#ifndef __COMMAND_SERVER_H__
+#define __COMMAND_SERVER_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AString.h"
+#include "CommandInputCache.h"
+
+#include <QLocalServer>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <vector>
+
+class QLocalSocket;
+
+namespace caret {
+
+    ///long-lived wb_command that runs command lines sent over a local socket, each on its own thread, sharing a cache of read-only inputs
+    class CommandServer : public QLocalServer
+    {
+        AString m_socketName;
+        CommandInputCache m_inputCache;
+        QThreadPool m_threadPool;
+        QMutex m_directoryMutex;//the working directory belongs to the process, so requests from different directories take turns
+        QWaitCondition m_directoryFree;
+        AString m_currentDirectory;
+        int64_t m_directoryUsers;
+        bool acquireDirectory(const AString& directory);//false if the directory can't be used
+        void releaseDirectory();
+    protected:
+        void incomingConnection(quintptr socketDescriptor);
+    public:
+        CommandServer(const AString& socketName, const int& maxRequests, const int64_t& cacheBytes);
+
+        ///listen on the socket and run requests until the process is killed
+        void run();
+
+        ///run one request, as wb_command would with the same arguments, returns the exit code
+        int runRequest(const std::vector<AString>& arguments, const AString& workingDirectory, QByteArray& stdoutOut, QByteArray& stderrOut);
+
+        ///send the arguments to a server and print its output, returns the exit code to use
+        static int runClient(const AString& socketName, const std::vector<AString>& arguments);
+
+        ///length-prefixed messages, used by both sides of the connection
+        static bool writeMessage(QLocalSocket& socket, const QByteArray& message);
+        static bool readMessage(QLocalSocket& socket, QByteArray& messageOut);
+    };
+
+}
+
+#endif //__COMMAND_SERVER_H__
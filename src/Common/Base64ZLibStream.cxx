@@ -0,0 +1,234 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "Base64ZLibStream.h"
+
+#include "Base64.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const int64_t CHUNK_BYTES = 1 << 16;//size of the buffers for compressed data
+    const int64_t ENCODE_CHUNK_BYTES = CHUNK_BYTES - (CHUNK_BYTES % 3);//uncompressed data is encoded in multiples of 3 bytes, so that only the last piece has padding
+
+    //same as Base64's table, but whitespace is marked separately, so that it can be skipped
+    const unsigned char INVALID_CHAR = 0xFF, SKIP_CHAR = 0xFE, PAD_CHAR = 0xFD;
+
+    struct DecodeTable
+    {
+        unsigned char m_table[256];
+        DecodeTable()
+        {
+            for (int i = 0; i < 256; ++i) m_table[i] = INVALID_CHAR;
+            const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            for (int i = 0; i < 64; ++i) m_table[(unsigned char)alphabet[i]] = (unsigned char)i;
+            m_table[(unsigned char)' '] = SKIP_CHAR;
+            m_table[(unsigned char)'\t'] = SKIP_CHAR;
+            m_table[(unsigned char)'\n'] = SKIP_CHAR;
+            m_table[(unsigned char)'\r'] = SKIP_CHAR;
+            m_table[(unsigned char)'='] = PAD_CHAR;
+        }
+    };
+
+    const DecodeTable s_decodeTable;//constructed during static initialization, so it is never built by two threads at once
+
+    ///decodes base64 text in pieces, keeping partial quads between calls
+    class Base64Decoder
+    {
+        const unsigned char* m_text;
+        const unsigned char* m_textEnd;
+        bool m_finished;
+    public:
+        Base64Decoder(const char* text, const uint64_t textLength)
+        {
+            m_text = (const unsigned char*)text;
+            m_textEnd = m_text + textLength;
+            m_finished = false;
+        }
+        bool finished() const { return m_finished; }
+        ///decode up to outLength bytes, only stops short of outLength when the data ends, returns number of bytes written
+        uint64_t decode(unsigned char* out, const uint64_t outLength)
+        {
+            uint64_t written = 0;
+            while (!m_finished && outLength - written >= 3)
+            {
+                unsigned char quad[4];
+                int numChars = 0;
+                while (numChars < 4 && m_text < m_textEnd)
+                {
+                    unsigned char value = s_decodeTable.m_table[*m_text];
+                    ++m_text;
+                    if (value == SKIP_CHAR) continue;
+                    if (value == INVALID_CHAR) break;
+                    quad[numChars] = value;
+                    ++numChars;
+                    if (value == PAD_CHAR) break;
+                }
+                if (numChars < 4)
+                {//end of text, invalid character, or padding: same as Base64::decode, a partial quad ends the data
+                    int numBytes = 0;
+                    for (int i = 0; i < numChars && quad[i] != PAD_CHAR; ++i) ++numBytes;
+                    if (numBytes >= 2)
+                    {
+                        out[written] = (unsigned char)((quad[0] << 2) | (quad[1] >> 4));
+                        ++written;
+                    }
+                    if (numBytes >= 3)
+                    {
+                        out[written] = (unsigned char)(((quad[1] << 4) & 0xF0) | (quad[2] >> 2));
+                        ++written;
+                    }
+                    m_finished = true;
+                    break;
+                }
+                int numBytes = 3;
+                if (quad[2] == PAD_CHAR)
+                {
+                    numBytes = 1;
+                    m_finished = true;
+                } else if (quad[3] == PAD_CHAR) {
+                    numBytes = 2;
+                    m_finished = true;
+                }
+                out[written] = (unsigned char)((quad[0] << 2) | (quad[1] >> 4));
+                if (numBytes > 1) out[written + 1] = (unsigned char)(((quad[1] << 4) & 0xF0) | (quad[2] >> 2));
+                if (numBytes > 2) out[written + 2] = (unsigned char)(((quad[2] << 6) & 0xC0) | quad[3]);
+                written += numBytes;
+            }
+            if (m_text >= m_textEnd) m_finished = true;
+            return written;
+        }
+    };
+}
+
+uint64_t Base64ZLibStream::decode(const char* text, const uint64_t textLength, const bool zlibCompressed, unsigned char* output, const uint64_t outputLength)
+{
+    Base64Decoder decoder(text, textLength);
+    if (!zlibCompressed)
+    {//decode straight into the output, whole quads only, then handle a partial group at the end through a tiny buffer
+        uint64_t written = decoder.decode(output, outputLength - (outputLength % 3));
+        if (!decoder.finished() && written < outputLength)
+        {
+            unsigned char tail[3];
+            uint64_t tailBytes = decoder.decode(tail, 3);
+            tailBytes = min(tailBytes, outputLength - written);
+            for (uint64_t i = 0; i < tailBytes; ++i) output[written + i] = tail[i];
+            written += tailBytes;
+        }
+        return written;
+    }
+    z_stream myStream;
+    myStream.zalloc = Z_NULL;
+    myStream.zfree = Z_NULL;
+    myStream.opaque = Z_NULL;
+    myStream.next_in = Z_NULL;
+    myStream.avail_in = 0;
+    if (inflateInit(&myStream) != Z_OK) return 0;
+    vector<unsigned char> inBuffer(CHUNK_BYTES);
+    uint64_t outputUsed = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+        if (myStream.avail_in == 0)
+        {
+            if (decoder.finished()) break;//truncated
+            uint64_t decoded = decoder.decode(inBuffer.data(), inBuffer.size());
+            if (decoded == 0) break;
+            myStream.next_in = inBuffer.data();
+            myStream.avail_in = (uInt)decoded;
+        }
+        uint64_t outputRemaining = outputLength - outputUsed;
+        uInt availOut = (uInt)min(outputRemaining, (uint64_t)numeric_limits<uInt>::max());
+        myStream.next_out = output + outputUsed;
+        myStream.avail_out = availOut;
+        ret = inflate(&myStream, Z_NO_FLUSH);
+        outputUsed += availOut - myStream.avail_out;
+        if (ret == Z_BUF_ERROR && outputUsed == outputLength) break;//more data than the output can hold
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) break;//corrupt data
+    }
+    inflateEnd(&myStream);
+    if (ret != Z_STREAM_END || outputUsed != outputLength) return 0;//same as DataCompressZLib::uncompressData, anything but the exact size is a failure
+    return outputUsed;
+}
+
+bool Base64ZLibStream::encode(const unsigned char* input, const uint64_t inputLength, const bool zlibCompress, ostream& stream)
+{
+    vector<unsigned char> encoded((ENCODE_CHUNK_BYTES / 3) * 4 + 4);
+    if (!zlibCompress)
+    {
+        for (uint64_t start = 0; start < inputLength; start += ENCODE_CHUNK_BYTES)
+        {
+            uint64_t length = min((uint64_t)ENCODE_CHUNK_BYTES, inputLength - start);
+            uint64_t encodedLength = Base64::encode(input + start, length, encoded.data());
+            stream.write((const char*)encoded.data(), encodedLength);
+        }
+        return true;
+    }
+    z_stream myStream;
+    myStream.zalloc = Z_NULL;
+    myStream.zfree = Z_NULL;
+    myStream.opaque = Z_NULL;
+    myStream.next_in = Z_NULL;
+    myStream.avail_in = 0;
+    if (deflateInit(&myStream, Z_DEFAULT_COMPRESSION) != Z_OK) return false;
+    vector<unsigned char> compressed(CHUNK_BYTES);
+    uint64_t compressedUsed = 0;//bytes in the compressed buffer that are not yet encoded, fewer than 3 carry over to the next chunk
+    uint64_t inputUsed = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+        if (myStream.avail_in == 0 && inputUsed < inputLength)
+        {
+            uInt availIn = (uInt)min(inputLength - inputUsed, (uint64_t)numeric_limits<uInt>::max());
+            myStream.next_in = (Bytef*)(input + inputUsed);
+            myStream.avail_in = availIn;
+            inputUsed += availIn;
+        }
+        int flush = (inputUsed == inputLength) ? Z_FINISH : Z_NO_FLUSH;
+        myStream.next_out = compressed.data() + compressedUsed;
+        myStream.avail_out = (uInt)(compressed.size() - compressedUsed);
+        ret = deflate(&myStream, flush);
+        if (ret == Z_STREAM_ERROR)
+        {
+            deflateEnd(&myStream);
+            return false;
+        }
+        compressedUsed = compressed.size() - myStream.avail_out;
+        uint64_t toEncode = compressedUsed - (compressedUsed % 3);
+        if (ret == Z_STREAM_END) toEncode = compressedUsed;//last piece gets padding
+        if (toEncode > 0)
+        {
+            uint64_t encodedLength = Base64::encode(compressed.data(), toEncode, encoded.data());
+            stream.write((const char*)encoded.data(), encodedLength);
+            for (uint64_t i = toEncode; i < compressedUsed; ++i) compressed[i - toEncode] = compressed[i];
+            compressedUsed -= toEncode;
+        }
+    }
+    deflateEnd(&myStream);
+    return true;
+}
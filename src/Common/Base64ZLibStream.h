@@ -0,0 +1,46 @@
+#ifndef __BASE64_ZLIB_STREAM_H__
+#define __BASE64_ZLIB_STREAM_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include <ostream>
+#include <stdint.h>
+
+namespace caret {
+
+    ///base64 and base64 of zlib compressed data, converted in one pass with small buffers
+    ///the output of decode and the stream written by encode are the same as using Base64 and DataCompressZLib with full size intermediate buffers
+    class Base64ZLibStream
+    {
+        Base64ZLibStream();
+    public:
+        ///decode base64 text directly into output, inflating it if it is zlib compressed, whitespace in the text is skipped
+        ///decoding stops at the end of the text, padding, an invalid character, or when output is full
+        ///returns number of bytes written to output, for compressed data this is zero if the data is not a complete zlib stream that fits in output
+        static uint64_t decode(const char* text, const uint64_t textLength, const bool zlibCompressed, unsigned char* output, const uint64_t outputLength);
+
+        ///base64 encode the data (compressed with zlib, if requested) and write it to the stream, returns false if compression fails
+        static bool encode(const unsigned char* input, const uint64_t inputLength, const bool zlibCompress, std::ostream& stream);
+    };
+
+} // namespace
+
+#endif // __BASE64_ZLIB_STREAM_H__
@@ -0,0 +1,135 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "BlockedDot.h"
+
+#include "CaretAssert.h"
+
+using namespace caret;
+
+namespace
+{
+    const int TILE = BlockedDot::TILE_ROWS;
+    const int LANES = 8;//independent partial sums per output element, so the compiler can vectorize across columns without reassociating
+    const int SPAN = 256;//columns summed in float before adding into the double result, keeps float error similar to a short dot product
+
+    //one TILE x TILE block of outputs, all partial sums stay in registers (or at worst L1) for the whole row length
+    void tileKernel(const float* const* left, const float* const* right, const int& length, double result[TILE][TILE])
+    {
+        for (int a = 0; a < TILE; ++a)
+        {
+            for (int b = 0; b < TILE; ++b)
+            {
+                result[a][b] = 0.0;
+            }
+        }
+        for (int start = 0; start < length; start += SPAN)
+        {
+            int end = start + SPAN;
+            if (end > length) end = length;
+            int vecEnd = start + ((end - start) / LANES) * LANES;
+            float accum[TILE][TILE][LANES];
+            for (int a = 0; a < TILE; ++a)
+            {
+                for (int b = 0; b < TILE; ++b)
+                {
+                    for (int l = 0; l < LANES; ++l)
+                    {
+                        accum[a][b][l] = 0.0f;
+                    }
+                }
+            }
+            for (int k = start; k < vecEnd; k += LANES)
+            {
+                float leftVals[TILE][LANES], rightVals[TILE][LANES];
+                for (int a = 0; a < TILE; ++a)
+                {
+                    for (int l = 0; l < LANES; ++l)
+                    {
+                        leftVals[a][l] = left[a][k + l];
+                        rightVals[a][l] = right[a][k + l];
+                    }
+                }
+                for (int a = 0; a < TILE; ++a)
+                {
+                    for (int b = 0; b < TILE; ++b)
+                    {
+                        for (int l = 0; l < LANES; ++l)
+                        {
+                            accum[a][b][l] += leftVals[a][l] * rightVals[b][l];
+                        }
+                    }
+                }
+            }
+            for (int a = 0; a < TILE; ++a)
+            {
+                for (int b = 0; b < TILE; ++b)
+                {
+                    double spanSum = 0.0;
+                    for (int l = 0; l < LANES; ++l)
+                    {
+                        spanSum += accum[a][b][l];
+                    }
+                    for (int k = vecEnd; k < end; ++k)
+                    {
+                        spanSum += left[a][k] * right[b][k];
+                    }
+                    result[a][b] += spanSum;
+                }
+            }
+        }
+    }
+}
+
+void BlockedDot::multiplyTransposed(const float* const* leftRows, const int& numLeft, const float* const* rightRows, const int& numRight,
+                                    const int& length, double* out, const int64_t& outStride)
+{
+    CaretAssert(numLeft >= 0 && numRight >= 0 && length >= 0);
+    if (numLeft == 0 || numRight == 0) return;
+    const float* leftTile[TILE], *rightTile[TILE];
+    double result[TILE][TILE];
+    for (int i = 0; i < numLeft; i += TILE)
+    {
+        int leftCount = numLeft - i;
+        if (leftCount > TILE) leftCount = TILE;
+        for (int a = 0; a < TILE; ++a)
+        {//pad partial tiles by repeating the first row, and just don't store those outputs
+            leftTile[a] = leftRows[i + (a < leftCount ? a : 0)];
+        }
+        for (int j = 0; j < numRight; j += TILE)
+        {
+            int rightCount = numRight - j;
+            if (rightCount > TILE) rightCount = TILE;
+            for (int b = 0; b < TILE; ++b)
+            {
+                rightTile[b] = rightRows[j + (b < rightCount ? b : 0)];
+            }
+            tileKernel(leftTile, rightTile, length, result);
+            for (int a = 0; a < leftCount; ++a)
+            {
+                double* outRow = out + (i + a) * outStride + j;
+                for (int b = 0; b < rightCount; ++b)
+                {
+                    outRow[b] = result[a][b];
+                }
+            }
+        }
+    }
+}
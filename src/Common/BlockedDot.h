@@ -0,0 +1,45 @@
+#ifndef __BLOCKED_DOT_H__
+#define __BLOCKED_DOT_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "stdint.h"
+
+namespace caret {
+
+    ///dot products of every row in one set of rows with every row in another, ie, the matrix multiply left * right^T
+    ///rows are given as pointers so that they can come from a row cache rather than a single contiguous matrix
+    class BlockedDot
+    {
+        BlockedDot();//static only
+    public:
+        ///number of rows from each side that the register-blocked kernel handles at once, use multiples of this for block sizes when possible
+        static const int TILE_ROWS = 4;
+
+        ///out[i * outStride + j] = sum(leftRows[i][k] * rightRows[j][k], k = 0..length - 1)
+        ///products are summed in float over short spans of columns, then accumulated in double, for accuracy similar to sddot
+        static void multiplyTransposed(const float* const* leftRows, const int& numLeft, const float* const* rightRows, const int& numRight,
+                                       const int& length, double* out, const int64_t& outStride);
+    };
+
+}
+
+#endif //__BLOCKED_DOT_H__
@@ -28,16 +28,56 @@
 #include "CaretAssert.h"
 #include "CaretBinaryFile.h"
 #include "CaretLogger.h"
+#include "CaretMutex.h"
+#include "CaretOMP.h"
 #include "DataFileException.h"
 
 #include <QFile>
+#include <QFileInfo>
 #include "zlib.h"
 
 #include <algorithm>
+#include <limits>
+#include <vector>
+
+#ifndef CARET_OS_WINDOWS
+#include <cerrno>
+#include <unistd.h>
+#endif
 
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    ///keeps the first error from a parallel loop, to rethrow after the loop, with running out of memory still thrown as bad_alloc
+    class ParallelFailure
+    {
+        bool m_failed, m_outOfMemory;
+        AString m_message;
+    public:
+        ParallelFailure() { m_failed = false; m_outOfMemory = false; }
+        void record(const AString& message, const bool& outOfMemory)
+        {
+#pragma omp critical (CaretBinaryFileFailure)
+            {
+                if (!m_failed)
+                {
+                    m_failed = true;
+                    m_outOfMemory = outOfMemory;
+                    m_message = message;
+                }
+            }
+        }
+        void rethrow() const
+        {
+            if (!m_failed) return;
+            if (m_outOfMemory) throw bad_alloc();
+            throw DataFileException(m_message);
+        }
+    };
+}
+
 //private implementation classes
 namespace caret
 {
@@ -59,13 +99,95 @@ namespace caret
     };
     
     const int64_t ZFileImpl::CHUNK_SIZE = 1<<26;//64MiB, large enough for good performance, small enough for zlib, must convert to uint32
+    
+    //write-only single gzip stream, compressed in parallel like pigz: independent chunks primed with the previous 32KiB as dictionary,
+    //each ended with a sync flush so they can simply be concatenated, then an empty final block and the trailer
+    class ZFileWriteImpl : public CaretBinaryFile::ImplInterface
+    {
+        QFile m_file;
+        std::vector<char> m_buffer;//uncompressed data not yet compressed, preceded by the dictionary for its first chunk
+        int64_t m_dictSize;//bytes at the start of m_buffer that were already written
+        int64_t m_pos;
+        uLong m_crc;
+        const static int64_t CHUNK_SIZE;
+        const static int64_t CHUNKS_PER_BATCH;
+        const static int64_t DICT_SIZE;
+        void compressChunk(const char* dictionary, const int64_t& dictSize, const char* data, const int64_t& count, std::vector<char>& compressedOut) const;
+        void flushChunks(const bool& final);
+        void writeRaw(const void* data, const int64_t& count);
+    public:
+        ZFileWriteImpl() { m_dictSize = 0; m_pos = 0; m_crc = 0; }
+        void open(const QString& filename, const CaretBinaryFile::OpenMode& opmode);
+        void close();
+        void seek(const int64_t& position);
+        int64_t pos() { return m_pos; }
+        int64_t size() { return -1; }
+        void read(void*, const int64_t&, int64_t*) { throw DataFileException("read called on compressed file opened for writing"); }
+        void write(const void* dataIn, const int64_t& count);
+        ~ZFileWriteImpl();
+    };
+    
+    const int64_t ZFileWriteImpl::CHUNK_SIZE = 1<<20;//large enough that restarting the compressor costs little ratio
+    const int64_t ZFileWriteImpl::CHUNKS_PER_BATCH = 32;
+    const int64_t ZFileWriteImpl::DICT_SIZE = 1<<15;//deflate window size
+    
+    //BGZF: a series of gzip members of at most 64KiB each, with the compressed member size in a "BC" extra field
+    //ordinary gzip readers see concatenated members, but with an index of block offsets we can seek by inflating only one block
+    class BgzfFileImpl : public CaretBinaryFile::ImplInterface
+    {
+        QFile m_file;
+        bool m_writing;
+        int64_t m_pos;//uncompressed position
+        //reading - index of non-empty blocks
+        std::vector<int64_t> m_blockCompOffset, m_blockUncompOffset;//m_blockUncompOffset has an extra element at the end, the total uncompressed size
+        std::vector<int32_t> m_blockCompSize;
+        std::vector<char> m_cacheData;//most recently inflated block, so small sequential reads don't inflate it repeatedly
+        int64_t m_cacheBlock;
+#ifdef CARET_OS_WINDOWS
+        CaretMutex m_readMutex;//no pread(), so compressed reads use seek+read under a lock
+#endif
+        //writing
+        std::vector<char> m_writeBuffer;
+        std::vector<std::pair<uint64_t, uint64_t> > m_writtenIndex;//compressed and uncompressed offsets of blocks after the first, for the .gzi file
+        int64_t m_compWritten;
+        const static int64_t MAX_BLOCK_DATA;
+        const static int64_t BLOCKS_PER_BATCH;
+        void readCompressed(const int64_t& offset, void* dataOut, const int64_t& count);//positional, thread-safe
+        void readBlockHeader(const int64_t& offset, int64_t& compSizeOut, int64_t& uncompSizeOut);
+        void buildIndex();
+        bool readIndexFile();
+        void writeIndexFile();
+        int64_t findBlock(const int64_t& position) const;
+        void inflateBlock(const int64_t& block, const char* compressed, char* dataOut) const;
+        void deflateBlock(const char* data, const int64_t& count, std::vector<char>& blockOut) const;
+        void flushBlocks(const bool& final);
+    public:
+        BgzfFileImpl() { m_writing = false; m_pos = 0; m_cacheBlock = -1; m_compWritten = 0; }
+        static bool isBlockCompressed(const QString& filename);
+        void open(const QString& filename, const CaretBinaryFile::OpenMode& opmode);
+        void close();
+        void seek(const int64_t& position);
+        int64_t pos() { return m_pos; }
+        int64_t size();
+        void read(void* dataOut, const int64_t& count, int64_t* numRead);
+        void write(const void* dataIn, const int64_t& count);
+        bool supportsReadAt() { return !m_writing && m_file.isOpen(); }
+        void readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead);
+        ~BgzfFileImpl();
+    };
+    
+    const int64_t BgzfFileImpl::MAX_BLOCK_DATA = 0xff00;//same as htslib, leaves room for incompressible data to fit in a 64KiB member
+    const int64_t BgzfFileImpl::BLOCKS_PER_BATCH = 256;//16MiB uncompressed, bounds the temporary memory of large reads and writes
 #endif //ZLIB_VERSION
 
     class QFileImpl : public CaretBinaryFile::ImplInterface
     {
         QFile m_file;
+        bool m_readOnly;//positional reads bypass QFile's buffering, so only allow them when there can't be unflushed writes
+        uchar* m_mapped;
         const static int64_t CHUNK_SIZE;
     public:
+        QFileImpl() { m_readOnly = false; m_mapped = NULL; }
         void open(const QString& filename, const CaretBinaryFile::OpenMode& opmode);
         void close();
         void seek(const int64_t& position);
@@ -73,15 +195,35 @@ namespace caret
         int64_t size() { return m_file.size(); }
         void read(void* dataOut, const int64_t& count, int64_t* numRead);
         void write(const void* dataIn, const int64_t& count);
+        bool supportsReadAt();
+        void readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead);
+        const char* mapReadOnly();
     };
     
     const int64_t QFileImpl::CHUNK_SIZE = 1<<30;//1GiB, QT4 apparently chokes at more than 2GiB via buffer.read using int32
 }
 
+bool CaretBinaryFile::s_writeBlockCompressed = false;
+
+void CaretBinaryFile::setWriteBlockCompressed(const bool& enabled)
+{
+    s_writeBlockCompressed = enabled;
+}
+
+bool CaretBinaryFile::getWriteBlockCompressed()
+{
+    return s_writeBlockCompressed;
+}
+
 CaretBinaryFile::ImplInterface::~ImplInterface()
 {
 }
 
+void CaretBinaryFile::ImplInterface::readAt(const int64_t&, void*, const int64_t&, int64_t*)
+{
+    throw DataFileException("positional read is not supported for file '" + m_fileName + "'");
+}
+
 CaretBinaryFile::CaretBinaryFile(const QString& filename, const OpenMode& fileMode)
 {
     open(filename, fileMode);
@@ -118,7 +260,24 @@ void CaretBinaryFile::open(const QString& filename, const OpenMode& opmode)
     if (filename.endsWith(".gz"))
     {
 #ifdef ZLIB_VERSION
-        m_impl.grabNew(new ZFileImpl());
+        bool useBlocks = false;
+        if (opmode & WRITE)
+        {
+            useBlocks = s_writeBlockCompressed && (opmode & TRUNCATE);
+        } else {
+            useBlocks = BgzfFileImpl::isBlockCompressed(filename);//reading doesn't need the setting, the file says what it is
+        }
+        if (useBlocks)
+        {
+            m_impl.grabNew(new BgzfFileImpl());
+        } else {
+            if (opmode & WRITE)
+            {
+                m_impl.grabNew(new ZFileWriteImpl());
+            } else {
+                m_impl.grabNew(new ZFileImpl());
+            }
+        }
 #else //ZLIB_VERSION
         throw DataFileException("can't open .gz file '" + filename + "', compiled without zlib support");
 #endif //ZLIB_VERSION
@@ -136,6 +295,26 @@ void CaretBinaryFile::read(void* dataOut, const int64_t& count, int64_t* numRead
     m_impl->read(dataOut, count, numRead);
 }
 
+bool CaretBinaryFile::getSupportsReadAt()
+{
+    if (m_curMode == NONE) return false;
+    return m_impl->supportsReadAt();
+}
+
+void CaretBinaryFile::readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead)
+{
+    CaretAssert(position >= 0);
+    CaretAssert(count >= 0);
+    if (m_curMode == NONE) throw DataFileException("file is not open, can't read");
+    m_impl->readAt(position, dataOut, count, numRead);
+}
+
+const char* CaretBinaryFile::mapReadOnly()
+{
+    if (m_curMode == NONE) throw DataFileException("file is not open, can't map");
+    return m_impl->mapReadOnly();
+}
+
 void CaretBinaryFile::seek(const int64_t& position)
 {
     CaretAssert(position >= 0);
@@ -197,6 +376,9 @@ void ZFileImpl::open(const QString& filename, const CaretBinaryFile::OpenMode& o
         }//TODO: check gzerror and errno for more informative error messages
         throw DataFileException("failed to open compressed file '" + filename + "'");
     }
+#if ZLIB_VERNUM >= 0x1240
+    gzbuffer(m_zfile, 1<<18);//default 8KiB input buffer means many small reads of the compressed file
+#endif
 }
 
 void ZFileImpl::close()
@@ -279,12 +461,700 @@ ZFileImpl::~ZFileImpl()
         CaretLogSevere("caught unknown exception type while closing a compressed file");
     }
 }
+
+void ZFileWriteImpl::open(const QString& filename, const CaretBinaryFile::OpenMode& opmode)
+{
+    close();
+    m_fileName = filename;
+    if (opmode != CaretBinaryFile::WRITE_TRUNCATE) throw DataFileException("compressed file only supports READ and WRITE_TRUNCATE modes");
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        throw DataFileException("failed to open compressed file '" + filename + "', unable to create file");
+    }
+    m_buffer.clear();
+    m_dictSize = 0;
+    m_pos = 0;
+    m_crc = crc32(0L, Z_NULL, 0);
+    const unsigned char header[10] = { 31, 139, 8, 0, 0, 0, 0, 0, 0, 255 };//no name or mtime, unknown OS
+    writeRaw(header, 10);
+}
+
+void ZFileWriteImpl::writeRaw(const void* data, const int64_t& count)
+{
+    if (m_file.write((const char*)data, count) != count) throw DataFileException("failed to write to compressed file '" + m_fileName + "'");
+}
+
+void ZFileWriteImpl::compressChunk(const char* dictionary, const int64_t& dictSize, const char* data, const int64_t& count, std::vector<char>& compressedOut) const
+{
+    z_stream myStream;
+    myStream.zalloc = Z_NULL;
+    myStream.zfree = Z_NULL;
+    myStream.opaque = Z_NULL;
+    if (deflateInit2(&myStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw DataFileException("failed to initialize zlib");
+    if (dictSize > 0 && deflateSetDictionary(&myStream, (const Bytef*)dictionary, (uInt)dictSize) != Z_OK)
+    {
+        deflateEnd(&myStream);
+        throw DataFileException("failed to initialize zlib");
+    }
+    compressedOut.resize(deflateBound(&myStream, count) + 16);//sync flush marker isn't in the bound
+    myStream.next_in = (Bytef*)data;
+    myStream.avail_in = (uInt)count;
+    myStream.next_out = (Bytef*)compressedOut.data();
+    myStream.avail_out = (uInt)compressedOut.size();
+    int ret = deflate(&myStream, Z_SYNC_FLUSH);//ends on a byte boundary without marking the last block
+    int64_t outSize = compressedOut.size() - myStream.avail_out;
+    deflateEnd(&myStream);
+    if (ret != Z_OK || myStream.avail_in != 0 || myStream.avail_out == 0)//avail_out == 0 could mean an incomplete flush
+    {
+        throw DataFileException("failed to compress data for file '" + m_fileName + "'");
+    }
+    compressedOut.resize(outSize);
+}
+
+void ZFileWriteImpl::flushChunks(const bool& final)
+{
+    int64_t dataSize = (int64_t)m_buffer.size() - m_dictSize;
+    int64_t numChunks = dataSize / CHUNK_SIZE;
+    if (final && dataSize % CHUNK_SIZE != 0) ++numChunks;
+    if (numChunks == 0) return;
+    std::vector<std::vector<char> > compressed(numChunks);
+    std::vector<uLong> chunkCrc(numChunks);
+    ParallelFailure myFailure;
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int64_t i = 0; i < numChunks; ++i)
+    {
+        try
+        {
+            const char* chunkStart = m_buffer.data() + m_dictSize + i * CHUNK_SIZE;
+            int64_t chunkSize = min(CHUNK_SIZE, dataSize - i * CHUNK_SIZE);
+            int64_t dictSize = min(DICT_SIZE, (int64_t)(chunkStart - m_buffer.data()));
+            compressChunk(chunkStart - dictSize, dictSize, chunkStart, chunkSize, compressed[i]);
+            chunkCrc[i] = crc32(crc32(0L, Z_NULL, 0), (const Bytef*)chunkStart, (uInt)chunkSize);
+        } catch (CaretException& e) {
+            myFailure.record(e.whatString(), false);
+        } catch (bad_alloc&) {
+            myFailure.record("", true);
+        } catch (exception& e) {
+            myFailure.record(e.what(), false);
+        }
+    }
+    myFailure.rethrow();
+    for (int64_t i = 0; i < numChunks; ++i)
+    {
+        writeRaw(compressed[i].data(), compressed[i].size());
+        m_crc = crc32_combine(m_crc, chunkCrc[i], (z_off_t)min(CHUNK_SIZE, dataSize - i * CHUNK_SIZE));
+    }
+    int64_t consumed = min(dataSize, numChunks * CHUNK_SIZE);
+    int64_t keep = min(DICT_SIZE, m_dictSize + consumed);//the tail of what was written is the dictionary for the next chunk
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + (m_dictSize + consumed - keep));
+    m_dictSize = keep;
+}
+
+void ZFileWriteImpl::write(const void* dataIn, const int64_t& count)
+{
+    if (!m_file.isOpen()) throw DataFileException("write called on unopened compressed file");//shouldn't happen
+    const char* charData = (const char*)dataIn;
+    int64_t done = 0;
+    while (done < count)
+    {
+        int64_t toAdd = min(count - done, m_dictSize + CHUNKS_PER_BATCH * CHUNK_SIZE - (int64_t)m_buffer.size());
+        m_buffer.insert(m_buffer.end(), charData + done, charData + done + toAdd);
+        done += toAdd;
+        m_pos += toAdd;
+        if ((int64_t)m_buffer.size() - m_dictSize >= CHUNKS_PER_BATCH * CHUNK_SIZE) flushChunks(false);
+    }
+}
+
+void ZFileWriteImpl::seek(const int64_t& position)
+{
+    if (position < m_pos) throw DataFileException("can't seek backwards while writing compressed file '" + m_fileName + "'");
+    if (position > m_pos)
+    {//same as gzseek, fill the gap with zeros
+        std::vector<char> zeros(min(position - m_pos, CHUNK_SIZE), 0);
+        while (m_pos < position)
+        {
+            write(zeros.data(), min(position - m_pos, (int64_t)zeros.size()));
+        }
+    }
+}
+
+void ZFileWriteImpl::close()
+{
+    if (!m_file.isOpen()) return;
+    try
+    {
+        flushChunks(true);
+        unsigned char trailer[10] = { 3, 0 };//empty final block with fixed codes, byte aligned since every chunk ended in a sync flush
+        uint32_t crcVal = (uint32_t)m_crc, sizeVal = (uint32_t)(m_pos & 0xffffffff);
+        for (int i = 0; i < 4; ++i)
+        {
+            trailer[2 + i] = (unsigned char)((crcVal >> (8 * i)) & 0xff);
+            trailer[6 + i] = (unsigned char)((sizeVal >> (8 * i)) & 0xff);
+        }
+        writeRaw(trailer, 10);
+    } catch (...) {
+        m_file.close();
+        m_buffer.clear();
+        throw;
+    }
+    m_file.close();
+    m_buffer.clear();
+    m_dictSize = 0;
+}
+
+ZFileWriteImpl::~ZFileWriteImpl()
+{
+    try//throwing from a destructor is a bad idea
+    {
+        close();
+    } catch (CaretException& e) {
+        CaretLogSevere(e.whatString());
+    } catch (exception& e) {
+        CaretLogSevere(e.what());
+    } catch (...) {
+        CaretLogSevere("caught unknown exception type while closing a compressed file");
+    }
+}
+
+namespace
+{
+    void putLE16(unsigned char* out, const uint32_t& val)
+    {
+        out[0] = (unsigned char)(val & 0xff);
+        out[1] = (unsigned char)((val >> 8) & 0xff);
+    }
+    
+    void putLE32(unsigned char* out, const uint32_t& val)
+    {
+        putLE16(out, val & 0xffff);
+        putLE16(out + 2, val >> 16);
+    }
+    
+    void putLE64(unsigned char* out, const uint64_t& val)
+    {
+        putLE32(out, (uint32_t)(val & 0xffffffff));
+        putLE32(out + 4, (uint32_t)(val >> 32));
+    }
+    
+    uint32_t getLE16(const unsigned char* in)
+    {
+        return (uint32_t)in[0] | ((uint32_t)in[1] << 8);
+    }
+    
+    uint32_t getLE32(const unsigned char* in)
+    {
+        return getLE16(in) | (getLE16(in + 2) << 16);
+    }
+    
+    uint64_t getLE64(const unsigned char* in)
+    {
+        return (uint64_t)getLE32(in) | ((uint64_t)getLE32(in + 4) << 32);
+    }
+    
+    const int BGZF_HEADER_SIZE = 18;//with only the BC extra field, which is what we write
+    const int BGZF_FOOTER_SIZE = 8;//crc32 and uncompressed size
+    
+    //finds the BC subfield, returns the total compressed member size, or -1 if this isn't a BGZF member
+    int64_t parseBgzfHeader(const unsigned char* header, const int64_t& available, int64_t& dataStartOut)
+    {
+        if (available < 12) return -1;
+        if (header[0] != 31 || header[1] != 139 || header[2] != 8 || (header[3] & 4) == 0) return -1;//gzip magic, deflate, FEXTRA
+        int64_t xlen = getLE16(header + 10);
+        if (12 + xlen > available) return -1;
+        int64_t subPos = 12;
+        while (subPos + 4 <= 12 + xlen)
+        {
+            int64_t subLen = getLE16(header + subPos + 2);
+            if (header[subPos] == 66 && header[subPos + 1] == 67 && subLen == 2)//'B', 'C'
+            {
+                dataStartOut = 12 + xlen;
+                return (int64_t)getLE16(header + subPos + 4) + 1;
+            }
+            subPos += 4 + subLen;
+        }
+        return -1;
+    }
+    
+    //the standard empty BGZF member that marks a complete file
+    const unsigned char BGZF_EOF_BLOCK[28] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+}
+
+bool BgzfFileImpl::isBlockCompressed(const QString& filename)
+{
+    QFile testFile(filename);
+    if (!testFile.open(QIODevice::ReadOnly)) return false;//let the real open generate the error
+    unsigned char header[BGZF_HEADER_SIZE];
+    int64_t numRead = testFile.read((char*)header, BGZF_HEADER_SIZE);
+    int64_t dataStart;
+    return parseBgzfHeader(header, numRead, dataStart) > 0;
+}
+
+void BgzfFileImpl::open(const QString& filename, const CaretBinaryFile::OpenMode& opmode)
+{
+    close();
+    m_fileName = filename;
+    m_pos = 0;
+    m_cacheBlock = -1;
+    switch (opmode)
+    {
+        case CaretBinaryFile::READ:
+            m_writing = false;
+            break;
+        case CaretBinaryFile::WRITE_TRUNCATE:
+            m_writing = true;
+            break;
+        default:
+            throw DataFileException("compressed file only supports READ and WRITE_TRUNCATE modes");
+    }
+    QIODevice::OpenMode mode = (m_writing ? QIODevice::WriteOnly | QIODevice::Truncate : QIODevice::ReadOnly | QIODevice::Unbuffered);//index building does many tiny reads at scattered offsets
+    m_file.setFileName(filename);
+    if (!m_file.open(mode))
+    {
+        if (!m_writing)
+        {
+            throw DataFileException("failed to open compressed file '" + filename + "', file does not exist, or folder permissions prevent seeing it");
+        } else {
+            throw DataFileException("failed to open compressed file '" + filename + "', unable to create file");
+        }
+    }
+    if (m_writing)
+    {
+        m_compWritten = 0;
+        m_writtenIndex.clear();
+        m_writeBuffer.clear();
+    } else {
+        if (!readIndexFile())
+        {
+            buildIndex();
+        }
+    }
+}
+
+void BgzfFileImpl::close()
+{
+    if (!m_file.isOpen()) return;
+    if (m_writing)
+    {
+        flushBlocks(true);
+        if (m_file.write((const char*)BGZF_EOF_BLOCK, sizeof(BGZF_EOF_BLOCK)) != (int64_t)sizeof(BGZF_EOF_BLOCK))
+        {
+            m_file.close();
+            throw DataFileException("failed to write to compressed file '" + m_fileName + "'");
+        }
+        m_file.close();
+        writeIndexFile();
+    } else {
+        m_file.close();
+    }
+    m_blockCompOffset.clear();
+    m_blockCompSize.clear();
+    m_blockUncompOffset.clear();
+    m_cacheData.clear();
+    m_cacheBlock = -1;
+}
+
+void BgzfFileImpl::readCompressed(const int64_t& offset, void* dataOut, const int64_t& count)
+{
+#ifdef CARET_OS_WINDOWS
+    CaretMutexLocker locked(&m_readMutex);
+    if (!m_file.seek(offset) || m_file.read((char*)dataOut, count) != count)
+    {
+        throw DataFileException("error while reading compressed file '" + m_fileName + "'");
+    }
+#else
+    int fd = m_file.handle();
+    int64_t total = 0;
+    while (total < count)
+    {
+        int64_t readret = pread(fd, ((char*)dataOut) + total, count - total, offset + total);
+        if (readret < 0 && errno == EINTR) continue;
+        if (readret < 1) throw DataFileException("error while reading compressed file '" + m_fileName + "'");
+        total += readret;
+    }
+#endif
+}
+
+void BgzfFileImpl::readBlockHeader(const int64_t& offset, int64_t& compSizeOut, int64_t& uncompSizeOut)
+{
+    unsigned char header[BGZF_HEADER_SIZE];
+    readCompressed(offset, header, BGZF_HEADER_SIZE);
+    int64_t dataStart;
+    compSizeOut = parseBgzfHeader(header, BGZF_HEADER_SIZE, dataStart);//our files always have exactly the BC subfield, others usually do
+    if (compSizeOut < 0)
+    {//other extra subfields, read the whole extra field
+        unsigned char fullHeader[12 + 65535];
+        readCompressed(offset, fullHeader, 12);
+        int64_t xlen = getLE16(fullHeader + 10);
+        readCompressed(offset + 12, fullHeader + 12, xlen);
+        compSizeOut = parseBgzfHeader(fullHeader, 12 + xlen, dataStart);
+        if (compSizeOut < 0) throw DataFileException("compressed file '" + m_fileName + "' contains a member that is not block compressed");
+    }
+    unsigned char footer[4];
+    readCompressed(offset + compSizeOut - 4, footer, 4);
+    uncompSizeOut = getLE32(footer);
+}
+
+void BgzfFileImpl::buildIndex()
+{
+    m_blockCompOffset.clear();
+    m_blockCompSize.clear();
+    m_blockUncompOffset.clear();
+    int64_t fileSize = m_file.size(), offset = 0, uncompOffset = 0;
+    while (offset < fileSize)
+    {
+        int64_t compSize, uncompSize;
+        readBlockHeader(offset, compSize, uncompSize);
+        if (offset + compSize > fileSize) throw DataFileException("compressed file '" + m_fileName + "' is truncated");
+        if (uncompSize > 0)//skip empty blocks, including the EOF marker
+        {
+            m_blockCompOffset.push_back(offset);
+            m_blockCompSize.push_back((int32_t)compSize);
+            m_blockUncompOffset.push_back(uncompOffset);
+            uncompOffset += uncompSize;
+        }
+        offset += compSize;
+    }
+    m_blockUncompOffset.push_back(uncompOffset);
+}
+
+bool BgzfFileImpl::readIndexFile()
+{//same layout as htslib's .gzi: count, then (compressed, uncompressed) offset pairs for every block after the first, all little endian uint64
+    QString indexName = m_fileName + ".gzi";
+    QFileInfo indexInfo(indexName), dataInfo(m_fileName);
+    if (!indexInfo.exists() || indexInfo.lastModified() < dataInfo.lastModified()) return false;//stale index would be worse than none
+    QFile indexFile(indexName);
+    if (!indexFile.open(QIODevice::ReadOnly)) return false;
+    QByteArray indexBytes = indexFile.readAll();
+    if (indexBytes.size() < 8) return false;
+    const unsigned char* indexData = (const unsigned char*)indexBytes.constData();
+    uint64_t numEntries = getLE64(indexData);
+    if ((uint64_t)indexBytes.size() != 8 + 16 * numEntries) return false;
+    std::vector<std::pair<int64_t, int64_t> > starts(1, std::pair<int64_t, int64_t>(0, 0));
+    for (uint64_t i = 0; i < numEntries; ++i)
+    {
+        starts.push_back(std::pair<int64_t, int64_t>((int64_t)getLE64(indexData + 8 + 16 * i), (int64_t)getLE64(indexData + 16 + 16 * i)));
+    }
+    try
+    {
+        m_blockCompOffset.clear();
+        m_blockCompSize.clear();
+        m_blockUncompOffset.clear();
+        int64_t fileSize = m_file.size(), totalSize = 0;
+        for (size_t i = 0; i < starts.size(); ++i)
+        {
+            int64_t compSize, uncompSize;
+            if (i + 1 < starts.size())
+            {
+                compSize = starts[i + 1].first - starts[i].first;
+                uncompSize = starts[i + 1].second - starts[i].second;
+            } else {
+                readBlockHeader(starts[i].first, compSize, uncompSize);//last block, also serves as a sanity check
+                totalSize = starts[i].second + uncompSize;
+                int64_t lastEnd = starts[i].first + compSize;
+                if (lastEnd != fileSize && lastEnd + (int64_t)sizeof(BGZF_EOF_BLOCK) != fileSize)
+                {
+                    CaretLogFine("ignoring index file '" + indexName + "', it doesn't match the length of the compressed file");
+                    return false;//modification times only have limited resolution, so an index for other data can look current
+                }
+            }
+            if (compSize <= 0 || compSize > 65536 || uncompSize < 0 || starts[i].first + compSize > fileSize) return false;
+            if (uncompSize > 0)
+            {
+                m_blockCompOffset.push_back(starts[i].first);
+                m_blockCompSize.push_back((int32_t)compSize);
+                m_blockUncompOffset.push_back(starts[i].second);
+            }
+        }
+        m_blockUncompOffset.push_back(totalSize);
+    } catch (DataFileException& e) {
+        CaretLogFine("ignoring bad index file '" + indexName + "': " + e.whatString());
+        return false;
+    }
+    return true;
+}
+
+void BgzfFileImpl::writeIndexFile()
+{
+    QFile indexFile(m_fileName + ".gzi");
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        CaretLogWarning("unable to write block index file '" + m_fileName + ".gzi', seeking in the compressed file will be slower to set up");
+        return;
+    }
+    std::vector<unsigned char> indexBytes(8 + 16 * m_writtenIndex.size());
+    putLE64(indexBytes.data(), m_writtenIndex.size());
+    for (size_t i = 0; i < m_writtenIndex.size(); ++i)
+    {
+        putLE64(indexBytes.data() + 8 + 16 * i, m_writtenIndex[i].first);
+        putLE64(indexBytes.data() + 16 + 16 * i, m_writtenIndex[i].second);
+    }
+    if (indexFile.write((const char*)indexBytes.data(), indexBytes.size()) != (int64_t)indexBytes.size())
+    {
+        CaretLogWarning("failed to write block index file '" + m_fileName + ".gzi'");
+    }
+}
+
+int64_t BgzfFileImpl::findBlock(const int64_t& position) const
+{//last block that starts at or before position
+    CaretAssert(!m_blockCompOffset.empty());
+    std::vector<int64_t>::const_iterator iter = upper_bound(m_blockUncompOffset.begin(), m_blockUncompOffset.end() - 1, position);
+    return (iter - m_blockUncompOffset.begin()) - 1;
+}
+
+void BgzfFileImpl::inflateBlock(const int64_t& block, const char* compressed, char* dataOut) const
+{
+    int64_t compSize = m_blockCompSize[block];
+    int64_t uncompSize = m_blockUncompOffset[block + 1] - m_blockUncompOffset[block];
+    int64_t dataStart;
+    if (parseBgzfHeader((const unsigned char*)compressed, compSize, dataStart) != compSize)
+    {
+        throw DataFileException("corrupted block in compressed file '" + m_fileName + "'");
+    }
+    z_stream myStream;
+    myStream.zalloc = Z_NULL;
+    myStream.zfree = Z_NULL;
+    myStream.opaque = Z_NULL;
+    myStream.next_in = (Bytef*)(compressed + dataStart);
+    myStream.avail_in = (uInt)(compSize - dataStart - BGZF_FOOTER_SIZE);
+    if (inflateInit2(&myStream, -15) != Z_OK) throw DataFileException("failed to initialize zlib");//raw deflate data, we parsed the gzip wrapper ourselves
+    myStream.next_out = (Bytef*)dataOut;
+    myStream.avail_out = (uInt)uncompSize;
+    int ret = inflate(&myStream, Z_FINISH);
+    inflateEnd(&myStream);
+    const unsigned char* footer = (const unsigned char*)(compressed + compSize - BGZF_FOOTER_SIZE);
+    if (ret != Z_STREAM_END || myStream.avail_out != 0 || crc32(crc32(0L, Z_NULL, 0), (const Bytef*)dataOut, (uInt)uncompSize) != getLE32(footer))
+    {
+        throw DataFileException("corrupted block in compressed file '" + m_fileName + "'");
+    }
+}
+
+int64_t BgzfFileImpl::size()
+{
+    if (m_writing) return -1;
+    return m_blockUncompOffset.back();
+}
+
+void BgzfFileImpl::readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead)
+{
+    if (m_writing) throw DataFileException("positional read is not supported for file '" + m_fileName + "'");
+    int64_t totalSize = m_blockUncompOffset.back();
+    int64_t end = min(position + count, totalSize);
+    int64_t total = 0;
+    if (end > position)
+    {
+        int64_t firstBlock = findBlock(position), lastBlock = findBlock(end - 1);
+        std::vector<char> compressed;
+        for (int64_t batchStart = firstBlock; batchStart <= lastBlock; batchStart += BLOCKS_PER_BATCH)
+        {
+            int64_t batchEnd = min(batchStart + BLOCKS_PER_BATCH, lastBlock + 1);
+            int64_t compStart = m_blockCompOffset[batchStart];
+            compressed.resize(m_blockCompOffset[batchEnd - 1] + m_blockCompSize[batchEnd - 1] - compStart);
+            readCompressed(compStart, compressed.data(), compressed.size());//one read for the whole batch, then blocks inflate independently
+            ParallelFailure myFailure;
+#pragma omp CARET_PARFOR schedule(dynamic) if (batchEnd - batchStart > 1)
+            for (int64_t block = batchStart; block < batchEnd; ++block)
+            {
+                try
+                {
+                    int64_t blockStart = m_blockUncompOffset[block], blockEnd = m_blockUncompOffset[block + 1];
+                    const char* blockComp = compressed.data() + (m_blockCompOffset[block] - compStart);
+                    if (blockStart >= position && blockEnd <= end)
+                    {//whole block wanted, inflate straight into the output
+                        inflateBlock(block, blockComp, ((char*)dataOut) + (blockStart - position));
+                    } else {
+                        std::vector<char> blockData(blockEnd - blockStart);
+                        inflateBlock(block, blockComp, blockData.data());
+                        int64_t copyStart = max(blockStart, position), copyEnd = min(blockEnd, end);
+                        std::copy(blockData.begin() + (copyStart - blockStart), blockData.begin() + (copyEnd - blockStart), ((char*)dataOut) + (copyStart - position));
+                    }
+                } catch (CaretException& e) {
+                    myFailure.record(e.whatString(), false);
+                } catch (bad_alloc&) {
+                    myFailure.record("", true);
+                } catch (exception& e) {
+                    myFailure.record(e.what(), false);
+                }
+            }
+            myFailure.rethrow();
+        }
+        total = end - position;
+    }
+    if (numRead == NULL)
+    {
+        if (total != count) throw DataFileException("premature end of file in compressed file '" + m_fileName + "'");
+    } else {
+        *numRead = total;
+    }
+}
+
+void BgzfFileImpl::read(void* dataOut, const int64_t& count, int64_t* numRead)
+{
+    if (m_writing) throw DataFileException("read called on compressed file opened for writing");
+    int64_t totalSize = m_blockUncompOffset.back();
+    int64_t end = min(m_pos + count, totalSize);
+    if (end > m_pos && findBlock(m_pos) == findBlock(end - 1))
+    {//within one block, go through the cache so that many small reads don't each inflate it
+        int64_t block = findBlock(m_pos);
+        if (m_cacheBlock != block)
+        {
+            m_cacheBlock = -1;//in case of exception
+            m_cacheData.resize(m_blockUncompOffset[block + 1] - m_blockUncompOffset[block]);
+            std::vector<char> compressed(m_blockCompSize[block]);
+            readCompressed(m_blockCompOffset[block], compressed.data(), compressed.size());
+            inflateBlock(block, compressed.data(), m_cacheData.data());
+            m_cacheBlock = block;
+        }
+        std::copy(m_cacheData.begin() + (m_pos - m_blockUncompOffset[block]), m_cacheData.begin() + (end - m_blockUncompOffset[block]), (char*)dataOut);
+        int64_t total = end - m_pos;
+        m_pos = end;
+        if (numRead == NULL)
+        {
+            if (total != count) throw DataFileException("premature end of file in compressed file '" + m_fileName + "'");
+        } else {
+            *numRead = total;
+        }
+        return;
+    }
+    int64_t total = 0;
+    readAt(m_pos, dataOut, count, &total);
+    m_pos += total;
+    if (numRead == NULL)
+    {
+        if (total != count) throw DataFileException("premature end of file in compressed file '" + m_fileName + "'");
+    } else {
+        *numRead = total;
+    }
+}
+
+void BgzfFileImpl::seek(const int64_t& position)
+{
+    if (m_writing)
+    {
+        if (position < m_pos) throw DataFileException("can't seek backwards while writing compressed file '" + m_fileName + "'");
+        if (position > m_pos)
+        {//same as gzseek, fill the gap with zeros
+            std::vector<char> zeros(min(position - m_pos, MAX_BLOCK_DATA), 0);
+            while (m_pos < position)
+            {
+                write(zeros.data(), min(position - m_pos, (int64_t)zeros.size()));
+            }
+        }
+        return;
+    }
+    m_pos = position;//reads past the end will fail or return short, like other implementations
+}
+
+void BgzfFileImpl::deflateBlock(const char* data, const int64_t& count, std::vector<char>& blockOut) const
+{
+    CaretAssert(count <= MAX_BLOCK_DATA);
+    int level = Z_DEFAULT_COMPRESSION;
+    while (true)
+    {
+        blockOut.resize(65536);
+        z_stream myStream;
+        myStream.zalloc = Z_NULL;
+        myStream.zfree = Z_NULL;
+        myStream.opaque = Z_NULL;
+        if (deflateInit2(&myStream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw DataFileException("failed to initialize zlib");
+        myStream.next_in = (Bytef*)data;
+        myStream.avail_in = (uInt)count;
+        myStream.next_out = (Bytef*)(blockOut.data() + BGZF_HEADER_SIZE);
+        myStream.avail_out = (uInt)(blockOut.size() - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE);
+        int ret = deflate(&myStream, Z_FINISH);
+        int64_t compDataSize = blockOut.size() - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE - myStream.avail_out;
+        deflateEnd(&myStream);
+        if (ret != Z_STREAM_END)
+        {
+            if (level == Z_NO_COMPRESSION) throw DataFileException("failed to compress block for file '" + m_fileName + "'");
+            level = Z_NO_COMPRESSION;//incompressible data that expanded past the block limit, store it instead
+            continue;
+        }
+        int64_t blockSize = BGZF_HEADER_SIZE + compDataSize + BGZF_FOOTER_SIZE;
+        unsigned char* header = (unsigned char*)blockOut.data();
+        const unsigned char templateHeader[BGZF_HEADER_SIZE] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0, 0, 0 };
+        std::copy(templateHeader, templateHeader + BGZF_HEADER_SIZE, header);
+        putLE16(header + 16, (uint32_t)(blockSize - 1));
+        unsigned char* footer = header + BGZF_HEADER_SIZE + compDataSize;
+        putLE32(footer, (uint32_t)crc32(crc32(0L, Z_NULL, 0), (const Bytef*)data, (uInt)count));
+        putLE32(footer + 4, (uint32_t)count);
+        blockOut.resize(blockSize);
+        return;
+    }
+}
+
+void BgzfFileImpl::flushBlocks(const bool& final)
+{
+    int64_t numBlocks = (int64_t)m_writeBuffer.size() / MAX_BLOCK_DATA;
+    if (final && (int64_t)m_writeBuffer.size() % MAX_BLOCK_DATA != 0) ++numBlocks;
+    if (numBlocks == 0) return;
+    std::vector<std::vector<char> > compressedBlocks(numBlocks);
+    ParallelFailure myFailure;
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int64_t i = 0; i < numBlocks; ++i)
+    {
+        try
+        {
+            int64_t blockStart = i * MAX_BLOCK_DATA;
+            deflateBlock(m_writeBuffer.data() + blockStart, min(MAX_BLOCK_DATA, (int64_t)m_writeBuffer.size() - blockStart), compressedBlocks[i]);
+        } catch (CaretException& e) {
+            myFailure.record(e.whatString(), false);
+        } catch (bad_alloc&) {
+            myFailure.record("", true);
+        } catch (exception& e) {
+            myFailure.record(e.what(), false);
+        }
+    }
+    myFailure.rethrow();
+    int64_t uncompOffset = m_pos - (int64_t)m_writeBuffer.size();
+    for (int64_t i = 0; i < numBlocks; ++i)
+    {
+        if (m_compWritten != 0)//.gzi doesn't list the first block
+        {
+            m_writtenIndex.push_back(std::pair<uint64_t, uint64_t>(m_compWritten, uncompOffset + i * MAX_BLOCK_DATA));
+        }
+        int64_t blockSize = (int64_t)compressedBlocks[i].size();
+        if (m_file.write(compressedBlocks[i].data(), blockSize) != blockSize) throw DataFileException("failed to write to compressed file '" + m_fileName + "'");
+        m_compWritten += blockSize;
+    }
+    m_writeBuffer.erase(m_writeBuffer.begin(), m_writeBuffer.begin() + min((int64_t)m_writeBuffer.size(), numBlocks * MAX_BLOCK_DATA));
+}
+
+void BgzfFileImpl::write(const void* dataIn, const int64_t& count)
+{
+    if (!m_writing) throw DataFileException("write called on compressed file opened for reading");
+    const char* charData = (const char*)dataIn;
+    int64_t done = 0;
+    while (done < count)
+    {
+        int64_t toAdd = min(count - done, BLOCKS_PER_BATCH * MAX_BLOCK_DATA - (int64_t)m_writeBuffer.size());
+        m_writeBuffer.insert(m_writeBuffer.end(), charData + done, charData + done + toAdd);
+        done += toAdd;
+        m_pos += toAdd;
+        if ((int64_t)m_writeBuffer.size() >= BLOCKS_PER_BATCH * MAX_BLOCK_DATA) flushBlocks(false);
+    }
+}
+
+BgzfFileImpl::~BgzfFileImpl()
+{
+    try//throwing from a destructor is a bad idea
+    {
+        close();
+    } catch (CaretException& e) {
+        CaretLogSevere(e.whatString());
+    } catch (exception& e) {
+        CaretLogSevere(e.what());
+    } catch (...) {
+        CaretLogSevere("caught unknown exception type while closing a compressed file");
+    }
+}
 #endif //ZLIB_VERSION
 
 void QFileImpl::open(const QString& filename, const CaretBinaryFile::OpenMode& opmode)
 {
     close();//don't need to, but just because
     m_fileName = filename;
+    m_readOnly = !(opmode & CaretBinaryFile::WRITE);
     QIODevice::OpenMode mode = QIODevice::NotOpen;//means 0
     if (opmode & CaretBinaryFile::READ) mode |= QIODevice::ReadOnly;
     if (opmode & CaretBinaryFile::WRITE) mode |= QIODevice::WriteOnly;
@@ -318,7 +1188,28 @@ void QFileImpl::open(const QString& filename, const CaretBinaryFile::OpenMode& o
 
 void QFileImpl::close()
 {
+    if (m_mapped != NULL)
+    {
+        m_file.unmap(m_mapped);
+        m_mapped = NULL;
+    }
     m_file.close();
+    m_readOnly = false;
+}
+
+const char* QFileImpl::mapReadOnly()
+{
+    if (m_mapped != NULL) return (const char*)m_mapped;
+    if (!m_readOnly || !m_file.isOpen()) return NULL;//writable mappings would need flushing rules, and we don't need them
+    int64_t fileSize = m_file.size();
+    if (fileSize <= 0) return NULL;
+    if ((uint64_t)fileSize > (uint64_t)std::numeric_limits<size_t>::max()) return NULL;//32-bit address space, fall back to reads
+    m_mapped = m_file.map(0, fileSize);//QFile uses a shared read-only mapping, so the page cache is shared with other processes reading the file
+    if (m_mapped == NULL)
+    {
+        CaretLogFine("memory mapping failed for file '" + m_fileName + "', using normal reads");
+    }
+    return (const char*)m_mapped;
 }
 
 void QFileImpl::read(void* dataOut, const int64_t& count, int64_t* numRead)
@@ -344,6 +1235,45 @@ void QFileImpl::read(void* dataOut, const int64_t& count, int64_t* numRead)
     }
 }
 
+bool QFileImpl::supportsReadAt()
+{
+#ifdef CARET_OS_WINDOWS
+    return false;//ReadFile with an offset still moves the shared file pointer, use the locked seek+read path
+#else
+    return m_readOnly && m_file.isOpen();
+#endif
+}
+
+void QFileImpl::readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead)
+{
+#ifdef CARET_OS_WINDOWS
+    CaretBinaryFile::ImplInterface::readAt(position, dataOut, count, numRead);
+#else
+    if (!supportsReadAt()) throw DataFileException("positional read is not supported for file '" + m_fileName + "'");
+    int fd = m_file.handle();
+    int64_t total = 0;
+    int64_t readret = -1;
+    while (total < count)
+    {
+        int64_t maxToRead = min(count - total, CHUNK_SIZE);
+        readret = pread(fd, ((char*)dataOut) + total, maxToRead, position + total);//pread doesn't touch the file offset, so concurrent calls don't interfere
+        if (readret < 0 && errno == EINTR) continue;
+        if (readret < 1) break;//0 or -1 means error or eof
+        total += readret;
+    }
+    if (numRead == NULL)
+    {
+        if (total != count)
+        {
+            if (readret < 0) throw DataFileException("error while reading file '" + m_fileName + "'");
+            throw DataFileException("premature end of file in '" + m_fileName + "'");
+        }
+    } else {
+        *numRead = total;
+    }
+#endif
+}
+
 void QFileImpl::seek(const int64_t& position)
 {
     if (!m_file.seek(position)) throw DataFileException("seek failed in file '" + m_fileName + "'");
@@ -56,6 +56,15 @@ namespace caret {
         void read(void* dataOut, const int64_t& count, int64_t* numRead = NULL);//throw if numRead is NULL and (error or end of file reached early)
         void write(const void* dataIn, const int64_t& count);//failure to complete write is always an exception
         int64_t size();//may return -1 if size cannot be determined efficiently
+        ///whether readAt can be used, currently only files opened for read only that are uncompressed (on platforms with pread()) or block compressed
+        bool getSupportsReadAt();
+        ///positional read that doesn't use or change the current position, safe to call from multiple threads at once
+        void readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead = NULL);
+        ///map the entire file read-only, returns NULL if it can't be mapped (compressed, open for writing, or the mapping failed), unmapped by close()
+        const char* mapReadOnly();
+        ///whether new .gz files are written as BGZF (independently compressed blocks, still valid gzip), which allows fast seeking when read
+        static void setWriteBlockCompressed(const bool& enabled);
+        static bool getWriteBlockCompressed();
         class ImplInterface
         {
         protected:
@@ -69,11 +78,15 @@ namespace caret {
             virtual int64_t size() = 0;
             virtual void read(void* dataOut, const int64_t& count, int64_t* numRead) = 0;
             virtual void write(const void* dataIn, const int64_t& count) = 0;
+            virtual bool supportsReadAt() { return false; }
+            virtual void readAt(const int64_t& position, void* dataOut, const int64_t& count, int64_t* numRead);
+            virtual const char* mapReadOnly() { return NULL; }
             virtual ~ImplInterface();
         };
     private:
         CaretPointer<ImplInterface> m_impl;
         OpenMode m_curMode;//so implementation classes don't have to track it
+        static bool s_writeBlockCompressed;
     };
 } //namespace caret
 
@@ -23,6 +23,8 @@
 
 #include "AString.h"
 
+#include <vector>
+
 namespace caret {
     
     class ProgramParameters;
@@ -33,6 +35,9 @@ namespace caret {
     
     void caret_global_commandLine_init(const int& argc, const char *const * argv);
     
+    ///quote the arguments as needed for a shell, as done for caret_global_commandLine
+    AString caret_format_command_line(const std::vector<AString>& arguments);
+    
 }
 
 #endif //__CARET_COMMAND_LINE_H__
@@ -38,6 +38,8 @@ CaretMathExpression::CaretMathExpression(const AString& expression)
     {
         throw CaretException("extra characters on end of expression input: '" + m_input.mid(m_position) + "'");
     }
+    m_numRegisters = 0;
+    compile(*m_root, 0);
     CaretLogFiner("parsed '" + expression + "' as '" + toString() + "'");
 }
 
@@ -47,6 +49,249 @@ double CaretMathExpression::evaluate(const vector<float>& variableValues) const
     return m_root->eval(variableValues);
 }
 
+void CaretMathExpression::compile(const MathNode& node, const int& dest)
+{//result goes in register dest, only registers above dest are used as temporaries
+    m_numRegisters = max(m_numRegisters, dest + 1);
+    Instruction myInstr;
+    myInstr.m_dest = dest;
+    switch (node.m_type)
+    {
+        case MathNode::OR:
+        case MathNode::AND:
+        case MathNode::EQUAL:
+        case MathNode::GREATERLESS:
+        case MathNode::ADDSUB:
+        case MathNode::MULTDIV:
+        {//left to right folds, same order as MathNode::eval
+            int end = (int)node.m_arguments.size();
+            CaretAssert(end > 1);
+            compile(*(node.m_arguments[0]), dest);
+            for (int i = 1; i < end; ++i)
+            {
+                compile(*(node.m_arguments[i]), dest + 1);
+                switch (node.m_type)
+                {
+                    case MathNode::OR:
+                        myInstr.m_op = Instruction::OR;
+                        break;
+                    case MathNode::AND:
+                        myInstr.m_op = Instruction::AND;
+                        break;
+                    case MathNode::EQUAL:
+                        myInstr.m_op = (node.m_invert[i] ? Instruction::NOT_EQUAL : Instruction::EQUAL);
+                        break;
+                    case MathNode::GREATERLESS:
+                        if (node.m_inclusive[i])
+                        {
+                            myInstr.m_op = (node.m_invert[i] ? Instruction::LESS_EQUAL : Instruction::GREATER_EQUAL);
+                        } else {
+                            myInstr.m_op = (node.m_invert[i] ? Instruction::LESS : Instruction::GREATER);
+                        }
+                        break;
+                    case MathNode::ADDSUB:
+                        myInstr.m_op = (node.m_invert[i] ? Instruction::SUBTRACT : Instruction::ADD);
+                        break;
+                    default://MULTDIV
+                        myInstr.m_op = (node.m_invert[i] ? Instruction::DIVIDE : Instruction::MULTIPLY);
+                        break;
+                }
+                m_program.push_back(myInstr);
+            }
+            return;
+        }
+        case MathNode::NOT:
+        case MathNode::NEGATE:
+            CaretAssert(node.m_arguments.size() == 1);
+            compile(*(node.m_arguments[0]), dest);
+            myInstr.m_op = (node.m_type == MathNode::NOT ? Instruction::NOT : Instruction::NEGATE);
+            m_program.push_back(myInstr);
+            return;
+        case MathNode::POW:
+            CaretAssert(node.m_arguments.size() == 2);
+            compile(*(node.m_arguments[0]), dest);
+            compile(*(node.m_arguments[1]), dest + 1);
+            myInstr.m_op = Instruction::POW;
+            m_program.push_back(myInstr);
+            return;
+        case MathNode::FUNC:
+            for (int i = 0; i < (int)node.m_arguments.size(); ++i)
+            {
+                compile(*(node.m_arguments[i]), dest + i);
+            }
+            switch (node.m_function)
+            {
+                case MathFunctionEnum::ATAN2:
+                    myInstr.m_op = Instruction::ATAN2;
+                    break;
+                case MathFunctionEnum::MIN:
+                    myInstr.m_op = Instruction::MIN;
+                    break;
+                case MathFunctionEnum::MAX:
+                    myInstr.m_op = Instruction::MAX;
+                    break;
+                case MathFunctionEnum::MOD:
+                    myInstr.m_op = Instruction::MOD;
+                    break;
+                case MathFunctionEnum::CLAMP:
+                    myInstr.m_op = Instruction::CLAMP;
+                    break;
+                case MathFunctionEnum::INVALID:
+                    CaretAssertMessage(0, "MathNode is type FUNC but INVALID function");
+                    throw CaretException("parsing problem in CaretMathExpression");
+                default:
+                    CaretAssert(node.m_arguments.size() == 1);
+                    myInstr.m_op = Instruction::FUNC;
+                    myInstr.m_function = node.m_function;
+                    break;
+            }
+            m_program.push_back(myInstr);
+            return;
+        case MathNode::VAR:
+            myInstr.m_op = Instruction::LOAD_VAR;
+            myInstr.m_varIndex = node.m_varIndex;
+            m_program.push_back(myInstr);
+            return;
+        case MathNode::CONST:
+            myInstr.m_op = Instruction::LOAD_CONST;
+            myInstr.m_constVal = node.m_constVal;
+            m_program.push_back(myInstr);
+            return;
+        case MathNode::INVALID:
+            break;
+    }
+    CaretAssertMessage(0, "parsing left INVALID MathNode");
+    throw CaretException("parsing problem in CaretMathExpression");
+}
+
+void CaretMathExpression::evaluateBatch(const vector<const float*>& variableValues, const vector<int64_t>& variableStrides, const int64_t& count, float* resultOut) const
+{
+    CaretAssert(variableValues.size() == m_varNames.size());
+    CaretAssert(variableStrides.size() == m_varNames.size());
+    const int64_t BATCH = 256;//registers for a typical expression stay in L1
+    vector<double> registers(m_numRegisters * BATCH);
+    const int programSize = (int)m_program.size();
+    for (int64_t start = 0; start < count; start += BATCH)
+    {
+        const int64_t num = min(BATCH, count - start);
+        for (int p = 0; p < programSize; ++p)
+        {
+            const Instruction& myInstr = m_program[p];
+            double* out = registers.data() + myInstr.m_dest * BATCH;
+            const double* second = out + BATCH;//always the next register up, see compile()
+            switch (myInstr.m_op)
+            {
+                case Instruction::LOAD_VAR:
+                {
+                    CaretAssertVectorIndex(variableValues, myInstr.m_varIndex);
+                    const int64_t stride = variableStrides[myInstr.m_varIndex];
+                    const float* in = variableValues[myInstr.m_varIndex] + start * stride;
+                    for (int64_t i = 0; i < num; ++i) out[i] = in[i * stride];
+                    break;
+                }
+                case Instruction::LOAD_CONST:
+                    for (int64_t i = 0; i < num; ++i) out[i] = myInstr.m_constVal;
+                    break;
+                case Instruction::OR://eager rather than lazy, which doesn't change the result
+                    for (int64_t i = 0; i < num; ++i) out[i] = ((out[i] > 0.0 || second[i] > 0.0) ? 1.0 : 0.0);
+                    break;
+                case Instruction::AND:
+                    for (int64_t i = 0; i < num; ++i) out[i] = ((out[i] > 0.0 && second[i] > 0.0) ? 1.0 : 0.0);
+                    break;
+                case Instruction::EQUAL:
+                case Instruction::NOT_EQUAL:
+                {
+                    const double ifEqual = (myInstr.m_op == Instruction::EQUAL ? 1.0 : 0.0);
+                    for (int64_t i = 0; i < num; ++i)
+                    {
+                        float adjust = min(abs(out[i]), abs(second[i])) / 1000000;//must match MathNode::eval exactly
+                        bool equal = (out[i] >= second[i] - adjust) && (out[i] <= second[i] + adjust);
+                        out[i] = (equal ? ifEqual : 1.0 - ifEqual);
+                    }
+                    break;
+                }
+                case Instruction::GREATER:
+                    for (int64_t i = 0; i < num; ++i) out[i] = (out[i] > second[i] ? 1.0 : 0.0);
+                    break;
+                case Instruction::LESS:
+                    for (int64_t i = 0; i < num; ++i) out[i] = (out[i] < second[i] ? 1.0 : 0.0);
+                    break;
+                case Instruction::GREATER_EQUAL:
+                    for (int64_t i = 0; i < num; ++i)
+                    {
+                        float adjust = min(abs(out[i]), abs(second[i])) / 1000000;
+                        out[i] = (out[i] >= second[i] - adjust ? 1.0 : 0.0);
+                    }
+                    break;
+                case Instruction::LESS_EQUAL:
+                    for (int64_t i = 0; i < num; ++i)
+                    {
+                        float adjust = min(abs(out[i]), abs(second[i])) / 1000000;
+                        out[i] = (out[i] <= second[i] + adjust ? 1.0 : 0.0);
+                    }
+                    break;
+                case Instruction::ADD:
+                    for (int64_t i = 0; i < num; ++i) out[i] += second[i];
+                    break;
+                case Instruction::SUBTRACT:
+                    for (int64_t i = 0; i < num; ++i) out[i] -= second[i];
+                    break;
+                case Instruction::MULTIPLY:
+                    for (int64_t i = 0; i < num; ++i) out[i] *= second[i];
+                    break;
+                case Instruction::DIVIDE:
+                    for (int64_t i = 0; i < num; ++i) out[i] /= second[i];
+                    break;
+                case Instruction::NOT:
+                    for (int64_t i = 0; i < num; ++i) out[i] = (out[i] > 0.0 ? 0.0 : 1.0);
+                    break;
+                case Instruction::NEGATE:
+                    for (int64_t i = 0; i < num; ++i) out[i] = -out[i];
+                    break;
+                case Instruction::POW:
+                    for (int64_t i = 0; i < num; ++i) out[i] = pow(out[i], second[i]);
+                    break;
+                case Instruction::FUNC:
+                    for (int64_t i = 0; i < num; ++i) out[i] = evalUnaryFunction(myInstr.m_function, out[i]);
+                    break;
+                case Instruction::ATAN2:
+                    for (int64_t i = 0; i < num; ++i) out[i] = atan2(out[i], second[i]);
+                    break;
+                case Instruction::MIN:
+                    for (int64_t i = 0; i < num; ++i) if (out[i] > second[i]) out[i] = second[i];
+                    break;
+                case Instruction::MAX:
+                    for (int64_t i = 0; i < num; ++i) if (out[i] < second[i]) out[i] = second[i];
+                    break;
+                case Instruction::MOD:
+                    for (int64_t i = 0; i < num; ++i)
+                    {
+                        if (second[i] == 0.0)
+                        {
+                            out[i] = 0.0;
+                        } else {
+                            out[i] = out[i] - second[i] * floor(out[i] / second[i]);
+                        }
+                    }
+                    break;
+                case Instruction::CLAMP:
+                {
+                    const double* third = second + BATCH;
+                    for (int64_t i = 0; i < num; ++i)
+                    {
+                        if (out[i] < second[i]) out[i] = second[i];
+                        if (out[i] > third[i]) out[i] = third[i];
+                    }
+                    break;
+                }
+            }
+        }
+        for (int64_t i = 0; i < num; ++i)
+        {
+            resultOut[start + i] = (float)registers[i];
+        }
+    }
+}
+
 vector<AString> CaretMathExpression::getVarNames() const
 {
     vector<AString> ret(m_varNames.size());
@@ -85,6 +330,70 @@ AString CaretMathExpression::getExpressionHelpInfo()
     return ret;
 }
 
+double CaretMathExpression::evalUnaryFunction(const MathFunctionEnum::Enum& function, const double& arg)
+{
+    switch (function)
+    {
+        case MathFunctionEnum::SIN:
+            return sin(arg);
+        case MathFunctionEnum::COS:
+            return cos(arg);
+        case MathFunctionEnum::TAN:
+            return tan(arg);
+        case MathFunctionEnum::ASIN:
+            return asin(arg);
+        case MathFunctionEnum::ACOS:
+            return acos(arg);
+        case MathFunctionEnum::ATAN:
+            return atan(arg);
+        case MathFunctionEnum::SINH:
+            return sinh(arg);
+        case MathFunctionEnum::COSH:
+            return cosh(arg);
+        case MathFunctionEnum::TANH:
+            return tanh(arg);
+        case MathFunctionEnum::ASINH:
+            //return asinh(arg);//will work, and be preferred, when we use c++11, but doesn't work on windows with previous standard
+            if (arg > 0)
+            {
+                return log(arg + sqrt(arg * arg + 1));
+            } else {
+                return -log(-arg + sqrt(arg * arg + 1));//special case negative for stability in large negatives
+            }
+        case MathFunctionEnum::ACOSH:
+            //return acosh(arg);
+            return log(arg + sqrt(arg * arg - 1));
+        case MathFunctionEnum::ATANH:
+            //return atanh(arg);
+            return 0.5 * log((1 + arg) / (1 - arg));
+        case MathFunctionEnum::LN:
+            return log(arg);
+        case MathFunctionEnum::EXP:
+            return exp(arg);
+        case MathFunctionEnum::LOG:
+            return log10(arg);
+        case MathFunctionEnum::SQRT:
+            return sqrt(arg);
+        case MathFunctionEnum::ABS:
+            return abs(arg);
+        case MathFunctionEnum::FLOOR:
+            return floor(arg);
+        case MathFunctionEnum::ROUND://windows doesn't use c99 when compiling c++ earlier than c++11, so implement manually
+            if (arg > 0.0)
+            {
+                return floor(arg + 0.5);
+            } else {
+                return ceil(arg - 0.5);
+            }
+        case MathFunctionEnum::CEIL:
+            return ceil(arg);
+        default:
+            break;
+    }
+    CaretAssertMessage(0, "evalUnaryFunction called with function that doesn't take one argument");
+    throw CaretException("parsing problem in CaretMathExpression");
+}
+
 double CaretMathExpression::MathNode::eval(const vector<float>& values) const
 {
     double ret = 0.0;
@@ -219,109 +528,27 @@ double CaretMathExpression::MathNode::eval(const vector<float>& values) const
             switch (m_function)//this could be (partly) moved into MathFunctionEnum, but it wouldn't strictly be an enum class then
             {
                 case MathFunctionEnum::SIN:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = sin(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::COS:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = cos(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::TAN:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = tan(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::ASIN:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = asin(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::ACOS:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = acos(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::ATAN:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = atan(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::SINH:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = sinh(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::COSH:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = cosh(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::TANH:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = tanh(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::ASINH:
-                {
-                    CaretAssert(m_arguments.size() == 1);
-                    //ret = asinh(m_arguments[0].eval(values));//will work, and be preferred, when we use c++11, but doesn't work on windows with previous standard
-                    double arg = m_arguments[0]->eval(values);
-                    if (arg > 0)
-                    {
-                        ret = log(arg + sqrt(arg * arg + 1));
-                    } else {
-                        ret = -log(-arg + sqrt(arg * arg + 1));//special case negative for stability in large negatives
-                    }
-                    break;
-                }
                 case MathFunctionEnum::ACOSH:
-                {
-                    CaretAssert(m_arguments.size() == 1);
-                    //ret = acosh(m_arguments[0].eval(values));
-                    double arg = m_arguments[0]->eval(values);
-                    ret = log(arg + sqrt(arg * arg - 1));
-                    break;
-                }
                 case MathFunctionEnum::ATANH:
-                {
-                    CaretAssert(m_arguments.size() == 1);
-                    //ret = atanh(m_arguments[0].eval(values));
-                    double arg = m_arguments[0]->eval(values);
-                    ret = 0.5 * log((1 + arg) / (1 - arg));
-                    break;
-                }
                 case MathFunctionEnum::LN:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = log(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::EXP:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = exp(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::LOG:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = log10(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::SQRT:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = sqrt(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::ABS:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = abs(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::FLOOR:
-                    CaretAssert(m_arguments.size() == 1);
-                    ret = floor(m_arguments[0]->eval(values));
-                    break;
                 case MathFunctionEnum::ROUND:
-                {
-                    CaretAssert(m_arguments.size() == 1);
-                    double temp = m_arguments[0]->eval(values);//windows doesn't use c99 when compiling c++ earlier than c++11, so implement manually
-                    if (temp > 0.0)
-                    {
-                        ret = floor(temp + 0.5);
-                    } else {
-                        ret = ceil(temp - 0.5);
-                    }
-                    break;
-                }
                 case MathFunctionEnum::CEIL:
                     CaretAssert(m_arguments.size() == 1);
-                    ret = ceil(m_arguments[0]->eval(values));
+                    ret = evalUnaryFunction(m_function, m_arguments[0]->eval(values));//shared with the compiled evaluator, so they can't give different answers
                     break;
                 case MathFunctionEnum::ATAN2:
                     CaretAssert(m_arguments.size() == 2);
@@ -25,6 +25,8 @@
 #include "CaretPointer.h"
 #include "MathFunctionEnum.h"
 
+#include "stdint.h"
+
 #include <map>
 #include <vector>
 
@@ -63,6 +65,45 @@ class CaretMathExpression
         double eval(const std::vector<float>& values) const;
         AString toString(const std::vector<AString>& varNames) const;
     };
+    struct Instruction
+    {//one step of the compiled form: operates on whole batches of elements, in registers m_dest and above
+        enum OpCode
+        {
+            LOAD_VAR,
+            LOAD_CONST,
+            OR,
+            AND,
+            EQUAL,
+            NOT_EQUAL,
+            GREATER,
+            LESS,
+            GREATER_EQUAL,
+            LESS_EQUAL,
+            ADD,
+            SUBTRACT,
+            MULTIPLY,
+            DIVIDE,
+            NOT,
+            NEGATE,
+            POW,
+            FUNC,//single argument functions
+            ATAN2,
+            MIN,
+            MAX,
+            MOD,
+            CLAMP
+        };
+        OpCode m_op;
+        int m_dest;//binary operations combine m_dest and m_dest + 1 into m_dest, clamp also uses m_dest + 2
+        int m_varIndex;
+        double m_constVal;
+        MathFunctionEnum::Enum m_function;
+        Instruction() { m_op = LOAD_CONST; m_dest = 0; m_varIndex = -1; m_constVal = 0.0; m_function = MathFunctionEnum::INVALID; }
+    };
+    std::vector<Instruction> m_program;
+    int m_numRegisters;
+    void compile(const MathNode& node, const int& dest);
+    static double evalUnaryFunction(const MathFunctionEnum::Enum& function, const double& arg);
     std::map<AString, int> m_varNames;
     AString m_input;
     int m_position, m_end;
@@ -86,6 +127,9 @@ public:
     static bool getNamedConstant(const AString& name, double& valueOut);
     CaretMathExpression(const AString& expression);
     double evaluate(const std::vector<float>& variableValues) const;
+    ///evaluate many elements at once with the compiled form of the expression, gives the same results as calling evaluate() on each and converting to float
+    ///variable v for element i is variableValues[v][i * variableStrides[v]], use a stride of 0 for a variable that doesn't change
+    void evaluateBatch(const std::vector<const float*>& variableValues, const std::vector<int64_t>& variableStrides, const int64_t& count, float* resultOut) const;
     std::vector<AString> getVarNames() const;
     AString toString() const;//the expression, with a lot of parentheses added
 };
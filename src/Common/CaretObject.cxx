@@ -57,8 +57,12 @@ CaretObject::~CaretObject()
     /*
      * Erase returns the number of objects deleted.
      * If zero, then the object has already been deleted.
+     * Objects are created and deleted on worker threads
+     * (files are read concurrently), so the map is guarded.
      */
-    uint64_t numDeleted = CaretObject::allocatedObjects.erase(this);
+    uint64_t numDeleted = 0;
+#pragma omp critical (CaretObjectAllocatedObjects)
+    numDeleted = CaretObject::allocatedObjects.erase(this);
     if (numDeleted <= 0) {
         std::cerr << "Destructor for a CaretObject called but the object is not allocated "
                   << "and this implies that the object has already been deleted.";
@@ -81,6 +85,7 @@ CaretObject::initializeMembersCaretObject()
 #ifndef NDEBUG
     SystemBacktrace myBacktrace;
     SystemUtilities::getBackTrace(myBacktrace);
+#pragma omp critical (CaretObjectAllocatedObjects)
     CaretObject::allocatedObjects.insert(
                std::make_pair(this,
                               myBacktrace));
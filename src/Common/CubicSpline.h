@@ -33,6 +33,9 @@ namespace caret {
         
         ///NOTE: data should be deconvolved before using this spline
         static CubicSpline bspline(float frac, bool lowEdge, bool highEdge);
+        
+        ///weight applied to sample p0 through p3
+        inline float getWeight(const int& which) const { return m_weights[which]; }
 
         //splines will be reused, so this part should be fast for the majority case (testing for if it is an edge case would slow it down for the majority case)
         ///evaluate the spline with these samples
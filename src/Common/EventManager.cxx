@@ -166,6 +166,7 @@ void
 EventManager::addEventListener(EventListenerInterface* eventListener,
                                const EventTypeEnum::Enum listenForEventType)
 {
+    CaretMutexLocker locked(&m_listenerMutex);
 #ifdef CONTAINER_VECTOR
     m_eventListeners[listenForEventType].push_back(eventListener);
 #elif CONTAINER_HASH_SET
@@ -196,6 +197,7 @@ void
 EventManager::addProcessedEventListener(EventListenerInterface* eventListener,
                                const EventTypeEnum::Enum listenForEventType)
 {
+    CaretMutexLocker locked(&m_listenerMutex);
 #ifdef CONTAINER_VECTOR
     m_eventProcessedListeners[listenForEventType].push_back(eventListener);
 #elif CONTAINER_HASH_SET
@@ -225,6 +227,7 @@ void
 EventManager::removeEventFromListener(EventListenerInterface* eventListener,
                                   const EventTypeEnum::Enum listenForEventType)
 {
+    CaretMutexLocker locked(&m_listenerMutex);
 #ifdef CONTAINER_VECTOR
     /*
      * Remove from NORMAL listeners
@@ -370,7 +373,11 @@ EventManager::sendEvent(Event* event)
         /*
          * Get listeners for event.
          */
-        EVENT_LISTENER_CONTAINER listeners = m_eventListeners[eventType];
+        EVENT_LISTENER_CONTAINER listeners;
+        {
+            CaretMutexLocker locked(&m_listenerMutex);//copy under the lock, listeners may add or remove listeners when they receive the event
+            listeners = m_eventListeners[eventType];
+        }
         
         const AString eventNumberString = AString::number(m_eventIssuedCounter);
         
@@ -409,7 +416,11 @@ EventManager::sendEvent(Event* event)
             /*
              * Send event to each of the PROCESSED listeners.
              */
-            EVENT_LISTENER_CONTAINER processedListeners = m_eventProcessedListeners[eventType];
+            EVENT_LISTENER_CONTAINER processedListeners;
+            {
+                CaretMutexLocker locked(&m_listenerMutex);
+                processedListeners = m_eventProcessedListeners[eventType];
+            }
             for (EVENT_LISTENER_CONTAINER_ITERATOR iter = processedListeners.begin();
                  iter != processedListeners.end();
                  iter++) {
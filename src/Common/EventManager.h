@@ -23,6 +23,7 @@
 
 #include <stdint.h>
 
+#include "CaretMutex.h"
 #include "CaretObject.h"
 
 #include "EventTypeEnum.h"
@@ -129,6 +130,12 @@ namespace caret {
          */
         EVENT_LISTENER_CONTAINER m_eventProcessedListeners[EventTypeEnum::EVENT_COUNT];
         
+        /**
+         * Guards both listener containers, files that listen for events
+         * (such as surfaces) are created and destroyed on worker threads
+         */
+        CaretMutex m_listenerMutex;
+        
         /** Counter that is incremented each time an event is issued */
         int64_t m_eventIssuedCounter;
         
@@ -570,4 +570,46 @@ FastStatistics::getPositiveValuePercentile(const float value) const
 //    return percentile;
 }
 
+void FastStatistics::writeBinary(ostream& stream) const
+{
+    const float values[11] = { m_min, m_max, m_mean, m_stdDevPop, m_stdDevSample,
+                               m_mostPos, m_leastPos, m_leastNeg, m_mostNeg, m_leastAbs, m_mostAbs };
+    stream.write((const char*)values, sizeof(values));
+    const int64_t counts[7] = { m_posCount, m_zeroCount, m_negCount, m_infCount, m_negInfCount, m_nanCount, m_absCount };
+    stream.write((const char*)counts, sizeof(counts));
+    m_posPercentHist.writeBinary(stream);
+    m_negPercentHist.writeBinary(stream);
+    m_absPercentHist.writeBinary(stream);
+}
 
+bool FastStatistics::readBinary(istream& stream)
+{
+    float values[11];
+    int64_t counts[7];
+    stream.read((char*)values, sizeof(values));
+    stream.read((char*)counts, sizeof(counts));
+    if (!stream || !m_posPercentHist.readBinary(stream) || !m_negPercentHist.readBinary(stream) || !m_absPercentHist.readBinary(stream))
+    {
+        reset();
+        return false;
+    }
+    m_min = values[0];
+    m_max = values[1];
+    m_mean = values[2];
+    m_stdDevPop = values[3];
+    m_stdDevSample = values[4];
+    m_mostPos = values[5];
+    m_leastPos = values[6];
+    m_leastNeg = values[7];
+    m_mostNeg = values[8];
+    m_leastAbs = values[9];
+    m_mostAbs = values[10];
+    m_posCount = counts[0];
+    m_zeroCount = counts[1];
+    m_negCount = counts[2];
+    m_infCount = counts[3];
+    m_negInfCount = counts[4];
+    m_nanCount = counts[5];
+    m_absCount = counts[6];
+    return true;
+}
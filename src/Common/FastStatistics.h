@@ -101,6 +101,12 @@ namespace caret
         
         float getAbsoluteValuePercentile(const float value) const;
         
+        ///write all statistics in a compact binary form, in native byte order, for caching
+        void writeBinary(std::ostream& stream) const;
+        
+        ///read statistics written by writeBinary, returns false (and leaves the statistics reset) if the data is bad
+        bool readBinary(std::istream& stream);
+        
     };
     
 }
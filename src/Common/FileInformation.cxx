@@ -19,6 +19,7 @@
  */
 /*LICENSE_END*/
 
+#include <QDateTime>
 #include <QDir>
 
 #define __FILE_INFORMATION_DECLARE__
@@ -349,6 +350,27 @@ FileInformation::size() const
     return m_fileInfo.size();
 }
 
+/**
+ * @return Time the file was last modified in milliseconds
+ * since the epoch.
+ *
+ * A remote file or a file that does not exist always returns 0.
+ */
+int64_t
+FileInformation::getLastModifiedMilliseconds() const
+{
+    if (m_isRemoteFile) {
+        return 0;
+    }
+    
+    const QDateTime dateTime = m_fileInfo.lastModified();
+    if ( ! dateTime.isValid()) {
+        return 0;
+    }
+    
+    return dateTime.toMSecsSinceEpoch();
+}
+
 /**
  * @return name of file followed by path in parenthesis.
  *
@@ -65,6 +65,8 @@ namespace caret {
         
         int64_t size() const;
         
+        int64_t getLastModifiedMilliseconds() const;
+        
         AString getAsLocalAbsoluteFilePath(const AString& currentDirectory,
                                            const DataFileTypeEnum::Enum dataFileType) const;
         
@@ -26,6 +26,33 @@
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    ///bucket counts are mostly small, so write them as 7 bits per byte with a continuation bit
+    void writeVarInt(ostream& stream, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            stream.put((char)((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        stream.put((char)value);
+    }
+    
+    bool readVarInt(istream& stream, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            int c = stream.get();
+            if (c == istream::traits_type::eof()) return false;
+            value |= ((uint64_t)(c & 0x7F)) << shift;
+            if ((c & 0x80) == 0) return true;
+        }
+        return false;
+    }
+}
+
 Histogram::Histogram(const int& numBuckets)
 {
     resize(numBuckets);
@@ -314,3 +341,64 @@ void Histogram::computeCumulative()
         m_cumulative[i] = accum;
     }
 }
+
+void Histogram::writeBinary(ostream& stream) const
+{
+    int32_t numBuckets = (int32_t)m_buckets.size();
+    stream.write((const char*)&numBuckets, sizeof(numBuckets));
+    stream.write((const char*)&m_bucketMin, sizeof(m_bucketMin));
+    stream.write((const char*)&m_bucketMax, sizeof(m_bucketMax));
+    const int64_t counts[6] = { m_posCount, m_zeroCount, m_negCount, m_infCount, m_negInfCount, m_nanCount };
+    stream.write((const char*)counts, sizeof(counts));
+    for (int32_t i = 0; i < numBuckets; ++i)
+    {
+        writeVarInt(stream, (uint64_t)m_buckets[i]);
+    }
+}
+
+bool Histogram::readBinary(istream& stream)
+{
+    const int32_t MAX_BUCKET_COUNT = 1 << 24;//anything bigger is garbage
+    int32_t numBuckets = 0;
+    float bucketMin = 0.0f, bucketMax = 0.0f;
+    int64_t counts[6];
+    stream.read((char*)&numBuckets, sizeof(numBuckets));
+    stream.read((char*)&bucketMin, sizeof(bucketMin));
+    stream.read((char*)&bucketMax, sizeof(bucketMax));
+    stream.read((char*)counts, sizeof(counts));
+    if (!stream || numBuckets < 1 || numBuckets > MAX_BUCKET_COUNT)
+    {
+        reset();
+        return false;
+    }
+    resize(numBuckets);
+    reset();
+    for (int32_t i = 0; i < numBuckets; ++i)
+    {
+        uint64_t value;
+        if (!readVarInt(stream, value))
+        {
+            reset();
+            return false;
+        }
+        m_buckets[i] = (int64_t)value;
+    }
+    m_bucketMin = bucketMin;
+    m_bucketMax = bucketMax;
+    m_posCount = counts[0];
+    m_zeroCount = counts[1];
+    m_negCount = counts[2];
+    m_infCount = counts[3];
+    m_negInfCount = counts[4];
+    m_nanCount = counts[5];
+    computeCumulative();
+    if (m_bucketMin != m_bucketMax)
+    {//same as update(), display stays zeroed when the range is zero
+        float bucketsize = (m_bucketMax - m_bucketMin) / numBuckets;
+        for (int i = 0; i < numBuckets; ++i)
+        {
+            m_display[i] = m_buckets[i] / bucketsize;
+        }
+    }
+    return true;
+}
@@ -21,6 +21,7 @@
  */
 /*LICENSE_END*/
 
+#include <iostream>
 #include <vector>
 #include "stdint.h"
 
@@ -86,6 +87,12 @@ namespace caret
             histMin = m_bucketMin;
             histMax = m_bucketMax;
         }
+        
+        ///write the histogram in a compact binary form, in native byte order, for caching
+        void writeBinary(std::ostream& stream) const;
+        
+        ///read a histogram written by writeBinary, returns false (and leaves the histogram reset) if the data is bad
+        bool readBinary(std::istream& stream);
     };
 
 }
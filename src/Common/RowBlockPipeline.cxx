@@ -0,0 +1,152 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "RowBlockPipeline.h"
+
+#include "CaretAssert.h"
+#include "CaretException.h"
+#include "CaretOMP.h"
+
+#include <algorithm>
+#include <exception>
+#include <new>
+
+using namespace caret;
+using namespace std;
+
+const int RowBlockPipeline::NUM_SLOTS;
+
+namespace
+{
+    const int64_t BLOCK_BYTES = 1 << 23;//per slot, so the three slots stay well inside the cache of a large machine, and the per-block sync cost is small
+    const int64_t MIN_BLOCKS = 8;//so that reading and writing overlap with processing for most of the run
+    const int PARTS_PER_THREAD = 4;//parts are claimed dynamically, so the reading and writing threads can take the leftovers
+    
+    ///exceptions can't leave a parallel region, so keep the first one to rethrow after it
+    class StageError
+    {
+        bool m_failed, m_outOfMemory;
+        AString m_message;
+    public:
+        StageError()
+        {
+            m_failed = false;
+            m_outOfMemory = false;
+        }
+        void record(const AString& message, const bool& outOfMemory)
+        {
+#pragma omp critical
+            {
+                if (!m_failed)
+                {
+                    m_failed = true;
+                    m_outOfMemory = outOfMemory;
+                    m_message = message;
+                }
+            }
+        }
+        ///only call outside the parallel region
+        void rethrow() const
+        {
+            if (!m_failed) return;
+            if (m_outOfMemory) throw bad_alloc();//so that callers report it as out of memory, as they would without the pipeline
+            throw CaretException(m_message);
+        }
+    };
+}
+
+int64_t RowBlockPipeline::getItemsPerBlock(const int64_t& bytesPerItem, const int64_t& numItems)
+{
+    int64_t ret = BLOCK_BYTES / max(bytesPerItem, (int64_t)1);
+    ret = min(ret, (numItems + MIN_BLOCKS - 1) / MIN_BLOCKS);
+    return max(ret, (int64_t)1);
+}
+
+void RowBlockPipeline::getPartRange(const int64_t& count, const int& part, const int& numParts, int64_t& startOut, int64_t& endOut)
+{
+    CaretAssert(part >= 0 && part < numParts);
+    startOut = count * part / numParts;
+    endOut = count * (part + 1) / numParts;
+}
+
+void RowBlockPipeline::run(Processor& processor, const int64_t& numItems, const int64_t& itemsPerBlock)
+{
+    CaretAssert(itemsPerBlock > 0);
+    if (numItems <= 0) return;
+    const int64_t numBlocks = (numItems - 1) / itemsPerBlock + 1;
+#ifdef CARET_OMP
+    StageError myError;
+    for (int64_t block = -1; block <= numBlocks; ++block)
+    {//block is the one being processed, block + 1 the one being read, block - 1 the one being written
+#pragma omp CARET_PAR
+        {
+            const int myThread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+            const int writeThread = (numThreads > 2 ? 1 : 0);//with only 2 threads, let the other one process without interruption
+            const int numParts = numThreads * PARTS_PER_THREAD;
+            try
+            {
+                if (myThread == 0 && block + 1 < numBlocks)
+                {
+                    const int64_t readStart = (block + 1) * itemsPerBlock;
+                    processor.readBlock(readStart, min(itemsPerBlock, numItems - readStart), (block + 1) % NUM_SLOTS);
+                }
+                if (myThread == writeThread && block - 1 >= 0)
+                {
+                    const int64_t writeStart = (block - 1) * itemsPerBlock;
+                    processor.writeBlock(writeStart, min(itemsPerBlock, numItems - writeStart), (block - 1) % NUM_SLOTS);
+                }
+            } catch (CaretException& e) {
+                myError.record(e.whatString(), false);
+            } catch (bad_alloc&) {
+                myError.record("", true);
+            } catch (exception& e) {
+                myError.record(e.what(), false);
+            }
+            if (block >= 0 && block < numBlocks)
+            {
+                const int64_t processStart = block * itemsPerBlock, processCount = min(itemsPerBlock, numItems - processStart);
+#pragma omp CARET_FOR schedule(dynamic, 1)
+                for (int part = 0; part < numParts; ++part)
+                {
+                    try
+                    {
+                        processor.processBlock(processStart, processCount, block % NUM_SLOTS, part, numParts);
+                    } catch (CaretException& e) {
+                        myError.record(e.whatString(), false);
+                    } catch (bad_alloc&) {
+                        myError.record("", true);
+                    } catch (exception& e) {
+                        myError.record(e.what(), false);
+                    }
+                }
+            }
+        }
+        myError.rethrow();//a failure stops before the next block is read or written
+    }
+#else
+    for (int64_t block = 0; block < numBlocks; ++block)
+    {
+        const int64_t blockStart = block * itemsPerBlock, blockCount = min(itemsPerBlock, numItems - blockStart);
+        processor.readBlock(blockStart, blockCount, block % NUM_SLOTS);
+        processor.processBlock(blockStart, blockCount, block % NUM_SLOTS, 0, 1);
+        processor.writeBlock(blockStart, blockCount, block % NUM_SLOTS);
+    }
+#endif
+}
@@ -0,0 +1,61 @@
+#ifndef __ROW_BLOCK_PIPELINE_H__
+#define __ROW_BLOCK_PIPELINE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "stdint.h"
+
+namespace caret {
+
+    ///runs read, process, and write stages over blocks of items (usually rows of a file), overlapping them with openmp:
+    ///while block b is processed by all threads, one thread reads block b + 1 and another writes block b - 1, so file access stays single-threaded and in order
+    class RowBlockPipeline
+    {
+        RowBlockPipeline();
+    public:
+        ///each block's data lives in one of NUM_SLOTS buffers of the processor, block b uses slot b % NUM_SLOTS
+        static const int NUM_SLOTS = 3;
+
+        class Processor
+        {
+        public:
+            virtual ~Processor() { }
+            ///read the input of the items into the slot, called by one thread at a time, in block order
+            virtual void readBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot) = 0;
+            ///do one part of the work for the block, different parts of the same block are called concurrently
+            virtual void processBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot, const int& part, const int& numParts) = 0;
+            ///write the output of the items from the slot, called by one thread at a time, in block order
+            virtual void writeBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot) = 0;
+        };
+
+        ///number of items per block so that a block's data is a few megabytes, while leaving enough blocks to overlap the stages
+        static int64_t getItemsPerBlock(const int64_t& bytesPerItem, const int64_t& numItems);
+
+        ///the range of items (or other units) a part should process, splitting them evenly
+        static void getPartRange(const int64_t& count, const int& part, const int& numParts, int64_t& startOut, int64_t& endOut);
+
+        ///run all stages on all items, the first exception from any stage is rethrown after the current blocks finish, as bad_alloc if it was one, otherwise as CaretException
+        static void run(Processor& processor, const int64_t& numItems, const int64_t& itemsPerBlock);
+    };
+
+}
+
+#endif //__ROW_BLOCK_PIPELINE_H__
@@ -0,0 +1,159 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "SparseMatrixCSR.h"
+
+#include "CaretAssert.h"
+#include "CaretOMP.h"
+
+#include <algorithm>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const int64_t VECTOR_BLOCK = 256;//vectors accumulated at once, keeps the accumulators in L1 for long interleaved rows (dtseries)
+}
+
+void SparseMatrixCSR::swapIn(const int64_t& numColumns, vector<int64_t>& rowStarts, vector<int32_t>& indices, vector<float>& values)
+{
+    CaretAssert(rowStarts.size() > 0 && rowStarts[0] == 0 && rowStarts.back() == (int64_t)indices.size() && indices.size() == values.size());
+    m_numColumns = numColumns;
+    m_rowStarts.swap(rowStarts);
+    m_indices.swap(indices);
+    m_values.swap(values);
+    rowStarts.clear();
+    indices.clear();
+    values.clear();
+}
+
+void SparseMatrixCSR::getRowSums(vector<float>& sumsOut) const
+{
+    const int64_t numRows = getNumberOfRows();
+    sumsOut.resize(numRows);
+    for (int64_t row = 0; row < numRows; ++row)
+    {
+        float sum = 0.0f;
+        for (int64_t j = m_rowStarts[row]; j < m_rowStarts[row + 1]; ++j)
+        {
+            sum += m_values[j];
+        }
+        sumsOut[row] = sum;
+    }
+}
+
+void SparseMatrixCSR::getMasked(const float* rowMask, const float* columnMask, SparseMatrixCSR& matrixOut) const
+{
+    const int64_t numRows = getNumberOfRows();
+    vector<int64_t> rowStarts(numRows + 1, 0);
+    vector<int32_t> indices;
+    vector<float> values;
+    indices.reserve(m_indices.size());
+    values.reserve(m_values.size());
+    for (int64_t row = 0; row < numRows; ++row)
+    {
+        if (rowMask == NULL || rowMask[row] > 0.0f)
+        {
+            for (int64_t j = m_rowStarts[row]; j < m_rowStarts[row + 1]; ++j)
+            {
+                if (columnMask == NULL || columnMask[m_indices[j]] > 0.0f)
+                {
+                    indices.push_back(m_indices[j]);
+                    values.push_back(m_values[j]);
+                }
+            }
+        }
+        rowStarts[row + 1] = (int64_t)indices.size();
+    }
+    matrixOut.swapIn(m_numColumns, rowStarts, indices, values);
+}
+
+void SparseMatrixCSR::multiply(const float* in, float* out, const float& emptyValue) const
+{
+    const int64_t numRows = getNumberOfRows();
+#pragma omp CARET_PARFOR schedule(dynamic, 256)
+    for (int64_t row = 0; row < numRows; ++row)
+    {
+        const int64_t start = m_rowStarts[row], end = m_rowStarts[row + 1];
+        if (start != end)
+        {
+            double accum = 0.0;
+            for (int64_t j = start; j < end; ++j)
+            {
+                accum += in[m_indices[j]] * m_values[j];
+            }
+            out[row] = accum;
+        } else {
+            out[row] = emptyValue;
+        }
+    }
+}
+
+void SparseMatrixCSR::multiplyInterleaved(const float* in, const int64_t& inStride, float* out, const int64_t& outStride, const int64_t& numVectors, const float& emptyValue) const
+{
+    CaretAssert(numVectors <= inStride && numVectors <= outStride);
+    if (numVectors == 1 && inStride == 1 && outStride == 1)
+    {
+        multiply(in, out, emptyValue);
+        return;
+    }
+    const int64_t numRows = getNumberOfRows();
+#pragma omp CARET_PAR
+    {
+        vector<double> accum(min(numVectors, VECTOR_BLOCK));
+#pragma omp CARET_FOR schedule(dynamic, 64)
+        for (int64_t row = 0; row < numRows; ++row)
+        {
+            const int64_t start = m_rowStarts[row], end = m_rowStarts[row + 1];
+            float* outRow = out + row * outStride;
+            if (start == end)
+            {
+                for (int64_t v = 0; v < numVectors; ++v)
+                {
+                    outRow[v] = emptyValue;
+                }
+                continue;
+            }
+            for (int64_t vecBase = 0; vecBase < numVectors; vecBase += VECTOR_BLOCK)
+            {
+                const int64_t vecCount = min(VECTOR_BLOCK, numVectors - vecBase);
+                double* accumPtr = accum.data();
+                for (int64_t v = 0; v < vecCount; ++v)
+                {
+                    accumPtr[v] = 0.0;
+                }
+                for (int64_t j = start; j < end; ++j)
+                {
+                    const float weight = m_values[j];
+                    const float* inRow = in + m_indices[j] * inStride + vecBase;
+                    for (int64_t v = 0; v < vecCount; ++v)
+                    {
+                        accumPtr[v] += inRow[v] * weight;
+                    }
+                }
+                for (int64_t v = 0; v < vecCount; ++v)
+                {
+                    outRow[vecBase + v] = accumPtr[v];
+                }
+            }
+        }
+    }
+}
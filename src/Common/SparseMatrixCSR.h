@@ -0,0 +1,63 @@
+#ifndef __SPARSE_MATRIX_CSR_H__
+#define __SPARSE_MATRIX_CSR_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "stdint.h"
+#include <vector>
+
+namespace caret {
+
+    ///compressed sparse row matrix of float weights, row i has entries getRowStarts()[i] to getRowStarts()[i + 1] - 1
+    ///used for surface resampling and smoothing, where each output vertex is a weighted sum of a few input vertices
+    class SparseMatrixCSR
+    {
+        std::vector<int64_t> m_rowStarts;//includes the end of the last row, so always has at least one element
+        std::vector<int32_t> m_indices;
+        std::vector<float> m_values;
+        int64_t m_numColumns;
+    public:
+        SparseMatrixCSR() : m_rowStarts(1, 0), m_numColumns(0) { }
+        ///takes the contents of the vectors by swapping, the arguments are left empty
+        void swapIn(const int64_t& numColumns, std::vector<int64_t>& rowStarts, std::vector<int32_t>& indices, std::vector<float>& values);
+        
+        int64_t getNumberOfRows() const { return (int64_t)m_rowStarts.size() - 1; }
+        int64_t getNumberOfColumns() const { return m_numColumns; }
+        int64_t getNumberOfEntries() const { return (int64_t)m_indices.size(); }
+        const std::vector<int64_t>& getRowStarts() const { return m_rowStarts; }
+        const std::vector<int32_t>& getIndices() const { return m_indices; }
+        const std::vector<float>& getValues() const { return m_values; }
+        
+        ///sum of each row's values, added in order in float
+        void getRowSums(std::vector<float>& sumsOut) const;
+        ///copy of the matrix with only the entries whose row and column have mask values greater than zero, NULL means no mask
+        void getMasked(const float* rowMask, const float* columnMask, SparseMatrixCSR& matrixOut) const;
+        
+        ///out[row] = sum(values * in[indices]), products in float, summed in double, rows without entries get emptyValue
+        void multiply(const float* in, float* out, const float& emptyValue = 0.0f) const;
+        ///the same for numVectors vectors at once, stored interleaved: in[column * inStride + v] and out[row * outStride + v]
+        ///this reads the matrix once for all vectors, and each entry becomes a contiguous multiply-add rather than a scattered gather
+        void multiplyInterleaved(const float* in, const int64_t& inStride, float* out, const int64_t& outStride, const int64_t& numVectors, const float& emptyValue = 0.0f) const;
+    };
+
+}
+
+#endif //__SPARSE_MATRIX_CSR_H__
@@ -24,14 +24,87 @@
 #include "ByteSwapping.h"
 #include "CaretAssert.h"
 #include "CaretLogger.h"
+#include "CaretOMP.h"
 #include "FileInformation.h"
 
 #include <QByteArray>
 
+#include "zlib.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <map>
+#include <new>
+
 using namespace caret;
 using namespace std;
 
 const char magic[] = "\0\0\0\0cst\0";
+const char magicVersion2[] = "\0\0\0\0cs2\0";
+
+namespace
+{
+    const int64_t ROWS_PER_BLOCK = 16;//rows are read a block at a time, but nearby rows are often loaded together for averaging
+    
+    ///keeps the first error from a parallel loop, to rethrow after the loop, with running out of memory still thrown as bad_alloc
+    class ParallelFailure
+    {
+        bool m_failed, m_outOfMemory;
+        AString m_message;
+    public:
+        ParallelFailure() { m_failed = false; m_outOfMemory = false; }
+        bool failed()
+        {
+            bool ret;
+#pragma omp critical (CaretSparseFileFailure)
+            ret = m_failed;
+            return ret;
+        }
+        void record(const AString& message, const bool& outOfMemory)
+        {
+#pragma omp critical (CaretSparseFileFailure)
+            {
+                if (!m_failed)
+                {
+                    m_failed = true;
+                    m_outOfMemory = outOfMemory;
+                    m_message = message;
+                }
+            }
+        }
+        void rethrow() const
+        {
+            if (!m_failed) return;
+            if (m_outOfMemory) throw bad_alloc();
+            throw DataFileException(m_message);
+        }
+    };
+    
+    void appendVarint(vector<unsigned char>& buffer, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            buffer.push_back((unsigned char)(value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        buffer.push_back((unsigned char)value);
+    }
+    
+    uint64_t readVarint(const unsigned char*& pos, const unsigned char* end)
+    {
+        uint64_t ret = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos >= end) throw DataFileException("sparse file block ends in the middle of a value");
+            unsigned char byte = *pos;
+            ++pos;
+            ret |= ((uint64_t)(byte & 0x7F)) << shift;
+            if ((byte & 0x80) == 0) return ret;
+        }
+        throw DataFileException("invalid variable length integer in sparse file block");
+    }
+}
 
 CaretSparseFile::CaretSparseFile(const AString& fileName)
 {
@@ -47,33 +120,77 @@ void CaretSparseFile::readFile(const AString& filename)
     }
     m_file.open(filename);
     FileInformation fileInfo(filename);//useful later for file size, but create it now to reduce the amount of time between file open and size check
+    m_version = 0;
+    m_cachedBlockIndex = -1;
+    m_supportsReadAt = m_file.getSupportsReadAt();
     char buf[8];
     m_file.read(buf, 8);
+    bool isVersion1 = true, isVersion2 = true;
     for (int i = 0; i < 8; ++i)
     {
-        if (buf[i] != magic[i]) throw DataFileException("file has the wrong magic string");
+        if (buf[i] != magic[i]) isVersion1 = false;
+        if (buf[i] != magicVersion2[i]) isVersion2 = false;
     }
+    if (!isVersion1 && !isVersion2) throw DataFileException("file has the wrong magic string");
     m_file.read(m_dims, 2 * sizeof(int64_t));
     if (ByteOrderEnum::isSystemBigEndian())
     {
         ByteSwapping::swapBytes(m_dims, 2);
     }
     if (m_dims[0] < 1 || m_dims[1] < 1) throw DataFileException("both dimensions must be positive");
-    m_indexArray.resize(m_dims[1] + 1);
-    vector<int64_t> lengthArray(m_dims[1]);
-    m_file.read(lengthArray.data(), m_dims[1] * sizeof(int64_t));
-    if (ByteOrderEnum::isSystemBigEndian())
-    {
-        ByteSwapping::swapBytes(lengthArray.data(), m_dims[1]);
-    }
-    m_indexArray[0] = 0;
-    for (int64_t i = 0; i < m_dims[1]; ++i)
+    int64_t xml_offset = -1;
+    if (isVersion1)
     {
-        if (lengthArray[i] > m_dims[0] || lengthArray[i] < 0) throw DataFileException("impossible value found in length array");
-        m_indexArray[i + 1] = m_indexArray[i] + lengthArray[i];
+        m_version = 1;
+        m_indexArray.resize(m_dims[1] + 1);
+        vector<int64_t> lengthArray(m_dims[1]);
+        m_file.read(lengthArray.data(), m_dims[1] * sizeof(int64_t));
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(lengthArray.data(), m_dims[1]);
+        }
+        m_indexArray[0] = 0;
+        for (int64_t i = 0; i < m_dims[1]; ++i)
+        {
+            if (lengthArray[i] > m_dims[0] || lengthArray[i] < 0) throw DataFileException("impossible value found in length array");
+            m_indexArray[i + 1] = m_indexArray[i] + lengthArray[i];
+        }
+        m_valuesOffset = 8 + 2 * sizeof(int64_t) + m_dims[1] * sizeof(int64_t);
+        xml_offset = m_valuesOffset + m_indexArray[m_dims[1]] * 2 * sizeof(int64_t);
+    } else {
+        m_version = 2;
+        m_file.read(&m_rowsPerBlock, sizeof(int64_t));
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(&m_rowsPerBlock, 1);
+        }
+        if (m_rowsPerBlock < 1) throw DataFileException("impossible number of rows per block in sparse file");
+        int64_t numBlocks = (m_dims[1] - 1) / m_rowsPerBlock + 1;
+        m_indexArray.resize(numBlocks + 1);
+        m_blockSizeArray.resize(numBlocks);
+        m_file.read(m_indexArray.data(), (numBlocks + 1) * sizeof(uint64_t));
+        m_file.read(m_blockSizeArray.data(), numBlocks * sizeof(uint64_t));
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(m_indexArray.data(), numBlocks + 1);
+            ByteSwapping::swapBytes(m_blockSizeArray.data(), numBlocks);
+        }
+        m_valuesOffset = 8 + 3 * sizeof(int64_t) + (2 * numBlocks + 1) * sizeof(uint64_t);
+        if (m_indexArray[0] != (uint64_t)m_valuesOffset) throw DataFileException("impossible value found in block offset array");
+        const uint64_t SIZE_LIMIT = numeric_limits<uint64_t>::max();
+        uint64_t maxBlockBytes = SIZE_LIMIT;//if the largest possible block doesn't fit in 64 bits, no block size is impossible
+        if ((uint64_t)m_dims[0] <= (SIZE_LIMIT - 10) / 24)
+        {//at most 24 bytes per nonzero: two varints of 10 bytes and 4 fixed bytes, plus a 10 byte varint for the row length
+            const uint64_t maxRowBytes = 10 + (uint64_t)m_dims[0] * 24;
+            if ((uint64_t)m_rowsPerBlock <= SIZE_LIMIT / maxRowBytes) maxBlockBytes = (uint64_t)m_rowsPerBlock * maxRowBytes;
+        }
+        for (int64_t i = 0; i < numBlocks; ++i)
+        {
+            if (m_indexArray[i + 1] < m_indexArray[i] || m_indexArray[i + 1] > (uint64_t)fileInfo.size()) throw DataFileException("impossible value found in block offset array");
+            if (m_blockSizeArray[i] > maxBlockBytes) throw DataFileException("impossible value found in block size array");
+        }
+        xml_offset = m_indexArray[numBlocks];
     }
-    m_valuesOffset = 8 + 2 * sizeof(int64_t) + m_dims[1] * sizeof(int64_t);
-    int64_t xml_offset = m_valuesOffset + m_indexArray[m_dims[1]] * 2 * sizeof(int64_t);
     if (xml_offset >= fileInfo.size()) throw DataFileException("file is truncated");
     int64_t xml_length = fileInfo.size() - xml_offset;
     if (xml_length < 1) throw DataFileException("file is truncated");
@@ -100,30 +217,108 @@ CaretSparseFile::~CaretSparseFile()
 {
 }
 
-void CaretSparseFile::getRow(const int64_t& index, int64_t* rowOut)
+void CaretSparseFile::readBytes(const int64_t& position, void* dataOut, const int64_t& count)
+{
+    if (m_supportsReadAt)
+    {
+        m_file.readAt(position, dataOut, count);
+        return;
+    }
+    CaretMutexLocker locked(&m_fileMutex);
+    m_file.seek(position);
+    m_file.read(dataOut, count);
+}
+
+void CaretSparseFile::readRowVersion1(const int64_t& index, vector<int64_t>& indicesOut, vector<int64_t>& valuesOut, vector<int64_t>& scratch)
 {
     CaretAssert(index >= 0 && index < m_dims[1]);
     int64_t start = m_indexArray[index], end = m_indexArray[index + 1];
-    int64_t numToRead = (end - start) * 2;
-    m_scratchArray.resize(numToRead);
-    m_file.seek(m_valuesOffset + start * sizeof(int64_t) * 2);
-    m_file.read(m_scratchArray.data(), numToRead * sizeof(int64_t));
+    int64_t numToRead = (end - start) * 2, numNonzero = end - start;
+    scratch.resize(numToRead);
+    readBytes(m_valuesOffset + start * sizeof(int64_t) * 2, scratch.data(), numToRead * sizeof(int64_t));
     if (ByteOrderEnum::isSystemBigEndian())
     {
-        ByteSwapping::swapBytes(m_scratchArray.data(), numToRead);
+        ByteSwapping::swapBytes(scratch.data(), numToRead);
+    }
+    indicesOut.resize(numNonzero);
+    valuesOut.resize(numNonzero);
+    int64_t lastIndex = -1;
+    for (int64_t i = 0; i < numNonzero; ++i)
+    {
+        indicesOut[i] = scratch[i * 2];
+        valuesOut[i] = scratch[i * 2 + 1];
+        if (indicesOut[i] <= lastIndex || indicesOut[i] >= m_dims[0]) throw DataFileException("impossible index value found in file");
+        lastIndex = indicesOut[i];
+    }
+}
+
+void CaretSparseFile::readBlock(const int64_t& block, DecodedBlock& blockOut)
+{
+    CaretAssert(m_version == 2);
+    CaretAssert(block >= 0 && block < (int64_t)m_blockSizeArray.size());
+    int64_t compressedSize = m_indexArray[block + 1] - m_indexArray[block];
+    uLongf uncompressedSize = m_blockSizeArray[block];
+    vector<unsigned char> compressed(compressedSize), uncompressed(uncompressedSize);
+    readBytes(m_indexArray[block], compressed.data(), compressedSize);
+    uLongf outSize = uncompressedSize;
+    if (uncompress(uncompressed.data(), &outSize, compressed.data(), compressedSize) != Z_OK || outSize != uncompressedSize)
+    {
+        throw DataFileException("failed to decompress block " + AString::number(block) + " of sparse file '" + m_file.getFilename() + "'");
+    }
+    int64_t firstRow = block * m_rowsPerBlock, numRows = min(m_rowsPerBlock, m_dims[1] - firstRow);
+    const unsigned char* pos = uncompressed.data(), *end = uncompressed.data() + uncompressed.size();
+    blockOut.m_rowStarts.resize(numRows + 1);
+    blockOut.m_indices.clear();
+    blockOut.m_values.clear();
+    blockOut.m_rowStarts[0] = 0;
+    for (int64_t row = 0; row < numRows; ++row)
+    {
+        uint64_t numNonzero = readVarint(pos, end);
+        if (numNonzero > (uint64_t)m_dims[0]) throw DataFileException("impossible row length found in sparse file");
+        int64_t lastIndex = -1;
+        for (uint64_t i = 0; i < numNonzero; ++i)
+        {
+            uint64_t delta = readVarint(pos, end);
+            if (delta >= (uint64_t)(m_dims[0] - lastIndex - 1)) throw DataFileException("impossible index value found in file");
+            lastIndex += delta + 1;
+            blockOut.m_indices.push_back(lastIndex);
+        }
+        for (uint64_t i = 0; i < numNonzero; ++i)
+        {
+            uint64_t high = readVarint(pos, end);
+            if (high > 0xFFFFFFFFULL || end - pos < 4) throw DataFileException("impossible value found in sparse file");
+            uint64_t low = (uint64_t)pos[0] | ((uint64_t)pos[1] << 8) | ((uint64_t)pos[2] << 16) | ((uint64_t)pos[3] << 24);
+            pos += 4;
+            blockOut.m_values.push_back((int64_t)((high << 32) | low));
+        }
+        blockOut.m_rowStarts[row + 1] = blockOut.m_indices.size();
     }
+    if (pos != end) throw DataFileException("sparse file block has extra data");
+}
+
+void CaretSparseFile::DecodedBlock::getRow(const int64_t& blockRow, vector<int64_t>& indicesOut, vector<int64_t>& valuesOut) const
+{
+    CaretAssert(blockRow >= 0 && blockRow + 1 < (int64_t)m_rowStarts.size());
+    int64_t start = m_rowStarts[blockRow], end = m_rowStarts[blockRow + 1];
+    indicesOut.assign(m_indices.begin() + start, m_indices.begin() + end);
+    valuesOut.assign(m_values.begin() + start, m_values.begin() + end);
+}
+
+void CaretSparseFile::getRow(const int64_t& index, int64_t* rowOut)
+{
+    getRowSparse(index, m_scratchIndices, m_scratchValues);
     int64_t curIndex = 0;
-    for (int64_t i = 0; i < numToRead; i += 2)
+    size_t numNonzero = m_scratchIndices.size();
+    for (size_t i = 0; i < numNonzero; ++i)
     {
-        int64_t index = m_scratchArray[i];
-        if (index < curIndex || index >= m_dims[0]) throw DataFileException("impossible index value found in file");
+        int64_t index = m_scratchIndices[i];
         while (curIndex < index)
         {
             rowOut[curIndex] = 0;
             ++curIndex;
         }
         ++curIndex;
-        rowOut[index] = m_scratchArray[i + 1];
+        rowOut[index] = m_scratchValues[i];
     }
     while (curIndex < m_dims[0])
     {
@@ -135,25 +330,111 @@ void CaretSparseFile::getRow(const int64_t& index, int64_t* rowOut)
 void CaretSparseFile::getRowSparse(const int64_t& index, vector<int64_t>& indicesOut, vector<int64_t>& valuesOut)
 {
     CaretAssert(index >= 0 && index < m_dims[1]);
-    int64_t start = m_indexArray[index], end = m_indexArray[index + 1];
-    int64_t numToRead = (end - start) * 2, numNonzero = end - start;
-    m_scratchArray.resize(numToRead);
-    m_file.seek(m_valuesOffset + start * sizeof(int64_t) * 2);
-    m_file.read(m_scratchArray.data(), numToRead * sizeof(int64_t));
-    if (ByteOrderEnum::isSystemBigEndian())
+    if (m_version == 1)
     {
-        ByteSwapping::swapBytes(m_scratchArray.data(), numToRead);
+        readRowVersion1(index, indicesOut, valuesOut, m_scratchArray);
+        return;
     }
-    indicesOut.resize(numNonzero);
-    valuesOut.resize(numNonzero);
-    int64_t lastIndex = -1;
-    for (int64_t i = 0; i < numNonzero; ++i)
+    int64_t block = index / m_rowsPerBlock;
+    if (block != m_cachedBlockIndex)
     {
-        indicesOut[i] = m_scratchArray[i * 2];
-        valuesOut[i] = m_scratchArray[i * 2 + 1];
-        if (indicesOut[i] <= lastIndex || indicesOut[i] >= m_dims[0]) throw DataFileException("impossible index value found in file");
-        lastIndex = indicesOut[i];
+        m_cachedBlockIndex = -1;//in case reading fails partway
+        readBlock(block, m_cachedBlock);
+        m_cachedBlockIndex = block;
+    }
+    m_cachedBlock.getRow(index - block * m_rowsPerBlock, indicesOut, valuesOut);
+}
+
+void CaretSparseFile::getRowsSparse(const vector<int64_t>& indices, vector<vector<int64_t> >& indicesOut, vector<vector<int64_t> >& valuesOut)
+{
+    int64_t numRows = (int64_t)indices.size();
+    indicesOut.resize(numRows);
+    valuesOut.resize(numRows);
+    for (int64_t i = 0; i < numRows; ++i)
+    {
+        if (indices[i] < 0 || indices[i] >= m_dims[1]) throw DataFileException("row index " + AString::number(indices[i]) + " is out of range for sparse file");
+    }
+    ParallelFailure myFailure;
+    if (m_version == 1)
+    {
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int64_t i = 0; i < numRows; ++i)
+        {
+            if (myFailure.failed()) continue;
+            try
+            {
+                vector<int64_t> scratch;
+                readRowVersion1(indices[i], indicesOut[i], valuesOut[i], scratch);
+            } catch (CaretException& e) {
+                myFailure.record(e.whatString(), false);
+            } catch (bad_alloc&) {
+                myFailure.record("", true);
+            } catch (exception& e) {
+                myFailure.record(e.what(), false);
+            }
+        }
+    } else {
+        map<int64_t, vector<int64_t> > blockRequests;//block to positions in indices, so each block is read and decoded once
+        for (int64_t i = 0; i < numRows; ++i)
+        {
+            blockRequests[indices[i] / m_rowsPerBlock].push_back(i);
+        }
+        vector<pair<int64_t, vector<int64_t> > > blockList(blockRequests.begin(), blockRequests.end());
+        int64_t numBlocks = (int64_t)blockList.size();
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int64_t b = 0; b < numBlocks; ++b)
+        {
+            if (myFailure.failed()) continue;
+            try
+            {
+                DecodedBlock decoded;
+                int64_t block = blockList[b].first, firstRow = block * m_rowsPerBlock;
+                readBlock(block, decoded);
+                const vector<int64_t>& positions = blockList[b].second;
+                for (size_t j = 0; j < positions.size(); ++j)
+                {
+                    decoded.getRow(indices[positions[j]] - firstRow, indicesOut[positions[j]], valuesOut[positions[j]]);
+                }
+            } catch (CaretException& e) {
+                myFailure.record(e.whatString(), false);
+            } catch (bad_alloc&) {
+                myFailure.record("", true);
+            } catch (exception& e) {
+                myFailure.record(e.what(), false);
+            }
+        }
     }
+    myFailure.rethrow();
+}
+
+void CaretSparseFile::getFibersRowsSparse(const vector<int64_t>& indices, vector<vector<int64_t> >& indicesOut, vector<vector<FiberFractions> >& valuesOut)
+{
+    vector<vector<int64_t> > coded;
+    getRowsSparse(indices, indicesOut, coded);
+    int64_t numRows = (int64_t)indices.size();
+    valuesOut.resize(numRows);
+    ParallelFailure myFailure;
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int64_t i = 0; i < numRows; ++i)
+    {
+        if (myFailure.failed()) continue;
+        try
+        {
+            size_t numNonzero = coded[i].size();
+            valuesOut[i].resize(numNonzero);
+            for (size_t j = 0; j < numNonzero; ++j)
+            {
+                decodeFibers((uint64_t)coded[i][j], valuesOut[i][j]);
+            }
+        } catch (CaretException& e) {
+            myFailure.record(e.whatString(), false);
+        } catch (bad_alloc&) {
+            myFailure.record("", true);
+        } catch (exception& e) {
+            myFailure.record(e.what(), false);
+        }
+    }
+    myFailure.rethrow();
 }
 
 void CaretSparseFile::getFibersRow(const int64_t& index, FiberFractions* rowOut)
@@ -206,12 +487,14 @@ void FiberFractions::zero()
     distance = 0.0f;
 }
 
-CaretSparseFileWriter::CaretSparseFileWriter(const AString& fileName, const CiftiXML& xml)
+CaretSparseFileWriter::CaretSparseFileWriter(const AString& fileName, const CiftiXML& xml, const int32_t& version)
 {
     if (!fileName.endsWith(".trajTEMP.wbsparse"))
     {//for now (and maybe forever), this format is single-purpose
         CaretLogWarning("sparse trajectory file '" + fileName + "' should be saved ending in .trajTEMP.wbsparse");
     }
+    if (version != 1 && version != 2) throw DataFileException("unsupported wbsparse version: " + AString::number(version));
+    m_version = version;
     m_finished = false;
     int64_t dimensions[2] = { xml.getDimensionLength(CiftiXML::ALONG_ROW), xml.getDimensionLength(CiftiXML::ALONG_COLUMN) };
     if (dimensions[0] < 1 || dimensions[1] < 1) throw DataFileException("both dimensions must be positive");
@@ -223,47 +506,107 @@ CaretSparseFileWriter::CaretSparseFileWriter(const AString& fileName, const Cift
         throw DataFileException("wbsparse files cannot be written compressed");
     }//because after we finish writing the data, we have to come back and write the lengths array
     m_file.open(fileName, CaretBinaryFile::WRITE_TRUNCATE);
-    m_file.write(magic, 8);
+    m_file.write((m_version == 1 ? magic : magicVersion2), 8);
     int64_t tempdims[2] = { m_dims[0], m_dims[1] };
     if (ByteOrderEnum::isSystemBigEndian())
     {
         ByteSwapping::swapBytes(tempdims, 2);
     }
     m_file.write(tempdims, 2 * sizeof(int64_t));
-    m_lengthArray.resize(m_dims[1], 0);//initialize the memory so that valgrind won't complain
-    m_file.write(m_lengthArray.data(), m_dims[1] * sizeof(uint64_t));//write it to get the file to the correct length
     m_nextRowIndex = 0;
-    m_valuesOffset = 8 + 2 * sizeof(int64_t) + m_dims[1] * sizeof(int64_t);
+    m_blockRows = 0;
+    m_blocksWritten = 0;
+    if (m_version == 1)
+    {
+        m_lengthArray.resize(m_dims[1], 0);//initialize the memory so that valgrind won't complain
+        m_file.write(m_lengthArray.data(), m_dims[1] * sizeof(uint64_t));//write it to get the file to the correct length
+        m_valuesOffset = 8 + 2 * sizeof(int64_t) + m_dims[1] * sizeof(int64_t);
+    } else {
+        int64_t rowsPerBlock = ROWS_PER_BLOCK;
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(&rowsPerBlock, 1);
+        }
+        m_file.write(&rowsPerBlock, sizeof(int64_t));
+        int64_t numBlocks = (m_dims[1] - 1) / ROWS_PER_BLOCK + 1;
+        m_lengthArray.resize(numBlocks + 1, 0);
+        m_blockSizeArray.resize(numBlocks, 0);
+        m_file.write(m_lengthArray.data(), (numBlocks + 1) * sizeof(uint64_t));//filled in by finish()
+        m_file.write(m_blockSizeArray.data(), numBlocks * sizeof(uint64_t));
+        m_valuesOffset = 8 + 3 * sizeof(int64_t) + (2 * numBlocks + 1) * sizeof(uint64_t);
+        m_lengthArray[0] = m_valuesOffset;
+    }
 }
 
-void CaretSparseFileWriter::writeRow(const int64_t& index, const int64_t* row)
+void CaretSparseFileWriter::skipToRow(const int64_t& index)
 {
-    CaretAssert(index < m_dims[1]);
-    CaretAssert(index >= m_nextRowIndex);
     while (m_nextRowIndex < index)
     {
-        m_lengthArray[m_nextRowIndex] = 0;
+        if (m_version == 1)
+        {
+            m_lengthArray[m_nextRowIndex] = 0;
+        } else {
+            appendBlockRow(NULL, NULL, 0);
+        }
         ++m_nextRowIndex;
     }
+}
+
+void CaretSparseFileWriter::appendBlockRow(const int64_t* indices, const int64_t* values, const int64_t& count)
+{
+    CaretAssert(m_version == 2);
+    appendVarint(m_blockBuffer, count);
+    int64_t lastIndex = -1;
+    for (int64_t i = 0; i < count; ++i)
+    {
+        appendVarint(m_blockBuffer, indices[i] - lastIndex - 1);
+        lastIndex = indices[i];
+    }
+    for (int64_t i = 0; i < count; ++i)
+    {
+        uint64_t value = (uint64_t)values[i];
+        appendVarint(m_blockBuffer, value >> 32);
+        for (int j = 0; j < 4; ++j)
+        {
+            m_blockBuffer.push_back((unsigned char)((value >> (8 * j)) & 0xFF));
+        }
+    }
+    ++m_blockRows;
+    if (m_blockRows == ROWS_PER_BLOCK) flushBlock();
+}
+
+void CaretSparseFileWriter::flushBlock()
+{
+    if (m_blockRows == 0) return;
+    int64_t block = m_blocksWritten;
+    CaretAssert(block < (int64_t)m_blockSizeArray.size());
+    uLongf compressedSize = compressBound(m_blockBuffer.size());
+    m_compressBuffer.resize(compressedSize);
+    if (compress2(m_compressBuffer.data(), &compressedSize, m_blockBuffer.data(), m_blockBuffer.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        throw DataFileException("failed to compress block of sparse file '" + m_file.getFilename() + "'");
+    }
+    m_file.write(m_compressBuffer.data(), compressedSize);
+    m_blockSizeArray[block] = m_blockBuffer.size();
+    m_lengthArray[block + 1] = m_lengthArray[block] + compressedSize;
+    m_blockBuffer.clear();
+    m_blockRows = 0;
+    ++m_blocksWritten;
+}
+
+void CaretSparseFileWriter::writeRow(const int64_t& index, const int64_t* row)
+{
+    m_scratchIndices.clear();
     m_scratchArray.clear();
-    int64_t count = 0;
     for (int64_t i = 0; i < m_dims[0]; ++i)
     {
         if (row[i] != 0)
         {
-            m_scratchArray.push_back(i);
+            m_scratchIndices.push_back(i);
             m_scratchArray.push_back(row[i]);
-            ++count;
         }
     }
-    m_lengthArray[index] = count;
-    if (ByteOrderEnum::isSystemBigEndian())
-    {
-        ByteSwapping::swapBytes(m_scratchArray.data(), m_scratchArray.size());
-    }
-    m_file.write(m_scratchArray.data(), m_scratchArray.size() * sizeof(int64_t));
-    m_nextRowIndex = index + 1;
-    if (m_nextRowIndex == m_dims[1]) finish();
+    writeRowSparse(index, m_scratchIndices, m_scratchArray);
 }
 
 void CaretSparseFileWriter::writeRowSparse(const int64_t& index, const vector<int64_t>& indices, const vector<int64_t>& values)
@@ -271,31 +614,34 @@ void CaretSparseFileWriter::writeRowSparse(const int64_t& index, const vector<in
     CaretAssert(index < m_dims[1]);
     CaretAssert(index >= m_nextRowIndex);
     CaretAssert(indices.size() == values.size());
-    while (m_nextRowIndex < index)
-    {
-        m_lengthArray[m_nextRowIndex] = 0;
-        ++m_nextRowIndex;
-    }
-    m_scratchArray.clear();
+    skipToRow(index);
     size_t numNonzero = indices.size();//assume no zeros
-    m_lengthArray[index] = numNonzero;
     int64_t lastIndex = -1;
     for (size_t i = 0; i < numNonzero; ++i)
     {
         if (indices[i] <= lastIndex || indices[i] >= m_dims[0]) throw DataFileException("indices must be sorted when writing sparse rows");
         lastIndex = indices[i];
-        m_scratchArray.push_back(indices[i]);
-        m_scratchArray.push_back(values[i]);
     }
-    if (ByteOrderEnum::isSystemBigEndian())
+    if (m_version == 1)
     {
-        ByteSwapping::swapBytes(m_scratchArray.data(), m_scratchArray.size());
+        m_lengthArray[index] = numNonzero;
+        vector<int64_t> interleaved(numNonzero * 2);
+        for (size_t i = 0; i < numNonzero; ++i)
+        {
+            interleaved[i * 2] = indices[i];
+            interleaved[i * 2 + 1] = values[i];
+        }
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(interleaved.data(), interleaved.size());
+        }
+        m_file.write(interleaved.data(), interleaved.size() * sizeof(int64_t));
+    } else {
+        appendBlockRow(indices.data(), values.data(), numNonzero);
     }
-    m_file.write(m_scratchArray.data(), m_scratchArray.size() * sizeof(int64_t));
     m_nextRowIndex = index + 1;
     if (m_nextRowIndex == m_dims[1]) finish();
 }
-
 void CaretSparseFileWriter::writeFibersRow(const int64_t& index, const FiberFractions* row)
 {
     if (m_scratchRow.size() != (size_t)m_dims[0]) m_scratchRow.resize(m_dims[0]);
@@ -326,19 +672,29 @@ void CaretSparseFileWriter::finish()
 {
     if (m_finished) return;
     m_finished = true;
-    while (m_nextRowIndex < m_dims[1])
-    {
-        m_lengthArray[m_nextRowIndex] = 0;
-        ++m_nextRowIndex;
-    }
+    skipToRow(m_dims[1]);
     QByteArray myXMLBytes = m_xml.writeXMLToQByteArray();
-    m_file.write(myXMLBytes.constData(), myXMLBytes.size());
-    m_file.seek(8 + 2 * sizeof(int64_t));
-    if (ByteOrderEnum::isSystemBigEndian())
+    if (m_version == 1)
     {
-        ByteSwapping::swapBytes(m_lengthArray.data(), m_lengthArray.size());
+        m_file.write(myXMLBytes.constData(), myXMLBytes.size());
+        m_file.seek(8 + 2 * sizeof(int64_t));
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(m_lengthArray.data(), m_lengthArray.size());
+        }
+        m_file.write(m_lengthArray.data(), m_lengthArray.size() * sizeof(uint64_t));
+    } else {
+        flushBlock();
+        m_file.write(myXMLBytes.constData(), myXMLBytes.size());
+        m_file.seek(8 + 3 * sizeof(int64_t));
+        if (ByteOrderEnum::isSystemBigEndian())
+        {
+            ByteSwapping::swapBytes(m_lengthArray.data(), m_lengthArray.size());
+            ByteSwapping::swapBytes(m_blockSizeArray.data(), m_blockSizeArray.size());
+        }
+        m_file.write(m_lengthArray.data(), m_lengthArray.size() * sizeof(uint64_t));
+        m_file.write(m_blockSizeArray.data(), m_blockSizeArray.size() * sizeof(uint64_t));
     }
-    m_file.write(m_lengthArray.data(), m_lengthArray.size() * sizeof(uint64_t));
     m_file.close();
 }
 
@@ -26,6 +26,7 @@
 
 #include "AString.h"
 #include "CaretBinaryFile.h"
+#include "CaretMutex.h"
 #include "CiftiXML.h"
 #include "DataFile.h"
 #include "DataFileException.h"
@@ -40,19 +41,38 @@ namespace caret {
         void zero();
     };
     
+    ///version 1 stores each nonzero as a raw int64 index and value, with a table of row lengths
+    ///version 2 stores blocks of rows, each compressed with zlib, with the column indices as varint deltas and the values split
+    ///into a varint of the high 32 bits (the streamline count in trajectory files) and 4 fixed bytes of the low 32 bits (the packed fractions and distance)
     class CaretSparseFile /* : public DataFile */
     {
+        ///rows of one version 2 block, decoded
+        struct DecodedBlock
+        {
+            std::vector<int64_t> m_rowStarts, m_indices, m_values;
+            void getRow(const int64_t& blockRow, std::vector<int64_t>& indicesOut, std::vector<int64_t>& valuesOut) const;
+        };
         static void decodeFibers(const uint64_t& coded, FiberFractions& decoded);//takes a uint because right shift on signed is implementation dependent
         CaretBinaryFile m_file;
-        int64_t m_dims[2], m_valuesOffset;
-        std::vector<uint64_t> m_indexArray, m_scratchRow;
-        std::vector<int64_t> m_scratchArray, m_scratchSparseRow;
+        CaretMutex m_fileMutex;//for seek and read when the file doesn't support positional reads
+        bool m_supportsReadAt;
+        int32_t m_version;
+        int64_t m_dims[2], m_valuesOffset, m_rowsPerBlock, m_cachedBlockIndex;
+        std::vector<uint64_t> m_indexArray, m_scratchRow;//version 1: start of each row in values, version 2: file offset of each block, plus the end of the last block
+        std::vector<uint64_t> m_blockSizeArray;//version 2: uncompressed size of each block
+        std::vector<int64_t> m_scratchArray, m_scratchSparseRow, m_scratchIndices, m_scratchValues;
+        DecodedBlock m_cachedBlock;//version 2: the last block used by the single row functions
         CaretSparseFile(const CaretSparseFile& rhs);
         CiftiXML m_xml;
+        void readBytes(const int64_t& position, void* dataOut, const int64_t& count);
+        void readRowVersion1(const int64_t& index, std::vector<int64_t>& indicesOut, std::vector<int64_t>& valuesOut, std::vector<int64_t>& scratch);
+        void readBlock(const int64_t& block, DecodedBlock& blockOut);
     public:
         const int64_t* getDimensions() { return m_dims; }
+        
+        int32_t getVersion() const { return m_version; }
 
-        CaretSparseFile() {};
+        CaretSparseFile() { m_version = 0; m_cachedBlockIndex = -1; m_supportsReadAt = false; }
         
         virtual void readFile(const AString& filename);
         
@@ -70,6 +90,12 @@ namespace caret {
         void getFibersRow(const int64_t& index, FiberFractions* rowOut);
         
         void getFibersRowSparse(const int64_t& index, std::vector<int64_t>& indicesOut, std::vector<FiberFractions>& valuesOut);
+        
+        ///fetch and decode many rows using multiple threads, doesn't use the scratch space of the single row functions, so it is also safe to call from multiple threads at once
+        void getRowsSparse(const std::vector<int64_t>& indices, std::vector<std::vector<int64_t> >& indicesOut, std::vector<std::vector<int64_t> >& valuesOut);
+        
+        ///same as getRowsSparse, but decodes the values as fibers
+        void getFibersRowsSparse(const std::vector<int64_t>& indices, std::vector<std::vector<int64_t> >& indicesOut, std::vector<std::vector<FiberFractions> >& valuesOut);
 
         virtual ~CaretSparseFile();
     };
@@ -79,14 +105,21 @@ namespace caret {
         static void encodeFibers(const FiberFractions& orig, uint64_t& coded);
         static uint32_t myclamp(const int& x);
         CaretBinaryFile m_file;
-        int64_t m_dims[2], m_valuesOffset, m_nextRowIndex;
+        int32_t m_version;
+        int64_t m_dims[2], m_valuesOffset, m_nextRowIndex, m_blockRows, m_blocksWritten;
         bool m_finished;
-        std::vector<uint64_t> m_lengthArray, m_scratchRow;
-        std::vector<int64_t> m_scratchArray, m_scratchSparseRow;
+        std::vector<uint64_t> m_lengthArray, m_scratchRow;//version 1: length of each row, version 2: file offset of each block, plus the end of the last block
+        std::vector<uint64_t> m_blockSizeArray;
+        std::vector<int64_t> m_scratchArray, m_scratchSparseRow, m_scratchIndices;
+        std::vector<unsigned char> m_blockBuffer, m_compressBuffer;
         CaretSparseFileWriter(const CaretSparseFileWriter& rhs);
         CiftiXML m_xml;
+        void skipToRow(const int64_t& index);
+        void appendBlockRow(const int64_t* indices, const int64_t* values, const int64_t& count);
+        void flushBlock();
     public:
-        CaretSparseFileWriter(const AString& fileName, const CiftiXML& xml);
+        ///version 1 is the original uncompressed format, for compatibility with older versions of workbench
+        CaretSparseFileWriter(const AString& fileName, const CiftiXML& xml, const int32_t& version = 2);
         
         ~CaretSparseFileWriter();
         
@@ -19,6 +19,7 @@
  */
 /*LICENSE_END*/
 
+#include <algorithm>
 #include <map>
 #include <set>
 
@@ -1003,8 +1004,13 @@ CiftiFiberTrajectoryFile::writeLoadedDataToFile(const AString& filename) const
     tempMap.setMapName(0, m_loadedDataDescriptionForMapName);
     xml.setMap(CiftiXML::ALONG_COLUMN, tempMap);
     
+    /*
+     * Use the original uncompressed format, so the file can be
+     * opened by older versions of workbench.
+     */
     CaretSparseFileWriter sparseWriter(filename,
-                                       xml);
+                                       xml,
+                                       1);
     const int64_t rowIndex = 0;
     if (isWriteFullRow) {
         sparseWriter.writeFibersRow(rowIndex,
@@ -1389,15 +1395,16 @@ CiftiFiberTrajectoryFile::loadRowsForAveraging(const std::vector<int64_t>& rowIn
     const CiftiXML& trajXML = m_sparseFile->getCiftiXML();
     const int64_t numberOfColumns = trajXML.getDimensionLength(CiftiXML::ALONG_ROW);
     
-    std::vector<FiberFractions> fiberFractionsForRowVector(numberOfColumns);
-    FiberFractions* fiberFractionsForRow = &fiberFractionsForRowVector[0];
-    
     const int64_t numberOfRowsToLoad = static_cast<int64_t>(rowIndices.size());
     if (numberOfRowsToLoad <= 0) {
         return false;
     }
     
-    const int32_t progressUpdateInterval = 1;
+    /*
+     * Rows are read and decoded in parallel, a batch at a time,
+     * so that progress is updated and cancelling is possible.
+     */
+    const int64_t rowsPerBatch = 64;
     EventProgressUpdate progressEvent(0,
                                       numberOfRowsToLoad,
                                       0,
@@ -1416,25 +1423,49 @@ CiftiFiberTrajectoryFile::loadRowsForAveraging(const std::vector<int64_t>& rowIn
     
     bool userCancelled = false;
     
-    for (int64_t iRow = 0; iRow < numberOfRowsToLoad; iRow++) {
-        const int64_t rowIndex = rowIndices[iRow];
-        
-        if ((iRow % progressUpdateInterval) == 0) {
-            progressEvent.setProgress(iRow,
-                                      "");
-            EventManager::get()->sendEvent(progressEvent.getPointer());
-            if (progressEvent.isCancelled()) {
-                userCancelled = true;
-                break;
-            }
+    FiberFractions zeroFiberFractions;
+    zeroFiberFractions.zero();
+    
+    std::vector<std::vector<int64_t> > batchFiberIndices;
+    std::vector<std::vector<FiberFractions> > batchFiberFractions;
+    
+    for (int64_t batchStart = 0; batchStart < numberOfRowsToLoad; batchStart += rowsPerBatch) {
+        progressEvent.setProgress(batchStart,
+                                  "");
+        EventManager::get()->sendEvent(progressEvent.getPointer());
+        if (progressEvent.isCancelled()) {
+            userCancelled = true;
+            break;
         }
         
-        m_sparseFile->getFibersRow(rowIndex,
-                                   fiberFractionsForRow);
+        const int64_t batchEnd = std::min(batchStart + rowsPerBatch,
+                                          numberOfRowsToLoad);
+        const std::vector<int64_t> batchRowIndices(rowIndices.begin() + batchStart,
+                                                   rowIndices.begin() + batchEnd);
+        m_sparseFile->getFibersRowsSparse(batchRowIndices,
+                                          batchFiberIndices,
+                                          batchFiberFractions);
         
-        for (int64_t iCol = 0; iCol < numberOfColumns; iCol++) {
-            FiberOrientationTrajectory* fot = m_fiberOrientationTrajectories[iCol];
-            fot->addFiberFractionsForAveraging(fiberFractionsForRow[iCol]);
+        for (int64_t iRow = 0; iRow < (batchEnd - batchStart); iRow++) {
+            const std::vector<int64_t>& fiberIndices = batchFiberIndices[iRow];
+            const std::vector<FiberFractions>& fiberFractions = batchFiberFractions[iRow];
+            const int64_t numFibers = static_cast<int64_t>(fiberIndices.size());
+            
+            /*
+             * Columns not in the sparse row are zero and still count toward the average
+             */
+            int64_t iFiber = 0;
+            for (int64_t iCol = 0; iCol < numberOfColumns; iCol++) {
+                FiberOrientationTrajectory* fot = m_fiberOrientationTrajectories[iCol];
+                if ((iFiber < numFibers)
+                    && (fiberIndices[iFiber] == iCol)) {
+                    fot->addFiberFractionsForAveraging(fiberFractions[iFiber]);
+                    iFiber++;
+                }
+                else {
+                    fot->addFiberFractionsForAveraging(zeroFiberFractions);
+                }
+            }
         }
     }
     
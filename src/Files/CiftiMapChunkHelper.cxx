@@ -0,0 +1,265 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CiftiMapChunkHelper.h"
+
+#include "CaretAssert.h"
+#include "CaretException.h"
+#include "CaretLogger.h"
+#include "CiftiFile.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+#include <algorithm>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const int64_t DEFAULT_CHUNK_BYTES = ((int64_t)1)<<30;//without a limit, don't let a chunk grow to the size of the whole file
+    const int64_t IO_CHUNK = 1<<30;//qt4 uses int for sizes
+    
+    void writeAll(QFile& file, const char* data, const int64_t& count)
+    {
+        for (int64_t done = 0; done < count; done += IO_CHUNK)
+        {
+            int64_t toWrite = min(IO_CHUNK, count - done);
+            if (file.write(data + done, toWrite) != toWrite)
+            {
+                throw CaretException("failed to write to temporary file '" + file.fileName() + "'");
+            }
+        }
+    }
+    
+    void readAll(QFile& file, char* data, const int64_t& count)
+    {
+        for (int64_t done = 0; done < count; done += IO_CHUNK)
+        {
+            int64_t toRead = min(IO_CHUNK, count - done);
+            if (file.read(data + done, toRead) != toRead)
+            {
+                throw CaretException("failed to read from temporary file '" + file.fileName() + "'");
+            }
+        }
+    }
+    
+    void seekTo(QFile& file, const int64_t& offset)
+    {
+        if (!file.seek(offset))
+        {
+            throw CaretException("failed to seek in temporary file '" + file.fileName() + "'");
+        }
+    }
+}
+
+CiftiMapChunkHelper::CiftiMapChunkHelper(const CiftiFile* input, CiftiFile* output, const int& direction, const float& memLimitGB, const int64_t& extraBytesPerMap)
+{
+    CaretAssert(input != NULL && output != NULL);
+    const vector<int64_t>& inDims = input->getDimensions(), &outDims = output->getDimensions();
+    if (inDims.size() != 2 || outDims.size() != 2) throw CaretException("chunked map processing only supports 2D cifti");
+    if (direction != CiftiXML::ALONG_ROW && direction != CiftiXML::ALONG_COLUMN) throw CaretException("invalid direction for chunked map processing");
+    m_input = input;
+    m_output = output;
+    m_direction = direction;
+    m_inLength = inDims[direction];
+    m_outLength = outDims[direction];
+    m_numMaps = inDims[1 - direction];
+    if (outDims[1 - direction] != m_numMaps) throw CaretException("output cifti has a different number of maps than the input");
+    int64_t fixedBytes;
+    if (m_direction == CiftiXML::ALONG_COLUMN)
+    {
+        m_rowScratch.resize(m_numMaps);
+        fixedBytes = sizeof(float) * m_numMaps;
+    } else {
+        m_rowScratch.resize(max(m_inLength, m_outLength));
+        fixedBytes = sizeof(float) * max(m_inLength, m_outLength);
+    }
+    m_mapsPerChunk = m_numMaps;
+    if (m_numMaps > 1)
+    {
+        int64_t targetBytes = DEFAULT_CHUNK_BYTES;
+        if (memLimitGB >= 0.0f)
+        {
+            targetBytes = (int64_t)(memLimitGB * 1024 * 1024 * 1024) - fixedBytes;
+            if (m_output->isInMemory()) targetBytes -= sizeof(float) * m_outLength * m_numMaps;
+        }
+        int64_t bytesPerMap = sizeof(float) * (m_inLength + m_outLength) + extraBytesPerMap;
+        int64_t maxMaps = targetBytes / bytesPerMap;
+        if (maxMaps < 1)
+        {
+            if (memLimitGB >= 0.0f) CaretLogWarning("requested memory limit is too low, processing only 1 map at a time - this may be extremely slow");
+            maxMaps = 1;
+        }
+        int64_t numPasses = (m_numMaps - 1) / maxMaps + 1;
+        m_mapsPerChunk = (m_numMaps - 1) / numPasses + 1;//most even distribution for that number of passes
+    }
+    m_chunkStart = 0;
+    m_chunkSize = 0;
+    m_chunksWritten = 0;
+}
+
+CiftiMapChunkHelper::~CiftiMapChunkHelper()
+{//QTemporaryFile is only declared in the header
+}
+
+bool CiftiMapChunkHelper::usesChunkFiles() const
+{//along rows, a chunk is a set of whole rows, so nothing is read or written twice anyway
+    return m_direction == CiftiXML::ALONG_COLUMN && getNumberOfChunks() > 1;
+}
+
+void CiftiMapChunkHelper::openChunkFile(CaretPointer<QTemporaryFile>& file, const char* what)
+{
+    AString tempTemplate = QDir::tempPath() + "/wb_cifti_chunks." + what + ".XXXXXX";
+    if (!m_output->isInMemory() && m_output->getFileName() != "")
+    {//temp is often small or in memory, and these are the size of the whole file
+        QFileInfo outInfo(m_output->getFileName());
+        tempTemplate = outInfo.absolutePath() + "/." + outInfo.fileName() + ".chunks." + what + ".XXXXXX";
+    }
+    file.grabNew(new QTemporaryFile(tempTemplate));
+    if (!file->open())
+    {
+        throw CaretException("failed to create temporary file '" + tempTemplate + "'");
+    }
+}
+
+void CiftiMapChunkHelper::spoolInput()
+{//read each input row once, a tile of rows at a time, the rows of a tile are then a contiguous piece of every chunk's block
+    openChunkFile(m_inTemp, "in");
+    int64_t numChunks = getNumberOfChunks();
+    int64_t tileRows = max((int64_t)1, min(m_inLength, m_inLength * m_mapsPerChunk / m_numMaps));//no more than one chunk's worth of memory
+    vector<float> tile(tileRows * m_numMaps);
+    for (int64_t tileStart = 0; tileStart < m_inLength; tileStart += tileRows)
+    {
+        int64_t thisTileRows = min(tileRows, m_inLength - tileStart);
+        for (int64_t i = 0; i < thisTileRows; ++i)
+        {
+            m_input->getRow(tile.data() + i * m_numMaps, tileStart + i);
+        }
+        for (int64_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            int64_t chunkStart = chunk * m_mapsPerChunk, chunkSize = min(m_mapsPerChunk, m_numMaps - chunkStart);
+            seekTo(*m_inTemp, sizeof(float) * (chunkStart * m_inLength + tileStart * chunkSize));//all earlier chunks are full size
+            for (int64_t i = 0; i < thisTileRows; ++i)
+            {
+                writeAll(*m_inTemp, (const char*)(tile.data() + i * m_numMaps + chunkStart), sizeof(float) * chunkSize);
+            }
+        }
+    }
+}
+
+void CiftiMapChunkHelper::readChunk(const int64_t& chunk)
+{
+    CaretAssert(chunk >= 0 && chunk < getNumberOfChunks());
+    m_chunkStart = chunk * m_mapsPerChunk;
+    m_chunkSize = min(m_mapsPerChunk, m_numMaps - m_chunkStart);
+    m_inData.resize(m_inLength * m_chunkSize);
+    m_outData.resize(m_outLength * m_chunkSize);
+    fill(m_outData.begin(), m_outData.end(), 0.0f);
+    if (m_direction == CiftiXML::ALONG_COLUMN)
+    {
+        if (usesChunkFiles() && !m_input->isInMemory())
+        {//rereading an on-disk input for each chunk would be a pass over the file per chunk, an in-memory input is cheaper to reread than a temporary file
+            if (m_inTemp == NULL) spoolInput();
+            seekTo(*m_inTemp, sizeof(float) * m_chunkStart * m_inLength);
+            readAll(*m_inTemp, (char*)m_inData.data(), sizeof(float) * m_inLength * m_chunkSize);
+        } else {//brainordinates are rows, so every row is read, but only this chunk's part of it is kept
+            for (int64_t i = 0; i < m_inLength; ++i)
+            {
+                m_input->getRow(m_rowScratch.data(), i);
+                float* dest = m_inData.data() + i * m_chunkSize;
+                for (int64_t j = 0; j < m_chunkSize; ++j)
+                {
+                    dest[j] = m_rowScratch[m_chunkStart + j];
+                }
+            }
+        }
+    } else {
+        for (int64_t j = 0; j < m_chunkSize; ++j)
+        {
+            m_input->getRow(m_rowScratch.data(), m_chunkStart + j);
+            for (int64_t i = 0; i < m_inLength; ++i)
+            {
+                m_inData[i * m_chunkSize + j] = m_rowScratch[i];
+            }
+        }
+    }
+}
+
+void CiftiMapChunkHelper::assembleOutput()
+{//the reverse of spoolInput, gather a tile of output rows from every chunk's block, and write each row once
+    int64_t numChunks = getNumberOfChunks();
+    int64_t tileRows = max((int64_t)1, min(m_outLength, m_outLength * m_mapsPerChunk / m_numMaps));
+    vector<float>().swap(m_inData);//chunk buffers aren't needed anymore, make room for the tile
+    vector<float>().swap(m_outData);
+    vector<float> tile(tileRows * m_numMaps);
+    for (int64_t tileStart = 0; tileStart < m_outLength; tileStart += tileRows)
+    {
+        int64_t thisTileRows = min(tileRows, m_outLength - tileStart);
+        for (int64_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            int64_t chunkStart = chunk * m_mapsPerChunk, chunkSize = min(m_mapsPerChunk, m_numMaps - chunkStart);
+            seekTo(*m_outTemp, sizeof(float) * (chunkStart * m_outLength + tileStart * chunkSize));
+            for (int64_t i = 0; i < thisTileRows; ++i)
+            {
+                readAll(*m_outTemp, (char*)(tile.data() + i * m_numMaps + chunkStart), sizeof(float) * chunkSize);
+            }
+        }
+        for (int64_t i = 0; i < thisTileRows; ++i)
+        {
+            m_output->setRow(tile.data() + i * m_numMaps, tileStart + i);
+        }
+    }
+    m_inTemp.grabNew(NULL);//deletes the temporary files
+    m_outTemp.grabNew(NULL);
+}
+
+void CiftiMapChunkHelper::writeChunk()
+{
+    CaretAssert(m_chunkSize > 0);
+    ++m_chunksWritten;
+    CaretAssert(m_chunksWritten <= getNumberOfChunks());
+    if (m_direction == CiftiXML::ALONG_COLUMN)
+    {
+        if (usesChunkFiles())
+        {//output rows aren't complete until the last chunk, so hold chunks in a temporary file rather than rewriting every row once per chunk
+            if (m_outTemp == NULL) openChunkFile(m_outTemp, "out");
+            seekTo(*m_outTemp, sizeof(float) * m_chunkStart * m_outLength);
+            writeAll(*m_outTemp, (const char*)m_outData.data(), sizeof(float) * m_outLength * m_chunkSize);
+            if (m_chunksWritten == getNumberOfChunks()) assembleOutput();
+        } else {
+            for (int64_t i = 0; i < m_outLength; ++i)
+            {
+                m_output->setRow(m_outData.data() + i * m_chunkSize, i);
+            }
+        }
+    } else {
+        for (int64_t j = 0; j < m_chunkSize; ++j)
+        {
+            for (int64_t i = 0; i < m_outLength; ++i)
+            {
+                m_rowScratch[i] = m_outData[i * m_chunkSize + j];
+            }
+            m_output->setRow(m_rowScratch.data(), m_chunkStart + j);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef __CIFTI_MAP_CHUNK_HELPER_H__
+#define __CIFTI_MAP_CHUNK_HELPER_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CaretPointer.h"
+
+#include "stdint.h"
+#include <vector>
+
+class QTemporaryFile;
+
+namespace caret {
+
+    class CiftiFile;
+
+    ///moves whole maps of a 2D cifti file through memory a bounded chunk at a time, for algorithms that need all brainordinates of a map at once
+    ///chunk data is brainordinate-major (data[index * chunkSize + map]), so maps of the same brainordinate are contiguous, as multiplyInterleaved wants
+    ///the output file must already have its XML set, and must have the same number of maps as the input, but may have different brainordinates
+    ///when direction is ALONG_COLUMN and there is more than one chunk, an on-disk input is read once into a chunk-major temporary file, and the output
+    ///goes to another one until the last chunk is written, then every output row is written once - the temporary files go next to the output file
+    class CiftiMapChunkHelper
+    {
+        const CiftiFile* m_input;
+        CiftiFile* m_output;
+        int m_direction;
+        int64_t m_inLength, m_outLength, m_numMaps, m_mapsPerChunk, m_chunkStart, m_chunkSize, m_chunksWritten;
+        std::vector<float> m_inData, m_outData, m_rowScratch;
+        CaretPointer<QTemporaryFile> m_inTemp, m_outTemp;
+        CiftiMapChunkHelper();
+        CiftiMapChunkHelper(const CiftiMapChunkHelper&);
+        CiftiMapChunkHelper& operator=(const CiftiMapChunkHelper&);
+        bool usesChunkFiles() const;
+        void openChunkFile(CaretPointer<QTemporaryFile>& file, const char* what);
+        void spoolInput();
+        void assembleOutput();
+    public:
+        ///direction is the dimension that has the brainordinates, memLimitGB < 0 uses a default limit of about 1GB for the chunk buffers
+        ///extraBytesPerMap is the caller's own per-map temporary memory, so it can be counted against the limit
+        CiftiMapChunkHelper(const CiftiFile* input, CiftiFile* output, const int& direction, const float& memLimitGB = -1.0f, const int64_t& extraBytesPerMap = 0);
+        ~CiftiMapChunkHelper();
+        int64_t getNumberOfMaps() const { return m_numMaps; }
+        int64_t getNumberOfChunks() const { return (m_numMaps - 1) / m_mapsPerChunk + 1; }
+        int64_t getMapsPerChunk() const { return m_mapsPerChunk; }
+        ///read all brainordinates of the maps in a chunk, and zero the output buffer
+        void readChunk(const int64_t& chunk);
+        int64_t getChunkStart() const { return m_chunkStart; }
+        int64_t getChunkSize() const { return m_chunkSize; }
+        const float* getInputData() const { return m_inData.data(); }
+        float* getOutputData() { return m_outData.data(); }
+        ///write the output buffer for the current chunk, every chunk must be written exactly once, the output file is complete after the last one
+        void writeChunk();
+    };
+
+}
+
+#endif //__CIFTI_MAP_CHUNK_HELPER_H__
@@ -0,0 +1,317 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CiftiMapStatisticsCache.h"
+
+#include "CaretAssert.h"
+#include "CaretLogger.h"
+#include "CaretOMP.h"
+#include "CiftiFile.h"
+#include "DataFile.h"
+#include "DataFileException.h"
+#include "FileInformation.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const char CACHE_MAGIC[8] = { 'W', 'B', 'S', 'T', 'A', 'T', 'S', '\0' };
+    const int32_t CACHE_VERSION = 1;
+    const int32_t BYTE_ORDER_CHECK = 0x01020304;//written in native order, a mismatch just means a cache miss
+    const int64_t IO_CHUNK = 1<<30;//qt4 uses int for sizes
+    
+    //flags before each map, and before the file statistics
+    const char HAS_FAST_STATISTICS = 1;
+    const char HAS_HISTOGRAM = 2;
+    
+    template <typename T>
+    void writeValue(ostream& stream, const T& value)
+    {
+        stream.write((const char*)&value, sizeof(T));
+    }
+    
+    template <typename T>
+    bool readValue(istream& stream, T& value)
+    {
+        stream.read((char*)&value, sizeof(T));
+        return !stream.fail();
+    }
+    
+    void writeStatistics(ostream& stream, const CaretPointer<FastStatistics>& fastStatistics, const CaretPointer<Histogram>& histogram)
+    {
+        char flags = 0;
+        if (fastStatistics != NULL) flags |= HAS_FAST_STATISTICS;
+        if (histogram != NULL) flags |= HAS_HISTOGRAM;
+        stream.put(flags);
+        if (fastStatistics != NULL) fastStatistics->writeBinary(stream);
+        if (histogram != NULL) histogram->writeBinary(stream);
+    }
+    
+    bool readStatistics(istream& stream, CaretPointer<FastStatistics>& fastStatisticsOut, CaretPointer<Histogram>& histogramOut)
+    {
+        fastStatisticsOut.grabNew(NULL);
+        histogramOut.grabNew(NULL);
+        int flags = stream.get();
+        if (flags == istream::traits_type::eof()) return false;
+        if ((flags & HAS_FAST_STATISTICS) != 0)
+        {
+            fastStatisticsOut.grabNew(new FastStatistics());
+            if (!fastStatisticsOut->readBinary(stream)) return false;
+        }
+        if ((flags & HAS_HISTOGRAM) != 0)
+        {
+            histogramOut.grabNew(new Histogram());
+            if (!histogramOut->readBinary(stream)) return false;
+        }
+        return true;
+    }
+}
+
+AString CiftiMapStatisticsCache::getCacheFileName(const AString& dataFileName)
+{
+    return dataFileName + ".wbstats";
+}
+
+bool CiftiMapStatisticsCache::load(const AString& dataFileName, const int64_t& dataFileSize, const int64_t& dataFileModified,
+                                   const int64_t& numRows, const int64_t& numColumns, const int64_t& numMaps, Statistics& statisticsOut)
+{
+    statisticsOut = Statistics();
+    if (DataFile::isFileOnNetwork(dataFileName)) return false;
+    const AString fileName = getCacheFileName(dataFileName);
+    if (!QFileInfo(fileName).exists()) return false;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        CaretLogFine("unable to open statistics cache file '" + fileName + "'");
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+    file.close();
+    istringstream stream(string(contents.constData(), contents.size()));
+    char magic[8];
+    int32_t version, byteOrder;
+    int64_t fileSize, fileModified, fileRows, fileColumns, fileMaps;
+    stream.read(magic, 8);
+    if (!readValue(stream, version) || !readValue(stream, byteOrder) || !readValue(stream, fileSize) || !readValue(stream, fileModified)
+        || !readValue(stream, fileRows) || !readValue(stream, fileColumns) || !readValue(stream, fileMaps)) return false;
+    if (memcmp(magic, CACHE_MAGIC, 8) != 0 || version != CACHE_VERSION || byteOrder != BYTE_ORDER_CHECK) return false;
+    if (fileSize != dataFileSize || fileModified != dataFileModified)
+    {
+        CaretLogFine("statistics cache file '" + fileName + "' is out of date");
+        return false;
+    }
+    if (fileRows != numRows || fileColumns != numColumns || fileMaps != numMaps) return false;
+    statisticsOut.m_mapFastStatistics.resize(numMaps);
+    statisticsOut.m_mapHistograms.resize(numMaps);
+    for (int64_t i = 0; i < numMaps; ++i)
+    {
+        if (!readStatistics(stream, statisticsOut.m_mapFastStatistics[i], statisticsOut.m_mapHistograms[i]))
+        {
+            statisticsOut = Statistics();
+            return false;
+        }
+    }
+    if (!readStatistics(stream, statisticsOut.m_fileFastStatistics, statisticsOut.m_fileHistogram))
+    {
+        statisticsOut = Statistics();
+        return false;
+    }
+    CaretLogFine("using map statistics from '" + fileName + "'");
+    return true;
+}
+
+void CiftiMapStatisticsCache::store(const AString& dataFileName, const int64_t& dataFileSize, const int64_t& dataFileModified,
+                                    const int64_t& numRows, const int64_t& numColumns, const Statistics& statistics)
+{
+    CaretAssert(statistics.m_mapFastStatistics.size() == statistics.m_mapHistograms.size());
+    if (DataFile::isFileOnNetwork(dataFileName)) return;
+    const AString fileName = getCacheFileName(dataFileName);
+    try
+    {
+        ostringstream stream;
+        stream.write(CACHE_MAGIC, 8);
+        writeValue(stream, CACHE_VERSION);
+        writeValue(stream, BYTE_ORDER_CHECK);
+        writeValue(stream, dataFileSize);
+        writeValue(stream, dataFileModified);
+        writeValue(stream, numRows);
+        writeValue(stream, numColumns);
+        const int64_t numMaps = (int64_t)statistics.m_mapFastStatistics.size();
+        writeValue(stream, numMaps);
+        for (int64_t i = 0; i < numMaps; ++i)
+        {
+            writeStatistics(stream, statistics.m_mapFastStatistics[i], statistics.m_mapHistograms[i]);
+        }
+        writeStatistics(stream, statistics.m_fileFastStatistics, statistics.m_fileHistogram);
+        const string contents = stream.str();
+        QTemporaryFile tempFile(fileName + ".XXXXXX");//write elsewhere and rename, so another instance never reads a partial file
+        if (!tempFile.open())
+        {
+            throw DataFileException("failed to create temporary file for '" + fileName + "'");
+        }
+        const int64_t count = (int64_t)contents.size();
+        for (int64_t done = 0; done < count; done += IO_CHUNK)
+        {
+            int64_t toWrite = min(IO_CHUNK, count - done);
+            if (tempFile.write(contents.data() + done, toWrite) != toWrite)
+            {
+                throw DataFileException("failed to write to file '" + tempFile.fileName() + "'");
+            }
+        }
+        tempFile.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther);//temporary files are private, but the data file usually isn't
+        tempFile.close();
+        QFile::remove(fileName);//rename won't overwrite an out of date cache file
+        if (QFile::rename(tempFile.fileName(), fileName))
+        {
+            tempFile.setAutoRemove(false);
+            CaretLogFine("wrote statistics cache file '" + fileName + "'");
+        }
+    } catch (DataFileException& e) {
+        CaretLogFine("unable to write statistics cache file: " + e.whatString());
+    }
+}
+
+CiftiMapStatisticsThread::CiftiMapStatisticsThread(const AString& dataFileName, const int64_t& dataFileSize, const int64_t& dataFileModified,
+                                                   const int64_t& numMaps, const bool& mapsAreColumns)
+{
+    m_dataFileName = dataFileName;
+    m_dataFileSize = dataFileSize;
+    m_dataFileModified = dataFileModified;
+    m_numMaps = numMaps;
+    m_mapsAreColumns = mapsAreColumns;
+    m_cancelled = false;
+    m_statistics.m_mapFastStatistics.resize(numMaps);
+    m_statistics.m_mapHistograms.resize(numMaps);
+}
+
+CiftiMapStatisticsThread::~CiftiMapStatisticsThread()
+{
+    cancel();
+    wait();
+}
+
+void CiftiMapStatisticsThread::cancel()
+{
+    CaretMutexLocker locked(&m_mutex);
+    m_cancelled = true;
+}
+
+bool CiftiMapStatisticsThread::isCancelled()
+{
+    CaretMutexLocker locked(&m_mutex);
+    return m_cancelled;
+}
+
+void CiftiMapStatisticsThread::getMapStatistics(const int64_t& mapIndex, CaretPointer<FastStatistics>& fastStatisticsOut, CaretPointer<Histogram>& histogramOut)
+{
+    CaretAssert(mapIndex >= 0 && mapIndex < m_numMaps);
+    CaretMutexLocker locked(&m_mutex);
+    fastStatisticsOut = m_statistics.m_mapFastStatistics[mapIndex];
+    histogramOut = m_statistics.m_mapHistograms[mapIndex];
+}
+
+void CiftiMapStatisticsThread::run()
+{
+    try
+    {
+        FileInformation myInfo(m_dataFileName);
+        if (!myInfo.exists() || myInfo.size() != m_dataFileSize || myInfo.getLastModifiedMilliseconds() != m_dataFileModified)
+        {
+            CaretLogFine("file '" + m_dataFileName + "' changed since it was loaded, not computing map statistics in the background");
+            return;
+        }
+        CiftiFile myFile;
+        myFile.openFile(m_dataFileName);
+        const int64_t numRows = myFile.getNumberOfRows(), numColumns = myFile.getNumberOfColumns();
+        const int64_t mapLength = (m_mapsAreColumns ? numRows : numColumns);
+        if (m_numMaps > (m_mapsAreColumns ? numColumns : numRows) || mapLength <= 0) return;
+        const int64_t blockBytes = 64 * 1024 * 1024;//small enough to check for cancel often
+        int64_t mapsPerBlock = max(int64_t(1), blockBytes / (mapLength * (int64_t)sizeof(float)));
+        vector<float> blockData, rowMajorBlock;
+        CiftiMapStatisticsCache::Statistics blockStatistics;
+        for (int64_t firstMap = 0; firstMap < m_numMaps; firstMap += mapsPerBlock)
+        {
+            if (isCancelled()) return;
+            const int64_t numMapsInBlock = min(mapsPerBlock, m_numMaps - firstMap);
+            blockData.resize(numMapsInBlock * mapLength);//each map contiguous
+            if (m_mapsAreColumns)
+            {
+                rowMajorBlock.resize(numMapsInBlock * mapLength);
+                myFile.getColumns(rowMajorBlock.data(), firstMap, numMapsInBlock);
+                for (int64_t row = 0; row < numRows; ++row)
+                {
+                    const float* rowData = rowMajorBlock.data() + row * numMapsInBlock;
+                    for (int64_t j = 0; j < numMapsInBlock; ++j)
+                    {
+                        blockData[j * mapLength + row] = rowData[j];
+                    }
+                }
+            } else {
+                for (int64_t j = 0; j < numMapsInBlock; ++j)
+                {
+                    myFile.getRow(blockData.data() + j * mapLength, firstMap + j);
+                }
+            }
+            blockStatistics.m_mapFastStatistics.assign(numMapsInBlock, CaretPointer<FastStatistics>());
+            blockStatistics.m_mapHistograms.assign(numMapsInBlock, CaretPointer<Histogram>());
+#pragma omp CARET_PARFOR schedule(dynamic)
+            for (int64_t j = 0; j < numMapsInBlock; ++j)
+            {
+                const float* mapData = blockData.data() + j * mapLength;
+                blockStatistics.m_mapFastStatistics[j].grabNew(new FastStatistics(mapData, mapLength));
+                blockStatistics.m_mapHistograms[j].grabNew(new Histogram());
+                blockStatistics.m_mapHistograms[j]->update(mapData, mapLength);
+            }
+            CaretMutexLocker locked(&m_mutex);
+            for (int64_t j = 0; j < numMapsInBlock; ++j)
+            {
+                m_statistics.m_mapFastStatistics[firstMap + j] = blockStatistics.m_mapFastStatistics[j];
+                m_statistics.m_mapHistograms[firstMap + j] = blockStatistics.m_mapHistograms[j];
+            }
+        }
+        if (isCancelled()) return;
+        CiftiMapStatisticsCache::Statistics toStore;
+        {
+            CaretMutexLocker locked(&m_mutex);
+            toStore = m_statistics;
+        }
+        CiftiMapStatisticsCache::Statistics previous;//keep the file-wide statistics, if the GUI already saved them
+        if (CiftiMapStatisticsCache::load(m_dataFileName, m_dataFileSize, m_dataFileModified, numRows, numColumns, m_numMaps, previous))
+        {
+            toStore.m_fileFastStatistics = previous.m_fileFastStatistics;
+            toStore.m_fileHistogram = previous.m_fileHistogram;
+        }
+        CiftiMapStatisticsCache::store(m_dataFileName, m_dataFileSize, m_dataFileModified, numRows, numColumns, toStore);
+    } catch (CaretException& e) {
+        CaretLogFine("failed to compute map statistics in the background: " + e.whatString());
+    } catch (bad_alloc&) {
+        CaretLogFine("ran out of memory computing map statistics in the background");
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef __CIFTI_MAP_STATISTICS_CACHE_H__
+#define __CIFTI_MAP_STATISTICS_CACHE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+//NOTE: the cache is a file next to the data file, with the data file's name plus ".wbstats", that records the size and modification time
+//      of the data file it was computed from.  When either changes, the cache file is simply ignored and overwritten.
+//      Files that are not on the local filesystem have no cache.
+
+#include "AString.h"
+#include "CaretMutex.h"
+#include "CaretPointer.h"
+#include "FastStatistics.h"
+#include "Histogram.h"
+
+#include <QThread>
+
+#include "stdint.h"
+#include <vector>
+
+namespace caret {
+    
+    class CiftiMapStatisticsCache
+    {
+        CiftiMapStatisticsCache();//static only
+    public:
+        ///statistics of each map of a file, and of all data in the file, pointers are NULL for anything that wasn't computed
+        struct Statistics
+        {
+            std::vector<CaretPointer<FastStatistics> > m_mapFastStatistics;
+            std::vector<CaretPointer<Histogram> > m_mapHistograms;
+            CaretPointer<FastStatistics> m_fileFastStatistics;
+            CaretPointer<Histogram> m_fileHistogram;
+        };
+        
+        static AString getCacheFileName(const AString& dataFileName);
+        
+        ///returns false if there is no cache file, or it was made from a data file with a different size, modification time, or dimensions
+        static bool load(const AString& dataFileName, const int64_t& dataFileSize, const int64_t& dataFileModified,
+                         const int64_t& numRows, const int64_t& numColumns, const int64_t& numMaps, Statistics& statisticsOut);
+        
+        ///failure to write is only logged, a read-only directory just means there is no cache
+        static void store(const AString& dataFileName, const int64_t& dataFileSize, const int64_t& dataFileModified,
+                          const int64_t& numRows, const int64_t& numColumns, const Statistics& statistics);
+    };
+    
+    ///computes the statistics of every map of a local file in the background, reading the file with its own reader, and then saves the cache
+    ///the file is checked against the size and modification time it had when it was loaded, so results always match the data that was loaded
+    class CiftiMapStatisticsThread : public QThread
+    {
+        AString m_dataFileName;
+        int64_t m_dataFileSize, m_dataFileModified, m_numMaps;
+        bool m_mapsAreColumns;
+        CaretMutex m_mutex;
+        bool m_cancelled;//protected by m_mutex
+        CiftiMapStatisticsCache::Statistics m_statistics;//protected by m_mutex
+        bool isCancelled();
+        CiftiMapStatisticsThread(const CiftiMapStatisticsThread&);
+        CiftiMapStatisticsThread& operator=(const CiftiMapStatisticsThread&);
+    protected:
+        void run();
+    public:
+        ///mapsAreColumns is true when each map is a column of the cifti file
+        CiftiMapStatisticsThread(const AString& dataFileName, const int64_t& dataFileSize, const int64_t& dataFileModified,
+                                 const int64_t& numMaps, const bool& mapsAreColumns);
+        
+        ///cancels, and waits for the thread to finish
+        ~CiftiMapStatisticsThread();
+        
+        ///stop after the current block of maps, without saving the cache
+        void cancel();
+        
+        ///results for one map, pointers are NULL if it hasn't been computed yet
+        void getMapStatistics(const int64_t& mapIndex, CaretPointer<FastStatistics>& fastStatisticsOut, CaretPointer<Histogram>& histogramOut);
+    };
+    
+}
+
+#endif //__CIFTI_MAP_STATISTICS_CACHE_H__
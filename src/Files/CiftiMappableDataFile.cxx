@@ -18,6 +18,7 @@
  */
 /*LICENSE_END*/
 
+#include <algorithm>
 #include <set>
 
 #define __CIFTI_MAPPABLE_DATA_FILE_DECLARE__
@@ -27,11 +28,13 @@
 #include "BoundingBox.h"
 #include "CaretAssert.h"
 #include "CaretLogger.h"
+#include "CaretOMP.h"
 #include "ChartDataCartesian.h"
 #include "CiftiBrainordinateLabelFile.h"
 #include "CiftiBrainordinateScalarFile.h"
 #include "CiftiFiberTrajectoryFile.h"
 #include "CiftiFile.h"
+#include "CiftiMapStatisticsCache.h"
 #include "CiftiMappableConnectivityMatrixDataFile.h"
 #include "CiftiParcelLabelFile.h"
 #include "CaretTemporaryFile.h"
@@ -114,6 +117,14 @@ CiftiMappableDataFile::CiftiMappableDataFile(const DataFileTypeEnum::Enum dataFi
      */
     m_forceUpdateOfGroupAndNameHierarchy = true;
     
+    m_columnTileFirstColumn = 0;
+    m_columnTileNumberOfColumns = 0;
+    
+    m_statisticsCacheDataFileSize     = 0;
+    m_statisticsCacheDataFileModified = 0;
+    m_statisticsCacheChecked          = false;
+    m_statisticsThreadStarted         = false;
+    
     switch (dataFileType) {
         case DataFileTypeEnum::CONNECTIVITY_DENSE:
             m_dataReadingAccessMethod      = DATA_ACCESS_FILE_ROWS_OR_XML_ALONG_COLUMN;
@@ -426,6 +437,9 @@ CiftiMappableDataFile::clearPrivate()
      * m_fileMapDataType
      */
     
+    stopStatisticsThread();
+    m_statisticsThreadStarted = false;
+    
     m_ciftiFile.grabNew(NULL);
     
     resetDataLoadingMembers();
@@ -436,6 +450,11 @@ CiftiMappableDataFile::clearPrivate()
     m_mappingTimeStart = 0.0;
     m_mappingTimeStep = 0.0;
     m_mappingTimeUnits = NiftiTimeUnitsEnum::NIFTI_UNITS_UNKNOWN;
+    
+    m_statisticsCacheDataFileName     = "";
+    m_statisticsCacheDataFileSize     = 0;
+    m_statisticsCacheDataFileModified = 0;
+    m_statisticsCacheChecked          = false;
 }
 
 /**
@@ -452,6 +471,7 @@ CiftiMappableDataFile::resetDataLoadingMembers()
     m_mapContent.clear();
     m_classNameHierarchy->clear();
     m_forceUpdateOfGroupAndNameHierarchy = true;
+    invalidateColumnTile();
 }
 
 /**
@@ -650,6 +670,7 @@ CiftiMappableDataFile::readFile(const AString& ciftiMapFileName)
                     m_ciftiFile->openFile(ciftiMapFileName);
                     break;
                 case FILE_MAP_DATA_TYPE_MULTI_MAP:
+                {
                     m_ciftiFile->openFile(ciftiMapFileName);
                     
                     switch (m_fileDataReadingType) {
@@ -659,6 +680,15 @@ CiftiMappableDataFile::readFile(const AString& ciftiMapFileName)
                         case FILE_READ_DATA_AS_NEEDED:
                             break;
                     }
+                    
+                    /*
+                     * Identifies the file contents for the statistics cache
+                     */
+                    FileInformation fileInfo(ciftiMapFileName);
+                    m_statisticsCacheDataFileName     = fileInfo.getAbsoluteFilePath();
+                    m_statisticsCacheDataFileSize     = fileInfo.size();
+                    m_statisticsCacheDataFileModified = fileInfo.getLastModifiedMilliseconds();
+                }
                     break;
             }
         }
@@ -1285,9 +1315,15 @@ CiftiMappableDataFile::getMapData(const int32_t mapIndex,
             break;
         case DATA_ACCESS_FILE_COLUMNS_OR_XML_ALONG_ROW:
             CaretAssert(mapIndex < m_ciftiFile->getNumberOfColumns());
-            dataOut.resize(m_ciftiFile->getNumberOfRows());
-            m_ciftiFile->getColumn(&dataOut[0],
-                                   mapIndex);
+            if (m_ciftiFile->isInMemory()) {
+                dataOut.resize(m_ciftiFile->getNumberOfRows());
+                m_ciftiFile->getColumn(&dataOut[0],
+                                       mapIndex);
+            }
+            else {
+                getColumnMapDataFromTile(mapIndex,
+                                         dataOut);
+            }
             break;
         case DATA_ACCESS_FILE_ROWS_OR_XML_ALONG_COLUMN:
             CaretAssert(mapIndex < m_ciftiFile->getNumberOfRows());
@@ -1298,6 +1334,91 @@ CiftiMappableDataFile::getMapData(const int32_t mapIndex,
     }
 }
 
+/**
+ * Get the data for a map that is a column of an on-disk file.
+ *
+ * Reading a single column of an on-disk file reads one element
+ * from each row, which is far too slow for scrubbing through the
+ * timepoints of a dense time series.  Instead, a block of adjacent
+ * columns is read with coalesced reads and kept transposed, so that
+ * neighboring maps are simply copied from memory.
+ *
+ * @param mapIndex
+ *     Index of the map.
+ * @param dataOut
+ *     A vector that will contain the data for the map upon exit.
+ */
+void
+CiftiMappableDataFile::getColumnMapDataFromTile(const int32_t mapIndex,
+                                                std::vector<float>& dataOut) const
+{
+    const int64_t numberOfRows    = m_ciftiFile->getNumberOfRows();
+    const int64_t numberOfColumns = m_ciftiFile->getNumberOfColumns();
+    CaretAssert(mapIndex < numberOfColumns);
+    dataOut.resize(numberOfRows);
+    if (numberOfRows <= 0) {
+        return;
+    }
+    
+    CaretMutexLocker locker(&m_columnTileMutex);
+    
+    if ((mapIndex < m_columnTileFirstColumn)
+        || (mapIndex >= (m_columnTileFirstColumn + m_columnTileNumberOfColumns))) {
+        /*
+         * Limit the tile to about 64MB.  Start the tile slightly
+         * before the requested map so that stepping backwards
+         * a few maps does not reload the tile.
+         */
+        const int64_t tileBytes = 64 * 1024 * 1024;
+        int64_t tileColumns = tileBytes / (numberOfRows * static_cast<int64_t>(sizeof(float)));
+        if (tileColumns < 1) {
+            tileColumns = 1;
+        }
+        if (tileColumns > numberOfColumns) {
+            tileColumns = numberOfColumns;
+        }
+        int64_t firstColumn = mapIndex - (tileColumns / 8);
+        if ((firstColumn + tileColumns) > numberOfColumns) {
+            firstColumn = numberOfColumns - tileColumns;
+        }
+        if (firstColumn < 0) {
+            firstColumn = 0;
+        }
+        
+        std::vector<float> rowMajorTile(numberOfRows * tileColumns);
+        m_ciftiFile->getColumns(&rowMajorTile[0],
+                                firstColumn,
+                                tileColumns);
+        
+        m_columnTileData.resize(numberOfRows * tileColumns);
+        for (int64_t iRow = 0; iRow < numberOfRows; iRow++) {
+            const float* rowData = &rowMajorTile[iRow * tileColumns];
+            for (int64_t jCol = 0; jCol < tileColumns; jCol++) {
+                m_columnTileData[jCol * numberOfRows + iRow] = rowData[jCol];
+            }
+        }
+        m_columnTileFirstColumn     = firstColumn;
+        m_columnTileNumberOfColumns = tileColumns;
+    }
+    
+    const float* columnData = &m_columnTileData[(mapIndex - m_columnTileFirstColumn) * numberOfRows];
+    std::copy(columnData,
+              columnData + numberOfRows,
+              dataOut.begin());
+}
+
+/**
+ * Invalidate the column tile so that it is reloaded on next use.
+ */
+void
+CiftiMappableDataFile::invalidateColumnTile() const
+{
+    CaretMutexLocker locker(&m_columnTileMutex);
+    m_columnTileData.clear();
+    m_columnTileFirstColumn     = 0;
+    m_columnTileNumberOfColumns = 0;
+}
+
 /**
  * Set the data for the given map index.
  *
@@ -1326,6 +1447,7 @@ CiftiMappableDataFile::setMapData(const int32_t mapIndex,
             CaretAssert(mapIndex < m_ciftiFile->getNumberOfColumns());
             m_ciftiFile->setColumn(&data[0],
                                    mapIndex);
+            invalidateColumnTile();
             break;
         case DATA_ACCESS_FILE_ROWS_OR_XML_ALONG_COLUMN:
             CaretAssert(mapIndex < m_ciftiFile->getNumberOfRows());
@@ -1336,6 +1458,11 @@ CiftiMappableDataFile::setMapData(const int32_t mapIndex,
     
     m_forceUpdateOfGroupAndNameHierarchy = true;
     
+    /*
+     * Statistics from the background no longer match the data
+     */
+    stopStatisticsThread();
+    
     m_mapContent[mapIndex]->updateForChangeInMapData();
 }
 
@@ -1349,6 +1476,7 @@ void
 CiftiMappableDataFile::updateForChangeInMapDataWithMapIndex(const int32_t mapIndex)
 {
     CaretAssertVectorIndex(m_mapContent, mapIndex);
+    stopStatisticsThread();
     m_mapContent[mapIndex]->updateForChangeInMapData();
 }
 
@@ -1478,11 +1606,16 @@ CiftiMappableDataFile::getMapFastStatistics(const int32_t mapIndex)
             CaretAssertVectorIndex(m_mapContent,
                                    mapIndex);
             
+            if ( ! m_mapContent[mapIndex]->isFastStatisticsValid()) {
+                adoptBackgroundStatistics(mapIndex);
+            }
+            
             if ( ! m_mapContent[mapIndex]->isFastStatisticsValid()) {
                 std::vector<float> data;
                 getMapData(mapIndex,
                            data);
                 m_mapContent[mapIndex]->updateFastStatistics(data);
+                startStatisticsThread();
             }
             
             fastStatsOut =  m_mapContent[mapIndex]->m_fastStatistics;
@@ -1510,11 +1643,16 @@ CiftiMappableDataFile::getMapHistogram(const int32_t mapIndex)
         CaretAssertVectorIndex(m_mapContent,
                                mapIndex);
         
+        if ( ! m_mapContent[mapIndex]->isHistogramValid()) {
+            adoptBackgroundStatistics(mapIndex);
+        }
+        
         if ( ! m_mapContent[mapIndex]->isHistogramValid()) {
             std::vector<float> data;
             getMapData(mapIndex,
                        data);
             m_mapContent[mapIndex]->updateHistogram(data);
+            startStatisticsThread();
         }
         
         histogramOut = m_mapContent[mapIndex]->m_histogram;
@@ -1579,6 +1717,215 @@ CiftiMappableDataFile::getMapHistogram(const int32_t mapIndex,
     return histogramOut;    
 }
 
+/**
+ * Use the statistics and histogram for a map from the statistics
+ * cache file or, if they have been computed, from the statistics
+ * thread.
+ *
+ * @param mapIndex
+ *    Index of the map.
+ */
+void
+CiftiMappableDataFile::adoptBackgroundStatistics(const int32_t mapIndex)
+{
+    CaretAssertVectorIndex(m_mapContent, mapIndex);
+    
+    readStatisticsCache();
+    
+    if (m_statisticsThread == NULL) {
+        return;
+    }
+    MapContent* mapContent = m_mapContent[mapIndex];
+    if (mapContent->isFastStatisticsValid()
+        && mapContent->isHistogramValid()) {
+        return;
+    }
+    CaretPointer<FastStatistics> fastStatistics;
+    CaretPointer<Histogram> histogram;
+    m_statisticsThread->getMapStatistics(mapIndex,
+                                         fastStatistics,
+                                         histogram);
+    if ( ! mapContent->isFastStatisticsValid()) {
+        mapContent->m_fastStatistics = fastStatistics;
+    }
+    if ( ! mapContent->isHistogramValid()) {
+        mapContent->m_histogram = histogram;
+    }
+}
+
+/**
+ * Start computing the statistics and histogram of all maps in the
+ * background, after the statistics of the first requested map have
+ * been computed.
+ *
+ * Requesting the statistics of one map at a time, as happens while
+ * stepping through the maps of a scalar or series file, reads the
+ * file once for each map, and reading one column of an on-disk
+ * file is nearly as slow as reading all of the columns.  The
+ * thread reads the file with its own reader in blocks of adjacent
+ * maps and, when done, saves the results to a cache file beside
+ * the data file so that they are available immediately when the
+ * file is opened again.
+ *
+ * The thread is only started once, for a file on the local
+ * filesystem whose data has not been modified.  Matrix files are
+ * not processed since their single map changes as rows are loaded.
+ */
+void
+CiftiMappableDataFile::startStatisticsThread()
+{
+    if (m_statisticsThreadStarted) {
+        return;
+    }
+    if ((m_fileMapDataType != FILE_MAP_DATA_TYPE_MULTI_MAP)
+        || (m_ciftiFile == NULL)
+        || m_statisticsCacheDataFileName.isEmpty()
+        || isModifiedExcludingPaletteColorMapping()) {
+        return;
+    }
+    
+    const int32_t numberOfMaps = getNumberOfMaps();
+    if (numberOfMaps <= 1) {
+        return;
+    }
+    bool mapsAreColumns = false;
+    switch (m_dataReadingAccessMethod) {
+        case DATA_ACCESS_METHOD_INVALID:
+            return;
+        case DATA_ACCESS_NONE:
+            return;
+        case DATA_ACCESS_FILE_COLUMNS_OR_XML_ALONG_ROW:
+            mapsAreColumns = true;
+            break;
+        case DATA_ACCESS_FILE_ROWS_OR_XML_ALONG_COLUMN:
+            mapsAreColumns = false;
+            break;
+    }
+    
+    bool anyMissingFlag = false;
+    for (int32_t i = 0; i < numberOfMaps; i++) {
+        if (( ! m_mapContent[i]->isFastStatisticsValid())
+            || ( ! m_mapContent[i]->isHistogramValid())) {
+            anyMissingFlag = true;
+            break;
+        }
+    }
+    if ( ! anyMissingFlag) {
+        return;
+    }
+    
+    m_statisticsThreadStarted = true;
+    m_statisticsThread.grabNew(new CiftiMapStatisticsThread(m_statisticsCacheDataFileName,
+                                                            m_statisticsCacheDataFileSize,
+                                                            m_statisticsCacheDataFileModified,
+                                                            numberOfMaps,
+                                                            mapsAreColumns));
+    m_statisticsThread->start(QThread::LowPriority);
+}
+
+/**
+ * Stop the statistics thread, if it is running, and discard its
+ * results.  Used when the file's data changes and when the file
+ * is cleared.
+ */
+void
+CiftiMappableDataFile::stopStatisticsThread()
+{
+    if (m_statisticsThread != NULL) {
+        m_statisticsThread->cancel();
+        m_statisticsThread->wait();
+        m_statisticsThread.grabNew(NULL);
+    }
+}
+
+/**
+ * Fill in any statistics that are missing from the map and file
+ * statistics in the cache file for this file.  The cache file is
+ * only read once after the file is read, and is not used once
+ * the file's data is modified.
+ */
+void
+CiftiMappableDataFile::readStatisticsCache()
+{
+    if (m_statisticsCacheChecked) {
+        return;
+    }
+    m_statisticsCacheChecked = true;
+    
+    if (m_statisticsCacheDataFileName.isEmpty()
+        || (m_ciftiFile == NULL)
+        || ( ! isMappedWithPalette())
+        || isModifiedExcludingPaletteColorMapping()) {
+        return;
+    }
+    
+    const int32_t numberOfMaps = getNumberOfMaps();
+    CiftiMapStatisticsCache::Statistics statistics;
+    if ( ! CiftiMapStatisticsCache::load(m_statisticsCacheDataFileName,
+                                         m_statisticsCacheDataFileSize,
+                                         m_statisticsCacheDataFileModified,
+                                         m_ciftiFile->getNumberOfRows(),
+                                         m_ciftiFile->getNumberOfColumns(),
+                                         numberOfMaps,
+                                         statistics)) {
+        return;
+    }
+    
+    for (int32_t i = 0; i < numberOfMaps; i++) {
+        MapContent* mapContent = m_mapContent[i];
+        if ( ! mapContent->isFastStatisticsValid()) {
+            mapContent->m_fastStatistics = statistics.m_mapFastStatistics[i];
+        }
+        if ( ! mapContent->isHistogramValid()) {
+            mapContent->m_histogram = statistics.m_mapHistograms[i];
+        }
+    }
+    if (m_fileFastStatistics == NULL) {
+        m_fileFastStatistics = statistics.m_fileFastStatistics;
+    }
+    if (m_fileHistogram == NULL) {
+        m_fileHistogram = statistics.m_fileHistogram;
+    }
+}
+
+/**
+ * Save the map and file statistics that have been computed to the
+ * cache file for this file.  Nothing is saved if the file's data
+ * has been modified since the statistics would not match the
+ * data in the file.
+ */
+void
+CiftiMappableDataFile::writeStatisticsCache()
+{
+    if (m_statisticsCacheDataFileName.isEmpty()
+        || (m_ciftiFile == NULL)
+        || (m_fileMapDataType != FILE_MAP_DATA_TYPE_MULTI_MAP)
+        || isModifiedExcludingPaletteColorMapping()) {
+        return;
+    }
+    
+    const int32_t numberOfMaps = getNumberOfMaps();
+    for (int32_t i = 0; i < numberOfMaps; i++) {
+        adoptBackgroundStatistics(i);
+    }
+    CiftiMapStatisticsCache::Statistics statistics;
+    statistics.m_mapFastStatistics.resize(numberOfMaps);
+    statistics.m_mapHistograms.resize(numberOfMaps);
+    for (int32_t i = 0; i < numberOfMaps; i++) {
+        statistics.m_mapFastStatistics[i] = m_mapContent[i]->m_fastStatistics;
+        statistics.m_mapHistograms[i]     = m_mapContent[i]->m_histogram;
+    }
+    statistics.m_fileFastStatistics = m_fileFastStatistics;
+    statistics.m_fileHistogram      = m_fileHistogram;
+    
+    CiftiMapStatisticsCache::store(m_statisticsCacheDataFileName,
+                                   m_statisticsCacheDataFileSize,
+                                   m_statisticsCacheDataFileModified,
+                                   m_ciftiFile->getNumberOfRows(),
+                                   m_ciftiFile->getNumberOfColumns(),
+                                   statistics);
+}
+
 /**
  * @return The estimated size of data after it is uncompressed
  * and loaded into RAM.  A negative value indicates that the
@@ -1609,6 +1956,10 @@ CiftiMappableDataFile::getDataSizeUncompressedInBytes() const
 const FastStatistics*
 CiftiMappableDataFile::getFileFastStatistics()
 {
+    if (m_fileFastStatistics == NULL) {
+        readStatisticsCache();
+    }
+    
     if (m_fileFastStatistics == NULL) {
         std::vector<float> fileData;
         getFileData(fileData);
@@ -1616,6 +1967,7 @@ CiftiMappableDataFile::getFileFastStatistics()
             m_fileFastStatistics.grabNew(new FastStatistics());
             m_fileFastStatistics->update(&fileData[0],
                                          fileData.size());
+            writeStatisticsCache();
         }
     }
     
@@ -1634,6 +1986,10 @@ CiftiMappableDataFile::getFileFastStatistics()
 const Histogram*
 CiftiMappableDataFile::getFileHistogram()
 {
+    if (m_fileHistogram == NULL) {
+        readStatisticsCache();
+    }
+    
     if (m_fileHistogram == NULL) {
         std::vector<float> fileData;
         getFileData(fileData);
@@ -1641,6 +1997,7 @@ CiftiMappableDataFile::getFileHistogram()
             m_fileHistogram.grabNew(new Histogram());
             m_fileHistogram->update(&fileData[0],
                                     fileData.size());
+            writeStatisticsCache();
         }
     }
     return m_fileHistogram;
@@ -22,6 +22,7 @@
 /*LICENSE_END*/
 
 #include "CaretMappableDataFile.h"
+#include "CaretMutex.h"
 #include "CaretPointer.h"
 #include "CaretObjectTracksModification.h"
 #include "CiftiMappingType.h"
@@ -36,6 +37,7 @@ namespace caret {
     class ChartData;
     class ChartDataCartesian;
     class CiftiFile;
+    class CiftiMapStatisticsThread;
     class CiftiParcelsMap;
     class CiftiXML;
     class FastStatistics;
@@ -643,6 +645,21 @@ namespace caret {
         
         void resetDataLoadingMembers();
         
+        void getColumnMapDataFromTile(const int32_t mapIndex,
+                                      std::vector<float>& dataOut) const;
+        
+        void invalidateColumnTile() const;
+        
+        void adoptBackgroundStatistics(const int32_t mapIndex);
+        
+        void startStatisticsThread();
+        
+        void stopStatisticsThread();
+        
+        void readStatisticsCache();
+        
+        void writeStatisticsCache();
+        
         void validateKeysAndLabels() const;
         
         virtual void validateAfterFileReading();
@@ -746,6 +763,40 @@ namespace caret {
         /** force an update of the class and name hierarchy */
         mutable bool m_forceUpdateOfGroupAndNameHierarchy;
 
+        /**
+         * Block of adjacent columns of an on-disk file, stored transposed
+         * (each column contiguous) so that stepping through the maps of
+         * a dense time series does not read the file one element at a time.
+         */
+        mutable std::vector<float> m_columnTileData;
+        
+        /** Index of first column in the column tile */
+        mutable int64_t m_columnTileFirstColumn;
+        
+        /** Number of columns in the column tile, zero if tile is invalid */
+        mutable int64_t m_columnTileNumberOfColumns;
+        
+        /** Protects the column tile since getMapData() may be called from multiple threads */
+        mutable CaretMutex m_columnTileMutex;
+        
+        /** Absolute name of the file read, empty if the statistics cache is not used */
+        AString m_statisticsCacheDataFileName;
+        
+        /** Size of the file when it was read, identifies the contents for the statistics cache */
+        int64_t m_statisticsCacheDataFileSize;
+        
+        /** Modification time of the file when it was read, identifies the contents for the statistics cache */
+        int64_t m_statisticsCacheDataFileModified;
+        
+        /** True once the statistics cache has been read (or found unusable) */
+        bool m_statisticsCacheChecked;
+        
+        /** Computes the statistics of the maps that have not been requested yet, NULL when not running */
+        CaretPointer<CiftiMapStatisticsThread> m_statisticsThread;
+        
+        /** True once the statistics thread has been started, it is only started once after the file is read */
+        bool m_statisticsThreadStarted;
+
         
         static const int32_t S_CIFTI_XML_ALONG_INVALID;
         
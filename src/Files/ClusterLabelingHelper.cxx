@@ -0,0 +1,180 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "ClusterLabelingHelper.h"
+
+#include "CaretAssert.h"
+#include "CaretException.h"
+#include "CaretOMP.h"
+#include "TopologyHelper.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    int32_t findRoot(vector<int32_t>& parent, int32_t element)
+    {//path halving
+        while (parent[element] != element)
+        {
+            parent[element] = parent[parent[element]];
+            element = parent[element];
+        }
+        return element;
+    }
+    
+    int32_t findRootNoCompress(const vector<int32_t>& parent, int32_t element)
+    {//for when other threads are also reading the forest
+        while (parent[element] != element)
+        {
+            element = parent[element];
+        }
+        return element;
+    }
+    
+    void unite(vector<int32_t>& parent, const int32_t& first, const int32_t& second)
+    {//the lower root always wins, so a root is the lowest index in its set
+        int32_t root1 = findRoot(parent, first), root2 = findRoot(parent, second);
+        if (root1 < root2)
+        {
+            parent[root2] = root1;
+        } else if (root2 < root1) {
+            parent[root1] = root2;
+        }
+    }
+    
+    ///second pass: roots must already be in labels for elements in the mask (and parent is scratch now), numbers the components in order of their roots, and counts them
+    void numberComponents(const vector<char>& mask, vector<int32_t>& parent, const float* areas, ClusterLabelingHelper::Components& componentsOut)
+    {
+        const int32_t numElements = (int32_t)mask.size();
+        vector<int32_t>& labels = componentsOut.m_labels;
+        componentsOut.m_counts.clear();
+        componentsOut.m_areas.clear();
+        for (int32_t i = 0; i < numElements; ++i)
+        {
+            if (!mask[i]) continue;
+            const int32_t root = labels[i];
+            CaretAssert(root <= i);
+            if (root == i)
+            {
+                parent[i] = (int32_t)componentsOut.m_counts.size();
+                componentsOut.m_counts.push_back(0);
+                if (areas != NULL) componentsOut.m_areas.push_back(0.0);
+            }
+            const int32_t component = parent[root];//root <= i, so it is already numbered
+            labels[i] = component;
+            ++componentsOut.m_counts[component];
+            if (areas != NULL) componentsOut.m_areas[component] += areas[i];
+        }
+    }
+}
+
+void ClusterLabelingHelper::labelVolume(const int64_t dims[3], const vector<char>& mask, Components& componentsOut)
+{
+    const int64_t frameSize = dims[0] * dims[1] * dims[2];
+    CaretAssert((int64_t)mask.size() == frameSize);
+    if (frameSize >= numeric_limits<int32_t>::max()) throw CaretException("volume frame is too large for cluster labeling");
+    const int64_t planeSize = dims[0] * dims[1];
+    vector<int32_t> parent(frameSize);
+    componentsOut.m_labels.assign(frameSize, -1);
+    int64_t numSlabs = 1;
+#ifdef CARET_OMP
+    if (!omp_in_parallel())
+    {
+        numSlabs = min((int64_t)omp_get_max_threads(), dims[2]);
+    }
+#endif
+    if (numSlabs < 1) numSlabs = 1;
+    vector<int64_t> slabStart(numSlabs + 1);
+    for (int64_t s = 0; s <= numSlabs; ++s)
+    {
+        slabStart[s] = (dims[2] * s) / numSlabs;
+    }
+    //first pass: within a slab, all members of a set are in the slab, so no other thread touches its part of the forest
+#pragma omp CARET_PARFOR schedule(static) if (numSlabs > 1)
+    for (int64_t s = 0; s < numSlabs; ++s)
+    {
+        for (int64_t k = slabStart[s]; k < slabStart[s + 1]; ++k)
+        {
+            for (int64_t j = 0; j < dims[1]; ++j)
+            {
+                int64_t index = dims[0] * (j + dims[1] * k);
+                for (int64_t i = 0; i < dims[0]; ++i, ++index)
+                {
+                    parent[index] = (int32_t)index;
+                    if (!mask[index]) continue;
+                    if (i > 0 && mask[index - 1]) unite(parent, (int32_t)index, (int32_t)(index - 1));
+                    if (j > 0 && mask[index - dims[0]]) unite(parent, (int32_t)index, (int32_t)(index - dims[0]));
+                    if (k > slabStart[s] && mask[index - planeSize]) unite(parent, (int32_t)index, (int32_t)(index - planeSize));
+                }
+            }
+        }
+    }
+    for (int64_t s = 1; s < numSlabs; ++s)
+    {//join across slab boundaries, these sets span threads, so this part is serial
+        const int64_t planeStart = slabStart[s] * planeSize;
+        for (int64_t index = planeStart; index < planeStart + planeSize; ++index)
+        {
+            if (mask[index] && mask[index - planeSize]) unite(parent, (int32_t)index, (int32_t)(index - planeSize));
+        }
+    }
+    //the forest is done changing, so roots can be found in parallel without compressing paths
+#pragma omp CARET_PARFOR schedule(static) if (numSlabs > 1)
+    for (int64_t s = 0; s < numSlabs; ++s)
+    {
+        for (int64_t index = slabStart[s] * planeSize; index < slabStart[s + 1] * planeSize; ++index)
+        {
+            if (mask[index]) componentsOut.m_labels[index] = findRootNoCompress(parent, (int32_t)index);
+        }
+    }
+    numberComponents(mask, parent, NULL, componentsOut);
+}
+
+void ClusterLabelingHelper::labelSurface(const TopologyHelper* myTopoHelp, const vector<char>& mask, const float* vertexAreas, Components& componentsOut)
+{
+    CaretAssert(myTopoHelp != NULL);
+    const int32_t numNodes = myTopoHelp->getNumberOfNodes();
+    CaretAssert((int32_t)mask.size() == numNodes);
+    vector<int32_t> parent(numNodes);
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        parent[i] = i;
+    }
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        if (!mask[i]) continue;
+        const vector<int32_t>& neighbors = myTopoHelp->getNodeNeighbors(i);
+        const int numNeigh = (int)neighbors.size();
+        for (int n = 0; n < numNeigh; ++n)
+        {
+            const int32_t neighbor = neighbors[n];
+            if (neighbor < i && mask[neighbor]) unite(parent, i, neighbor);//each edge only once
+        }
+    }
+    componentsOut.m_labels.assign(numNodes, -1);
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        if (mask[i]) componentsOut.m_labels[i] = findRoot(parent, i);
+    }
+    numberComponents(mask, parent, vertexAreas, componentsOut);
+}
@@ -0,0 +1,54 @@
+#ifndef __CLUSTER_LABELING_HELPER_H__
+#define __CLUSTER_LABELING_HELPER_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "stdint.h"
+#include <vector>
+
+namespace caret {
+
+    class TopologyHelper;
+
+    ///labels the connected components (clusters) of a mask with a disjoint-set forest, and counts their members (and sums their areas) in the same pass
+    ///a component's root is always its lowest index, so components are numbered in the same order as flood filling from each unvisited element in index order
+    ///all functions are safe to call from multiple threads, so many maps can be labeled at once
+    class ClusterLabelingHelper
+    {
+        ClusterLabelingHelper();//static only
+    public:
+        struct Components
+        {
+            std::vector<int32_t> m_labels;//component of each element, -1 for elements not in the mask
+            std::vector<int64_t> m_counts;//number of elements in each component
+            std::vector<double> m_areas;//sum of element areas in each component, empty when no areas are given
+            int32_t getNumberOfComponents() const { return (int32_t)m_counts.size(); }
+        };
+        ///mask is indexed like a volume frame (i + dims[0] * (j + dims[1] * k)), voxels are face neighbors only
+        ///slabs of the frame are labeled in parallel and then joined across the slab boundaries, unless this is called from inside a parallel region
+        static void labelVolume(const int64_t dims[3], const std::vector<char>& mask, Components& componentsOut);
+        ///vertices are neighbors when they share an edge, vertexAreas can be NULL
+        static void labelSurface(const TopologyHelper* myTopoHelp, const std::vector<char>& mask, const float* vertexAreas, Components& componentsOut);
+    };
+
+}
+
+#endif //__CLUSTER_LABELING_HELPER_H__
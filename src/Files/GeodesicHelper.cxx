@@ -23,10 +23,12 @@
 #include "CaretAssert.h"
 #include "CaretHeap.h"
 #include "CaretMutex.h"
+#include "CaretOMP.h"
 #include "FastStatistics.h"
 #include "SurfaceFile.h"
 #include "TopologyHelper.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <stdint.h>
@@ -215,6 +217,146 @@ void GeodesicHelper::getNodesToGeoDist(const int32_t node, const float maxdist,
     }
 }
 
+void GeodesicHelper::getNodesToGeoDist(const vector<int32_t>& roots, const float maxdist, vector<int64_t>& rowStartsOut, vector<int32_t>& nodesOut,
+                                       vector<float>& distsOut, const bool smoothflag, const bool useBucketQueue)
+{
+    const int64_t numRoots = (int64_t)roots.size();
+    rowStartsOut.assign(numRoots + 1, 0);
+    nodesOut.clear();
+    distsOut.clear();
+    if (numRoots == 0 || maxdist < 0.0f) return;
+    float bucketWidth = -1.0f;
+    int64_t numBuckets = 0;
+    if (useBucketQueue && !getBucketSetup(smoothflag, bucketWidth, numBuckets))
+    {
+        bucketWidth = -1.0f;//degenerate edges, just use the heap
+    }
+    const int64_t BLOCK_SIZE = 64;//roots per unit of work, enough that per-block result storage isn't a big overhead
+    const int64_t numBlocks = (numRoots + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    vector<vector<int32_t> > blockNodes(numBlocks);
+    vector<vector<float> > blockDists(numBlocks);
+    vector<int64_t> rowCounts(numRoots, 0);
+#pragma omp CARET_PAR
+    {
+        GeodesicHelper myHelp(m_myBase);//own scratch space per thread, doesn't touch this object's, so doesn't need the lock
+        vector<int32_t> nodes;
+        vector<float> dists;
+#pragma omp CARET_FOR schedule(dynamic)
+        for (int64_t block = 0; block < numBlocks; ++block)
+        {
+            int64_t blockEnd = min(numRoots, (block + 1) * BLOCK_SIZE);
+            for (int64_t i = block * BLOCK_SIZE; i < blockEnd; ++i)
+            {
+                nodes.clear();
+                dists.clear();
+                const int32_t root = roots[i];
+                CaretAssert(root < numNodes && root >= 0);
+                if (root < numNodes && root >= 0)//same as single version, empty result on invalid root in release
+                {
+                    if (bucketWidth > 0.0f)
+                    {
+                        myHelp.dijkstraBuckets(root, maxdist, nodes, dists, smoothflag, bucketWidth, numBuckets);
+                    } else {
+                        myHelp.dijkstra(root, maxdist, nodes, dists, smoothflag);
+                    }
+                }
+                rowCounts[i] = (int64_t)nodes.size();
+                blockNodes[block].insert(blockNodes[block].end(), nodes.begin(), nodes.end());
+                blockDists[block].insert(blockDists[block].end(), dists.begin(), dists.end());
+            }
+        }
+    }
+    for (int64_t i = 0; i < numRoots; ++i)
+    {
+        rowStartsOut[i + 1] = rowStartsOut[i] + rowCounts[i];
+    }
+    nodesOut.reserve(rowStartsOut[numRoots]);
+    distsOut.reserve(rowStartsOut[numRoots]);
+    for (int64_t block = 0; block < numBlocks; ++block)
+    {
+        nodesOut.insert(nodesOut.end(), blockNodes[block].begin(), blockNodes[block].end());
+        distsOut.insert(distsOut.end(), blockDists[block].begin(), blockDists[block].end());
+        vector<int32_t>().swap(blockNodes[block]);//free as we go, to keep peak memory down
+        vector<float>().swap(blockDists[block]);
+    }
+}
+
+bool GeodesicHelper::getBucketSetup(const bool& smooth, float& bucketWidthOut, int64_t& numBucketsOut) const
+{//buckets narrower than any edge mean nodes in the lowest bucket can't improve each other, so they are all final
+    float minEdge = -1.0f, maxEdge = -1.0f;
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        for (int pass = 0; pass < (smooth ? 2 : 1); ++pass)
+        {
+            const vector<float>& edgeDists = (pass == 0 ? distances[i] : distances2[i]);
+            for (int j = 0; j < (int)edgeDists.size(); ++j)
+            {
+                if (minEdge < 0.0f || edgeDists[j] < minEdge) minEdge = edgeDists[j];
+                if (edgeDists[j] > maxEdge) maxEdge = edgeDists[j];
+            }
+        }
+    }
+    if (!(minEdge > 0.0f)) return false;
+    bucketWidthOut = minEdge * 0.999f;//margin so that rounding in the bucket index can't put a neighbor in the current bucket
+    numBucketsOut = (int64_t)ceil(maxEdge / bucketWidthOut) + 3;//circular, only needs to cover the longest edge
+    return numBucketsOut <= (1<<16);//very uneven edge lengths, the heap is better
+}
+
+void GeodesicHelper::dijkstraBuckets(const int32_t root, const float maxdist, std::vector<int32_t>& nodes, std::vector<float>& dists, bool smooth,
+                                     const float& bucketWidth, const int64_t& numBuckets)
+{//entries are never removed when a node's distance decreases, instead, the duplicate that comes later is skipped because the node is already frozen
+    if ((int64_t)m_buckets.size() < numBuckets) m_buckets.resize(numBuckets);
+    int32_t numChanged = 0;
+    output[root] = 0.0f;
+    marked[root] |= 4;
+    parent[root] = -1;
+    changed[numChanged++] = root;
+    m_buckets[0].push_back(root);
+    int64_t numPending = 1;
+    for (int64_t curBucket = 0; numPending > 0; ++curBucket)
+    {
+        vector<int32_t>& thisBucket = m_buckets[curBucket % numBuckets];
+        for (size_t k = 0; k < thisBucket.size(); ++k)//can't use an iterator or reference, rounding could conceivably still add to this bucket
+        {
+            const int32_t whichnode = thisBucket[k];
+            --numPending;
+            if (marked[whichnode] & 1) continue;//stale duplicate
+            marked[whichnode] |= 1;
+            nodes.push_back(whichnode);
+            dists.push_back(output[whichnode]);
+            for (int pass = 0; pass < (smooth ? 2 : 1); ++pass)
+            {
+                const vector<int32_t>& neighbors = (pass == 0 ? nodeNeighbors[whichnode] : nodeNeighbors2[whichnode]);
+                const vector<float>& edgeDists = (pass == 0 ? distances[whichnode] : distances2[whichnode]);
+                const int32_t numNeigh = (int32_t)neighbors.size();
+                for (int32_t j = 0; j < numNeigh; ++j)
+                {
+                    const int32_t whichneigh = neighbors[j];
+                    if (marked[whichneigh] & 1) continue;
+                    const float tempf = output[whichnode] + edgeDists[j];
+                    if (tempf > maxdist) continue;
+                    if (!(marked[whichneigh] & 4))
+                    {
+                        marked[whichneigh] |= 4;
+                        changed[numChanged++] = whichneigh;
+                    } else if (!(tempf < output[whichneigh])) {
+                        continue;
+                    }
+                    output[whichneigh] = tempf;
+                    parent[whichneigh] = whichnode;
+                    m_buckets[((int64_t)(tempf / bucketWidth)) % numBuckets].push_back(whichneigh);
+                    ++numPending;
+                }
+            }
+        }
+        thisBucket.clear();
+    }
+    for (int32_t i = 0; i < numChanged; ++i)
+    {
+        marked[changed[i]] = 0;
+    }
+}
+
 void GeodesicHelper::dijkstra(const int32_t root, const float maxdist, std::vector<int32_t>& nodes, std::vector<float>& dists, bool smooth)
 {
     int32_t i, j, whichnode, whichneigh, numNeigh, numChanged = 0;
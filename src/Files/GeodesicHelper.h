@@ -78,6 +78,7 @@ namespace caret {
         std::vector<float> heurVal;
         std::vector<int32_t> marked, changed, parentStore;
         std::vector<int64_t> m_heapIdent;
+        std::vector<std::vector<int32_t> > m_buckets;//circular bucket queue for bounded batch queries
         int32_t numNodes;
         float m_avgNodeSpacing;
         float m_corrAreaSmallestFactor;
@@ -85,6 +86,8 @@ namespace caret {
         GeodesicHelper& operator=(const GeodesicHelper& right);//can't assign
         GeodesicHelper(const GeodesicHelper&);//can't use copy constructor
         void dijkstra(const int32_t root, const float maxdist, std::vector<int32_t>& nodes, std::vector<float>& dists, bool smooth);//geodesic distance restricted
+        void dijkstraBuckets(const int32_t root, const float maxdist, std::vector<int32_t>& nodes, std::vector<float>& dists, bool smooth, const float& bucketWidth, const int64_t& numBuckets);//same, with bucket queue
+        bool getBucketSetup(const bool& smooth, float& bucketWidthOut, int64_t& numBucketsOut) const;
         void dijkstra(const int32_t root, bool smooth);//full surface
         void dijkstra(const int32_t root, const std::vector<int32_t>& interested, bool smooth);//partial surface
         int32_t dijkstra(const std::vector<int32_t>& startList, const std::vector<int32_t>& endList, const float& maxDist, bool smooth);//one path that connects lists
@@ -104,6 +107,12 @@ namespace caret {
         /// Get distances from root node, up to a geodesic distance cutoff, and also return their parents (root node has -1 as parent)
         void getNodesToGeoDist(const int32_t node, const float maxdist, std::vector<int32_t>& neighborsOut, std::vector<float>& distsOut, std::vector<int32_t>& parentsOut, const bool smoothflag = true);
 
+        /// Get distances from many root nodes, up to a geodesic distance cutoff, computed in parallel, in compressed sparse row form:
+        /// the nodes within maxdist of roots[i] are nodesOut[rowStartsOut[i]] to nodesOut[rowStartsOut[i + 1] - 1], in the same order as the single root version
+        /// useBucketQueue replaces the heap with buckets narrower than the shortest edge, which gives identical distances, but not in increasing order within a row
+        void getNodesToGeoDist(const std::vector<int32_t>& roots, const float maxdist, std::vector<int64_t>& rowStartsOut, std::vector<int32_t>& nodesOut,
+                               std::vector<float>& distsOut, const bool smoothflag = true, const bool useBucketQueue = false);
+
         /// Get distances from root node to entire surface - allocate the array first
         void getGeoFromNode(const int32_t node, float* valuesOut, const bool smoothflag = true);//MUST be already allocated to number of nodes
 
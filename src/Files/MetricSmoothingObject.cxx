@@ -25,13 +25,60 @@
 #include "SurfaceFile.h"
 #include "MetricFile.h"
 #include "GeodesicHelper.h"
+#include "SurfaceWeightCache.h"
 #include "TopologyHelper.h"
 #include "CaretOMP.h"
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
 using namespace caret;
 
+namespace
+{
+    const int32_t GEO_BLOCK_ROOTS = 16384;//neighborhoods are computed this many roots at a time, so the batch result stays small next to the weights
+    
+    //geodesic neighborhoods for a block of roots, from one parallel batch query, rather than one query per node in each thread
+    class GeoNeighborhoodBlock
+    {
+        GeodesicHelper* m_helper;
+        float m_maxDist;
+        const float* m_roi;
+        int32_t m_blockStart;
+        vector<int32_t> m_rowForNode, m_roots, m_nodes;
+        vector<int64_t> m_rowStarts;
+        vector<float> m_dists;
+    public:
+        GeoNeighborhoodBlock(GeodesicHelper* helper, const float& maxDist, const float* roi = NULL) : m_helper(helper), m_maxDist(maxDist), m_roi(roi), m_blockStart(0) { }
+        
+        //only nodes inside the roi get a neighborhood
+        void compute(const int32_t& blockStart, const int32_t& blockEnd)
+        {
+            m_blockStart = blockStart;
+            m_roots.clear();
+            m_rowForNode.assign(blockEnd - blockStart, -1);
+            for (int32_t i = blockStart; i < blockEnd; ++i)
+            {
+                if (m_roi == NULL || m_roi[i] > 0.0f)
+                {
+                    m_rowForNode[i - blockStart] = (int32_t)m_roots.size();
+                    m_roots.push_back(i);
+                }
+            }
+            m_helper->getNodesToGeoDist(m_roots, m_maxDist, m_rowStarts, m_nodes, m_dists, true);
+        }
+        
+        //same order and values as the single root getNodesToGeoDist, so the weights don't change
+        void getNeighborhood(const int32_t& node, vector<int32_t>& nodesOut, vector<float>& distsOut) const
+        {
+            const int32_t row = m_rowForNode[node - m_blockStart];
+            CaretAssert(row >= 0);
+            nodesOut.assign(m_nodes.begin() + m_rowStarts[row], m_nodes.begin() + m_rowStarts[row + 1]);
+            distsOut.assign(m_dists.begin() + m_rowStarts[row], m_dists.begin() + m_rowStarts[row + 1]);
+        }
+    };
+}
+
 MetricSmoothingObject::MetricSmoothingObject(const SurfaceFile* mySurf, const float& kernel, const MetricFile* myRoi, Method myMethod, const float* nodeAreas)
 {
     CaretAssert(mySurf != NULL);
@@ -46,7 +93,7 @@ void MetricSmoothingObject::smoothColumn(const MetricFile* metricIn, const int&
 {
     CaretAssert(metricIn != NULL);
     CaretAssert(columnOut != NULL);
-    if (metricIn->getNumberOfNodes() != (int32_t)m_weightLists.size())
+    if (metricIn->getNumberOfNodes() != (int32_t)m_weightSums.size())
     {
         throw CaretException("metric does not match surface number of nodes");
     }
@@ -54,14 +101,14 @@ void MetricSmoothingObject::smoothColumn(const MetricFile* metricIn, const int&
     {
         throw CaretException("invalid column number");
     }
-    if (columnOut->getNumberOfNodes() != (int32_t)m_weightLists.size() || columnOut->getNumberOfColumns() != 1)
+    if (columnOut->getNumberOfNodes() != (int32_t)m_weightSums.size() || columnOut->getNumberOfColumns() != 1)
     {
-        columnOut->setNumberOfNodesAndColumns(m_weightLists.size(), 1);
+        columnOut->setNumberOfNodesAndColumns(m_weightSums.size(), 1);
     }
     vector<float> scratch(metricIn->getNumberOfNodes());
     if (roi != NULL)
     {
-        if (roi->getNumberOfNodes() != (int32_t)m_weightLists.size())
+        if (roi->getNumberOfNodes() != (int32_t)m_weightSums.size())
         {
             throw CaretException("roi does not match surface number of nodes");
         }
@@ -75,15 +122,15 @@ void MetricSmoothingObject::smoothColumn(const MetricFile* metricIn, const int&
 {
     CaretAssert(metricIn != NULL);
     CaretAssert(metricOut != NULL);
-    if (metricIn->getNumberOfNodes() != (int32_t)m_weightLists.size())
+    if (metricIn->getNumberOfNodes() != (int32_t)m_weightSums.size())
     {
         throw CaretException("metric does not match surface number of nodes");
     }
-    if (metricOut->getNumberOfNodes() != (int32_t)m_weightLists.size())
+    if (metricOut->getNumberOfNodes() != (int32_t)m_weightSums.size())
     {
         throw CaretException("output metric does not match surface number of nodes");
     }
-    if (roi != NULL && (roi->getNumberOfNodes() != (int32_t)m_weightLists.size()))
+    if (roi != NULL && (roi->getNumberOfNodes() != (int32_t)m_weightSums.size()))
     {
         throw CaretException("roi does not match surface number of nodes");
     }
@@ -113,29 +160,75 @@ void MetricSmoothingObject::smoothMetric(const MetricFile* metricIn, MetricFile*
     CaretAssert(metricIn != NULL);
     CaretAssert(metricOut != NULL);
     int32_t numCols = metricIn->getNumberOfColumns();
-    if (metricIn->getNumberOfNodes() != (int32_t)m_weightLists.size())
+    if (metricIn->getNumberOfNodes() != (int32_t)m_weightSums.size())
     {
         throw CaretException("metric does not match surface number of nodes");
     }
-    if (metricOut->getNumberOfNodes() != (int32_t)m_weightLists.size() || metricOut->getNumberOfColumns() != numCols)
+    if (metricOut->getNumberOfNodes() != (int32_t)m_weightSums.size() || metricOut->getNumberOfColumns() != numCols)
     {
-        metricOut->setNumberOfNodesAndColumns(m_weightLists.size(), numCols);
+        metricOut->setNumberOfNodesAndColumns(m_weightSums.size(), numCols);
     }
-    vector<float> scratch(metricIn->getNumberOfNodes());
-    if (roi != NULL)
+    if (roi != NULL && roi->getNumberOfNodes() != (int32_t)m_weightSums.size())
     {
-        if (roi->getNumberOfNodes() != (int32_t)m_weightLists.size())
-        {
-            throw CaretException("roi does not match surface number of nodes");
-        }
+        throw CaretException("roi does not match surface number of nodes");
+    }
+    if (fixZeros)
+    {//which neighbors are used depends on the data, so go one column at a time
+        vector<float> scratch(metricIn->getNumberOfNodes());
         for (int32_t i = 0; i < numCols; ++i)
         {
-            smoothColumnInternal(scratch.data(), metricIn, i, metricOut, i, roi, 0, fixZeros);
+            if (roi != NULL)
+            {
+                smoothColumnInternal(scratch.data(), metricIn, i, metricOut, i, roi, 0, fixZeros);
+            } else {
+                smoothColumnInternal(scratch.data(), metricIn, i, metricOut, i, fixZeros);
+            }
         }
     } else {
-        for (int32_t i = 0; i < numCols; ++i)
+        if (roi != NULL)
+        {//the roi is the same for all columns, so restrict the weights once and then do all columns together
+            const float* roiColumn = roi->getValuePointerForColumn(0);
+            SparseMatrixCSR maskedWeights;
+            vector<float> maskedSums;
+            m_weights.getMasked(roiColumn, roiColumn, maskedWeights);
+            maskedWeights.getRowSums(maskedSums);
+            smoothColumnsInterleaved(maskedWeights, maskedSums, metricIn, metricOut);
+        } else {
+            smoothColumnsInterleaved(m_weights, m_weightSums, metricIn, metricOut);
+        }
+    }
+}
+
+void MetricSmoothingObject::smoothColumnsInterleaved(const SparseMatrixCSR& weights, const vector<float>& weightSums, const MetricFile* metricIn, MetricFile* metricOut) const
+{
+    const int32_t numNodes = metricIn->getNumberOfNodes(), numCols = metricIn->getNumberOfColumns();
+    const int32_t COLUMN_BLOCK = 32;//enough columns to make each weight do a useful amount of work, few enough that the interleaved copies are modest
+    const int32_t blockSize = min(numCols, COLUMN_BLOCK);
+    vector<float> interleavedIn((int64_t)numNodes * blockSize), interleavedOut((int64_t)numNodes * blockSize), scratch(numNodes);
+    for (int32_t colBase = 0; colBase < numCols; colBase += COLUMN_BLOCK)
+    {
+        const int32_t colCount = min(COLUMN_BLOCK, numCols - colBase);
+        for (int32_t c = 0; c < colCount; ++c)
         {
-            smoothColumnInternal(scratch.data(), metricIn, i, metricOut, i, fixZeros);
+            const float* myColumn = metricIn->getValuePointerForColumn(colBase + c);
+            for (int32_t i = 0; i < numNodes; ++i)
+            {
+                interleavedIn[(int64_t)i * blockSize + c] = myColumn[i];
+            }
+        }
+        weights.multiplyInterleaved(interleavedIn.data(), blockSize, interleavedOut.data(), blockSize, colCount);
+        for (int32_t c = 0; c < colCount; ++c)
+        {
+            for (int32_t i = 0; i < numNodes; ++i)
+            {
+                if (weightSums[i] != 0.0f)
+                {
+                    scratch[i] = interleavedOut[(int64_t)i * blockSize + c] / weightSums[i];
+                } else {
+                    scratch[i] = 0.0f;
+                }
+            }
+            metricOut->setValuesForColumn(colBase + c, scratch.data());
         }
     }
 }
@@ -149,22 +242,23 @@ void MetricSmoothingObject::smoothColumnInternal(float* scratch, const MetricFil
     CaretAssert(whichOutColumn >= 0 && whichOutColumn < metricOut->getNumberOfColumns());
     const float* myColumn = metricIn->getValuePointerForColumn(whichColumn);
     int32_t numNodes = metricIn->getNumberOfNodes();
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
+    const int32_t* indices = m_weights.getIndices().data();
+    const float* weights = m_weights.getValues().data();
     if (fixZeros)//special case early to keep branching down
     {
 #pragma omp CARET_PARFOR schedule(dynamic)
         for (int32_t i = 0; i < numNodes; ++i)
         {
-            const WeightList& myWeightRef = m_weightLists[i];
-            if (myWeightRef.m_weightSum != 0.0f)//skip nodes with no neighbors quickly
+            if (m_weightSums[i] != 0.0f)//skip nodes with no neighbors quickly
             {
                 float sum = 0.0f, weightsum = 0.0f;
-                int32_t numWeights = myWeightRef.m_nodes.size();
-                for (int32_t j = 0; j < numWeights; ++j)
+                for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
                 {
-                    float value = myColumn[myWeightRef.m_nodes[j]];
+                    float value = myColumn[indices[j]];
                     if (value != 0.0f)
                     {
-                        float weight = myWeightRef.m_weights[j];
+                        float weight = weights[j];
                         sum += weight * value;
                         weightsum += weight;
                     }
@@ -180,19 +274,12 @@ void MetricSmoothingObject::smoothColumnInternal(float* scratch, const MetricFil
             }
         }
     } else {
-#pragma omp CARET_PARFOR schedule(dynamic)
+        m_weights.multiply(myColumn, scratch);
         for (int32_t i = 0; i < numNodes; ++i)
         {
-            const WeightList& myWeightRef = m_weightLists[i];
-            if (myWeightRef.m_weightSum != 0.0f)
+            if (m_weightSums[i] != 0.0f)
             {
-                float sum = 0.0f;
-                int32_t numWeights = myWeightRef.m_nodes.size();
-                for (int32_t j = 0; j < numWeights; ++j)
-                {
-                    sum += myWeightRef.m_weights[j] * myColumn[myWeightRef.m_nodes[j]];
-                }
-                scratch[i] = sum / myWeightRef.m_weightSum;
+                scratch[i] /= m_weightSums[i];
             } else {
                 scratch[i] = 0.0f;
             }
@@ -213,141 +300,126 @@ void MetricSmoothingObject::smoothColumnInternal(float* scratch, const MetricFil
     const float* myColumn = metricIn->getValuePointerForColumn(whichColumn);
     const float* roiColumn = roi->getValuePointerForColumn(whichRoiColumn);
     int32_t numNodes = metricIn->getNumberOfNodes();
-    if (fixZeros)//special case early to keep branching down
-    {
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
+    const int32_t* indices = m_weights.getIndices().data();
+    const float* weights = m_weights.getValues().data();
 #pragma omp CARET_PARFOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        if (roiColumn[i] > 0.0f && m_weightSums[i] != 0.0f)//skip nodes with no neighbors quickly
         {
-            const WeightList& myWeightRef = m_weightLists[i];
-            if (roiColumn[i] > 0.0f && myWeightRef.m_weightSum != 0.0f)//skip nodes with no neighbors quickly
+            float sum = 0.0f, weightsum = 0.0f;
+            for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
             {
-                float sum = 0.0f, weightsum = 0.0f;
-                int32_t numWeights = myWeightRef.m_nodes.size();
-                for (int32_t j = 0; j < numWeights; ++j)
-                {
-                    int32_t neighbor = myWeightRef.m_nodes[j];
-                    float value = myColumn[neighbor];
-                    if (roiColumn[neighbor] > 0.0f && value != 0.0f)
-                    {
-                        float weight = myWeightRef.m_weights[j];
-                        sum += weight * value;
-                        weightsum += weight;
-                    }
-                }
-                if (weightsum != 0.0f)
+                int32_t neighbor = indices[j];
+                float value = myColumn[neighbor];
+                if (roiColumn[neighbor] > 0.0f && (!fixZeros || value != 0.0f))
                 {
-                    scratch[i] = sum / weightsum;
-                } else {
-                    scratch[i] = 0.0f;
+                    float weight = weights[j];
+                    sum += weight * value;
+                    weightsum += weight;
                 }
-            } else {
-                scratch[i] = 0.0f;//but we do need to zero what we skip, so a list of nodes to check may not help
             }
-        }
-    } else {
-#pragma omp CARET_PARFOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
-        {
-            const WeightList& myWeightRef = m_weightLists[i];
-            if (roiColumn[i] > 0.0f && myWeightRef.m_weightSum != 0.0f)
+            if (weightsum != 0.0f)
             {
-                float sum = 0.0f, weightsum = 0.0f;
-                int32_t numWeights = myWeightRef.m_nodes.size();
-                for (int32_t j = 0; j < numWeights; ++j)
-                {
-                    int32_t neighbor = myWeightRef.m_nodes[j];
-                    if (roiColumn[neighbor] > 0.0f)
-                    {
-                        float weight = myWeightRef.m_weights[j];
-                        sum += weight * myColumn[neighbor];
-                        weightsum += weight;
-                    }
-                }
-                if (weightsum != 0.0f)
-                {
-                    scratch[i] = sum / weightsum;
-                } else {
-                    scratch[i] = 0.0f;
-                }
+                scratch[i] = sum / weightsum;
             } else {
                 scratch[i] = 0.0f;
             }
+        } else {
+            scratch[i] = 0.0f;//but we do need to zero what we skip, so a list of nodes to check may not help
         }
     }
     metricOut->setValuesForColumn(whichOutColumn, scratch);
 }
 
-void MetricSmoothingObject::precomputeWeightsGeoGauss(const SurfaceFile* mySurf, float myKernel)
+void MetricSmoothingObject::precomputeWeightsGeoGauss(vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel)
 {
     int32_t numNodes = mySurf->getNumberOfNodes();
     float myGeoDist = myKernel * 3.0f;
     float gaussianDenom = -0.5f / myKernel / myKernel;
-    m_weightLists.resize(numNodes);
-#pragma omp CARET_PAR
+    weightLists.resize(numNodes);
+    CaretPointer<GeodesicHelper> batchHelp = mySurf->getGeodesicHelper();
+    GeoNeighborhoodBlock myBlock(batchHelp, myGeoDist);
+    for (int32_t blockStart = 0; blockStart < numNodes; blockStart += GEO_BLOCK_ROOTS)
     {
-        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();//don't really need one per thread here, but good practice in case we want getNeighborsToDepth
-        CaretPointer<GeodesicHelper> myGeoHelp = mySurf->getGeodesicHelper();
-        vector<float> distances;
-#pragma omp CARET_FOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+        const int32_t blockEnd = min(numNodes, blockStart + GEO_BLOCK_ROOTS);
+        myBlock.compute(blockStart, blockEnd);
+#pragma omp CARET_PAR
         {
-            myGeoHelp->getNodesToGeoDist(i, myGeoDist, m_weightLists[i].m_nodes, distances, true);
-            if (distances.size() < 7)
-            {
-                m_weightLists[i].m_nodes = myTopoHelp->getNodeNeighbors(i);
-                m_weightLists[i].m_nodes.push_back(i);
-                myGeoHelp->getGeoToTheseNodes(i, m_weightLists[i].m_nodes, distances, true);
-            }
-            int32_t numNeigh = (int32_t)distances.size();
-            m_weightLists[i].m_weights.resize(numNeigh);
-            m_weightLists[i].m_weightSum = 0.0f;
-            for (int32_t j = 0; j < numNeigh; ++j)
+            CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();//don't really need one per thread here, but good practice in case we want getNeighborsToDepth
+            CaretPointer<GeodesicHelper> myGeoHelp;//only needed for the fallback, which is rare
+            vector<float> distances;
+#pragma omp CARET_FOR schedule(dynamic)
+            for (int32_t i = blockStart; i < blockEnd; ++i)
             {
-                float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
-                m_weightLists[i].m_weights[j] = weight;
-                m_weightLists[i].m_weightSum += weight;
+                myBlock.getNeighborhood(i, weightLists[i].m_nodes, distances);
+                if (distances.size() < 7)
+                {
+                    weightLists[i].m_nodes = myTopoHelp->getNodeNeighbors(i);
+                    weightLists[i].m_nodes.push_back(i);
+                    if (myGeoHelp == NULL) myGeoHelp = mySurf->getGeodesicHelper();
+                    myGeoHelp->getGeoToTheseNodes(i, weightLists[i].m_nodes, distances, true);
+                }
+                int32_t numNeigh = (int32_t)distances.size();
+                weightLists[i].m_weights.resize(numNeigh);
+                weightLists[i].m_weightSum = 0.0f;
+                for (int32_t j = 0; j < numNeigh; ++j)
+                {
+                    float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
+                    weightLists[i].m_weights[j] = weight;
+                    weightLists[i].m_weightSum += weight;
+                }
             }
         }
     }
 }
 
-void MetricSmoothingObject::precomputeWeightsROIGeoGauss(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi)
+void MetricSmoothingObject::precomputeWeightsROIGeoGauss(vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi)
 {
     int32_t numNodes = mySurf->getNumberOfNodes();
     float myGeoDist = myKernel * 3.0f;
     float gaussianDenom = -0.5f / myKernel / myKernel;
-    m_weightLists.resize(numNodes);
+    weightLists.resize(numNodes);
     const float* myRoiColumn = theRoi->getValuePointerForColumn(0);
-#pragma omp CARET_PAR
+    CaretPointer<GeodesicHelper> batchHelp = mySurf->getGeodesicHelper();
+    GeoNeighborhoodBlock myBlock(batchHelp, myGeoDist, myRoiColumn);
+    for (int32_t blockStart = 0; blockStart < numNodes; blockStart += GEO_BLOCK_ROOTS)
     {
-        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
-        CaretPointer<GeodesicHelper> myGeoHelp = mySurf->getGeodesicHelper();
-        vector<float> distances;
-        vector<int32_t> nodes;
-#pragma omp CARET_FOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+        const int32_t blockEnd = min(numNodes, blockStart + GEO_BLOCK_ROOTS);
+        myBlock.compute(blockStart, blockEnd);
+#pragma omp CARET_PAR
         {
-            if (myRoiColumn[i] > 0.0f)
+            CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
+            CaretPointer<GeodesicHelper> myGeoHelp;//only needed for the fallback, which is rare
+            vector<float> distances;
+            vector<int32_t> nodes;
+#pragma omp CARET_FOR schedule(dynamic)
+            for (int32_t i = blockStart; i < blockEnd; ++i)
             {
-                myGeoHelp->getNodesToGeoDist(i, myGeoDist, nodes, distances, true);
-                if (distances.size() < 7)
-                {
-                    nodes = myTopoHelp->getNodeNeighbors(i);
-                    nodes.push_back(i);
-                    myGeoHelp->getGeoToTheseNodes(i, nodes, distances, true);
-                }
-                int32_t numNeigh = (int32_t)distances.size();
-                m_weightLists[i].m_weights.reserve(numNeigh);
-                m_weightLists[i].m_nodes.reserve(numNeigh);
-                m_weightLists[i].m_weightSum = 0.0f;
-                for (int32_t j = 0; j < numNeigh; ++j)
+                if (myRoiColumn[i] > 0.0f)
                 {
-                    if (myRoiColumn[nodes[j]] > 0.0f)
+                    myBlock.getNeighborhood(i, nodes, distances);
+                    if (distances.size() < 7)
                     {
-                        float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
-                        m_weightLists[i].m_weights.push_back(weight);
-                        m_weightLists[i].m_nodes.push_back(nodes[j]);
-                        m_weightLists[i].m_weightSum += weight;
+                        nodes = myTopoHelp->getNodeNeighbors(i);
+                        nodes.push_back(i);
+                        if (myGeoHelp == NULL) myGeoHelp = mySurf->getGeodesicHelper();
+                        myGeoHelp->getGeoToTheseNodes(i, nodes, distances, true);
+                    }
+                    int32_t numNeigh = (int32_t)distances.size();
+                    weightLists[i].m_weights.reserve(numNeigh);
+                    weightLists[i].m_nodes.reserve(numNeigh);
+                    weightLists[i].m_weightSum = 0.0f;
+                    for (int32_t j = 0; j < numNeigh; ++j)
+                    {
+                        if (myRoiColumn[nodes[j]] > 0.0f)
+                        {
+                            float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
+                            weightLists[i].m_weights.push_back(weight);
+                            weightLists[i].m_nodes.push_back(nodes[j]);
+                            weightLists[i].m_weightSum += weight;
+                        }
                     }
                 }
             }
@@ -355,7 +427,7 @@ void MetricSmoothingObject::precomputeWeightsROIGeoGauss(const SurfaceFile* mySu
     }
 }
 
-void MetricSmoothingObject::precomputeWeightsGeoGaussArea(const SurfaceFile* mySurf, float myKernel, const float* nodeAreas)
+void MetricSmoothingObject::precomputeWeightsGeoGaussArea(vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const float* nodeAreas)
 {//this method is normalized in two ways to provide evenly diffusing smoothing with equivalent sum of areas * values as input
     int32_t numNodes = mySurf->getNumberOfNodes();
     float myGeoDist = myKernel * 3.0f;
@@ -363,46 +435,54 @@ void MetricSmoothingObject::precomputeWeightsGeoGaussArea(const SurfaceFile* myS
     vector<WeightList> tempList;//this is used to compute scattering kernels because it is easier to normalize scattering kernels correctly, and then convert to gathering kernels
     tempList.resize(numNodes);
     CaretPointer<GeodesicHelperBase> myGeoBase(new GeodesicHelperBase(mySurf, nodeAreas));//NOTE: if these are equal to the surface's areas, then it does some extra operations, but gets the same answer
-#pragma omp CARET_PAR
+    GeodesicHelper batchHelp(myGeoBase);//only its base is used by the batch query
+    GeoNeighborhoodBlock myBlock(&batchHelp, myGeoDist);
+    for (int32_t blockStart = 0; blockStart < numNodes; blockStart += GEO_BLOCK_ROOTS)
     {
-        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();//don't really need one per thread here, but good practice in case we want getNeighborsToDepth
-        CaretPointer<GeodesicHelper> myGeoHelp(new GeodesicHelper(myGeoBase));
-        vector<float> distances;
-#pragma omp CARET_FOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+        const int32_t blockEnd = min(numNodes, blockStart + GEO_BLOCK_ROOTS);
+        myBlock.compute(blockStart, blockEnd);
+#pragma omp CARET_PAR
         {
-            myGeoHelp->getNodesToGeoDist(i, myGeoDist, tempList[i].m_nodes, distances, true);
-            const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
-            if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
-            {
-                tempList[i].m_nodes = tempneighbors;
-                tempList[i].m_nodes.push_back(i);
-                myGeoHelp->getGeoToTheseNodes(i, tempList[i].m_nodes, distances, true);
-            }
-            int32_t numNeigh = (int32_t)distances.size();
-            tempList[i].m_weights.resize(numNeigh);
-            tempList[i].m_weightSum = 0.0f;
-            for (int32_t j = 0; j < numNeigh; ++j)
-            {
-                float weight = exp(distances[j] * distances[j] * gaussianDenom) * nodeAreas[tempList[i].m_nodes[j]];//exp(- dist ^ 2 / (2 * sigma ^ 2)) * area
-                tempList[i].m_weights[j] = weight;//we multiply by area so that a node scattering to a dense region on one side and a sparse region on the other
-                tempList[i].m_weightSum += weight;//gives similar areal influence to each direction rather than giving a more influence on the dense region (simply because nodes are more numerous)
-            }
-            float myFactor = nodeAreas[i] / tempList[i].m_weightSum;//make each scattering kernel sum to the area of the node it scatters from
-            for (int32_t j = 0; j < numNeigh; ++j)
+            CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();//don't really need one per thread here, but good practice in case we want getNeighborsToDepth
+            CaretPointer<GeodesicHelper> myGeoHelp;//only needed for the fallback, which is rare
+            vector<float> distances;
+#pragma omp CARET_FOR schedule(dynamic)
+            for (int32_t i = blockStart; i < blockEnd; ++i)
             {
-                tempList[i].m_weights[j] *= myFactor;
+                myBlock.getNeighborhood(i, tempList[i].m_nodes, distances);
+                const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
+                if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
+                {
+                    tempList[i].m_nodes = tempneighbors;
+                    tempList[i].m_nodes.push_back(i);
+                    if (myGeoHelp == NULL) myGeoHelp.grabNew(new GeodesicHelper(myGeoBase));
+                    myGeoHelp->getGeoToTheseNodes(i, tempList[i].m_nodes, distances, true);
+                }
+                int32_t numNeigh = (int32_t)distances.size();
+                tempList[i].m_weights.resize(numNeigh);
+                tempList[i].m_weightSum = 0.0f;
+                for (int32_t j = 0; j < numNeigh; ++j)
+                {
+                    float weight = exp(distances[j] * distances[j] * gaussianDenom) * nodeAreas[tempList[i].m_nodes[j]];//exp(- dist ^ 2 / (2 * sigma ^ 2)) * area
+                    tempList[i].m_weights[j] = weight;//we multiply by area so that a node scattering to a dense region on one side and a sparse region on the other
+                    tempList[i].m_weightSum += weight;//gives similar areal influence to each direction rather than giving a more influence on the dense region (simply because nodes are more numerous)
+                }
+                float myFactor = nodeAreas[i] / tempList[i].m_weightSum;//make each scattering kernel sum to the area of the node it scatters from
+                for (int32_t j = 0; j < numNeigh; ++j)
+                {
+                    tempList[i].m_weights[j] *= myFactor;
+                }
+                tempList[i].m_weightSum = nodeAreas[i];
             }
-            tempList[i].m_weightSum = nodeAreas[i];
         }
     }
-    m_weightLists.resize(numNodes);//now convert it to gathering kernels
+    weightLists.resize(numNodes);//now convert it to gathering kernels
     for (int32_t i = 0; i < numNodes; ++i)//sadly, this is VERY hard to parallelize in a manner that is efficient, since it needs random access modification
     {
-        m_weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
+        weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
         size_t neighborCount = tempList[i].m_nodes.size();
-        m_weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes (geodesic distance should be symmetric except for rounding errors, so it should usually be exact)
-        m_weightLists[i].m_weights.reserve(neighborCount);
+        weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes (geodesic distance should be symmetric except for rounding errors, so it should usually be exact)
+        weightLists[i].m_weights.reserve(neighborCount);
     }
     for (int32_t i = 0; i < numNodes; ++i)//and this needs to push onto random vectors in the weight list
     {
@@ -411,14 +491,14 @@ void MetricSmoothingObject::precomputeWeightsGeoGaussArea(const SurfaceFile* myS
         {
             int32_t node = tempList[i].m_nodes[j];
             float weight = tempList[i].m_weights[j];
-            m_weightLists[node].m_nodes.push_back(i);
-            m_weightLists[node].m_weights.push_back(weight);
-            m_weightLists[node].m_weightSum += weight;
+            weightLists[node].m_nodes.push_back(i);
+            weightLists[node].m_weights.push_back(weight);
+            weightLists[node].m_weightSum += weight;
         }
     }
 }
 
-void MetricSmoothingObject::precomputeWeightsROIGeoGaussArea(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi, const float* nodeAreas)
+void MetricSmoothingObject::precomputeWeightsROIGeoGaussArea(vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi, const float* nodeAreas)
 {
     int32_t numNodes = mySurf->getNumberOfNodes();
     float myGeoDist = myKernel * 3.0f;
@@ -427,54 +507,62 @@ void MetricSmoothingObject::precomputeWeightsROIGeoGaussArea(const SurfaceFile*
     tempList.resize(numNodes);
     const float* myRoiColumn = theRoi->getValuePointerForColumn(0);
     CaretPointer<GeodesicHelperBase> myGeoBase(new GeodesicHelperBase(mySurf, nodeAreas));//NOTE: if these are equal to the surface's areas, then it does some extra operations, but gets the same answer
-#pragma omp CARET_PAR
+    GeodesicHelper batchHelp(myGeoBase);//only its base is used by the batch query
+    GeoNeighborhoodBlock myBlock(&batchHelp, myGeoDist, myRoiColumn);
+    for (int32_t blockStart = 0; blockStart < numNodes; blockStart += GEO_BLOCK_ROOTS)
     {
-        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
-        CaretPointer<GeodesicHelper> myGeoHelp(new GeodesicHelper(myGeoBase));
-        vector<float> distances;
-        vector<int32_t> nodes;
-#pragma omp CARET_FOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+        const int32_t blockEnd = min(numNodes, blockStart + GEO_BLOCK_ROOTS);
+        myBlock.compute(blockStart, blockEnd);
+#pragma omp CARET_PAR
         {
-            if (myRoiColumn[i] > 0.0f)//we don't need to scatter from things outside the ROI
+            CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
+            CaretPointer<GeodesicHelper> myGeoHelp;//only needed for the fallback, which is rare
+            vector<float> distances;
+            vector<int32_t> nodes;
+#pragma omp CARET_FOR schedule(dynamic)
+            for (int32_t i = blockStart; i < blockEnd; ++i)
             {
-                myGeoHelp->getNodesToGeoDist(i, myGeoDist, nodes, distances, true);
-                const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
-                if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
+                if (myRoiColumn[i] > 0.0f)//we don't need to scatter from things outside the ROI
                 {
-                    nodes = tempneighbors;
-                    nodes.push_back(i);
-                    myGeoHelp->getGeoToTheseNodes(i, nodes, distances, true);
-                }
-                int32_t numNeigh = (int32_t)distances.size();
-                tempList[i].m_weightSum = 0.0f;
-                for (int32_t j = 0; j < numNeigh; ++j)
-                {//but we DO need to compute scattering TO things outside the ROI, so that our normalization doesn't increase the in-ROI influence of edge nodes
-                    float weight = exp(distances[j] * distances[j] * gaussianDenom) * nodeAreas[nodes[j]];//exp(- dist ^ 2 / (2 * sigma ^ 2)) * area
-                    tempList[i].m_weightSum += weight;//add it to the total weight in order to normalize correctly
-                    if (myRoiColumn[nodes[j]] > 0.0f)
-                    {//BUT, don't add it to the list if it is outside the ROI
-                        tempList[i].m_nodes.push_back(nodes[j]);
-                        tempList[i].m_weights.push_back(weight);
+                    myBlock.getNeighborhood(i, nodes, distances);
+                    const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
+                    if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
+                    {
+                        nodes = tempneighbors;
+                        nodes.push_back(i);
+                        if (myGeoHelp == NULL) myGeoHelp.grabNew(new GeodesicHelper(myGeoBase));
+                        myGeoHelp->getGeoToTheseNodes(i, nodes, distances, true);
                     }
+                    int32_t numNeigh = (int32_t)distances.size();
+                    tempList[i].m_weightSum = 0.0f;
+                    for (int32_t j = 0; j < numNeigh; ++j)
+                    {//but we DO need to compute scattering TO things outside the ROI, so that our normalization doesn't increase the in-ROI influence of edge nodes
+                        float weight = exp(distances[j] * distances[j] * gaussianDenom) * nodeAreas[nodes[j]];//exp(- dist ^ 2 / (2 * sigma ^ 2)) * area
+                        tempList[i].m_weightSum += weight;//add it to the total weight in order to normalize correctly
+                        if (myRoiColumn[nodes[j]] > 0.0f)
+                        {//BUT, don't add it to the list if it is outside the ROI
+                            tempList[i].m_nodes.push_back(nodes[j]);
+                            tempList[i].m_weights.push_back(weight);
+                        }
+                    }
+                    float myFactor = nodeAreas[i] / tempList[i].m_weightSum;//make each scattering kernel sum to the area of the node it scatters from
+                    int32_t numUsed = (int32_t)tempList[i].m_nodes.size();
+                    for (int32_t j = 0; j < numUsed; ++j)
+                    {
+                        tempList[i].m_weights[j] *= myFactor;
+                    }
+                    tempList[i].m_weightSum = 0.0f;//this is never actually used again, but make sure it is wrong in case anything tries to use it
                 }
-                float myFactor = nodeAreas[i] / tempList[i].m_weightSum;//make each scattering kernel sum to the area of the node it scatters from
-                int32_t numUsed = (int32_t)tempList[i].m_nodes.size();
-                for (int32_t j = 0; j < numUsed; ++j)
-                {
-                    tempList[i].m_weights[j] *= myFactor;
-                }
-                tempList[i].m_weightSum = 0.0f;//this is never actually used again, but make sure it is wrong in case anything tries to use it
             }
         }
     }
-    m_weightLists.resize(numNodes);//now convert it to gathering kernels
+    weightLists.resize(numNodes);//now convert it to gathering kernels
     for (int32_t i = 0; i < numNodes; ++i)//sadly, this is VERY hard to parallelize in a manner that is efficient, since it needs random access modification
     {
-        m_weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
+        weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
         size_t neighborCount = tempList[i].m_nodes.size();
-        m_weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes, again, should be exact except for rounding errors in geodesic distance
-        m_weightLists[i].m_weights.reserve(neighborCount);
+        weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes, again, should be exact except for rounding errors in geodesic distance
+        weightLists[i].m_weights.reserve(neighborCount);
     }
     for (int32_t i = 0; i < numNodes; ++i)//and this needs to push onto random vectors in the weight list
     {
@@ -483,60 +571,68 @@ void MetricSmoothingObject::precomputeWeightsROIGeoGaussArea(const SurfaceFile*
         {
             int32_t node = tempList[i].m_nodes[j];
             float weight = tempList[i].m_weights[j];
-            m_weightLists[node].m_nodes.push_back(i);
-            m_weightLists[node].m_weights.push_back(weight);
-            m_weightLists[node].m_weightSum += weight;
+            weightLists[node].m_nodes.push_back(i);
+            weightLists[node].m_weights.push_back(weight);
+            weightLists[node].m_weightSum += weight;
         }
     }
 }
 
-void MetricSmoothingObject::precomputeWeightsGeoGaussEqual(const SurfaceFile* mySurf, float myKernel)
+void MetricSmoothingObject::precomputeWeightsGeoGaussEqual(vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel)
 {//this method is normalized in two ways to provide evenly diffusing smoothing with equivalent sum of values as input - this special purpose smoothing is for things that should not be integrated across the surface
     int32_t numNodes = mySurf->getNumberOfNodes();
     float myGeoDist = myKernel * 3.0f;
     float gaussianDenom = -0.5f / myKernel / myKernel;
     vector<WeightList> tempList;//this is used to compute scattering kernels because it is easier to normalize scattering kernels correctly, and then convert to gathering kernels
     tempList.resize(numNodes);
-#pragma omp CARET_PAR
+    CaretPointer<GeodesicHelper> batchHelp = mySurf->getGeodesicHelper();
+    GeoNeighborhoodBlock myBlock(batchHelp, myGeoDist);
+    for (int32_t blockStart = 0; blockStart < numNodes; blockStart += GEO_BLOCK_ROOTS)
     {
-        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();//don't really need one per thread here, but good practice in case we want getNeighborsToDepth
-        CaretPointer<GeodesicHelper> myGeoHelp = mySurf->getGeodesicHelper();
-        vector<float> distances;
-#pragma omp CARET_FOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+        const int32_t blockEnd = min(numNodes, blockStart + GEO_BLOCK_ROOTS);
+        myBlock.compute(blockStart, blockEnd);
+#pragma omp CARET_PAR
         {
-            myGeoHelp->getNodesToGeoDist(i, myGeoDist, tempList[i].m_nodes, distances, true);
-            const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
-            if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
-            {
-                tempList[i].m_nodes = tempneighbors;
-                tempList[i].m_nodes.push_back(i);
-                myGeoHelp->getGeoToTheseNodes(i, tempList[i].m_nodes, distances, true);
-            }
-            int32_t numNeigh = (int32_t)distances.size();
-            tempList[i].m_weights.resize(numNeigh);
-            tempList[i].m_weightSum = 0.0f;
-            for (int32_t j = 0; j < numNeigh; ++j)
-            {
-                float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
-                tempList[i].m_weights[j] = weight;//we multiply by area so that a node scattering to a dense region on one side and a sparse region on the other
-                tempList[i].m_weightSum += weight;//gives similar areal influence to each direction rather than giving a more influence on the dense region (simply because nodes are more numerous)
-            }
-            float myFactor = 1.0f / tempList[i].m_weightSum;//make each scattering kernel sum to 1
-            for (int32_t j = 0; j < numNeigh; ++j)
+            CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();//don't really need one per thread here, but good practice in case we want getNeighborsToDepth
+            CaretPointer<GeodesicHelper> myGeoHelp;//only needed for the fallback, which is rare
+            vector<float> distances;
+#pragma omp CARET_FOR schedule(dynamic)
+            for (int32_t i = blockStart; i < blockEnd; ++i)
             {
-                tempList[i].m_weights[j] *= myFactor;
+                myBlock.getNeighborhood(i, tempList[i].m_nodes, distances);
+                const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
+                if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
+                {
+                    tempList[i].m_nodes = tempneighbors;
+                    tempList[i].m_nodes.push_back(i);
+                    if (myGeoHelp == NULL) myGeoHelp = mySurf->getGeodesicHelper();
+                    myGeoHelp->getGeoToTheseNodes(i, tempList[i].m_nodes, distances, true);
+                }
+                int32_t numNeigh = (int32_t)distances.size();
+                tempList[i].m_weights.resize(numNeigh);
+                tempList[i].m_weightSum = 0.0f;
+                for (int32_t j = 0; j < numNeigh; ++j)
+                {
+                    float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
+                    tempList[i].m_weights[j] = weight;//we multiply by area so that a node scattering to a dense region on one side and a sparse region on the other
+                    tempList[i].m_weightSum += weight;//gives similar areal influence to each direction rather than giving a more influence on the dense region (simply because nodes are more numerous)
+                }
+                float myFactor = 1.0f / tempList[i].m_weightSum;//make each scattering kernel sum to 1
+                for (int32_t j = 0; j < numNeigh; ++j)
+                {
+                    tempList[i].m_weights[j] *= myFactor;
+                }
+                tempList[i].m_weightSum = 1.0f;
             }
-            tempList[i].m_weightSum = 1.0f;
         }
     }
-    m_weightLists.resize(numNodes);//now convert it to gathering kernels
+    weightLists.resize(numNodes);//now convert it to gathering kernels
     for (int32_t i = 0; i < numNodes; ++i)//sadly, this is VERY hard to parallelize in a manner that is efficient, since it needs random access modification
     {
-        m_weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
+        weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
         size_t neighborCount = tempList[i].m_nodes.size();
-        m_weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes (geodesic distance should be symmetric except for rounding errors, so it should usually be exact)
-        m_weightLists[i].m_weights.reserve(neighborCount);
+        weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes (geodesic distance should be symmetric except for rounding errors, so it should usually be exact)
+        weightLists[i].m_weights.reserve(neighborCount);
     }
     for (int32_t i = 0; i < numNodes; ++i)//and this needs to push onto random vectors in the weight list
     {
@@ -545,14 +641,14 @@ void MetricSmoothingObject::precomputeWeightsGeoGaussEqual(const SurfaceFile* my
         {
             int32_t node = tempList[i].m_nodes[j];
             float weight = tempList[i].m_weights[j];
-            m_weightLists[node].m_nodes.push_back(i);
-            m_weightLists[node].m_weights.push_back(weight);
-            m_weightLists[node].m_weightSum += weight;
+            weightLists[node].m_nodes.push_back(i);
+            weightLists[node].m_weights.push_back(weight);
+            weightLists[node].m_weightSum += weight;
         }
     }
 }
 
-void MetricSmoothingObject::precomputeWeightsROIGeoGaussEqual(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi)
+void MetricSmoothingObject::precomputeWeightsROIGeoGaussEqual(vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi)
 {
     int32_t numNodes = mySurf->getNumberOfNodes();
     float myGeoDist = myKernel * 3.0f;
@@ -560,54 +656,62 @@ void MetricSmoothingObject::precomputeWeightsROIGeoGaussEqual(const SurfaceFile*
     vector<WeightList> tempList;//this is used to compute scattering kernels because it is easier to normalize scattering kernels correctly, and then convert to gathering kernels
     tempList.resize(numNodes);
     const float* myRoiColumn = theRoi->getValuePointerForColumn(0);
-#pragma omp CARET_PAR
+    CaretPointer<GeodesicHelper> batchHelp = mySurf->getGeodesicHelper();
+    GeoNeighborhoodBlock myBlock(batchHelp, myGeoDist, myRoiColumn);
+    for (int32_t blockStart = 0; blockStart < numNodes; blockStart += GEO_BLOCK_ROOTS)
     {
-        CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
-        CaretPointer<GeodesicHelper> myGeoHelp = mySurf->getGeodesicHelper();
-        vector<float> distances;
-        vector<int32_t> nodes;
-#pragma omp CARET_FOR schedule(dynamic)
-        for (int32_t i = 0; i < numNodes; ++i)
+        const int32_t blockEnd = min(numNodes, blockStart + GEO_BLOCK_ROOTS);
+        myBlock.compute(blockStart, blockEnd);
+#pragma omp CARET_PAR
         {
-            if (myRoiColumn[i] > 0.0f)//we don't need to scatter from things outside the ROI
+            CaretPointer<TopologyHelper> myTopoHelp = mySurf->getTopologyHelper();
+            CaretPointer<GeodesicHelper> myGeoHelp;//only needed for the fallback, which is rare
+            vector<float> distances;
+            vector<int32_t> nodes;
+#pragma omp CARET_FOR schedule(dynamic)
+            for (int32_t i = blockStart; i < blockEnd; ++i)
             {
-                myGeoHelp->getNodesToGeoDist(i, myGeoDist, nodes, distances, true);
-                const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
-                if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
+                if (myRoiColumn[i] > 0.0f)//we don't need to scatter from things outside the ROI
                 {
-                    nodes = tempneighbors;
-                    nodes.push_back(i);
-                    myGeoHelp->getGeoToTheseNodes(i, nodes, distances, true);
-                }
-                int32_t numNeigh = (int32_t)distances.size();
-                tempList[i].m_weightSum = 0.0f;
-                for (int32_t j = 0; j < numNeigh; ++j)
-                {//but we DO need to compute scattering TO things outside the ROI, so that our normalization doesn't increase the in-ROI influence of edge nodes
-                    float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
-                    tempList[i].m_weightSum += weight;//add it to the total weight in order to normalize correctly
-                    if (myRoiColumn[nodes[j]] > 0.0f)
-                    {//BUT, don't add it to the list if it is outside the ROI
-                        tempList[i].m_nodes.push_back(nodes[j]);
-                        tempList[i].m_weights.push_back(weight);
+                    myBlock.getNeighborhood(i, nodes, distances);
+                    const vector<int32_t>& tempneighbors = myTopoHelp->getNodeNeighbors(i);
+                    if (distances.size() <= tempneighbors.size())//because neighbors doesn't include center, so if they are equal, geo is missing a neighbor
+                    {
+                        nodes = tempneighbors;
+                        nodes.push_back(i);
+                        if (myGeoHelp == NULL) myGeoHelp = mySurf->getGeodesicHelper();
+                        myGeoHelp->getGeoToTheseNodes(i, nodes, distances, true);
                     }
+                    int32_t numNeigh = (int32_t)distances.size();
+                    tempList[i].m_weightSum = 0.0f;
+                    for (int32_t j = 0; j < numNeigh; ++j)
+                    {//but we DO need to compute scattering TO things outside the ROI, so that our normalization doesn't increase the in-ROI influence of edge nodes
+                        float weight = exp(distances[j] * distances[j] * gaussianDenom);//exp(- dist ^ 2 / (2 * sigma ^ 2))
+                        tempList[i].m_weightSum += weight;//add it to the total weight in order to normalize correctly
+                        if (myRoiColumn[nodes[j]] > 0.0f)
+                        {//BUT, don't add it to the list if it is outside the ROI
+                            tempList[i].m_nodes.push_back(nodes[j]);
+                            tempList[i].m_weights.push_back(weight);
+                        }
+                    }
+                    float myFactor = 1.0f / tempList[i].m_weightSum;//make each scattering kernel sum to 1
+                    int32_t numUsed = (int32_t)tempList[i].m_nodes.size();
+                    for (int32_t j = 0; j < numUsed; ++j)
+                    {
+                        tempList[i].m_weights[j] *= myFactor;
+                    }
+                    tempList[i].m_weightSum = 0.0f;//this is never actually used again, but make sure it is wrong in case anything tries to use it
                 }
-                float myFactor = 1.0f / tempList[i].m_weightSum;//make each scattering kernel sum to 1
-                int32_t numUsed = (int32_t)tempList[i].m_nodes.size();
-                for (int32_t j = 0; j < numUsed; ++j)
-                {
-                    tempList[i].m_weights[j] *= myFactor;
-                }
-                tempList[i].m_weightSum = 0.0f;//this is never actually used again, but make sure it is wrong in case anything tries to use it
             }
         }
     }
-    m_weightLists.resize(numNodes);//now convert it to gathering kernels
+    weightLists.resize(numNodes);//now convert it to gathering kernels
     for (int32_t i = 0; i < numNodes; ++i)//sadly, this is VERY hard to parallelize in a manner that is efficient, since it needs random access modification
     {
-        m_weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
+        weightLists[i].m_weightSum = 0.0f;//memory initialization may not go much faster in parallel
         size_t neighborCount = tempList[i].m_nodes.size();
-        m_weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes, again, should be exact except for rounding errors in geodesic distance
-        m_weightLists[i].m_weights.reserve(neighborCount);
+        weightLists[i].m_nodes.reserve(neighborCount);//also preallocate the expected number of nodes, again, should be exact except for rounding errors in geodesic distance
+        weightLists[i].m_weights.reserve(neighborCount);
     }
     for (int32_t i = 0; i < numNodes; ++i)//and this needs to push onto random vectors in the weight list
     {
@@ -616,9 +720,9 @@ void MetricSmoothingObject::precomputeWeightsROIGeoGaussEqual(const SurfaceFile*
         {
             int32_t node = tempList[i].m_nodes[j];
             float weight = tempList[i].m_weights[j];
-            m_weightLists[node].m_nodes.push_back(i);
-            m_weightLists[node].m_weights.push_back(weight);
-            m_weightLists[node].m_weightSum += weight;
+            weightLists[node].m_nodes.push_back(i);
+            weightLists[node].m_weights.push_back(weight);
+            weightLists[node].m_weightSum += weight;
         }
     }
 }
@@ -639,18 +743,36 @@ void MetricSmoothingObject::precomputeWeights(const SurfaceFile* mySurf, float m
         default:
             break;
     }
+    int32_t numNodes = mySurf->getNumberOfNodes();
+    SurfaceWeightCache::Key cacheKey("MetricSmoothingObject weights v1");//change the version if the weight computation changes
+    const bool useCache = SurfaceWeightCache::isEnabled();
+    if (useCache)
+    {
+        cacheKey.addSurface(mySurf);
+        cacheKey.addInt(myMethod);
+        cacheKey.addFloat(myKernel);
+        cacheKey.addInt(theRoi != NULL ? 1 : 0);
+        if (theRoi != NULL) cacheKey.addData(theRoi->getValuePointerForColumn(0), numNodes);
+        if (myMethod == GEO_GAUSS_AREA) cacheKey.addData(passAreas, numNodes);
+        if (SurfaceWeightCache::load(cacheKey, numNodes, numNodes, m_weights))
+        {
+            m_weights.getRowSums(m_weightSums);
+            return;
+        }
+    }
+    vector<WeightList> weightLists;
     if (theRoi != NULL)
     {
         switch (myMethod)
         {
             case GEO_GAUSS_AREA:
-                precomputeWeightsROIGeoGaussArea(mySurf, myKernel, theRoi, passAreas);
+                precomputeWeightsROIGeoGaussArea(weightLists, mySurf, myKernel, theRoi, passAreas);
                 break;
             case GEO_GAUSS_EQUAL:
-                precomputeWeightsROIGeoGaussEqual(mySurf, myKernel, theRoi);
+                precomputeWeightsROIGeoGaussEqual(weightLists, mySurf, myKernel, theRoi);
                 break;
             case GEO_GAUSS:
-                precomputeWeightsROIGeoGauss(mySurf, myKernel, theRoi);
+                precomputeWeightsROIGeoGauss(weightLists, mySurf, myKernel, theRoi);
                 break;
             default:
                 throw CaretException("unknown smoothing method specified");
@@ -659,16 +781,38 @@ void MetricSmoothingObject::precomputeWeights(const SurfaceFile* mySurf, float m
         switch (myMethod)
         {
             case GEO_GAUSS_AREA:
-                precomputeWeightsGeoGaussArea(mySurf, myKernel, passAreas);
+                precomputeWeightsGeoGaussArea(weightLists, mySurf, myKernel, passAreas);
                 break;
             case GEO_GAUSS_EQUAL:
-                precomputeWeightsGeoGaussEqual(mySurf, myKernel);
+                precomputeWeightsGeoGaussEqual(weightLists, mySurf, myKernel);
                 break;
             case GEO_GAUSS:
-                precomputeWeightsGeoGauss(mySurf, myKernel);
+                precomputeWeightsGeoGauss(weightLists, mySurf, myKernel);
                 break;
             default:
                 throw CaretException("unknown smoothing method specified");
         };
     }
+    vector<int64_t> rowStarts(numNodes + 1, 0);
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        rowStarts[i + 1] = rowStarts[i] + (int64_t)weightLists[i].m_nodes.size();
+    }
+    vector<int32_t> indices;
+    vector<float> weights;
+    indices.reserve(rowStarts[numNodes]);
+    weights.reserve(rowStarts[numNodes]);
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        indices.insert(indices.end(), weightLists[i].m_nodes.begin(), weightLists[i].m_nodes.end());
+        weights.insert(weights.end(), weightLists[i].m_weights.begin(), weightLists[i].m_weights.end());
+        vector<int32_t>().swap(weightLists[i].m_nodes);//free as we go
+        vector<float>().swap(weightLists[i].m_weights);
+    }
+    m_weights.swapIn(numNodes, rowStarts, indices, weights);
+    m_weights.getRowSums(m_weightSums);//same order as the precompute methods sum them, so it is exactly the same
+    if (useCache)
+    {
+        SurfaceWeightCache::store(cacheKey, m_weights);
+    }
 }
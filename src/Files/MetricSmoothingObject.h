@@ -30,6 +30,8 @@
 //NOTE: for a static ROI, it is (sometimes much) more efficient to use it in the constructor, and provide no ROI (NULL) to the functions, using both an ROI in constructor and in method
 //      will result in the effective ROI being the logical AND of the two (intersection).
 
+#include "SparseMatrixCSR.h"
+
 #include "stdint.h"
 #include "stddef.h"
 #include <vector>
@@ -59,16 +61,18 @@ namespace caret {
             std::vector<float> m_weights;
             float m_weightSum;
         };
-        std::vector<WeightList> m_weightLists;
+        SparseMatrixCSR m_weights;//gathering kernels, not normalized
+        std::vector<float> m_weightSums;
         void smoothColumnInternal(float* scratch, const MetricFile* metricIn, const int& whichColumn, MetricFile* metricOut, const int& whichOutColumn, const bool& fixZeros) const;
         void smoothColumnInternal(float* scratch, const MetricFile* metricIn, const int& whichColumn, MetricFile* metricOut, const int& whichOutColumn, const MetricFile* roi, const int& whichRoiColumn, const bool& fixZeros) const;
+        void smoothColumnsInterleaved(const SparseMatrixCSR& weights, const std::vector<float>& weightSums, const MetricFile* metricIn, MetricFile* metricOut) const;
         void precomputeWeights(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi, Method myMethod, const float* nodeAreas);
-        void precomputeWeightsGeoGauss(const SurfaceFile* mySurf, float myKernel);
-        void precomputeWeightsROIGeoGauss(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi);
-        void precomputeWeightsGeoGaussArea(const SurfaceFile* mySurf, float myKernel, const float* nodeAreas);
-        void precomputeWeightsROIGeoGaussArea(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi, const float* nodeAreas);
-        void precomputeWeightsGeoGaussEqual(const SurfaceFile* mySurf, float myKernel);
-        void precomputeWeightsROIGeoGaussEqual(const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi);
+        void precomputeWeightsGeoGauss(std::vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel);
+        void precomputeWeightsROIGeoGauss(std::vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi);
+        void precomputeWeightsGeoGaussArea(std::vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const float* nodeAreas);
+        void precomputeWeightsROIGeoGaussArea(std::vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi, const float* nodeAreas);
+        void precomputeWeightsGeoGaussEqual(std::vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel);
+        void precomputeWeightsROIGeoGaussEqual(std::vector<WeightList>& weightLists, const SurfaceFile* mySurf, float myKernel, const MetricFile* theRoi);
         MetricSmoothingObject();
     };
     
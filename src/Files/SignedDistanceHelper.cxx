@@ -241,6 +241,148 @@ void SignedDistanceHelper::barycentricWeights(const float coord[3], BarycentricI
     }
 }
 
+bool SignedDistanceHelper::rayIntersection(const float start[3], const float direction[3], BarycentricInfo& hitOut)
+{
+    CaretMutexLocker locked(&m_mutex);
+    CaretSimpleMinHeap<Oct<SignedDistanceHelperBase::TriVector>*, float> myHeap;//octs ordered by where the ray enters them, so we can stop once the nearest hit is closer than the next oct
+    float tempf;
+    if (rayHitsOct(m_base->m_indexRoot, start, direction, tempf))
+    {
+        myHeap.push(m_base->m_indexRoot, tempf);
+    }
+    bool found = false;
+    float bestT = -1.0f, bestU = 0.0f, bestV = 0.0f;
+    int32_t bestTri = -1;
+    int numChanged = 0;
+    while (!myHeap.isEmpty())
+    {
+        Oct<SignedDistanceHelperBase::TriVector>* curOct = myHeap.pop(&tempf);
+        if (found && tempf > bestT) break;
+        if (curOct->m_leaf)
+        {
+            vector<int32_t>& myVecRef = *(curOct->m_data.m_triList);
+            int numTris = (int)myVecRef.size();
+            for (int i = 0; i < numTris; ++i)
+            {
+                if (m_triMarked[myVecRef[i]] != 1)
+                {
+                    m_triMarked[myVecRef[i]] = 1;
+                    m_triMarkChanged[numChanged++] = myVecRef[i];
+                    float tempt, tempu, tempv;
+                    if (rayHitsTri(start, direction, myVecRef[i], tempt, tempu, tempv) && (!found || tempt < bestT))
+                    {
+                        found = true;
+                        bestT = tempt;
+                        bestU = tempu;
+                        bestV = tempv;
+                        bestTri = myVecRef[i];
+                    }
+                }
+            }
+        } else {
+            for (int ci = 0; ci < 2; ++ci)
+            {
+                for (int cj = 0; cj < 2; ++cj)
+                {
+                    for (int ck = 0; ck < 2; ++ck)
+                    {
+                        if (rayHitsOct(curOct->m_children[ci][cj][ck], start, direction, tempf) && (!found || tempf <= bestT))
+                        {
+                            myHeap.push(curOct->m_children[ci][cj][ck], tempf);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    while (numChanged)
+    {
+        m_triMarked[m_triMarkChanged[--numChanged]] = 0;//clean up
+    }
+    if (!found) return false;
+    const int32_t* triNodes = m_base->getTriangle(bestTri);
+    hitOut.triangle = bestTri;
+    hitOut.type = BarycentricInfo::TRIANGLE;
+    hitOut.absDistance = bestT;
+    for (int i = 0; i < 3; ++i)
+    {
+        hitOut.nodes[i] = triNodes[i];
+        hitOut.point[i] = start[i] + bestT * direction[i];
+    }
+    hitOut.baryWeights[0] = 1.0f - bestU - bestV;
+    hitOut.baryWeights[1] = bestU;
+    hitOut.baryWeights[2] = bestV;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (hitOut.baryWeights[i] < 0.0f)
+        {
+            hitOut.baryWeights[i] = 0.0f;//rounding on the edges
+        }
+    }
+    return true;
+}
+
+bool SignedDistanceHelper::rayHitsOct(const Oct<SignedDistanceHelperBase::TriVector>* thisOct, const float start[3], const float direction[3], float& entryOut)
+{//slab test like Oct::rayIntersects, but we also need where the ray enters, for ordering
+    float curlow = 0.0f, curhigh = 0.0f;
+    bool first = true;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (direction[i] != 0.0f)
+        {
+            float templow = (thisOct->m_bounds[i][0] - start[i]) / direction[i];
+            float temphigh = (thisOct->m_bounds[i][2] - start[i]) / direction[i];
+            if (templow > temphigh)
+            {
+                float swap = templow;
+                templow = temphigh;
+                temphigh = swap;
+            }
+            if (first)
+            {
+                curlow = templow;
+                curhigh = temphigh;
+                first = false;
+            } else {
+                if (templow > curlow) curlow = templow;
+                if (temphigh < curhigh) curhigh = temphigh;
+            }
+        } else {
+            if (start[i] < thisOct->m_bounds[i][0] || start[i] > thisOct->m_bounds[i][2])
+            {
+                return false;//parallel to this axis and outside the slab
+            }
+        }
+    }
+    if (first) return false;//zero length direction
+    if (curlow > curhigh || curhigh < 0.0f) return false;
+    entryOut = (curlow > 0.0f ? curlow : 0.0f);
+    return true;
+}
+
+bool SignedDistanceHelper::rayHitsTri(const float start[3], const float direction[3], int32_t triangle, float& tOut, float& uOut, float& vOut)
+{//Moller-Trumbore, accepts either winding
+    const int32_t* triNodes = m_base->getTriangle(triangle);
+    Vector3D vert1 = m_base->getCoordinate(triNodes[0]);
+    Vector3D vert2 = m_base->getCoordinate(triNodes[1]);
+    Vector3D vert3 = m_base->getCoordinate(triNodes[2]);
+    Vector3D rayDir = direction;
+    Vector3D edge1 = vert2 - vert1;
+    Vector3D edge2 = vert3 - vert1;
+    Vector3D pvec = rayDir.cross(edge2);
+    float det = edge1.dot(pvec);
+    if (det == 0.0f) return false;//parallel to the triangle plane, or degenerate triangle
+    float invDet = 1.0f / det;
+    Vector3D tvec = Vector3D(start) - vert1;
+    uOut = tvec.dot(pvec) * invDet;
+    if (uOut < 0.0f || uOut > 1.0f) return false;
+    Vector3D qvec = tvec.cross(edge1);
+    vOut = rayDir.dot(qvec) * invDet;
+    if (vOut < 0.0f || uOut + vOut > 1.0f) return false;
+    tOut = edge2.dot(qvec) * invDet;
+    return tOut >= 0.0f;
+}
+
 int SignedDistanceHelper::computeSign(const float coord[3], SignedDistanceHelper::ClosestPointInfo myInfo, WindingLogic myWinding)
 {
     Vector3D point = coord;
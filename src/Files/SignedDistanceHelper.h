@@ -106,6 +106,8 @@ namespace caret {
         float unsignedDistToTri(const float coord[3], int32_t triangle, ClosestPointInfo& myInfo);
         int computeSign(const float coord[3], ClosestPointInfo myInfo, WindingLogic myWinding);
         bool pointInTri(Vector3D verts[3], Vector3D inPlane, int majAxis, int midAxis);
+        bool rayHitsOct(const Oct<SignedDistanceHelperBase::TriVector>* thisOct, const float start[3], const float direction[3], float& entryOut);
+        bool rayHitsTri(const float start[3], const float direction[3], int32_t triangle, float& tOut, float& uOut, float& vOut);
     public:
         SignedDistanceHelper(CaretPointer<SignedDistanceHelperBase> myBase);
         
@@ -115,6 +117,10 @@ namespace caret {
         ///find the closest point ON the surface, and return information about it
         ///will never have negative barycentric weights, or a point outside the triangle
         void barycentricWeights(const float coordIn[3], BarycentricInfo& baryInfoOut);
+        
+        ///find the first triangle hit by the ray, in either winding, returns false if the ray misses the surface
+        ///absDistance is in units of the length of direction, type is always TRIANGLE
+        bool rayIntersection(const float start[3], const float direction[3], BarycentricInfo& hitOut);
     };
 
 }
@@ -49,6 +49,9 @@
 
 using namespace caret;
 
+static CaretMutex s_modificationCountMutex;
+static int64_t s_modificationCount = 0;
+
 /**
  * Constructor.
  */
@@ -525,6 +528,18 @@ SurfaceFile::initializeMembersSurfaceFile()
     m_geoHelperIndex = 0;
     m_topoHelperIndex = 0;
     m_normalsComputed = false;
+    m_geometryModificationCount = nextModificationCount();
+    m_nodeColoringModificationCount = nextModificationCount();
+}
+
+/**
+ * @return A modification count that has never been used by any surface file.
+ */
+int64_t
+SurfaceFile::nextModificationCount()
+{
+    CaretMutexLocker locked(&s_modificationCountMutex);
+    return ++s_modificationCount;
 }
 
 /**
@@ -565,6 +580,7 @@ void
 SurfaceFile::invalidateNormals()
 {
     m_normalsComputed = false;
+    m_geometryModificationCount = nextModificationCount();
 }
 /**
  * Compute surface normals.
@@ -634,6 +650,7 @@ SurfaceFile::computeNormals()
             }
         }
     }
+    m_geometryModificationCount = nextModificationCount();//normals are part of the geometry that the drawing buffers copy
 }
 
 std::vector<float> SurfaceFile::computeAverageNormals()
@@ -1161,6 +1178,7 @@ SurfaceFile::setModified()
         delete this->boundingBox;
         this->boundingBox = NULL;
     }
+    m_geometryModificationCount = nextModificationCount();
     
     GiftiTypeFile::setModified();
 }
@@ -1351,6 +1369,7 @@ SurfaceFile::invalidateNodeColoringForBrowserTabs()
         this->surfaceMontageNodeColoringForBrowserTabs[i].clear();
         this->wholeBrainNodeColoringForBrowserTabs[i].clear();
     }    
+    m_nodeColoringModificationCount = nextModificationCount();
 }
 
 /**
@@ -1479,6 +1498,7 @@ SurfaceFile::setSurfaceNodeColoringRgbaForBrowserTab(const int32_t browserTabInd
     for (int32_t i = 0; i < numberOfComponentsRGBA; i++) {
         rgba[i] = rgbaNodeColorComponents[i];
     }
+    m_nodeColoringModificationCount = nextModificationCount();
 }
 
 /**
@@ -1526,6 +1546,7 @@ SurfaceFile::setSurfaceMontageNodeColoringRgbaForBrowserTab(const int32_t browse
     for (int32_t i = 0; i < numberOfComponentsRGBA; i++) {
         rgba[i] = rgbaNodeColorComponents[i];
     }
+    m_nodeColoringModificationCount = nextModificationCount();
 }
 
 
@@ -1573,6 +1594,7 @@ SurfaceFile::setWholeBrainNodeColoringRgbaForBrowserTab(const int32_t browserTab
     for (int32_t i = 0; i < numberOfComponentsRGBA; i++) {
         rgba[i] = rgbaNodeColorComponents[i];
     }
+    m_nodeColoringModificationCount = nextModificationCount();
 }
 
 /**
@@ -176,6 +176,12 @@ namespace caret {
 
         void invalidateNormals();
         
+        ///changes whenever coordinates, triangles, or normals may have changed, never repeats across surface files
+        int64_t getGeometryModificationCount() const { return m_geometryModificationCount; }
+        
+        ///changes whenever the node coloring of any tab is replaced or invalidated, never repeats across surface files
+        int64_t getNodeColoringModificationCount() const { return m_nodeColoringModificationCount; }
+        
         void translateToCenterOfMass();
         
         void flipNormals();
@@ -261,6 +267,11 @@ namespace caret {
         bool m_normalsComputed;
         
         bool m_skipSanityCheck;
+        
+        ///so that drawing code can tell when cached copies of the geometry or coloring are stale
+        int64_t m_geometryModificationCount, m_nodeColoringModificationCount;
+        
+        static int64_t nextModificationCount();
 
         ///topology base for surface
         mutable CaretPointer<TopologyHelperBase> m_topoBase;
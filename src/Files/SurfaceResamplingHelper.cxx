@@ -31,6 +31,7 @@
 #include "GeodesicHelper.h"
 #include "SignedDistanceHelper.h"
 #include "SurfaceFile.h"
+#include "SurfaceWeightCache.h"
 #include "TopologyHelper.h"
 #include "Vector3D.h"
 
@@ -44,6 +45,26 @@ SurfaceResamplingHelper::SurfaceResamplingHelper(const SurfaceResamplingMethodEn
                                                  const float* currentAreas, const float* newAreas, const float* currentRoi)
 {
     if (!checkSphere(currentSphere) || !checkSphere(newSphere)) throw CaretException("input surfaces to SurfaceResamplingHelper must be spheres");
+    const int numOldNodes = currentSphere->getNumberOfNodes(), numNewNodes = newSphere->getNumberOfNodes();
+    SurfaceWeightCache::Key cacheKey("SurfaceResamplingHelper weights v2");//change the version if the weight computation changes
+    const bool useCache = SurfaceWeightCache::isEnabled();
+    if (useCache)
+    {
+        cacheKey.addInt(myMethod);
+        cacheKey.addSurface(currentSphere);
+        cacheKey.addSurface(newSphere);
+        if (myMethod == SurfaceResamplingMethodEnum::ADAP_BARY_AREA && currentAreas != NULL && newAreas != NULL)
+        {
+            cacheKey.addData(currentAreas, numOldNodes);
+            cacheKey.addData(newAreas, numNewNodes);
+        }
+        cacheKey.addInt(currentRoi != NULL ? 1 : 0);
+        if (currentRoi != NULL) cacheKey.addData(currentRoi, numOldNodes);
+        if (SurfaceWeightCache::load(cacheKey, numNewNodes, numOldNodes, m_weights))
+        {
+            return;
+        }
+    }
     SurfaceFile currentSphereMod, newSphereMod;
     changeRadius(100.0f, currentSphere, &currentSphereMod);
     changeRadius(100.0f, newSphere, &newSphereMod);
@@ -58,43 +79,38 @@ SurfaceResamplingHelper::SurfaceResamplingHelper(const SurfaceResamplingMethodEn
             computeWeightsBarycentric(&currentSphereMod, &newSphereMod, currentRoi);
             break;
     }
+    if (useCache)
+    {
+        SurfaceWeightCache::store(cacheKey, m_weights);
+    }
 }
 
 void SurfaceResamplingHelper::resampleNormal(const float* input, float* output, const float& invalidVal) const
 {
-    int numNodes = (int)m_weights.size() - 1;
-#pragma omp CARET_PARFOR schedule(dynamic)
-    for (int i = 0; i < numNodes; ++i)
-    {
-        WeightElem* end = m_weights[i + 1], *elem = m_weights[i];
-        if (elem != end)
-        {
-            double accum = 0.0;
-            for (; elem != end; ++elem)
-            {
-                accum += input[elem->node] * elem->weight;//don't need to divide afterwards, because the weights already sum to 1
-            }
-            output[i] = accum;
-        } else {
-            output[i] = invalidVal;
-        }
-    }
+    m_weights.multiply(input, output, invalidVal);//don't need to divide afterwards, because the weights already sum to 1
+}
+
+void SurfaceResamplingHelper::resampleNormalInterleaved(const float* input, float* output, const int64_t& numMaps, const float& invalidVal) const
+{
+    m_weights.multiplyInterleaved(input, numMaps, output, numMaps, numMaps, invalidVal);
 }
 
 void SurfaceResamplingHelper::resample3DCoord(const float* input, float* output) const
 {
-    int numNodes = (int)m_weights.size() - 1;
+    int numNodes = (int)m_weights.getNumberOfRows();
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
+    const int32_t* indices = m_weights.getIndices().data();
+    const float* weights = m_weights.getValues().data();
 #pragma omp CARET_PARFOR schedule(dynamic)
     for (int i = 0; i < numNodes; ++i)
     {
         double tempvec[3] = { 0.0, 0.0, 0.0 };
-        WeightElem* end = m_weights[i + 1];
-        for (WeightElem* elem = m_weights[i]; elem != end; ++elem)
+        for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
         {
-            const float* coord = input + elem->node * 3;
-            tempvec[0] += coord[0] * elem->weight;//don't need to divide afterwards, because the weights already sum to 1
-            tempvec[1] += coord[1] * elem->weight;
-            tempvec[2] += coord[2] * elem->weight;
+            const float* coord = input + indices[j] * 3;
+            tempvec[0] += coord[0] * weights[j];//don't need to divide afterwards, because the weights already sum to 1
+            tempvec[1] += coord[1] * weights[j];
+            tempvec[2] += coord[2] * weights[j];
         }
         int i3 = i * 3;
         output[i3] = tempvec[0];
@@ -105,28 +121,30 @@ void SurfaceResamplingHelper::resample3DCoord(const float* input, float* output)
 
 void SurfaceResamplingHelper::resamplePopular(const int32_t* input, int32_t* output, const int32_t& invalidVal) const
 {
-    int numNodes = (int)m_weights.size() - 1;
+    int numNodes = (int)m_weights.getNumberOfRows();
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
+    const int32_t* indices = m_weights.getIndices().data();
+    const float* weights = m_weights.getValues().data();
 #pragma omp CARET_PARFOR schedule(dynamic)
     for (int i = 0; i < numNodes; ++i)
     {
         map<int32_t, float> accum;
         float maxweight = -1.0f;
         int32_t bestlabel = invalidVal;
-        WeightElem* end = m_weights[i + 1];
-        for (WeightElem* elem = m_weights[i]; elem != end; ++elem)
+        for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
         {
-            int32_t label = input[elem->node];
+            int32_t label = input[indices[j]];
             map<int, float>::iterator iter = accum.find(label);
             if (iter == accum.end())
             {
-                accum[label] = elem->weight;
-                if (elem->weight > maxweight)
+                accum[label] = weights[j];
+                if (weights[j] > maxweight)
                 {
-                    maxweight = elem->weight;
+                    maxweight = weights[j];
                     bestlabel = label;
                 }
             } else {
-                iter->second += elem->weight;
+                iter->second += weights[j];
                 if (iter->second > maxweight)
                 {
                     maxweight = iter->second;
@@ -140,19 +158,21 @@ void SurfaceResamplingHelper::resamplePopular(const int32_t* input, int32_t* out
 
 void SurfaceResamplingHelper::resampleLargest(const float* input, float* output, const float& invalidVal) const
 {
-    int numNodes = (int)m_weights.size() - 1;
+    int numNodes = (int)m_weights.getNumberOfRows();
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
+    const int32_t* indices = m_weights.getIndices().data();
+    const float* weights = m_weights.getValues().data();
 #pragma omp CARET_PARFOR schedule(dynamic)
     for (int i = 0; i < numNodes; ++i)
     {
-        WeightElem* end = m_weights[i + 1];
         float largest = -1.0f;
         int largestNode = -1;
-        for (WeightElem* elem = m_weights[i]; elem != end; ++elem)
+        for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
         {
-            if (elem->weight > largest)
+            if (weights[j] > largest)
             {
-                largest = elem->weight;
-                largestNode = elem->node;
+                largest = weights[j];
+                largestNode = indices[j];
             }
         }
         if (largestNode != -1)
@@ -166,19 +186,21 @@ void SurfaceResamplingHelper::resampleLargest(const float* input, float* output,
 
 void SurfaceResamplingHelper::resampleLargest(const int32_t* input, int32_t* output, const int32_t& invalidVal) const
 {
-    int numNodes = (int)m_weights.size() - 1;
+    int numNodes = (int)m_weights.getNumberOfRows();
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
+    const int32_t* indices = m_weights.getIndices().data();
+    const float* weights = m_weights.getValues().data();
 #pragma omp CARET_PARFOR schedule(dynamic)
     for (int i = 0; i < numNodes; ++i)
     {
-        WeightElem* end = m_weights[i + 1];
         float largest = -1.0f;
         int largestNode = -1;
-        for (WeightElem* elem = m_weights[i]; elem != end; ++elem)
+        for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
         {
-            if (elem->weight > largest)
+            if (weights[j] > largest)
             {
-                largest = elem->weight;
-                largestNode = elem->node;
+                largest = weights[j];
+                largestNode = indices[j];
             }
         }
         if (largestNode != -1)
@@ -192,10 +214,11 @@ void SurfaceResamplingHelper::resampleLargest(const int32_t* input, int32_t* out
 
 void SurfaceResamplingHelper::getResampleValidROI(float* output) const
 {
-    int numNodes = (int)m_weights.size() - 1;
+    int numNodes = (int)m_weights.getNumberOfRows();
+    const int64_t* rowStarts = m_weights.getRowStarts().data();
     for (int i = 0; i < numNodes; ++i)
     {
-        if (m_weights[i] != m_weights[i + 1])
+        if (rowStarts[i] != rowStarts[i + 1])
         {
             output[i] = 1.0f;
         } else {
@@ -478,14 +501,14 @@ void SurfaceResamplingHelper::computeWeightsAdapBaryArea(const SurfaceFile* curr
             }
         }
     }
-    compactWeights(adap_gather);//and compact them into the internal weight storage
+    compactWeights(adap_gather, numOldNodes);//and compact them into the internal weight storage
 }
 
 void SurfaceResamplingHelper::computeWeightsBarycentric(const SurfaceFile* currentSphere, const SurfaceFile* newSphere, const float* currentRoi)
 {
     vector<map<int, float> > forward;
     makeBarycentricWeights(currentSphere, newSphere, forward, currentRoi);//this should ensure they sum to 1, so we are done
-    compactWeights(forward);
+    compactWeights(forward, currentSphere->getNumberOfNodes());
 }
 
 bool SurfaceResamplingHelper::checkSphere(const SurfaceFile* surface)
@@ -533,28 +556,28 @@ void SurfaceResamplingHelper::changeRadius(const float& radius, const SurfaceFil
     output->setCoordinates(newCoordData.data());
 }
 
-void SurfaceResamplingHelper::compactWeights(const vector<map<int, float> >& weights)
+void SurfaceResamplingHelper::compactWeights(const vector<map<int, float> >& weights, const int& numColumns)
 {
-    int compactsize = 0;
     int numNodes = (int)weights.size();
-    m_weights = CaretArray<WeightElem*>(numNodes + 1);//include a "one-after" pointer
+    vector<int64_t> rowStarts(numNodes + 1, 0);
     for (int i = 0; i < numNodes; ++i)
     {
-        compactsize += (int)weights[i].size();
+        rowStarts[i + 1] = rowStarts[i] + (int64_t)weights[i].size();
     }
-    m_storagechunk = CaretArray<WeightElem>(compactsize);
-    int curpos = 0;
+    vector<int32_t> indices(rowStarts[numNodes]);
+    vector<float> values(rowStarts[numNodes]);
+    int64_t curpos = 0;
     for (int i = 0; i < numNodes; ++i)
     {
-        m_weights[i] = m_storagechunk + curpos;
         for (map<int, float>::const_iterator iter = weights[i].begin(); iter != weights[i].end(); ++iter)
         {
-            m_storagechunk[curpos] = WeightElem(iter->first, iter->second);
+            indices[curpos] = iter->first;
+            values[curpos] = iter->second;
             ++curpos;
         }
     }
-    CaretAssert(curpos == compactsize);
-    m_weights[numNodes] = m_storagechunk + compactsize;
+    CaretAssert(curpos == rowStarts[numNodes]);
+    m_weights.swapIn(numColumns, rowStarts, indices, values);
 }
 
 void SurfaceResamplingHelper::makeBarycentricWeights(const SurfaceFile* from, const SurfaceFile* to, vector<map<int, float> >& weights, const float* currentRoi)
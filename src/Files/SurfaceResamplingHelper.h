@@ -22,6 +22,7 @@
 /*LICENSE_END*/
 
 #include "CaretPointer.h"
+#include "SparseMatrixCSR.h"
 #include "SurfaceResamplingMethodEnum.h"
 
 #include <map>
@@ -33,27 +34,21 @@ namespace caret {
     
     class SurfaceResamplingHelper
     {
-        struct WeightElem
-        {
-            int node;
-            float weight;
-            WeightElem() { }
-            WeightElem(const int& nodeIn, const float& weightIn) : node(nodeIn), weight(weightIn) { }
-        };
-        CaretArray<WeightElem> m_storagechunk;
-        CaretArray<WeightElem*> m_weights;
+        SparseMatrixCSR m_weights;//rows are new nodes, columns are current nodes
         static bool checkSphere(const SurfaceFile* surface);
         static void changeRadius(const float& radius, const SurfaceFile* input, SurfaceFile* output);
         void computeWeightsAdapBaryArea(const SurfaceFile* currentSphere, const SurfaceFile* newSphere, const float* currentAreas, const float* newAreas, const float* currentRoi);
         void computeWeightsBarycentric(const SurfaceFile* currentSphere, const SurfaceFile* newSphere, const float* currentRoi);
         static void makeBarycentricWeights(const SurfaceFile* from, const SurfaceFile* to, std::vector<std::map<int, float> >& weights, const float* currentRoi);
-        void compactWeights(const std::vector<std::map<int, float> >& weights);
+        void compactWeights(const std::vector<std::map<int, float> >& weights, const int& numColumns);
     public:
         SurfaceResamplingHelper() { }
         SurfaceResamplingHelper(const SurfaceResamplingMethodEnum::Enum& myMethod, const SurfaceFile* currentSphere, const SurfaceFile* newSphere,
                                 const float* currentAreas = NULL, const float* newAreas = NULL, const float* currentRoi = NULL);
         ///resample real-valued data by means of weights
         void resampleNormal(const float* input, float* output, const float& invalidVal = 0.0f) const;
+        ///resample many maps in one pass over the weights, with maps interleaved (input[node * numMaps + map]), as in cifti rows along brainordinates
+        void resampleNormalInterleaved(const float* input, float* output, const int64_t& numMaps, const float& invalidVal = 0.0f) const;
         ///resample 3D coordinate data by means of weights
         void resample3DCoord(const float* input, float* output) const;
         ///resample label-like data according to which value gets the largest weight sum
@@ -0,0 +1,272 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "SurfaceWeightCache.h"
+
+#include "CaretAssert.h"
+#include "CaretBinaryFile.h"
+#include "CaretLogger.h"
+#include "CaretMutex.h"
+#include "DataFileException.h"
+#include "SparseMatrixCSR.h"
+#include "SurfaceFile.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const char CACHE_MAGIC[8] = { 'W', 'B', 'W', 'E', 'I', 'G', 'H', 'T' };
+    const int32_t CACHE_VERSION = 1;
+    const int32_t BYTE_ORDER_CHECK = 0x01020304;//written in native order, a mismatch just means a cache miss
+    const int HASH_CHARS = 40;//sha1 in hex
+    const int64_t HEADER_SIZE = 8 + 4 + 4 + 8 + 8 + 8 + HASH_CHARS;
+    const int64_t IO_CHUNK = 1<<30;//qt4 uses int for sizes
+    
+    AString getCacheFileName(const AString& directory, const AString& hashString)
+    {
+        return directory + "/" + hashString + ".wbweights";
+    }
+    
+    void writeAll(QFile& file, const char* data, const int64_t& count)
+    {
+        for (int64_t done = 0; done < count; done += IO_CHUNK)
+        {
+            int64_t toWrite = min(IO_CHUNK, count - done);
+            if (file.write(data + done, toWrite) != toWrite)
+            {
+                throw DataFileException("failed to write to file '" + file.fileName() + "'");
+            }
+        }
+    }
+    
+    //reads straight into the vectors that the matrix will take by swapping, so the data is only copied once
+    bool readEntry(const AString& fileName, const AString& hashString, const int64_t& numRows, const int64_t& numColumns,
+                   vector<int64_t>& rowStarts, vector<int32_t>& indices, vector<float>& weights)
+    {
+        CaretBinaryFile myFile;
+        myFile.open(fileName);
+        char header[HEADER_SIZE];
+        int64_t numRead = 0;
+        myFile.read(header, HEADER_SIZE, &numRead);
+        if (numRead != HEADER_SIZE) return false;
+        int32_t version, byteOrder;
+        int64_t fileRows, fileColumns, fileEntries;
+        memcpy(&version, header + 8, 4);
+        memcpy(&byteOrder, header + 12, 4);
+        memcpy(&fileRows, header + 16, 8);
+        memcpy(&fileColumns, header + 24, 8);
+        memcpy(&fileEntries, header + 32, 8);
+        if (memcmp(header, CACHE_MAGIC, 8) != 0 || version != CACHE_VERSION || byteOrder != BYTE_ORDER_CHECK) return false;
+        if (fileRows != numRows || fileColumns != numColumns) return false;
+        if (AString::fromLatin1(header + 40, HASH_CHARS) != hashString) return false;//guard against renamed files
+        const int64_t fileSize = myFile.size();
+        if (fileEntries < 0 || fileEntries > fileSize) return false;//also keeps the size computation from overflowing on garbage
+        const int64_t dataSize = (numRows + 1) * sizeof(int64_t) + fileEntries * (sizeof(int32_t) + sizeof(float));
+        if (fileSize != HEADER_SIZE + dataSize) return false;//truncated
+        rowStarts.resize(numRows + 1);
+        indices.resize(fileEntries);
+        weights.resize(fileEntries);
+        myFile.read(rowStarts.data(), (numRows + 1) * sizeof(int64_t));
+        if (rowStarts[0] != 0 || rowStarts[numRows] != fileEntries) return false;
+        for (int64_t i = 0; i < numRows; ++i)
+        {
+            if (rowStarts[i + 1] < rowStarts[i]) return false;
+        }
+        myFile.read(indices.data(), fileEntries * sizeof(int32_t));
+        for (int64_t i = 0; i < fileEntries; ++i)
+        {
+            if (indices[i] < 0 || indices[i] >= numColumns) return false;
+        }
+        myFile.read(weights.data(), fileEntries * sizeof(float));
+        return true;
+    }
+    
+    CaretMutex s_directoryMutex;
+}
+
+AString SurfaceWeightCache::s_cacheDirectory;
+bool SurfaceWeightCache::s_directorySet = false;
+
+void SurfaceWeightCache::setCacheDirectory(const AString& directory)
+{
+    CaretMutexLocker locked(&s_directoryMutex);
+    s_cacheDirectory = directory;
+    s_directorySet = true;
+}
+
+AString SurfaceWeightCache::getCacheDirectory()
+{
+    CaretMutexLocker locked(&s_directoryMutex);//the first call may come from inside a parallel loop
+    if (!s_directorySet)
+    {
+        const char* envDir = getenv("WB_WEIGHT_CACHE_DIR");
+        if (envDir != NULL)
+        {
+            s_cacheDirectory = AString(envDir);
+        }
+        s_directorySet = true;
+    }
+    return s_cacheDirectory;
+}
+
+SurfaceWeightCache::Key::Key(const AString& kind)
+{
+    m_hash.grabNew(new QCryptographicHash(QCryptographicHash::Sha1));
+    QByteArray kindBytes = kind.toUtf8();
+    addInt(kindBytes.size());//lengths before variable-length things, so different inputs can't concatenate to the same bytes
+    m_hash->addData(kindBytes.constData(), kindBytes.size());
+}
+
+void SurfaceWeightCache::Key::addSurface(const SurfaceFile* surface)
+{
+    CaretAssert(surface != NULL);
+    const int64_t numNodes = surface->getNumberOfNodes();
+    addInt(numNodes);
+    addData(surface->getCoordinateData(), numNodes * 3);
+    const int64_t numTriangles = surface->getNumberOfTriangles();
+    addInt(numTriangles);
+    vector<int32_t> triangles(numTriangles * 3);
+    for (int64_t i = 0; i < numTriangles; ++i)
+    {
+        const int32_t* thisTri = surface->getTriangle(i);
+        triangles[i * 3] = thisTri[0];
+        triangles[i * 3 + 1] = thisTri[1];
+        triangles[i * 3 + 2] = thisTri[2];
+    }
+    const char* triBytes = (const char*)triangles.data();
+    const int64_t numBytes = numTriangles * 3 * sizeof(int32_t);
+    for (int64_t done = 0; done < numBytes; done += IO_CHUNK)
+    {
+        m_hash->addData(triBytes + done, (int)min(IO_CHUNK, numBytes - done));
+    }
+}
+
+void SurfaceWeightCache::Key::addData(const float* data, const int64_t& count)
+{
+    CaretAssert(data != NULL || count == 0);
+    addInt(count);
+    const char* bytes = (const char*)data;
+    const int64_t numBytes = count * sizeof(float);
+    for (int64_t done = 0; done < numBytes; done += IO_CHUNK)
+    {
+        m_hash->addData(bytes + done, (int)min(IO_CHUNK, numBytes - done));
+    }
+}
+
+void SurfaceWeightCache::Key::addInt(const int64_t& value)
+{
+    m_hash->addData((const char*)&value, sizeof(int64_t));
+}
+
+void SurfaceWeightCache::Key::addFloat(const float& value)
+{
+    m_hash->addData((const char*)&value, sizeof(float));
+}
+
+AString SurfaceWeightCache::Key::getHashString() const
+{
+    return AString::fromLatin1(m_hash->result().toHex());
+}
+
+bool SurfaceWeightCache::load(const Key& key, const int64_t& numRows, const int64_t& numColumns, SparseMatrixCSR& weightsOut)
+{
+    AString directory = getCacheDirectory();
+    if (directory.isEmpty()) return false;
+    AString hashString = key.getHashString();
+    AString fileName = getCacheFileName(directory, hashString);
+    if (!QFileInfo(fileName).exists()) return false;
+    vector<int64_t> rowStarts;
+    vector<int32_t> indices;
+    vector<float> weights;
+    bool usable = false;
+    try
+    {
+        usable = readEntry(fileName, hashString, numRows, numColumns, rowStarts, indices, weights);
+    } catch (DataFileException& e) {
+        CaretLogInfo("failed to read weight cache file '" + fileName + "': " + e.whatString());
+    }
+    if (!usable)
+    {
+        CaretLogFine("no usable weight cache entry '" + fileName + "'");
+        return false;
+    }
+    weightsOut.swapIn(numColumns, rowStarts, indices, weights);
+    CaretLogFine("using cached weights from '" + fileName + "'");
+    return true;
+}
+
+void SurfaceWeightCache::store(const Key& key, const SparseMatrixCSR& weightMatrix)
+{
+    AString directory = getCacheDirectory();
+    if (directory.isEmpty()) return;
+    const vector<int64_t>& rowStarts = weightMatrix.getRowStarts();
+    const vector<int32_t>& indices = weightMatrix.getIndices();
+    const vector<float>& weights = weightMatrix.getValues();
+    const int64_t numColumns = weightMatrix.getNumberOfColumns();
+    AString hashString = key.getHashString();
+    AString fileName = getCacheFileName(directory, hashString);
+    if (QFileInfo(fileName).exists()) return;//another process beat us to it
+    try
+    {
+        if (!QDir().mkpath(directory))
+        {
+            throw DataFileException("failed to create directory '" + directory + "'");
+        }
+        QTemporaryFile tempFile(fileName + ".XXXXXX");//write elsewhere and rename, so other processes never see a partial file
+        if (!tempFile.open())
+        {
+            throw DataFileException("failed to create temporary file in '" + directory + "'");
+        }
+        const int64_t numRows = (int64_t)rowStarts.size() - 1, numEntries = (int64_t)indices.size();
+        char header[HEADER_SIZE];
+        memcpy(header, CACHE_MAGIC, 8);
+        memcpy(header + 8, &CACHE_VERSION, 4);
+        memcpy(header + 12, &BYTE_ORDER_CHECK, 4);
+        memcpy(header + 16, &numRows, 8);
+        memcpy(header + 24, &numColumns, 8);
+        memcpy(header + 32, &numEntries, 8);
+        QByteArray hashBytes = hashString.toLatin1();
+        CaretAssert(hashBytes.size() == HASH_CHARS);
+        memcpy(header + 40, hashBytes.constData(), HASH_CHARS);
+        writeAll(tempFile, header, HEADER_SIZE);
+        writeAll(tempFile, (const char*)rowStarts.data(), (numRows + 1) * sizeof(int64_t));
+        writeAll(tempFile, (const char*)indices.data(), numEntries * sizeof(int32_t));
+        writeAll(tempFile, (const char*)weights.data(), numEntries * sizeof(float));
+        tempFile.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther);//temporary files are private, but the cache may be shared
+        tempFile.close();
+        if (QFile::rename(tempFile.fileName(), fileName))
+        {
+            tempFile.setAutoRemove(false);
+            CaretLogFine("wrote weight cache file '" + fileName + "'");
+        }//otherwise, another process wrote it first, and the temporary file gets removed
+    } catch (DataFileException& e) {
+        CaretLogWarning("failed to write weight cache file: " + e.whatString());
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef __SURFACE_WEIGHT_CACHE_H__
+#define __SURFACE_WEIGHT_CACHE_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+//NOTE: the cache is a directory of files named by a hash of everything the weights were computed from (surface coordinates and topology, method, kernel, roi, areas),
+//      so entries never need to be invalidated, and any number of processes can share the directory.  Stale entries can simply be deleted.
+
+#include "AString.h"
+#include "CaretPointer.h"
+
+#include "stdint.h"
+
+class QCryptographicHash;
+
+namespace caret {
+    
+    class SparseMatrixCSR;
+    class SurfaceFile;
+    
+    class SurfaceWeightCache
+    {
+        static AString s_cacheDirectory;
+        static bool s_directorySet;
+        SurfaceWeightCache();//static only
+    public:
+        ///incrementally hashes the inputs of a weight computation
+        class Key
+        {
+            CaretPointer<QCryptographicHash> m_hash;
+            Key();
+            Key(const Key&);
+            Key& operator=(const Key&);
+        public:
+            ///kind should name the computation and include a version, so that changes to how the weights are computed don't use old entries
+            explicit Key(const AString& kind);
+            void addSurface(const SurfaceFile* surface);
+            void addData(const float* data, const int64_t& count);
+            void addInt(const int64_t& value);
+            void addFloat(const float& value);
+            AString getHashString() const;
+        };
+        
+        ///set the cache directory, empty disables caching - if never called, the WB_WEIGHT_CACHE_DIR environment variable is used
+        ///both of these are thread safe, the weights are computed inside parallel loops in some callers
+        static void setCacheDirectory(const AString& directory);
+        ///empty when caching is disabled
+        static AString getCacheDirectory();
+        static bool isEnabled() { return !getCacheDirectory().isEmpty(); }
+        
+        ///reads the entry directly into weightsOut, returns false and leaves weightsOut unchanged if caching is disabled, there is no entry, or the entry is unusable (wrong dimensions, truncated, corrupt)
+        static bool load(const Key& key, const int64_t& numRows, const int64_t& numColumns, SparseMatrixCSR& weightsOut);
+        ///failure to write is only a warning, the weights are still valid to use
+        static void store(const Key& key, const SparseMatrixCSR& weights);
+    };
+    
+}
+
+#endif //__SURFACE_WEIGHT_CACHE_H__
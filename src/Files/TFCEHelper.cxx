@@ -0,0 +1,388 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "TFCEHelper.h"
+
+#include "CaretAssert.h"
+#include "CaretException.h"
+#include "CaretOMP.h"
+#include "TopologyHelper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    uint64_t mixBits(uint64_t x)
+    {//splitmix64 finalizer, so nearby seeds, permutations and maps give unrelated sign flips
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+}
+
+TFCEHelper::TFCEHelper(const int64_t& numElements)
+{
+    if (numElements < 0 || numElements >= numeric_limits<int32_t>::max()) throw CaretException("too many elements for TFCE");
+    m_numElements = (int32_t)numElements;
+    m_neighborStart.resize(m_numElements + 1, 0);
+    m_areas.resize(m_numElements, 0.0f);
+    m_paramE.resize(m_numElements, 0.0f);
+    m_paramH.resize(m_numElements, 0.0f);
+    m_included.resize(m_numElements, 0);
+}
+
+void TFCEHelper::addNeighbors(const vector<int32_t>& edgeFrom, const vector<int32_t>& edgeTo)
+{//rebuild the compressed neighbor lists with the new edges included, this only happens once per structure
+    CaretAssert(edgeFrom.size() == edgeTo.size());
+    vector<int64_t> newStart(m_numElements + 1, 0);
+    for (int32_t i = 0; i < m_numElements; ++i)
+    {
+        newStart[i + 1] = m_neighborStart[i + 1] - m_neighborStart[i];
+    }
+    int64_t numEdges = (int64_t)edgeFrom.size();
+    for (int64_t e = 0; e < numEdges; ++e)
+    {
+        ++newStart[edgeFrom[e] + 1];
+    }
+    for (int32_t i = 0; i < m_numElements; ++i)
+    {
+        newStart[i + 1] += newStart[i];
+    }
+    vector<int32_t> newNeighbors(newStart[m_numElements]);
+    vector<int64_t> nextPos(newStart.begin(), newStart.end() - 1);
+    for (int32_t i = 0; i < m_numElements; ++i)
+    {
+        for (int64_t j = m_neighborStart[i]; j < m_neighborStart[i + 1]; ++j)
+        {
+            newNeighbors[nextPos[i]] = m_neighbors[j];
+            ++nextPos[i];
+        }
+    }
+    for (int64_t e = 0; e < numEdges; ++e)
+    {
+        newNeighbors[nextPos[edgeFrom[e]]] = edgeTo[e];
+        ++nextPos[edgeFrom[e]];
+    }
+    m_neighborStart.swap(newStart);
+    m_neighbors.swap(newNeighbors);
+}
+
+void TFCEHelper::addSurface(const TopologyHelper* myTopoHelp, const float* vertexAreas, const vector<int32_t>& vertexToElement, const float& param_e, const float& param_h)
+{
+    int32_t numNodes = myTopoHelp->getNumberOfNodes();
+    if ((int64_t)vertexToElement.size() != numNodes) throw CaretException("vertex to element mapping has the wrong number of vertices for TFCE");
+    vector<int32_t> edgeFrom, edgeTo;
+    for (int32_t node = 0; node < numNodes; ++node)
+    {
+        int32_t element = vertexToElement[node];
+        if (element < 0) continue;
+        CaretAssert(element < m_numElements);
+        if (m_included[element]) throw CaretException("element used more than once in TFCE structures");
+        m_included[element] = 1;
+        m_areas[element] = vertexAreas[node];
+        m_paramE[element] = param_e;
+        m_paramH[element] = param_h;
+        const vector<int32_t>& neighbors = myTopoHelp->getNodeNeighbors(node);
+        int numNeigh = (int)neighbors.size();
+        for (int i = 0; i < numNeigh; ++i)
+        {
+            int32_t neighElement = vertexToElement[neighbors[i]];
+            if (neighElement >= 0)
+            {
+                edgeFrom.push_back(element);
+                edgeTo.push_back(neighElement);
+            }
+        }
+    }
+    addNeighbors(edgeFrom, edgeTo);
+}
+
+void TFCEHelper::addVolume(const int64_t dims[3], const float& voxelVolume, const vector<int32_t>& voxelToElement, const float& param_e, const float& param_h)
+{
+    if ((int64_t)voxelToElement.size() != dims[0] * dims[1] * dims[2]) throw CaretException("voxel to element mapping has the wrong number of voxels for TFCE");
+    const int64_t stencil[18] = { 0, 0, -1,
+                                  0, -1, 0,
+                                  -1, 0, 0,
+                                  1, 0, 0,
+                                  0, 1, 0,
+                                  0, 0, 1 };
+    vector<int32_t> edgeFrom, edgeTo;
+    for (int64_t k = 0; k < dims[2]; ++k)
+    {
+        for (int64_t j = 0; j < dims[1]; ++j)
+        {
+            for (int64_t i = 0; i < dims[0]; ++i)
+            {
+                int32_t element = voxelToElement[i + dims[0] * (j + dims[1] * k)];
+                if (element < 0) continue;
+                CaretAssert(element < m_numElements);
+                if (m_included[element]) throw CaretException("element used more than once in TFCE structures");
+                m_included[element] = 1;
+                m_areas[element] = voxelVolume;
+                m_paramE[element] = param_e;
+                m_paramH[element] = param_h;
+                for (int s = 0; s < 18; s += 3)
+                {
+                    int64_t ni = i + stencil[s], nj = j + stencil[s + 1], nk = k + stencil[s + 2];
+                    if (ni < 0 || nj < 0 || nk < 0 || ni >= dims[0] || nj >= dims[1] || nk >= dims[2]) continue;
+                    int32_t neighElement = voxelToElement[ni + dims[0] * (nj + dims[1] * nk)];
+                    if (neighElement >= 0)
+                    {
+                        edgeFrom.push_back(element);
+                        edgeTo.push_back(neighElement);
+                    }
+                }
+            }
+        }
+    }
+    addNeighbors(edgeFrom, edgeTo);
+}
+
+int32_t TFCEHelper::findRoot(const int32_t& element, Scratch& scratch) const
+{
+    int32_t root = element;
+    scratch.path.clear();
+    while (scratch.parent[root] != root)
+    {
+        scratch.path.push_back(root);
+        root = scratch.parent[root];
+    }
+    double pathOffset = 0.0;
+    for (int64_t i = (int64_t)scratch.path.size() - 1; i >= 0; --i)//walk back down from the root, making every offset on the path relative to the root
+    {
+        int32_t pathElement = scratch.path[i];
+        pathOffset += scratch.offset[pathElement];
+        scratch.offset[pathElement] = pathOffset;
+        scratch.parent[pathElement] = root;
+    }
+    return root;
+}
+
+void TFCEHelper::updateRoot(const int32_t& root, const float& bottomVal, Scratch& scratch) const
+{
+    float& lastVal = scratch.rootLastVal[root];
+    if (bottomVal != lastVal)//skip computing if there is no difference
+    {
+        CaretAssert(bottomVal < lastVal);
+        double integrated_h = m_paramH[root] + 1.0f;//integral(x^h) = (x^(h + 1))/(h + 1) + C
+        double newSlice = pow(scratch.rootArea[root], (double)m_paramE[root]) * (pow((double)lastVal, integrated_h) - pow((double)bottomVal, integrated_h)) / integrated_h;
+        scratch.rootAccum[root] += newSlice;
+        lastVal = bottomVal;
+    }
+}
+
+void TFCEHelper::tfcePass(const float* data, const bool& negate, double* accum, Scratch& scratch) const
+{
+    scratch.order.clear();
+    for (int32_t i = 0; i < m_numElements; ++i)
+    {
+        if (!m_included[i]) continue;
+        float value = (negate ? -data[i] : data[i]);
+        if (value > 0.0f)
+        {
+            scratch.order.push_back(pair<float, int32_t>(value, i));
+        }
+    }
+    sort(scratch.order.begin(), scratch.order.end(), greater<pair<float, int32_t> >());
+    fill(scratch.parent.begin(), scratch.parent.end(), -1);
+    int64_t numActive = (int64_t)scratch.order.size();
+    for (int64_t a = 0; a < numActive; ++a)
+    {
+        float value = scratch.order[a].first;
+        int32_t element = scratch.order[a].second;
+        scratch.roots.clear();
+        for (int64_t n = m_neighborStart[element]; n < m_neighborStart[element + 1]; ++n)
+        {
+            int32_t neighbor = m_neighbors[n];
+            if (scratch.parent[neighbor] != -1)
+            {
+                int32_t root = findRoot(neighbor, scratch);
+                if (find(scratch.roots.begin(), scratch.roots.end(), root) == scratch.roots.end())
+                {
+                    scratch.roots.push_back(root);
+                }
+            }
+        }
+        int numTouching = (int)scratch.roots.size();
+        if (numTouching == 0)
+        {//new cluster, the element is its own root
+            scratch.parent[element] = element;
+            scratch.size[element] = 1;
+            scratch.offset[element] = 0.0;
+            scratch.rootAccum[element] = 0.0;
+            scratch.rootArea[element] = m_areas[element];
+            scratch.rootLastVal[element] = value;
+            continue;
+        }
+        int32_t mergedRoot = scratch.roots[0];
+        for (int i = 0; i < numTouching; ++i)
+        {
+            updateRoot(scratch.roots[i], value, scratch);//align cluster bottoms
+            if (scratch.size[scratch.roots[i]] > scratch.size[mergedRoot])
+            {
+                mergedRoot = scratch.roots[i];
+            }
+        }
+        for (int i = 0; i < numTouching; ++i)
+        {//hang the smaller trees under the largest, their members' offsets become relative to the merged root through the old root's offset
+            int32_t thisRoot = scratch.roots[i];
+            if (thisRoot == mergedRoot) continue;
+            scratch.parent[thisRoot] = mergedRoot;
+            scratch.offset[thisRoot] = scratch.rootAccum[thisRoot] - scratch.rootAccum[mergedRoot];
+            scratch.rootArea[mergedRoot] += scratch.rootArea[thisRoot];
+            scratch.size[mergedRoot] += scratch.size[thisRoot];
+        }
+        scratch.parent[element] = mergedRoot;
+        scratch.offset[element] = -scratch.rootAccum[mergedRoot];//this element gets only what the cluster accumulates from here down
+        scratch.rootArea[mergedRoot] += m_areas[element];
+        ++scratch.size[mergedRoot];
+    }
+    for (int64_t a = 0; a < numActive; ++a)
+    {
+        int32_t element = scratch.order[a].second;
+        if (scratch.parent[element] == element)
+        {
+            updateRoot(element, 0.0f, scratch);//include the to-zero slice
+        }
+    }
+    for (int64_t a = 0; a < numActive; ++a)
+    {
+        int32_t element = scratch.order[a].second;
+        int32_t root = findRoot(element, scratch);
+        accum[element] += scratch.offset[element] + scratch.rootAccum[root];//offset of a root is always zero
+    }
+}
+
+void TFCEHelper::computeInternal(const float* data, float* dataOut, Scratch& scratch) const
+{
+    if ((int64_t)scratch.parent.size() != m_numElements)
+    {
+        scratch.parent.resize(m_numElements);
+        scratch.size.resize(m_numElements);
+        scratch.offset.resize(m_numElements);
+        scratch.rootAccum.resize(m_numElements);
+        scratch.rootArea.resize(m_numElements);
+        scratch.rootLastVal.resize(m_numElements);
+        scratch.accum.resize(m_numElements);
+    }
+    fill(scratch.accum.begin(), scratch.accum.end(), 0.0);
+    tfcePass(data, false, scratch.accum.data(), scratch);
+    tfcePass(data, true, scratch.accum.data(), scratch);//negatives and positives don't overlap, so reuse the accum array
+    for (int32_t i = 0; i < m_numElements; ++i)
+    {
+        if (m_included[i])
+        {
+            if (data[i] < 0.0f)
+            {
+                dataOut[i] = (float)-scratch.accum[i];
+            } else {
+                dataOut[i] = (float)scratch.accum[i];
+            }
+        } else {
+            dataOut[i] = 0.0f;
+        }
+    }
+}
+
+void TFCEHelper::compute(const float* data, float* dataOut) const
+{
+    Scratch scratch;
+    computeInternal(data, dataOut, scratch);
+}
+
+void TFCEHelper::oneSampleT(const vector<const float*>& maps, const vector<float>& signs, const int64_t& numElements, float* tOut)
+{
+    int numMaps = (int)maps.size();
+    CaretAssert(numMaps > 1 && (int)signs.size() == numMaps);
+    for (int64_t i = 0; i < numElements; ++i)
+    {
+        double mean = 0.0, sumSquareDiff = 0.0;//welford's method, the naive sum of squares cancels badly when the mean is large compared to the spread
+        for (int m = 0; m < numMaps; ++m)
+        {
+            double value = signs[m] * maps[m][i];
+            double delta = value - mean;
+            mean += delta / (m + 1);
+            sumSquareDiff += delta * (value - mean);
+        }
+        double variance = sumSquareDiff / (numMaps - 1);
+        if (variance > 0.0)
+        {
+            tOut[i] = (float)(mean / sqrt(variance / numMaps));
+        } else {
+            tOut[i] = 0.0f;
+        }
+    }
+}
+
+void TFCEHelper::signFlipMaxNull(const vector<const float*>& maps, const int& numPermutations, const int64_t& seed, vector<float>& nullOut) const
+{
+    int numMaps = (int)maps.size();
+    if (numMaps < 2) throw CaretException("sign flipping requires at least 2 maps");
+    CaretAssert(numPermutations >= 0);
+    nullOut.resize(numPermutations);
+    uint64_t seedBits = mixBits((uint64_t)seed);
+#pragma omp CARET_PAR
+    {
+        Scratch scratch;
+        vector<float> signs(numMaps), tMap(m_numElements), tfceMap(m_numElements);
+#pragma omp CARET_FOR schedule(dynamic)
+        for (int perm = 0; perm < numPermutations; ++perm)
+        {
+            for (int m = 0; m < numMaps; ++m)
+            {
+                if (perm == 0 || (mixBits(seedBits + (uint64_t)perm * numMaps + m) >> 63) == 0)
+                {
+                    signs[m] = 1.0f;
+                } else {
+                    signs[m] = -1.0f;
+                }
+            }
+            oneSampleT(maps, signs, m_numElements, tMap.data());
+            computeInternal(tMap.data(), tfceMap.data(), scratch);
+            float maxVal = 0.0f;
+            for (int32_t i = 0; i < m_numElements; ++i)
+            {
+                float absVal = abs(tfceMap[i]);
+                if (absVal > maxVal) maxVal = absVal;
+            }
+            nullOut[perm] = maxVal;
+        }
+    }
+}
+
+void TFCEHelper::writeNullDistribution(const AString& nullTextName, const vector<float>& nullDist)
+{
+    ofstream nullOut(nullTextName.toLocal8Bit().constData());
+    if (!nullOut) throw CaretException("failed to open text file for output: " + nullTextName);
+    nullOut.precision(2 + numeric_limits<float>::digits * 3010 / 10000);//same as numeric_limits<float>::max_digits10, which needs c++11
+    for (int i = 0; i < (int)nullDist.size(); ++i)
+    {
+        nullOut << nullDist[i] << endl;
+    }
+    if (!nullOut) throw CaretException("failed to write text file: " + nullTextName);
+}
@@ -0,0 +1,76 @@
+#ifndef __TFCE_HELPER_H__
+#define __TFCE_HELPER_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "AString.h"
+
+#include "stdint.h"
+#include <vector>
+
+namespace caret {
+
+    class TopologyHelper;
+
+    ///threshold-free cluster enhancement over an arbitrary set of elements (vertices, voxels, or cifti brainordinates)
+    ///clusters are tracked in a disjoint-set forest with path compression, and the integral is kept as per-element offsets from the cluster root, so merges are constant time
+    ///add the structures once, then compute as many maps as needed, compute() and signFlipMaxNull() are safe to call from multiple threads
+    class TFCEHelper
+    {
+        struct Scratch
+        {
+            std::vector<std::pair<float, int32_t> > order;
+            std::vector<int32_t> parent, size, path, roots;
+            std::vector<double> offset, rootAccum, rootArea, accum;
+            std::vector<float> rootLastVal;
+        };
+        int32_t m_numElements;
+        std::vector<int64_t> m_neighborStart;//neighbors of element i are m_neighbors[m_neighborStart[i]] through m_neighbors[m_neighborStart[i + 1] - 1]
+        std::vector<int32_t> m_neighbors;
+        std::vector<float> m_areas, m_paramE, m_paramH;
+        std::vector<char> m_included;
+        void addNeighbors(const std::vector<int32_t>& edgeFrom, const std::vector<int32_t>& edgeTo);
+        int32_t findRoot(const int32_t& element, Scratch& scratch) const;
+        void updateRoot(const int32_t& root, const float& bottomVal, Scratch& scratch) const;
+        void tfcePass(const float* data, const bool& negate, double* accum, Scratch& scratch) const;
+        void computeInternal(const float* data, float* dataOut, Scratch& scratch) const;
+        TFCEHelper();
+    public:
+        TFCEHelper(const int64_t& numElements);
+        ///vertexToElement gives the element index of each vertex, or -1 to leave it out
+        void addSurface(const TopologyHelper* myTopoHelp, const float* vertexAreas, const std::vector<int32_t>& vertexToElement, const float& param_e, const float& param_h);
+        ///voxelToElement is indexed like a volume frame (i + dims[0] * (j + dims[1] * k)), -1 to leave a voxel out, voxels are face neighbors only
+        void addVolume(const int64_t dims[3], const float& voxelVolume, const std::vector<int32_t>& voxelToElement, const float& param_e, const float& param_h);
+        int64_t getNumberOfElements() const { return m_numElements; }
+        ///positive and negative values are enhanced separately, output has the sign of the input, elements that were never added get zero
+        void compute(const float* data, float* dataOut) const;
+        ///one-sample t statistic at each element, after multiplying each map by its sign
+        static void oneSampleT(const std::vector<const float*>& maps, const std::vector<float>& signs, const int64_t& numElements, float* tOut);
+        ///maximum absolute TFCE value of the one-sample t map, for each of numPermutations random sign flips of the input maps
+        ///permutation 0 uses the maps as given, the flips depend only on the seed, so the result doesn't depend on the number of threads
+        void signFlipMaxNull(const std::vector<const float*>& maps, const int& numPermutations, const int64_t& seed, std::vector<float>& nullOut) const;
+        ///write a null distribution as text, one value per line, with enough digits to read back the same floats
+        static void writeNullDistribution(const AString& nullTextName, const std::vector<float>& nullDist);
+    };
+
+}
+
+#endif //__TFCE_HELPER_H__
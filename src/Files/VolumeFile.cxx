@@ -446,6 +446,87 @@ float VolumeFile::interpolateValue(const float coordIn1, const float coordIn2, c
     return INVALID_INTERP_VALUE;
 }
 
+bool VolumeFile::rayIntersectVoxel(const float start[3], const float direction[3], const float& threshold, int64_t ijkOut[3],
+                                   float* distanceOut, const int64_t brickIndex, const int64_t component) const
+{
+    const int64_t* dimensions = getDimensionsPtr();
+    CaretAssert(brickIndex >= 0 && brickIndex < dimensions[3]);
+    CaretAssert(component >= 0 && component < dimensions[4]);
+    float idxStart[3], idxEnd[3], idxDir[3];
+    spaceToIndex(start, idxStart);
+    spaceToIndex(start[0] + direction[0], start[1] + direction[1], start[2] + direction[2], idxEnd);
+    for (int i = 0; i < 3; ++i)
+    {//shift by half a voxel so that voxel n spans [n, n + 1) on each axis
+        idxStart[i] += 0.5f;
+        idxEnd[i] += 0.5f;
+        idxDir[i] = idxEnd[i] - idxStart[i];
+    }
+    float tenter = 0.0f, texit = numeric_limits<float>::max();//clip the ray to the volume bounds
+    for (int i = 0; i < 3; ++i)
+    {
+        if (idxDir[i] != 0.0f)
+        {
+            float tlow = (0.0f - idxStart[i]) / idxDir[i];
+            float thigh = (dimensions[i] - idxStart[i]) / idxDir[i];
+            if (tlow > thigh)
+            {
+                float swap = tlow;
+                tlow = thigh;
+                thigh = swap;
+            }
+            if (tlow > tenter) tenter = tlow;
+            if (thigh < texit) texit = thigh;
+        } else {
+            if (idxStart[i] < 0.0f || idxStart[i] >= dimensions[i]) return false;
+        }
+    }
+    if (texit == numeric_limits<float>::max()) return false;//zero length direction
+    if (tenter > texit) return false;
+    int64_t voxel[3], step[3];
+    float tnext[3], tdelta[3];
+    for (int i = 0; i < 3; ++i)
+    {//3D DDA, standard Amanatides and Woo voxel traversal
+        float entry = idxStart[i] + tenter * idxDir[i];
+        voxel[i] = (int64_t)floor(entry);
+        if (voxel[i] < 0) voxel[i] = 0;
+        if (voxel[i] >= dimensions[i]) voxel[i] = dimensions[i] - 1;
+        if (idxDir[i] > 0.0f)
+        {
+            step[i] = 1;
+            tdelta[i] = 1.0f / idxDir[i];
+            tnext[i] = (voxel[i] + 1 - idxStart[i]) / idxDir[i];
+        } else if (idxDir[i] < 0.0f) {
+            step[i] = -1;
+            tdelta[i] = -1.0f / idxDir[i];
+            tnext[i] = (voxel[i] - idxStart[i]) / idxDir[i];
+        } else {
+            step[i] = 0;
+            tdelta[i] = numeric_limits<float>::max();
+            tnext[i] = numeric_limits<float>::max();
+        }
+    }
+    float t = tenter;
+    while (true)
+    {
+        if (fabs(getValue(voxel, brickIndex, component)) > threshold)
+        {
+            ijkOut[0] = voxel[0];
+            ijkOut[1] = voxel[1];
+            ijkOut[2] = voxel[2];
+            if (distanceOut != NULL) *distanceOut = t;
+            return true;
+        }
+        int axis = 0;
+        if (tnext[1] < tnext[axis]) axis = 1;
+        if (tnext[2] < tnext[axis]) axis = 2;
+        t = tnext[axis];
+        if (t > texit) return false;
+        voxel[axis] += step[axis];
+        if (voxel[axis] < 0 || voxel[axis] >= dimensions[axis]) return false;
+        tnext[axis] += tdelta[axis];
+    }
+}
+
 void VolumeFile::validateSpline(const int64_t brickIndex, const int64_t component) const
 {
     const int64_t* dimensions = getDimensionsPtr();
@@ -170,6 +170,11 @@ namespace caret {
 
         float interpolateValue(const float coordIn1, const float coordIn2, const float coordIn3, InterpType interp = TRILINEAR, bool* validOut = NULL, const int64_t brickIndex = 0, const int64_t component = 0) const;
 
+        ///find the first voxel along the ray whose absolute value is above threshold, by stepping through every voxel the ray crosses
+        ///distanceOut is where the ray enters that voxel, in units of the length of direction, returns false if no voxel qualifies
+        bool rayIntersectVoxel(const float start[3], const float direction[3], const float& threshold, int64_t ijkOut[3],
+                               float* distanceOut = NULL, const int64_t brickIndex = 0, const int64_t component = 0) const;
+
         ///returns true if volume space matches in spatial dimensions and sform
         bool matchesVolumeSpace(const VolumeFile* right) const;
         
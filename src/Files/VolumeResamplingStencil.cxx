@@ -0,0 +1,239 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "VolumeResamplingStencil.h"
+
+#include "CaretAssert.h"
+#include "CaretLogger.h"
+#include "CaretOMP.h"
+#include "CubicSpline.h"
+#include "VolumeSpline.h"
+
+#include <cmath>
+
+using namespace caret;
+using namespace std;
+
+VolumeResamplingStencil::VolumeResamplingStencil(const VolumeSpace& sourceSpace, const VolumeFile::InterpType& method, const int64_t& numSamples)
+{
+    m_sourceSpace = sourceSpace;
+    m_method = method;
+    const int64_t* dims = m_sourceSpace.getDims();
+    if (dims[0] == 1 || dims[1] == 1 || dims[2] == 1)
+    {
+        m_method = VolumeFile::ENCLOSING_VOXEL;//same as VolumeFile, single slices can't use the neighboring slices
+    }
+    m_numSamples = numSamples;
+    m_lowCorner.resize(m_numSamples, -1);
+    switch (m_method)
+    {
+        case VolumeFile::TRILINEAR:
+            m_weights.resize(m_numSamples * 3);
+            break;
+        case VolumeFile::CUBIC:
+            m_weights.resize(m_numSamples * 12);
+            m_edges.resize(m_numSamples);
+            break;
+        case VolumeFile::ENCLOSING_VOXEL:
+            break;
+    }
+}
+
+void VolumeResamplingStencil::setSample(const int64_t& sample, const float coord[3])
+{
+    CaretAssert(sample >= 0 && sample < m_numSamples);
+    const int64_t* dims = m_sourceSpace.getDims();
+    if (m_method == VolumeFile::ENCLOSING_VOXEL)
+    {
+        int64_t ijk[3];
+        m_sourceSpace.enclosingVoxel(coord, ijk);
+        if (m_sourceSpace.indexValid(ijk))
+        {
+            m_lowCorner[sample] = m_sourceSpace.getIndex(ijk);
+        } else {
+            m_lowCorner[sample] = -1;
+        }
+        return;
+    }
+    float indexSpace[3];
+    m_sourceSpace.spaceToIndex(coord, indexSpace);
+    int64_t low[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        low[axis] = (int64_t)floor(indexSpace[axis]);
+    }
+    if (!m_sourceSpace.indexValid(low) || !m_sourceSpace.indexValid(low[0] + 1, low[1] + 1, low[2] + 1))
+    {//same test as interpolateValue, so cubic doesn't need to handle the outer half-voxel
+        m_lowCorner[sample] = -1;
+        return;
+    }
+    m_lowCorner[sample] = m_sourceSpace.getIndex(low);
+    if (m_method == VolumeFile::TRILINEAR)
+    {
+        float* weights = m_weights.data() + sample * 3;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            weights[axis] = indexSpace[axis] - low[axis];
+        }
+    } else {
+        float* weights = m_weights.data() + sample * 12;
+        uint8_t edges = 0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bool lowEdge = (low[axis] < 1), highEdge = (low[axis] >= dims[axis] - 2);
+            if (lowEdge) edges |= (1 << axis);
+            if (highEdge) edges |= (8 << axis);
+            CubicSpline axisSpline = CubicSpline::bspline(indexSpace[axis] - low[axis], lowEdge, highEdge);
+            for (int w = 0; w < 4; ++w)
+            {
+                weights[axis * 4 + w] = axisSpline.getWeight(w);
+            }
+        }
+        m_edges[sample] = edges;
+    }
+}
+
+void VolumeResamplingStencil::resample(const float* sourceFrame, float* samplesOut) const
+{
+    const int64_t* dims = m_sourceSpace.getDims();
+    const int64_t zstep = dims[0] * dims[1];
+    switch (m_method)
+    {
+        case VolumeFile::ENCLOSING_VOXEL:
+        {
+#pragma omp CARET_PARFOR
+            for (int64_t s = 0; s < m_numSamples; ++s)
+            {
+                int64_t index = m_lowCorner[s];
+                if (index < 0)
+                {
+                    samplesOut[s] = VolumeFile::INVALID_INTERP_VALUE;
+                } else {
+                    samplesOut[s] = sourceFrame[index];
+                }
+            }
+            break;
+        }
+        case VolumeFile::TRILINEAR:
+        {
+#pragma omp CARET_PARFOR
+            for (int64_t s = 0; s < m_numSamples; ++s)
+            {
+                int64_t index = m_lowCorner[s];
+                if (index < 0)
+                {
+                    samplesOut[s] = VolumeFile::INVALID_INTERP_VALUE;
+                    continue;
+                }
+                const float* weights = m_weights.data() + s * 3;
+                const float* base = sourceFrame + index;
+                float xhighWeight = weights[0];
+                float xlowWeight = 1.0f - xhighWeight;
+                float xinterp[2][2];//same order of operations as VolumeFile::interpolateValue
+                xinterp[0][0] = xlowWeight * base[0] + xhighWeight * base[1];
+                xinterp[1][0] = xlowWeight * base[dims[0]] + xhighWeight * base[dims[0] + 1];
+                xinterp[0][1] = xlowWeight * base[zstep] + xhighWeight * base[zstep + 1];
+                xinterp[1][1] = xlowWeight * base[zstep + dims[0]] + xhighWeight * base[zstep + dims[0] + 1];
+                float yhighWeight = weights[1];
+                float ylowWeight = 1.0f - yhighWeight;
+                float yinterp[2];
+                yinterp[0] = ylowWeight * xinterp[0][0] + yhighWeight * xinterp[1][0];
+                yinterp[1] = ylowWeight * xinterp[0][1] + yhighWeight * xinterp[1][1];
+                float zhighWeight = weights[2];
+                float zlowWeight = 1.0f - zhighWeight;
+                samplesOut[s] = zlowWeight * yinterp[0] + zhighWeight * yinterp[1];
+            }
+            break;
+        }
+        case VolumeFile::CUBIC:
+        {
+            VolumeSpline mySpline(sourceFrame, dims);
+            if (mySpline.ignoredNonNumeric())
+            {
+                CaretLogWarning("ignored non-numeric input value when calculating cubic splines");
+            }
+            resampleCubic(mySpline.getCoefficients(), samplesOut);
+            break;
+        }
+    }
+}
+
+void VolumeResamplingStencil::resample(const VolumeSpline& sourceSpline, float* samplesOut) const
+{
+    CaretAssert(m_method == VolumeFile::CUBIC);
+    resampleCubic(sourceSpline.getCoefficients(), samplesOut);
+}
+
+void VolumeResamplingStencil::resampleCubic(const float* coefficients, float* samplesOut) const
+{
+    const int64_t* dims = m_sourceSpace.getDims();
+    const int64_t zstep = dims[0] * dims[1];
+#pragma omp CARET_PARFOR
+    for (int64_t s = 0; s < m_numSamples; ++s)
+    {
+        int64_t index = m_lowCorner[s];
+        if (index < 0)
+        {
+            samplesOut[s] = VolumeFile::INVALID_INTERP_VALUE;
+            continue;
+        }
+        const float* weights = m_weights.data() + s * 12;
+        const float* base = coefficients + index - 1 - dims[0] - zstep;//the neighborhood starts one voxel lower on each axis
+        uint8_t edges = m_edges[s];
+        int istart = (edges & 1) ? 1 : 0, jstart = (edges & 2) ? 1 : 0, kstart = (edges & 4) ? 1 : 0;
+        int iend = (edges & 8) ? 3 : 4, jend = (edges & 16) ? 3 : 4, kend = (edges & 32) ? 3 : 4;
+        float jtemp[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, ktemp[4] = { 0.0f, 0.0f, 0.0f, 0.0f };//taps off the edge have zero weight, but must not be read
+        for (int k = kstart; k < kend; ++k)
+        {
+            for (int j = jstart; j < jend; ++j)
+            {
+                const float* row = base + k * zstep + j * dims[0];
+                float accum = 0.0f;
+                for (int i = istart; i < iend; ++i)
+                {
+                    accum += row[i] * weights[i];
+                }
+                jtemp[j] = accum;
+            }
+            ktemp[k] = jtemp[0] * weights[4] + jtemp[1] * weights[5] + jtemp[2] * weights[6] + jtemp[3] * weights[7];
+        }
+        samplesOut[s] = ktemp[0] * weights[8] + ktemp[1] * weights[9] + ktemp[2] * weights[10] + ktemp[3] * weights[11];
+    }
+}
+
+int64_t VolumeResamplingStencil::samplesForMemoryLimit(const VolumeFile::InterpType& method, const int64_t& granularity, const int64_t& memLimitBytes)
+{
+    CaretAssert(granularity > 0);
+    int64_t bytesPerSample = sizeof(int64_t) + sizeof(float);//corner index, plus the output buffer
+    switch (method)
+    {
+        case VolumeFile::TRILINEAR:
+            bytesPerSample += 3 * sizeof(float);
+            break;
+        case VolumeFile::CUBIC:
+            bytesPerSample += 12 * sizeof(float) + sizeof(uint8_t);
+            break;
+        case VolumeFile::ENCLOSING_VOXEL:
+            break;
+    }
+    int64_t numGroups = memLimitBytes / (bytesPerSample * granularity);
+    if (numGroups < 1) numGroups = 1;
+    return numGroups * granularity;
+}
@@ -0,0 +1,62 @@
+#ifndef __VOLUME_RESAMPLING_STENCIL_H__
+#define __VOLUME_RESAMPLING_STENCIL_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "VolumeFile.h"
+#include "VolumeSpace.h"
+#include "VolumeSpline.h"
+
+#include "stdint.h"
+#include <vector>
+
+namespace caret {
+
+    ///precomputed interpolation weights for sampling every frame of a volume at the same set of coordinates
+    ///gives the same values as VolumeFile::interpolateValue, but the coordinate transform and weights are only computed once, rather than once per frame
+    class VolumeResamplingStencil
+    {
+        VolumeSpace m_sourceSpace;
+        VolumeFile::InterpType m_method;
+        int64_t m_numSamples;
+        std::vector<int64_t> m_lowCorner;//frame index of the lowest voxel of the trilinear or cubic neighborhood (or the enclosing voxel), -1 for samples outside the volume
+        std::vector<float> m_weights;//trilinear: fraction toward the high voxel on each axis, cubic: 4 bspline weights per axis
+        std::vector<uint8_t> m_edges;//cubic only: bits 0-2 are low edge on i, j, k, bits 3-5 are high edge
+        VolumeResamplingStencil();
+        void resampleCubic(const float* coefficients, float* samplesOut) const;
+    public:
+        VolumeResamplingStencil(const VolumeSpace& sourceSpace, const VolumeFile::InterpType& method, const int64_t& numSamples);
+        ///coordinate is in the source volume's space, samples that are never set (or are outside the volume) give INVALID_INTERP_VALUE
+        ///safe to call from multiple threads for different samples
+        void setSample(const int64_t& sample, const float coord[3]);
+        ///sourceFrame must be a frame of a volume in sourceSpace, for cubic it is deconvolved here, once per call
+        void resample(const float* sourceFrame, float* samplesOut) const;
+        ///cubic only, for when several stencils sample the same frame: deconvolve the frame once into a VolumeSpline, and use it for every stencil
+        void resample(const VolumeSpline& sourceSpline, float* samplesOut) const;
+        ///method actually used for sampling, single-slice volumes use ENCLOSING_VOXEL just like VolumeFile
+        VolumeFile::InterpType getMethod() const { return m_method; }
+        ///number of samples to give each stencil so that it stays under roughly memLimitBytes, rounded down to a multiple of granularity (but at least granularity)
+        static int64_t samplesForMemoryLimit(const VolumeFile::InterpType& method, const int64_t& granularity, const int64_t& memLimitBytes);
+    };
+
+}
+
+#endif //__VOLUME_RESAMPLING_STENCIL_H__
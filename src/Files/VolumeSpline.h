@@ -39,6 +39,8 @@ namespace caret {
         float sample(const float& i, const float& j, const float& k);
         float sample(const float ijk[3]) { return sample(ijk[0], ijk[1], ijk[2]); }
         bool ignoredNonNumeric() const { return m_ignoredNonNumeric; }
+        ///the deconvolved coefficients, in frame order, for callers that precompute their own bspline weights
+        const float* getCoefficients() const { return m_deconv.getArray(); }
     };
     
 }
@@ -24,12 +24,11 @@
 #include <limits>
 #include <sstream>
 
-#include "Base64.h"
+#include "Base64ZLibStream.h"
 #include "ByteOrderEnum.h"
 #include "ByteSwapping.h"
 #include "CaretAssert.h"
 #include "CaretLogger.h"
-#include "DataCompressZLib.h"
 
 //#include "FileUtilities.h"
 #include "FastStatistics.h"
@@ -579,7 +578,7 @@ GiftiDataArray::transferLabelIndices(const std::map<int32_t,int32_t>& indexConve
  * Data array should already be initialized and allocated.
  */
 void 
-GiftiDataArray::readFromText(const AString text,
+GiftiDataArray::readFromText(const std::string& text,
                              const GiftiEndianEnum::Enum dataEndianForReading,
                              const GiftiArrayIndexingOrderEnum::Enum arraySubscriptingOrderForReading,
                              const NiftiDataTypeEnum::Enum dataTypeForReading,
@@ -613,7 +612,7 @@ GiftiDataArray::readFromText(const AString text,
       switch (encoding) {
           case GiftiEncodingEnum::ASCII:
             {
-                std::istringstream stream(text.toStdString());
+                std::istringstream stream(text);
                 
                switch (dataType) {
                   case NiftiDataTypeEnum::NIFTI_TYPE_FLOAT32:
@@ -653,12 +652,14 @@ GiftiDataArray::readFromText(const AString text,
           case GiftiEncodingEnum::BASE64_BINARY:
             {
                //
-               // Decode the Base64 data using VTK's algorithm
+               // Decode the Base64 data directly into the data array
                //
                const uint64_t numDecoded =
-                     Base64::decode((const unsigned char*)(text.toStdString().c_str()),
-                                                data.size(),
-                                                &data[0]);
+                     Base64ZLibStream::decode(text.data(),
+                                              text.size(),
+                                              false,
+                                              &data[0],
+                                              data.size());
                if (numDecoded != data.size()) {
                   std::ostringstream str;
                   str << "Decoding of Base64 Binary data failed.\n"
@@ -678,32 +679,16 @@ GiftiDataArray::readFromText(const AString text,
           case GiftiEncodingEnum::GZIP_BASE64_BINARY:
             {
                //
-               // Decode the Base64 data using VTK's algorithm
+               // Decode the Base64 data and uncompress it in one pass,
+               // directly into the data array, without a buffer for
+               // all of the compressed data
                //
-               unsigned char* dataBuffer = new unsigned char[data.size()];
-               //const char* textChars = text.toLatin1().constData();
-               const uint64_t numDecoded =
-                     Base64::decode((unsigned char*)text.toStdString().c_str(),
-                                                data.size(),
-                                                dataBuffer);
-               if (numDecoded == 0) {
-                   std::ostringstream str;
-                   str << "Decoding of GZip Base64 Binary data failed."
-                   << "Decoded " << AString::number(numDecoded).toStdString() << " bytes but should be "
-                   << AString::number(static_cast<int>(data.size())).toStdString() << " bytes.";
-                   throw GiftiException(AString::fromStdString(str.str()));
-               }
-               
-               
-               //
-               // Uncompress the data using VTK's algorithm
-               // 
-                DataCompressZLib compressor;
-                const uint64_t uncompressedDataLength = 
-                                   compressor.uncompressData(dataBuffer,
-                                                          numDecoded,
-                                                          (unsigned char*)&data[0],
-                                                          data.size());
+               const uint64_t uncompressedDataLength =
+                     Base64ZLibStream::decode(text.data(),
+                                              text.size(),
+                                              true,
+                                              &data[0],
+                                              data.size());
                if (uncompressedDataLength != data.size()) {
                   std::ostringstream str;
                   str << "Decompression of Binary data failed.\n"
@@ -712,11 +697,6 @@ GiftiDataArray::readFromText(const AString text,
                   throw GiftiException(AString::fromStdString(str.str()));
                }
                
-               //
-               // Free memory
-               //
-               delete[] dataBuffer;
-               
                //
                // Is byte swapping needed ? 
                //
@@ -1169,72 +1149,23 @@ GiftiDataArray::writeAsXML(std::ostream& stream,
          }
          break;
        case GiftiEncodingEnum::BASE64_BINARY:
-         {
-            //
-            // Encode the data with VTK's Base64 algorithm
-            //
-            const uint64_t bufferLength = static_cast<uint64_t>(data.size() * 1.5);
-            char* buffer = new char[bufferLength];
-            const uint64_t compressedLength =
-               Base64::encode(&data[0],
-                                          data.size(),
-                                          (unsigned char*)buffer);
-            if (compressedLength >= bufferLength) {
-               throw GiftiException(
-                     "Base64 encoding buffer length ("
-                     + AString::number(bufferLength)
-                     + ") is too small but needs to be "
-                                    + AString::number(compressedLength));
-            }
-            buffer[compressedLength] = '\0';
-            
-            //
-            // Write the data  MUST BE NO space around data
-            //
-            xmlWriter.writeElementNoSpace(GiftiXmlElements::TAG_DATA, buffer);
-            
-            //
-            // Free memory
-            //
-            delete[] buffer;
-         }
-         break;
        case GiftiEncodingEnum::GZIP_BASE64_BINARY:
          {
             //
-            // Compress the data with VTK's ZLIB algorithm
-            //
-             DataCompressZLib compressor;
-             unsigned long compressedDataBufferLength = 
-                              compressor.getMaximumCompressionSpace(data.size());
-            unsigned char* compressedDataBuffer = new unsigned char[compressedDataBufferLength];
-            unsigned long compressedDataLength =
-                          compressor.compressData(&data[0], 
-                                               data.size(),
-                                               compressedDataBuffer,
-                                               compressedDataBufferLength);
-            
-            //
-            // Encode the data with VTK's Base64 algorithm
+            // Compress (if needed) and encode the data in pieces, writing
+            // each piece to the stream, so that there is no buffer
+            // for all of the encoded data.
+            // MUST BE NO space around data
             //
-            char* buffer = new char[static_cast<int64_t>(compressedDataLength * 1.5)];
-            const uint64_t compressedLength =
-               Base64::encode(compressedDataBuffer,
-                                          compressedDataLength,
-                                          (unsigned char*)buffer);
-            buffer[compressedLength] = '\0';
-            
-             //
-             // Write the data  MUST BE NO space around data
-             //
-             xmlWriter.writeElementNoSpace(GiftiXmlElements::TAG_DATA, buffer);
-             
-            
-            //
-            // Free memory
-            //
-            delete[] buffer;
-            delete[] compressedDataBuffer;
+            xmlWriter.writeStartElementNoSpace(GiftiXmlElements::TAG_DATA);
+            const bool compressFlag = (encoding == GiftiEncodingEnum::GZIP_BASE64_BINARY);
+            if ( ! Base64ZLibStream::encode(&data[0],
+                                            data.size(),
+                                            compressFlag,
+                                            stream)) {
+               throw GiftiException("Compression of data failed.");
+            }
+            xmlWriter.writeEndElementNoSpace(GiftiXmlElements::TAG_DATA);
          }
          break;
        case GiftiEncodingEnum::EXTERNAL_FILE_BINARY:
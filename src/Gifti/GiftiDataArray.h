@@ -25,6 +25,7 @@
 #include <map>
 #include <ostream>
 #include <AString.h>
+#include <string>
 #include <vector>
 
 #include <stdint.h>
@@ -113,7 +114,7 @@ namespace caret {
         //int64_t getDataOffset(const int64_t nodeNum, const int64_t componentNum) const;//TSC: implementation was wrong, commenting out for now
         
         // read a data array from text
-        void readFromText(const AString text,
+        void readFromText(const std::string& text,
                           const GiftiEndianEnum::Enum dataEndianForReading,
                           const GiftiArrayIndexingOrderEnum::Enum arraySubscriptingOrderForReading,
                           const NiftiDataTypeEnum::Enum dataTypeForReading,
@@ -18,10 +18,14 @@
  */
 /*LICENSE_END*/
 
+#include <new>
 #include <sstream>
 
+#include "CaretAssert.h"
 #include "CaretLogger.h"
+#include "CaretOMP.h"
 #include "FileInformation.h"
+#include "GiftiDataArray.h"
 #include "GiftiEndianEnum.h"
 #include "GiftiLabel.h"
 #include "GiftiFile.h"
@@ -50,6 +54,7 @@ GiftiFileSaxReader::GiftiFileSaxReader(GiftiFile* giftiFileIn)
     this->labelTableSaxReader = NULL;
     this->metaDataSaxReader = NULL;
     this->dataArrayDataHasBeenRead = false;
+    this->pendingArrayTextBytes = 0;
 }
 
 /**
@@ -295,6 +300,7 @@ GiftiFileSaxReader::endElement(const AString& namespaceURI,
    // Clear out for new elements
    //
    this->elementText = "";
+   this->dataArrayText.clear();
    
    //
    // Go to previous state
@@ -515,19 +521,98 @@ GiftiFileSaxReader::processArrayData()
     this->dataArrayDataHasBeenRead = true;
 
     CaretAssert(dataArray);
-    try {
-        dataArray->readFromText(elementText,
-                                this->endianForReadingArrayData,
-                                arraySubscriptingOrderForReadingArrayData,
-                                dataTypeForReadingArrayData,
-                                dimensionsForReadingArrayData,
-                                encodingForReadingArrayData,
-                                externalFileNameForReadingData,
-                                externalFileOffsetForReadingData,
-                                this->giftiFile->getReadMetaDataOnlyFlag());
+    if (this->giftiFile->getReadMetaDataOnlyFlag()) {
+        try {
+            dataArray->readFromText(dataArrayText,
+                                    this->endianForReadingArrayData,
+                                    arraySubscriptingOrderForReadingArrayData,
+                                    dataTypeForReadingArrayData,
+                                    dimensionsForReadingArrayData,
+                                    encodingForReadingArrayData,
+                                    externalFileNameForReadingData,
+                                    externalFileOffsetForReadingData,
+                                    true);
+        }
+        catch (const GiftiException& e) {
+            throw XmlSaxParserException(e.whatString());
+        }
+        return;
     }
-    catch (const GiftiException& e) {
-        throw XmlSaxParserException(e.whatString());
+    
+    /*
+     * Decoding is deferred so that several data arrays can be
+     * decoded in parallel.  The text is swapped, not copied, into
+     * the pending data, and the pending arrays are decoded once
+     * their text reaches a limit so that the text of the whole
+     * document is never held at once.
+     */
+    pendingArrayData.push_back(PendingArrayData());
+    PendingArrayData& pending = pendingArrayData.back();
+    pending.dataArray = dataArray.getPointer();
+    pending.text.swap(dataArrayText);
+    pending.endian = this->endianForReadingArrayData;
+    pending.arraySubscriptingOrder = arraySubscriptingOrderForReadingArrayData;
+    pending.dataType = dataTypeForReadingArrayData;
+    pending.dimensions = dimensionsForReadingArrayData;
+    pending.encoding = encodingForReadingArrayData;
+    pending.externalFileName = externalFileNameForReadingData;
+    pending.externalFileOffset = externalFileOffsetForReadingData;
+    
+    pendingArrayTextBytes += static_cast<int64_t>(pending.text.size());
+    const int64_t maximumPendingTextBytes = 64 * 1024 * 1024;
+    if (pendingArrayTextBytes >= maximumPendingTextBytes) {
+        decodePendingArrayData();
+    }
+}
+
+/**
+ * Decode the data of the pending data arrays, in parallel.  Each
+ * data array decodes (base64, inflate, byteswap) directly into its
+ * own storage so the arrays are independent.
+ */
+void
+GiftiFileSaxReader::decodePendingArrayData()
+{
+    const int64_t numPending = static_cast<int64_t>(pendingArrayData.size());
+    std::vector<AString> errorMessages(numPending);
+    bool outOfMemoryFlag = false;
+    
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int64_t i = 0; i < numPending; i++) {
+        PendingArrayData& pending = pendingArrayData[i];
+        try {
+            pending.dataArray->readFromText(pending.text,
+                                            pending.endian,
+                                            pending.arraySubscriptingOrder,
+                                            pending.dataType,
+                                            pending.dimensions,
+                                            pending.encoding,
+                                            pending.externalFileName,
+                                            pending.externalFileOffset,
+                                            false);
+        }
+        catch (const GiftiException& e) {
+            errorMessages[i] = e.whatString();
+        }
+        catch (const std::bad_alloc&) {
+            outOfMemoryFlag = true;
+        }
+        
+        /*
+         * Release the text as soon as it is decoded
+         */
+        std::string().swap(pending.text);
+    }
+    pendingArrayData.clear();
+    pendingArrayTextBytes = 0;
+    
+    if (outOfMemoryFlag) {
+        throw std::bad_alloc();
+    }
+    for (int64_t i = 0; i < numPending; i++) {
+        if ( ! errorMessages[i].isEmpty()) {
+            throw XmlSaxParserException(errorMessages[i]);
+        }
     }
 }
 
@@ -543,6 +628,9 @@ GiftiFileSaxReader::characters(const char* ch)
     else if (this->labelTableSaxReader != NULL) {
         this->labelTableSaxReader->characters(ch);
     }
+    else if (this->state == STATE_DATA_ARRAY_DATA) {
+        dataArrayText += ch;
+    }
     else {
         elementText += ch;
     }
@@ -594,5 +682,6 @@ GiftiFileSaxReader::startDocument()
 void 
 GiftiFileSaxReader::endDocument()
 {
+    decodePendingArrayData();
 }
 
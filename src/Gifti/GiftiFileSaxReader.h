@@ -23,6 +23,8 @@
 /*LICENSE_END*/
 
 #include <stack>
+#include <string>
+#include <vector>
 #include <AString.h>
 #include <stdint.h>
 
@@ -103,6 +105,9 @@ namespace caret {
         // process the array data into numbers
         void processArrayData();
         
+        // decode the data of the pending data arrays
+        void decodePendingArrayData();
+        
         // create a data array
         void createDataArray(const XmlAttributes& attributes);
         
@@ -162,6 +167,28 @@ namespace caret {
         
         /// tracks if data has been read since external binary may not have DATA tag
         bool dataArrayDataHasBeenRead;
+        
+        /// text of the data array's DATA element, kept as 8-bit characters since it is base64, gzip base64, or numbers
+        std::string dataArrayText;
+        
+        /// a data array with the information needed to decode its data
+        struct PendingArrayData {
+            GiftiDataArray* dataArray;
+            std::string text;
+            GiftiEndianEnum::Enum endian;
+            GiftiArrayIndexingOrderEnum::Enum arraySubscriptingOrder;
+            NiftiDataTypeEnum::Enum dataType;
+            std::vector<int64_t> dimensions;
+            GiftiEncodingEnum::Enum encoding;
+            AString externalFileName;
+            int64_t externalFileOffset;
+        };
+        
+        /// data arrays are decoded in parallel, in batches, since each one is independent
+        std::vector<PendingArrayData> pendingArrayData;
+        
+        /// size of the text of the pending data arrays, a batch is decoded when this reaches a limit
+        int64_t pendingArrayTextBytes;
     };
 
 } // namespace
@@ -27,6 +27,8 @@ using namespace caret;
 
 void NiftiIO::openRead(const QString& filename)
 {
+    m_mappedData = NULL;//open() closes any previous file
+    m_mappedSize = 0;
     m_file.open(filename);
     m_header.read(m_file);
     if (m_header.getDataType() == DT_BINARY)
@@ -46,6 +48,16 @@ void NiftiIO::openRead(const QString& filename)
     }
 }
 
+bool NiftiIO::mapForReading()
+{
+    if (m_mappedData != NULL) return true;
+    if (m_header.getDataOffset() % 16 != 0) return false;//nifti recommends vox_offset be a multiple of 16, don't do unaligned element access if it isn't
+    m_mappedData = m_file.mapReadOnly();
+    if (m_mappedData == NULL) return false;
+    m_mappedSize = m_file.size();
+    return true;
+}
+
 void NiftiIO::writeNew(const QString& filename, const NiftiHeader& header, const int& version, const bool& withRead, const bool& swapEndian)
 {
     if (header.getDataType() == DT_BINARY)
@@ -58,6 +70,8 @@ void NiftiIO::writeNew(const QString& filename, const NiftiHeader& header, const
     } else {
         m_file.open(filename, CaretBinaryFile::WRITE_TRUNCATE);
     }
+    m_mappedData = NULL;
+    m_mappedSize = 0;
     m_header = header;
     m_header.write(m_file, version, swapEndian);
     m_dims = m_header.getDimensions();
@@ -65,8 +79,27 @@ void NiftiIO::writeNew(const QString& filename, const NiftiHeader& header, const
 
 void NiftiIO::close()
 {
+    m_mappedData = NULL;//the file unmaps it when it closes
+    m_mappedSize = 0;
     m_file.close();
     m_dims.clear();
+    CaretMutexLocker locked(&m_scratchMutex);
+    m_freeScratch.clear();
+}
+
+void NiftiIO::borrowScratch(vector<char>& scratchOut)
+{
+    CaretMutexLocker locked(&m_scratchMutex);
+    if (m_freeScratch.empty()) return;//caller will allocate, and give it to us afterwards
+    scratchOut.swap(m_freeScratch.back());//swap, so we don't copy or reallocate
+    m_freeScratch.pop_back();
+}
+
+void NiftiIO::returnScratch(vector<char>& scratchIn)
+{
+    CaretMutexLocker locked(&m_scratchMutex);
+    m_freeScratch.push_back(vector<char>());
+    m_freeScratch.back().swap(scratchIn);
 }
 
 int NiftiIO::getNumComponents() const
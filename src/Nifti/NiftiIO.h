@@ -30,8 +30,11 @@
 
 #include <QString>
 
+#include <algorithm>
 #include <cmath>
+#include <exception>
 #include <limits>
+#include <new>
 #include <vector>
 
 namespace caret
@@ -44,15 +47,37 @@ namespace caret
         std::vector<int64_t> m_dims;
         std::vector<char> m_scratch;//scratch memory for byteswapping, type conversion, etc
         CaretMutex m_mutex;//protect multithreaded calls from each other
+        std::vector<std::vector<char> > m_freeScratch;//scratch buffers for positional reads that aren't currently in use, so concurrent reads each get their own
+        CaretMutex m_scratchMutex;//only held while taking or returning a buffer
+        const char* m_mappedData;//entire file, when mapForReading() succeeded
+        int64_t m_mappedSize;
+        static const int64_t PIPELINE_CHUNK_BYTES = 1<<20;//small enough that a single frame is several chunks, so the reading thread rarely waits
+        void borrowScratch(std::vector<char>& scratchOut);
+        void returnScratch(std::vector<char>& scratchIn);
         int numBytesPerElem();//for resizing scratch
+        template<typename T>
+        void convertReadRaw(T* out, char* in, const int64_t& count);//dispatch on file datatype
+        template<typename T>
+        void readElements(T* dataOut, const int64_t& startElem, int64_t numElems, const bool& tolerateShortRead);//startElem counts components, from the start of the data
+        template<typename T>
+        void readPipelined(T* dataOut, const int64_t& numElems, const bool& tolerateShortRead);//overlap file reading (decompression) with conversion, m_mutex must be held
+        template<typename T>
+        void convertReadMapped(T* out, const char* in, const int64_t& count);//dispatch on file datatype, input is read-only
         template<typename TO, typename FROM>
         void convertRead(TO* out, FROM* in, const int64_t& count);//for reading from file
         template<typename TO, typename FROM>
+        void convertReadNoSwap(TO* out, const FROM* in, const int64_t& count);//just the type conversion and scaling
+        template<typename TO, typename FROM>
+        void convertReadConst(TO* out, const FROM* in, const int64_t& count);//swaps copies instead of modifying the input
+        template<typename TO, typename FROM>
         void convertWrite(TO* out, const FROM* in, const int64_t& count);//for writing to file
         template<typename TO, typename FROM>
         static TO clamp(const FROM& in);//deal with integer cast being undefined when converting from outside range
     public:
+        NiftiIO() { m_mappedData = NULL; m_mappedSize = 0; }
         void openRead(const QString& filename);
+        ///after openRead, try to memory map the file so reads convert directly from the mapped pages, returns false (and keeps using normal reads) if it can't
+        bool mapForReading();
         void writeNew(const QString& filename, const NiftiHeader& header, const int& version = 1, const bool& withRead = false, const bool& swapEndian = false);
         QString getFilename() const { return m_file.getFilename(); }
         void overrideDimensions(const std::vector<int64_t>& newDims) { m_dims = newDims; }//HACK: deal with reading/writing CIFTI-1's broken headers
@@ -64,6 +89,9 @@ namespace caret
         //NOTE: you need to provide storage for all components within the range, if getNumComponents() == 3 and fullDims == 0, you need 3 elements allocated
         template<typename T>
         void readData(T* dataOut, const int& fullDims, const std::vector<int64_t>& indexSelect, const bool& tolerateShortRead = false);
+        //read only part of what readData would, rangeStart and rangeCount count components, use fullDims = 5 on cifti for part of a row, or fullDims = 6 for a block of whole rows
+        template<typename T>
+        void readDataRange(T* dataOut, const int& fullDims, const std::vector<int64_t>& indexSelect, const int64_t& rangeStart, const int64_t& rangeCount);
         template<typename T>
         void writeData(const T* dataIn, const int& fullDims, const std::vector<int64_t>& indexSelect);
     };
@@ -86,55 +114,265 @@ namespace caret
             numSkip += indexSelect[curDim - fullDims] * numDimSkip;
             numDimSkip *= m_dims[curDim];
         }
+        readElements(dataOut, numSkip, numElems, tolerateShortRead);
+    }
+    
+    template<typename T>
+    void NiftiIO::readDataRange(T* dataOut, const int& fullDims, const std::vector<int64_t>& indexSelect, const int64_t& rangeStart, const int64_t& rangeCount)
+    {
+        CaretAssert(fullDims >= 0 && fullDims <= (int)m_dims.size());
+        CaretAssert((size_t)fullDims + indexSelect.size() == m_dims.size());
+        int64_t numElems = getNumComponents();
+        int curDim;
+        for (curDim = 0; curDim < fullDims; ++curDim)
+        {
+            numElems *= m_dims[curDim];
+        }
+        CaretAssert(rangeStart >= 0 && rangeCount >= 0 && rangeStart + rangeCount <= numElems);
+        int64_t numDimSkip = numElems, numSkip = 0;
+        for (; curDim < (int)m_dims.size(); ++curDim)
+        {
+            CaretAssert(indexSelect[curDim - fullDims] >= 0 && indexSelect[curDim - fullDims] < m_dims[curDim]);
+            numSkip += indexSelect[curDim - fullDims] * numDimSkip;
+            numDimSkip *= m_dims[curDim];
+        }
+        readElements(dataOut, numSkip + rangeStart, rangeCount, false);
+    }
+    
+    template<typename T>
+    void NiftiIO::readElements(T* dataOut, const int64_t& startElem, int64_t numElems, const bool& tolerateShortRead)
+    {
+        int64_t numBytes = numElems * numBytesPerElem();
+        int64_t readOffset = startElem * numBytesPerElem() + m_header.getDataOffset();
+        if (m_mappedData != NULL)
+        {//no file access or scratch at all, and no locking
+            int64_t numAvailable = m_mappedSize - readOffset;
+            if (numAvailable < numBytes)
+            {
+                if (!tolerateShortRead) throw DataFileException("error while reading from nifti file '" + m_file.getFilename() + "'");
+                numElems = (numAvailable > 0 ? numAvailable / numBytesPerElem() : 0);
+            }
+            convertReadMapped(dataOut, m_mappedData + readOffset, numElems);
+            return;
+        }
+        if (m_file.getSupportsReadAt())
+        {//positional read into a buffer only this call is using, so concurrent readers don't wait on each other
+            std::vector<char> scratch;
+            borrowScratch(scratch);
+            scratch.resize(numBytes);
+            int64_t numRead = 0;
+            m_file.readAt(readOffset, scratch.data(), numBytes, &numRead);
+            if ((numRead != numBytes && !tolerateShortRead) || numRead < 0)
+            {
+                throw DataFileException("error while reading from nifti file '" + m_file.getFilename() + "'");
+            }
+            convertReadRaw(dataOut, scratch.data(), numElems);
+            returnScratch(scratch);
+            return;
+        }
         CaretMutexLocker locked(&m_mutex);//protect starting with resizing until we are done converting, because we use an internal variable for scratch space
+        m_file.seek(readOffset);
+#ifdef CARET_OMP
+        if (numBytes >= 2 * PIPELINE_CHUNK_BYTES && omp_get_max_threads() > 1 && !omp_in_parallel())
+        {//compressed files are cpu-bound in the read, so let other threads convert while it inflates the next chunk
+            readPipelined(dataOut, numElems, tolerateShortRead);
+            return;
+        }
+#endif
         //we can't guarantee that the output memory is enough to use as scratch space, as we might be doing a narrowing conversion
-        //we are doing FILE ACCESS, so cpu performance isn't really something to worry about
-        m_scratch.resize(numElems * numBytesPerElem());
-        m_file.seek(numSkip * numBytesPerElem() + m_header.getDataOffset());
+        m_scratch.resize(numBytes);
         int64_t numRead = 0;
         m_file.read(m_scratch.data(), m_scratch.size(), &numRead);
         if ((numRead != (int64_t)m_scratch.size() && !tolerateShortRead) || numRead < 0)//for now, assume read giving -1 is always a problem
         {
             throw DataFileException("error while reading from nifti file '" + m_file.getFilename() + "'");
         }
+        convertReadRaw(dataOut, m_scratch.data(), numElems);
+    }
+    
+    template<typename T>
+    void NiftiIO::convertReadRaw(T* out, char* in, const int64_t& count)
+    {
         switch (m_header.getDataType())
         {
             case NIFTI_TYPE_UINT8:
             case NIFTI_TYPE_RGB24://handled by components
-                convertRead(dataOut, (uint8_t*)m_scratch.data(), numElems);
+                convertRead(out, (uint8_t*)in, count);
                 break;
             case NIFTI_TYPE_INT8:
-                convertRead(dataOut, (int8_t*)m_scratch.data(), numElems);
+                convertRead(out, (int8_t*)in, count);
                 break;
             case NIFTI_TYPE_UINT16:
-                convertRead(dataOut, (uint16_t*)m_scratch.data(), numElems);
+                convertRead(out, (uint16_t*)in, count);
                 break;
             case NIFTI_TYPE_INT16:
-                convertRead(dataOut, (int16_t*)m_scratch.data(), numElems);
+                convertRead(out, (int16_t*)in, count);
                 break;
             case NIFTI_TYPE_UINT32:
-                convertRead(dataOut, (uint32_t*)m_scratch.data(), numElems);
+                convertRead(out, (uint32_t*)in, count);
                 break;
             case NIFTI_TYPE_INT32:
-                convertRead(dataOut, (int32_t*)m_scratch.data(), numElems);
+                convertRead(out, (int32_t*)in, count);
                 break;
             case NIFTI_TYPE_UINT64:
-                convertRead(dataOut, (uint64_t*)m_scratch.data(), numElems);
+                convertRead(out, (uint64_t*)in, count);
                 break;
             case NIFTI_TYPE_INT64:
-                convertRead(dataOut, (int64_t*)m_scratch.data(), numElems);
+                convertRead(out, (int64_t*)in, count);
                 break;
             case NIFTI_TYPE_FLOAT32:
             case NIFTI_TYPE_COMPLEX64://components
-                convertRead(dataOut, (float*)m_scratch.data(), numElems);
+                convertRead(out, (float*)in, count);
                 break;
             case NIFTI_TYPE_FLOAT64:
             case NIFTI_TYPE_COMPLEX128:
-                convertRead(dataOut, (double*)m_scratch.data(), numElems);
+                convertRead(out, (double*)in, count);
                 break;
             case NIFTI_TYPE_FLOAT128:
             case NIFTI_TYPE_COMPLEX256:
-                convertRead(dataOut, (long double*)m_scratch.data(), numElems);
+                convertRead(out, (long double*)in, count);
+                break;
+            default:
+                CaretAssert(0);
+                throw DataFileException("internal error, tell the developers what you just tried to do");
+        }
+    }
+    
+    template<typename T>
+    void NiftiIO::readPipelined(T* dataOut, const int64_t& numElems, const bool& tolerateShortRead)
+    {
+#ifdef CARET_OMP
+        const int64_t elemBytes = numBytesPerElem();
+        const int64_t chunkElems = std::max(PIPELINE_CHUNK_BYTES / elemBytes, (int64_t)1);
+        const int64_t numChunks = (numElems + chunkElems - 1) / chunkElems;
+        m_scratch.resize(2 * chunkElems * elemBytes);//double buffered: one chunk being read, the other being converted
+        char* buffers[2] = { m_scratch.data(), m_scratch.data() + chunkElems * elemBytes };
+        bool failed = false, outOfMemory = false;//exceptions can't leave the parallel region, keep the first one to rethrow after it
+        AString failMessage;
+        for (int64_t chunk = -1; chunk < numChunks; ++chunk)
+        {//chunk is the one being converted, chunk + 1 the one being read
+#pragma omp CARET_PAR
+            {
+                int myThread = omp_get_thread_num(), numThreads = omp_get_num_threads();
+                if (myThread == 0 && chunk + 1 < numChunks)
+                {
+                    try
+                    {
+                        int64_t readStart = (chunk + 1) * chunkElems;
+                        int64_t readBytes = std::min(chunkElems, numElems - readStart) * elemBytes;
+                        char* readBuffer = buffers[(chunk + 1) % 2];
+                        int64_t numRead = 0;
+                        m_file.read(readBuffer, readBytes, &numRead);
+                        if ((numRead != readBytes && !tolerateShortRead) || numRead < 0)
+                        {
+                            throw DataFileException("error while reading from nifti file '" + m_file.getFilename() + "'");
+                        }
+                        if (numRead < readBytes)
+                        {
+                            std::fill(readBuffer + std::max(numRead, (int64_t)0), readBuffer + readBytes, 0);
+                        }
+                    } catch (CaretException& e) {
+#pragma omp critical (NiftiIOReadPipelined)
+                        {
+                            if (!failed)
+                            {
+                                failed = true;
+                                failMessage = e.whatString();
+                            }
+                        }
+                    } catch (std::bad_alloc&) {
+#pragma omp critical (NiftiIOReadPipelined)
+                        {
+                            if (!failed)
+                            {
+                                failed = true;
+                                outOfMemory = true;
+                            }
+                        }
+                    } catch (std::exception& e) {
+#pragma omp critical (NiftiIOReadPipelined)
+                        {
+                            if (!failed)
+                            {
+                                failed = true;
+                                failMessage = e.what();
+                            }
+                        }
+                    }
+                }
+                if (chunk >= 0 && (myThread != 0 || numThreads == 1))
+                {//the reading thread doesn't take a share of the conversion, unless it is the only thread
+                    int numConverters = std::max(numThreads - 1, 1), myIndex = std::max(myThread - 1, 0);
+                    int64_t chunkStart = chunk * chunkElems;
+                    int64_t chunkCount = std::min(chunkElems, numElems - chunkStart);
+                    int64_t myStart = chunkCount * myIndex / numConverters, myEnd = chunkCount * (myIndex + 1) / numConverters;
+                    if (myEnd > myStart)
+                    {
+                        try
+                        {
+                            convertReadRaw(dataOut + chunkStart + myStart, buffers[chunk % 2] + myStart * elemBytes, myEnd - myStart);
+                        } catch (CaretException& e) {
+#pragma omp critical (NiftiIOReadPipelined)
+                            {
+                                if (!failed)
+                                {
+                                    failed = true;
+                                    failMessage = e.whatString();
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            if (outOfMemory) throw std::bad_alloc();//so that callers report it as out of memory, as they would without the pipeline
+            if (failed) throw DataFileException(failMessage);
+        }
+#else
+        CaretAssertMessage(false, "readPipelined called without openmp");
+#endif
+    }
+    
+    template<typename T>
+    void NiftiIO::convertReadMapped(T* out, const char* in, const int64_t& count)
+    {
+        switch (m_header.getDataType())
+        {
+            case NIFTI_TYPE_UINT8:
+            case NIFTI_TYPE_RGB24://handled by components
+                convertReadConst(out, (const uint8_t*)in, count);
+                break;
+            case NIFTI_TYPE_INT8:
+                convertReadConst(out, (const int8_t*)in, count);
+                break;
+            case NIFTI_TYPE_UINT16:
+                convertReadConst(out, (const uint16_t*)in, count);
+                break;
+            case NIFTI_TYPE_INT16:
+                convertReadConst(out, (const int16_t*)in, count);
+                break;
+            case NIFTI_TYPE_UINT32:
+                convertReadConst(out, (const uint32_t*)in, count);
+                break;
+            case NIFTI_TYPE_INT32:
+                convertReadConst(out, (const int32_t*)in, count);
+                break;
+            case NIFTI_TYPE_UINT64:
+                convertReadConst(out, (const uint64_t*)in, count);
+                break;
+            case NIFTI_TYPE_INT64:
+                convertReadConst(out, (const int64_t*)in, count);
+                break;
+            case NIFTI_TYPE_FLOAT32:
+            case NIFTI_TYPE_COMPLEX64://components
+                convertReadConst(out, (const float*)in, count);
+                break;
+            case NIFTI_TYPE_FLOAT64:
+            case NIFTI_TYPE_COMPLEX128:
+                convertReadConst(out, (const double*)in, count);
+                break;
+            case NIFTI_TYPE_FLOAT128:
+            case NIFTI_TYPE_COMPLEX256:
+                convertReadConst(out, (const long double*)in, count);
                 break;
             default:
                 CaretAssert(0);
@@ -217,6 +455,34 @@ namespace caret
         {
             ByteSwapping::swapArray(in, count);
         }
+        convertReadNoSwap(out, in, count);
+    }
+    
+    template<typename TO, typename FROM>
+    void NiftiIO::convertReadConst(TO* out, const FROM* in, const int64_t& count)
+    {
+        if (m_header.isSwapped())
+        {//can't swap in place, so swap small blocks on the stack
+            const int64_t BLOCK_SIZE = 1024;
+            FROM swapped[BLOCK_SIZE];
+            for (int64_t base = 0; base < count; base += BLOCK_SIZE)
+            {
+                int64_t blockCount = std::min(BLOCK_SIZE, count - base);
+                for (int64_t i = 0; i < blockCount; ++i)
+                {
+                    swapped[i] = in[base + i];
+                }
+                ByteSwapping::swapArray(swapped, blockCount);
+                convertReadNoSwap(out + base, swapped, blockCount);
+            }
+        } else {
+            convertReadNoSwap(out, in, count);
+        }
+    }
+    
+    template<typename TO, typename FROM>
+    void NiftiIO::convertReadNoSwap(TO* out, const FROM* in, const int64_t& count)
+    {
         double mult, offset;
         bool doScale = m_header.getDataScaling(mult, offset);
         if (std::numeric_limits<TO>::is_integer)//do round to nearest when integer output type
@@ -24,15 +24,22 @@
 #include "CaretAssert.h"
 #include "CaretLogger.h"
 #include "CaretMathExpression.h"
+#include "CaretOMP.h"
 #include "CiftiFile.h"
 #include "CiftiXML.h"
 #include "MultiDimIterator.h"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    const int64_t MATH_BLOCK_SIZE = 4096;//elements per batch evaluation, small enough to balance across threads
+}
+
 AString OperationCiftiMath::getCommandSwitch()
 {
     return "-cifti-math";
@@ -235,7 +242,9 @@ void OperationCiftiMath::useParameters(OperationParameters* myParams, ProgressOb
     }
     if (outXML.getNumberOfDimensions() < 1) throw OperationException("output must have at least 1 dimension");
     myCiftiOut->setCiftiXML(outXML);
-    vector<float> values(numVars), scratchRow(outDims[0]);
+    vector<float> scratchRow(outDims[0]);
+    vector<const float*> rowPointers(numVars);
+    vector<int64_t> strides(numVars);
     vector<vector<float> > inputRows(numVars);
     vector<vector<int64_t> > loadedRow(numVars);//to detect and prevent rereading the same row
     for (int v = 0; v < numVars; ++v)
@@ -269,21 +278,34 @@ void OperationCiftiMath::useParameters(OperationParameters* myParams, ProgressOb
                 varCiftiFiles[v]->getRow(inputRows[v].data(), loadedRow[v]);
             }
         }
-        for (int j = 0; j < outDims[0]; ++j)
+        for (int v = 0; v < numVars; ++v)//now we check for select along row
         {
-            for (int v = 0; v < numVars; ++v)//now we check for select along row
+            if (selectInfo[v][0] == -1)
             {
-                if (selectInfo[v][0] == -1)
-                {
-                    values[v] = inputRows[v][j];
-                } else {
-                    values[v] = inputRows[v][selectInfo[v][0]];
-                }
+                rowPointers[v] = inputRows[v].data();
+                strides[v] = 1;
+            } else {
+                rowPointers[v] = inputRows[v].data() + selectInfo[v][0];
+                strides[v] = 0;//same element for the whole row
             }
-            scratchRow[j] = (float)myExpr.evaluate(values);
-            if (nanfix && scratchRow[j] != scratchRow[j])
+        }
+        const int64_t rowLength = outDims[0];
+#pragma omp CARET_PARFOR schedule(dynamic) if (rowLength > MATH_BLOCK_SIZE)
+        for (int64_t start = 0; start < rowLength; start += MATH_BLOCK_SIZE)
+        {
+            int64_t count = min(MATH_BLOCK_SIZE, rowLength - start);
+            vector<const float*> blockInputs(numVars);
+            for (int v = 0; v < numVars; ++v)
+            {
+                blockInputs[v] = rowPointers[v] + start * strides[v];
+            }
+            myExpr.evaluateBatch(blockInputs, strides, count, scratchRow.data() + start);
+            if (nanfix)
             {
-                scratchRow[j] = nanfixval;
+                for (int64_t j = start; j < start + count; ++j)
+                {
+                    if (scratchRow[j] != scratchRow[j]) scratchRow[j] = nanfixval;
+                }
             }
         }
         myCiftiOut->setRow(scratchRow.data(), *iter);
@@ -64,9 +64,12 @@ OperationParameters* OperationConvertMatrix4ToWorkbenchSparse::getParameters()
     volumeOpt->addCiftiParameter(1, "cifti-template", "cifti file to use the volume mappings from");
     volumeOpt->addStringParameter(2, "direction", "dimension along the cifti file to take the mapping from, ROW or COLUMN");
     
+    ret->createOptionalParameter(9, "-version-1", "write the original uncompressed format, for older versions of workbench");
+    
     ret->setHelpText(
         AString("Converts the matrix 4 output of probtrackx to workbench sparse file format.  ") +
-        "Exactly one of -surface-seeds and -volume-seeds must be specified."
+        "Exactly one of -surface-seeds and -volume-seeds must be specified.  " +
+        "By default, the output is written in the compressed version 2 format."
     );
     return ret;
 }
@@ -84,6 +87,8 @@ void OperationConvertMatrix4ToWorkbenchSparse::useParameters(OperationParameters
     const int64_t* sparseDims = inFile.getDimensions();
     OptionalParameter* surfaceOpt = myParams->getOptionalParameter(7);
     OptionalParameter* volumeOpt = myParams->getOptionalParameter(8);
+    int32_t outVersion = 2;
+    if (myParams->getOptionalParameter(9)->m_present) outVersion = 1;
     if (surfaceOpt->m_present == volumeOpt->m_present) throw OperationException("you must specify exactly one of -surface-seeds and -volume-seeds");//use == on booleans as xnor
     const CiftiXML& orientXML = orientationFile->getCiftiXML();
     if (orientXML.getMappingType(CiftiXML::ALONG_COLUMN) != CiftiMappingType::BRAIN_MODELS) throw OperationException("orientation file must have brain models mapping along column");
@@ -180,7 +185,7 @@ void OperationConvertMatrix4ToWorkbenchSparse::useParameters(OperationParameters
             rowReorder[i / 3] = tempInd;
         }
     }
-    CaretSparseFileWriter mywriter(outFileName, myXML);//NOTE: CaretSparseFile has a different encoding of fibers, ALWAYS use getFibersRow, etc
+    CaretSparseFileWriter mywriter(outFileName, myXML, outVersion);//NOTE: CaretSparseFile has a different encoding of fibers, ALWAYS use getFibersRow, etc
     vector<int64_t> indicesIn, indicesOut;//this method knows about sparseness, does sorting of indexes in order to avoid scanning full rows
     vector<FiberFractions> fibersIn, fibersOut;//can be slower if matrix isn't very sparse, but that is a problem for other reasons anyway
     CaretMinHeap<FiberFractions, int64_t> myHeap;//use our heap to do heapsort, rather than coding a struct for stl sort
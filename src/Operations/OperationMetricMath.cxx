@@ -24,13 +24,20 @@
 #include "CaretAssert.h"
 #include "CaretLogger.h"
 #include "CaretMathExpression.h"
+#include "CaretOMP.h"
 #include "MetricFile.h"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    const int MATH_BLOCK_SIZE = 4096;//vertices per batch evaluation, small enough to balance across threads
+}
+
 AString OperationMetricMath::getCommandSwitch()
 {
     return "-metric-math";
@@ -181,8 +188,9 @@ void OperationMetricMath::useParameters(OperationParameters* myParams, ProgressO
     {
         throw OperationException("all -var options used -repeat, there is no file to get number of desired output columns from");
     }
-    vector<float> values(numVars), colScratch(numNodes);
+    vector<float> colScratch(numNodes);
     vector<const float*> columnPointers(numVars);
+    const vector<int64_t> strides(numVars, 1);
     myMetricOut->setNumberOfNodesAndColumns(numNodes, numColumns);
     myMetricOut->setStructure(myStructure);
     for (int j = 0; j < numColumns; ++j)
@@ -197,16 +205,22 @@ void OperationMetricMath::useParameters(OperationParameters* myParams, ProgressO
                 columnPointers[v] = varMetrics[v]->getValuePointerForColumn(metricColumns[v]);
             }
         }
-        for (int i = 0; i < numNodes; ++i)
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int start = 0; start < numNodes; start += MATH_BLOCK_SIZE)
         {
+            int count = min(MATH_BLOCK_SIZE, numNodes - start);
+            vector<const float*> blockInputs(numVars);
             for (int v = 0; v < numVars; ++v)
             {
-                values[v] = columnPointers[v][i];
+                blockInputs[v] = columnPointers[v] + start;
             }
-            colScratch[i] = (float)myExpr.evaluate(values);
-            if (nanfix && colScratch[i] != colScratch[i])
+            myExpr.evaluateBatch(blockInputs, strides, count, colScratch.data() + start);
+            if (nanfix)
             {
-                colScratch[i] = nanfixval;
+                for (int i = start; i < start + count; ++i)
+                {
+                    if (colScratch[i] != colScratch[i]) colScratch[i] = nanfixval;
+                }
             }
         }
         myMetricOut->setValuesForColumn(j, colScratch.data());
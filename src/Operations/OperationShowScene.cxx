@@ -19,8 +19,10 @@
  */
 /*LICENSE_END*/
 
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
+#include <iostream>
 
 #ifdef HAVE_OSMESA
 #include <GL/osmesa.h>
@@ -36,6 +38,7 @@
 #include "CaretAssert.h"
 #include "CaretLogger.h"
 #include "DataFileException.h"
+#include "ElapsedTimer.h"
 #include "EventBrowserTabGet.h"
 #include "EventMapYokingSelectMap.h"
 #include "EventManager.h"
@@ -112,6 +115,9 @@ OperationShowScene::getParameters()
     mapYokeOpt->addStringParameter(1, "Map Yoking Roman Numeral", "Roman numeral identifying the map yoking group (I, II, III, IV, V, VI, VII, VIII, IX, X)");
     mapYokeOpt->addIntegerParameter(2, "Map Index", "Map index for yoking group.  Indices start at 1 (one)");
     
+    OptionalParameter* frameTimingOpt = ret->createOptionalParameter(9, "-frame-timing", "Draw each image repeatedly and print the drawing time of each frame");
+    frameTimingOpt->addIntegerParameter(1, "frame-count", "Number of times to draw each image");
+    
     AString helpText("Render content of browser windows displayed in a scene "
                      "into image file(s).  The image file name should be "
                      "similar to \"capture.png\".  If there is only one image "
@@ -151,6 +157,13 @@ OperationShowScene::getParameters()
                  "      output image.\n"
                  );
     
+    helpText += ("\n"
+                 "The \"-frame-timing\" option is for measuring drawing "
+                 "performance, such as a volume montage.  The first frame "
+                 "includes creation of textures and other items that are "
+                 "reused by the remaining frames.\n"
+                 );
+    
     
     ret->setHelpText(helpText);
     
@@ -207,6 +220,15 @@ OperationShowScene::useParameters(OperationParameters* myParams,
         mapYokingMapIndex--;
     }
     
+    int32_t frameTimingCount = 0;
+    OptionalParameter* frameTimingOpt = myParams->getOptionalParameter(9);
+    if (frameTimingOpt->m_present) {
+        frameTimingCount = frameTimingOpt->getInteger(1);
+        if (frameTimingCount < 1) {
+            throw OperationException("Frame timing count must be one or greater.");
+        }
+    }
+    
     if ( ! useWindowSizeForImageSizeFlag) {
         if ((userImageWidth <= 0)
             || (userImageHeight <= 0)) {
@@ -473,6 +495,14 @@ OperationShowScene::useParameters(OperationParameters* myParams,
                                                                                                      windowViewport,
                                                                                                      tabIndexToHighlight);
                         
+                        if (frameTimingCount > 0) {
+                            timeDrawing(brainOpenGL,
+                                        brain,
+                                        viewports,
+                                        frameTimingCount,
+                                        i);
+                        }
+                        
                         brainOpenGL->drawModels(brain,
                                                 viewports);
                         
@@ -529,6 +559,14 @@ OperationShowScene::useParameters(OperationParameters* myParams,
                     std::vector<BrainOpenGLViewportContent*> viewportContents;
                     viewportContents.push_back(content);
                     
+                    if (frameTimingCount > 0) {
+                        timeDrawing(brainOpenGL,
+                                    brain,
+                                    viewportContents,
+                                    frameTimingCount,
+                                    i);
+                    }
+                    
                     brainOpenGL->drawModels(brain,
                                             viewportContents);
                     
@@ -554,6 +592,68 @@ OperationShowScene::useParameters(OperationParameters* myParams,
     }
 }
 
+/**
+ * Draw the models repeatedly and print the time to draw each frame.
+ *
+ * @param brainOpenGL
+ *     OpenGL drawing.
+ * @param brain
+ *     Brain that is drawn.
+ * @param viewportContents
+ *     Content of the viewports that are drawn.
+ * @param frameCount
+ *     Number of frames to draw.
+ * @param windowIndex
+ *     Index of window, for the printed output.
+ */
+void
+OperationShowScene::timeDrawing(BrainOpenGL* brainOpenGL,
+                                Brain* brain,
+                                std::vector<BrainOpenGLViewportContent*>& viewportContents,
+                                const int32_t frameCount,
+                                const int32_t windowIndex)
+{
+    double totalMilliseconds = 0.0;
+    double minimumMilliseconds = 0.0;
+    double maximumMilliseconds = 0.0;
+    for (int32_t iFrame = 0; iFrame < frameCount; iFrame++) {
+        ElapsedTimer timer;
+        timer.start();
+        brainOpenGL->drawModels(brain,
+                                viewportContents);
+        glFinish();
+        const double milliseconds = timer.getElapsedTimeMilliseconds();
+        
+        std::cout << "Window " << (windowIndex + 1)
+        << " frame " << (iFrame + 1)
+        << ": " << milliseconds << " ms" << std::endl;
+        
+        /*
+         * First frame creates textures, buffers, etc. so it
+         * is not included in the statistics
+         */
+        if (iFrame == 1) {
+            minimumMilliseconds = milliseconds;
+            maximumMilliseconds = milliseconds;
+        }
+        else if (iFrame > 1) {
+            minimumMilliseconds = std::min(minimumMilliseconds, milliseconds);
+            maximumMilliseconds = std::max(maximumMilliseconds, milliseconds);
+        }
+        if (iFrame > 0) {
+            totalMilliseconds += milliseconds;
+        }
+    }
+    
+    if (frameCount > 1) {
+        std::cout << "Window " << (windowIndex + 1)
+        << " excluding first frame, mean: " << (totalMilliseconds / (frameCount - 1))
+        << " ms, min: " << minimumMilliseconds
+        << " ms, max: " << maximumMilliseconds
+        << " ms" << std::endl;
+    }
+}
+
 /**
  * Estimate the size of the graphics region from scenes that lack
  * an explicit entry for the graphics region size.  Scenes in version
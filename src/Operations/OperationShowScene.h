@@ -22,11 +22,16 @@
 /*LICENSE_END*/
 
 
+#include <vector>
+
 #include "AbstractOperation.h"
 
 namespace caret {
 
+    class Brain;
+    class BrainOpenGL;
     class BrainOpenGLFixedPipeline;
+    class BrainOpenGLViewportContent;
     
     class OperationShowScene : public AbstractOperation {
 
@@ -51,6 +56,12 @@ namespace caret {
                                   const int32_t imageWidth,
                                   const int32_t imageHeight);
         
+        static void timeDrawing(BrainOpenGL* brainOpenGL,
+                                Brain* brain,
+                                std::vector<BrainOpenGLViewportContent*>& viewportContents,
+                                const int32_t frameCount,
+                                const int32_t windowIndex);
+        
         static void estimateGraphicsSize(const SceneClass* windowSceneClass,
                                          float& estimatedWidthOut,
                                          float& estimatedHeightOut);
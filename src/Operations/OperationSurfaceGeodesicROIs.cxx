@@ -183,29 +183,34 @@ void OperationSurfaceGeodesicROIs::useParameters(OperationParameters* myParams,
         mygeobase.grabNew(new GeodesicHelperBase(mySurf, corrAreas->getValuePointerForColumn(0)));
         myhelp.grabNew(new GeodesicHelper(mygeobase));
     }
+    vector<int32_t> seeds(nodelist.begin(), nodelist.end());
+    vector<int64_t> rowStarts;
+    vector<int32_t> allROINodes;
+    vector<float> allDists;
+    myhelp->getNodesToGeoDist(seeds, limit, rowStarts, allROINodes, allDists);//does all seeds in parallel
     switch (overlapType)
     {
         case 1://ALLOW
             for (int i = 0; i < (int)nodelist.size(); ++i)
             {
-                vector<int32_t> roinodes;
-                vector<float> dists;
-                myhelp->getNodesToGeoDist(nodelist[i], limit, roinodes, dists);
+                const int32_t* roinodes = allROINodes.data() + rowStarts[i];
+                float* dists = allDists.data() + rowStarts[i];
+                const int rowSize = (int)(rowStarts[i + 1] - rowStarts[i]);
                 if (sigma > 0.0f)
                 {
                     double accum = 0.0;
-                    for (int j = 0; j < (int)dists.size(); ++j)
+                    for (int j = 0; j < rowSize; ++j)
                     {
                         dists[j] = exp(dists[j] * dists[j] * invneg2sigmasqr);//reuse the vector for weights
                         accum += dists[j];
                     }
-                    for (int j = 0; j < (int)dists.size(); ++j)
+                    for (int j = 0; j < rowSize; ++j)
                     {
                         dists[j] /= accum;
                         myMetricOut->setValue(roinodes[j], i, dists[j]);
                     }
                 } else {
-                    for (int j = 0; j < (int)roinodes.size(); ++j)
+                    for (int j = 0; j < rowSize; ++j)
                     {
                         myMetricOut->setValue(roinodes[j], i, 1.0f);
                     }
@@ -220,16 +225,13 @@ void OperationSurfaceGeodesicROIs::useParameters(OperationParameters* myParams,
             vector<float> bestDists(numNodes, -1.0f);
             for (int i = 0; i < (int)nodelist.size(); ++i)
             {
-                vector<int32_t> roinodes;
-                vector<float> dists;
-                myhelp->getNodesToGeoDist(nodelist[i], limit, roinodes, dists);
-                for (int j = 0; j < (int)roinodes.size(); ++j)
+                for (int64_t j = rowStarts[i]; j < rowStarts[i + 1]; ++j)
                 {
-                    ++useCounts[roinodes[j]];
-                    if (bestDists[roinodes[j]] < 0.0f || dists[j] < bestDists[roinodes[j]])
+                    ++useCounts[allROINodes[j]];
+                    if (bestDists[allROINodes[j]] < 0.0f || allDists[j] < bestDists[allROINodes[j]])
                     {
-                        bestDists[roinodes[j]] = dists[j];
-                        closestSeed[roinodes[j]] = i;//nodelist array index, not node number
+                        bestDists[allROINodes[j]] = allDists[j];
+                        closestSeed[allROINodes[j]] = i;//nodelist array index, not node number
                     }
                 }
             }
@@ -0,0 +1,118 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "OperationSurfaceRayIntersect.h"
+#include "OperationException.h"
+
+#include "SignedDistanceHelper.h"
+#include "SurfaceFile.h"
+
+#include <cmath>
+#include <fstream>
+
+using namespace caret;
+using namespace std;
+
+AString OperationSurfaceRayIntersect::getCommandSwitch()
+{
+    return "-surface-ray-intersect";
+}
+
+AString OperationSurfaceRayIntersect::getShortDescription()
+{
+    return "FIND WHERE RAYS FIRST HIT A SURFACE";
+}
+
+OperationParameters* OperationSurfaceRayIntersect::getParameters()
+{
+    OperationParameters* ret = new OperationParameters();
+    ret->addSurfaceParameter(1, "surface", "the surface to use");
+    ret->addStringParameter(2, "ray-list-file", "text file with rays");
+    ret->addStringParameter(3, "hit-list-out", "output - the output text file with the hits");//HACK: we don't currently have an "output text file" parameter type, fake the formatting
+    ret->setHelpText(
+        AString("Each ray is given as a starting XYZ coordinate followed by an XYZ direction, and only hits in front of the starting point are found.  ") +
+        "For each ray, find the first triangle of the surface that it passes through, and output a line containing the triangle number, the vertex of that triangle closest to the hit, " +
+        "the XYZ coordinate of the hit, and the distance from the starting point to the hit.  " +
+        "If the ray does not hit the surface, the line contains only -1.  " +
+        "The input file should only use whitespace to separate numbers (spaces, newlines, tabs), for instance:\n\n" +
+        "0 0 100 0 0 -1\n-80 10 5 1 0 0"
+    );
+    return ret;
+}
+
+void OperationSurfaceRayIntersect::readRayListFile(const AString& rayFileName, vector<float>& raysOut)
+{
+    fstream rayFile(rayFileName.toLocal8Bit().constData(), fstream::in);
+    if (!rayFile.good())
+    {
+        throw OperationException("error opening ray list file for reading");
+    }
+    raysOut.clear();
+    float x;
+    while (rayFile >> x)
+    {
+        raysOut.push_back(x);
+        for (int i = 1; i < 6; ++i)
+        {
+            if (!(rayFile >> x))
+            {
+                throw OperationException("read incomplete ray, would have been ray number " + AString::number(raysOut.size() / 6 + 1));
+            }
+            raysOut.push_back(x);
+        }
+    }
+    if (raysOut.empty())
+    {
+        throw OperationException("did not find any rays in file, make sure you use only whitespace to separate numbers");
+    }
+}
+
+void OperationSurfaceRayIntersect::useParameters(OperationParameters* myParams, ProgressObject* myProgObj)
+{
+    LevelProgress myProgress(myProgObj);
+    SurfaceFile* mySurf = myParams->getSurface(1);
+    vector<float> rays;
+    readRayListFile(myParams->getString(2), rays);
+    AString hitFileName = myParams->getString(3);
+    fstream hitFile(hitFileName.toLocal8Bit().constData(), fstream::out);
+    if (!hitFile.good())
+    {
+        throw OperationException("error opening output file for writing");
+    }
+    CaretPointer<SignedDistanceHelper> myHelper = mySurf->getSignedDistanceHelper();
+    for (int i = 0; i < (int)rays.size(); i += 6)
+    {
+        const float* start = rays.data() + i;
+        const float* direction = rays.data() + i + 3;
+        BarycentricInfo hit;
+        if (myHelper->rayIntersection(start, direction, hit))
+        {
+            int best = 0;
+            for (int j = 1; j < 3; ++j)
+            {
+                if (hit.baryWeights[j] > hit.baryWeights[best]) best = j;
+            }
+            float dirLength = sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+            hitFile << hit.triangle << " " << hit.nodes[best] << " " << hit.point[0] << " " << hit.point[1] << " " << hit.point[2] << " " << hit.absDistance * dirLength << endl;
+        } else {
+            hitFile << -1 << endl;
+        }
+    }
+}
@@ -24,13 +24,20 @@
 #include "CaretAssert.h"
 #include "CaretLogger.h"
 #include "CaretMathExpression.h"
+#include "CaretOMP.h"
 #include "VolumeFile.h"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    const int64_t MATH_BLOCK_SIZE = 4096;//voxels per batch evaluation, small enough to balance across threads
+}
+
 AString OperationVolumeMath::getCommandSwitch()
 {
     return "-volume-math";
@@ -189,8 +196,9 @@ void OperationVolumeMath::useParameters(OperationParameters* myParams, ProgressO
         throw OperationException("all -var options used -repeat, there is no file to get number of desired output subvolumes from");
     }
     int64_t frameSize = outDims[0] * outDims[1] * outDims[2];
-    vector<float> values(numVars), outFrame(frameSize);
+    vector<float> outFrame(frameSize);
     vector<const float*> inputFrames(numVars);
+    const vector<int64_t> strides(numVars, 1);
     myVolOut->reinitialize(outDims, first->getSform());//DO NOT take volume type from first volume, because we don't check for or copy label tables, nor do we want to
     for (int s = 0; s < numSubvols; ++s)
     {
@@ -204,18 +212,23 @@ void OperationVolumeMath::useParameters(OperationParameters* myParams, ProgressO
                 inputFrames[v] = varVolumes[v]->getFrame(varSubvolumes[v]);
             }
         }
-        for (int64_t i = 0; i < frameSize; ++i)
+#pragma omp CARET_PARFOR schedule(dynamic)
+        for (int64_t start = 0; start < frameSize; start += MATH_BLOCK_SIZE)
         {
+            int64_t count = min(MATH_BLOCK_SIZE, frameSize - start);
+            vector<const float*> blockInputs(numVars);
             for (int v = 0; v < numVars; ++v)
             {
-                values[v] = inputFrames[v][i];
+                blockInputs[v] = inputFrames[v] + start;
             }
-            float tempf = (float)myExpr.evaluate(values);
-            if (nanfix && tempf != tempf)
+            myExpr.evaluateBatch(blockInputs, strides, count, outFrame.data() + start);
+            if (nanfix)
             {
-                tempf = nanfixval;
+                for (int64_t i = start; i < start + count; ++i)
+                {
+                    if (outFrame[i] != outFrame[i]) outFrame[i] = nanfixval;
+                }
             }
-            outFrame[i] = tempf;
         }
         myVolOut->setFrame(outFrame.data(), s);
     }
@@ -0,0 +1,106 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "OperationVolumeRayIntersect.h"
+#include "OperationException.h"
+
+#include "OperationSurfaceRayIntersect.h"
+#include "VolumeFile.h"
+
+#include <cmath>
+#include <fstream>
+
+using namespace caret;
+using namespace std;
+
+AString OperationVolumeRayIntersect::getCommandSwitch()
+{
+    return "-volume-ray-intersect";
+}
+
+AString OperationVolumeRayIntersect::getShortDescription()
+{
+    return "FIND WHERE RAYS FIRST HIT NONZERO VOXELS";
+}
+
+OperationParameters* OperationVolumeRayIntersect::getParameters()
+{
+    OperationParameters* ret = new OperationParameters();
+    ret->addVolumeParameter(1, "volume", "the volume to use");
+    ret->addStringParameter(2, "ray-list-file", "text file with rays");
+    ret->addStringParameter(3, "hit-list-out", "output - the output text file with the hits");//HACK: we don't currently have an "output text file" parameter type, fake the formatting
+    OptionalParameter* threshOpt = ret->createOptionalParameter(4, "-threshold", "find voxels with a larger absolute value than zero");
+    threshOpt->addDoubleParameter(1, "value", "voxels with absolute value greater than this are hits");
+    OptionalParameter* subvolOpt = ret->createOptionalParameter(5, "-subvolume", "use a subvolume other than the first");
+    subvolOpt->addStringParameter(1, "subvolume", "the subvolume number or name");
+    ret->setHelpText(
+        AString("Each ray is given as a starting XYZ coordinate followed by an XYZ direction, and only hits in front of the starting point are found.  ") +
+        "For each ray, step through the voxels it passes through until one has an absolute value larger than the threshold (default 0), and output a line containing " +
+        "the IJK indices of that voxel, and the distance from the starting point to where the ray enters the voxel.  " +
+        "If no voxel along the ray qualifies, the line contains only -1.  " +
+        "The input file should only use whitespace to separate numbers (spaces, newlines, tabs), for instance:\n\n" +
+        "0 0 100 0 0 -1\n-80 10 5 1 0 0"
+    );
+    return ret;
+}
+
+void OperationVolumeRayIntersect::useParameters(OperationParameters* myParams, ProgressObject* myProgObj)
+{
+    LevelProgress myProgress(myProgObj);
+    VolumeFile* myVol = myParams->getVolume(1);
+    vector<float> rays;
+    OperationSurfaceRayIntersect::readRayListFile(myParams->getString(2), rays);
+    AString hitFileName = myParams->getString(3);
+    fstream hitFile(hitFileName.toLocal8Bit().constData(), fstream::out);
+    if (!hitFile.good())
+    {
+        throw OperationException("error opening output file for writing");
+    }
+    float threshold = 0.0f;
+    OptionalParameter* threshOpt = myParams->getOptionalParameter(4);
+    if (threshOpt->m_present)
+    {
+        threshold = (float)threshOpt->getDouble(1);
+    }
+    int64_t subvol = 0;
+    OptionalParameter* subvolOpt = myParams->getOptionalParameter(5);
+    if (subvolOpt->m_present)
+    {
+        subvol = myVol->getMapIndexFromNameOrNumber(subvolOpt->getString(1));
+        if (subvol < 0)
+        {
+            throw OperationException("invalid subvolume specified");
+        }
+    }
+    for (int i = 0; i < (int)rays.size(); i += 6)
+    {
+        const float* start = rays.data() + i;
+        const float* direction = rays.data() + i + 3;
+        int64_t ijk[3];
+        float distance;
+        if (myVol->rayIntersectVoxel(start, direction, threshold, ijk, &distance, subvol))
+        {
+            float dirLength = sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+            hitFile << ijk[0] << " " << ijk[1] << " " << ijk[2] << " " << distance * dirLength << endl;
+        } else {
+            hitFile << -1 << endl;
+        }
+    }
+}
@@ -66,6 +66,8 @@ namespace caret {
         virtual AString getCommandSwitch() = 0;
         virtual AString getShortDescription() = 0;
         virtual bool takesParameters() = 0;
+        ///new interface object for the same operation, so that more than one parser can use it at once
+        virtual AutoOperationInterface* clone() = 0;
         virtual ~AutoOperationInterface();
     };
 
@@ -80,6 +82,7 @@ namespace caret {
         AString getCommandSwitch() { return T::getCommandSwitch(); }
         AString getShortDescription() { return T::getShortDescription(); }
         bool takesParameters() { return T::takesParameters(); }
+        AutoOperationInterface* clone() { return new TemplateAutoOperation<T>(); }
     };
 
     ///interface class for parsers to inherit from
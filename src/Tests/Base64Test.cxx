@@ -0,0 +1,94 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "Base64Test.h"
+#include "Base64.h"
+#include "Base64ZLibStream.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+Base64Test::Base64Test(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void Base64Test::execute()
+{
+    const int64_t sizes[] = { 1, 2, 3, 4, 100, 65535, 65536, 65537, 1000003 };
+    const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+    for (int s = 0; s < numSizes; ++s)
+    {
+        const int64_t size = sizes[s];
+        vector<unsigned char> data(size);
+        for (int64_t i = 0; i < size; ++i)
+        {
+            data[i] = (i % 5 == 0) ? (unsigned char)(rand() & 0xFF) : (unsigned char)(i & 0x0F);//partly compressible
+        }
+        vector<unsigned char> reference((size / 3 + 1) * 4);
+        uint64_t referenceLength = Base64::encode(data.data(), size, reference.data());
+        for (int compress = 0; compress < 2; ++compress)
+        {
+            ostringstream encodedStream;
+            if (!Base64ZLibStream::encode(data.data(), size, compress != 0, encodedStream))
+            {
+                setFailed("encode reported failure for size " + AString::number(size));
+                continue;
+            }
+            string encoded = encodedStream.str();
+            if (compress == 0 && (encoded.size() != referenceLength || memcmp(encoded.data(), reference.data(), referenceLength) != 0))
+            {
+                setFailed("streamed base64 differs from Base64::encode for size " + AString::number(size));
+            }
+            string wrapped;//other writers may put whitespace in the data
+            for (size_t i = 0; i < encoded.size(); ++i)
+            {
+                if (i % 76 == 0) wrapped += "\n    ";
+                wrapped += encoded[i];
+            }
+            wrapped += "\n";
+            vector<unsigned char> decoded(size + 1, 0xAB);
+            uint64_t decodedLength = Base64ZLibStream::decode(wrapped.data(), wrapped.size(), compress != 0, decoded.data(), size);
+            if (decodedLength != (uint64_t)size || memcmp(decoded.data(), data.data(), size) != 0)
+            {
+                setFailed("round trip failed for size " + AString::number(size) + ", compressed " + AString::number(compress));
+            }
+            if (decoded[size] != 0xAB)
+            {
+                setFailed("decode wrote past the end of the output for size " + AString::number(size));
+            }
+            if (compress != 0 && size > 1)
+            {
+                if (Base64ZLibStream::decode(encoded.data(), encoded.size(), true, decoded.data(), size - 1) != 0)
+                {
+                    setFailed("compressed data larger than the output was not rejected for size " + AString::number(size));
+                }
+                if (Base64ZLibStream::decode(encoded.data(), encoded.size() / 2, true, decoded.data(), size) != 0)
+                {
+                    setFailed("truncated compressed data was not rejected for size " + AString::number(size));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,279 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "BlockCompressedFileTest.h"
+
+#include "CaretBinaryFile.h"
+#include "DataFileException.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <QDir>
+#include <QFile>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const int64_t BLOCK_DATA = 0xff00;//uncompressed bytes per block that the writer uses
+    
+    class SimpleRandom
+    {
+        uint32_t m_state;
+    public:
+        SimpleRandom(const uint32_t& seed) { m_state = seed; }
+        uint32_t next()
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return m_state >> 8;
+        }
+    };
+    
+    vector<char> makeData(const uint32_t& seed, const int64_t& count)
+    {//few distinct values, so it compresses somewhat, like real data
+        SimpleRandom myRandom(seed);
+        vector<char> ret(count);
+        for (int64_t i = 0; i < count; ++i)
+        {
+            ret[i] = (char)(myRandom.next() % 16 + (i / 1000) % 64);
+        }
+        return ret;
+    }
+    
+    void writeFile(const AString& fileName, const vector<char>& data, const bool& blockCompressed)
+    {
+        bool oldSetting = CaretBinaryFile::getWriteBlockCompressed();
+        CaretBinaryFile::setWriteBlockCompressed(blockCompressed);
+        try
+        {
+            CaretBinaryFile outFile(fileName, CaretBinaryFile::WRITE_TRUNCATE);
+            int64_t firstPart = min((int64_t)data.size(), (int64_t)1000);//uneven writes, so blocks don't line up with them
+            outFile.write(data.data(), firstPart);
+            outFile.write(data.data() + firstPart, (int64_t)data.size() - firstPart);
+            outFile.close();
+        } catch (...) {
+            CaretBinaryFile::setWriteBlockCompressed(oldSetting);
+            throw;
+        }
+        CaretBinaryFile::setWriteBlockCompressed(oldSetting);
+    }
+    
+    bool sameBytes(const vector<char>& expected, const int64_t& position, const vector<char>& actual, const int64_t& count)
+    {
+        return equal(actual.begin(), actual.begin() + count, expected.begin() + position);
+    }
+    
+    void removeFiles(const AString& fileName)
+    {
+        QFile::remove(fileName);
+        QFile::remove(fileName + ".gzi");
+    }
+}
+
+BlockCompressedFileTest::BlockCompressedFileTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void BlockCompressedFileTest::testBlockBoundaries(const AString& fileName)
+{
+    const int64_t numBytes = BLOCK_DATA * 3 + 1234;
+    vector<char> data = makeData(1, numBytes);
+    writeFile(fileName, data, true);
+    CaretBinaryFile inFile(fileName);
+    if (!inFile.getSupportsReadAt())
+    {
+        setFailed("block compressed file doesn't support positional reads");
+        return;
+    }
+    if (inFile.size() != numBytes)
+    {
+        setFailed("block compressed file has size " + AString::number(inFile.size()) + ", expected " + AString::number(numBytes));
+        return;
+    }
+    const int64_t ranges[][2] = { { BLOCK_DATA - 1, 2 }, { BLOCK_DATA - 10, 20 }, { BLOCK_DATA, BLOCK_DATA }, { BLOCK_DATA - 5, BLOCK_DATA + 10 },
+                                  { 2 * BLOCK_DATA - 1, 1 }, { 2 * BLOCK_DATA, numBytes - 2 * BLOCK_DATA }, { 0, numBytes }, { numBytes - 3, 3 } };
+    const int numRanges = sizeof(ranges) / sizeof(ranges[0]);
+    vector<char> buffer(numBytes);
+    for (int i = 0; i < numRanges; ++i)
+    {
+        inFile.readAt(ranges[i][0], buffer.data(), ranges[i][1]);
+        if (!sameBytes(data, ranges[i][0], buffer, ranges[i][1]))
+        {
+            setFailed("positional read of " + AString::number(ranges[i][1]) + " bytes at " + AString::number(ranges[i][0]) + " returned wrong data");
+        }
+    }
+    int64_t numRead = -1;
+    inFile.readAt(numBytes - 5, buffer.data(), 10, &numRead);
+    if (numRead != 5 || !sameBytes(data, numBytes - 5, buffer, 5))
+    {
+        setFailed("positional read past the end returned " + AString::number(numRead) + " bytes, or wrong data");
+    }
+    inFile.readAt(numBytes, buffer.data(), 4, &numRead);
+    if (numRead != 0)
+    {
+        setFailed("positional read at the end returned " + AString::number(numRead) + " bytes");
+    }
+    bool threw = false;
+    try
+    {
+        inFile.readAt(numBytes - 5, buffer.data(), 10);
+    } catch (DataFileException&) {
+        threw = true;
+    }
+    if (!threw)
+    {
+        setFailed("positional read past the end without numRead didn't throw");
+    }
+    //seek and read go through the single block cache when they stay in one block
+    inFile.seek(BLOCK_DATA - 3);
+    inFile.read(buffer.data(), 6);
+    if (!sameBytes(data, BLOCK_DATA - 3, buffer, 6)) setFailed("read across the first block boundary returned wrong data");
+    inFile.read(buffer.data(), BLOCK_DATA);
+    if (!sameBytes(data, BLOCK_DATA + 3, buffer, BLOCK_DATA)) setFailed("read continuing across the second block boundary returned wrong data");
+    if (inFile.pos() != 2 * BLOCK_DATA + 3) setFailed("position after reads is " + AString::number(inFile.pos()));
+    inFile.seek(10);
+    inFile.read(buffer.data(), 1);
+    if (buffer[0] != data[10]) setFailed("read after seeking backwards returned wrong data");
+    inFile.seek(2 * BLOCK_DATA);
+    inFile.read(buffer.data(), 1);
+    if (buffer[0] != data[2 * BLOCK_DATA]) setFailed("read after seeking to a block start returned wrong data");
+    inFile.seek(numBytes - 2);
+    inFile.read(buffer.data(), 10, &numRead);
+    if (numRead != 2 || !sameBytes(data, numBytes - 2, buffer, 2)) setFailed("read past the end returned " + AString::number(numRead) + " bytes, or wrong data");
+    inFile.close();
+    //same without the index file, which scans the block headers instead
+    QFile::remove(fileName + ".gzi");
+    inFile.open(fileName);
+    inFile.readAt(BLOCK_DATA - 5, buffer.data(), BLOCK_DATA + 10);
+    if (inFile.size() != numBytes || !sameBytes(data, BLOCK_DATA - 5, buffer, BLOCK_DATA + 10))
+    {
+        setFailed("block compressed file without an index file read incorrectly");
+    }
+}
+
+void BlockCompressedFileTest::testStaleIndex(const AString& fileName)
+{//the index of a different file, but newer than the data, as happens when the data is replaced within the timestamp resolution
+    const int64_t numBytes = BLOCK_DATA * 3 + 77;
+    vector<char> data = makeData(2, numBytes);
+    const AString staleIndexName = fileName + ".stale.gzi";
+    QFile::remove(staleIndexName);
+    //a shorter file with the same start is the hard case, the stale index points at real block headers, but would cut off the data
+    writeFile(fileName, vector<char>(data.begin(), data.begin() + BLOCK_DATA * 2 + 500), true);
+    QFile::copy(fileName + ".gzi", staleIndexName);
+    writeFile(fileName, data, true);
+    QFile::remove(fileName + ".gzi");
+    QFile::copy(staleIndexName, fileName + ".gzi");
+    QFile::remove(staleIndexName);
+    CaretBinaryFile inFile(fileName);
+    vector<char> buffer(numBytes);
+    int64_t numRead = -1;
+    inFile.readAt(0, buffer.data(), numBytes, &numRead);
+    if (inFile.size() != numBytes || numRead != numBytes || !sameBytes(data, 0, buffer, numBytes))
+    {
+        setFailed("block compressed file with a stale index file read incorrectly");
+    }
+    inFile.close();
+    //an index file that is the wrong length for its entry count
+    QFile indexFile(fileName + ".gzi");
+    indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    indexFile.write("\x02\0\0\0\0\0\0\0\x01", 9);
+    indexFile.close();
+    inFile.open(fileName);
+    inFile.readAt(BLOCK_DATA - 1, buffer.data(), 2);
+    if (inFile.size() != numBytes || !sameBytes(data, BLOCK_DATA - 1, buffer, 2))
+    {
+        setFailed("block compressed file with a truncated index file read incorrectly");
+    }
+}
+
+void BlockCompressedFileTest::testPlainGzip(const AString& fileName)
+{//a single gzip stream is not seekable by blocks, and has to be read sequentially
+    const int64_t numBytes = BLOCK_DATA * 2 + 4321;
+    vector<char> data = makeData(4, numBytes);
+    writeFile(fileName, data, false);
+    CaretBinaryFile inFile(fileName);
+    if (inFile.getSupportsReadAt())
+    {
+        setFailed("plain gzip file claims to support positional reads");
+    }
+    vector<char> buffer(numBytes);
+    inFile.read(buffer.data(), numBytes);
+    if (!sameBytes(data, 0, buffer, numBytes)) setFailed("plain gzip file read incorrectly");
+    inFile.seek(BLOCK_DATA - 7);
+    inFile.read(buffer.data(), 100);
+    if (!sameBytes(data, BLOCK_DATA - 7, buffer, 100)) setFailed("plain gzip file read incorrectly after seeking");
+    int64_t numRead = -1;
+    inFile.seek(numBytes - 3);
+    inFile.read(buffer.data(), 10, &numRead);
+    if (numRead != 3 || !sameBytes(data, numBytes - 3, buffer, 3)) setFailed("plain gzip read past the end returned " + AString::number(numRead) + " bytes, or wrong data");
+}
+
+void BlockCompressedFileTest::testEmptyFile(const AString& fileName)
+{
+    writeFile(fileName, vector<char>(), true);
+    for (int pass = 0; pass < 2; ++pass)//with and without the index file
+    {
+        if (pass == 1) QFile::remove(fileName + ".gzi");
+        CaretBinaryFile inFile(fileName);
+        char buffer[4];
+        int64_t numRead = -1;
+        inFile.readAt(0, buffer, 4, &numRead);
+        if (inFile.size() != 0 || numRead != 0)
+        {
+            setFailed("empty block compressed file has size " + AString::number(inFile.size()) + " and read " + AString::number(numRead) + " bytes");
+        }
+        inFile.read(buffer, 1, &numRead);
+        if (numRead != 0) setFailed("read from empty block compressed file returned " + AString::number(numRead) + " bytes");
+        bool threw = false;
+        try
+        {
+            inFile.read(buffer, 1);
+        } catch (DataFileException&) {
+            threw = true;
+        }
+        if (!threw) setFailed("read from empty block compressed file without numRead didn't throw");
+    }
+    writeFile(fileName, vector<char>(), false);
+    CaretBinaryFile inFile(fileName);
+    char buffer[4];
+    int64_t numRead = -1;
+    inFile.read(buffer, 4, &numRead);
+    if (numRead != 0) setFailed("read from empty plain gzip file returned " + AString::number(numRead) + " bytes");
+}
+
+void BlockCompressedFileTest::execute()
+{
+    const AString fileName = QDir::tempPath() + "/wb_blockcompressedfile_test.bin.gz";
+    try
+    {
+        testBlockBoundaries(fileName);
+        removeFiles(fileName);
+        testStaleIndex(fileName);
+        removeFiles(fileName);
+        testPlainGzip(fileName);
+        removeFiles(fileName);
+        testEmptyFile(fileName);
+    } catch (CaretException& e) {
+        setFailed("caught exception: " + e.whatString());
+    }
+    removeFiles(fileName);
+}
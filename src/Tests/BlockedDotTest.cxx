@@ -0,0 +1,93 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+#include "BlockedDotTest.h"
+
+#include "BlockedDot.h"
+#include "ElapsedTimer.h"
+#include "dot_wrapper.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+BlockedDotTest::BlockedDotTest(const AString& identifier, const bool& benchmark) : TestInterface(identifier)
+{
+    m_benchmark = benchmark;
+}
+
+void BlockedDotTest::execute()
+{
+    const int NUM_ROWS = 1003;//not a multiple of the tile size, to test the edge handling
+    const int ROW_LENGTH = 1201;//ditto for the column spans
+    vector<float> data(NUM_ROWS * ROW_LENGTH);
+    vector<const float*> rowPtrs(NUM_ROWS);
+    vector<double> rowNorms(NUM_ROWS);
+    for (int i = 0; i < NUM_ROWS; ++i)
+    {
+        double accum = 0.0;
+        for (int j = 0; j < ROW_LENGTH; ++j)
+        {
+            float val = ((float)rand()) / RAND_MAX - 0.5f;//roughly mean-centered, like rows in correlation
+            data[i * ROW_LENGTH + j] = val;
+            accum += val * val;
+        }
+        rowPtrs[i] = data.data() + i * ROW_LENGTH;
+        rowNorms[i] = sqrt(accum);
+    }
+    vector<double> pairwise(NUM_ROWS * NUM_ROWS), blocked(NUM_ROWS * NUM_ROWS);
+    dot_set_impl(DOT_AUTO);
+    ElapsedTimer myTimer;
+    myTimer.start();
+    for (int i = 0; i < NUM_ROWS; ++i)
+    {
+        for (int j = 0; j < NUM_ROWS; ++j)
+        {
+            pairwise[i * NUM_ROWS + j] = sddot(rowPtrs[i], rowPtrs[j], ROW_LENGTH);
+        }
+    }
+    double pairwiseTime = myTimer.getElapsedTimeSeconds();
+    myTimer.reset();
+    myTimer.start();
+    BlockedDot::multiplyTransposed(rowPtrs.data(), NUM_ROWS, rowPtrs.data(), NUM_ROWS, ROW_LENGTH, blocked.data(), NUM_ROWS);
+    double blockedTime = myTimer.getElapsedTimeSeconds();
+    const float TOLER = 0.00001f;//relative to the product of the norms, which is what correlation divides by
+    for (int i = 0; i < NUM_ROWS; ++i)
+    {
+        for (int j = 0; j < NUM_ROWS; ++j)
+        {
+            double diff = pairwise[i * NUM_ROWS + j] - blocked[i * NUM_ROWS + j];
+            if (!(abs(diff) < TOLER * rowNorms[i] * rowNorms[j]))//use "not less than" in order to catch NaNs
+            {
+                setFailed("blocked dot product of rows " + AString::number(i) + " and " + AString::number(j) + " got " +
+                          AString::number(blocked[i * NUM_ROWS + j]) + ", expected " + AString::number(pairwise[i * NUM_ROWS + j]));
+                return;
+            }
+        }
+    }
+    double flops = 2.0 * NUM_ROWS * NUM_ROWS * ROW_LENGTH;
+    if (m_benchmark && pairwiseTime > 0.0 && blockedTime > 0.0)
+    {
+        cout << "pairwise sddot: " << flops / pairwiseTime / 1e9 << " GFLOP/s, blocked: " << flops / blockedTime / 1e9 << " GFLOP/s" << endl;
+    }
+}
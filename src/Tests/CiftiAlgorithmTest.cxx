@@ -0,0 +1,658 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CiftiAlgorithmTest.h"
+#include "AlgorithmCiftiAverageDenseROI.h"
+#include "AlgorithmCiftiMergeDense.h"
+#include "AlgorithmCiftiParcellate.h"
+#include "AlgorithmCiftiReduce.h"
+#include "AlgorithmCiftiResample.h"
+#include "AlgorithmCiftiSmoothing.h"
+#include "AlgorithmCiftiTranspose.h"
+#include "CaretException.h"
+#include "CiftiFile.h"
+#include "FloatMatrix.h"
+#include "MetricFile.h"
+#include "ReductionOperation.h"
+#include "SurfaceFile.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    ///5 left vertices, 4 right vertices, then 3 voxels, so that only the first structure has cifti index equal to position in the structure
+    CiftiBrainModelsMap makeTestDenseMap(const bool& withLeft = true, const bool& withRest = true)
+    {
+        CiftiBrainModelsMap ret;
+        if (withLeft)
+        {
+            ret.addSurfaceModel(5, StructureEnum::CORTEX_LEFT);
+        }
+        if (withRest)
+        {
+            ret.addSurfaceModel(4, StructureEnum::CORTEX_RIGHT);
+            const int64_t dims[3] = { 4, 4, 4 };
+            const float sform[12] = { 2.0f, 0.0f, 0.0f, -4.0f,
+                                      0.0f, 2.0f, 0.0f, -4.0f,
+                                      0.0f, 0.0f, 2.0f, -4.0f };
+            ret.setVolumeSpace(VolumeSpace(dims, sform));
+            const int64_t voxels[9] = { 1, 1, 1,  2, 1, 1,  2, 2, 1 };
+            ret.addVolumeModel(StructureEnum::THALAMUS_LEFT, vector<int64_t>(voxels, voxels + 9));
+        }
+        return ret;
+    }
+    
+    ///brain models along denseDirection, scalars along the other, filled with testValue if fill is true
+    void makeTestDenseFile(CiftiFile& fileOut, const int64_t& numMaps, const int& denseDirection = CiftiXML::ALONG_COLUMN,
+                           const CiftiBrainModelsMap& denseMap = makeTestDenseMap(), const bool& fill = false);
+    
+    float testValue(const int64_t& row, const int64_t& column)
+    {//not symmetric, and not exactly representable in sums
+        return ((row * 37 + column * 11) % 101) * 0.37f - 10.0f;
+    }
+    
+    void makeTestDenseFile(CiftiFile& fileOut, const int64_t& numMaps, const int& denseDirection, const CiftiBrainModelsMap& denseMap, const bool& fill)
+    {
+        CiftiXML myXML;
+        myXML.setNumberOfDimensions(2);
+        myXML.setMap(denseDirection, denseMap);
+        CiftiScalarsMap myScalars;
+        myScalars.setLength(numMaps);
+        myXML.setMap(1 - denseDirection, myScalars);
+        fileOut.setCiftiXML(myXML);
+        if (!fill) return;
+        vector<float> row(fileOut.getNumberOfColumns());
+        for (int64_t i = 0; i < fileOut.getNumberOfRows(); ++i)
+        {
+            for (int64_t j = 0; j < (int64_t)row.size(); ++j)
+            {
+                row[j] = testValue(i, j);
+            }
+            fileOut.setRow(row.data(), i);
+        }
+    }
+    
+    vector<vector<float> > getAllRows(const CiftiFile& myFile)
+    {
+        vector<vector<float> > ret(myFile.getNumberOfRows(), vector<float>(myFile.getNumberOfColumns()));
+        for (int64_t i = 0; i < (int64_t)ret.size(); ++i)
+        {
+            myFile.getRow(ret[i].data(), i);
+        }
+        return ret;
+    }
+    
+    ///exact comparison, the algorithms must do the same float operations in the same order as the reference
+    bool compareRows(TestInterface& myTest, const AString& what, const CiftiFile& myFile, const vector<vector<float> >& expected)
+    {
+        if (myFile.getNumberOfRows() != (int64_t)expected.size() || (expected.size() > 0 && myFile.getNumberOfColumns() != (int64_t)expected[0].size()))
+        {
+            myTest.setFailed(what + " output has the wrong dimensions");
+            return false;
+        }
+        vector<vector<float> > actual = getAllRows(myFile);
+        for (int64_t i = 0; i < (int64_t)expected.size(); ++i)
+        {
+            for (int64_t j = 0; j < (int64_t)expected[i].size(); ++j)
+            {
+                if (actual[i][j] != expected[i][j])
+                {
+                    myTest.setFailed(what + " output at row " + AString::number(i) + ", column " + AString::number(j) + " is " +
+                                     AString::number(actual[i][j]) + ", expected " + AString::number(expected[i][j]));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    ///for when the reference does the same operations, but not necessarily in the same order
+    bool compareRowsClose(TestInterface& myTest, const AString& what, const CiftiFile& myFile, const vector<vector<float> >& expected)
+    {
+        if (myFile.getNumberOfRows() != (int64_t)expected.size() || (expected.size() > 0 && myFile.getNumberOfColumns() != (int64_t)expected[0].size()))
+        {
+            myTest.setFailed(what + " output has the wrong dimensions");
+            return false;
+        }
+        float maxAbs = 0.0f;
+        for (int64_t i = 0; i < (int64_t)expected.size(); ++i)
+        {
+            for (int64_t j = 0; j < (int64_t)expected[i].size(); ++j)
+            {
+                maxAbs = max(maxAbs, abs(expected[i][j]));
+            }
+        }
+        vector<vector<float> > actual = getAllRows(myFile);
+        for (int64_t i = 0; i < (int64_t)expected.size(); ++i)
+        {
+            for (int64_t j = 0; j < (int64_t)expected[i].size(); ++j)
+            {
+                if (!(abs(actual[i][j] - expected[i][j]) <= 1e-5f * maxAbs))
+                {
+                    myTest.setFailed(what + " output at row " + AString::number(i) + ", column " + AString::number(j) + " is " +
+                                     AString::number(actual[i][j]) + ", expected " + AString::number(expected[i][j]));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    
+    ///octahedron, all vertices at the same radius, so it also works as a sphere, rotated by the given angles around z and then x
+    void makeOctahedron(SurfaceFile& surfOut, const float& radius, const float& zAngle = 0.0f, const float& xAngle = 0.0f)
+    {
+        surfOut.setNumberOfNodesAndTriangles(6, 8);
+        surfOut.setStructure(StructureEnum::CORTEX_LEFT);
+        const float coords[18] = { 1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  0.0f, -1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f, -1.0f };
+        for (int i = 0; i < 6; ++i)
+        {
+            const float* c = coords + i * 3;
+            float x = c[0] * cos(zAngle) - c[1] * sin(zAngle), y = c[0] * sin(zAngle) + c[1] * cos(zAngle);
+            float y2 = y * cos(xAngle) - c[2] * sin(xAngle), z = y * sin(xAngle) + c[2] * cos(xAngle);
+            surfOut.setCoordinate(i, radius * x, radius * y2, radius * z);
+        }
+        int tri = 0;
+        for (int sx = 0; sx < 2; ++sx)
+        {
+            for (int sy = 0; sy < 2; ++sy)
+            {
+                for (int sz = 0; sz < 2; ++sz)
+                {//vertex 2 * axis + sign is the one on that axis, flip the winding in odd octants so all face outward
+                    if ((sx + sy + sz) % 2 == 0)
+                    {
+                        surfOut.setTriangle(tri++, sx, 2 + sy, 4 + sz);
+                    } else {
+                        surfOut.setTriangle(tri++, sx, 4 + sz, 2 + sy);
+                    }
+                }
+            }
+        }
+    }
+    
+    ///6 left vertices (the octahedron) and 10 voxels, in a volume big enough that smoothing and cubic interpolation have neighbors
+    CiftiBrainModelsMap makeChunkTestDenseMap()
+    {
+        CiftiBrainModelsMap ret;
+        ret.addSurfaceModel(6, StructureEnum::CORTEX_LEFT);
+        const int64_t dims[3] = { 5, 5, 5 };
+        const float sform[12] = { 2.0f, 0.0f, 0.0f, -4.0f,
+                                  0.0f, 2.0f, 0.0f, -4.0f,
+                                  0.0f, 0.0f, 2.0f, -4.0f };
+        ret.setVolumeSpace(VolumeSpace(dims, sform));
+        const int64_t voxels[30] = { 1, 1, 1,  2, 1, 1,  3, 1, 1,  1, 2, 1,  2, 2, 1,  3, 2, 2,  2, 3, 2,  2, 2, 2,  1, 2, 3,  2, 2, 3 };
+        ret.addVolumeModel(StructureEnum::THALAMUS_LEFT, vector<int64_t>(voxels, voxels + 30));
+        return ret;
+    }
+}
+
+CiftiAverageDenseROITest::CiftiAverageDenseROITest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CiftiAverageDenseROITest::execute()
+{
+    try
+    {
+        CiftiFile myData, myROI, myOutput;
+        makeTestDenseFile(myData, 3);
+        makeTestDenseFile(myROI, 2);
+        const int64_t numRows = myData.getNumberOfRows();
+        vector<float> row(3), roiRow(2);
+        for (int64_t i = 0; i < numRows; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                row[j] = 100 * i + j + 1;
+            }
+            myData.setRow(row.data(), i);
+            roiRow[0] = (i == 6 ? 1.0f : 0.0f);//right vertex 1
+            roiRow[1] = (i == 10 ? 2.0f : (i == 1 ? 1.0f : 0.0f));//second voxel and left vertex 1
+            myROI.setRow(roiRow.data(), i);
+        }
+        vector<const CiftiFile*> dataList(1, &myData);
+        AlgorithmCiftiAverageDenseROI(NULL, dataList, &myOutput, &myROI);
+        if (myOutput.getNumberOfRows() != 3 || myOutput.getNumberOfColumns() != 2)
+        {
+            setFailed("output has the wrong dimensions");
+            return;
+        }
+        vector<float> outRow(2);
+        for (int j = 0; j < 3; ++j)
+        {
+            myOutput.getRow(outRow.data(), j);
+            const float expect0 = 601 + j, expect1 = (2 * (1001 + j) + (101 + j)) / 3.0f;//both are exact
+            if (outRow[0] != expect0) setFailed("surface roi average of column " + AString::number(j) + " is " + AString::number(outRow[0]) + ", expected " + AString::number(expect0));
+            if (outRow[1] != expect1) setFailed("volume roi average of column " + AString::number(j) + " is " + AString::number(outRow[1]) + ", expected " + AString::number(expect1));
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+}
+
+CiftiRowAlgorithmsTest::CiftiRowAlgorithmsTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CiftiRowAlgorithmsTest::execute()
+{
+    try
+    {
+        testReduce();
+        testParcellate();
+        testAverageDenseROI();
+        testMergeDense();
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+}
+
+void CiftiRowAlgorithmsTest::testReduce()
+{
+    CiftiFile myData;
+    makeTestDenseFile(myData, 7, CiftiXML::ALONG_COLUMN, makeTestDenseMap(), true);
+    vector<vector<float> > inRows = getAllRows(myData);
+    const int64_t numRows = (int64_t)inRows.size(), numCols = (int64_t)inRows[0].size();
+    {
+        CiftiFile myOut;
+        AlgorithmCiftiReduce(NULL, &myData, ReductionEnum::MEAN, &myOut, false, CiftiXML::ALONG_ROW);
+        vector<vector<float> > expected(numRows, vector<float>(1));
+        for (int64_t i = 0; i < numRows; ++i)
+        {
+            expected[i][0] = ReductionOperation::reduce(inRows[i].data(), numCols, ReductionEnum::MEAN);
+        }
+        if (!compareRows(*this, "reduce along row", myOut, expected)) return;
+    }
+    vector<float> column(numRows);
+    {
+        CiftiFile myOut;
+        AlgorithmCiftiReduce(NULL, &myData, ReductionEnum::STDEV, &myOut, false, CiftiXML::ALONG_COLUMN);
+        vector<vector<float> > expected(1, vector<float>(numCols));
+        for (int64_t j = 0; j < numCols; ++j)
+        {
+            for (int64_t i = 0; i < numRows; ++i) column[i] = inRows[i][j];
+            expected[0][j] = ReductionOperation::reduce(column.data(), numRows, ReductionEnum::STDEV);
+        }
+        if (!compareRows(*this, "reduce along column", myOut, expected)) return;
+    }
+    {
+        CiftiFile myOut;
+        AlgorithmCiftiReduce(NULL, &myData, ReductionEnum::MEAN, &myOut, 1.0f, 1.0f, CiftiXML::ALONG_COLUMN);
+        vector<vector<float> > expected(1, vector<float>(numCols));
+        for (int64_t j = 0; j < numCols; ++j)
+        {
+            for (int64_t i = 0; i < numRows; ++i) column[i] = inRows[i][j];
+            expected[0][j] = ReductionOperation::reduceExcludeDev(column.data(), numRows, ReductionEnum::MEAN, 1.0f, 1.0f);
+        }
+        if (!compareRows(*this, "reduce along column with outlier exclusion", myOut, expected)) return;
+    }
+}
+
+void CiftiRowAlgorithmsTest::testParcellate()
+{
+    CiftiFile myLabel;
+    {
+        CiftiXML myXML;
+        myXML.setNumberOfDimensions(2);
+        myXML.setMap(CiftiXML::ALONG_COLUMN, makeTestDenseMap());
+        CiftiLabelsMap myLabelsMap;
+        myLabelsMap.setLength(1);
+        GiftiLabelTable* myTable = myLabelsMap.getMapLabelTable(0);
+        const float keyA = myTable->addLabel("A", 1.0f, 0.0f, 0.0f, 1.0f);
+        const float keyB = myTable->addLabel("B", 0.0f, 1.0f, 0.0f, 1.0f);
+        const float keyC = myTable->addLabel("C", 0.0f, 0.0f, 1.0f, 1.0f);
+        const float unassigned = myTable->getUnassignedLabelKey();
+        myXML.setMap(CiftiXML::ALONG_ROW, myLabelsMap);
+        myLabel.setCiftiXML(myXML);
+        const float labels[12] = { keyA, keyB, keyA, keyB, unassigned,//left
+                                   keyC, keyA, keyC, keyC,//right
+                                   keyB, unassigned, keyC };//voxels
+        for (int64_t i = 0; i < 12; ++i)
+        {
+            myLabel.setRow(labels + i, i);
+        }
+    }
+    vector<int> indexToParcel;
+    const int numParcels = AlgorithmCiftiParcellate::parcellateMapping(&myLabel, makeTestDenseMap(), indexToParcel).getLength();
+    CiftiFile myWeights;
+    makeTestDenseFile(myWeights, 1);
+    for (int64_t i = 0; i < 12; ++i)
+    {
+        const float weight = 1.0f + (i % 4) * 0.5f;
+        myWeights.setRow(&weight, i);
+    }
+    for (int weighted = 0; weighted < 2; ++weighted)
+    {
+        for (int direction = 0; direction < 2; ++direction)
+        {
+            CiftiFile myData, myOut;
+            makeTestDenseFile(myData, 7, direction, makeTestDenseMap(), true);
+            if (weighted)
+            {
+                AlgorithmCiftiParcellate(NULL, &myData, &myLabel, direction, &myOut, &myWeights);
+            } else {
+                AlgorithmCiftiParcellate(NULL, &myData, &myLabel, direction, &myOut);
+            }
+            vector<vector<float> > inRows = getAllRows(myData);
+            const int64_t otherLength = (direction == CiftiXML::ALONG_ROW ? (int64_t)inRows.size() : (int64_t)inRows[0].size());
+            vector<vector<float> > expected;
+            if (direction == CiftiXML::ALONG_ROW)
+            {
+                expected.resize(otherLength, vector<float>(numParcels));
+            } else {
+                expected.resize(numParcels, vector<float>(otherLength));
+            }
+            for (int p = 0; p < numParcels; ++p)
+            {
+                for (int64_t other = 0; other < otherLength; ++other)
+                {
+                    vector<float> values, weights;
+                    for (int64_t i = 0; i < 12; ++i)
+                    {
+                        if (indexToParcel[i] != p) continue;
+                        values.push_back(direction == CiftiXML::ALONG_ROW ? inRows[other][i] : inRows[i][other]);
+                        weights.push_back(1.0f + (i % 4) * 0.5f);
+                    }
+                    float result = 0.0f;
+                    if (values.size() > 0)
+                    {
+                        if (weighted)
+                        {
+                            result = ReductionOperation::reduceWeighted(values.data(), weights.data(), values.size(), ReductionEnum::MEAN);
+                        } else {
+                            result = ReductionOperation::reduce(values.data(), values.size(), ReductionEnum::MEAN);
+                        }
+                    }
+                    if (direction == CiftiXML::ALONG_ROW)
+                    {
+                        expected[other][p] = result;
+                    } else {
+                        expected[p][other] = result;
+                    }
+                }
+            }
+            const AString what = AString(weighted ? "weighted " : "") + "parcellate along " + (direction == CiftiXML::ALONG_ROW ? "row" : "column");
+            if (!compareRows(*this, what, myOut, expected)) return;
+        }
+    }
+}
+
+void CiftiRowAlgorithmsTest::testAverageDenseROI()
+{
+    CiftiFile myData[2];
+    vector<const CiftiFile*> dataList;
+    for (int f = 0; f < 2; ++f)
+    {
+        makeTestDenseFile(myData[f], 7, CiftiXML::ALONG_COLUMN, makeTestDenseMap(), false);
+        vector<float> row(7);
+        for (int64_t i = 0; i < myData[f].getNumberOfRows(); ++i)
+        {
+            for (int64_t j = 0; j < 7; ++j) row[j] = testValue(i + 5 * f, j);
+            myData[f].setRow(row.data(), i);
+        }
+        dataList.push_back(&myData[f]);
+    }
+    MetricFile leftROI, rightROI;
+    leftROI.setNumberOfNodesAndColumns(5, 2);
+    rightROI.setNumberOfNodesAndColumns(4, 2);
+    for (int m = 0; m < 2; ++m)
+    {
+        for (int32_t n = 0; n < 5; ++n) leftROI.setValue(n, m, ((n + m) % 3) * 0.75f);
+        for (int32_t n = 0; n < 4; ++n) rightROI.setValue(n, m, ((n * 2 + m) % 3) * 0.5f);
+    }
+    CiftiFile myOut;
+    AlgorithmCiftiAverageDenseROI(NULL, dataList, &myOut, &leftROI, &rightROI);
+    vector<vector<double> > accum(2, vector<double>(7, 0.0));
+    vector<double> denom(2, 0.0);
+    vector<float> row(7);
+    for (int f = 0; f < 2; ++f)
+    {//same order and operations as the loops before the pipeline: per file, left then right, rows in order
+        for (int64_t i = 0; i < 9; ++i)
+        {
+            const MetricFile& thisROI = (i < 5 ? leftROI : rightROI);
+            const int32_t node = (i < 5 ? i : i - 5);
+            myData[f].getRow(row.data(), i);
+            for (int m = 0; m < 2; ++m)
+            {
+                const float weight = thisROI.getValue(node, m);
+                if (weight == 0.0f) continue;
+                for (int j = 0; j < 7; ++j)
+                {
+                    accum[m][j] += row[j] * weight;
+                }
+                denom[m] += weight;
+            }
+        }
+    }
+    vector<vector<float> > expected(7, vector<float>(2));
+    for (int j = 0; j < 7; ++j)
+    {
+        for (int m = 0; m < 2; ++m)
+        {
+            expected[j][m] = accum[m][j] / denom[m];
+        }
+    }
+    compareRows(*this, "average dense roi", myOut, expected);
+}
+
+void CiftiRowAlgorithmsTest::testMergeDense()
+{
+    for (int direction = 0; direction < 2; ++direction)
+    {
+        CiftiFile first, second, myOut;
+        makeTestDenseFile(first, 4, direction, makeTestDenseMap(true, false), true);
+        makeTestDenseFile(second, 4, direction, makeTestDenseMap(false, true), false);
+        vector<float> row(second.getNumberOfColumns());
+        for (int64_t i = 0; i < second.getNumberOfRows(); ++i)
+        {
+            for (int64_t j = 0; j < (int64_t)row.size(); ++j) row[j] = -testValue(j, i);
+            second.setRow(row.data(), i);
+        }
+        vector<const CiftiFile*> mergeList;
+        mergeList.push_back(&first);
+        mergeList.push_back(&second);
+        AlgorithmCiftiMergeDense(NULL, direction, mergeList, &myOut);
+        vector<vector<float> > expected = getAllRows(first), secondRows = getAllRows(second);
+        if (direction == CiftiXML::ALONG_ROW)
+        {//second file's columns follow the first's
+            for (int64_t i = 0; i < (int64_t)expected.size(); ++i)
+            {
+                expected[i].insert(expected[i].end(), secondRows[i].begin(), secondRows[i].end());
+            }
+        } else {
+            expected.insert(expected.end(), secondRows.begin(), secondRows.end());
+        }
+        if (!compareRows(*this, AString("merge dense along ") + (direction == CiftiXML::ALONG_ROW ? "row" : "column"), myOut, expected)) return;
+    }
+}
+
+CiftiTransposeTest::CiftiTransposeTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CiftiTransposeTest::execute()
+{
+    const AString fileName = QDir::tempPath() + "/wb_ciftitranspose_test.dscalar.nii";
+    try
+    {
+        const int64_t inRows = 52, inColumns = 31;//output rows are 208 bytes, input rows 124 bytes
+        CiftiFile inMemory;
+        {
+            CiftiXML myXML;
+            myXML.setNumberOfDimensions(2);
+            CiftiScalarsMap rowMap, colMap;
+            rowMap.setLength(inColumns);
+            colMap.setLength(inRows);
+            myXML.setMap(CiftiXML::ALONG_ROW, rowMap);
+            myXML.setMap(CiftiXML::ALONG_COLUMN, colMap);
+            inMemory.setCiftiXML(myXML);
+            vector<float> row(inColumns);
+            for (int64_t i = 0; i < inRows; ++i)
+            {
+                for (int64_t j = 0; j < inColumns; ++j) row[j] = testValue(i, j);
+                inMemory.setRow(row.data(), i);
+            }
+        }
+        inMemory.writeFile(fileName);
+        CiftiFile onDisk;
+        onDisk.openFile(fileName);
+        if (onDisk.isInMemory())
+        {
+            setFailed("test input was read into memory, so the tiled transpose would not be tested");
+        }
+        vector<vector<float> > expected(inColumns, vector<float>(inRows));
+        for (int64_t i = 0; i < inRows; ++i)
+        {
+            for (int64_t j = 0; j < inColumns; ++j) expected[j][i] = testValue(i, j);
+        }
+        {
+            CiftiFile untiled;
+            AlgorithmCiftiTranspose(NULL, &onDisk, &untiled);
+            if (!compareRows(*this, "untiled transpose", untiled, expected)) return;
+        }
+        //limits in bytes: output chunks of 3 rows and tiles of 5 input rows, both with a partial last piece,
+        //then 1 row and 1 tile row (limit smaller than a row), then chunks of 30 of 31 rows with tiles of 50 of 52 rows
+        const float limitBytes[] = { 700.0f, 1.0f, 6300.0f };
+        for (int i = 0; i < 3; ++i)
+        {
+            const float limitGB = limitBytes[i] / (1024.0f * 1024.0f * 1024.0f);
+            CiftiFile tiled, fromMemory;
+            AlgorithmCiftiTranspose(NULL, &onDisk, &tiled, limitGB);
+            if (!compareRows(*this, "tiled transpose with a " + AString::number(limitBytes[i]) + " byte limit", tiled, expected)) return;
+            AlgorithmCiftiTranspose(NULL, &inMemory, &fromMemory, limitGB);
+            if (!compareRows(*this, "in-memory transpose with a " + AString::number(limitBytes[i]) + " byte limit", fromMemory, expected)) return;
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    QFile::remove(fileName);
+}
+
+CiftiChunkedMapsTest::CiftiChunkedMapsTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CiftiChunkedMapsTest::execute()
+{
+    try
+    {
+        testSmoothing();
+        if (failed()) return;
+        testResampling();
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+}
+
+namespace
+{
+    //limits in bytes: less than a map (one map per chunk), a few maps per chunk with a partial last chunk, and everything in one chunk
+    const float CHUNK_TEST_LIMITS[3] = { 1.0f, 700.0f, 1.0e6f };
+}
+
+void CiftiChunkedMapsTest::testSmoothing()
+{
+    const int64_t numMaps = 7;
+    const AString inName = QDir::tempPath() + "/wb_ciftichunkedmaps_in.dscalar.nii", outName = QDir::tempPath() + "/wb_ciftichunkedmaps_out.dscalar.nii";
+    SurfaceFile mySurf;
+    makeOctahedron(mySurf, 10.0f);
+    for (int direction = 0; direction < 2 && !failed(); ++direction)
+    {
+        CiftiFile inMemory;
+        makeTestDenseFile(inMemory, numMaps, direction, makeChunkTestDenseMap(), true);
+        inMemory.writeFile(inName);
+        CiftiFile onDisk;
+        onDisk.openFile(inName);
+        const AString dirName = (direction == CiftiXML::ALONG_ROW ? "row" : "column");
+        vector<vector<float> > expected;
+        {
+            CiftiFile byStructure;
+            AlgorithmCiftiSmoothing(NULL, &inMemory, 6.0f, 3.0f, direction, &byStructure, &mySurf);
+            expected = getAllRows(byStructure);
+        }
+        for (int i = 0; i < 3 && !failed(); ++i)
+        {
+            const float limitGB = CHUNK_TEST_LIMITS[i] / (1024.0f * 1024.0f * 1024.0f);
+            const AString what = "smoothing along " + dirName + " with a " + AString::number(CHUNK_TEST_LIMITS[i]) + " byte limit";
+            {
+                CiftiFile chunked;
+                AlgorithmCiftiSmoothing(NULL, &inMemory, 6.0f, 3.0f, direction, &chunked, &mySurf, NULL, NULL, NULL, false, false, NULL, NULL, NULL, false, limitGB);
+                if (!compareRowsClose(*this, "in-memory " + what, chunked, expected)) break;
+            }
+            {
+                CiftiFile chunked;
+                AlgorithmCiftiSmoothing(NULL, &onDisk, 6.0f, 3.0f, direction, &chunked, &mySurf, NULL, NULL, NULL, false, false, NULL, NULL, NULL, false, limitGB);
+                if (!compareRowsClose(*this, "on-disk " + what, chunked, expected)) break;
+            }
+            {//output on disk puts the temporary files next to it
+                CiftiFile chunked;
+                chunked.setWritingFile(outName);
+                AlgorithmCiftiSmoothing(NULL, &onDisk, 6.0f, 3.0f, direction, &chunked, &mySurf, NULL, NULL, NULL, false, false, NULL, NULL, NULL, false, limitGB);
+                if (!compareRowsClose(*this, "on-disk output of " + what, chunked, expected)) break;
+            }
+            QFile::remove(outName);
+        }
+    }
+    QFile::remove(inName);
+    QFile::remove(outName);
+}
+
+void CiftiChunkedMapsTest::testResampling()
+{//chunking is only done along columns, and not for labels
+    const int64_t numMaps = 7;
+    const AString inName = QDir::tempPath() + "/wb_ciftichunkedmaps_in.dscalar.nii";
+    SurfaceFile curSphere, newSphere;
+    makeOctahedron(curSphere, 100.0f);
+    makeOctahedron(newSphere, 100.0f, 0.3f, 0.2f);
+    const FloatMatrix affine = FloatMatrix::identity(4);
+    CiftiFile inMemory;
+    makeTestDenseFile(inMemory, numMaps, CiftiXML::ALONG_COLUMN, makeChunkTestDenseMap(), true);
+    inMemory.writeFile(inName);
+    CiftiFile onDisk;
+    onDisk.openFile(inName);
+    vector<vector<float> > expected;
+    {
+        CiftiFile byStructure;
+        AlgorithmCiftiResample(NULL, &inMemory, CiftiXML::ALONG_COLUMN, &inMemory, CiftiXML::ALONG_COLUMN, SurfaceResamplingMethodEnum::BARYCENTRIC, VolumeFile::CUBIC,
+                               &byStructure, false, -1.0f, -1.0f, affine, &curSphere, &newSphere, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+        expected = getAllRows(byStructure);
+    }
+    for (int i = 0; i < 3 && !failed(); ++i)
+    {
+        const float limitGB = CHUNK_TEST_LIMITS[i] / (1024.0f * 1024.0f * 1024.0f);
+        const AString what = "resampling with a " + AString::number(CHUNK_TEST_LIMITS[i]) + " byte limit";
+        for (int input = 0; input < 2; ++input)
+        {
+            const CiftiFile* myInput = (input == 0 ? &inMemory : &onDisk);
+            CiftiFile chunked;
+            AlgorithmCiftiResample(NULL, myInput, CiftiXML::ALONG_COLUMN, &inMemory, CiftiXML::ALONG_COLUMN, SurfaceResamplingMethodEnum::BARYCENTRIC, VolumeFile::CUBIC,
+                                   &chunked, false, -1.0f, -1.0f, affine, &curSphere, &newSphere, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                                   AlgorithmVolumeDilate::WEIGHTED, 2.0f, AlgorithmMetricDilate::WEIGHTED, 2.0f, limitGB);
+            if (!compareRowsClose(*this, AString(input == 0 ? "in-memory " : "on-disk ") + what, chunked, expected)) break;
+        }
+    }
+    QFile::remove(inName);
+}
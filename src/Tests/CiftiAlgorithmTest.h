@@ -0,0 +1,68 @@
+#ifndef __CIFTI_ALGORITHM_TEST_H__
+#define __CIFTI_ALGORITHM_TEST_H__
+
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "TestInterface.h"
+
+namespace caret
+{
+
+    ///checks that rows are found by their cifti index, not their position within the structure
+    class CiftiAverageDenseROITest : public TestInterface
+    {
+    public:
+        CiftiAverageDenseROITest(const AString& identifier);
+        virtual void execute();
+    };
+
+    ///compares tiled transposes of an on-disk file at small memory limits with the untiled transpose
+    class CiftiTransposeTest : public TestInterface
+    {
+    public:
+        CiftiTransposeTest(const AString& identifier);
+        virtual void execute();
+    };
+
+    ///compares cifti smoothing and resampling done in chunks of maps, with on-disk and in-memory files, against doing one structure at a time
+    class CiftiChunkedMapsTest : public TestInterface
+    {
+        void testSmoothing();
+        void testResampling();
+    public:
+        CiftiChunkedMapsTest(const AString& identifier);
+        virtual void execute();
+    };
+
+    ///compares cifti reduce, parcellate, average dense roi and merge dense with simple loops that do the same operations in the same order
+    class CiftiRowAlgorithmsTest : public TestInterface
+    {
+        void testReduce();
+        void testParcellate();
+        void testAverageDenseROI();
+        void testMergeDense();
+    public:
+        CiftiRowAlgorithmsTest(const AString& identifier);
+        virtual void execute();
+    };
+
+}
+#endif // __CIFTI_ALGORITHM_TEST_H__
@@ -20,7 +20,16 @@
 
 #include "CiftiFileTest.h"
 #include "CiftiFile.h"
+#include "ElapsedTimer.h"
+
+#include <QDir>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
 using namespace caret;
+
 CiftiFileTest::CiftiFileTest(const AString &identifier) : TestInterface(identifier)
 {
 }
@@ -199,3 +208,109 @@ void CiftiFileTest::testCiftiReadWriteOnDisk()
     delete [] testRow;
 }
 
+
+CiftiColumnScrubTest::CiftiColumnScrubTest(const AString &identifier, const bool& benchmark) : TestInterface(identifier)
+{
+    m_benchmark = benchmark;
+}
+
+namespace
+{
+    float scrubTestValue(const int64_t& row, const int64_t& column)
+    {//exactly representable
+        return (float)((row * 7919 + column * 31) % 65536);
+    }
+    
+    int64_t countWrongColumns(const std::vector<float>& data, const int64_t& numRows, const int64_t& firstColumn, const int64_t& numColumns)
+    {//data is row-major, as from getColumns
+        int64_t numWrong = 0;
+        for (int64_t i = 0; i < numRows; ++i)
+        {
+            for (int64_t j = 0; j < numColumns; ++j)
+            {
+                if (data[i * numColumns + j] != scrubTestValue(i, firstColumn + j)) ++numWrong;
+            }
+        }
+        return numWrong;
+    }
+}
+
+void CiftiColumnScrubTest::execute()
+{
+    AString fileName = QDir::tempPath() + "/wb_cifticolumnscrub_test.dtseries.nii";
+    //the test is about 3MB of float32, with rows still longer than a page
+    //the benchmark is about 150MB, long enough that the time series rows span several pages
+    const int64_t SCRUB_TEST_ROWS = (m_benchmark ? 8000 : 600), SCRUB_TEST_TIMEPOINTS = (m_benchmark ? 4800 : 1200);
+    try
+    {
+        {
+            CiftiXML myXML;
+            myXML.setNumberOfDimensions(2);
+            CiftiBrainModelsMap myModels;
+            myModels.addSurfaceModel(SCRUB_TEST_ROWS, StructureEnum::CORTEX_LEFT);
+            myXML.setMap(CiftiXML::ALONG_COLUMN, myModels);
+            myXML.setMap(CiftiXML::ALONG_ROW, CiftiSeriesMap(SCRUB_TEST_TIMEPOINTS));
+            CiftiFile writer;
+            writer.setWritingFile(fileName);
+            writer.setCiftiXML(myXML);
+            std::vector<float> row(SCRUB_TEST_TIMEPOINTS);
+            for (int64_t i = 0; i < SCRUB_TEST_ROWS; ++i)
+            {
+                for (int64_t j = 0; j < SCRUB_TEST_TIMEPOINTS; ++j)
+                {
+                    row[j] = scrubTestValue(i, j);
+                }
+                writer.setRow(row.data(), i);
+            }
+            writer.writeFile(fileName);
+        }
+        CiftiFile reader(fileName);//stays on disk
+        ElapsedTimer myTimer;
+        std::vector<float> column(SCRUB_TEST_ROWS);
+        const int64_t numSingleColumns = 20;//one read per element, so don't do many
+        int64_t numWrong = 0;
+        myTimer.start();
+        for (int64_t j = 0; j < numSingleColumns; ++j)
+        {
+            reader.getColumn(column.data(), j);
+            for (int64_t i = 0; i < SCRUB_TEST_ROWS; ++i)
+            {
+                if (column[i] != scrubTestValue(i, j)) ++numWrong;
+            }
+        }
+        double singleTime = myTimer.getElapsedTimeSeconds();
+        if (numWrong != 0)
+        {
+            setFailed(AString::number(numWrong) + " values were wrong from getColumn");
+        } else {
+            int64_t tileColumns = 97;//doesn't divide the number of timepoints, so the last tile is partial
+            if (m_benchmark) tileColumns = (64 * 1024 * 1024) / (SCRUB_TEST_ROWS * sizeof(float));//same tile budget as CiftiMappableDataFile
+            std::vector<float> tile(SCRUB_TEST_ROWS * tileColumns);
+            myTimer.start();
+            for (int64_t first = 0; first < SCRUB_TEST_TIMEPOINTS; first += tileColumns)
+            {
+                int64_t count = std::min(tileColumns, SCRUB_TEST_TIMEPOINTS - first);
+                reader.getColumns(tile.data(), first, count);
+                numWrong += countWrongColumns(tile, SCRUB_TEST_ROWS, first, count);
+            }
+            double tiledTime = myTimer.getElapsedTimeSeconds();
+            if (numWrong != 0)
+            {
+                setFailed(AString::number(numWrong) + " values were wrong from getColumns with partial rows");
+            } else {
+                std::vector<float> wide(SCRUB_TEST_ROWS * (SCRUB_TEST_TIMEPOINTS - 100));//wide enough to read whole rows
+                reader.getColumns(wide.data(), 50, SCRUB_TEST_TIMEPOINTS - 100);
+                numWrong = countWrongColumns(wide, SCRUB_TEST_ROWS, 50, SCRUB_TEST_TIMEPOINTS - 100);
+                if (numWrong != 0)
+                {
+                    setFailed(AString::number(numWrong) + " values were wrong from getColumns with whole rows");
+                } else if (m_benchmark && singleTime > 0.0 && tiledTime > 0.0) {
+                    std::cout << "getColumn: " << numSingleColumns / singleTime << " frames/s, tiled getColumns: " << SCRUB_TEST_TIMEPOINTS / tiledTime << " frames/s" << std::endl;
+                }
+            }
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    QFile::remove(fileName);
+}
@@ -34,6 +34,16 @@ public:
     void testCiftiReadWriteOnDisk();
 };
 
+//writes a small dtseries to disk, and checks getColumns against getColumn and the written values
+//as a benchmark, uses an HCP-length time series instead, and reports frames/sec when stepping through its maps
+class CiftiColumnScrubTest : public TestInterface
+{
+    bool m_benchmark;
+public:
+    CiftiColumnScrubTest(const AString &identifier, const bool& benchmark = false);
+    void execute();
+};
+
 } // namespace caret
 
 #endif // CIFTIFILETEST_H
@@ -0,0 +1,289 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "ClusterLabelingTest.h"
+#include "CaretException.h"
+#include "CaretOMP.h"
+#include "ClusterLabelingHelper.h"
+#include "SurfaceFile.h"
+#include "TopologyHelper.h"
+
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    ///deterministic, so failures can be reproduced
+    class SimpleRandom
+    {
+        uint32_t m_state;
+    public:
+        SimpleRandom(const uint32_t& seed) { m_state = seed; }
+        uint32_t next()
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return m_state >> 8;
+        }
+    };
+    
+    ///the numbering that the find-clusters algorithms used before the union-find helper
+    void floodFillReference(const vector<vector<int32_t> >& neighbors, const vector<char>& mask, const float* areas, ClusterLabelingHelper::Components& componentsOut)
+    {
+        int32_t numElements = (int32_t)mask.size();
+        componentsOut.m_labels.assign(numElements, -1);
+        componentsOut.m_counts.clear();
+        componentsOut.m_areas.clear();
+        vector<int32_t> stack;
+        for (int32_t seed = 0; seed < numElements; ++seed)
+        {
+            if (!mask[seed] || componentsOut.m_labels[seed] != -1) continue;
+            int32_t component = (int32_t)componentsOut.m_counts.size();
+            componentsOut.m_counts.push_back(0);
+            if (areas != NULL) componentsOut.m_areas.push_back(0.0);
+            componentsOut.m_labels[seed] = component;
+            stack.push_back(seed);
+            while (!stack.empty())
+            {
+                int32_t element = stack.back();
+                stack.pop_back();
+                ++componentsOut.m_counts[component];
+                if (areas != NULL) componentsOut.m_areas[component] += areas[element];
+                for (size_t n = 0; n < neighbors[element].size(); ++n)
+                {
+                    int32_t neighbor = neighbors[element][n];
+                    if (mask[neighbor] && componentsOut.m_labels[neighbor] == -1)
+                    {
+                        componentsOut.m_labels[neighbor] = component;
+                        stack.push_back(neighbor);
+                    }
+                }
+            }
+        }
+    }
+    
+    bool sameComponents(const ClusterLabelingHelper::Components& left, const ClusterLabelingHelper::Components& right)
+    {//areas are sums of multiples of 1/4, so they are exact in any order
+        return left.m_labels == right.m_labels && left.m_counts == right.m_counts && left.m_areas == right.m_areas;
+    }
+    
+    vector<vector<int32_t> > volumeNeighbors(const int64_t dims[3])
+    {
+        vector<vector<int32_t> > ret(dims[0] * dims[1] * dims[2]);
+        for (int64_t k = 0; k < dims[2]; ++k)
+        {
+            for (int64_t j = 0; j < dims[1]; ++j)
+            {
+                for (int64_t i = 0; i < dims[0]; ++i)
+                {
+                    int32_t index = (int32_t)(i + dims[0] * (j + dims[1] * k));
+                    if (i > 0) ret[index].push_back(index - 1);
+                    if (i < dims[0] - 1) ret[index].push_back(index + 1);
+                    if (j > 0) ret[index].push_back(index - dims[0]);
+                    if (j < dims[1] - 1) ret[index].push_back(index + dims[0]);
+                    if (k > 0) ret[index].push_back(index - dims[0] * dims[1]);
+                    if (k < dims[2] - 1) ret[index].push_back(index + dims[0] * dims[1]);
+                }
+            }
+        }
+        return ret;
+    }
+    
+    ///thread counts to compare, the first is the default
+    vector<int> threadCounts()
+    {
+        vector<int> ret;
+#ifdef CARET_OMP
+        ret.push_back(omp_get_max_threads());
+        ret.push_back(1);
+        ret.push_back(2);
+        ret.push_back(3);
+        ret.push_back(7);
+#else
+        ret.push_back(1);
+#endif
+        return ret;
+    }
+    
+    void setThreads(const int& numThreads)
+    {
+#ifdef CARET_OMP
+        omp_set_num_threads(numThreads);
+#endif
+    }
+}
+
+ClusterLabelingTest::ClusterLabelingTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void ClusterLabelingTest::execute()
+{
+    vector<int> counts = threadCounts();
+    try
+    {
+        testVolume();
+        testSurface();
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    setThreads(counts[0]);
+}
+
+void ClusterLabelingTest::testVolume()
+{
+    const int64_t dims[3] = { 9, 7, 23 };//enough k-planes that every thread count gets more than one slab
+    const int64_t frameSize = dims[0] * dims[1] * dims[2];
+    vector<vector<int32_t> > neighbors = volumeNeighbors(dims);
+    vector<vector<char> > masks;
+    masks.push_back(vector<char>(frameSize, 0));//empty
+    masks.push_back(vector<char>(frameSize, 1));//one component through every slab
+    {//serpentine: one component that leaves and reenters each slab, so slab joins must merge components found separately
+        vector<char> serpentine(frameSize, 0);
+        for (int64_t k = 0; k < dims[2]; ++k)
+        {
+            for (int64_t j = 0; j < dims[1]; j += 2)
+            {
+                for (int64_t i = 0; i < dims[0]; ++i) serpentine[i + dims[0] * (j + dims[1] * k)] = 1;
+                if (j + 1 < dims[1]) serpentine[((j / 2) % 2 == 0 ? dims[0] - 1 : 0) + dims[0] * (j + 1 + dims[1] * k)] = 1;
+            }
+            if (k + 1 < dims[2]) serpentine[(k % 2 == 0 ? dims[0] * (dims[1] - 1) : 0) + dims[0] * dims[1] * k] = 1;
+        }
+        masks.push_back(serpentine);
+    }
+    {//columns along k joined only at the top plane, so the lowest index of each component is far from where it joins
+        vector<char> comb(frameSize, 0);
+        for (int64_t k = 0; k < dims[2]; ++k)
+        {
+            for (int64_t i = 0; i < dims[0]; i += 2) comb[i + dims[0] * (3 + dims[1] * k)] = 1;
+        }
+        for (int64_t i = 0; i < dims[0]; ++i) comb[i + dims[0] * (3 + dims[1] * (dims[2] - 1))] = 1;
+        masks.push_back(comb);
+    }
+    SimpleRandom myRandom(12345);
+    const uint32_t densities[] = { 20, 31, 50, 70 };//percent, near the percolation threshold gives large tangled components
+    for (int d = 0; d < 4; ++d)
+    {
+        vector<char> randomMask(frameSize);
+        for (int64_t i = 0; i < frameSize; ++i) randomMask[i] = (myRandom.next() % 100 < densities[d]) ? 1 : 0;
+        masks.push_back(randomMask);
+    }
+    vector<int> counts = threadCounts();
+    for (size_t m = 0; m < masks.size(); ++m)
+    {
+        ClusterLabelingHelper::Components expected;
+        floodFillReference(neighbors, masks[m], NULL, expected);
+        for (size_t t = 0; t < counts.size(); ++t)
+        {
+            setThreads(counts[t]);
+            ClusterLabelingHelper::Components result;
+            ClusterLabelingHelper::labelVolume(dims, masks[m], result);
+            if (!sameComponents(result, expected))
+            {
+                setFailed("volume mask " + AString::number(m) + " labeled differently from flood fill with " + AString::number(counts[t]) + " threads");
+            }
+        }
+    }
+    setThreads(counts[0]);
+    //from inside a parallel region, the serial path is used, several masks at once
+    vector<ClusterLabelingHelper::Components> parallelResults(masks.size());
+#pragma omp CARET_PARFOR schedule(dynamic)
+    for (int m = 0; m < (int)masks.size(); ++m)
+    {
+        ClusterLabelingHelper::labelVolume(dims, masks[m], parallelResults[m]);
+    }
+    for (size_t m = 0; m < masks.size(); ++m)
+    {
+        ClusterLabelingHelper::Components expected;
+        floodFillReference(neighbors, masks[m], NULL, expected);
+        if (!sameComponents(parallelResults[m], expected))
+        {
+            setFailed("volume mask " + AString::number(m) + " labeled differently from flood fill inside a parallel region");
+        }
+    }
+}
+
+void ClusterLabelingTest::testSurface()
+{
+    const int32_t gridX = 17, gridY = 13;
+    SurfaceFile mySurf;
+    mySurf.setNumberOfNodesAndTriangles(gridX * gridY, (gridX - 1) * (gridY - 1) * 2);
+    for (int32_t y = 0; y < gridY; ++y)
+    {
+        for (int32_t x = 0; x < gridX; ++x)
+        {
+            mySurf.setCoordinate(x + gridX * y, float(x), float(y), 0.0f);
+        }
+    }
+    int32_t triangle = 0;
+    for (int32_t y = 0; y < gridY - 1; ++y)
+    {
+        for (int32_t x = 0; x < gridX - 1; ++x)
+        {
+            int32_t corner = x + gridX * y;
+            mySurf.setTriangle(triangle++, corner, corner + 1, corner + gridX + 1);
+            mySurf.setTriangle(triangle++, corner, corner + gridX + 1, corner + gridX);
+        }
+    }
+    CaretPointer<TopologyHelper> myTopoHelp = mySurf.getTopologyHelper();
+    const int32_t numNodes = gridX * gridY;
+    vector<vector<int32_t> > neighbors(numNodes);
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        neighbors[i] = myTopoHelp->getNodeNeighbors(i);
+    }
+    vector<float> areas(numNodes);
+    for (int32_t i = 0; i < numNodes; ++i)
+    {
+        areas[i] = 0.25f * (1 + i % 7);
+    }
+    SimpleRandom myRandom(54321);
+    vector<vector<char> > masks;
+    masks.push_back(vector<char>(numNodes, 0));
+    masks.push_back(vector<char>(numNodes, 1));
+    const uint32_t densities[] = { 25, 40, 60 };
+    for (int d = 0; d < 3; ++d)
+    {
+        vector<char> randomMask(numNodes);
+        for (int32_t i = 0; i < numNodes; ++i) randomMask[i] = (myRandom.next() % 100 < densities[d]) ? 1 : 0;
+        masks.push_back(randomMask);
+    }
+    vector<int> counts = threadCounts();
+    for (size_t m = 0; m < masks.size(); ++m)
+    {
+        for (int useAreas = 0; useAreas < 2; ++useAreas)
+        {
+            const float* areaPtr = (useAreas ? areas.data() : NULL);
+            ClusterLabelingHelper::Components expected;
+            floodFillReference(neighbors, masks[m], areaPtr, expected);
+            for (size_t t = 0; t < counts.size(); ++t)
+            {
+                setThreads(counts[t]);
+                ClusterLabelingHelper::Components result;
+                ClusterLabelingHelper::labelSurface(myTopoHelp, masks[m], areaPtr, result);
+                if (!sameComponents(result, expected))
+                {
+                    setFailed("surface mask " + AString::number(m) + (useAreas ? " with areas" : "") + " labeled differently from flood fill with " + AString::number(counts[t]) + " threads");
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,366 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "CommandTest.h"
+#include "AbstractOperation.h"
+#include "CaretException.h"
+#include "CommandBatch.h"
+#include "CommandInputCache.h"
+#include "CommandOperationManager.h"
+#include "CommandParser.h"
+#include "MetricFile.h"
+#include "OperationParameters.h"
+#include "ProgramParameters.h"
+#include "SurfaceFile.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    ///a strip of numTriangles triangles, with x coordinates scaled by xScale so rewrites can be told apart
+    void writeStripSurface(const AString& fileName, const int32_t& numTriangles, const float& xScale)
+    {
+        SurfaceFile mySurf;
+        mySurf.setNumberOfNodesAndTriangles(numTriangles + 2, numTriangles);
+        mySurf.setStructure(StructureEnum::CORTEX_LEFT);
+        for (int32_t i = 0; i < numTriangles + 2; ++i)
+        {
+            mySurf.setCoordinate(i, (i / 2) * xScale, float(i % 2), float(i % 3));//nonzero extent on every axis, for bounding box matching
+        }
+        for (int32_t i = 0; i < numTriangles; ++i)
+        {
+            mySurf.setTriangle(i, i, i + 1, i + 2);
+        }
+        mySurf.writeFile(fileName);
+    }
+    
+    ///records which files and strings the parser gave it, so that the batch dependency scan can be checked against real parsing
+    class ScanTestOperation : public AbstractOperation
+    {
+    public:
+        static vector<AString> s_inputs, s_strings;
+        static OperationParameters* getParameters()
+        {
+            OperationParameters* ret = new OperationParameters();
+            ret->addMetricParameter(1, "metric-in", "an input file");
+            ret->addStringParameter(2, "name", "a string");
+            ret->addDoubleParameter(3, "number", "a number");
+            ret->addMetricOutputParameter(4, "metric-out", "the output file");
+            OptionalParameter* optOpt = ret->createOptionalParameter(5, "-opt", "an option with a file and a string");
+            optOpt->addMetricParameter(1, "opt-metric", "an input file");
+            optOpt->addStringParameter(2, "opt-name", "a string");
+            OptionalParameter* subOpt = optOpt->createOptionalParameter(3, "-sub", "a nested option");
+            subOpt->addMetricParameter(1, "sub-metric", "an input file");
+            ParameterComponent* repOpt = ret->createRepeatableParameter(6, "-rep", "a repeatable option");
+            repOpt->addMetricParameter(1, "rep-metric", "an input file");
+            repOpt->addDoubleParameter(2, "rep-number", "a number");
+            return ret;
+        }
+        static void useParameters(OperationParameters* myParams, ProgressObject*)
+        {
+            MetricFile* myMetric = myParams->getMetric(1);
+            s_inputs.push_back(myMetric->getFileName());
+            s_strings.push_back(myParams->getString(2));
+            myParams->getDouble(3);
+            OptionalParameter* optOpt = myParams->getOptionalParameter(5);
+            if (optOpt->m_present)
+            {
+                s_inputs.push_back(optOpt->getMetric(1)->getFileName());
+                s_strings.push_back(optOpt->getString(2));
+                OptionalParameter* subOpt = optOpt->getOptionalParameter(3);
+                if (subOpt->m_present)
+                {
+                    s_inputs.push_back(subOpt->getMetric(1)->getFileName());
+                }
+            }
+            const vector<ParameterComponent*>& repInstances = *(myParams->getRepeatableParameterInstances(6));
+            for (int i = 0; i < (int)repInstances.size(); ++i)
+            {
+                s_inputs.push_back(repInstances[i]->getMetric(1)->getFileName());
+                repInstances[i]->getDouble(2);
+            }
+            MetricFile* myOut = myParams->getOutputMetric(4);
+            myOut->setNumberOfNodesAndColumns(myMetric->getNumberOfNodes(), 1);
+            myOut->setStructure(myMetric->getStructure());
+        }
+        static AString getCommandSwitch() { return "-scan-test"; }
+        static AString getShortDescription() { return "TEST OPERATION FOR FILE ARGUMENT SCANNING"; }
+    };
+    vector<AString> ScanTestOperation::s_inputs, ScanTestOperation::s_strings;
+    
+    vector<AString> absoluteSorted(const vector<AString>& names)
+    {
+        vector<AString> ret;
+        for (int i = 0; i < (int)names.size(); ++i)
+        {
+            ret.push_back(QFileInfo(names[i]).absoluteFilePath());
+        }
+        sort(ret.begin(), ret.end());
+        return ret;
+    }
+}
+
+CommandBatchScriptTest::CommandBatchScriptTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CommandBatchScriptTest::execute()
+{
+    try
+    {
+        testSplitScript();
+        testScanMatchesParse();
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+}
+
+void CommandBatchScriptTest::testSplitScript()
+{
+    const AString script = "# comment line\n"
+                           "\n"
+                           "-metric-smoothing a.func.gii 'b c.surf.gii' \"d\\\"e\" f\\ g # trailing comment\n"
+                           "  -cifti-math \"x + y\" out.dscalar.nii \\\n"
+                           "   -var x @tmp\n"
+                           "echo a#b ''\n"
+                           "x 'multi\nline'\n"
+                           "y";
+    const char* expected[][7] = { { "-metric-smoothing", "a.func.gii", "b c.surf.gii", "d\"e", "f g", NULL },
+                                  { "-cifti-math", "x + y", "out.dscalar.nii", "-var", "x", "@tmp", NULL },
+                                  { "echo", "a#b", "", NULL },
+                                  { "x", "multi\nline", NULL },
+                                  { "y", NULL } };
+    const int64_t expectedLines[] = { 3, 4, 6, 7, 9 };
+    const int numExpected = 5;
+    vector<vector<AString> > commands;
+    vector<int64_t> lineNumbers;
+    CommandBatch::splitScript(script, commands, lineNumbers);
+    if ((int)commands.size() != numExpected || (int)lineNumbers.size() != numExpected)
+    {
+        setFailed("script split into " + AString::number(commands.size()) + " commands, expected " + AString::number(numExpected));
+        return;
+    }
+    for (int i = 0; i < numExpected; ++i)
+    {
+        vector<AString> expectedCommand;
+        for (int j = 0; expected[i][j] != NULL; ++j)
+        {
+            expectedCommand.push_back(expected[i][j]);
+        }
+        if (commands[i] != expectedCommand)
+        {
+            setFailed("command " + AString::number(i + 1) + " was split incorrectly");
+        }
+        if (lineNumbers[i] != expectedLines[i])
+        {
+            setFailed("command " + AString::number(i + 1) + " reported line " + AString::number(lineNumbers[i]) + ", expected " + AString::number(expectedLines[i]));
+        }
+    }
+    bool threw = false;
+    try
+    {
+        CommandBatch::splitScript("a b\nc 'unterminated\n", commands, lineNumbers);
+    } catch (CaretException& e) {
+        threw = true;
+        if (!e.whatString().contains("line 2")) setFailed("unterminated quote error doesn't give the line it started on: " + e.whatString());
+    }
+    if (!threw) setFailed("unterminated quote was not an error");
+}
+
+void CommandBatchScriptTest::testScanMatchesParse()
+{
+    vector<AString> metricNames, outNames;
+    for (int i = 0; i < 4; ++i)
+    {
+        metricNames.push_back(QDir::tempPath() + "/wb_commandbatchscript_test_" + AString::number(i) + ".func.gii");
+        MetricFile myMetric;
+        myMetric.setNumberOfNodesAndColumns(3, 1);
+        myMetric.setStructure(StructureEnum::CORTEX_LEFT);
+        myMetric.writeFile(metricNames.back());
+    }
+    const AString outName = QDir::tempPath() + "/wb_commandbatchscript_test_out.func.gii";
+    const AString& m0 = metricNames[0], &m1 = metricNames[1], &m2 = metricNames[2], &m3 = metricNames[3];
+    vector<vector<AString> > commandLines;
+    {//required arguments only, with a negative number
+        const AString args[] = { m0, "name", "-3.5", outName };
+        commandLines.push_back(vector<AString>(args, args + 4));
+    }
+    {//option before the required arguments
+        const AString args[] = { "-opt", m1, "optname", m0, "x", "2", outName };
+        commandLines.push_back(vector<AString>(args, args + 7));
+    }
+    {//repeatable options between required arguments, negative number inside an option, nested option at the end
+        const AString args[] = { m0, "-rep", m1, "-1", "name", "-rep", m2, "4", "7", outName, "-opt", m3, "s", "-sub", m1 };
+        commandLines.push_back(vector<AString>(args, args + 15));
+    }
+    {//option after the output
+        const AString args[] = { m3, "n", "1", outName, "-rep", m2, "0" };
+        commandLines.push_back(vector<AString>(args, args + 7));
+    }
+    CommandParser myParser(new TemplateAutoOperation<ScanTestOperation>());
+    myParser.disableProvenance();
+    for (int c = 0; c < (int)commandLines.size(); ++c)
+    {
+        ProgramParameters scanParams, parseParams;
+        for (int i = 0; i < (int)commandLines[c].size(); ++i)
+        {
+            scanParams.addParameter(commandLines[c][i]);
+            parseParams.addParameter(commandLines[c][i]);
+        }
+        vector<AString> inputs, outputs, strings;
+        myParser.scanFileArguments(scanParams, inputs, outputs, strings);
+        ScanTestOperation::s_inputs.clear();
+        ScanTestOperation::s_strings.clear();
+        QFile::remove(outName);
+        myParser.executeOperation(parseParams);
+        const AString which = "command line " + AString::number(c + 1) + ": ";
+        if (absoluteSorted(inputs) != absoluteSorted(ScanTestOperation::s_inputs))
+        {
+            setFailed(which + "scanned input files don't match the parsed input files");
+        }
+        vector<AString> sortedStrings = strings, parsedStrings = ScanTestOperation::s_strings;
+        sort(sortedStrings.begin(), sortedStrings.end());
+        sort(parsedStrings.begin(), parsedStrings.end());
+        if (sortedStrings != parsedStrings)
+        {
+            setFailed(which + "scanned strings don't match the parsed strings");
+        }
+        if (outputs.size() != 1 || outputs[0] != outName || !QFile::exists(outName))
+        {
+            setFailed(which + "scanned output files don't match the written output");
+        }
+    }
+    for (int i = 0; i < (int)metricNames.size(); ++i)
+    {
+        QFile::remove(metricNames[i]);
+    }
+    QFile::remove(outName);
+}
+
+CommandInputCacheTest::CommandInputCacheTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CommandInputCacheTest::execute()
+{
+    const AString fileName = QDir::tempPath() + "/wb_commandinputcache_test.surf.gii";
+    const AString otherName = QDir::tempPath() + "/wb_commandinputcache_test_other.surf.gii";
+    try
+    {
+        writeStripSurface(fileName, 4, 1.0f);
+        writeStripSurface(otherName, 4, 3.0f);
+        CommandInputCache myCache(1 << 30);
+        CaretPointer<SurfaceFile> first = myCache.getSurface(fileName);
+        CaretPointer<SurfaceFile> second = myCache.getSurface(fileName);
+        if (first != second)
+        {
+            setFailed("reading an unchanged surface twice did not return the cached file");
+        }
+        if (first->getNumberOfNodes() != 6 || first->getCoordinate(4)[0] != 2.0f)
+        {
+            setFailed("cached surface has the wrong contents");
+        }
+        if (myCache.getSurface(otherName) == first)
+        {
+            setFailed("a different file returned the same cached surface");
+        }
+        writeStripSurface(fileName, 6, 2.0f);//different size, so the change is seen even if the modification time doesn't change
+        CaretPointer<SurfaceFile> changed = myCache.getSurface(fileName);
+        if (changed == first)
+        {
+            setFailed("rewriting a surface did not invalidate its cache entry");
+        } else if (changed->getNumberOfNodes() != 8 || changed->getCoordinate(4)[0] != 4.0f) {
+            setFailed("reread surface has the wrong contents");
+        }
+        if (first->getNumberOfNodes() != 6)
+        {
+            setFailed("the previously returned surface was modified when the cache entry was replaced");
+        }
+        if (myCache.getSurface(fileName) != changed)
+        {
+            setFailed("the reread surface was not cached");
+        }
+        CommandInputCache tinyCache(1);//every new surface evicts the others
+        CaretPointer<SurfaceFile> evicted = tinyCache.getSurface(fileName);
+        tinyCache.getSurface(otherName);
+        if (tinyCache.getSurface(fileName) == evicted)
+        {
+            setFailed("a surface beyond the cache limit was not released");
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    QFile::remove(fileName);
+    QFile::remove(otherName);
+}
+
+CommandServerRequestTest::CommandServerRequestTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void CommandServerRequestTest::execute()
+{
+    const AString fileName = QDir::tempPath() + "/wb_commandserverrequest_test.surf.gii";
+    const AString matchName = QDir::tempPath() + "/wb_commandserverrequest_test_match.surf.gii";
+    const AString outName = QDir::tempPath() + "/wb_commandserverrequest_test_out.surf.gii";
+    CommandInputCache myCache(1 << 30);
+    CommandParser::setInputCache(&myCache);//as CommandServer::run does
+    try
+    {
+        writeStripSurface(fileName, 4, 1.0f);
+        writeStripSurface(matchName, 4, 3.0f);
+        CaretPointer<SurfaceFile> cached = myCache.getSurface(fileName);
+        ProgramParameters myParams;
+        myParams.addParameter("-surface-match");
+        myParams.addParameter(matchName);
+        myParams.addParameter(fileName);
+        myParams.addParameter(outName);
+        CommandOperationManager::getCommandOperationManager()->runServerRequest(myParams, "wb_command -surface-match");
+        SurfaceFile outSurf;
+        outSurf.readFile(outName);
+        if (outSurf.getNumberOfNodes() != 6 || outSurf.getCoordinate(4)[0] != 6.0f)
+        {
+            setFailed("-surface-match output was not scaled to the match surface");
+        }
+        CaretPointer<SurfaceFile> reread = myCache.getSurface(fileName);
+        if (reread != cached)
+        {
+            setFailed("the input surface was not served from the cache");
+        }
+        if (reread->getCoordinate(4)[0] != 2.0f)
+        {
+            setFailed("-surface-match modified the cached input surface");
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    CommandParser::setInputCache(NULL);
+    QFile::remove(fileName);
+    QFile::remove(matchName);
+    QFile::remove(outName);
+}
@@ -22,6 +22,7 @@
 #include "GeodesicHelper.h"
 #include "SurfaceFile.h"
 
+#include <algorithm>
 #include <cstdlib>
 
 using namespace caret;
@@ -96,4 +97,45 @@ void GeodesicHelperTest::execute()
         checkNodeLists(this, "Comparing normal to quarter areas, getPathFollowingData", nodesNorm, nodesQuarter);
         checkNodeLists(this, "Comparing normal to quad areas, getPathFollowingData", nodesNorm, nodesQuad);
     }
+    const int BATCH_SAMPLES = 200;//enough for several blocks of work
+    const float BATCH_DIST = 10.0f;
+    vector<int32_t> batchRoots(BATCH_SAMPLES);
+    for (int i = 0; i < BATCH_SAMPLES; ++i)
+    {
+        batchRoots[i] = rand() % numNodes;
+    }
+    vector<int64_t> heapStarts, bucketStarts;
+    vector<int32_t> heapNodes, bucketNodes;
+    vector<float> heapDists, bucketDists;
+    normalHelp->getNodesToGeoDist(batchRoots, BATCH_DIST, heapStarts, heapNodes, heapDists);
+    normalHelp->getNodesToGeoDist(batchRoots, BATCH_DIST, bucketStarts, bucketNodes, bucketDists, true, true);
+    for (int i = 0; !failed() && i < BATCH_SAMPLES; ++i)
+    {
+        normalHelp->getNodesToGeoDist(batchRoots[i], BATCH_DIST, nodesNorm, distsNorm);
+        vector<int32_t> heapRow(heapNodes.begin() + heapStarts[i], heapNodes.begin() + heapStarts[i + 1]);
+        checkNodeLists(this, "Comparing single root to batch, getNodesToGeoDist", nodesNorm, heapRow);
+        for (size_t j = 0; !failed() && j < distsNorm.size(); ++j)
+        {
+            if (distsNorm[j] != heapDists[heapStarts[i] + j])
+            {
+                setFailed("Comparing single root to batch, found different distance for root " + AString::number(batchRoots[i]));
+            }
+        }
+        if (failed()) break;
+        vector<pair<int32_t, float> > heapPairs, bucketPairs;//bucket queue doesn't output in sorted order, so sort by node
+        for (int64_t j = heapStarts[i]; j < heapStarts[i + 1]; ++j)
+        {
+            heapPairs.push_back(pair<int32_t, float>(heapNodes[j], heapDists[j]));
+        }
+        for (int64_t j = bucketStarts[i]; j < bucketStarts[i + 1]; ++j)
+        {
+            bucketPairs.push_back(pair<int32_t, float>(bucketNodes[j], bucketDists[j]));
+        }
+        sort(heapPairs.begin(), heapPairs.end());
+        sort(bucketPairs.begin(), bucketPairs.end());
+        if (heapPairs != bucketPairs)
+        {
+            setFailed("Comparing heap to bucket queue, found different result for root " + AString::number(batchRoots[i]));
+        }
+    }
 }
@@ -22,6 +22,8 @@
 #include "CaretMathExpression.h"
 
 #include <cmath>
+#include <cstring>
+#include <limits>
 
 using namespace caret;
 using namespace std;
@@ -55,4 +57,54 @@ void MathExpressionTest::execute()
     {
         setFailed("output value incorrect, expected " + AString::number(correctresult) + ", got " + AString::number(testresult));
     }
+    testBatchMatchesScalar();
+}
+
+void MathExpressionTest::testBatchMatchesScalar()
+{//the compiled evaluator must give exactly the same floats as the tree, including for NaN, inf, and near-equal comparisons
+    const char* expressions[] = { " sin ( - yip * 5 ) + x ^ 3 * ( clamp(1, 3, 5) + 2 ) + - 2 ^ - 2 ",
+                                  "x > 0 && yip < 0 || !x",
+                                  "x == yip || x != 2 * yip",
+                                  "(x >= yip) + (x <= yip) * 2 + (x < 1) * 4",
+                                  "mod(x, yip) + min(x, yip) - max(x, 2) / atan2(x, yip)",
+                                  "asinh(x) + acosh(yip) + atanh(x / 10) + round(x) + ceil(yip) + floor(x) + abs(yip)",
+                                  "ln(x) + exp(yip) + log(x) + sqrt(yip) + tan(x) * cos(yip) + asin(x) + acos(yip) + atan(x) + sinh(x) + cosh(yip) + tanh(x)",
+                                  "PI * x / yip - 3 + clamp(x, yip, 2 * yip)" };
+    const int numValues = 1000;
+    vector<float> xValues(numValues), yipValues(numValues);
+    for (int i = 0; i < numValues; ++i)
+    {
+        xValues[i] = ((i * 37) % 201 - 100) / 7.0f;
+        yipValues[i] = (i % 5 == 0 ? xValues[i] : ((i * 53) % 199 - 99) / 11.0f);
+    }
+    xValues[1] = numeric_limits<float>::quiet_NaN();
+    yipValues[2] = numeric_limits<float>::infinity();
+    xValues[3] = 0.0f;
+    for (int e = 0; e < (int)(sizeof(expressions) / sizeof(expressions[0])); ++e)
+    {
+        CaretMathExpression myExpr(expressions[e]);
+        vector<AString> varNames = myExpr.getVarNames();
+        vector<const float*> inputs(varNames.size());
+        vector<int64_t> strides(varNames.size(), 1);
+        for (int v = 0; v < (int)varNames.size(); ++v)
+        {
+            inputs[v] = (varNames[v] == "x" ? xValues.data() : yipValues.data());
+        }
+        vector<float> batchResult(numValues), vars(varNames.size());
+        myExpr.evaluateBatch(inputs, strides, numValues, batchResult.data());
+        for (int i = 0; i < numValues; ++i)
+        {
+            for (int v = 0; v < (int)varNames.size(); ++v)
+            {
+                vars[v] = inputs[v][i];
+            }
+            float scalarResult = (float)myExpr.evaluate(vars);
+            if (memcmp(&scalarResult, &(batchResult[i]), sizeof(float)) != 0)
+            {
+                setFailed("batch evaluation of '" + AString(expressions[e]) + "' differs from evaluate(), got " +
+                          AString::number(batchResult[i]) + ", expected " + AString::number(scalarResult));
+                break;
+            }
+        }
+    }
 }
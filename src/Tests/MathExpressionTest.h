@@ -26,6 +26,7 @@ namespace caret {
 
    class MathExpressionTest : public TestInterface
    {
+      void testBatchMatchesScalar();
    public:
       MathExpressionTest(const AString& identifier);
       virtual void execute();
@@ -20,9 +20,16 @@
 
 #include "NiftiTest.h"
 
+#include "CaretBinaryFile.h"
+#include "CaretOMP.h"
+#include "ElapsedTimer.h"
 #include "MultiDimIterator.h"
 #include "NiftiIO.h"
 
+#include <QDir>
+#include <QFile>
+
+#include <iostream>
 #include <vector>
 
 using namespace std;
@@ -159,3 +166,208 @@ void NiftiHeaderTest::writeNifti2Header(AString filename, NiftiHeader &header)
     myFile.open(filename, CaretBinaryFile::WRITE_TRUNCATE);
     header.write(myFile, 2);
 }
+
+NiftiParallelReadTest::NiftiParallelReadTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+namespace
+{
+    float parallelReadTestValue(const int64_t& frame, const int64_t& index)
+    {
+        return frame * 1000.0f + (index % 997);//exactly representable in float32, for exact comparison
+    }
+}
+
+void NiftiParallelReadTest::execute()
+{
+    const int64_t DIMS[4] = { 13, 11, 7, 24 };//odd sizes, about 100KB of float32, enough frames for every thread to get some
+    const AString fileName = QDir::tempPath() + "/wb_niftiparallelread_test.nii";
+    const int64_t frameLength = DIMS[0] * DIMS[1] * DIMS[2];
+    vector<int64_t> dims(DIMS, DIMS + 4);
+    {
+        NiftiHeader header;
+        header.setDimensions(dims);
+        header.setDataType(NIFTI_TYPE_FLOAT32);
+        NiftiIO writer;
+        writer.writeNew(fileName, header);
+        vector<float> frame(frameLength);
+        for (int64_t t = 0; t < DIMS[3]; ++t)
+        {
+            for (int64_t i = 0; i < frameLength; ++i)
+            {
+                frame[i] = parallelReadTestValue(t, i);
+            }
+            writer.writeData(frame.data(), 3, vector<int64_t>(1, t));
+        }
+        writer.close();
+    }
+    NiftiIO reader;
+    reader.openRead(fileName);
+    vector<float> serialData(frameLength * DIMS[3]);
+    int numFailed = 0;
+    for (int64_t t = 0; t < DIMS[3]; ++t)
+    {
+        float* serialFrame = serialData.data() + t * frameLength;
+        reader.readData(serialFrame, 3, vector<int64_t>(1, t));
+        for (int64_t i = 0; i < frameLength; ++i)
+        {
+            if (serialFrame[i] != parallelReadTestValue(t, i))
+            {
+                ++numFailed;
+                break;
+            }
+        }
+    }
+    if (numFailed != 0)
+    {
+        reader.close();
+        QFile::remove(fileName);
+        setFailed(AString::number(numFailed) + " frames had incorrect data when read serially");
+        return;
+    }
+#pragma omp CARET_PAR
+    {
+        vector<float> myFrame(frameLength);
+#pragma omp CARET_FOR schedule(dynamic)
+        for (int64_t t = 0; t < DIMS[3]; ++t)
+        {
+            reader.readData(myFrame.data(), 3, vector<int64_t>(1, t));
+            const float* serialFrame = serialData.data() + t * frameLength;
+            for (int64_t i = 0; i < frameLength; ++i)
+            {
+                if (myFrame[i] != serialFrame[i])
+                {
+#pragma omp atomic
+                    ++numFailed;
+                    break;
+                }
+            }
+        }
+    }
+    reader.close();
+    QFile::remove(fileName);
+    if (numFailed != 0)
+    {
+        setFailed(AString::number(numFailed) + " frames read concurrently differed from the serial read");
+    }
+}
+
+NiftiGzipRoundTripTest::NiftiGzipRoundTripTest(const AString& identifier, const bool& benchmark) : TestInterface(identifier)
+{
+    m_benchmark = benchmark;
+}
+
+namespace
+{
+    const int64_t GZIP_TEST_DIMS[4] = { 23, 27, 23, 12 };//odd sizes, about 700KB of float32, spans several compressed blocks
+    const int64_t GZIP_BENCHMARK_DIMS[4] = { 91, 109, 91, 40 };//2mm MNI space, about 140MB of float32
+    
+    float gzipTestValue(const int64_t& i, const int64_t& j, const int64_t& k, const int64_t& t)
+    {//smooth spatial pattern plus a small pseudorandom part, so it compresses like real data rather than trivially, exactly representable
+        int64_t noise = ((i * 73856093) ^ (j * 19349663) ^ (k * 83492791) ^ (t * 2654435761LL)) & 255;
+        return (float)(((i * 7 + j * 5 + k * 3 + t * 11) % 4096) * 4 + noise) * 0.25f;
+    }
+}
+
+void NiftiGzipRoundTripTest::roundTrip(const AString& fileName, const bool& blockCompressed)
+{
+    const int64_t* testDims = (m_benchmark ? GZIP_BENCHMARK_DIMS : GZIP_TEST_DIMS);
+    const int64_t frameLength = testDims[0] * testDims[1] * testDims[2];
+    const double totalMB = frameLength * testDims[3] * sizeof(float) / (1024.0 * 1024.0);
+    vector<int64_t> dims(testDims, testDims + 4);
+    vector<float> frame(frameLength);
+    ElapsedTimer myTimer;
+    bool oldSetting = CaretBinaryFile::getWriteBlockCompressed();
+    CaretBinaryFile::setWriteBlockCompressed(blockCompressed);
+    try
+    {
+        double writeTime = 0.0;
+        {
+            NiftiHeader header;
+            header.setDimensions(dims);
+            header.setDataType(NIFTI_TYPE_FLOAT32);
+            NiftiIO writer;
+            writer.writeNew(fileName, header);
+            for (int64_t t = 0; t < testDims[3]; ++t)
+            {
+                int64_t index = 0;
+                for (int64_t k = 0; k < testDims[2]; ++k)
+                {
+                    for (int64_t j = 0; j < testDims[1]; ++j)
+                    {
+                        for (int64_t i = 0; i < testDims[0]; ++i)
+                        {
+                            frame[index] = gzipTestValue(i, j, k, t);
+                            ++index;
+                        }
+                    }
+                }
+                myTimer.start();//time only the nifti calls
+                writer.writeData(frame.data(), 3, vector<int64_t>(1, t));
+                writeTime += myTimer.getElapsedTimeSeconds();
+            }
+            myTimer.start();
+            writer.close();
+            writeTime += myTimer.getElapsedTimeSeconds();
+        }
+        CaretBinaryFile::setWriteBlockCompressed(oldSetting);
+        double readTime = 0.0;
+        int64_t numWrong = 0;
+        {
+            NiftiIO reader;
+            myTimer.start();
+            reader.openRead(fileName);
+            readTime += myTimer.getElapsedTimeSeconds();
+            for (int64_t t = 0; t < testDims[3]; ++t)
+            {
+                myTimer.start();
+                reader.readData(frame.data(), 3, vector<int64_t>(1, t));
+                readTime += myTimer.getElapsedTimeSeconds();
+                int64_t index = 0;
+                for (int64_t k = 0; k < testDims[2]; ++k)
+                {
+                    for (int64_t j = 0; j < testDims[1]; ++j)
+                    {
+                        for (int64_t i = 0; i < testDims[0]; ++i)
+                        {
+                            if (frame[index] != gzipTestValue(i, j, k, t)) ++numWrong;
+                            ++index;
+                        }
+                    }
+                }
+            }
+        }
+        QFile::remove(fileName);
+        QFile::remove(fileName + ".gzi");
+        if (numWrong != 0)
+        {
+            setFailed(AString::number(numWrong) + " voxels had incorrect values after round trip through " + (blockCompressed ? "block compressed" : "gzip") + " file");
+            return;
+        }
+        if (m_benchmark && writeTime > 0.0 && readTime > 0.0)
+        {
+            cout << (blockCompressed ? "block compressed: " : "gzip stream: ") << "save " << totalMB / writeTime << " MB/s, load " << totalMB / readTime << " MB/s" << endl;
+        }
+    } catch (CaretException& e) {
+        CaretBinaryFile::setWriteBlockCompressed(oldSetting);
+        QFile::remove(fileName);
+        QFile::remove(fileName + ".gzi");
+        setFailed(e.whatString());
+    }
+}
+
+void NiftiGzipRoundTripTest::execute()
+{
+    if (m_benchmark)
+    {
+        int numThreads = 1;
+#ifdef CARET_OMP
+        numThreads = omp_get_max_threads();
+#endif
+        cout << "using " << numThreads << " threads" << endl;
+    }
+    roundTrip(QDir::tempPath() + "/wb_niftigziproundtrip_test.nii.gz", false);
+    if (failed()) return;
+    roundTrip(QDir::tempPath() + "/wb_niftigziproundtrip_test_block.nii.gz", true);
+}
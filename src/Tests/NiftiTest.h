@@ -44,6 +44,25 @@ public:
     void writeNifti2Header(AString filename, NiftiHeader &header);
 };
 
+//checks that concurrent frame reads from one NiftiIO object match a serial read
+class NiftiParallelReadTest : public TestInterface
+{
+public:
+    NiftiParallelReadTest(const AString& identifier);
+    virtual void execute();
+};
+
+//round trips a small volume series through .nii.gz, as a single gzip stream and block compressed
+//as a benchmark, uses an HCP-sized volume series instead, and reports save and load throughput
+class NiftiGzipRoundTripTest : public TestInterface
+{
+    bool m_benchmark;
+    void roundTrip(const AString& fileName, const bool& blockCompressed);
+public:
+    NiftiGzipRoundTripTest(const AString& identifier, const bool& benchmark = false);
+    virtual void execute();
+};
+
 
 }
 
@@ -0,0 +1,320 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "RayIntersectTest.h"
+
+#include "CaretPointer.h"
+#include "SignedDistanceHelper.h"
+#include "SurfaceFile.h"
+#include "Vector3D.h"
+#include "VolumeFile.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    class SimpleRandom
+    {
+        uint32_t m_state;
+    public:
+        SimpleRandom(const uint32_t& seed) { m_state = seed; }
+        ///uniform in [low, high)
+        float next(const float& low, const float& high)
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return low + (high - low) * ((m_state >> 8) / 16777216.0f);
+        }
+    };
+    
+    ///same math as the helper, so that the same triangles are hit, either winding
+    bool rayHitsTriangle(const SurfaceFile& mySurf, const int32_t& triangle, const float start[3], const float direction[3], float& tOut)
+    {
+        const int32_t* triNodes = mySurf.getTriangle(triangle);
+        Vector3D vert1 = mySurf.getCoordinate(triNodes[0]);
+        Vector3D vert2 = mySurf.getCoordinate(triNodes[1]);
+        Vector3D vert3 = mySurf.getCoordinate(triNodes[2]);
+        Vector3D rayDir = direction;
+        Vector3D edge1 = vert2 - vert1;
+        Vector3D edge2 = vert3 - vert1;
+        Vector3D pvec = rayDir.cross(edge2);
+        float det = edge1.dot(pvec);
+        if (det == 0.0f) return false;
+        float invDet = 1.0f / det;
+        Vector3D tvec = Vector3D(start) - vert1;
+        float u = tvec.dot(pvec) * invDet;
+        if (u < 0.0f || u > 1.0f) return false;
+        Vector3D qvec = tvec.cross(edge1);
+        float v = rayDir.dot(qvec) * invDet;
+        if (v < 0.0f || u + v > 1.0f) return false;
+        tOut = edge2.dot(qvec) * invDet;
+        return tOut >= 0.0f;
+    }
+}
+
+SurfaceRayIntersectTest::SurfaceRayIntersectTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void SurfaceRayIntersectTest::execute()
+{
+    //two bumpy sheets, one above the other, with alternating triangle winding, so rays can pass through one to hit the other
+    const int gridSize = 12;
+    const float spacing = 2.0f;
+    const int numNodes = 2 * gridSize * gridSize, numTris = 2 * 2 * (gridSize - 1) * (gridSize - 1);
+    SurfaceFile mySurf;
+    mySurf.setNumberOfNodesAndTriangles(numNodes, numTris);
+    mySurf.setStructure(StructureEnum::CORTEX_LEFT);
+    int tri = 0;
+    for (int sheet = 0; sheet < 2; ++sheet)
+    {
+        const int base = sheet * gridSize * gridSize;
+        for (int i = 0; i < gridSize; ++i)
+        {
+            for (int j = 0; j < gridSize; ++j)
+            {
+                const float x = i * spacing, y = j * spacing;
+                mySurf.setCoordinate(base + i * gridSize + j, x, y, sheet * 8.0f + 3.0f * sin(x * 0.4f) * cos(y * 0.3f));
+            }
+        }
+        for (int i = 0; i < gridSize - 1; ++i)
+        {
+            for (int j = 0; j < gridSize - 1; ++j)
+            {
+                const int corner = base + i * gridSize + j;
+                if ((i + j) % 2 == 0)
+                {
+                    mySurf.setTriangle(tri++, corner, corner + gridSize, corner + 1);
+                    mySurf.setTriangle(tri++, corner + 1, corner + gridSize, corner + gridSize + 1);
+                } else {
+                    mySurf.setTriangle(tri++, corner, corner + 1, corner + gridSize);
+                    mySurf.setTriangle(tri++, corner + 1, corner + gridSize + 1, corner + gridSize);
+                }
+            }
+        }
+    }
+    CaretPointer<SignedDistanceHelper> myHelper = mySurf.getSignedDistanceHelper();
+    SimpleRandom myRandom(4321);
+    const int numRays = 2000;
+    int numHits = 0;
+    for (int r = 0; r < numRays; ++r)
+    {
+        float start[3], direction[3];
+        start[0] = myRandom.next(-5.0f, 27.0f);
+        start[1] = myRandom.next(-5.0f, 27.0f);
+        start[2] = myRandom.next(-10.0f, 18.0f);
+        for (int i = 0; i < 3; ++i) direction[i] = myRandom.next(-1.0f, 1.0f);
+        if (r % 4 == 0)
+        {//axis aligned, to test the parallel cases
+            direction[0] = 0.0f;
+            direction[1] = 0.0f;
+            direction[2] = (r % 8 == 0 ? -0.5f : 2.0f);
+        }
+        bool expectHit = false;
+        float expectT = numeric_limits<float>::max();
+        for (int t = 0; t < numTris; ++t)
+        {
+            float tempt;
+            if (rayHitsTriangle(mySurf, t, start, direction, tempt) && tempt < expectT)
+            {
+                expectHit = true;
+                expectT = tempt;
+            }
+        }
+        BarycentricInfo hit;
+        bool gotHit = myHelper->rayIntersection(start, direction, hit);
+        if (gotHit != expectHit)
+        {
+            setFailed("ray " + AString::number(r) + (expectHit ? " missed the surface" : " hit the surface where it should not"));
+            return;
+        }
+        if (!gotHit) continue;
+        ++numHits;
+        const float tolerance = 0.00001f * max(1.0f, expectT);
+        if (abs(hit.absDistance - expectT) > tolerance)
+        {//ties at a shared edge can give a different triangle, but never a different distance
+            setFailed("ray " + AString::number(r) + " hit at distance " + AString::number(hit.absDistance) + ", expected " + AString::number(expectT));
+            return;
+        }
+        float expectTriT;
+        if (!rayHitsTriangle(mySurf, hit.triangle, start, direction, expectTriT) || abs(expectTriT - expectT) > tolerance)
+        {
+            setFailed("ray " + AString::number(r) + " reported triangle " + AString::number(hit.triangle) + ", which it does not hit at that distance");
+            return;
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            if (abs(hit.point[i] - (start[i] + expectT * direction[i])) > 0.0001f)
+            {
+                setFailed("ray " + AString::number(r) + " reported a hit point that is not on the ray");
+                return;
+            }
+        }
+        float baryPoint[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 3; ++i)
+        {
+            const float* coord = mySurf.getCoordinate(hit.nodes[i]);
+            for (int j = 0; j < 3; ++j) baryPoint[j] += hit.baryWeights[i] * coord[j];
+        }
+        for (int j = 0; j < 3; ++j)
+        {
+            if (abs(baryPoint[j] - hit.point[j]) > 0.001f)
+            {
+                setFailed("ray " + AString::number(r) + " reported barycentric weights that do not give the hit point");
+                return;
+            }
+        }
+    }
+    if (numHits < numRays / 10)
+    {
+        setFailed("only " + AString::number(numHits) + " rays hit the surface, the test is not testing much");
+    }
+    float start[3] = { 5.0f, 5.0f, 30.0f }, zeroDir[3] = { 0.0f, 0.0f, 0.0f };
+    BarycentricInfo hit;
+    if (myHelper->rayIntersection(start, zeroDir, hit))
+    {
+        setFailed("a zero length direction hit the surface");
+    }
+}
+
+VolumeRayIntersectTest::VolumeRayIntersectTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void VolumeRayIntersectTest::execute()
+{
+    vector<int64_t> dims(3);
+    dims[0] = 13; dims[1] = 11; dims[2] = 9;
+    vector<vector<float> > sform(3, vector<float>(4));//oblique, so the ray is not axis aligned in index space
+    sform[0][0] = 1.5f; sform[0][1] = 0.2f; sform[0][2] = 0.0f; sform[0][3] = -10.0f;
+    sform[1][0] = 0.0f; sform[1][1] = 2.0f; sform[1][2] = 0.3f; sform[1][3] = -8.0f;
+    sform[2][0] = 0.1f; sform[2][1] = 0.0f; sform[2][2] = 2.5f; sform[2][3] = -12.0f;
+    VolumeFile myVol;
+    myVol.reinitialize(dims, sform);
+    const float threshold = 0.5f;
+    SimpleRandom myRandom(98765);
+    for (int64_t k = 0; k < dims[2]; ++k)
+    {
+        for (int64_t j = 0; j < dims[1]; ++j)
+        {
+            for (int64_t i = 0; i < dims[0]; ++i)
+            {
+                float chance = myRandom.next(0.0f, 1.0f);
+                float value = 0.0f;
+                if (chance < 0.04f)
+                {
+                    value = -1.0f;//absolute value counts
+                } else if (chance < 0.08f) {
+                    value = 2.0f;
+                } else if (chance < 0.12f) {
+                    value = 0.3f;//below threshold
+                }
+                myVol.setValue(value, i, j, k);
+            }
+        }
+    }
+    const int numRays = 2000;
+    int numHits = 0;
+    for (int r = 0; r < numRays; ++r)
+    {
+        float start[3], direction[3];
+        start[0] = myRandom.next(-20.0f, 20.0f);
+        start[1] = myRandom.next(-20.0f, 20.0f);
+        start[2] = myRandom.next(-20.0f, 20.0f);
+        for (int i = 0; i < 3; ++i) direction[i] = myRandom.next(-1.0f, 1.0f);
+        if (r % 4 == 0)
+        {//along the i axis of the volume
+            for (int i = 0; i < 3; ++i) direction[i] = (r % 8 == 0 ? -sform[i][0] : sform[i][0]);
+        } else if (r % 2 == 1) {//toward somewhere in the volume, most random rays miss it
+            const float target[3] = { myRandom.next(-8.0f, 8.0f), myRandom.next(-6.0f, 12.0f), myRandom.next(-10.0f, 8.0f) };
+            for (int i = 0; i < 3; ++i) direction[i] = target[i] - start[i];
+        }
+        float idxStart[3], idxEnd[3], idxDir[3];
+        myVol.spaceToIndex(start, idxStart);
+        myVol.spaceToIndex(start[0] + direction[0], start[1] + direction[1], start[2] + direction[2], idxEnd);
+        for (int i = 0; i < 3; ++i)
+        {
+            idxStart[i] += 0.5f;
+            idxEnd[i] += 0.5f;
+            idxDir[i] = idxEnd[i] - idxStart[i];
+        }
+        bool expectHit = false;
+        float expectT = numeric_limits<float>::max();
+        for (int64_t k = 0; k < dims[2]; ++k)
+        {
+            for (int64_t j = 0; j < dims[1]; ++j)
+            {
+                for (int64_t i = 0; i < dims[0]; ++i)
+                {
+                    if (abs(myVol.getValue(i, j, k)) <= threshold) continue;
+                    const int64_t voxel[3] = { i, j, k };
+                    float tenter = 0.0f, texit = numeric_limits<float>::max();
+                    bool inside = true;
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        if (idxDir[axis] != 0.0f)
+                        {
+                            float tlow = (voxel[axis] - idxStart[axis]) / idxDir[axis];
+                            float thigh = (voxel[axis] + 1 - idxStart[axis]) / idxDir[axis];
+                            if (tlow > thigh) swap(tlow, thigh);
+                            tenter = max(tenter, tlow);
+                            texit = min(texit, thigh);
+                        } else if (idxStart[axis] < voxel[axis] || idxStart[axis] >= voxel[axis] + 1) {
+                            inside = false;
+                        }
+                    }
+                    if (inside && tenter <= texit && tenter < expectT)
+                    {
+                        expectHit = true;
+                        expectT = tenter;
+                    }
+                }
+            }
+        }
+        int64_t ijk[3];
+        float distance;
+        bool gotHit = myVol.rayIntersectVoxel(start, direction, threshold, ijk, &distance);
+        if (gotHit != expectHit)
+        {
+            setFailed("ray " + AString::number(r) + (expectHit ? " missed the voxels" : " hit a voxel where it should not"));
+            return;
+        }
+        if (!gotHit) continue;
+        ++numHits;
+        if (abs(myVol.getValue(ijk)) <= threshold)
+        {
+            setFailed("ray " + AString::number(r) + " reported a voxel that is not above the threshold");
+            return;
+        }
+        if (abs(distance - expectT) > 0.0001f * max(1.0f, expectT))
+        {
+            setFailed("ray " + AString::number(r) + " entered the voxel at " + AString::number(distance) + ", expected " + AString::number(expectT));
+            return;
+        }
+    }
+    if (numHits < numRays / 10)
+    {
+        setFailed("only " + AString::number(numHits) + " rays hit a voxel, the test is not testing much");
+    }
+}
@@ -0,0 +1,152 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "RowBlockPipelineTest.h"
+#include "CaretException.h"
+#include "RowBlockPipeline.h"
+
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    ///doubles each input item, records the order of reads and writes, and can fail a chosen read or part
+    class DoublingProcessor : public RowBlockPipeline::Processor
+    {
+        const vector<float>& m_input;
+        vector<float> m_slotData[RowBlockPipeline::NUM_SLOTS];
+    public:
+        vector<float> m_output;
+        int64_t m_nextRead, m_nextWrite, m_failRead, m_failProcess;
+        bool m_outOfOrder, m_failOutOfMemory;
+        DoublingProcessor(const vector<float>& input) : m_input(input)
+        {
+            m_output.resize(input.size(), -1.0f);
+            m_nextRead = 0;
+            m_nextWrite = 0;
+            m_failRead = -1;
+            m_failProcess = -1;
+            m_outOfOrder = false;
+            m_failOutOfMemory = false;
+        }
+        void readBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            if (firstItem != m_nextRead) m_outOfOrder = true;
+            m_nextRead = firstItem + numItems;
+            if (firstItem == m_failRead) throw CaretException("requested failure");
+            m_slotData[slot].assign(m_input.begin() + firstItem, m_input.begin() + firstItem + numItems);
+        }
+        void processBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot, const int& part, const int& numParts)
+        {
+            int64_t start, end;
+            RowBlockPipeline::getPartRange(numItems, part, numParts, start, end);
+            if (firstItem + start <= m_failProcess && m_failProcess < firstItem + end)
+            {//exceptions other than CaretException, from a processing thread
+                if (m_failOutOfMemory) throw bad_alloc();
+                throw runtime_error("requested processing failure");
+            }
+            for (int64_t i = start; i < end; ++i)
+            {
+                m_slotData[slot][i] *= 2.0f;
+            }
+        }
+        void writeBlock(const int64_t& firstItem, const int64_t& numItems, const int& slot)
+        {
+            if (firstItem != m_nextWrite) m_outOfOrder = true;
+            m_nextWrite = firstItem + numItems;
+            for (int64_t i = 0; i < numItems; ++i)
+            {
+                m_output[firstItem + i] = m_slotData[slot][i];
+            }
+        }
+    };
+}
+
+RowBlockPipelineTest::RowBlockPipelineTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void RowBlockPipelineTest::execute()
+{
+    const int64_t sizes[] = { 0, 1, 2, 7, 100, 1001 };
+    const int64_t blockSizes[] = { 1, 3, 64, 5000 };
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+    {
+        vector<float> input(sizes[s]);
+        for (int64_t i = 0; i < sizes[s]; ++i)
+        {
+            input[i] = (float)i;
+        }
+        for (int b = 0; b < (int)(sizeof(blockSizes) / sizeof(blockSizes[0])); ++b)
+        {
+            DoublingProcessor myProcessor(input);
+            RowBlockPipeline::run(myProcessor, sizes[s], blockSizes[b]);
+            const AString where = " with " + AString::number(sizes[s]) + " items in blocks of " + AString::number(blockSizes[b]);
+            if (myProcessor.m_outOfOrder) setFailed("blocks read or written out of order" + where);
+            if (myProcessor.m_nextRead != sizes[s] || myProcessor.m_nextWrite != sizes[s]) setFailed("not all blocks were read and written" + where);
+            for (int64_t i = 0; i < sizes[s]; ++i)
+            {
+                if (myProcessor.m_output[i] != 2.0f * i)
+                {
+                    setFailed("wrong output at item " + AString::number(i) + where);
+                    break;
+                }
+            }
+        }
+    }
+    vector<float> input(100, 1.0f);
+    DoublingProcessor myProcessor(input);
+    myProcessor.m_failRead = 40;
+    bool caught = false;
+    try
+    {
+        RowBlockPipeline::run(myProcessor, 100, 10);
+    } catch (CaretException& e) {
+        caught = true;
+        if (e.whatString() != "requested failure") setFailed("wrong error message from failed read: " + e.whatString());
+    }
+    if (!caught) setFailed("exception from read was not rethrown");
+    if (myProcessor.m_nextWrite > 40) setFailed("blocks after a failed read were written");
+    DoublingProcessor otherProcessor(input);
+    otherProcessor.m_failProcess = 55;
+    try
+    {
+        RowBlockPipeline::run(otherProcessor, 100, 10);
+        setFailed("exception from processing was not rethrown");
+    } catch (exception& e) {//CaretException with openmp, the original exception without
+        if (AString(e.what()) != "requested processing failure") setFailed("wrong error message from failed processing: " + AString(e.what()));
+    }
+    DoublingProcessor memoryProcessor(input);
+    memoryProcessor.m_failProcess = 55;
+    memoryProcessor.m_failOutOfMemory = true;
+    caught = false;
+    try
+    {
+        RowBlockPipeline::run(memoryProcessor, 100, 10);
+    } catch (bad_alloc&) {
+        caught = true;
+    } catch (exception&) {
+    }
+    if (!caught) setFailed("bad_alloc from processing was not rethrown as bad_alloc");
+}
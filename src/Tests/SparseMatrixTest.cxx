@@ -0,0 +1,179 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2014  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+#include "SparseMatrixTest.h"
+
+#include "SparseMatrixCSR.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    ///the same products as the matrix, summed in double over a dense copy, so only the summation order differs
+    void denseMultiply(const vector<vector<float> >& dense, const float* in, vector<double>& out)
+    {
+        out.assign(dense.size(), 0.0);
+        for (size_t i = 0; i < dense.size(); ++i)
+        {
+            for (size_t j = 0; j < dense[i].size(); ++j)
+            {
+                out[i] += (double)(in[j] * dense[i][j]);
+            }
+        }
+    }
+    
+    bool closeEnough(const float& actual, const double& expected)
+    {
+        return abs(actual - expected) <= 1e-5 * max(1.0, abs(expected));
+    }
+}
+
+SparseMatrixTest::SparseMatrixTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void SparseMatrixTest::execute()
+{
+    const int NUM_ROWS = 1201, NUM_COLS = 803;
+    const int NUM_VECTORS = 300;//more than one block of vectors, and not a multiple of the block size
+    vector<int64_t> rowStarts(1, 0);
+    vector<int32_t> indices;
+    vector<float> values;
+    vector<vector<float> > dense(NUM_ROWS, vector<float>(NUM_COLS, 0.0f));
+    vector<vector<char> > hasEntry(NUM_ROWS, vector<char>(NUM_COLS, 0));
+    for (int i = 0; i < NUM_ROWS; ++i)
+    {
+        int rowLength = (i % 13 == 0 ? 0 : 1 + rand() % 20);//include some empty rows
+        for (int j = 0; j < rowLength; ++j)
+        {
+            int32_t column = rand() % NUM_COLS;
+            if (hasEntry[i][column]) continue;//keep entries unique, so the dense copy has the same products
+            hasEntry[i][column] = 1;
+            indices.push_back(column);
+            values.push_back(((float)rand()) / RAND_MAX);
+            dense[i][column] = values.back();
+        }
+        rowStarts.push_back((int64_t)indices.size());
+    }
+    SparseMatrixCSR myMatrix;
+    myMatrix.swapIn(NUM_COLS, rowStarts, indices, values);
+    if (myMatrix.getNumberOfRows() != NUM_ROWS || myMatrix.getNumberOfColumns() != NUM_COLS)
+    {
+        setFailed("matrix has wrong dimensions after swapIn");
+        return;
+    }
+    vector<float> interleavedIn((int64_t)NUM_COLS * NUM_VECTORS), interleavedOut((int64_t)NUM_ROWS * NUM_VECTORS);
+    for (int64_t i = 0; i < (int64_t)interleavedIn.size(); ++i)
+    {
+        interleavedIn[i] = ((float)rand()) / RAND_MAX - 0.5f;
+    }
+    const float EMPTY_VAL = -7.0f;
+    myMatrix.multiplyInterleaved(interleavedIn.data(), NUM_VECTORS, interleavedOut.data(), NUM_VECTORS, NUM_VECTORS, EMPTY_VAL);
+    vector<float> column(NUM_COLS), result(NUM_ROWS);
+    vector<double> reference;
+    for (int v = 0; v < NUM_VECTORS; ++v)
+    {
+        for (int i = 0; i < NUM_COLS; ++i)
+        {
+            column[i] = interleavedIn[(int64_t)i * NUM_VECTORS + v];
+        }
+        myMatrix.multiply(column.data(), result.data(), EMPTY_VAL);
+        denseMultiply(dense, column.data(), reference);
+        for (int i = 0; i < NUM_ROWS; ++i)
+        {
+            if (result[i] != interleavedOut[(int64_t)i * NUM_VECTORS + v])//same operations in the same order, so should be exactly equal
+            {
+                setFailed("interleaved multiply differs from single vector multiply at row " + AString::number(i) + ", vector " + AString::number(v));
+                return;
+            }
+            const bool emptyRow = (i % 13 == 0);
+            if (emptyRow ? result[i] != EMPTY_VAL : !closeEnough(result[i], reference[i]))
+            {
+                setFailed("multiply differs from dense reference at row " + AString::number(i) + ", vector " + AString::number(v));
+                return;
+            }
+        }
+    }
+    vector<float> rowMask(NUM_ROWS), colMask(NUM_COLS);
+    for (int i = 0; i < NUM_ROWS; ++i) rowMask[i] = (float)(i % 2);
+    for (int i = 0; i < NUM_COLS; ++i) colMask[i] = (float)(i % 3 != 0);
+    SparseMatrixCSR masked;
+    myMatrix.getMasked(rowMask.data(), colMask.data(), masked);
+    if (masked.getNumberOfRows() != NUM_ROWS || masked.getNumberOfColumns() != NUM_COLS)
+    {
+        setFailed("masked matrix has wrong dimensions");
+        return;
+    }
+    vector<vector<float> > maskedDense(dense);
+    vector<int64_t> maskedCounts(NUM_ROWS, 0);
+    for (int i = 0; i < NUM_ROWS; ++i)
+    {
+        for (int j = 0; j < NUM_COLS; ++j)
+        {
+            if (!(rowMask[i] > 0.0f) || !(colMask[j] > 0.0f))
+            {
+                maskedDense[i][j] = 0.0f;
+            } else if (hasEntry[i][j]) {
+                ++maskedCounts[i];
+            }
+        }
+    }
+    const vector<int64_t>& maskStarts = masked.getRowStarts();
+    const vector<int32_t>& maskIndices = masked.getIndices();
+    const vector<float>& maskValues = masked.getValues();
+    for (int i = 0; i < NUM_ROWS; ++i)
+    {
+        if (maskStarts[i + 1] - maskStarts[i] != maskedCounts[i])
+        {
+            setFailed("masked matrix has wrong number of entries in row " + AString::number(i));
+            return;
+        }
+        for (int64_t j = maskStarts[i]; j < maskStarts[i + 1]; ++j)
+        {
+            if (maskValues[j] != maskedDense[i][maskIndices[j]])
+            {
+                setFailed("masked matrix has wrong value or masked column in row " + AString::number(i));
+                return;
+            }
+        }
+    }
+    for (int v = 0; v < 3; ++v)
+    {//rows that lost all their entries get the empty value
+        for (int i = 0; i < NUM_COLS; ++i)
+        {
+            column[i] = interleavedIn[(int64_t)i * NUM_VECTORS + v];
+        }
+        masked.multiply(column.data(), result.data(), EMPTY_VAL);
+        denseMultiply(maskedDense, column.data(), reference);
+        for (int i = 0; i < NUM_ROWS; ++i)
+        {
+            if (maskedCounts[i] == 0 ? result[i] != EMPTY_VAL : !closeEnough(result[i], reference[i]))
+            {
+                setFailed("masked multiply differs from dense reference at row " + AString::number(i) + ", vector " + AString::number(v));
+                return;
+            }
+        }
+    }
+}
@@ -20,13 +20,107 @@
 #include "StatisticsTest.h"
 #include <cstdlib>
 #include <cmath>
+#include <limits>
+#include <sstream>
 
-#include "FastStatistics.h"
+#include "CaretException.h"
+#include "CiftiFile.h"
+#include "CiftiMapStatisticsCache.h"
 #include "DescriptiveStatistics.h"
+#include "FastStatistics.h"
+#include "FileInformation.h"
+#include "Histogram.h"
+
+#include <QDir>
+#include <QFile>
 
 using namespace caret;
 using namespace std;
 
+namespace
+{
+    ///data with every kind of value the statistics count separately
+    vector<float> makeSpecialData(const int& seed, const int& count)
+    {
+        vector<float> ret(count);
+        for (int i = 0; i < count; ++i)
+        {
+            ret[i] = ((i * 37 + seed * 11) % 101) * 0.37f - 10.0f;
+        }
+        if (count > 4)
+        {
+            ret[0] = 0.0f;
+            ret[1] = numeric_limits<float>::infinity();
+            ret[2] = -numeric_limits<float>::infinity();
+            ret[3] = numeric_limits<float>::quiet_NaN();
+        }
+        return ret;
+    }
+    
+    ///exact comparison, for values that should have been copied rather than recomputed
+    bool sameFloat(const float& a, const float& b)
+    {
+        if (a != a) return b != b;//NaN
+        return a == b;
+    }
+    
+    bool sameFastStatistics(TestInterface& myTest, const AString& what, const FastStatistics& a, const FastStatistics& b)
+    {
+        int64_t countsA[6], countsB[6];
+        a.getCounts(countsA[0], countsA[1], countsA[2], countsA[3], countsA[4], countsA[5]);
+        b.getCounts(countsB[0], countsB[1], countsB[2], countsB[3], countsB[4], countsB[5]);
+        float rangesA[4], rangesB[4];
+        a.getNonzeroRanges(rangesA[0], rangesA[1], rangesA[2], rangesA[3]);
+        b.getNonzeroRanges(rangesB[0], rangesB[1], rangesB[2], rangesB[3]);
+        bool same = sameFloat(a.getMin(), b.getMin()) && sameFloat(a.getMax(), b.getMax()) && sameFloat(a.getMean(), b.getMean()) &&
+                    sameFloat(a.getSampleStdDev(), b.getSampleStdDev()) && sameFloat(a.getPopulationStdDev(), b.getPopulationStdDev()) &&
+                    sameFloat(a.getApproximateMedian(), b.getApproximateMedian()) &&
+                    sameFloat(a.getApproxPositivePercentile(90.0f), b.getApproxPositivePercentile(90.0f)) &&
+                    sameFloat(a.getApproxNegativePercentile(90.0f), b.getApproxNegativePercentile(90.0f)) &&
+                    sameFloat(a.getApproxAbsolutePercentile(50.0f), b.getApproxAbsolutePercentile(50.0f)) &&
+                    sameFloat(a.getPositiveValuePercentile(5.0f), b.getPositiveValuePercentile(5.0f)) &&
+                    sameFloat(a.getNegativeValuePercentile(-5.0f), b.getNegativeValuePercentile(-5.0f)) &&
+                    sameFloat(a.getAbsoluteValuePercentile(5.0f), b.getAbsoluteValuePercentile(5.0f));
+        for (int i = 0; i < 6; ++i) same = same && countsA[i] == countsB[i];
+        for (int i = 0; i < 4; ++i) same = same && sameFloat(rangesA[i], rangesB[i]);
+        if (!same) myTest.setFailed(what + ": fast statistics differ");
+        return same;
+    }
+    
+    bool sameHistogram(TestInterface& myTest, const AString& what, const Histogram& a, const Histogram& b)
+    {
+        int64_t countsA[6], countsB[6];
+        a.getCounts(countsA[0], countsA[1], countsA[2], countsA[3], countsA[4], countsA[5]);
+        b.getCounts(countsB[0], countsB[1], countsB[2], countsB[3], countsB[4], countsB[5]);
+        float minA, maxA, minB, maxB;
+        a.getRange(minA, maxA);
+        b.getRange(minB, maxB);
+        bool same = a.getHistogramCounts() == b.getHistogramCounts() && a.getHistogramCumulativeCounts() == b.getHistogramCumulativeCounts() &&
+                    a.getHistogramDisplay() == b.getHistogramDisplay() && sameFloat(minA, minB) && sameFloat(maxA, maxB);
+        for (int i = 0; i < 6; ++i) same = same && countsA[i] == countsB[i];
+        if (!same) myTest.setFailed(what + ": histograms differ");
+        return same;
+    }
+    
+    CiftiMapStatisticsCache::Statistics makeStatistics(const int& numMaps, const int& mapLength)
+    {
+        CiftiMapStatisticsCache::Statistics ret;
+        ret.m_mapFastStatistics.resize(numMaps);
+        ret.m_mapHistograms.resize(numMaps);
+        vector<float> allData;
+        for (int i = 0; i < numMaps; ++i)
+        {
+            vector<float> data = makeSpecialData(i, mapLength);
+            if (i != 1) ret.m_mapFastStatistics[i].grabNew(new FastStatistics(data.data(), data.size()));//leave one map partly missing
+            ret.m_mapHistograms[i].grabNew(new Histogram());
+            ret.m_mapHistograms[i]->update(data.data(), data.size());
+            allData.insert(allData.end(), data.begin(), data.end());
+        }
+        ret.m_fileFastStatistics.grabNew(new FastStatistics(allData.data(), allData.size()));
+        return ret;
+    }
+}
+
 StatisticsTest::StatisticsTest(const AString& identifier) : TestInterface(identifier)
 {
 }
@@ -77,3 +171,221 @@ void StatisticsTest::execute()
         setFailed(AString("mismatch in 90% negative percentile, full: ") + AString::number(myFullStats.getNegativePercentile(90.0f)) + ", fast: " + AString::number(myFastStats.getApproxNegativePercentile(90.0f)));
     }
 }
+
+StatisticsBinaryTest::StatisticsBinaryTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void StatisticsBinaryTest::execute()
+{
+    const int sizes[] = { 1, 7, 1000 };
+    for (int i = 0; i < 3; ++i)
+    {
+        const AString what = AString::number(sizes[i]) + " elements";
+        vector<float> data = makeSpecialData(i, sizes[i]);
+        FastStatistics myFastStats(data.data(), data.size()), readFastStats;
+        Histogram myHist, readHist;
+        myHist.update(data.data(), data.size());
+        stringstream myStream;
+        myFastStats.writeBinary(myStream);
+        myHist.writeBinary(myStream);
+        if (!readFastStats.readBinary(myStream))
+        {
+            setFailed(what + ": failed to read fast statistics");
+            return;
+        }
+        if (!readHist.readBinary(myStream))
+        {
+            setFailed(what + ": failed to read histogram");
+            return;
+        }
+        if (!sameFastStatistics(*this, what, myFastStats, readFastStats)) return;
+        if (!sameHistogram(*this, what, myHist, readHist)) return;
+        const string written = myStream.str();
+        for (size_t length = 0; length < written.size(); length += max(size_t(1), written.size() / 17))
+        {
+            istringstream truncated(written.substr(0, length));
+            FastStatistics truncFastStats;
+            Histogram truncHist;
+            if (truncFastStats.readBinary(truncated) && truncHist.readBinary(truncated))
+            {
+                setFailed(what + ": reading succeeded on data truncated to " + AString::number(length) + " bytes");
+                return;
+            }
+        }
+    }
+}
+
+StatisticsCacheTest::StatisticsCacheTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void StatisticsCacheTest::execute()
+{
+    const AString dataName = QDir::tempPath() + "/wb_statisticscache_test.dscalar.nii";
+    const AString cacheName = CiftiMapStatisticsCache::getCacheFileName(dataName);
+    try
+    {
+        const int64_t numRows = 40, numColumns = 3, size = 12345, modified = 1234567890123LL;
+        CiftiMapStatisticsCache::Statistics stored = makeStatistics(numColumns, numRows), loaded;
+        QFile::remove(cacheName);
+        if (CiftiMapStatisticsCache::load(dataName, size, modified, numRows, numColumns, numColumns, loaded))
+        {
+            setFailed("cache was loaded when there is no cache file");
+        }
+        CiftiMapStatisticsCache::store(dataName, size, modified, numRows, numColumns, stored);
+        if (!CiftiMapStatisticsCache::load(dataName, size, modified, numRows, numColumns, numColumns, loaded))
+        {
+            setFailed("cache was not loaded after it was stored");
+            QFile::remove(cacheName);
+            return;
+        }
+        for (int64_t i = 0; i < numColumns; ++i)
+        {
+            const AString what = "cached map " + AString::number(i);
+            if ((stored.m_mapFastStatistics[i] == NULL) != (loaded.m_mapFastStatistics[i] == NULL) || loaded.m_mapHistograms[i] == NULL)
+            {
+                setFailed(what + ": wrong statistics are present");
+                continue;
+            }
+            if (stored.m_mapFastStatistics[i] != NULL) sameFastStatistics(*this, what, *(stored.m_mapFastStatistics[i]), *(loaded.m_mapFastStatistics[i]));
+            sameHistogram(*this, what, *(stored.m_mapHistograms[i]), *(loaded.m_mapHistograms[i]));
+        }
+        if (loaded.m_fileFastStatistics == NULL || loaded.m_fileHistogram != NULL)
+        {
+            setFailed("wrong file statistics are present in the cache");
+        } else {
+            sameFastStatistics(*this, "cached file statistics", *(stored.m_fileFastStatistics), *(loaded.m_fileFastStatistics));
+        }
+        if (CiftiMapStatisticsCache::load(dataName, size + 1, modified, numRows, numColumns, numColumns, loaded))
+        {
+            setFailed("cache was used after the data file size changed");
+        }
+        if (CiftiMapStatisticsCache::load(dataName, size, modified + 1000, numRows, numColumns, numColumns, loaded))
+        {
+            setFailed("cache was used after the data file modification time changed");
+        }
+        if (CiftiMapStatisticsCache::load(dataName, size, modified, numRows + 1, numColumns, numColumns, loaded) ||
+            CiftiMapStatisticsCache::load(dataName, size, modified, numRows, numColumns, numColumns - 1, loaded))
+        {
+            setFailed("cache was used for different dimensions");
+        }
+        QByteArray contents;
+        {
+            QFile cacheFile(cacheName);
+            if (!cacheFile.open(QIODevice::ReadOnly)) throw CaretException("failed to open '" + cacheName + "'");
+            contents = cacheFile.readAll();
+        }
+        const int truncateTo[] = { 0, 20, contents.size() / 2, contents.size() - 1 };
+        for (int i = 0; i < 4; ++i)
+        {
+            QFile cacheFile(cacheName);
+            if (!cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) throw CaretException("failed to open '" + cacheName + "'");
+            cacheFile.write(contents.constData(), truncateTo[i]);
+            cacheFile.close();
+            if (CiftiMapStatisticsCache::load(dataName, size, modified, numRows, numColumns, numColumns, loaded))
+            {
+                setFailed("cache file truncated to " + AString::number(truncateTo[i]) + " bytes was used");
+            }
+        }
+        {
+            QByteArray corrupted = contents;
+            corrupted[0] = (char)(corrupted.at(0) ^ 0xff);
+            QFile cacheFile(cacheName);
+            if (!cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) throw CaretException("failed to open '" + cacheName + "'");
+            cacheFile.write(corrupted);
+            cacheFile.close();
+            if (CiftiMapStatisticsCache::load(dataName, size, modified, numRows, numColumns, numColumns, loaded))
+            {
+                setFailed("cache file with a corrupted header was used");
+            }
+        }
+        QFile::remove(cacheName);
+        const AString remoteName = "http://localhost/wb_statisticscache_test.dscalar.nii";
+        CiftiMapStatisticsCache::store(remoteName, size, modified, numRows, numColumns, stored);
+        if (CiftiMapStatisticsCache::load(remoteName, size, modified, numRows, numColumns, numColumns, loaded))
+        {
+            setFailed("cache was used for a remote file");
+        }
+        
+        //background thread, with maps as columns and as rows
+        {
+            CiftiFile myFile;
+            CiftiXML myXML;
+            myXML.setNumberOfDimensions(2);
+            CiftiScalarsMap rowMap, colMap;
+            rowMap.setLength(numColumns);
+            colMap.setLength(numRows);
+            myXML.setMap(CiftiXML::ALONG_ROW, rowMap);
+            myXML.setMap(CiftiXML::ALONG_COLUMN, colMap);
+            myFile.setCiftiXML(myXML);
+            vector<vector<float> > columns(numColumns);
+            for (int64_t j = 0; j < numColumns; ++j) columns[j] = makeSpecialData(j, numRows);
+            vector<float> row(numColumns);
+            for (int64_t i = 0; i < numRows; ++i)
+            {
+                for (int64_t j = 0; j < numColumns; ++j) row[j] = columns[j][i];
+                myFile.setRow(row.data(), i);
+            }
+            myFile.writeFile(dataName);
+        }
+        FileInformation dataInfo(dataName);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const bool mapsAreColumns = (pass == 0);
+            const int64_t numMaps = (mapsAreColumns ? numColumns : numRows);
+            const AString what = (mapsAreColumns ? "background statistics of columns" : "background statistics of rows");
+            QFile::remove(cacheName);
+            {
+                CiftiMapStatisticsThread myThread(dataName, dataInfo.size(), dataInfo.getLastModifiedMilliseconds(), numMaps, mapsAreColumns);
+                myThread.start();
+                myThread.wait();
+                CiftiFile myFile;
+                myFile.openFile(dataName);
+                vector<float> mapData(mapsAreColumns ? numRows : numColumns);
+                for (int64_t m = 0; m < numMaps; ++m)
+                {
+                    if (mapsAreColumns)
+                    {
+                        myFile.getColumn(mapData.data(), m);
+                    } else {
+                        myFile.getRow(mapData.data(), m);
+                    }
+                    FastStatistics expectFastStats(mapData.data(), mapData.size());
+                    Histogram expectHist;
+                    expectHist.update(mapData.data(), mapData.size());
+                    CaretPointer<FastStatistics> fastStats;
+                    CaretPointer<Histogram> hist;
+                    myThread.getMapStatistics(m, fastStats, hist);
+                    if (fastStats == NULL || hist == NULL)
+                    {
+                        setFailed(what + ": map " + AString::number(m) + " was not computed");
+                        return;
+                    }
+                    if (!sameFastStatistics(*this, what, expectFastStats, *fastStats)) return;
+                    if (!sameHistogram(*this, what, expectHist, *hist)) return;
+                }
+            }
+            if (!CiftiMapStatisticsCache::load(dataName, dataInfo.size(), dataInfo.getLastModifiedMilliseconds(), numRows, numColumns, numMaps, loaded))
+            {
+                setFailed(what + ": cache was not stored");
+            }
+            {//a thread for a file that changed since it was loaded computes nothing
+                CiftiMapStatisticsThread myThread(dataName, dataInfo.size() + 1, dataInfo.getLastModifiedMilliseconds(), numMaps, mapsAreColumns);
+                myThread.start();
+                myThread.wait();
+                CaretPointer<FastStatistics> fastStats;
+                CaretPointer<Histogram> hist;
+                myThread.getMapStatistics(0, fastStats, hist);
+                if (fastStats != NULL || hist != NULL)
+                {
+                    setFailed(what + ": statistics were computed for a file that changed");
+                }
+            }
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    QFile::remove(cacheName);
+    QFile::remove(dataName);
+}
@@ -31,5 +31,19 @@ namespace caret {
       virtual void execute();
    };
 
+   class StatisticsBinaryTest : public TestInterface
+   {
+   public:
+      StatisticsBinaryTest(const AString& identifier);
+      virtual void execute();
+   };
+
+   class StatisticsCacheTest : public TestInterface
+   {
+   public:
+      StatisticsCacheTest(const AString& identifier);
+      virtual void execute();
+   };
+
 }
 #endif //__STATISTICS_TEST_H__
@@ -0,0 +1,232 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "SurfaceWeightCacheTest.h"
+
+#include "CaretOMP.h"
+#include "SparseMatrixCSR.h"
+#include "SurfaceWeightCache.h"
+
+#include <cstring>
+#include <vector>
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    class SimpleRandom
+    {
+        uint32_t m_state;
+    public:
+        SimpleRandom(const uint32_t& seed) { m_state = seed; }
+        uint32_t next()
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return m_state >> 8;
+        }
+    };
+    
+    //layout of a cache file: 80 byte header, then row starts (int64), then indices (int32), then weights (float)
+    const int HEADER_BYTES = 80;
+    
+    void makeRandomMatrix(SimpleRandom& myRandom, const int64_t& numRows, const int64_t& numColumns, SparseMatrixCSR& matrixOut)
+    {
+        vector<int64_t> rowStarts(1, 0);
+        vector<int32_t> indices;
+        vector<float> values;
+        for (int64_t row = 0; row < numRows; ++row)
+        {
+            int numEntries = myRandom.next() % 7;//includes empty rows
+            for (int j = 0; j < numEntries; ++j)
+            {
+                indices.push_back(myRandom.next() % numColumns);
+                values.push_back((myRandom.next() % 10000) / 3333.0f);
+            }
+            rowStarts.push_back(indices.size());
+        }
+        matrixOut.swapIn(numColumns, rowStarts, indices, values);
+    }
+    
+    bool sameMatrix(const SparseMatrixCSR& left, const SparseMatrixCSR& right)
+    {
+        return left.getNumberOfColumns() == right.getNumberOfColumns() && left.getRowStarts() == right.getRowStarts() &&
+               left.getIndices() == right.getIndices() && left.getValues() == right.getValues();
+    }
+    
+    void writeBytes(const AString& fileName, const QByteArray& bytes)
+    {
+        QFile myFile(fileName);
+        myFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        myFile.write(bytes);
+        myFile.close();
+    }
+}
+
+SurfaceWeightCacheTest::SurfaceWeightCacheTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void SurfaceWeightCacheTest::execute()
+{
+    const AString oldDirectory = SurfaceWeightCache::getCacheDirectory();
+    const AString cacheDir = QDir::tempPath() + "/wb_surfaceweightcache_test";
+    SurfaceWeightCache::setCacheDirectory(cacheDir);
+    const int64_t numRows = 300, numColumns = 250;
+    SimpleRandom myRandom(7);
+    SparseMatrixCSR original;
+    makeRandomMatrix(myRandom, numRows, numColumns, original);
+    SurfaceWeightCache::Key myKey("SurfaceWeightCacheTest v1"), otherKey("SurfaceWeightCacheTest v1");
+    myKey.addInt(numRows);
+    myKey.addFloat(2.5f);
+    otherKey.addInt(numRows);
+    otherKey.addFloat(2.6f);
+    if (myKey.getHashString() == otherKey.getHashString())
+    {
+        setFailed("different key inputs gave the same hash");
+    }
+    const AString fileName = cacheDir + "/" + myKey.getHashString() + ".wbweights";
+    const AString otherFileName = cacheDir + "/" + otherKey.getHashString() + ".wbweights";
+    QFile::remove(fileName);//in case a previous run left them
+    QFile::remove(otherFileName);
+    SparseMatrixCSR loaded;
+    //miss
+    if (SurfaceWeightCache::load(myKey, numRows, numColumns, loaded))
+    {
+        setFailed("load succeeded with no cache entry");
+    }
+    if (loaded.getNumberOfRows() != 0 || loaded.getNumberOfEntries() != 0)
+    {
+        setFailed("failed load modified the output matrix");
+    }
+    //store, then hit
+    SurfaceWeightCache::store(myKey, original);
+    if (!QFileInfo(fileName).exists())
+    {
+        setFailed("store did not create cache file '" + fileName + "'");
+        SurfaceWeightCache::setCacheDirectory(oldDirectory);
+        return;
+    }
+    if (!SurfaceWeightCache::load(myKey, numRows, numColumns, loaded))
+    {
+        setFailed("load of stored weights failed");
+    } else if (!sameMatrix(original, loaded)) {
+        setFailed("loaded weights differ from stored weights");
+    }
+    //callers load from inside parallel loops
+    int parallelFailures = 0;
+#pragma omp CARET_PARFOR
+    for (int i = 0; i < 16; ++i)
+    {
+        SparseMatrixCSR threadLoaded;
+        if (!SurfaceWeightCache::load(myKey, numRows, numColumns, threadLoaded) || !sameMatrix(original, threadLoaded))
+        {
+#pragma omp critical
+            ++parallelFailures;
+        }
+    }
+    if (parallelFailures != 0)
+    {
+        setFailed(AString::number(parallelFailures) + " parallel loads failed or differed");
+    }
+    //stale: the caller expects different dimensions
+    SparseMatrixCSR unchanged;
+    if (SurfaceWeightCache::load(myKey, numRows + 1, numColumns, unchanged) || SurfaceWeightCache::load(myKey, numRows, numColumns - 1, unchanged))
+    {
+        setFailed("load succeeded with mismatched dimensions");
+    }
+    //different inputs are a miss, even if a file with the right name exists
+    if (SurfaceWeightCache::load(otherKey, numRows, numColumns, unchanged))
+    {
+        setFailed("load succeeded for a key that was never stored");
+    }
+    QFile::copy(fileName, otherFileName);
+    if (SurfaceWeightCache::load(otherKey, numRows, numColumns, unchanged))
+    {
+        setFailed("load succeeded from a cache file whose contents have a different hash");
+    }
+    QFile::remove(otherFileName);
+    //corrupt entries are misses
+    QByteArray goodBytes;
+    {
+        QFile myFile(fileName);
+        myFile.open(QIODevice::ReadOnly);
+        goodBytes = myFile.readAll();
+        myFile.close();
+    }
+    const int64_t numEntries = original.getNumberOfEntries();
+    if (goodBytes.size() != HEADER_BYTES + (numRows + 1) * 8 + numEntries * 8)
+    {
+        setFailed("cache file has unexpected size " + AString::number(goodBytes.size()));
+    } else {
+        vector<QByteArray> corruptions;
+        vector<AString> descriptions;
+        corruptions.push_back(QByteArray());
+        descriptions.push_back("empty file");
+        corruptions.push_back(goodBytes.left(HEADER_BYTES - 1));
+        descriptions.push_back("truncated header");
+        corruptions.push_back(goodBytes.left(goodBytes.size() - 4));
+        descriptions.push_back("truncated data");
+        corruptions.push_back(goodBytes + QByteArray(4, '\0'));
+        descriptions.push_back("trailing data");
+        corruptions.push_back(goodBytes);
+        corruptions.back()[0] = 'X';
+        descriptions.push_back("wrong magic");
+        corruptions.push_back(goodBytes);
+        int64_t hugeEntries = ((int64_t)1) << 61;//would overflow the size computation
+        memcpy(corruptions.back().data() + 32, &hugeEntries, 8);
+        descriptions.push_back("huge entry count");
+        corruptions.push_back(goodBytes);
+        int64_t badStart = numEntries + 1;
+        memcpy(corruptions.back().data() + HEADER_BYTES + 8 * (numRows / 2), &badStart, 8);
+        descriptions.push_back("row starts out of order");
+        corruptions.push_back(goodBytes);
+        int32_t badIndex = numColumns;
+        memcpy(corruptions.back().data() + HEADER_BYTES + 8 * (numRows + 1) + 4 * (numEntries / 2), &badIndex, 4);
+        descriptions.push_back("index out of range");
+        for (size_t i = 0; i < corruptions.size(); ++i)
+        {
+            writeBytes(fileName, corruptions[i]);
+            if (SurfaceWeightCache::load(myKey, numRows, numColumns, unchanged))
+            {
+                setFailed("load succeeded from corrupt cache file: " + descriptions[i]);
+            }
+        }
+    }
+    if (unchanged.getNumberOfRows() != 0 || unchanged.getNumberOfEntries() != 0)
+    {
+        setFailed("failed load modified the output matrix");
+    }
+    //an empty directory disables the cache
+    writeBytes(fileName, goodBytes);
+    SurfaceWeightCache::setCacheDirectory("");
+    if (SurfaceWeightCache::isEnabled() || SurfaceWeightCache::load(myKey, numRows, numColumns, unchanged))
+    {
+        setFailed("cache was used after being disabled");
+    }
+    QFile::remove(fileName);
+    QDir().rmdir(cacheDir);
+    SurfaceWeightCache::setCacheDirectory(oldDirectory);
+}
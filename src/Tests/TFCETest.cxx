@@ -0,0 +1,361 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "TFCETest.h"
+
+#include "CaretAssert.h"
+#include "CaretHeap.h"
+#include "CaretPointer.h"
+#include "SurfaceFile.h"
+#include "TFCEHelper.h"
+#include "TopologyHelper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <vector>
+
+#include <QDir>
+#include <QFile>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    class SimpleRandom
+    {
+        uint32_t m_state;
+    public:
+        SimpleRandom(const uint32_t& seed) { m_state = seed; }
+        ///uniform in [low, high)
+        float next(const float& low, const float& high)
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return low + (high - low) * ((m_state >> 8) / 16777216.0f);
+        }
+    };
+    
+    //the set-based cluster tracking from AlgorithmMetricTFCE, before it moved to TFCEHelper, as the reference
+    struct Cluster
+    {
+        double accumVal, totalArea;
+        vector<int> members;
+        float lastVal;
+        bool first;
+        Cluster()
+        {
+            first = true;
+            accumVal = 0.0;
+            totalArea = 0.0;
+        }
+        void addMember(const int& node, const float& val, const float& area, const float& param_e, const float& param_h)
+        {
+            update(val, param_e, param_h);
+            members.push_back(node);
+            totalArea += area;
+        }
+        void update(const float& bottomVal, const float& param_e, const float& param_h)
+        {
+            if (first)
+            {
+                lastVal = bottomVal;
+                first = false;
+            } else {
+                if (bottomVal != lastVal)
+                {
+                    CaretAssert(bottomVal < lastVal);
+                    double integrated_h = param_h + 1.0f;
+                    double newSlice = pow(totalArea, (double)param_e) * (pow((double)lastVal, integrated_h) - pow((double)bottomVal, integrated_h)) / integrated_h;
+                    accumVal += newSlice;
+                    lastVal = bottomVal;
+                }
+            }
+        }
+    };
+    
+    int allocCluster(vector<Cluster>& clusterList, set<int>& deadClusters)
+    {
+        if (deadClusters.empty())
+        {
+            clusterList.push_back(Cluster());
+            return (int)(clusterList.size() - 1);
+        } else {
+            set<int>::iterator iter = deadClusters.begin();
+            int ret = *iter;
+            deadClusters.erase(iter);
+            clusterList[ret] = Cluster();
+            return ret;
+        }
+    }
+    
+    void referenceTfcePos(TopologyHelper* myHelper, const float* colData, double* accumData, const float* roiData, const float& param_e, const float& param_h, const float* areaData)
+    {
+        int numNodes = myHelper->getNumberOfNodes();
+        vector<int> membership(numNodes, -1);
+        vector<Cluster> clusterList;
+        set<int> deadClusters;
+        CaretSimpleMaxHeap<int, float> nodeHeap;
+        for (int i = 0; i < numNodes; ++i)
+        {
+            if ((roiData == NULL || roiData[i] > 0.0f) && colData[i] > 0.0f)
+            {
+                nodeHeap.push(i, colData[i]);
+            }
+        }
+        while (!nodeHeap.isEmpty())
+        {
+            float value;
+            int node = nodeHeap.pop(&value);
+            const vector<int32_t>& neighbors = myHelper->getNodeNeighbors(node);
+            int numNeigh = (int)neighbors.size();
+            set<int> touchingClusters;
+            for (int i = 0; i < numNeigh; ++i)
+            {
+                if (membership[neighbors[i]] != -1)
+                {
+                    touchingClusters.insert(membership[neighbors[i]]);
+                }
+            }
+            int numTouching = (int)touchingClusters.size();
+            switch (numTouching)
+            {
+                case 0:
+                {
+                    int newCluster = allocCluster(clusterList, deadClusters);
+                    clusterList[newCluster].addMember(node, value, areaData[node], param_e, param_h);
+                    membership[node] = newCluster;
+                    break;
+                }
+                case 1:
+                {
+                    int whichCluster = *(touchingClusters.begin());
+                    clusterList[whichCluster].addMember(node, value, areaData[node], param_e, param_h);
+                    membership[node] = whichCluster;
+                    accumData[node] -= clusterList[whichCluster].accumVal;
+                    break;
+                }
+                default:
+                {
+                    int mergedIndex = -1, biggestSize = 0;
+                    for (set<int>::iterator iter = touchingClusters.begin(); iter != touchingClusters.end(); ++iter)
+                    {
+                        if ((int)clusterList[*iter].members.size() > biggestSize)
+                        {
+                            mergedIndex = *iter;
+                            biggestSize = (int)clusterList[*iter].members.size();
+                        }
+                    }
+                    Cluster& mergedCluster = clusterList[mergedIndex];
+                    mergedCluster.update(value, param_e, param_h);
+                    for (set<int>::iterator iter = touchingClusters.begin(); iter != touchingClusters.end(); ++iter)
+                    {
+                        if (*iter != mergedIndex)
+                        {
+                            Cluster& thisCluster = clusterList[*iter];
+                            thisCluster.update(value, param_e, param_h);
+                            int numMembers = (int)thisCluster.members.size();
+                            double correctionVal = thisCluster.accumVal - mergedCluster.accumVal;
+                            for (int j = 0; j < numMembers; ++j)
+                            {
+                                accumData[thisCluster.members[j]] += correctionVal;
+                                membership[thisCluster.members[j]] = mergedIndex;
+                            }
+                            mergedCluster.members.insert(mergedCluster.members.end(), thisCluster.members.begin(), thisCluster.members.end());
+                            mergedCluster.totalArea += thisCluster.totalArea;
+                            deadClusters.insert(*iter);
+                            vector<int>().swap(clusterList[*iter].members);
+                        }
+                    }
+                    mergedCluster.addMember(node, value, areaData[node], param_e, param_h);
+                    accumData[node] -= mergedCluster.accumVal;
+                    membership[node] = mergedIndex;
+                    break;
+                }
+            }
+        }
+        int listSize = (int)clusterList.size();
+        for (int i = 0; i < listSize; ++i)
+        {
+            if (deadClusters.find(i) != deadClusters.end()) continue;
+            Cluster& thisCluster = clusterList[i];
+            thisCluster.update(0.0f, param_e, param_h);
+            int numMembers = (int)thisCluster.members.size();
+            for (int j = 0; j < numMembers; ++j)
+            {
+                accumData[thisCluster.members[j]] += thisCluster.accumVal;
+            }
+        }
+    }
+    
+    void referenceTfce(TopologyHelper* myHelper, const float* colData, float* outData, const float* roiData, const float& param_e, const float& param_h, const float* areaData)
+    {
+        int numNodes = myHelper->getNumberOfNodes();
+        vector<double> accum(numNodes, 0.0);
+        referenceTfcePos(myHelper, colData, accum.data(), roiData, param_e, param_h, areaData);
+        vector<float> negData(numNodes);
+        for (int i = 0; i < numNodes; ++i)
+        {
+            negData[i] = -colData[i];
+        }
+        referenceTfcePos(myHelper, negData.data(), accum.data(), roiData, param_e, param_h, areaData);
+        for (int i = 0; i < numNodes; ++i)
+        {
+            if (roiData == NULL || roiData[i] > 0.0f)
+            {
+                outData[i] = (float)(colData[i] < 0.0f ? -accum[i] : accum[i]);
+            } else {
+                outData[i] = 0.0f;
+            }
+        }
+    }
+}
+
+TFCETest::TFCETest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void TFCETest::execute()
+{
+    //a bumpy grid, with coarsely rounded data so that there are plateaus, and an roi with holes that splits clusters
+    const int gridSize = 24;
+    const int numNodes = gridSize * gridSize, numTris = 2 * (gridSize - 1) * (gridSize - 1);
+    SurfaceFile mySurf;
+    mySurf.setNumberOfNodesAndTriangles(numNodes, numTris);
+    mySurf.setStructure(StructureEnum::CORTEX_LEFT);
+    for (int i = 0; i < gridSize; ++i)
+    {
+        for (int j = 0; j < gridSize; ++j)
+        {
+            mySurf.setCoordinate(i * gridSize + j, i, j, sin(i * 0.5f) * cos(j * 0.4f));
+        }
+    }
+    int tri = 0;
+    for (int i = 0; i < gridSize - 1; ++i)
+    {
+        for (int j = 0; j < gridSize - 1; ++j)
+        {
+            const int corner = i * gridSize + j;
+            mySurf.setTriangle(tri++, corner, corner + gridSize, corner + 1);
+            mySurf.setTriangle(tri++, corner + 1, corner + gridSize, corner + gridSize + 1);
+        }
+    }
+    CaretPointer<TopologyHelper> myTopoHelp = mySurf.getTopologyHelper();
+    SimpleRandom myRandom(2468);
+    vector<float> areas(numNodes), roi(numNodes);
+    vector<int32_t> vertexToElement(numNodes, -1);
+    for (int i = 0; i < numNodes; ++i)
+    {
+        areas[i] = myRandom.next(0.5f, 1.5f);
+        roi[i] = (myRandom.next(0.0f, 1.0f) < 0.9f ? 1.0f : 0.0f);
+        if (roi[i] > 0.0f) vertexToElement[i] = i;
+    }
+    const float params[3][2] = { { 1.0f, 2.0f }, { 0.5f, 2.0f }, { 2.0f, 0.5f } };
+    for (int p = 0; p < 3 && !failed(); ++p)
+    {
+        TFCEHelper myTFCE(numNodes);
+        myTFCE.addSurface(myTopoHelp, areas.data(), vertexToElement, params[p][0], params[p][1]);
+        for (int trial = 0; trial < 5 && !failed(); ++trial)
+        {
+            vector<float> data(numNodes), helperOut(numNodes), referenceOut(numNodes);
+            float center = myRandom.next(0.0f, gridSize);
+            for (int i = 0; i < numNodes; ++i)
+            {
+                float dist = (i / gridSize - center) * 0.3f;
+                data[i] = floor((4.0f * exp(-dist * dist) + myRandom.next(-3.0f, 3.0f)) * 4.0f) / 4.0f;//quarter steps make ties
+            }
+            myTFCE.compute(data.data(), helperOut.data());
+            referenceTfce(myTopoHelp, data.data(), referenceOut.data(), roi.data(), params[p][0], params[p][1], areas.data());
+            float maxAbs = 0.0f;
+            for (int i = 0; i < numNodes; ++i)
+            {
+                maxAbs = max(maxAbs, abs(referenceOut[i]));
+            }
+            for (int i = 0; i < numNodes; ++i)
+            {//summation order differs, so allow rounding
+                if (abs(helperOut[i] - referenceOut[i]) > 1e-5f * maxAbs)
+                {
+                    setFailed("TFCE of vertex " + AString::number(i) + " with E = " + AString::number(params[p][0]) + ", H = " + AString::number(params[p][1]) +
+                              " is " + AString::number(helperOut[i]) + ", old implementation gives " + AString::number(referenceOut[i]));
+                    break;
+                }
+                if (roi[i] <= 0.0f && helperOut[i] != 0.0f)
+                {
+                    setFailed("TFCE of vertex outside the roi is nonzero");
+                    break;
+                }
+            }
+        }
+    }
+    //one-sample t with a mean that is large compared to the spread, against two passes in double
+    const int numMaps = 12, numElements = 50;
+    vector<vector<float> > mapData(numMaps, vector<float>(numElements));
+    vector<const float*> maps(numMaps);
+    vector<float> signs(numMaps);
+    for (int m = 0; m < numMaps; ++m)
+    {
+        for (int i = 0; i < numElements; ++i)
+        {
+            mapData[m][i] = 10000.0f + i + myRandom.next(-1.0f, 1.0f);
+        }
+        maps[m] = mapData[m].data();
+        signs[m] = (m % 3 == 0 ? -1.0f : 1.0f);
+    }
+    vector<float> tMap(numElements);
+    TFCEHelper::oneSampleT(maps, signs, numElements, tMap.data());
+    for (int i = 0; i < numElements && !failed(); ++i)
+    {
+        double mean = 0.0, sumSquareDiff = 0.0;
+        for (int m = 0; m < numMaps; ++m) mean += signs[m] * mapData[m][i];
+        mean /= numMaps;
+        for (int m = 0; m < numMaps; ++m)
+        {
+            double diff = signs[m] * mapData[m][i] - mean;
+            sumSquareDiff += diff * diff;
+        }
+        double expected = mean / sqrt(sumSquareDiff / (numMaps - 1) / numMaps);
+        if (abs(tMap[i] - expected) > 1e-4 * abs(expected))
+        {
+            setFailed("one-sample t of element " + AString::number(i) + " is " + AString::number(tMap[i]) + ", expected " + AString::number(expected));
+        }
+    }
+    //the null distribution has to read back as the same floats
+    vector<float> nullDist(100);
+    for (int i = 0; i < 100; ++i)
+    {
+        nullDist[i] = myRandom.next(0.0f, 1.0f) * pow(10.0f, (float)(i % 9));
+    }
+    const AString nullName = QDir::tempPath() + "/wb_tfce_test_null.txt";
+    TFCEHelper::writeNullDistribution(nullName, nullDist);
+    ifstream nullIn(nullName.toLocal8Bit().constData());
+    for (int i = 0; i < 100 && !failed(); ++i)
+    {
+        float value;
+        if (!(nullIn >> value))
+        {
+            setFailed("failed to read back null distribution value " + AString::number(i));
+        } else if (value != nullDist[i]) {
+            setFailed("null distribution value " + AString::number(i) + " did not read back exactly");
+        }
+    }
+    nullIn.close();
+    QFile::remove(nullName);
+}
@@ -0,0 +1,193 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "VolumeResamplingTest.h"
+
+#include "AlgorithmVolumeAffineResample.h"
+#include "CaretException.h"
+#include "FloatMatrix.h"
+#include "VolumeFile.h"
+#include "VolumeResamplingStencil.h"
+#include "VolumeSpline.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    class SimpleRandom
+    {
+        uint32_t m_state;
+    public:
+        SimpleRandom(const uint32_t& seed) { m_state = seed; }
+        ///uniform in [low, high)
+        float next(const float& low, const float& high)
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return low + (high - low) * ((m_state >> 8) / 16777216.0f);
+        }
+    };
+    
+    AString methodName(const VolumeFile::InterpType& method)
+    {
+        switch (method)
+        {
+            case VolumeFile::CUBIC:
+                return "cubic";
+            case VolumeFile::TRILINEAR:
+                return "trilinear";
+            case VolumeFile::ENCLOSING_VOXEL:
+                return "enclosing voxel";
+        }
+        return "unknown";
+    }
+    
+    ///enclosing voxel and trilinear do the same float operations as interpolateValue, cubic sums the spline taps in a different order
+    bool sameSample(const VolumeFile::InterpType& method, const float& value, const float& expected)
+    {
+        if (method != VolumeFile::CUBIC || expected == VolumeFile::INVALID_INTERP_VALUE) return value == expected;
+        return abs(value - expected) <= 0.00001f * max(1.0f, abs(expected));
+    }
+}
+
+VolumeResamplingTest::VolumeResamplingTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void VolumeResamplingTest::execute()
+{
+    try
+    {
+        vector<int64_t> inDims(4);
+        inDims[0] = 11; inDims[1] = 9; inDims[2] = 7; inDims[3] = 3;
+        vector<vector<float> > inSform(3, vector<float>(4, 0.0f));
+        inSform[0][0] = 2.0f; inSform[0][1] = 0.3f; inSform[0][3] = -10.0f;
+        inSform[1][1] = 2.0f; inSform[1][3] = -8.0f;
+        inSform[2][0] = -0.2f; inSform[2][2] = 2.5f; inSform[2][3] = -7.0f;
+        VolumeFile inVol;
+        inVol.reinitialize(inDims, inSform);
+        SimpleRandom myRandom(2468);
+        for (int64_t b = 0; b < inDims[3]; ++b)
+        {
+            for (int64_t k = 0; k < inDims[2]; ++k)
+            {
+                for (int64_t j = 0; j < inDims[1]; ++j)
+                {
+                    for (int64_t i = 0; i < inDims[0]; ++i)
+                    {
+                        inVol.setValue(sin(i * 0.7f + b) * cos(j * 0.5f - k * 0.3f) * 10.0f + myRandom.next(-1.0f, 1.0f), i, j, k, b);
+                    }
+                }
+            }
+        }
+        const VolumeFile::InterpType methods[3] = { VolumeFile::ENCLOSING_VOXEL, VolumeFile::TRILINEAR, VolumeFile::CUBIC };
+        const int64_t numSamples = 3000;
+        vector<float> coords(numSamples * 3);
+        for (int64_t s = 0; s < numSamples; ++s)
+        {//some outside the volume, and some in the outer half voxel
+            coords[s * 3] = myRandom.next(-14.0f, 14.0f);
+            coords[s * 3 + 1] = myRandom.next(-11.0f, 11.0f);
+            coords[s * 3 + 2] = myRandom.next(-10.0f, 11.0f);
+        }
+        for (int m = 0; m < 3; ++m)
+        {
+            const VolumeFile::InterpType method = methods[m];
+            //one stencil for all samples, and the same samples split between two stencils that share deconvolved frames, like the chunks in -volume-resample
+            const int64_t firstHalf = numSamples / 2;
+            VolumeResamplingStencil wholeStencil(inVol.getVolumeSpace(), method, numSamples);
+            VolumeResamplingStencil lowStencil(inVol.getVolumeSpace(), method, firstHalf), highStencil(inVol.getVolumeSpace(), method, numSamples - firstHalf);
+            for (int64_t s = 0; s < numSamples; ++s)
+            {
+                wholeStencil.setSample(s, coords.data() + s * 3);
+                if (s < firstHalf)
+                {
+                    lowStencil.setSample(s, coords.data() + s * 3);
+                } else {
+                    highStencil.setSample(s - firstHalf, coords.data() + s * 3);
+                }
+            }
+            vector<float> wholeOut(numSamples), chunkedOut(numSamples);
+            for (int64_t b = 0; b < inDims[3]; ++b)
+            {
+                wholeStencil.resample(inVol.getFrame(b), wholeOut.data());
+                if (method == VolumeFile::CUBIC)
+                {
+                    VolumeSpline frameSpline(inVol.getFrame(b), inVol.getVolumeSpace().getDims());
+                    lowStencil.resample(frameSpline, chunkedOut.data());
+                    highStencil.resample(frameSpline, chunkedOut.data() + firstHalf);
+                } else {
+                    lowStencil.resample(inVol.getFrame(b), chunkedOut.data());
+                    highStencil.resample(inVol.getFrame(b), chunkedOut.data() + firstHalf);
+                }
+                for (int64_t s = 0; s < numSamples; ++s)
+                {
+                    const float expected = inVol.interpolateValue(coords.data() + s * 3, method, NULL, b);
+                    if (!sameSample(method, wholeOut[s], expected))
+                    {
+                        setFailed(methodName(method) + " stencil gave " + AString::number(wholeOut[s]) + " for sample " + AString::number(s) +
+                                  " of frame " + AString::number(b) + ", expected " + AString::number(expected));
+                        return;
+                    }
+                    if (chunkedOut[s] != wholeOut[s])
+                    {
+                        setFailed(methodName(method) + " split stencils differ from one stencil at sample " + AString::number(s) + " of frame " + AString::number(b));
+                        return;
+                    }
+                }
+            }
+            
+            //whole algorithm, with the identity transform so that source coordinates are exactly the reference space coordinates
+            const int64_t refDims[3] = { 13, 10, 8 };
+            vector<vector<float> > refSform(3, vector<float>(4, 0.0f));
+            refSform[0][0] = 1.7f; refSform[0][3] = -11.3f;
+            refSform[1][1] = 1.9f; refSform[1][2] = 0.1f; refSform[1][3] = -8.6f;
+            refSform[2][2] = 2.2f; refSform[2][3] = -7.9f;
+            VolumeFile outVol;
+            AlgorithmVolumeAffineResample(NULL, &inVol, FloatMatrix::identity(4), refDims, refSform, method, &outVol);
+            for (int64_t b = 0; b < inDims[3]; ++b)
+            {
+                for (int64_t k = 0; k < refDims[2]; ++k)
+                {
+                    for (int64_t j = 0; j < refDims[1]; ++j)
+                    {
+                        for (int64_t i = 0; i < refDims[0]; ++i)
+                        {
+                            float coord[3];
+                            outVol.indexToSpace(i, j, k, coord);
+                            const float expected = inVol.interpolateValue(coord, method, NULL, b);
+                            if (!sameSample(method, outVol.getValue(i, j, k, b), expected))
+                            {
+                                setFailed(methodName(method) + " resample gave " + AString::number(outVol.getValue(i, j, k, b)) + " at voxel (" +
+                                          AString::number(i) + ", " + AString::number(j) + ", " + AString::number(k) + ") of frame " + AString::number(b) +
+                                          ", expected " + AString::number(expected));
+                                return;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+}
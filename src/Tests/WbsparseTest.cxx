@@ -0,0 +1,175 @@
+/*LICENSE_START*/
+/*
+ *  Copyright (C) 2016  Washington University School of Medicine
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/*LICENSE_END*/
+
+#include "WbsparseTest.h"
+#include "CaretException.h"
+#include "CaretSparseFile.h"
+#include "CiftiXML.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <limits>
+#include <vector>
+
+using namespace caret;
+using namespace std;
+
+namespace
+{
+    const int64_t NUM_COLS = 5000000;//more than 2^22, so index deltas need 4 byte varints
+    const int64_t NUM_ROWS = 37;//not a multiple of the 16 row blocks, so the last block is partial
+    
+    bool isSkipped(const int64_t& row)
+    {
+        return (row >= 1 && row <= 3) || (row > 5 && row % 7 == 3) || row == NUM_ROWS - 1;
+    }
+    
+    ///rows that aren't written are expected to be empty
+    void makeRow(const int64_t& row, vector<int64_t>& indices, vector<int64_t>& values)
+    {
+        indices.clear();
+        values.clear();
+        if (isSkipped(row)) return;
+        switch (row)
+        {
+            case 0://written but empty
+                return;
+            case 4:
+            {//index deltas and high value bits on both sides of each varint length boundary
+                const int64_t deltas[] = { 0, 127, 128, 16383, 16384, 2097151, 2097152, 0, 1, 126, 0 };//stored deltas are minus 1
+                const int64_t boundaryValues[] = { 1, 0x7FFFFFFFLL, 0x80000000LL, 0xFFFFFFFFLL, 1LL << 32, (127LL << 32) | 5, 128LL << 32, (16383LL << 32) | 0xFFFFFFFFLL,
+                                                   16384LL << 32, numeric_limits<int64_t>::max(), numeric_limits<int64_t>::min(), -1 };
+                int64_t index = -1;
+                for (int i = 0; i < 11; ++i)
+                {
+                    index += deltas[i] + 1;
+                    indices.push_back(index);
+                }
+                indices.push_back(NUM_COLS - 1);//last column
+                values.assign(boundaryValues, boundaryValues + 12);
+                return;
+            }
+            case 5:
+            {//negative values, and the first index not at 0
+                const int64_t negIndices[] = { 3, 4, 1000, 300000 };
+                const int64_t negValues[] = { -1, -2, -(1LL << 33), -0x80000000LL };
+                indices.assign(negIndices, negIndices + 4);
+                values.assign(negValues, negValues + 4);
+                return;
+            }
+            default:
+                break;
+        }
+        if (row % 5 == 0) return;//more written empty rows, some at block edges
+        int64_t count = (row * 13) % 23 + 1, index = (row * 7919) % 1000;
+        for (int64_t i = 0; i < count; ++i)
+        {
+            indices.push_back(index);
+            values.push_back((row * 1000003 + i * 7) * ((i % 3 == 0) ? -1 : 1) + (i % 4 == 1 ? (row << 32) : 0));
+            index += 1 + (i * i * 9173 + row) % 40000;
+        }
+    }
+    
+    void writeTestFile(const AString& fileName, const int32_t& version)
+    {
+        CiftiXML myXML;
+        myXML.setNumberOfDimensions(2);
+        CiftiScalarsMap rowMap, colMap;
+        rowMap.setLength(NUM_COLS);
+        colMap.setLength(NUM_ROWS);
+        myXML.setMap(CiftiXML::ALONG_ROW, rowMap);
+        myXML.setMap(CiftiXML::ALONG_COLUMN, colMap);
+        CaretSparseFileWriter myWriter(fileName, myXML, version);
+        vector<int64_t> indices, values;
+        for (int64_t row = 0; row < NUM_ROWS; ++row)
+        {
+            if (isSkipped(row)) continue;
+            makeRow(row, indices, values);
+            myWriter.writeRowSparse(row, indices, values);
+        }
+        myWriter.finish();
+    }
+}
+
+WbsparseRoundTripTest::WbsparseRoundTripTest(const AString& identifier) : TestInterface(identifier)
+{
+}
+
+void WbsparseRoundTripTest::execute()
+{
+    const AString fileNames[2] = { QDir::tempPath() + "/wb_wbsparse_test_v1.trajTEMP.wbsparse",
+                                   QDir::tempPath() + "/wb_wbsparse_test_v2.trajTEMP.wbsparse" };
+    try
+    {
+        vector<int64_t> expectIndices, expectValues, indices, values;
+        const int64_t requestList[] = { 36, 0, 17, 17, 5, 35, 4, 16, 31, 32, 2, 15 };//out of order, repeated, skipped, and on both sides of block edges
+        vector<int64_t> requests(requestList, requestList + 12);
+        for (int64_t row = 0; row < NUM_ROWS; ++row)
+        {
+            requests.push_back(row);
+        }
+        for (int32_t version = 1; version <= 2; ++version)
+        {//both versions are checked against the same rows, so they must match each other
+            const AString& fileName = fileNames[version - 1];
+            const AString which = "version " + AString::number(version) + ": ";
+            writeTestFile(fileName, version);
+            CaretSparseFile myFile(fileName);
+            if (myFile.getVersion() != version)
+            {
+                setFailed(which + "file read back as version " + AString::number(myFile.getVersion()));
+                continue;
+            }
+            if (myFile.getDimensions()[0] != NUM_COLS || myFile.getDimensions()[1] != NUM_ROWS)
+            {
+                setFailed(which + "dimensions did not round trip");
+                continue;
+            }
+            for (int64_t row = 0; row < NUM_ROWS; ++row)
+            {
+                makeRow(row, expectIndices, expectValues);
+                myFile.getRowSparse(row, indices, values);
+                if (indices != expectIndices || values != expectValues)
+                {
+                    setFailed(which + "row " + AString::number(row) + " did not round trip through getRowSparse");
+                }
+            }
+            vector<vector<int64_t> > manyIndices, manyValues;
+            myFile.getRowsSparse(requests, manyIndices, manyValues);
+            if (manyIndices.size() != requests.size() || manyValues.size() != requests.size())
+            {
+                setFailed(which + "getRowsSparse returned the wrong number of rows");
+                continue;
+            }
+            for (size_t i = 0; i < requests.size(); ++i)
+            {
+                myFile.getRowSparse(requests[i], indices, values);
+                if (manyIndices[i] != indices || manyValues[i] != values)
+                {
+                    setFailed(which + "getRowsSparse differs from getRowSparse for row " + AString::number(requests[i]));
+                }
+            }
+        }
+    } catch (CaretException& e) {
+        setFailed(e.whatString());
+    }
+    QFile::remove(fileNames[0]);
+    QFile::remove(fileNames[1]);
+}
@@ -33,7 +33,13 @@
 #include "CaretException.h"
 
 //tests
+#include "Base64Test.h"
+#include "BlockCompressedFileTest.h"
+#include "BlockedDotTest.h"
+#include "CiftiAlgorithmTest.h"
 #include "CiftiFileTest.h"
+#include "ClusterLabelingTest.h"
+#include "CommandTest.h"
 #include "DotTest.h"
 #include "GeodesicHelperTest.h"
 #include "HttpTest.h"
@@ -44,10 +50,17 @@
 #include "PointerTest.h"
 #include "ProgressTest.h"
 #include "QuatTest.h"
+#include "RayIntersectTest.h"
+#include "RowBlockPipelineTest.h"
+#include "SparseMatrixTest.h"
 #include "StatisticsTest.h"
+#include "SurfaceWeightCacheTest.h"
+#include "TFCETest.h"
 #include "TimerTest.h"
 #include "TopologyHelperTest.h"
 #include "VolumeFileTest.h"
+#include "VolumeResamplingTest.h"
+#include "WbsparseTest.h"
 #include "XnatTest.h"
 
 using namespace std;
@@ -69,7 +82,21 @@ int main(int argc, char** argv)
         caret_global_commandLine_init(argc, argv);
         SessionManager::createSessionManager(ApplicationTypeEnum::APPLICATION_TYPE_COMMAND_LINE);
         vector<TestInterface*> mytests;
+        mytests.push_back(new Base64Test("base64"));
+        mytests.push_back(new BlockCompressedFileTest("blockcompressedfile"));
+        mytests.push_back(new BlockedDotTest("blockeddot"));
+        mytests.push_back(new BlockedDotTest("blockeddotbench", true));//benchmark, run by hand, not part of ctest
+        mytests.push_back(new CiftiAverageDenseROITest("ciftiaveragedenseroi"));
+        mytests.push_back(new CiftiChunkedMapsTest("ciftichunkedmaps"));
         mytests.push_back(new CiftiFileTest("ciftifile"));
+        mytests.push_back(new CiftiRowAlgorithmsTest("ciftirowalgorithms"));
+        mytests.push_back(new CiftiTransposeTest("ciftitranspose"));
+        mytests.push_back(new CiftiColumnScrubTest("cifticolumnscrub"));
+        mytests.push_back(new CiftiColumnScrubTest("cifticolumnscrubbench", true));//benchmark, run by hand, not part of ctest
+        mytests.push_back(new ClusterLabelingTest("clusterlabeling"));
+        mytests.push_back(new CommandBatchScriptTest("commandbatchscript"));
+        mytests.push_back(new CommandInputCacheTest("commandinputcache"));
+        mytests.push_back(new CommandServerRequestTest("commandserverrequest"));
         mytests.push_back(new DotTest("dotsimd"));
         mytests.push_back(new GeodesicHelperTest("geohelp"));
         mytests.push_back(new HeapTest("heap"));
@@ -78,13 +105,26 @@ int main(int argc, char** argv)
         mytests.push_back(new MathExpressionTest("mathexpression"));
         mytests.push_back(new NiftiFileTest("niftifile"));
         mytests.push_back(new NiftiHeaderTest("niftiheader"));
+        mytests.push_back(new NiftiParallelReadTest("niftiparallelread"));
+        mytests.push_back(new NiftiGzipRoundTripTest("niftigziproundtrip"));
+        mytests.push_back(new NiftiGzipRoundTripTest("niftigzipthroughput", true));//benchmark, run by hand, not part of ctest
         mytests.push_back(new PointerTest("pointer"));
         mytests.push_back(new ProgressTest("progress"));
         mytests.push_back(new QuatTest("quaternion"));
+        mytests.push_back(new RowBlockPipelineTest("rowblockpipeline"));
+        mytests.push_back(new SurfaceRayIntersectTest("surfacerayintersect"));
+        mytests.push_back(new VolumeRayIntersectTest("volumerayintersect"));
+        mytests.push_back(new SparseMatrixTest("sparsematrix"));
         mytests.push_back(new StatisticsTest("statistics"));
+        mytests.push_back(new StatisticsBinaryTest("statisticsbinary"));
+        mytests.push_back(new StatisticsCacheTest("statisticscache"));
+        mytests.push_back(new SurfaceWeightCacheTest("surfaceweightcache"));
+        mytests.push_back(new TFCETest("tfce"));
         mytests.push_back(new TimerTest("timer"));
         mytests.push_back(new TopologyHelperTest("topohelp"));
         mytests.push_back(new VolumeFileTest("volumefile"));
+        mytests.push_back(new VolumeResamplingTest("volumeresampling"));
+        mytests.push_back(new WbsparseRoundTripTest("wbsparseroundtrip"));
         mytests.push_back(new XnatTest("xnat"));
         if (argc < 2)
         {
@@ -296,6 +296,31 @@ XmlWriter::writeElementNoSpace(const AString& localName, const AString& text) {
    this->writeTextToOutputStream("</" + localName + ">\n");
 }
 
+/**
+ * Write the start tag of an element with no spacing after the tag.
+ * The caller writes the element's text directly to the output stream,
+ * which is useful for large text, and then calls writeEndElementNoSpace().
+ *
+ * @param localName - local name of tag to write.
+ * @throws XmlAttributes if an I/O error occurs.
+ */
+void
+XmlWriter::writeStartElementNoSpace(const AString& localName) {
+   this->writeIndentation();
+   this->writeTextToOutputStream("<" + localName + ">");
+}
+
+/**
+ * Write the end tag of an element started with writeStartElementNoSpace().
+ *
+ * @param localName - local name of tag to write.
+ * @throws XmlAttributes if an I/O error occurs.
+ */
+void
+XmlWriter::writeEndElementNoSpace(const AString& localName) {
+   this->writeTextToOutputStream("</" + localName + ">\n");
+}
+
 /**
  * Writes a start tag to the output.
  *
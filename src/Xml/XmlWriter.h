@@ -79,6 +79,11 @@ namespace caret {
                                const AString& text);
         
         void writeElementNoSpace(const AString& localName, const AString& text);
+        
+        void writeStartElementNoSpace(const AString& localName);
+        
+        void writeEndElementNoSpace(const AString& localName);
+        
         void writeStartElement(const AString& localName);
         
         void writeStartElement(const AString& localName,